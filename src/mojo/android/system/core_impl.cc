@@ -106,7 +106,7 @@ static ScopedJavaLocalRef<jobject> CreateMessagePipe(
     DCHECK(buffer_start);
     DCHECK_EQ(reinterpret_cast<const uintptr_t>(buffer_start) % 8, 0u);
     const size_t buffer_size = env->GetDirectBufferCapacity(options_buffer);
-    DCHECK_EQ(buffer_size, sizeof(MojoCreateMessagePipeOptions));
+    DCHECK_LE(buffer_size, sizeof(MojoCreateMessagePipeOptions));
     options = static_cast<const MojoCreateMessagePipeOptions*>(buffer_start);
     DCHECK_EQ(options->struct_size, buffer_size);
   }
@@ -6,17 +6,29 @@
 
 #include <utility>
 
+#include "base/bind.h"
 #include "base/callback.h"
 #include "base/logging.h"
 #include "base/memory/weak_ptr.h"
+#include "base/message_loop/message_loop.h"
 #include "base/time/time.h"
 #include "base/trace_event/trace_config.h"
 #include "base/trace_event/trace_event.h"
 
 namespace mojo {
 
+namespace {
+
+const int kCounterSamplingIntervalMs = 100;
+
+}  // namespace
+
 TraceProviderImpl::TraceProviderImpl()
-    : binding_(this), tracing_forced_(false), weak_factory_(this) {}
+    : binding_(this),
+      tracing_forced_(false),
+      sampling_(false),
+      sampling_weak_factory_(this),
+      weak_factory_(this) {}
 
 TraceProviderImpl::~TraceProviderImpl() {}
 
@@ -41,10 +53,12 @@ void TraceProviderImpl::StartTracing(
                                        base::trace_event::RECORD_UNTIL_FULL),
         base::trace_event::TraceLog::RECORDING_MODE);
   }
+  StartSampling();
 }
 
 void TraceProviderImpl::StopTracing() {
   DCHECK(recorder_);
+  StopSampling();
   base::trace_event::TraceLog::GetInstance()->SetDisabled();
 
   base::trace_event::TraceLog::GetInstance()->Flush(
@@ -56,6 +70,7 @@ void TraceProviderImpl::ForceEnableTracing() {
       base::trace_event::TraceConfig("*", base::trace_event::RECORD_UNTIL_FULL),
       base::trace_event::TraceLog::RECORDING_MODE);
   tracing_forced_ = true;
+  StartSampling();
   base::MessageLoop::current()->PostTask(
       FROM_HERE,
       base::Bind(&TraceProviderImpl::DelayedStop, weak_factory_.GetWeakPtr()));
@@ -76,12 +91,49 @@ void TraceProviderImpl::StopIfForced() {
   if (!tracing_forced_) {
     return;
   }
+  StopSampling();
   base::trace_event::TraceLog::GetInstance()->SetDisabled();
   base::trace_event::TraceLog::GetInstance()->Flush(
       base::Callback<void(const scoped_refptr<base::RefCountedString>&,
                           bool)>());
 }
 
+void TraceProviderImpl::SetCounterSampler(const base::Closure& sampler) {
+  counter_sampler_ = sampler;
+  if (counter_sampler_.is_null()) {
+    sampling_weak_factory_.InvalidateWeakPtrs();
+    sampling_ = false;
+  } else if (base::trace_event::TraceLog::GetInstance()->IsEnabled() &&
+             (recorder_ || tracing_forced_)) {
+    StartSampling();
+  }
+}
+
+void TraceProviderImpl::StartSampling() {
+  if (sampling_ || counter_sampler_.is_null())
+    return;
+  sampling_ = true;
+  SampleCounters();
+}
+
+void TraceProviderImpl::StopSampling() {
+  if (!sampling_)
+    return;
+  // Take a final sample, so that the trace has the values at the end.
+  counter_sampler_.Run();
+  sampling_weak_factory_.InvalidateWeakPtrs();
+  sampling_ = false;
+}
+
+void TraceProviderImpl::SampleCounters() {
+  DCHECK(sampling_);
+  counter_sampler_.Run();
+  base::MessageLoop::current()->PostDelayedTask(
+      FROM_HERE, base::Bind(&TraceProviderImpl::SampleCounters,
+                            sampling_weak_factory_.GetWeakPtr()),
+      base::TimeDelta::FromMilliseconds(kCounterSamplingIntervalMs));
+}
+
 void TraceProviderImpl::SendChunk(
     const scoped_refptr<base::RefCountedString>& events_str,
     bool has_more_events) {
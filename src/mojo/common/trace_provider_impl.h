@@ -5,6 +5,7 @@
 #ifndef MOJO_COMMON_TRACE_PROVIDER_IMPL_H_
 #define MOJO_COMMON_TRACE_PROVIDER_IMPL_H_
 
+#include "base/callback.h"
 #include "base/memory/ref_counted_memory.h"
 #include "base/memory/weak_ptr.h"
 #include "mojo/public/cpp/bindings/binding.h"
@@ -24,6 +25,11 @@ class TraceProviderImpl : public tracing::TraceProvider {
   // no TraceRecorder is sent within a set time.
   void ForceEnableTracing();
 
+  // Sets a callback to be run periodically while tracing is enabled (by this
+  // provider), e.g., to record counters using |TRACE_COUNTER*()|. It is also
+  // run once just before tracing is stopped. A null callback disables this.
+  void SetCounterSampler(const base::Closure& sampler);
+
  private:
   // tracing::TraceProvider implementation:
   void StartTracing(
@@ -38,10 +44,19 @@ class TraceProviderImpl : public tracing::TraceProvider {
   // Stop the collection of traces if no external connection asked for them yet.
   void StopIfForced();
 
+  // Start/stop running |counter_sampler_| periodically.
+  void StartSampling();
+  void StopSampling();
+  void SampleCounters();
+
   Binding<tracing::TraceProvider> binding_;
   bool tracing_forced_;
   tracing::TraceRecorderPtr recorder_;
+  base::Closure counter_sampler_;
+  bool sampling_;
 
+  // Only used for |SampleCounters()|; invalidated by |StopSampling()|.
+  base::WeakPtrFactory<TraceProviderImpl> sampling_weak_factory_;
   base::WeakPtrFactory<TraceProviderImpl> weak_factory_;
   DISALLOW_COPY_AND_ASSIGN(TraceProviderImpl);
 };
@@ -38,4 +38,8 @@ void TracingImpl::Initialize(Shell* shell,
 #endif
 }
 
+void TracingImpl::SetCounterSampler(const base::Closure& sampler) {
+  provider_impl_.SetCounterSampler(sampler);
+}
+
 }  // namespace mojo
@@ -8,6 +8,7 @@
 #include <string>
 #include <vector>
 
+#include "base/callback.h"
 #include "base/macros.h"
 #include "mojo/common/trace_provider_impl.h"
 
@@ -26,6 +27,9 @@ class TracingImpl {
   // to the applications "command line".
   void Initialize(Shell* shell, const std::vector<std::string>* args);
 
+  // See |TraceProviderImpl::SetCounterSampler()|.
+  void SetCounterSampler(const base::Closure& sampler);
+
  private:
   TraceProviderImpl provider_impl_;
 
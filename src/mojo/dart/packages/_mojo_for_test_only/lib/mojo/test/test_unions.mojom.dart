@@ -873,6 +873,145 @@ class SmallObjStruct extends bindings.Struct {
 }
 
 
+class StructOfUnionsAndInterfaces extends bindings.Struct {
+  static const List<bindings.StructDataHeader> kVersions = const [
+    const bindings.StructDataHeader(96, 0)
+  ];
+  ObjectUnion objectUnion = null;
+  HandleUnion handleUnion = null;
+  HandleUnion nullableHandleUnion = null;
+  UnionOfUnions unionOfUnions = null;
+  List<HandleUnion> handleUnions = null;
+  List<SmallCacheInterface> caches = null;
+  List<SmallCacheInterfaceRequest> cacheRequests = null;
+
+  StructOfUnionsAndInterfaces() : super(kVersions.last.size);
+
+  StructOfUnionsAndInterfaces.init(
+    ObjectUnion this.objectUnion, 
+    HandleUnion this.handleUnion, 
+    HandleUnion this.nullableHandleUnion, 
+    UnionOfUnions this.unionOfUnions, 
+    List<HandleUnion> this.handleUnions, 
+    List<SmallCacheInterface> this.caches, 
+    List<SmallCacheInterfaceRequest> this.cacheRequests
+  ) : super(kVersions.last.size);
+
+  static StructOfUnionsAndInterfaces deserialize(bindings.Message message) =>
+      bindings.Struct.deserialize(decode, message);
+
+  static StructOfUnionsAndInterfaces decode(bindings.Decoder decoder0) {
+    if (decoder0 == null) {
+      return null;
+    }
+    StructOfUnionsAndInterfaces result = new StructOfUnionsAndInterfaces();
+
+    var mainDataHeader = bindings.Struct.checkVersion(decoder0, kVersions);
+    if (mainDataHeader.version >= 0) {
+      
+        result.objectUnion = ObjectUnion.decode(decoder0, 8);
+        if (result.objectUnion == null) {
+          throw new bindings.MojoCodecError(
+            'Trying to decode null union for non-nullable ObjectUnion.');
+        }
+    }
+    if (mainDataHeader.version >= 0) {
+      
+        result.handleUnion = HandleUnion.decode(decoder0, 24);
+        if (result.handleUnion == null) {
+          throw new bindings.MojoCodecError(
+            'Trying to decode null union for non-nullable HandleUnion.');
+        }
+    }
+    if (mainDataHeader.version >= 0) {
+      
+        result.nullableHandleUnion = HandleUnion.decode(decoder0, 40);
+    }
+    if (mainDataHeader.version >= 0) {
+      
+        result.unionOfUnions = UnionOfUnions.decode(decoder0, 56);
+        if (result.unionOfUnions == null) {
+          throw new bindings.MojoCodecError(
+            'Trying to decode null union for non-nullable UnionOfUnions.');
+        }
+    }
+    if (mainDataHeader.version >= 0) {
+      
+      var decoder1 = decoder0.decodePointer(72, false);
+      {
+        var si1 = decoder1.decodeDataHeaderForUnionArray(bindings.kUnspecifiedArrayLength);
+        result.handleUnions = new List<HandleUnion>(si1.numElements);
+        for (int i1 = 0; i1 < si1.numElements; ++i1) {
+          
+            result.handleUnions[i1] = HandleUnion.decode(decoder1, bindings.ArrayDataHeader.kHeaderSize + bindings.kUnionSize * i1);
+            if (result.handleUnions[i1] == null) {
+              throw new bindings.MojoCodecError(
+                'Trying to decode null union for non-nullable HandleUnion.');
+            }
+        }
+      }
+    }
+    if (mainDataHeader.version >= 0) {
+      
+      result.caches = decoder0.decodeServiceInterfaceArray(80, bindings.kNothingNullable, SmallCacheProxy.newFromEndpoint, bindings.kUnspecifiedArrayLength);
+    }
+    if (mainDataHeader.version >= 0) {
+      
+      result.cacheRequests = decoder0.decodeInterfaceRequestArray(88, bindings.kNothingNullable, SmallCacheStub.newFromEndpoint, bindings.kUnspecifiedArrayLength);
+    }
+    return result;
+  }
+
+  void encode(bindings.Encoder encoder) {
+    var encoder0 = encoder.getStructEncoderAtOffset(kVersions.last);
+    const String structName = "StructOfUnionsAndInterfaces";
+    String fieldName;
+    try {
+      fieldName = "objectUnion";
+      encoder0.encodeUnion(objectUnion, 8, false);
+      fieldName = "handleUnion";
+      encoder0.encodeUnion(handleUnion, 24, false);
+      fieldName = "nullableHandleUnion";
+      encoder0.encodeUnion(nullableHandleUnion, 40, true);
+      fieldName = "unionOfUnions";
+      encoder0.encodeUnion(unionOfUnions, 56, false);
+      fieldName = "handleUnions";
+      if (handleUnions == null) {
+        encoder0.encodeNullPointer(72, false);
+      } else {
+        var encoder1 = encoder0.encodeUnionArray(handleUnions.length, 72, bindings.kUnspecifiedArrayLength);
+        for (int i0 = 0; i0 < handleUnions.length; ++i0) {
+          encoder1.encodeUnion(handleUnions[i0], bindings.ArrayDataHeader.kHeaderSize + bindings.kUnionSize * i0, false);
+        }
+      }
+      fieldName = "caches";
+      encoder0.encodeInterfaceArray(caches, 80, bindings.kNothingNullable, bindings.kUnspecifiedArrayLength);
+      fieldName = "cacheRequests";
+      encoder0.encodeInterfaceRequestArray(cacheRequests, 88, bindings.kNothingNullable, bindings.kUnspecifiedArrayLength);
+    } on bindings.MojoCodecError catch(e) {
+      bindings.Struct.fixErrorMessage(e, fieldName, structName);
+      rethrow;
+    }
+  }
+
+  String toString() {
+    return "StructOfUnionsAndInterfaces("
+           "objectUnion: $objectUnion" ", "
+           "handleUnion: $handleUnion" ", "
+           "nullableHandleUnion: $nullableHandleUnion" ", "
+           "unionOfUnions: $unionOfUnions" ", "
+           "handleUnions: $handleUnions" ", "
+           "caches: $caches" ", "
+           "cacheRequests: $cacheRequests" ")";
+  }
+
+  Map toJson() {
+    throw new bindings.MojoCodecError(
+        'Object containing handles cannot be encoded to JSON.');
+  }
+}
+
+
 class TryNonNullStruct extends bindings.Struct {
   static const List<bindings.StructDataHeader> kVersions = const [
     const bindings.StructDataHeader(24, 0)
@@ -3252,7 +3391,7 @@ mojom_types.RuntimeTypeInfo  _initRuntimeTypeInfo() {
   // serializedRuntimeTypeInfo contains the bytes of the Mojo serialization of
   // a mojom_types.RuntimeTypeInfo struct describing the Mojom types in this
   // file. The string contains the base64 encoding of the gzip-compressed bytes.
-  var serializedRuntimeTypeInfo = "H4sIAAAJbogC/+xdTXTbxhEGSVGWbDWm458wcdswTtMqSS3KP1XZtGnVZyuR0hdJjdyGfk0fBZGgKT2SYEgisdO+Vx9z7DFHH3v0MccefczRRx111NG3FgBnROxgFwBpcLGWjPfgNaghsPPNz87ODpZ5bXDkoF2Eln6O7QxpKd1BZtA+ss/z9vkdfP49tE+hfQZtITVol6FtQPsttP+B9gm0B9Dm0tBfaLeh/Rbax9A+hVaDfhWgfcs+X7fPO3c3Vyp/Wrn7QcvcMxf6Rq+/8Mf2Sttqwdd+bp8/5dPdtlqtB1v9rlXtB9Kt6u1a0/hLe9dsa9p7Ns0VPt1au9q0arvte3hP53jbPi/z6deNr+GmWuB9N3b2jGp/o918MCQP6u+AHmgDnr/RrA1vGEC3aXro3rHPn/Dptlp6s3lLrzYM++/vgoxEdHYnvTAF8ePSI/GSTbMQSrduttetZlPfOZKbYxfzgu8NvmK5nULkgvrv0m/UXboe9P99wJBDf6f7APrj4Tjg/u5919p9o1vXqwbc3+l7IYAeuxNA93lX73SM7qATpdTAvtHu51NDP+D8d3tqeO2Y4ONp9u+PXmH/Xj5Hri+w108usdf3C+T6yvDaMfGni+zznv2GvX7yIXu9/Al7nfuUvd7fIH+/yz5v9e9sf76vkfu3+P7yENpljT3QD5eg/R8clA4PB04HYnReeXgGdWv0+bP2mbVPp7tf2GfR6nWLTbOqN4v3TPNe0yg2zJZR/KarF51bXS/2ulX3f8WOtdPcrRZ3UdF6xZ3dtuO+ekXneYN/K5arVQvON1rIf9rzfPT/83itBR9RcVoVfP9HwO9Ha59t3QGfcYmD0wIQULxOQ/9l4RWGSyomXFB/tlZubazf1rQ37f+/xsMFCCguZyTjUiDxxwwAUUgH47FM8NgU4HEeeGIGeRi7LjK4sBQUlzX7PCURF/Q3M4TfEulXRot2iHDUPDh69VSkV/WKzUjJj88nCeOTJ7aUE8S1aGhx6RUTFHL1iqWg/fkAcJWFWwmeh/wuAh4lsLdVUKgyjPvbWb5fd/rvkOzHrGc5kGm90nBxo3j9FsY6mXrmPUQ4HET0414cUpzP8bgENlevtIxeT79nVDq7HcOvP78D/54EHqkAPDAeSo+AR9rj3+jxY/u84OJR0/u6C0alavfMahldnp1/CLaYBC7pCLhkRsAlMyIuna5Zs6p8XH6fIC6ZCPYzNQIuUwH249jEWReXXkPvGrXKjlWv25BQPP4AGCWBx5QAj6wHj+wIeGQD8LgIMbONhzM9rlRhfk7xWAY62fGfRvqBn78KsTqTVBgh/0Djy1yKzS9FjQPKIXpGkz6YlwpJC/nw/5eCcWbWk+ebdJw5C/3RBfg8hP+rop9oVwPpGkcZsoD8C0MaFsfmBTg8i2m+iPEWJiHfAJsTpCd9/fhGcvxK8w5aShyX8eZHk54H/UOy/Yr4nhozHhXxfRb4cvm+tuTj+5+gRzL1gFnPSMXrz2my3e/Puel4X7/+Jtk+qD8RxRf7E7KLmpNFuebH4QugUcVvi/JCUdeJJp1XYBZvuHkFloK3/idT75bBP5TIOsI8xFn3wRH/AI7pAALbwim1/Pc1Bfx3ymOfcfnvYV6l1+/anaJ8X1cwr+L1U6PmEcLHMddT+eR/45j5qbD55ah5CNH8Eudp9UobFlz54+FNkIFsfFMS8U1PIJ/h5HjmXHz1bld/AN7Lj++vEtRfhwfqt3n4ZCaQ3xjqX0vvHKHjx2cJsJSFzyLHvlOcfmVoPBHiFxG/6RHwmw7AD+2gXumYtQEXXPx+DXRJ+8c8GdewOCVq/cqk59NYVOOfTzPlNr5+fKXgfCGJOOxryXHYpPUBlc+vD4xa+vrximR96EA+qwHPL8PAuYn5UlCERRjYCuDAc+iIIJ4/hHYfFOuH2UH739NQ13dGLX07q0jeJhPzOuIwbnD4rpj9Bn9dKKcI/6cmFu9bruAp3+ck563C8nWjxuPj5uteVYTvmTHj5PB5ruUyTvk+L3meK+I7O2b8G0neN6775H1BEXnPjhm3RpP3jeuU74uKyJsMj5H4PhVV3ks3ffK+pIi8TxM7j8L3TGR5L92kfL+miLzTRN+j8D0bSd71pqn3ffLOKyLvFJF7FL5PR5J3zbQ76qsHe10ReWue+tmofJ+JFK/umGbTH6+9oUC85s3Pzo3A91wkvo2j+ncv35clyzss/0Dr9aO+jySqB8d1zLB5T9T1JFH9DNaNCcpmfLg34D5JzcfzJL/qrY/w1gOUM3x8D5+zXiUsb7Zl9Nfa/b/qTcvgzuN3tWTr6pH/XDo6384hqju8DLx7+L7aNb607L5w+cdDtfr56ZjrmkR6cg78ls1G5asjLeHryQVNvTp6kT3l0/HmK9CePg6xpz1F7OlQi9eePlbUnmbI+gVPX7x0k/Y/OH6xePU6dqeNl/5nfP+zB7Glav6H6hPGSY8y8cRJ+L4FfSm5AM8UvbZM8asmsG7hjX8epsT6lvU6akn6Zu7seVYT/fpWU7TegtZfRX3PXmTnmYD57ai4p55jncPQ1HlPL+3BXWTfq3Px1tUxmwhw6+pYCorfp5Lxo3V1uI9GDhTqO0icz8NA8hgSjOVZNfwArj+51VZO7RkAT3FdP2Z1QaPiPjOmHwjzv2w1hx/3DZRPwrg/bz0HD+90AN75MfBOa+Hvmx3hPajT8uG9CbqVBN5Yn5XlxOmaJHnMCORRGEMeQe9FYtyG1YgVIhgqlz9LnndHlYssOxG93zU/hlymIqxj9AT28RnE4qrbxyTHiUyA31ocQx5R3gsdmkdL73DGiS3Ia8uum0yRvEOejKeieb5Mv5YJ8GulMeQ1HeDXcJ8bjl9zBUfxuCN5Ph+X3OL2e0HzEMcfrQrmIfgey6OQvNUmmYd0BPLD/gZuUmYfV7XBO84RtzXz4fm5puZ7xLLzD2Hxb1k7HvXMUd8jpvqdj6jfq0S/twW443yau5me/fkvtMGeVCHb7vnkVHmpz5HyadsJzi948ZHofdpR97kcV7+PxuXZmPPEZPNHTp6YoaBympesz4ugrxiX/xtwyeM+r5BHKk0H67vsfSAsgZ6/ewLyxkHzsrjzxk4OyFEBvWJaPLzfA7+e5Htl48zLZMlj3HxSuDwaXHm8/4LKg+6XF3W/ZdG865kWbz4pTB4tgX38MqF5liZYT1bBXjIS80pD+fDt5eoxkc+49hMUP2U9cqPxE+6XNTM1WvxUDvCTTl/oZthXQD4h22X75Pplwuvt91NqxEs4b8S8EMWp+3J9Ldb1NVzXbJttZscDintPO177SYSt5+cF9YIanY9p8c7H6Gb5/vkYS0Hl5ICnQn3zHFHhsPezcR+A+5l4/QmOpyvVhsnrb1tLtv4S+S6PWE8YZs8Ov97CyxehjlDmOIP1Rbttp4yQrxe5E5xPjVsvcX0O9PKowPWlXvLXlU3LrW/l6uU7J0gvJ7U/Heoj82MzGu93JlgK2p83Nbn7WtD8J8btB2CnuN/904D97iexb2JYnrNwzPKcov2y9sl8YdL5zLdOWD4zDPe0pLzllROWtxTtf4a4ZyTlJ98+4fnJMDlMScpD/uyE5yFF67MPs/HGJ8yP3HHjE5aCyumW5LxiAfQR+4G/m3mYVqP+AOfHpmtUwxIEitttRfOMca5rBOGeiznPGLWOaUU7vnX8QXgXxlx3DdPzwa9PifX8I0X1fBLrQ946+/8HAAD//22WXrtoeAAA";
+  var serializedRuntimeTypeInfo = "H4sIAAAAAAAC/+xdzXPbxhV/JEVZtpWEcWSHidtGcZrW+bAkf0TVpF/K2LKldiqpltso03YgiARNqiSAkIQbdaZtpp1pPdMe/Cf46GOPOfqoo4866qijjr61A/AtiV3s4kvYpT6CQzaQH4l9v/f24X3tsgy9q4TjDI7s38k4xows3dWR3vgMACYA4Cn+/TmOezhCDulxXMTRxvEJjv/F8QWOBziW871xDsc6jk9w/AbHfRxLBaTHcR3HdwHgLQB48MXqgvbLhS8+bVlb1lTX6HSnPjMXTKeF0/0BAHyPT3fHabW217ptp9INpVvUzWrT+I3ZsEyADwHgCp9uyaw0nWrDfEi+073eA4DLfPpl40/4pRD6vSubW0alu2I2twfkYfPt0SNtyPNXmtXBF4bQrVo+uvcB4Lt8urWW3mze1it1AwA+QBmJ6FY2t/wwhfHj0RPiWQCYiqRbtsxlp9nUN/tyc9fHVcHneh9xvEkR5MLm79Gv1Dy6Ds4/bF4U/WdmdcnsGu2aXjE6AB8h9pzPPWhvIx8+pELm5X1//7vJugaAyRB6Mq0Qus/bum0b7d4k3PU+4bMbc7mBHcn57Ih77y7hxVH635+8Qv97uUTfv7hA35cu0veekvjp3xncu6Zh72P6efOf0Pc7c/T913fo+8l79P3zJfp+4z59v/sH+vk7Oj2/Z3Wa/qnNt7+7OM4DfRG7jtOG/+HF0pHrVQBwISdGsIzPYM0j+/yzAFAEgGUAuAsA023L6k63Ddua7rQr0+7Hp21ns9moTDf66ju92TBdg9eZdr+591/N8fRpyv0EPj/vfw/lBnoJqHNhV1w8FgWffwX5urt0f+0Bqs8lDh5TSMDicg7nnzUuUfznMuKf6MPawu2V5TsA7nJ5k8c/ErD8n5fE/yTjhxwA7SeI+J5n+F4V8P0Gzp16yeO76yLFP03B8u8u/zMS+Cf2YIzha455fgHiXSK8wIeXf92J9KSmNczuXBCHXyjCocysgZLAX92HbPWEcvK4ekJTsPP5FPHLGp85/N6+f4/rYyxPK8hLHPdH+PbVnaf7TzsZ600JZVfT6h4+LC4/xneLDL3xXyJ+X8S0p35+c5y/k+sSrpWa1jI6Hf2hodkN2wjqw0/QzsrkOxfCN/En8gn4zvvsD3t9B+PCmlbVu7rHtFaxzI7TMtq89flTXEMy+c/H4L+QgP9CQv7ttlV1Knz+f6aA/0IMvR9JwP9IiN67uvyax3+nrreNqrbp1GpGO8D3zxELmXyPCPgu+vguJuC7GML3RfQha1rHDS+1Csa3LN/zSCfLTwLmeeTvF9BHpYLvBHE664e9xHE9n+z9uh6hN2xyhORvItInAZz/PUR/rOjPg0n2x87ifHQBDv/B/1etb2Q99KRl9DNDIfkDijTK3ysL+N3LKB4i/gpJvr2Na0iQlgvM45+S/Dw2Tt4P8Wt4cYFs//9fktadiL+RlH6biL/XcP4ef9dnA/w9JnohQa7+5xxAtnaVTQ4H7So3fRyY1+8k6TW73kXv7R1J+lx1o/vrQX5/jzSq7acoLxG3TiE7DqaKB9w4mKbg1aFk6NE8rt/++xgNw0scZ9Ag2mg4bHQAn4weLTt6XaEdzfnWVVZ2dBDvd7rthvmQ5e/GEON9vx1JGvdGvzc8SxKQ581jakei4qekcbMofiLxSU0zsSDHf//cQqxl4ZhTiGNeQvw9AQDjHo56u61vo3UJ4viJAn1058raTx4OBQnx+ECfWrrdRyGIwyxiljUOM5x1meM8v8DcR9ktgtNoApxGQ3Aiel3TbKva44GL04+QTpX9KjPvEdJcELf/QHZcSJoignEh1S4RmMffh+g/D8OP+YckP0a2fIkyBeVLqVlgHq9Kkq+N+ZQ64RNfVJPowLzE8QUK+Bm+UL5Gg7qOBmPmDNaFUFH2cPzmLPrB546W/rymOJ9QyLgONHgfu/xpVrfOrwOUFPN5Rpr/63iCZPl7XVLeJCovlNQ/TZsXuqCYv7GUfmN0vOZ4DLL8vSEpXhPxV0zpD8aS380bAflNKJbf2ZR+XDz53bzB8ndRsfxGGTsTh78zceU3eysgv0uK5XeOWYdx+BuLLb/ZWyx/byqWX57R0zj8nY0lv1rT0rsB+ZUVyy/HyDEOf+diya9qOZvB/pa3FMsPfH15cfk7H8tP27SsZtB/eVuh/+LP340n4G88Fn9Gvx/Wz99lSfKLin/ZPt24+xlEfaMHMf33uPUAUV8B6YMRtBME8O3i98iOE8tM/s1fT/bXVcl+EhbH3UPW8aPyMGtGd8ns/lZvOgY3vnQU9dkSPvdy8flzL1Ff1GXk0cfftbbxpWN0ulw+yTWsftrRjPs3RHJ/He1Kw+xqj/pS58t9Yoh9taJ1sJ/LNl4m6+BexDp4pHgd7EK26+DekNfBGJOX5snf79/Ktg/kfUHj0rEts2N8ax+i7cMj9MGGZR9E+zTIPszD+hmkn5rdFDiJzxRtG2RxqkjMR/v9h3ouvD9wX7H+WJtbvupOUH+qQ65Ps/0kcfetJt0PU0qBb+4Q+WtjCPth8j58Revy8fls+4GozbfcfiCagsXpV5JwYvuByL7zPXT+VzGBuoOJxjlMWO2MHY31S+oHXleJ1ukDzOK3fEz7IpLiO5Zy/UbZR7r6HcR3BeWgCt/D1r95uOZDcC2nwDUfYx9IH9deP0oA11XUIZm4kj6UIsefBUW4HwhwmkyBe9j+I+IPkS4qjREAi/+vJcWVcfFXpfei/RhXU+A/EiPP3RHo+330ZY+Kvsu044UQezOTAvc4+68G6t7SbY4dX8P8qax+r1xIv1cxJI5VaY8KIfZoLoVcRkPsETlHgWOPPAGxeDyQFMdmJZ+s7VWYH+/akUWBH0/62u2I/XerjB9vC+RE5ht6OA4AXMM9gzGP0wng+fmQ9+Wpjruj/Mr1Y9ZXGXdfHquvEFNfFxl93RDgS+JL7qFMAPBD6J1hEnF8U0Ae2inTz6i80IYC/5znj4j2rSU9/yytvpL3oz2Wcf6SORSMk7+kKALn70nSzxnUP+LXfoWCIefrrWOeZLcYrr+q9z07Ar394ATlM8Pil6zzmePYU6hrlsPD9UO0uyr2jaSJX1ThnjZfEo17nYv7R0ccd/ZcpLjnZIrik72M8yVRuLcE+v6x5HgEBHXFo6D/BYV5k4Ec+Pp/7ZjJIe16CPNXij75iOLBxfMZx4Nhh5Ly48HQT7By3VJc9yH+zCL6M0/Rnylj3efxEav7WN4iHbjoLH5/PEF+Thi+pYzrPgTf3ml0YnybQ8Y3y/dqMeM6RNg5cCQ+7+f9GKBZnFtDrl9mjXOWee9CjDpbL6Vq1ZD9AL7mkM+Bog6RTnDedNI65nxKvySqruBXX957zDpF/nlYXLSYsq4T1V/jnafXCeJuS65fpsX9sOftJdX71ZR1m6jzSz3cNexQ5eD/5ZD1Pi8J/6i6zIbADyfnIj5P2Pe4HpJncOfCHvJ/BeOhiJ8BCMjrL4r6HzdyRyNPSOocxA9h8fjrt31Th/KfTcukTuxh8f3bMT33KKq/sizYFwFM/SAK76T1A/bHO4L1A5qClce24n1W4741wKvHsPiR821mCtnaAZJfWqjULZ6e/lnRfhLC39V8sn0TUevQ5cu/keQo7ZdQae+Jv9gwtUd6ky/n0imot2etZyQOQj3rb8w5rXpG+vwsx9uXw9Wz90+gnsk6V1SUJwj+Dg1Nwc7nHUnnL7H1ceLfkt+hK2E++asi/70m6/zaqDr45DHND4vOS8z6nNKoeve7J7TeHYVvXlFd+8oJzZuJzrkk+BYU1a/fOyX16yi8RxTVqb9/SurUon65yWK2/gD1o5Jcf4CmYOVxW1K+axL1izyP/K7t8/zxqh/fGXL+67jWj+P2dy+cgH2DYbimrRsfti5/95jWi8PiLP++vv8HAAD//zCmwei4ewAA";
 
   // Deserialize RuntimeTypeInfo
   var bytes = BASE64.decode(serializedRuntimeTypeInfo);
@@ -19,13 +19,22 @@ DataPipeDrainer::DataPipeDrainer(Client* client,
 DataPipeDrainer::~DataPipeDrainer() {}
 
 void DataPipeDrainer::ReadData() {
-  const void* buffer = nullptr;
-  uint32_t num_bytes = 0;
-  MojoResult rv = BeginReadDataRaw(source_.get(), &buffer, &num_bytes,
-                                   MOJO_READ_DATA_FLAG_NONE);
+  // Take all the available data, which may be in two spans if it wraps around
+  // the data pipe's buffer.
+  const void* buffers[2] = {};
+  uint32_t buffers_num_bytes[2] = {};
+  MojoResult rv = BeginReadDataSpansRaw(source_.get(), buffers,
+                                        buffers_num_bytes,
+                                        MOJO_READ_DATA_FLAG_NONE);
+  if (rv == MOJO_RESULT_UNIMPLEMENTED) {
+    rv = BeginReadDataRaw(source_.get(), &buffers[0], &buffers_num_bytes[0],
+                          MOJO_READ_DATA_FLAG_NONE);
+  }
   if (rv == MOJO_RESULT_OK) {
-    client_->OnDataAvailable(buffer, num_bytes);
-    EndReadDataRaw(source_.get(), num_bytes);
+    client_->OnDataAvailable(buffers[0], buffers_num_bytes[0]);
+    if (buffers_num_bytes[1])
+      client_->OnDataAvailable(buffers[1], buffers_num_bytes[1]);
+    EndReadDataRaw(source_.get(), buffers_num_bytes[0] + buffers_num_bytes[1]);
     WaitForData();
   } else if (rv == MOJO_RESULT_SHOULD_WAIT) {
     WaitForData();
@@ -7,9 +7,11 @@
 
 #include "mojo/edk/platform/simple_platform_shared_buffer.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>     // For |fileno()|.
-#include <sys/mman.h>  // For |mmap()|/|munmap()|.
+#include <sys/mman.h>  // For |mmap()|/|munmap()|/|madvise()|.
 #include <sys/stat.h>
 #include <sys/types.h>  // For |off_t|.
 #include <unistd.h>
@@ -30,6 +32,34 @@
 #include "third_party/ashmem/ashmem.h"
 #endif  // defined(OS_ANDROID)
 
+#if defined(OS_LINUX)
+#include <sys/syscall.h>  // For |SYS_memfd_create|.
+
+// These may be missing from older headers (memfd and file sealing were added in
+// Linux 3.17); the values are part of the kernel ABI.
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS (1024 + 9)
+#endif
+#ifndef F_GET_SEALS
+#define F_GET_SEALS (1024 + 10)
+#endif
+#ifndef F_SEAL_SEAL
+#define F_SEAL_SEAL 0x0001
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK 0x0002
+#endif
+#ifndef F_SEAL_GROW
+#define F_SEAL_GROW 0x0004
+#endif
+#endif  // defined(OS_LINUX)
+
 using mojo::util::RefPtr;
 
 // We assume that |size_t| and |off_t| (type for |ftruncate()|) fits in a
@@ -41,6 +71,96 @@ namespace mojo {
 namespace platform {
 namespace {
 
+// Mappings at least this big are advised to use (transparent) huge pages, to
+// reduce TLB misses.
+const size_t kHugePageAdviceThreshold = 2u * 1024u * 1024u;
+
+#if !defined(OS_ANDROID)
+
+#if defined(OS_LINUX) && defined(SYS_memfd_create)
+// Creates an anonymous memory file (using |memfd_create()|) of size |num_bytes|
+// and seals its size, so that whoever maps it need not worry about it being
+// truncated (and getting |SIGBUS|) by another process with a handle to it.
+// Returns an invalid handle on failure (e.g., if memfds aren't supported by the
+// kernel), in which case the caller should fall back to a temporary file.
+//
+// Note: Only the size is sealed, not the contents. |F_SEAL_WRITE| and
+// |F_SEAL_FUTURE_WRITE| would forbid all (new) writable mappings, including the
+// creator's, so any process with a handle may still modify the memory while
+// others read it. Receivers must not assume that it won't change under them.
+ScopedPlatformHandle CreateSizeSealedMemoryFile(size_t num_bytes) {
+  ScopedPlatformHandle handle(PlatformHandle(static_cast<int>(
+      syscall(SYS_memfd_create, "mojo_shared_buffer",
+              MFD_CLOEXEC | MFD_ALLOW_SEALING))));
+  if (!handle.is_valid()) {
+    DPLOG_IF(WARNING, errno != ENOSYS) << "memfd_create";
+    return ScopedPlatformHandle();
+  }
+
+  if (HANDLE_EINTR(
+          ftruncate(handle.get().fd, static_cast<off_t>(num_bytes))) != 0) {
+    PLOG(ERROR) << "ftruncate";
+    return ScopedPlatformHandle();
+  }
+
+  // Note: |fcntl()| with |F_ADD_SEALS| is not interruptible.
+  if (fcntl(handle.get().fd, F_ADD_SEALS,
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+    PLOG(ERROR) << "fcntl(F_ADD_SEALS)";
+    return ScopedPlatformHandle();
+  }
+
+  return handle;
+}
+#endif  // defined(OS_LINUX) && defined(SYS_memfd_create)
+
+// Creates an (unlinked) temporary file of size |num_bytes|. Returns an invalid
+// handle on failure.
+ScopedPlatformHandle CreateTemporaryFile(size_t num_bytes) {
+  base::ThreadRestrictions::ScopedAllowIO allow_io;
+
+  // TODO(vtl): This is stupid. The implementation of
+  // |CreateAndOpenTemporaryFileInDir()| starts with an FD, |fdopen()|s to get a
+  // |FILE*|, and then we have to |dup(fileno(fp))| to get back to an FD that we
+  // can own. (base/memory/shared_memory_posix.cc does this too, with more
+  // |fstat()|s thrown in for good measure.)
+  base::FilePath shared_buffer_dir;
+  if (!base::GetShmemTempDir(false, &shared_buffer_dir)) {
+    LOG(ERROR) << "Failed to get temporary directory for shared memory";
+    return ScopedPlatformHandle();
+  }
+  base::FilePath shared_buffer_file;
+  util::ScopedFILE fp(base::CreateAndOpenTemporaryFileInDir(
+      shared_buffer_dir, &shared_buffer_file));
+  if (!fp) {
+    LOG(ERROR) << "Failed to create/open temporary file for shared memory";
+    return ScopedPlatformHandle();
+  }
+  // Note: |unlink()| is not interruptible.
+  if (unlink(shared_buffer_file.value().c_str()) != 0) {
+    PLOG(WARNING) << "unlink";
+    // This isn't "fatal" (e.g., someone else may have unlinked the file first),
+    // so we may as well continue.
+  }
+
+  // Note: |dup()| is not interruptible (but |dup2()|/|dup3()| are).
+  ScopedPlatformHandle handle(PlatformHandle(dup(fileno(fp.get()))));
+  if (!handle.is_valid()) {
+    PLOG(ERROR) << "dup";
+    return ScopedPlatformHandle();
+  }
+
+  if (HANDLE_EINTR(
+          ftruncate(handle.get().fd, static_cast<off_t>(num_bytes))) != 0) {
+    PLOG(ERROR) << "ftruncate";
+    return ScopedPlatformHandle();
+  }
+
+  return handle;
+}
+
+#endif  // !defined(OS_ANDROID)
+
 // SimplePlatformSharedBufferMapping -------------------------------------------
 
 // An implementation of |PlatformSharedBufferMapping|, produced by
@@ -105,12 +225,22 @@ class SimplePlatformSharedBuffer final : public PlatformSharedBuffer {
   std::unique_ptr<PlatformSharedBufferMapping> MapNoCheck(
       size_t offset,
       size_t length) override;
+  std::unique_ptr<PlatformSharedBufferMapping> MapReadOnlyNoCheck(
+      size_t offset,
+      size_t length) override;
   ScopedPlatformHandle DuplicatePlatformHandle() override;
   ScopedPlatformHandle PassPlatformHandle() override;
 
  private:
   ~SimplePlatformSharedBuffer() override {}
 
+  // Implements |MapNoCheck()| and |MapReadOnlyNoCheck()|. |protection| is as
+  // for |mmap()|.
+  std::unique_ptr<PlatformSharedBufferMapping> MapNoCheckWithProtection(
+      size_t offset,
+      size_t length,
+      int protection);
+
   const size_t num_bytes_;
 
   // This is set in |Init()|/|InitFromPlatformHandle()| and never modified
@@ -144,43 +274,14 @@ bool SimplePlatformSharedBuffer::Init() {
     return false;
   }
 #else
-  base::ThreadRestrictions::ScopedAllowIO allow_io;
-
-  // TODO(vtl): This is stupid. The implementation of
-  // |CreateAndOpenTemporaryFileInDir()| starts with an FD, |fdopen()|s to get a
-  // |FILE*|, and then we have to |dup(fileno(fp))| to get back to an FD that we
-  // can own. (base/memory/shared_memory_posix.cc does this too, with more
-  // |fstat()|s thrown in for good measure.)
-  base::FilePath shared_buffer_dir;
-  if (!base::GetShmemTempDir(false, &shared_buffer_dir)) {
-    LOG(ERROR) << "Failed to get temporary directory for shared memory";
-    return false;
-  }
-  base::FilePath shared_buffer_file;
-  util::ScopedFILE fp(base::CreateAndOpenTemporaryFileInDir(
-      shared_buffer_dir, &shared_buffer_file));
-  if (!fp) {
-    LOG(ERROR) << "Failed to create/open temporary file for shared memory";
-    return false;
-  }
-  // Note: |unlink()| is not interruptible.
-  if (unlink(shared_buffer_file.value().c_str()) != 0) {
-    PLOG(WARNING) << "unlink";
-    // This isn't "fatal" (e.g., someone else may have unlinked the file first),
-    // so we may as well continue.
-  }
-
-  // Note: |dup()| is not interruptible (but |dup2()|/|dup3()| are).
-  handle.reset(PlatformHandle(dup(fileno(fp.get()))));
+// Prefer a sealed memfd on Linux (which also avoids touching the file system).
+#if defined(OS_LINUX) && defined(SYS_memfd_create)
+  handle = CreateSizeSealedMemoryFile(num_bytes_);
+#endif  // defined(OS_LINUX) && defined(SYS_memfd_create)
   if (!handle.is_valid()) {
-    PLOG(ERROR) << "dup";
-    return false;
-  }
-
-  if (HANDLE_EINTR(
-          ftruncate(handle.get().fd, static_cast<off_t>(num_bytes_))) != 0) {
-    PLOG(ERROR) << "ftruncate";
-    return false;
+    handle = CreateTemporaryFile(num_bytes_);
+    if (!handle.is_valid())
+      return false;
   }
 #endif  // defined(OS_ANDROID)
 
@@ -261,6 +362,27 @@ bool SimplePlatformSharedBuffer::IsValidMap(size_t offset, size_t length) {
 
 std::unique_ptr<PlatformSharedBufferMapping>
 SimplePlatformSharedBuffer::MapNoCheck(size_t offset, size_t length) {
+  return MapNoCheckWithProtection(offset, length, PROT_READ | PROT_WRITE);
+}
+
+std::unique_ptr<PlatformSharedBufferMapping>
+SimplePlatformSharedBuffer::MapReadOnlyNoCheck(size_t offset, size_t length) {
+  return MapNoCheckWithProtection(offset, length, PROT_READ);
+}
+
+ScopedPlatformHandle SimplePlatformSharedBuffer::DuplicatePlatformHandle() {
+  return handle_.Duplicate();
+}
+
+ScopedPlatformHandle SimplePlatformSharedBuffer::PassPlatformHandle() {
+  DCHECK(HasOneRef());
+  return std::move(handle_);
+}
+
+std::unique_ptr<PlatformSharedBufferMapping>
+SimplePlatformSharedBuffer::MapNoCheckWithProtection(size_t offset,
+                                                     size_t length,
+                                                     int protection) {
   DCHECK(IsValidMap(offset, length));
 
   long page_size = sysconf(_SC_PAGESIZE);
@@ -276,9 +398,8 @@ SimplePlatformSharedBuffer::MapNoCheck(size_t offset, size_t length) {
   DCHECK_LE(static_cast<uint64_t>(real_offset),
             static_cast<uint64_t>(std::numeric_limits<off_t>::max()));
 
-  void* real_base =
-      mmap(nullptr, real_length, PROT_READ | PROT_WRITE, MAP_SHARED,
-           handle_.get().fd, static_cast<off_t>(real_offset));
+  void* real_base = mmap(nullptr, real_length, protection, MAP_SHARED,
+                         handle_.get().fd, static_cast<off_t>(real_offset));
   // |mmap()| should return |MAP_FAILED| (a.k.a. -1) on error. But it shouldn't
   // return null either.
   if (real_base == MAP_FAILED || !real_base) {
@@ -286,6 +407,15 @@ SimplePlatformSharedBuffer::MapNoCheck(size_t offset, size_t length) {
     return nullptr;
   }
 
+#if defined(MADV_HUGEPAGE)
+  // This is only advice: it fails harmlessly (e.g., with |EINVAL|) if
+  // transparent huge pages aren't available (or aren't enabled for shared
+  // memory), so ignore the result. (Note that |MAP_HUGETLB| isn't an option
+  // here, since it requires hugetlbfs-backed memory.)
+  if (real_length >= kHugePageAdviceThreshold)
+    ignore_result(madvise(real_base, real_length, MADV_HUGEPAGE));
+#endif  // defined(MADV_HUGEPAGE)
+
   void* base = static_cast<char*>(real_base) + offset_rounding;
   // Note: We can't use |MakeUnique| here, since it's not a friend of
   // |SimplePlatformSharedBufferMapping| (only we are).
@@ -294,15 +424,6 @@ SimplePlatformSharedBuffer::MapNoCheck(size_t offset, size_t length) {
                                             real_length));
 }
 
-ScopedPlatformHandle SimplePlatformSharedBuffer::DuplicatePlatformHandle() {
-  return handle_.Duplicate();
-}
-
-ScopedPlatformHandle SimplePlatformSharedBuffer::PassPlatformHandle() {
-  DCHECK(HasOneRef());
-  return std::move(handle_);
-}
-
 }  // namespace
 
 // Public factory functions ----------------------------------------------------
@@ -39,6 +39,15 @@ struct Configuration {
   // message pipes. The default is 10,000.
   size_t max_message_num_handles;
 
+  // Default limits on the number of messages and the total number of bytes of
+  // message data queued (i.e., written but not yet read) on either end of a
+  // message pipe, if not specified explicitly in the creation options. Once a
+  // limit is reached, writes to the peer fail with |MOJO_RESULT_SHOULD_WAIT|
+  // until the queue drains. Zero means no limit. Values above 2^32 - 1 are
+  // treated as 2^32 - 1. The defaults are 0 (no limit).
+  size_t default_message_pipe_max_queued_messages;
+  size_t default_message_pipe_max_queued_num_bytes;
+
   // Maximum capacity of a data pipe, in bytes. The default is 256MB. This value
   // must fit into a |uint32_t|. WARNING: If you bump it closer to 2^32, you
   // must audit all the code to check that we don't overflow (2^31 would
@@ -54,6 +63,13 @@ struct Configuration {
   // default is 16 bytes.
   size_t data_pipe_buffer_alignment_bytes;
 
+  // Whether data pipes whose producer and consumer are on opposite ends of a
+  // channel (e.g., in different processes) should pass their data through a
+  // shared memory ring buffer, sending only read/write notifications over the
+  // channel. If false, the data itself is sent in messages over the channel.
+  // The default is true.
+  bool use_shared_memory_for_remote_data_pipes;
+
   // Maximum size of a single shared memory segment, in bytes. The default is
   // 1GB.
   //
@@ -64,6 +80,29 @@ struct Configuration {
 
   // Maximum number of entries in a wait set. The default is 1,000,000.
   size_t max_wait_set_num_entries;
+
+  // Maximum time, in microseconds, that a message written to a channel may be
+  // held back so that it can be sent (in a single system call) together with
+  // messages written after it. Messages are only held back while messages are
+  // being written in quick succession (i.e., within this amount of time of the
+  // previous write), so isolated messages are never delayed. If zero, messages
+  // are never held back (but messages that are queued while a write is pending
+  // are still sent together). The default is 0.
+  size_t max_channel_write_coalescing_delay_microseconds;
+
+  // Number of I/O threads used for channels (see |InitIPCSupport()|). The I/O
+  // thread given to |InitIPCSupport()| is one of them; any others are created
+  // (and destroyed) by the system. Each channel lives on just one of these
+  // threads, chosen according to its ID. The default is 1.
+  size_t num_io_threads;
+  // Whether the messages still queued on a message pipe endpoint when it is
+  // closed are destroyed on a private background thread, instead of by the
+  // thread doing the closing. (Destroying them closes any handles attached to
+  // them, which may be expensive.) The peer still sees the endpoint closed
+  // immediately, but the peers of the attached handles see them closed only
+  // once the background thread gets to them. This must be set before
+  // |embedder::Init()|. The default is false.
+  bool defer_close_teardown;
 };
 
 }  // namespace embedder
@@ -9,6 +9,7 @@
 #include "mojo/edk/system/configuration.h"
 #include "mojo/edk/system/core.h"
 #include "mojo/edk/system/handle.h"
+#include "mojo/edk/system/message_pipe_dispatcher.h"
 #include "mojo/edk/system/platform_handle_dispatcher.h"
 #include "mojo/edk/util/ref_ptr.h"
 
@@ -91,5 +92,22 @@ MojoResult PassWrappedPlatformHandle(MojoHandle platform_handle_wrapper_handle,
   return MOJO_RESULT_OK;
 }
 
+MojoResult GetMessagePipeStats(MojoHandle message_pipe_handle,
+                               MessagePipeStats* stats) {
+  DCHECK(stats);
+
+  DCHECK(internal::g_core);
+  system::Handle h;
+  MojoResult result = internal::g_core->GetHandle(message_pipe_handle, &h);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  if (h.dispatcher->GetType() != system::Dispatcher::Type::MESSAGE_PIPE)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  return static_cast<system::MessagePipeDispatcher*>(h.dispatcher.get())
+      ->GetStats(stats);
+}
+
 }  // namespace embedder
 }  // namespace mojo
@@ -17,6 +17,7 @@ namespace mojo {
 namespace embedder {
 
 struct Configuration;
+struct MessagePipeStats;
 class PlatformSupport;
 
 // Basic configuration/initialization ------------------------------------------
@@ -61,6 +62,13 @@ MojoResult PassWrappedPlatformHandle(
     MojoHandle platform_handle_wrapper_handle,
     platform::ScopedPlatformHandle* platform_handle);
 
+// Gets statistics (see |MessagePipeStats|) for the message pipe endpoint given
+// by |message_pipe_handle|. Returns |MOJO_RESULT_INVALID_ARGUMENT| if
+// |message_pipe_handle| isn't a valid message pipe handle. (This may be called
+// from any thread and doesn't require any particular handle rights.)
+MojoResult GetMessagePipeStats(MojoHandle message_pipe_handle,
+                               MessagePipeStats* stats);
+
 }  // namespace embedder
 }  // namespace mojo
 
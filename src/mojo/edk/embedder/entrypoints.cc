@@ -13,6 +13,7 @@
 #include "mojo/public/c/system/message_pipe.h"
 #include "mojo/public/c/system/time.h"
 #include "mojo/public/c/system/wait.h"
+#include "mojo/public/c/system/wait_set.h"
 
 using mojo::embedder::internal::g_core;
 using mojo::system::MakeUserPointer;
@@ -100,6 +101,49 @@ MojoResult MojoReadMessage(MojoHandle message_pipe_handle,
       MakeUserPointer(handles), MakeUserPointer(num_handles), flags);
 }
 
+MojoResult MojoBeginReadMessage(MojoHandle message_pipe_handle,
+                                void** buffer,
+                                uint32_t* buffer_num_bytes,
+                                MojoHandle* handles,
+                                uint32_t* num_handles,
+                                MojoReadMessageFlags flags) {
+  return g_core->BeginReadMessage(
+      message_pipe_handle, MakeUserPointer(buffer),
+      MakeUserPointer(buffer_num_bytes), MakeUserPointer(handles),
+      MakeUserPointer(num_handles), flags);
+}
+
+MojoResult MojoEndReadMessage(MojoHandle message_pipe_handle) {
+  return g_core->EndReadMessage(message_pipe_handle);
+}
+
+MojoResult MojoWriteMessages(MojoHandle message_pipe_handle,
+                             const void* bytes,
+                             const uint32_t* message_num_bytes,
+                             uint32_t num_messages,
+                             uint32_t* num_messages_written,
+                             MojoWriteMessageFlags flags) {
+  return g_core->WriteMessages(message_pipe_handle, MakeUserPointer(bytes),
+                               MakeUserPointer(message_num_bytes), num_messages,
+                               MakeUserPointer(num_messages_written), flags);
+}
+
+MojoResult MojoReadMessages(MojoHandle message_pipe_handle,
+                            void* bytes,
+                            uint32_t* num_bytes,
+                            MojoHandle* handles,
+                            uint32_t* num_handles,
+                            uint32_t* message_num_bytes,
+                            uint32_t* message_num_handles,
+                            uint32_t* num_messages,
+                            MojoReadMessageFlags flags) {
+  return g_core->ReadMessages(
+      message_pipe_handle, MakeUserPointer(bytes), MakeUserPointer(num_bytes),
+      MakeUserPointer(handles), MakeUserPointer(num_handles),
+      MakeUserPointer(message_num_bytes), MakeUserPointer(message_num_handles),
+      MakeUserPointer(num_messages), flags);
+}
+
 MojoResult MojoCreateDataPipe(const MojoCreateDataPipeOptions* options,
                               MojoHandle* data_pipe_producer_handle,
                               MojoHandle* data_pipe_consumer_handle) {
@@ -145,6 +189,26 @@ MojoResult MojoEndWriteData(MojoHandle data_pipe_producer_handle,
   return g_core->EndWriteData(data_pipe_producer_handle, num_elements_written);
 }
 
+MojoResult MojoBeginWriteDataSpans(MojoHandle data_pipe_producer_handle,
+                                   void** buffers,
+                                   uint32_t* buffers_num_bytes,
+                                   MojoWriteDataFlags flags) {
+  return g_core->BeginWriteDataSpans(data_pipe_producer_handle,
+                                     MakeUserPointer(buffers),
+                                     MakeUserPointer(buffers_num_bytes), flags);
+}
+
+MojoResult MojoWriteDataV(MojoHandle data_pipe_producer_handle,
+                          const void* const* buffers,
+                          const uint32_t* buffers_num_bytes,
+                          uint32_t num_buffers,
+                          uint32_t* num_bytes_written,
+                          MojoWriteDataFlags flags) {
+  return g_core->WriteDataV(data_pipe_producer_handle, MakeUserPointer(buffers),
+                            MakeUserPointer(buffers_num_bytes), num_buffers,
+                            MakeUserPointer(num_bytes_written), flags);
+}
+
 MojoResult MojoSetDataPipeConsumerOptions(
     MojoHandle data_pipe_consumer_handle,
     const struct MojoDataPipeConsumerOptions* options) {
@@ -182,6 +246,26 @@ MojoResult MojoEndReadData(MojoHandle data_pipe_consumer_handle,
   return g_core->EndReadData(data_pipe_consumer_handle, num_elements_read);
 }
 
+MojoResult MojoBeginReadDataSpans(MojoHandle data_pipe_consumer_handle,
+                                  const void** buffers,
+                                  uint32_t* buffers_num_bytes,
+                                  MojoReadDataFlags flags) {
+  return g_core->BeginReadDataSpans(data_pipe_consumer_handle,
+                                    MakeUserPointer(buffers),
+                                    MakeUserPointer(buffers_num_bytes), flags);
+}
+
+MojoResult MojoReadDataV(MojoHandle data_pipe_consumer_handle,
+                         void* const* buffers,
+                         const uint32_t* buffers_num_bytes,
+                         uint32_t num_buffers,
+                         uint32_t* num_bytes_read,
+                         MojoReadDataFlags flags) {
+  return g_core->ReadDataV(data_pipe_consumer_handle, MakeUserPointer(buffers),
+                           MakeUserPointer(buffers_num_bytes), num_buffers,
+                           MakeUserPointer(num_bytes_read), flags);
+}
+
 MojoResult MojoCreateSharedBuffer(
     const struct MojoCreateSharedBufferOptions* options,
     uint64_t num_bytes,
@@ -218,4 +302,34 @@ MojoResult MojoUnmapBuffer(void* buffer) {
   return g_core->UnmapBuffer(MakeUserPointer(buffer));
 }
 
+MojoResult MojoCreateWaitSet(const struct MojoCreateWaitSetOptions* options,
+                             MojoHandle* handle) {
+  return g_core->CreateWaitSet(MakeUserPointer(options),
+                               MakeUserPointer(handle));
+}
+
+MojoResult MojoWaitSetAdd(const struct MojoWaitSetAddOptions* options,
+                          MojoHandle wait_set_handle,
+                          MojoHandle handle,
+                          MojoHandleSignals signals,
+                          uint64_t cookie) {
+  return g_core->WaitSetAdd(MakeUserPointer(options), wait_set_handle, handle,
+                            signals, cookie);
+}
+
+MojoResult MojoWaitSetRemove(MojoHandle wait_set_handle, uint64_t cookie) {
+  return g_core->WaitSetRemove(wait_set_handle, cookie);
+}
+
+MojoResult MojoWaitSetWait(MojoHandle wait_set_handle,
+                           MojoDeadline deadline,
+                           uint32_t* num_results,
+                           struct MojoWaitSetResult* results,
+                           uint32_t* max_results) {
+  return g_core->WaitSetWait(wait_set_handle, deadline,
+                             MakeUserPointer(num_results),
+                             MakeUserPointer(results),
+                             MakeUserPointer(max_results));
+}
+
 }  // extern "C"
@@ -0,0 +1,76 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Statistics about interprocess communication (IPC), as returned by
+// |GetChannelStats()|, |GetAllChannelStats()| (see multiprocess_embedder.h),
+// and |GetMessagePipeStats()| (see embedder.h).
+
+#ifndef MOJO_EDK_EMBEDDER_IPC_STATS_H_
+#define MOJO_EDK_EMBEDDER_IPC_STATS_H_
+
+#include <stdint.h>
+
+namespace mojo {
+namespace embedder {
+
+// Statistics for a channel (i.e., a connection on top of an OS "pipe"). All
+// counts are since the channel was created, and include any control messages
+// (which aren't visible to message pipes). The average number of system calls
+// per message sent is |num_write_syscalls / num_messages_sent| (and similarly
+// for messages received).
+struct ChannelStats {
+  // The channel's ID. (For a channel to another process connected via the
+  // master process, this is that process's process identifier.)
+  uint64_t channel_id;
+
+  // Messages (and their total size, including headers) completely written to
+  // the OS "pipe".
+  uint64_t num_messages_sent;
+  uint64_t num_bytes_sent;
+  // Messages (and their total size, including headers) read from the OS "pipe"
+  // and dispatched.
+  uint64_t num_messages_received;
+  uint64_t num_bytes_received;
+
+  // Mojo handles attached to messages sent/received.
+  uint64_t num_handles_sent;
+  uint64_t num_handles_received;
+  // Platform handles (e.g., file descriptors) sent/received over the OS "pipe".
+  uint64_t num_platform_handles_sent;
+  uint64_t num_platform_handles_received;
+
+  // Number of (successful) write/read system calls.
+  uint64_t num_write_syscalls;
+  uint64_t num_read_syscalls;
+
+  // Messages (and the number of bytes of them) that have been queued to be
+  // sent, but haven't been written yet, at the time the statistics were taken.
+  uint64_t num_messages_pending_write;
+  uint64_t num_bytes_pending_write;
+};
+
+// Statistics for one end of a message pipe (in this process). Counts are since
+// the message pipe (end) was created or arrived in this process.
+struct MessagePipeStats {
+  // Messages (and their total size, and number of attached handles) written to
+  // this end.
+  uint64_t num_messages_written;
+  uint64_t num_bytes_written;
+  uint64_t num_handles_written;
+  // Messages (and their total size, and number of attached handles)
+  // successfully read from this end.
+  uint64_t num_messages_read;
+  uint64_t num_bytes_read;
+  uint64_t num_handles_read;
+
+  // Messages (and their total size) queued to be read from this end, at the
+  // time the statistics were taken.
+  uint64_t num_messages_queued;
+  uint64_t num_bytes_queued;
+};
+
+}  // namespace embedder
+}  // namespace mojo
+
+#endif  // MOJO_EDK_EMBEDDER_IPC_STATS_H_
@@ -253,5 +253,22 @@ void WillDestroyChannelSoon(ChannelInfo* channel_info) {
   channel_manager->WillShutdownChannel(channel_info->channel_id);
 }
 
+void GetChannelStats(const ChannelInfo* channel_info, ChannelStats* stats) {
+  DCHECK(channel_info);
+  DCHECK(stats);
+  DCHECK(internal::g_ipc_support);
+
+  system::ChannelManager* channel_manager =
+      internal::g_ipc_support->channel_manager();
+  channel_manager->GetChannel(channel_info->channel_id)->GetStats(stats);
+}
+
+void GetAllChannelStats(std::vector<ChannelStats>* stats) {
+  DCHECK(stats);
+  DCHECK(internal::g_ipc_support);
+
+  internal::g_ipc_support->channel_manager()->GetAllChannelStats(stats);
+}
+
 }  // namespace embedder
 }  // namespace mojo
@@ -7,8 +7,10 @@
 
 #include <functional>
 #include <string>
+#include <vector>
 
 #include "mojo/edk/embedder/channel_info_forward.h"
+#include "mojo/edk/embedder/ipc_stats.h"
 #include "mojo/edk/embedder/process_type.h"
 #include "mojo/edk/embedder/slave_info.h"
 #include "mojo/edk/platform/scoped_platform_handle.h"
@@ -46,6 +48,11 @@ class ProcessDelegate;
 //     |platform_handle| should be connected to the handle passed to
 //     |ConnectToSlave()| (in the master process). For other processes,
 //     |platform_handle| is ignored (and should not be valid).
+//   - If |Configuration::num_io_threads| is greater than 1, that many I/O
+//     threads (including the one given by |io_task_runner|/|io_watcher|) are
+//     used for channels. In that case, "the I/O thread" below still refers to
+//     the one given here; callbacks that are run "on the I/O thread" are run on
+//     it, and the |...OnIOThread()| functions must be called on it.
 void InitIPCSupport(
     ProcessType process_type,
     util::RefPtr<platform::TaskRunner>&& delegate_thread_task_runner,
@@ -173,8 +180,9 @@ ScopedMessagePipeHandle CreateChannel(
 
 // Destroys a channel that was created using |ConnectToMaster()|,
 // |ConnectToSlave()|, |CreateChannel()|, or |CreateChannelOnIOThread()|; must
-// be called from the channel's I'O thread. Completes synchronously (and posts
-// no tasks).
+// be called from the I/O thread. Completes synchronously (and posts no tasks,
+// unless the channel lives on one of the additional I/O threads -- see
+// |Configuration::num_io_threads|).
 void DestroyChannelOnIOThread(ChannelInfo* channel_info);
 
 // Like |DestroyChannelOnIOThread()|, but asynchronous and may be called from
@@ -192,6 +200,20 @@ void DestroyChannel(
 // called before |DestroyChannel()|.
 void WillDestroyChannelSoon(ChannelInfo* channel_info);
 
+// IPC statistics --------------------------------------------------------------
+
+// These may be called from any thread, but (like the IPC functions above) not
+// while or after IPC support is shut down.
+
+// Gets statistics for the given channel (which must not have been destroyed);
+// see |ChannelStats|.
+void GetChannelStats(const ChannelInfo* channel_info, ChannelStats* stats);
+
+// Gets statistics for all channels, in no particular order. (This includes
+// channels that the embedder doesn't see directly, such as those created to
+// connect slaves to each other.)
+void GetAllChannelStats(std::vector<ChannelStats>* stats);
+
 }  // namespace embedder
 }  // namespace mojo
 
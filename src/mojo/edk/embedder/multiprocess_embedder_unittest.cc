@@ -7,8 +7,10 @@
 #include <string.h>
 
 #include <memory>
+#include <utility>
 
 #include "base/logging.h"
+#include "mojo/edk/embedder/embedder.h"
 #include "mojo/edk/embedder/test_embedder.h"
 #include "mojo/edk/platform/platform_pipe.h"
 #include "mojo/edk/system/test/test_command_line.h"
@@ -19,6 +21,7 @@
 #include "mojo/edk/util/command_line.h"
 #include "mojo/edk/util/ref_ptr.h"
 #include "mojo/edk/util/waitable_event.h"
+#include "mojo/public/c/system/buffer.h"
 #include "mojo/public/c/system/handle.h"
 #include "mojo/public/c/system/time.h"
 #include "mojo/public/c/system/wait.h"
@@ -314,6 +317,115 @@ TEST_F(MultiprocessEmbedderTest, ChannelsHandlePassing) {
   EXPECT_TRUE(client_channel.channel_info());
 }
 
+TEST_F(MultiprocessEmbedderTest, ChannelStats) {
+  mojo::test::ScopedIPCSupport ipc_support(test_io_task_runner().Clone(),
+                                           test_io_watcher());
+
+  PlatformPipe channel_pair;
+  ScopedTestChannel server_channel(channel_pair.handle0.Pass());
+  MojoHandle server_mp = server_channel.bootstrap_message_pipe();
+  EXPECT_NE(server_mp, MOJO_HANDLE_INVALID);
+  ScopedTestChannel client_channel(channel_pair.handle1.Pass());
+  MojoHandle client_mp = client_channel.bootstrap_message_pipe();
+  EXPECT_NE(client_mp, MOJO_HANDLE_INVALID);
+  server_channel.WaitForChannelCreationCompletion();
+  client_channel.WaitForChannelCreationCompletion();
+
+  MojoHandle h0, h1;
+  EXPECT_EQ(MOJO_RESULT_OK, MojoCreateMessagePipe(nullptr, &h0, &h1));
+
+  // Write one message to |server_mp|, attaching |h1|.
+  const char kHello[] = "hello";
+  EXPECT_EQ(
+      MOJO_RESULT_OK,
+      MojoWriteMessage(server_mp, kHello, static_cast<uint32_t>(sizeof(kHello)),
+                       &h1, 1, MOJO_WRITE_MESSAGE_FLAG_NONE));
+  h1 = MOJO_HANDLE_INVALID;
+
+  MessagePipeStats mp_stats = {};
+  EXPECT_EQ(MOJO_RESULT_OK, GetMessagePipeStats(server_mp, &mp_stats));
+  EXPECT_EQ(1u, mp_stats.num_messages_written);
+  EXPECT_EQ(sizeof(kHello), mp_stats.num_bytes_written);
+  EXPECT_EQ(1u, mp_stats.num_handles_written);
+  EXPECT_EQ(0u, mp_stats.num_messages_read);
+
+  // Wait for |client_mp| to become readable.
+  EXPECT_EQ(MOJO_RESULT_OK, MojoWait(client_mp, MOJO_HANDLE_SIGNAL_READABLE,
+                                     MOJO_DEADLINE_INDEFINITE, nullptr));
+  EXPECT_EQ(MOJO_RESULT_OK, GetMessagePipeStats(client_mp, &mp_stats));
+  EXPECT_EQ(0u, mp_stats.num_messages_written);
+  EXPECT_EQ(0u, mp_stats.num_messages_read);
+  EXPECT_EQ(1u, mp_stats.num_messages_queued);
+  EXPECT_EQ(sizeof(kHello), mp_stats.num_bytes_queued);
+
+  // Read the message from |client_mp|.
+  char buffer[1000] = {};
+  uint32_t num_bytes = static_cast<uint32_t>(sizeof(buffer));
+  MojoHandle handles[10] = {};
+  uint32_t num_handles = MOJO_ARRAYSIZE(handles);
+  EXPECT_EQ(MOJO_RESULT_OK,
+            MojoReadMessage(client_mp, buffer, &num_bytes, handles,
+                            &num_handles, MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(1u, num_handles);
+  h1 = handles[0];
+
+  EXPECT_EQ(MOJO_RESULT_OK, GetMessagePipeStats(client_mp, &mp_stats));
+  EXPECT_EQ(1u, mp_stats.num_messages_read);
+  EXPECT_EQ(sizeof(kHello), mp_stats.num_bytes_read);
+  EXPECT_EQ(1u, mp_stats.num_handles_read);
+  EXPECT_EQ(0u, mp_stats.num_messages_queued);
+  EXPECT_EQ(0u, mp_stats.num_bytes_queued);
+
+  // The message (and the handle it carried) went from the server channel to
+  // the client channel. (There may also have been control messages.)
+  ChannelStats server_stats = {};
+  GetChannelStats(server_channel.channel_info(), &server_stats);
+  EXPECT_GE(server_stats.num_messages_sent, 1u);
+  EXPECT_GT(server_stats.num_bytes_sent, sizeof(kHello));
+  EXPECT_EQ(1u, server_stats.num_handles_sent);
+  EXPECT_EQ(0u, server_stats.num_handles_received);
+  EXPECT_GE(server_stats.num_write_syscalls, 1u);
+  EXPECT_LE(server_stats.num_write_syscalls, server_stats.num_messages_sent);
+  EXPECT_EQ(0u, server_stats.num_platform_handles_sent);
+
+  ChannelStats client_stats = {};
+  GetChannelStats(client_channel.channel_info(), &client_stats);
+  EXPECT_GE(client_stats.num_messages_received, 1u);
+  EXPECT_EQ(0u, client_stats.num_handles_sent);
+  EXPECT_EQ(1u, client_stats.num_handles_received);
+  EXPECT_GE(client_stats.num_read_syscalls, 1u);
+  EXPECT_EQ(0u, client_stats.num_messages_pending_write);
+  EXPECT_EQ(0u, client_stats.num_bytes_pending_write);
+
+  // Both channels are managed by the (same) channel manager.
+  EXPECT_NE(server_stats.channel_id, client_stats.channel_id);
+  std::vector<ChannelStats> all_stats;
+  GetAllChannelStats(&all_stats);
+  ASSERT_EQ(2u, all_stats.size());
+  if (all_stats[0].channel_id != server_stats.channel_id)
+    std::swap(all_stats[0], all_stats[1]);
+  EXPECT_EQ(server_stats.channel_id, all_stats[0].channel_id);
+  EXPECT_EQ(1u, all_stats[0].num_handles_sent);
+  EXPECT_GE(all_stats[0].num_messages_sent, server_stats.num_messages_sent);
+  EXPECT_EQ(client_stats.channel_id, all_stats[1].channel_id);
+  EXPECT_EQ(1u, all_stats[1].num_handles_received);
+
+  // Only message pipe handles have message pipe statistics.
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            GetMessagePipeStats(MOJO_HANDLE_INVALID, &mp_stats));
+  MojoHandle shared_buffer = MOJO_HANDLE_INVALID;
+  ASSERT_EQ(MOJO_RESULT_OK,
+            MojoCreateSharedBuffer(nullptr, 100u, &shared_buffer));
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            GetMessagePipeStats(shared_buffer, &mp_stats));
+  EXPECT_EQ(MOJO_RESULT_OK, MojoClose(shared_buffer));
+
+  EXPECT_EQ(MOJO_RESULT_OK, MojoClose(server_mp));
+  EXPECT_EQ(MOJO_RESULT_OK, MojoClose(client_mp));
+  EXPECT_EQ(MOJO_RESULT_OK, MojoClose(h0));
+  EXPECT_EQ(MOJO_RESULT_OK, MojoClose(h1));
+}
+
 #if defined(OS_ANDROID)
 // Android multi-process tests are not executing the new process. This is flaky.
 // TODO(vtl): I'm guessing this is true of this test too?
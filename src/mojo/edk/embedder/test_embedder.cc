@@ -18,19 +18,15 @@ namespace system {
 namespace internal {
 
 bool ShutdownCheckNoLeaks(Core* core) {
-  // No point in taking the lock.
-  const HandleTable::HandleToEntryMap& handle_to_entry_map =
-      core->handle_table_.handle_to_entry_map_;
-
-  if (handle_to_entry_map.empty())
-    return true;
-
-  for (HandleTable::HandleToEntryMap::const_iterator it =
-           handle_to_entry_map.begin();
-       it != handle_to_entry_map.end(); ++it) {
-    LOG(ERROR) << "Mojo embedder shutdown: Leaking handle " << (*it).first;
+  // No point in taking the locks.
+  bool rv = true;
+  for (const auto& shard : core->handle_table_.shards_) {
+    for (const auto& p : shard->handle_to_entry_map) {
+      LOG(ERROR) << "Mojo embedder shutdown: Leaking handle " << p.first;
+      rv = false;
+    }
   }
-  return false;
+  return rv;
 }
 
 }  // namespace internal
@@ -28,9 +28,13 @@ class PlatformSharedBufferMapping;
 //   - Sizes/offsets (of the shared memory and mappings) are arbitrary, and not
 //     restricted by page size. However, more memory may actually be mapped than
 //     requested.
+//   - Mappings may be read/write or read-only.
 //
 // It currently does NOT support the following:
-//   - Sharing read-only. (This will probably eventually be supported.)
+//   - Sharing read-only. (This will probably eventually be supported.) Note
+//     that a read-only mapping doesn't prevent others (with the platform
+//     handle) from writing to the shared memory, so its contents may change at
+//     any time (e.g., after having been validated).
 //
 // TODO(vtl): Rectify this with |base::SharedMemory|.
 class PlatformSharedBuffer
@@ -54,6 +58,12 @@ class PlatformSharedBuffer
       size_t offset,
       size_t length) = 0;
 
+  // Like |MapNoCheck()|, but maps the memory read-only (writing to it is
+  // undefined behavior).
+  virtual std::unique_ptr<PlatformSharedBufferMapping> MapReadOnlyNoCheck(
+      size_t offset,
+      size_t length) = 0;
+
   // Duplicates the underlying platform handle and passes it to the caller.
   // TODO(vtl): On POSIX, we'll need two FDs to support sharing read-only.
   virtual ScopedPlatformHandle DuplicatePlatformHandle() = 0;
@@ -4,8 +4,12 @@
 
 #include "mojo/edk/platform/simple_platform_shared_buffer.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <limits>
 
+#include "build/build_config.h"
 #include "mojo/public/cpp/system/macros.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
@@ -93,7 +97,86 @@ TEST(SimplePlatformSharedBufferTest, Basic) {
   }
 }
 
-// TODO(vtl): Bigger buffers.
+TEST(SimplePlatformSharedBufferTest, ReadOnlyMapping) {
+  auto buffer = CreateSimplePlatformSharedBuffer(100);
+  ASSERT_TRUE(buffer);
+
+  std::unique_ptr<PlatformSharedBufferMapping> mapping1(buffer->Map(0, 100));
+  ASSERT_TRUE(mapping1);
+  static_cast<char*>(mapping1->GetBase())[50] = 'x';
+
+  ASSERT_TRUE(buffer->IsValidMap(50, 50));
+  std::unique_ptr<PlatformSharedBufferMapping> mapping2(
+      buffer->MapReadOnlyNoCheck(50, 50));
+  ASSERT_TRUE(mapping2);
+  ASSERT_TRUE(mapping2->GetBase());
+  EXPECT_EQ(50u, mapping2->GetLength());
+  EXPECT_EQ('x', static_cast<const char*>(mapping2->GetBase())[0]);
+
+  static_cast<char*>(mapping1->GetBase())[51] = 'y';
+  EXPECT_EQ('y', static_cast<const char*>(mapping2->GetBase())[1]);
+
+  // The read-only mapping may outlive the buffer (and the other mapping).
+  buffer = nullptr;
+  mapping1.reset();
+  EXPECT_EQ('x', static_cast<const char*>(mapping2->GetBase())[0]);
+}
+
+TEST(SimplePlatformSharedBufferTest, BigBuffer) {
+  // Big enough that huge pages may be used for the mapping.
+  const size_t kNumBytes = 8u * 1024u * 1024u;
+  auto buffer = CreateSimplePlatformSharedBuffer(kNumBytes);
+  ASSERT_TRUE(buffer);
+  std::unique_ptr<PlatformSharedBufferMapping> mapping(
+      buffer->Map(0, kNumBytes));
+  ASSERT_TRUE(mapping);
+  char* base = static_cast<char*>(mapping->GetBase());
+  EXPECT_EQ('\0', base[0]);
+  EXPECT_EQ('\0', base[kNumBytes - 1]);
+  base[0] = 'a';
+  base[kNumBytes - 1] = 'z';
+
+  std::unique_ptr<PlatformSharedBufferMapping> mapping2(
+      buffer->MapReadOnlyNoCheck(kNumBytes / 2, kNumBytes / 2));
+  ASSERT_TRUE(mapping2);
+  EXPECT_EQ('z', static_cast<const char*>(mapping2->GetBase())[kNumBytes / 2 -
+                                                                1]);
+}
+
+#if defined(OS_LINUX) && !defined(OS_ANDROID) && defined(F_GET_SEALS)
+// On Linux, the buffer should be a memfd whose size (but not contents) is
+// sealed (unless memfds aren't supported, in which case there's nothing to
+// test).
+TEST(SimplePlatformSharedBufferTest, SizeSealed) {
+  auto buffer = CreateSimplePlatformSharedBuffer(100);
+  ASSERT_TRUE(buffer);
+  ScopedPlatformHandle handle = buffer->DuplicatePlatformHandle();
+  ASSERT_TRUE(handle.is_valid());
+
+  int seals = fcntl(handle.get().fd, F_GET_SEALS);
+  if (seals < 0)
+    return;
+  EXPECT_TRUE((seals & F_SEAL_SHRINK));
+  EXPECT_TRUE((seals & F_SEAL_GROW));
+  EXPECT_TRUE((seals & F_SEAL_SEAL));
+  EXPECT_FALSE((seals & F_SEAL_WRITE));
+
+  // So the size can't be changed.
+  EXPECT_NE(0, ftruncate(handle.get().fd, 50));
+  EXPECT_NE(0, ftruncate(handle.get().fd, 200));
+
+  // But the handle can still be used to make a buffer.
+  auto buffer2 =
+      CreateSimplePlatformSharedBufferFromPlatformHandle(100, handle.Pass());
+  ASSERT_TRUE(buffer2);
+  std::unique_ptr<PlatformSharedBufferMapping> mapping1(buffer->Map(0, 100));
+  std::unique_ptr<PlatformSharedBufferMapping> mapping2(buffer2->Map(0, 100));
+  ASSERT_TRUE(mapping1);
+  ASSERT_TRUE(mapping2);
+  static_cast<char*>(mapping1->GetBase())[10] = 'x';
+  EXPECT_EQ('x', static_cast<char*>(mapping2->GetBase())[10]);
+}
+#endif  // defined(OS_LINUX) && !defined(OS_ANDROID) && defined(F_GET_SEALS)
 
 TEST(SimplePlatformSharedBufferTest, InvalidMappings) {
   auto buffer = CreateSimplePlatformSharedBuffer(100);
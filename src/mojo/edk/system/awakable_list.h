@@ -30,6 +30,8 @@ class AwakableList {
   AwakableList();
   ~AwakableList();
 
+  bool IsEmpty() const { return awakables_.empty(); }
+
   void AwakeForStateChange(const HandleSignalsState& state);
   void CancelAll();
   void Add(Awakable* awakable, MojoHandleSignals signals, uint64_t context);
@@ -5,9 +5,14 @@
 #include "mojo/edk/system/channel.h"
 
 #include <algorithm>
+#include <limits>
+#include <type_traits>
 #include <utility>
 
 #include "base/logging.h"
+#include "mojo/edk/embedder/ipc_stats.h"
+#include "mojo/edk/system/channel_manager.h"
+#include "mojo/edk/system/connection_manager.h"
 #include "mojo/edk/system/endpoint_relayer.h"
 #include "mojo/edk/system/transport_data.h"
 #include "mojo/edk/util/string_printf.h"
@@ -51,13 +56,38 @@ void Channel::Init(RefPtr<TaskRunner>&& io_task_runner,
   is_running_ = true;
 }
 
-void Channel::SetChannelManager(ChannelManager* channel_manager) {
+void Channel::SetChannelManager(ChannelManager* channel_manager,
+                                ChannelId channel_id) {
   DCHECK(channel_manager);
+  DCHECK_NE(channel_id, kInvalidChannelId);
 
   MutexLocker locker(&mutex_);
   DCHECK(!is_shutting_down_);
   DCHECK(!channel_manager_);
   channel_manager_ = channel_manager;
+  channel_id_ = channel_id;
+}
+
+ChannelManager* Channel::GetChannelManager() const {
+  MutexLocker locker(&mutex_);
+  return channel_manager_;
+}
+
+ProcessIdentifier Channel::GetPeerProcessIdentifier() const {
+  MutexLocker locker(&mutex_);
+  if (!channel_manager_ || !channel_manager_->connection_manager())
+    return kInvalidProcessIdentifier;
+
+  // Channels to other processes that were set up via the |ConnectionManager|
+  // use the peer's process identifier as their ID (see, e.g.,
+  // |IPCSupport::ConnectToSlave()|). Other channels created by the embedder use
+  // "negative" IDs (see |embedder::MakeChannelId()|), which we must not mistake
+  // for process identifiers.
+  if (channel_id_ > std::numeric_limits<uint32_t>::max())
+    return kInvalidProcessIdentifier;
+  static_assert(std::is_same<ChannelId, ProcessIdentifier>::value,
+                "ChannelId and ProcessIdentifier types don't match");
+  return channel_id_;
 }
 
 void Channel::Shutdown() {
@@ -129,17 +159,92 @@ void Channel::SetBootstrapEndpointWithIds(RefPtr<ChannelEndpoint>&& endpoint,
   endpoint->AttachAndRun(this, local_id, remote_id);
 }
 
-bool Channel::WriteMessage(std::unique_ptr<MessageInTransit> message) {
-  MutexLocker locker(&mutex_);
-  if (!is_running_) {
-    // TODO(vtl): I think this is probably not an error condition, but I should
-    // think about it (and the shutdown sequence) more carefully.
-    LOG(WARNING) << "WriteMessage() after shutdown";
-    return false;
+void Channel::AttachEndpoint(RefPtr<ChannelEndpoint>&& endpoint,
+                             ChannelEndpointId* local_id,
+                             ChannelEndpointId* remote_id) {
+  DCHECK(endpoint);
+  DCHECK(local_id);
+  DCHECK(remote_id);
+
+  {
+    MutexLocker locker(&mutex_);
+
+    DLOG_IF(WARNING, is_shutting_down_)
+        << "AttachEndpoint() while shutting down";
+
+    do {
+      *local_id = local_id_generator_.GetNext();
+    } while (local_id_to_endpoint_map_.find(*local_id) !=
+             local_id_to_endpoint_map_.end());
+
+    // TODO(vtl): We also need to check for collisions of remote IDs here.
+    *remote_id = remote_id_generator_.GetNext();
+
+    local_id_to_endpoint_map_[*local_id] = endpoint;
   }
 
-  DLOG_IF(WARNING, is_shutting_down_) << "WriteMessage() while shutting down";
-  return raw_channel_->WriteMessage(std::move(message));
+  if (!SendControlMessage(
+          MessageInTransit::Subtype::CHANNEL_ATTACH_AND_RUN_ENDPOINT, *local_id,
+          *remote_id, 0, nullptr)) {
+    HandleLocalError(
+        StringPrintf("Failed to send message to run remote endpoint (local "
+                     "ID %u, remote ID %u)",
+                     static_cast<unsigned>(local_id->value()),
+                     static_cast<unsigned>(remote_id->value()))
+            .c_str());
+    // TODO(vtl): Should we continue on to |AttachAndRun()|?
+  }
+
+  endpoint->AttachAndRun(this, *local_id, *remote_id);
+}
+
+RefPtr<IncomingEndpoint> Channel::ClaimIncomingEndpoint(
+    ChannelEndpointId local_id,
+    ChannelEndpointId remote_id) {
+  // As in |OnAttachAndRunEndpoint()|, the IDs were allocated by the remote
+  // side.
+  if (!local_id.is_valid() || !local_id.is_remote() || !remote_id.is_valid() ||
+      remote_id.is_remote())
+    return nullptr;
+
+  // In case we have to create it, create/initialize an |IncomingEndpoint| (and
+  // thus an endpoint) outside the lock.
+  auto incoming_endpoint = MakeRefCounted<IncomingEndpoint>();
+  RefPtr<ChannelEndpoint> endpoint = incoming_endpoint->Init();
+
+  RefPtr<IncomingEndpoint> rv;
+  {
+    MutexLocker locker(&mutex_);
+
+    auto it = incoming_endpoints_.find(local_id);
+    if (it != incoming_endpoints_.end()) {
+      rv = std::move(it->second);
+      incoming_endpoints_.erase(it);
+    } else if (is_running_ &&
+               local_id_to_endpoint_map_.find(local_id) ==
+                   local_id_to_endpoint_map_.end()) {
+      local_id_to_endpoint_map_[local_id] = endpoint;
+      claimed_endpoint_ids_.insert(local_id);
+    } else {
+      endpoint = nullptr;
+    }
+  }
+
+  if (rv || !endpoint) {
+    // We need to call |Close()| outside the lock.
+    incoming_endpoint->Close();
+    DVLOG_IF(2, !rv) << "Failed to claim incoming endpoint (local ID "
+                     << local_id << ")";
+    return rv;
+  }
+
+  endpoint->AttachAndRun(this, local_id, remote_id);
+  return incoming_endpoint;
+}
+
+bool Channel::WriteMessage(std::unique_ptr<MessageInTransit> message) {
+  MutexLocker locker(&mutex_);
+  return WriteMessageNoLock(std::move(message));
 }
 
 bool Channel::IsWriteBufferEmpty() {
@@ -152,26 +257,51 @@ bool Channel::IsWriteBufferEmpty() {
 void Channel::DetachEndpoint(ChannelEndpoint* endpoint,
                              ChannelEndpointId local_id,
                              ChannelEndpointId remote_id) {
+  DCHECK(endpoint);
+  DCHECK(local_id.is_valid());
+
+  if (!remote_id.is_valid())
+    return;  // Nothing to do.
+
   // Keep a reference to |this| to prevent this |Channel| from being deleted
   // while this function is running. Without this, if |Shutdown()| is started on
   // the I/O thread immediately after |mutex_| is released below and finishes
-  // before |SendControlMessage()| gets to run, |this| could be deleted while
-  // this function is still running.
+  // before |HandleLocalError()| gets to run, |this| could be deleted while this
+  // function is still running.
   RefPtr<Channel> self(this);
 
-  if (!DetachEndpointInternal(endpoint, local_id, remote_id))
-    return;
+  {
+    MutexLocker locker(&mutex_);
+    if (!is_running_)
+      return;
 
-  // Note: Send the remove message outside the lock.
-  if (!SendControlMessage(MessageInTransit::Subtype::CHANNEL_REMOVE_ENDPOINT,
-                          local_id, remote_id, 0, nullptr)) {
-    HandleLocalError(
-        StringPrintf("Failed to send message to remove remote endpoint (local "
-                     "ID %u, remote ID %u)",
-                     static_cast<unsigned>(local_id.value()),
-                     static_cast<unsigned>(remote_id.value()))
-            .c_str());
+    IdToEndpointMap::iterator it = local_id_to_endpoint_map_.find(local_id);
+    // We detach immediately if we receive a remove message, so it's possible
+    // that the local ID is no longer in |local_id_to_endpoint_map_|, or even
+    // that it's since been reused for another endpoint. In both cases, there's
+    // nothing more to do.
+    if (it == local_id_to_endpoint_map_.end() || it->second.get() != endpoint)
+      return;
+
+    DCHECK(it->second);
+    it->second = nullptr;
+
+    // Send the remove message under the lock: if the remote side's remove
+    // crosses it, we ack that as soon as we see our zombie (see
+    // |OnRemoveEndpoint()|), and our remove must not be overtaken by that ack
+    // (or the remote side would drop it, and we'd never get our ack).
+    if (SendControlMessageNoLock(
+            MessageInTransit::Subtype::CHANNEL_REMOVE_ENDPOINT, local_id,
+            remote_id, 0, nullptr))
+      return;
   }
+
+  HandleLocalError(
+      StringPrintf("Failed to send message to remove remote endpoint (local ID "
+                   "%u, remote ID %u)",
+                   static_cast<unsigned>(local_id.value()),
+                   static_cast<unsigned>(remote_id.value()))
+          .c_str());
 }
 
 size_t Channel::GetSerializedEndpointSize() const {
@@ -212,9 +342,9 @@ void Channel::SerializeEndpointWithRemotePeer(
   DCHECK(destination);
   DCHECK(peer_endpoint);
 
-  DVLOG(1) << "Direct message pipe passing across multiple channels not yet "
-              "implemented; will proxy";
-  // Create and set up an |EndpointRelayer| to proxy.
+  // Create and set up an |EndpointRelayer| to proxy. If possible, the relayer
+  // will be bypassed once the endpoints on either side of it have connected
+  // directly (see |MaybeRequestBypass()|).
   // TODO(vtl): If we were to own/track the relayer directly (rather than owning
   // it via its |ChannelEndpoint|s), then we might be able to make
   // |ChannelEndpoint|'s |client_| pointer a raw pointer.
@@ -222,12 +352,16 @@ void Channel::SerializeEndpointWithRemotePeer(
   auto endpoint =
       MakeRefCounted<ChannelEndpoint>(relayer.Clone(), 0, message_queue);
   relayer->Init(endpoint.Clone(), peer_endpoint.Clone());
-  peer_endpoint->ReplaceClient(std::move(relayer), 1);
+  peer_endpoint->ReplaceClient(relayer.Clone(), 1);
 
   SerializedEndpoint* s = static_cast<SerializedEndpoint*>(destination);
-  s->receiver_endpoint_id = AttachAndRunEndpoint(std::move(endpoint));
+  s->receiver_endpoint_id = AttachAndRunEndpoint(endpoint.Clone());
   DVLOG(2) << "Serializing endpoint with remote peer (remote ID = "
            << s->receiver_endpoint_id << ")";
+
+  // Note: The bypass request must be sent after the remote side has been told
+  // to attach and run the endpoint (above).
+  MaybeRequestBypass(relayer.get(), peer_endpoint.get());
 }
 
 RefPtr<IncomingEndpoint> Channel::DeserializeEndpoint(const void* source) {
@@ -260,43 +394,53 @@ size_t Channel::GetSerializedPlatformHandleSize() const {
   return raw_channel_->GetSerializedPlatformHandleSize();
 }
 
+void Channel::GetStats(embedder::ChannelStats* stats) const {
+  *stats = embedder::ChannelStats();
+  stats->num_handles_sent = num_handles_sent_.load(std::memory_order_relaxed);
+  stats->num_handles_received =
+      num_handles_received_.load(std::memory_order_relaxed);
+
+  RawChannel::WriteStats write_stats = {};
+  RawChannel::ReadStats read_stats = {};
+  {
+    MutexLocker locker(&mutex_);
+    stats->channel_id = channel_id_;
+    if (!raw_channel_)
+      return;
+    raw_channel_->GetWriteStats(&write_stats);
+    raw_channel_->GetReadStats(&read_stats);
+  }
+  stats->num_messages_sent = write_stats.num_messages_written;
+  stats->num_bytes_sent = write_stats.num_bytes_written;
+  stats->num_messages_received = read_stats.num_messages_read;
+  stats->num_bytes_received = read_stats.num_bytes_read;
+  stats->num_platform_handles_sent = write_stats.num_platform_handles_written;
+  stats->num_platform_handles_received = read_stats.num_platform_handles_read;
+  stats->num_write_syscalls = write_stats.num_writes;
+  stats->num_read_syscalls = read_stats.num_reads;
+  stats->num_messages_pending_write = write_stats.num_messages_pending;
+  stats->num_bytes_pending_write = write_stats.num_bytes_pending;
+}
+
+size_t Channel::GetNumEndpointsForTest() const {
+  MutexLocker locker(&mutex_);
+  return local_id_to_endpoint_map_.size();
+}
+
 Channel::Channel(embedder::PlatformSupport* platform_support)
     : platform_support_(platform_support),
       is_running_(false),
       is_shutting_down_(false),
-      channel_manager_(nullptr) {}
+      channel_manager_(nullptr),
+      channel_id_(kInvalidChannelId),
+      num_handles_sent_(0),
+      num_handles_received_(0) {}
 
 Channel::~Channel() {
   // The channel should have been shut down first.
   DCHECK(!is_running_);
 }
 
-bool Channel::DetachEndpointInternal(ChannelEndpoint* endpoint,
-                                     ChannelEndpointId local_id,
-                                     ChannelEndpointId remote_id) {
-  DCHECK(endpoint);
-  DCHECK(local_id.is_valid());
-
-  if (!remote_id.is_valid())
-    return false;  // Nothing to do.
-
-  MutexLocker locker(&mutex_);
-  if (!is_running_)
-    return false;
-
-  IdToEndpointMap::iterator it = local_id_to_endpoint_map_.find(local_id);
-  // We detach immediately if we receive a remove message, so it's possible
-  // that the local ID is no longer in |local_id_to_endpoint_map_|, or even
-  // that it's since been reused for another endpoint. In both cases, there's
-  // nothing more to do.
-  if (it == local_id_to_endpoint_map_.end() || it->second.get() != endpoint)
-    return false;
-
-  DCHECK(it->second);
-  it->second = nullptr;
-  return true;
-}
-
 void Channel::OnReadMessage(
     const MessageInTransit::View& message_view,
     std::unique_ptr<std::vector<ScopedPlatformHandle>> platform_handles) {
@@ -412,6 +556,10 @@ void Channel::OnReadMessageForEndpoint(
         message_view.transport_data_buffer(),
         message_view.transport_data_buffer_size(), std::move(platform_handles),
         this));
+    if (message->handles()) {
+      num_handles_received_.fetch_add(message->handles()->size(),
+                                      std::memory_order_relaxed);
+    }
   }
 
   endpoint->OnReadMessage(std::move(message));
@@ -491,11 +639,14 @@ bool Channel::OnAttachAndRunEndpoint(ChannelEndpointId local_id,
   RefPtr<ChannelEndpoint> endpoint = incoming_endpoint->Init();
 
   bool success = true;
+  bool already_claimed = false;
   {
     MutexLocker locker(&mutex_);
 
-    if (local_id_to_endpoint_map_.find(local_id) ==
-        local_id_to_endpoint_map_.end()) {
+    if (claimed_endpoint_ids_.erase(local_id)) {
+      already_claimed = true;
+    } else if (local_id_to_endpoint_map_.find(local_id) ==
+               local_id_to_endpoint_map_.end()) {
       DCHECK(incoming_endpoints_.find(local_id) == incoming_endpoints_.end());
 
       // TODO(vtl): Use emplace when we move to C++11 unordered_maps. (It'll
@@ -507,6 +658,12 @@ bool Channel::OnAttachAndRunEndpoint(ChannelEndpointId local_id,
       success = false;
     }
   }
+  if (already_claimed) {
+    // The endpoint was already created when it was claimed (see
+    // |ClaimIncomingEndpoint()|), so there's nothing to do.
+    incoming_endpoint->Close();
+    return true;
+  }
   if (!success) {
     DVLOG(2) << "Received attach and run endpoint for existing local ID";
     incoming_endpoint->Close();
@@ -533,17 +690,18 @@ bool Channel::OnRemoveEndpoint(ChannelEndpointId local_id,
       return false;
     }
 
-    if (!it->second) {
-      // Remove messages "crossed"; we have to wait for the ack.
-      return true;
+    if (it->second) {
+      endpoint = std::move(it->second);
+      local_id_to_endpoint_map_.erase(it);
     }
-
-    endpoint = std::move(it->second);
-    local_id_to_endpoint_map_.erase(it);
+    // Otherwise, remove messages "crossed". We have to wait for the ack, but we
+    // must still ack the remote side's remove (since it's waiting for an ack
+    // too).
     // Detach and send the remove ack message outside the lock.
   }
 
-  endpoint->DetachFromChannel();
+  if (endpoint)
+    endpoint->DetachFromChannel();
 
   if (!SendControlMessage(
           MessageInTransit::Subtype::CHANNEL_REMOVE_ENDPOINT_ACK, local_id,
@@ -596,45 +754,50 @@ void Channel::HandleLocalError(const char* error_message) {
   LOG(WARNING) << error_message;
 }
 
-// Note: |endpoint| being a |RefPtr| makes this function safe, since it keeps
-// the endpoint alive even after the lock is released.
+void Channel::MaybeRequestBypass(EndpointRelayer* relayer,
+                                 ChannelEndpoint* peer_endpoint) {
+  ProcessIdentifier process_identifier = GetPeerProcessIdentifier();
+  if (process_identifier == kInvalidProcessIdentifier)
+    return;
+  ProcessIdentifier peer_process_identifier =
+      peer_endpoint->GetPeerProcessIdentifierForBypass();
+  if (peer_process_identifier == kInvalidProcessIdentifier ||
+      peer_process_identifier == process_identifier)
+    return;
+
+  ChannelManager* channel_manager = GetChannelManager();
+  if (!channel_manager)
+    return;
+
+  DVLOG(2) << "Requesting bypass of relayer between processes "
+           << process_identifier << " and " << peer_process_identifier;
+  relayer->RequestBypass(
+      channel_manager->connection_manager()->GenerateConnectionIdentifier());
+}
+
 ChannelEndpointId Channel::AttachAndRunEndpoint(
     RefPtr<ChannelEndpoint>&& endpoint) {
-  DCHECK(endpoint);
-
   ChannelEndpointId local_id;
   ChannelEndpointId remote_id;
-  {
-    MutexLocker locker(&mutex_);
-
-    DLOG_IF(WARNING, is_shutting_down_)
-        << "AttachAndRunEndpoint() while shutting down";
-
-    do {
-      local_id = local_id_generator_.GetNext();
-    } while (local_id_to_endpoint_map_.find(local_id) !=
-             local_id_to_endpoint_map_.end());
-
-    // TODO(vtl): We also need to check for collisions of remote IDs here.
-    remote_id = remote_id_generator_.GetNext();
+  AttachEndpoint(std::move(endpoint), &local_id, &remote_id);
+  return remote_id;
+}
 
-    local_id_to_endpoint_map_[local_id] = endpoint;
+bool Channel::WriteMessageNoLock(std::unique_ptr<MessageInTransit> message) {
+  mutex_.AssertHeld();
+  if (!is_running_) {
+    // TODO(vtl): I think this is probably not an error condition, but I should
+    // think about it (and the shutdown sequence) more carefully.
+    LOG(WARNING) << "WriteMessage() after shutdown";
+    return false;
   }
 
-  if (!SendControlMessage(
-          MessageInTransit::Subtype::CHANNEL_ATTACH_AND_RUN_ENDPOINT, local_id,
-          remote_id, 0, nullptr)) {
-    HandleLocalError(
-        StringPrintf("Failed to send message to run remote endpoint (local "
-                     "ID %u, remote ID %u)",
-                     static_cast<unsigned>(local_id.value()),
-                     static_cast<unsigned>(remote_id.value()))
-            .c_str());
-    // TODO(vtl): Should we continue on to |AttachAndRun()|?
+  DLOG_IF(WARNING, is_shutting_down_) << "WriteMessage() while shutting down";
+  if (const TransportData* transport_data = message->transport_data()) {
+    num_handles_sent_.fetch_add(transport_data->num_handles(),
+                                std::memory_order_relaxed);
   }
-
-  endpoint->AttachAndRun(this, local_id, remote_id);
-  return remote_id;
+  return raw_channel_->WriteMessage(std::move(message));
 }
 
 bool Channel::SendControlMessage(MessageInTransit::Subtype subtype,
@@ -642,13 +805,23 @@ bool Channel::SendControlMessage(MessageInTransit::Subtype subtype,
                                  ChannelEndpointId remote_id,
                                  uint32_t num_bytes,
                                  const void* bytes) {
+  MutexLocker locker(&mutex_);
+  return SendControlMessageNoLock(subtype, local_id, remote_id, num_bytes,
+                                  bytes);
+}
+
+bool Channel::SendControlMessageNoLock(MessageInTransit::Subtype subtype,
+                                       ChannelEndpointId local_id,
+                                       ChannelEndpointId remote_id,
+                                       uint32_t num_bytes,
+                                       const void* bytes) {
   DVLOG(2) << "Sending channel control message: subtype " << subtype
            << ", local ID " << local_id << ", remote ID " << remote_id;
   std::unique_ptr<MessageInTransit> message(new MessageInTransit(
       MessageInTransit::Type::CHANNEL, subtype, num_bytes, bytes));
   message->set_source_id(local_id);
   message->set_destination_id(remote_id);
-  return WriteMessage(std::move(message));
+  return WriteMessageNoLock(std::move(message));
 }
 
 }  // namespace system
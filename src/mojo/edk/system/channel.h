@@ -7,15 +7,19 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "mojo/edk/platform/scoped_platform_handle.h"
 #include "mojo/edk/platform/task_runner.h"
 #include "mojo/edk/system/channel_endpoint.h"
 #include "mojo/edk/system/channel_endpoint_id.h"
+#include "mojo/edk/system/channel_id.h"
 #include "mojo/edk/system/incoming_endpoint.h"
 #include "mojo/edk/system/message_in_transit.h"
+#include "mojo/edk/system/process_identifier.h"
 #include "mojo/edk/system/raw_channel.h"
 #include "mojo/edk/util/mutex.h"
 #include "mojo/edk/util/ref_counted.h"
@@ -28,6 +32,7 @@ namespace mojo {
 
 namespace embedder {
 class PlatformSupport;
+struct ChannelStats;
 }
 
 namespace platform {
@@ -38,6 +43,7 @@ namespace system {
 
 class ChannelEndpointClient;
 class ChannelManager;
+class EndpointRelayer;
 class MessageInTransitQueue;
 
 // This class is mostly thread-safe. It may be created and destroyed on any
@@ -63,12 +69,22 @@ class Channel final : public util::RefCountedThreadSafe<Channel>,
             platform::PlatformHandleWatcher* io_watcher,
             std::unique_ptr<RawChannel> raw_channel) MOJO_NOT_THREAD_SAFE;
 
-  // Sets the channel manager associated with this channel. This should be set
-  // at most once and only called before |WillShutdownSoon()| (and
-  // |Shutdown()|). (This is called by the channel manager when adding a
-  // channel; this should not be called before the channel is managed by the
-  // channel manager.)
-  void SetChannelManager(ChannelManager* channel_manager);
+  // Sets the channel manager associated with this channel (and the ID that it
+  // assigned to this channel). This should be set at most once and only called
+  // before |WillShutdownSoon()| (and |Shutdown()|). (This is called by the
+  // channel manager when adding a channel; this should not be called before the
+  // channel is managed by the channel manager.)
+  void SetChannelManager(ChannelManager* channel_manager,
+                         ChannelId channel_id);
+
+  // Gets the channel manager associated with this channel, or null if there is
+  // none (or if |WillShutdownSoon()| has been called).
+  ChannelManager* GetChannelManager() const;
+
+  // Gets the process identifier of the process at the other end of this
+  // channel, or |kInvalidProcessIdentifier| if it isn't known (e.g., if the
+  // channel wasn't set up via a |ConnectionManager|).
+  ProcessIdentifier GetPeerProcessIdentifier() const;
 
   // This must be called on the creation thread before destruction (which can
   // happen on any thread).
@@ -100,6 +116,29 @@ class Channel final : public util::RefCountedThreadSafe<Channel>,
                                    ChannelEndpointId local_id,
                                    ChannelEndpointId remote_id);
 
+  // Attaches the given (non-bootstrap) endpoint to this channel and runs it,
+  // assigning it new local and remote IDs (returned via |*local_id| and
+  // |*remote_id|), and tells the remote side to create an (incoming) endpoint
+  // for it, as |SerializeEndpoint...()| do. The caller is responsible for
+  // getting the IDs to the remote side (by some other means), which should then
+  // call |ClaimIncomingEndpoint()| with the IDs interchanged. (Since the remote
+  // side always has an endpoint for it, the endpoint may be detached at any
+  // time.)
+  void AttachEndpoint(util::RefPtr<ChannelEndpoint>&& endpoint,
+                      ChannelEndpointId* local_id,
+                      ChannelEndpointId* remote_id);
+
+  // The other half of |AttachEndpoint()|: claims the incoming endpoint with the
+  // given IDs (which were allocated by the remote side, so |local_id| should be
+  // "remote" and |remote_id| should not be). If the remote side's message
+  // telling us to create it hasn't been received yet (since the IDs may arrive
+  // via another channel first), the endpoint is created now, and that message
+  // will be ignored. Returns null if the IDs are invalid or |local_id| is
+  // already in use (other than by an unclaimed incoming endpoint).
+  util::RefPtr<IncomingEndpoint> ClaimIncomingEndpoint(
+      ChannelEndpointId local_id,
+      ChannelEndpointId remote_id);
+
   // This forwards |message| verbatim to |raw_channel_|.
   bool WriteMessage(std::unique_ptr<MessageInTransit> message);
 
@@ -173,6 +212,15 @@ class Channel final : public util::RefCountedThreadSafe<Channel>,
   // See |RawChannel::GetSerializedPlatformHandleSize()|.
   size_t GetSerializedPlatformHandleSize() const;
 
+  // Gets statistics for this channel (see |embedder::GetChannelStats()|). This
+  // may be called from any thread.
+  void GetStats(embedder::ChannelStats* stats) const;
+
+  // Returns the number of endpoints attached to this channel, including
+  // zombies (i.e., endpoints that have been detached but whose removal hasn't
+  // been acked by the remote side yet).
+  size_t GetNumEndpointsForTest() const;
+
   embedder::PlatformSupport* platform_support() const {
     return platform_support_;
   }
@@ -185,11 +233,6 @@ class Channel final : public util::RefCountedThreadSafe<Channel>,
   explicit Channel(embedder::PlatformSupport* platform_support);
   ~Channel() override;
 
-  // Helper for |DetachEndpoint()| (returns true if a "remove" should be sent).
-  bool DetachEndpointInternal(ChannelEndpoint* endpoint,
-                              ChannelEndpointId local_id,
-                              ChannelEndpointId remote_id);
-
   // |RawChannel::Delegate| implementation (only called on the creation thread):
   void OnReadMessage(
       const MessageInTransit::View& message_view,
@@ -223,17 +266,27 @@ class Channel final : public util::RefCountedThreadSafe<Channel>,
   // thread.
   void HandleLocalError(const char* error_message);
 
+  // Helper for |SerializeEndpointWithRemotePeer()|: Asks the endpoints on
+  // either side of a newly-created |EndpointRelayer| to connect to each other
+  // directly (if they're in processes that can be connected by the
+  // |ConnectionManager|). See |ChannelEndpoint::RequestBypass()|.
+  void MaybeRequestBypass(EndpointRelayer* relayer,
+                          ChannelEndpoint* peer_endpoint);
+
   // Helper for |SerializeEndpoint...()|: Attaches the given (non-bootstrap)
-  // endpoint to this channel and runs it. This assigns the endpoint both local
-  // and remote IDs. This will also send a
-  // |Subtype::CHANNEL_ATTACH_AND_RUN_ENDPOINT| message to the remote side to
-  // tell it to create an endpoint as well. This returns the *remote* ID (one
-  // for which |is_remote()| returns true).
+  // endpoint to this channel and runs it (see |AttachEndpoint()|). This will
+  // send a |Subtype::CHANNEL_ATTACH_AND_RUN_ENDPOINT| message to the remote
+  // side to tell it to create an endpoint as well. This returns the *remote* ID
+  // (one for which |is_remote()| returns true).
   //
   // TODO(vtl): Maybe limit the number of attached message pipes.
   ChannelEndpointId AttachAndRunEndpoint(
       util::RefPtr<ChannelEndpoint>&& endpoint);
 
+  // Like |WriteMessage()|, but must be called under |mutex_|.
+  bool WriteMessageNoLock(std::unique_ptr<MessageInTransit> message)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // Helper to send channel control messages. Returns true on success. Callable
   // from any thread.
   bool SendControlMessage(MessageInTransit::Subtype subtype,
@@ -241,6 +294,13 @@ class Channel final : public util::RefCountedThreadSafe<Channel>,
                           ChannelEndpointId destination_id,
                           uint32_t num_bytes,
                           const void* bytes) MOJO_LOCKS_EXCLUDED(mutex_);
+  // Like |SendControlMessage()|, but must be called under |mutex_|.
+  bool SendControlMessageNoLock(MessageInTransit::Subtype subtype,
+                                ChannelEndpointId source_id,
+                                ChannelEndpointId destination_id,
+                                uint32_t num_bytes,
+                                const void* bytes)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
 #if !defined(NDEBUG) || defined(DCHECK_ALWAYS_ON)
   util::ThreadChecker thread_checker_;
@@ -265,6 +325,8 @@ class Channel final : public util::RefCountedThreadSafe<Channel>,
 
   // Has a reference to us.
   ChannelManager* channel_manager_ MOJO_GUARDED_BY(mutex_);
+  // The ID assigned to us by |channel_manager_| (valid if it is set).
+  ChannelId channel_id_ MOJO_GUARDED_BY(mutex_);
 
   using IdToEndpointMap =
       std::unordered_map<ChannelEndpointId, util::RefPtr<ChannelEndpoint>>;
@@ -277,12 +339,23 @@ class Channel final : public util::RefCountedThreadSafe<Channel>,
   using IdToIncomingEndpointMap =
       std::unordered_map<ChannelEndpointId, util::RefPtr<IncomingEndpoint>>;
   // Map from local IDs to incoming endpoints (i.e., those received inside other
-  // messages, but not yet claimed via |DeserializeEndpoint()|).
+  // messages, but not yet claimed via |DeserializeEndpoint()| or
+  // |ClaimIncomingEndpoint()|).
   IdToIncomingEndpointMap incoming_endpoints_ MOJO_GUARDED_BY(mutex_);
+  // Local IDs claimed via |ClaimIncomingEndpoint()| before the remote side's
+  // "attach and run endpoint" message was received (that message is then
+  // ignored).
+  std::unordered_set<ChannelEndpointId> claimed_endpoint_ids_
+      MOJO_GUARDED_BY(mutex_);
   // TODO(vtl): We need to keep track of remote IDs (so that we don't collide
   // if/when we wrap).
   RemoteChannelEndpointIdGenerator remote_id_generator_ MOJO_GUARDED_BY(mutex_);
 
+  // Handles attached to messages sent (on any thread) and received (on the
+  // creation thread), for |GetStats()|.
+  std::atomic<uint64_t> num_handles_sent_;
+  std::atomic<uint64_t> num_handles_received_;
+
   MOJO_DISALLOW_COPY_AND_ASSIGN(Channel);
 };
 
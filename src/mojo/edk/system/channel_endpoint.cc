@@ -10,15 +10,186 @@
 #include "mojo/edk/platform/thread_utils.h"
 #include "mojo/edk/system/channel.h"
 #include "mojo/edk/system/channel_endpoint_client.h"
+#include "mojo/edk/system/channel_manager.h"
+#include "mojo/edk/system/incoming_endpoint.h"
+#include "mojo/edk/system/message_in_transit.h"
+#include "mojo/public/c/system/macros.h"
 #include "mojo/public/cpp/system/macros.h"
 
 using mojo::platform::ThreadYield;
+using mojo::util::MakeRefCounted;
 using mojo::util::MutexLocker;
 using mojo::util::RefPtr;
 
 namespace mojo {
 namespace system {
 
+namespace {
+
+// Payload of the bypass handshake messages (see "Bypassing relayers" in
+// channel_endpoint.h).
+struct MOJO_ALIGNAS(8) ChannelEndpointBypassData {
+  ConnectionIdentifier connection_id;
+  // Only used for |Subtype::ENDPOINT_CLIENT_BYPASS_ATTACH|: the IDs of the
+  // sender's endpoint on the direct channel.
+  ChannelEndpointId local_id;
+  ChannelEndpointId remote_id;
+};
+
+std::unique_ptr<MessageInTransit> MakeBypassMessage(
+    MessageInTransit::Type type,
+    MessageInTransit::Subtype subtype,
+    const ConnectionIdentifier& connection_id,
+    ChannelEndpointId local_id = ChannelEndpointId(),
+    ChannelEndpointId remote_id = ChannelEndpointId()) {
+  ChannelEndpointBypassData data = {connection_id, local_id, remote_id};
+  return std::unique_ptr<MessageInTransit>(
+      new MessageInTransit(type, subtype, sizeof(data), &data));
+}
+
+bool IsBypassMessage(const MessageInTransit& message) {
+  if (message.type() != MessageInTransit::Type::ENDPOINT_CLIENT)
+    return false;
+  switch (message.subtype()) {
+    case MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_ALLOWED:
+    case MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_CANCEL:
+    case MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_ATTACH:
+    case MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_SWITCH:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns null if |message| is malformed.
+const ChannelEndpointBypassData* GetBypassData(
+    const MessageInTransit& message) {
+  if (message.num_bytes() != sizeof(ChannelEndpointBypassData) ||
+      message.transport_data())
+    return nullptr;
+  return static_cast<const ChannelEndpointBypassData*>(message.bytes());
+}
+
+}  // namespace
+
+// ChannelEndpoint::BypassClient -----------------------------------------------
+
+// The client of the endpoint on the direct channel (the "bypass endpoint"),
+// which just passes everything on to the |ChannelEndpoint| that owns the
+// bypass.
+class ChannelEndpoint::BypassClient final : public ChannelEndpointClient {
+ public:
+  // Note: Use |util::MakeRefCounted<BypassClient>()|.
+
+  // Sets the bypass endpoint whose client this is. If |Detach()| has already
+  // been called (or the endpoint has already been detached from its channel),
+  // this detaches from it immediately.
+  void SetEndpoint(RefPtr<ChannelEndpoint>&& endpoint) {
+    {
+      MutexLocker locker(&mutex_);
+      DCHECK(!endpoint_);
+      if (!is_detached_) {
+        endpoint_ = std::move(endpoint);
+        return;
+      }
+    }
+    endpoint->DetachFromClient();
+  }
+
+  // Detaches from the bypass endpoint (if this hasn't been done already). This
+  // must be called (by the owner) once the bypass endpoint is no longer wanted,
+  // unless it has been detached from its channel.
+  void Detach() {
+    RefPtr<ChannelEndpoint> endpoint;
+    {
+      MutexLocker locker(&mutex_);
+      is_detached_ = true;
+      endpoint = std::move(endpoint_);
+    }
+    if (endpoint)
+      endpoint->DetachFromClient();
+  }
+
+  // |ChannelEndpointClient| methods:
+  bool OnReadMessage(unsigned /*port*/, MessageInTransit* message) override {
+    owner_->OnReadMessageFromBypass(this,
+                                    std::unique_ptr<MessageInTransit>(message));
+    return true;
+  }
+  void OnDetachFromChannel(unsigned /*port*/) override {
+    owner_->OnBypassDetachFromChannel(this);
+    Detach();
+  }
+
+ private:
+  FRIEND_MAKE_REF_COUNTED(BypassClient);
+
+  explicit BypassClient(RefPtr<ChannelEndpoint>&& owner)
+      : owner_(std::move(owner)), is_detached_(false) {}
+  ~BypassClient() override {}
+
+  const RefPtr<ChannelEndpoint> owner_;
+
+  util::Mutex mutex_;
+  RefPtr<ChannelEndpoint> endpoint_ MOJO_GUARDED_BY(mutex_);
+  bool is_detached_ MOJO_GUARDED_BY(mutex_);
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(BypassClient);
+};
+
+// ChannelEndpoint::Bypass -----------------------------------------------------
+
+struct ChannelEndpoint::Bypass {
+  Bypass(const ConnectionIdentifier& connection_id,
+         ChannelManager* channel_manager)
+      : connection_id(connection_id), channel_manager(channel_manager) {}
+
+  // Called (outside |ChannelEndpoint::mutex_|) once this bypass has been given
+  // up (and taken from |bypass_|): gets rid of the bypass endpoint, and cancels
+  // the connection if we allowed it but never connected.
+  void Abandon() {
+    if (client)
+      client->Detach();
+    if (allowed && !connect_called)
+      channel_manager->CancelConnect(connection_id);
+  }
+
+  const ConnectionIdentifier connection_id;
+  // The channel manager for the old route's channel. (This remains valid while
+  // that channel is running, which it is while there's a bypass in progress.)
+  ChannelManager* const channel_manager;
+
+  // Set once |ChannelManager::AllowConnect()| has succeeded (and we've sent
+  // "allowed").
+  bool allowed = false;
+  // Set once we've received the peer's "allowed".
+  bool peer_allowed = false;
+  // Set once |ChannelManager::Connect()| has been called (after which
+  // |ConnectionManager::CancelConnect()| must not be called).
+  bool connect_called = false;
+  // Whether we were the "first" to connect (see |ConnectionManager|).
+  bool is_first = false;
+  // The direct channel to the peer's process (set on successful connection).
+  RefPtr<Channel> channel;
+  // The IDs from the first side's "attach", if it was received before
+  // |channel| was set.
+  ChannelEndpointId attach_local_id;
+  ChannelEndpointId attach_remote_id;
+  // The bypass endpoint (on |channel|) and its client.
+  RefPtr<ChannelEndpoint> endpoint;
+  RefPtr<BypassClient> client;
+
+  // Set once we've sent "switch" (so that we write via |endpoint|).
+  bool switched = false;
+  // Set once we've received the peer's "switch" (and flushed |message_queue|),
+  // so that messages received via |endpoint| are delivered immediately.
+  bool peer_switched = false;
+  // Messages received via |endpoint| before the peer's "switch".
+  MessageInTransitQueue message_queue;
+};
+
+// ChannelEndpoint -------------------------------------------------------------
+
 bool ChannelEndpoint::EnqueueMessage(
     std::unique_ptr<MessageInTransit> message) {
   DCHECK(message);
@@ -30,7 +201,12 @@ bool ChannelEndpoint::EnqueueMessage(
       channel_message_queue_.AddMessage(std::move(message));
       return true;
     case State::RUNNING:
-      return WriteMessageNoLock(std::move(message));
+      if (!bypass_ || !bypass_->switched)
+        return WriteMessageNoLock(std::move(message));
+    // Fall through.
+    case State::BYPASSED:
+      return bypass_->endpoint &&
+             bypass_->endpoint->EnqueueMessage(std::move(message));
     case State::DEAD:
       return false;
   }
@@ -52,14 +228,56 @@ bool ChannelEndpoint::ReplaceClient(RefPtr<ChannelEndpointClient>&& client,
 }
 
 void ChannelEndpoint::DetachFromClient() {
+  RefPtr<BypassClient> bypass_client;
+  std::unique_ptr<Bypass> bypass;
+  {
+    MutexLocker locker(&mutex_);
+    DCHECK(client_);
+    client_ = nullptr;
+
+    if (bypass_) {
+      // If we're the second side and have already switched, the first side will
+      // detach the old route (see |OnBypassSwitch()|), so just wait for that
+      // (rather than crossing "remove" messages with it).
+      if (state_ != State::RUNNING || !bypass_->switched ||
+          bypass_->is_first) {
+        bypass = std::move(bypass_);
+      } else {
+        bypass_->endpoint = nullptr;
+        bypass_client = std::move(bypass_->client);
+      }
+    }
+
+    if (state_ == State::BYPASSED) {
+      state_ = State::DEAD;
+    } else if (channel_ && !bypass_) {
+      channel_->DetachEndpoint(this, local_id_, remote_id_);
+      DieNoLock();
+    }
+  }
+
+  if (bypass_client)
+    bypass_client->Detach();
+  if (bypass)
+    bypass->Abandon();
+}
+
+ProcessIdentifier ChannelEndpoint::GetPeerProcessIdentifierForBypass() {
   MutexLocker locker(&mutex_);
-  DCHECK(client_);
-  client_ = nullptr;
+  if (state_ != State::RUNNING || bypass_ || forwards_bypass_messages_)
+    return kInvalidProcessIdentifier;
+  return channel_->GetPeerProcessIdentifier();
+}
 
-  if (!channel_)
+void ChannelEndpoint::RequestBypass(const ConnectionIdentifier& connection_id) {
+  MutexLocker locker(&mutex_);
+  if (state_ != State::RUNNING || bypass_ || forwards_bypass_messages_)
     return;
-  channel_->DetachEndpoint(this, local_id_, remote_id_);
-  DieNoLock();
+
+  forwards_bypass_messages_ = true;
+  WriteMessageNoLock(MakeBypassMessage(
+      MessageInTransit::Type::ENDPOINT,
+      MessageInTransit::Subtype::ENDPOINT_BYPASS_REQUEST, connection_id));
 }
 
 void ChannelEndpoint::AttachAndRun(Channel* channel,
@@ -91,32 +309,32 @@ void ChannelEndpoint::AttachAndRun(Channel* channel,
 }
 
 void ChannelEndpoint::OnReadMessage(std::unique_ptr<MessageInTransit> message) {
-  if (message->type() == MessageInTransit::Type::ENDPOINT_CLIENT) {
-    OnReadMessageForClient(std::move(message));
-    return;
-  }
-
-  DCHECK_EQ(message->type(), MessageInTransit::Type::ENDPOINT);
-
-  // TODO(vtl)
-  // Note that this won't crash on Release builds, which is important (since the
-  // other side may be malicious). Doing nothing is safe and will dispose of the
-  // message.
-  NOTREACHED();
+  DispatchMessage(std::move(message));
 }
 
 void ChannelEndpoint::DetachFromChannel() {
   RefPtr<ChannelEndpointClient> client;
   unsigned client_port = 0;
+  std::unique_ptr<Bypass> bypass;
   {
     MutexLocker locker(&mutex_);
 
+    if (state_ == State::RUNNING && bypass_ && bypass_->switched &&
+        bypass_->peer_switched && bypass_->endpoint) {
+      // Both sides have switched to the bypass route, and the other side has
+      // given up the old route.
+      BypassNoLock();
+      return;
+    }
+
     if (client_) {
       // Take a ref, and call |OnDetachFromChannel()| outside the lock.
       client = client_;
       client_port = client_port_;
     }
 
+    bypass = std::move(bypass_);
+
     // |channel_| may already be null if we already detached from the channel in
     // |DetachFromClient()| by calling |Channel::DetachEndpoint()| (and there
     // are racing detaches).
@@ -126,6 +344,9 @@ void ChannelEndpoint::DetachFromChannel() {
       DCHECK(state_ == State::DEAD);
   }
 
+  if (bypass)
+    bypass->Abandon();
+
   // If |ReplaceClient()| is called (from another thread) after the above locked
   // section but before we call |OnDetachFromChannel()|, |ReplaceClient()|
   // returns false to notify the caller that the channel was already detached.
@@ -141,7 +362,8 @@ ChannelEndpoint::ChannelEndpoint(RefPtr<ChannelEndpointClient>&& client,
     : state_(State::PAUSED),
       client_(std::move(client)),
       client_port_(client_port),
-      channel_(nullptr) {
+      channel_(nullptr),
+      forwards_bypass_messages_(false) {
   DCHECK(client_ || message_queue);
 
   if (message_queue)
@@ -153,6 +375,7 @@ ChannelEndpoint::~ChannelEndpoint() {
   DCHECK(!channel_);
   DCHECK(!local_id_.is_valid());
   DCHECK(!remote_id_.is_valid());
+  DCHECK(!bypass_ || !bypass_->client);
 }
 
 bool ChannelEndpoint::WriteMessageNoLock(
@@ -171,6 +394,35 @@ bool ChannelEndpoint::WriteMessageNoLock(
   return channel_->WriteMessage(std::move(message));
 }
 
+void ChannelEndpoint::DispatchMessage(
+    std::unique_ptr<MessageInTransit> message) {
+  if (message->type() == MessageInTransit::Type::ENDPOINT_CLIENT) {
+    if (IsBypassMessage(*message))
+      OnReadBypassMessage(std::move(message));
+    else
+      OnReadMessageForClient(std::move(message));
+    return;
+  }
+
+  DCHECK_EQ(message->type(), MessageInTransit::Type::ENDPOINT);
+
+  if (message->subtype() ==
+      MessageInTransit::Subtype::ENDPOINT_BYPASS_REQUEST) {
+    const ChannelEndpointBypassData* data = GetBypassData(*message);
+    if (!data) {
+      LOG(WARNING) << "Received invalid bypass request";
+      return;
+    }
+    OnBypassRequest(data->connection_id);
+    return;
+  }
+
+  // Note that this won't crash on Release builds, which is important (since the
+  // other side may be malicious). Doing nothing is safe and will dispose of the
+  // message.
+  NOTREACHED();
+}
+
 void ChannelEndpoint::OnReadMessageForClient(
     std::unique_ptr<MessageInTransit> message) {
   DCHECK_EQ(message->type(), MessageInTransit::Type::ENDPOINT_CLIENT);
@@ -192,7 +444,7 @@ void ChannelEndpoint::OnReadMessageForClient(
   for (;;) {
     {
       MutexLocker locker(&mutex_);
-      if (!channel_ || !client_) {
+      if (state_ == State::DEAD || !client_) {
         // This isn't a failure per se. (It just means that, e.g., the other end
         // of the message pipe closed first.)
         return;
@@ -216,6 +468,429 @@ void ChannelEndpoint::OnReadMessageForClient(
   }
 }
 
+void ChannelEndpoint::OnReadBypassMessage(
+    std::unique_ptr<MessageInTransit> message) {
+  const ChannelEndpointBypassData* data = GetBypassData(*message);
+  if (!data) {
+    LOG(WARNING) << "Received invalid bypass message";
+    return;
+  }
+
+  {
+    MutexLocker locker(&mutex_);
+    if (!bypass_ || bypass_->connection_id != data->connection_id) {
+      // It's not for us. If we're relaying the handshake for some other bypass,
+      // pass it on (outside the lock); otherwise just drop it.
+      if (!forwards_bypass_messages_) {
+        DVLOG(2) << "Dropping bypass message (subtype " << message->subtype()
+                 << ")";
+        return;
+      }
+      data = nullptr;
+    }
+  }
+  if (!data) {
+    OnReadMessageForClient(std::move(message));
+    return;
+  }
+
+  switch (message->subtype()) {
+    case MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_ALLOWED:
+      OnBypassAllowed(data->connection_id);
+      break;
+    case MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_CANCEL:
+      OnBypassCancel(data->connection_id);
+      break;
+    case MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_ATTACH:
+      // The sender's local ID is our remote ID and vice versa.
+      OnBypassAttach(data->remote_id, data->local_id);
+      break;
+    case MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_SWITCH:
+      OnBypassSwitch();
+      break;
+    default:
+      NOTREACHED();
+      break;
+  }
+}
+
+void ChannelEndpoint::OnBypassRequest(
+    const ConnectionIdentifier& connection_id) {
+  ChannelManager* channel_manager = nullptr;
+  {
+    MutexLocker locker(&mutex_);
+    if (state_ != State::RUNNING)
+      return;
+
+    // Refuse if we're already involved in some other bypass (see "Bypassing
+    // relayers" in channel_endpoint.h).
+    if (!bypass_ && !forwards_bypass_messages_) {
+      channel_manager = channel_->GetChannelManager();
+      if (channel_manager && !channel_manager->connection_manager())
+        channel_manager = nullptr;
+    }
+    if (!channel_manager) {
+      DVLOG(2) << "Refusing bypass request";
+      WriteMessageNoLock(MakeBypassMessage(
+          MessageInTransit::Type::ENDPOINT_CLIENT,
+          MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_CANCEL,
+          connection_id));
+      return;
+    }
+
+    // Set this now, so that we'll refuse any other bypass in the meantime.
+    bypass_.reset(new Bypass(connection_id, channel_manager));
+  }
+
+  RefPtr<ChannelEndpoint> self(this);
+  channel_manager->AllowConnect(
+      connection_id, [self, channel_manager, connection_id](bool allowed) {
+        self->OnAllowConnect(channel_manager, connection_id, allowed);
+      });
+}
+
+void ChannelEndpoint::OnAllowConnect(ChannelManager* channel_manager,
+                                     const ConnectionIdentifier& connection_id,
+                                     bool allowed) {
+  {
+    MutexLocker locker(&mutex_);
+    if (state_ == State::RUNNING && bypass_ &&
+        bypass_->connection_id == connection_id) {
+      if (allowed) {
+        bypass_->allowed = true;
+        WriteMessageNoLock(MakeBypassMessage(
+            MessageInTransit::Type::ENDPOINT_CLIENT,
+            MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_ALLOWED,
+            connection_id));
+        // The peer's "allowed" may have arrived first.
+        if (bypass_->peer_allowed)
+          ConnectBypassNoLock();
+        return;
+      }
+
+      bypass_.reset();
+      WriteMessageNoLock(MakeBypassMessage(
+          MessageInTransit::Type::ENDPOINT_CLIENT,
+          MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_CANCEL,
+          connection_id));
+    }
+  }
+
+  // If we allowed the connection but are no longer in a position to use it
+  // (e.g., we were closed meanwhile), cancel it.
+  if (allowed)
+    channel_manager->CancelConnect(connection_id);
+}
+
+void ChannelEndpoint::OnBypassAllowed(
+    const ConnectionIdentifier& connection_id) {
+  MutexLocker locker(&mutex_);
+  if (state_ != State::RUNNING || !bypass_ || bypass_->peer_allowed)
+    return;
+  bypass_->peer_allowed = true;
+  // If we haven't allowed the connection ourselves yet, we'll connect once we
+  // have (see |OnAllowConnect()|).
+  if (bypass_->allowed)
+    ConnectBypassNoLock();
+}
+
+void ChannelEndpoint::ConnectBypassNoLock() {
+  mutex_.AssertHeld();
+  DCHECK(bypass_);
+  DCHECK(bypass_->allowed);
+  DCHECK(bypass_->peer_allowed);
+  DCHECK(!bypass_->connect_called);
+
+  bypass_->connect_called = true;
+  RefPtr<ChannelEndpoint> self(this);
+  ConnectionIdentifier connection_id = bypass_->connection_id;
+  bypass_->channel_manager->Connect(
+      connection_id,
+      [self, connection_id](RefPtr<Channel>&& channel, bool is_first) {
+        self->OnConnect(connection_id, std::move(channel), is_first);
+      });
+}
+
+void ChannelEndpoint::OnConnect(const ConnectionIdentifier& connection_id,
+                                RefPtr<Channel>&& channel,
+                                bool is_first) {
+  // The first side attaches its bypass endpoint now, and tells the second side
+  // the IDs. (The second side's channel will have an endpoint for it, even if
+  // we detach it before the second side gets the IDs.)
+  RefPtr<BypassClient> bypass_client;
+  RefPtr<ChannelEndpoint> endpoint;
+  ChannelEndpointId local_id;
+  ChannelEndpointId remote_id;
+  if (channel && is_first) {
+    endpoint = CreateBypassEndpoint(&bypass_client);
+    channel->AttachEndpoint(endpoint.Clone(), &local_id, &remote_id);
+  }
+
+  {
+    MutexLocker locker(&mutex_);
+    if (state_ == State::RUNNING && bypass_ &&
+        bypass_->connection_id == connection_id) {
+      if (channel) {
+        bypass_->is_first = is_first;
+        bypass_->channel = channel;
+        if (is_first) {
+          bypass_->endpoint = std::move(endpoint);
+          bypass_->client = std::move(bypass_client);
+          WriteMessageNoLock(MakeBypassMessage(
+              MessageInTransit::Type::ENDPOINT_CLIENT,
+              MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_ATTACH,
+              connection_id, local_id, remote_id));
+          return;
+        }
+
+        // The first side's "attach" may have arrived first.
+        local_id = bypass_->attach_local_id;
+        remote_id = bypass_->attach_remote_id;
+        if (!local_id.is_valid())
+          return;
+      } else {
+        bypass_.reset();
+        WriteMessageNoLock(MakeBypassMessage(
+            MessageInTransit::Type::ENDPOINT_CLIENT,
+            MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_CANCEL,
+            connection_id));
+      }
+    }
+  }
+
+  if (bypass_client)
+    bypass_client->Detach();
+  else if (channel && local_id.is_valid())
+    ClaimBypassEndpoint(std::move(channel), local_id, remote_id);
+}
+
+void ChannelEndpoint::OnBypassCancel(
+    const ConnectionIdentifier& connection_id) {
+  std::unique_ptr<Bypass> bypass;
+  {
+    MutexLocker locker(&mutex_);
+    // Once we've switched, the other side can no longer cancel.
+    if (!bypass_ || bypass_->switched)
+      return;
+    bypass = std::move(bypass_);
+  }
+
+  DVLOG(2) << "Bypass cancelled";
+  bypass->Abandon();
+}
+
+void ChannelEndpoint::OnBypassAttach(ChannelEndpointId local_id,
+                                     ChannelEndpointId remote_id) {
+  RefPtr<Channel> channel;
+  {
+    MutexLocker locker(&mutex_);
+    if (state_ != State::RUNNING || !bypass_ || !bypass_->connect_called ||
+        bypass_->is_first || bypass_->attach_local_id.is_valid() ||
+        bypass_->endpoint || bypass_->switched)
+      return;
+
+    if (!bypass_->channel) {
+      // We're still connecting; we'll claim our bypass endpoint once we're done
+      // (see |OnConnect()|).
+      bypass_->attach_local_id = local_id;
+      bypass_->attach_remote_id = remote_id;
+      return;
+    }
+    channel = bypass_->channel;
+  }
+
+  ClaimBypassEndpoint(std::move(channel), local_id, remote_id);
+}
+
+void ChannelEndpoint::ClaimBypassEndpoint(RefPtr<Channel>&& channel,
+                                          ChannelEndpointId local_id,
+                                          ChannelEndpointId remote_id) {
+  // Claim the endpoint that the first side attached (see |OnConnect()|), and
+  // make it our bypass endpoint.
+  auto bypass_client =
+      MakeRefCounted<BypassClient>(RefPtr<ChannelEndpoint>(this));
+  RefPtr<IncomingEndpoint> incoming_endpoint =
+      channel->ClaimIncomingEndpoint(local_id, remote_id);
+  RefPtr<ChannelEndpoint> endpoint;
+  if (incoming_endpoint)
+    endpoint = incoming_endpoint->ConvertToClient(bypass_client.Clone(), 0);
+  if (endpoint) {
+    {
+      // The bypass endpoint passes on any messages for other bypasses.
+      MutexLocker locker(&endpoint->mutex_);
+      endpoint->forwards_bypass_messages_ = true;
+    }
+    bypass_client->SetEndpoint(endpoint.Clone());
+  }
+
+  std::unique_ptr<Bypass> bypass;
+  {
+    MutexLocker locker(&mutex_);
+    if (state_ == State::RUNNING && bypass_ && bypass_->channel == channel &&
+        !bypass_->endpoint && !bypass_->switched) {
+      if (endpoint) {
+        // Tell the first side to switch over, and switch ourselves: anything
+        // we write from now on goes via the bypass endpoint.
+        bypass_->endpoint = std::move(endpoint);
+        bypass_->client = std::move(bypass_client);
+        WriteMessageNoLock(MakeBypassMessage(
+            MessageInTransit::Type::ENDPOINT_CLIENT,
+            MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_SWITCH,
+            bypass_->connection_id));
+        bypass_->switched = true;
+        return;
+      }
+
+      LOG(WARNING) << "Failed to claim bypass endpoint (local ID " << local_id
+                   << ", remote ID " << remote_id << ")";
+      WriteMessageNoLock(MakeBypassMessage(
+          MessageInTransit::Type::ENDPOINT_CLIENT,
+          MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_CANCEL,
+          bypass_->connection_id));
+      bypass = std::move(bypass_);
+    }
+  }
+
+  // Either way, we no longer want it.
+  bypass_client->Detach();
+  if (bypass)
+    bypass->Abandon();
+}
+
+void ChannelEndpoint::OnBypassSwitch() {
+  {
+    MutexLocker locker(&mutex_);
+    if (state_ != State::RUNNING || !bypass_ || !bypass_->channel)
+      return;
+
+    if (!bypass_->switched) {
+      // Only the first side gets "switch" before switching itself.
+      if (!bypass_->is_first) {
+        LOG(WARNING) << "Received unexpected bypass switch";
+        return;
+      }
+
+      // Tell the second side that it'll receive nothing more via the old
+      // route. (Don't bother if the bypass route is already gone.)
+      if (bypass_->endpoint) {
+        WriteMessageNoLock(MakeBypassMessage(
+            MessageInTransit::Type::ENDPOINT_CLIENT,
+            MessageInTransit::Subtype::ENDPOINT_CLIENT_BYPASS_SWITCH,
+            bypass_->connection_id));
+      }
+      bypass_->switched = true;
+    }
+  }
+
+  // We'll receive nothing more via the old route, so deliver what we've
+  // received via the bypass route.
+  FlushBypassMessageQueue();
+
+  RefPtr<ChannelEndpointClient> client;
+  unsigned client_port = 0;
+  {
+    MutexLocker locker(&mutex_);
+    // The second side waits for the old route to be removed (which happens once
+    // the first side detaches from it below).
+    if (state_ != State::RUNNING || !bypass_ || !bypass_->is_first)
+      return;
+
+    channel_->DetachEndpoint(this, local_id_, remote_id_);
+    if (bypass_->endpoint) {
+      BypassNoLock();
+      return;
+    }
+
+    // The bypass route is gone (i.e., the peer has been closed), so we're done.
+    bypass_.reset();
+    DieNoLock();
+    if (client_) {
+      client = client_;
+      client_port = client_port_;
+    }
+  }
+
+  if (client)
+    client->OnDetachFromChannel(client_port);
+}
+
+void ChannelEndpoint::FlushBypassMessageQueue() {
+  for (;;) {
+    MessageInTransitQueue messages;
+    {
+      MutexLocker locker(&mutex_);
+      if (!bypass_)
+        return;
+      if (bypass_->message_queue.IsEmpty()) {
+        bypass_->peer_switched = true;
+        return;
+      }
+      messages.Swap(&bypass_->message_queue);
+    }
+
+    // More messages may be queued while we deliver these (outside the lock),
+    // hence the loop.
+    while (!messages.IsEmpty())
+      DispatchMessage(messages.GetMessage());
+  }
+}
+
+RefPtr<ChannelEndpoint> ChannelEndpoint::CreateBypassEndpoint(
+    RefPtr<BypassClient>* bypass_client) {
+  *bypass_client = MakeRefCounted<BypassClient>(RefPtr<ChannelEndpoint>(this));
+  auto endpoint = MakeRefCounted<ChannelEndpoint>(bypass_client->Clone(), 0);
+  {
+    // The bypass endpoint passes on any messages for other bypasses.
+    MutexLocker locker(&endpoint->mutex_);
+    endpoint->forwards_bypass_messages_ = true;
+  }
+  (*bypass_client)->SetEndpoint(endpoint.Clone());
+  return endpoint;
+}
+
+void ChannelEndpoint::OnReadMessageFromBypass(
+    BypassClient* bypass_client,
+    std::unique_ptr<MessageInTransit> message) {
+  {
+    MutexLocker locker(&mutex_);
+    if (!bypass_ || bypass_->client.get() != bypass_client)
+      return;
+    if (!bypass_->peer_switched) {
+      bypass_->message_queue.AddMessage(std::move(message));
+      return;
+    }
+  }
+
+  DispatchMessage(std::move(message));
+}
+
+void ChannelEndpoint::OnBypassDetachFromChannel(BypassClient* bypass_client) {
+  RefPtr<ChannelEndpointClient> client;
+  unsigned client_port = 0;
+  {
+    MutexLocker locker(&mutex_);
+    if (!bypass_ || bypass_->client.get() != bypass_client)
+      return;
+
+    // (|bypass_client| detaches from the bypass endpoint itself.)
+    bypass_->endpoint = nullptr;
+    bypass_->client = nullptr;
+    // If we're still using the old route, it'll take care of things (we'll die
+    // when we're detached from it). Otherwise, we're done.
+    if (state_ == State::BYPASSED) {
+      bypass_.reset();
+      state_ = State::DEAD;
+      if (client_) {
+        client = client_;
+        client_port = client_port_;
+      }
+    }
+  }
+
+  if (client)
+    client->OnDetachFromChannel(client_port);
+}
+
 void ChannelEndpoint::DieNoLock() {
   DCHECK(state_ == State::RUNNING);
   DCHECK(channel_);
@@ -228,5 +903,17 @@ void ChannelEndpoint::DieNoLock() {
   remote_id_ = ChannelEndpointId();
 }
 
+void ChannelEndpoint::BypassNoLock() {
+  DCHECK(state_ == State::RUNNING);
+  DCHECK(channel_);
+  DCHECK(bypass_);
+  DCHECK(bypass_->endpoint);
+
+  state_ = State::BYPASSED;
+  channel_ = nullptr;
+  local_id_ = ChannelEndpointId();
+  remote_id_ = ChannelEndpointId();
+}
+
 }  // namespace system
 }  // namespace mojo
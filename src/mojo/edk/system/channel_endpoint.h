@@ -8,7 +8,9 @@
 #include <memory>
 
 #include "mojo/edk/system/channel_endpoint_id.h"
+#include "mojo/edk/system/connection_identifier.h"
 #include "mojo/edk/system/message_in_transit_queue.h"
+#include "mojo/edk/system/process_identifier.h"
 #include "mojo/edk/util/mutex.h"
 #include "mojo/edk/util/ref_counted.h"
 #include "mojo/edk/util/ref_ptr.h"
@@ -20,6 +22,7 @@ namespace system {
 
 class Channel;
 class ChannelEndpointClient;
+class ChannelManager;
 class MessageInTransit;
 
 // TODO(vtl): The plan:
@@ -110,6 +113,41 @@ class MessageInTransit;
 //         simultaneously, and both sides send "remove" messages). In that
 //         case, it must still remain alive until it receives the "remove
 //         ack" (and it must ack the "remove" message that it received).
+//
+// Bypassing relayers:
+//   - When an endpoint whose peer is remote is sent over another channel (from
+//     a process M), M ends up with an |EndpointRelayer| relaying messages
+//     between two of its channels. If the processes on the far sides of those
+//     channels (A and B) can be connected directly (via the
+//     |ConnectionManager|), M asks the |ChannelEndpoint|s in A and B to do so
+//     (|RequestBypass()|), after which M drops out of the route.
+//   - Handshake (all these messages go via the old route, through M):
+//       - M sends a "bypass request" to both A and B. Each calls
+//         |ChannelManager::AllowConnect()| and, once that completes, replies
+//         "allowed".
+//       - Once it has both allowed the connection and received "allowed",
+//         each calls |ChannelManager::Connect()|, getting a direct channel.
+//         (These |ChannelManager| calls complete asynchronously, so the I/O
+//         thread never waits for the master process.) The "first" side
+//         attaches a new endpoint to it (with a |BypassClient|), which also
+//         creates an incoming endpoint on the second side's end, and sends
+//         "attach" with the IDs to the second side.
+//       - The second side claims that endpoint (waiting until it has connected,
+//         if necessary), sends "switch", and from then on writes via the direct
+//         channel.
+//       - The first side, on receiving "switch", sends its own "switch", starts
+//         writing via the direct channel, and detaches from the old channel
+//         (so that M tears down the relayer, and sends a "remove" to the
+//         second side).
+//       - Messages received via the direct channel are queued until the peer's
+//         "switch" has been received, so that ordering is preserved.
+//   - Either side may instead reply "cancel", in which case the relayer just
+//     stays in place. Endpoints that are already involved in a bypass (or are
+//     themselves clients of a relayer) refuse requests.
+//   - A side that gives up on the bypass (e.g., on "cancel", or because it was
+//     closed) after allowing the connection but before connecting cancels the
+//     connection (|ChannelManager::CancelConnect()|), and detaches its bypass
+//     endpoint (if any) as usual.
 class ChannelEndpoint final
     : public util::RefCountedThreadSafe<ChannelEndpoint> {
  public:
@@ -136,6 +174,20 @@ class ChannelEndpoint final
   // object.
   void DetachFromClient();
 
+  // Methods called by |EndpointRelayer| (and |Channel|, on its behalf):
+
+  // Returns the identifier of the process at the other end of this endpoint's
+  // channel if this endpoint is running and could be bypassed (see
+  // |RequestBypass()|), and |kInvalidProcessIdentifier| otherwise.
+  ProcessIdentifier GetPeerProcessIdentifierForBypass();
+
+  // Called by this endpoint's client, which should be an |EndpointRelayer|, to
+  // ask the remote endpoint to connect directly (using |connection_id|) to the
+  // remote endpoint on the other side of the relayer. (See "Bypassing
+  // relayers" above.) Thereafter, this endpoint relays messages for the bypass
+  // handshake to its client instead of dropping them.
+  void RequestBypass(const ConnectionIdentifier& connection_id);
+
   // Methods called by |Channel|:
 
   // Called when the |Channel| takes a reference to this object. This will send
@@ -155,6 +207,9 @@ class ChannelEndpoint final
   FRIEND_REF_COUNTED_THREAD_SAFE(ChannelEndpoint);
   FRIEND_MAKE_REF_COUNTED(ChannelEndpoint);
 
+  class BypassClient;
+  struct Bypass;
+
   // Constructor for a |ChannelEndpoint| with the given client (specified by
   // |client| and |client_port|). Optionally takes messages from
   // |*message_queue| if |message_queue| is non-null.
@@ -172,13 +227,67 @@ class ChannelEndpoint final
   bool WriteMessageNoLock(std::unique_ptr<MessageInTransit> message)
       MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  // Helper for |OnReadMessage()|, handling messages for the client.
+  // Helper for |OnReadMessage()|, also used for messages received via the
+  // bypass route (once they may be delivered).
+  void DispatchMessage(std::unique_ptr<MessageInTransit> message);
+
+  // Helper for |DispatchMessage()|, handling messages for the client.
   void OnReadMessageForClient(std::unique_ptr<MessageInTransit> message);
 
+  // Helper for |DispatchMessage()|, handling |Type::ENDPOINT_CLIENT| messages
+  // used for the bypass handshake.
+  void OnReadBypassMessage(std::unique_ptr<MessageInTransit> message);
+
+  // Handlers for the various bypass handshake messages (see "Bypassing
+  // relayers" above), and for the completion of the |ChannelManager| calls
+  // that they make. These are only called on the (old) channel's I/O thread.
+  void OnBypassRequest(const ConnectionIdentifier& connection_id);
+  void OnAllowConnect(ChannelManager* channel_manager,
+                      const ConnectionIdentifier& connection_id,
+                      bool allowed);
+  void OnBypassAllowed(const ConnectionIdentifier& connection_id);
+  void OnConnect(const ConnectionIdentifier& connection_id,
+                 util::RefPtr<Channel>&& channel,
+                 bool is_first);
+  void OnBypassCancel(const ConnectionIdentifier& connection_id);
+  void OnBypassAttach(ChannelEndpointId local_id, ChannelEndpointId remote_id);
+  void OnBypassSwitch();
+
+  // Calls |ChannelManager::Connect()| for |bypass_|, once both sides have
+  // allowed the connection.
+  void ConnectBypassNoLock() MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Used by the second side to claim the bypass endpoint that the first side
+  // attached to |channel| (with the given IDs, from our point of view), after
+  // which it sends "switch".
+  void ClaimBypassEndpoint(util::RefPtr<Channel>&& channel,
+                           ChannelEndpointId local_id,
+                           ChannelEndpointId remote_id);
+
+  // Delivers the messages queued in |bypass_->message_queue|, after which
+  // messages received via the bypass route are delivered immediately.
+  void FlushBypassMessageQueue();
+
+  // Creates a (paused) bypass endpoint, whose client is a |BypassClient| for
+  // this endpoint (returned via |*bypass_client|).
+  util::RefPtr<ChannelEndpoint> CreateBypassEndpoint(
+      util::RefPtr<BypassClient>* bypass_client);
+
+  // Called by |bypass_client| when its bypass endpoint receives a message or is
+  // detached from its channel. (Calls from clients other than |bypass_->client|
+  // are ignored.)
+  void OnReadMessageFromBypass(BypassClient* bypass_client,
+                               std::unique_ptr<MessageInTransit> message);
+  void OnBypassDetachFromChannel(BypassClient* bypass_client);
+
   // Moves |state_| from |RUNNING| to |DEAD|. |channel_| must be non-null, but
   // this does not call |channel_->DetachEndpoint()|.
   void DieNoLock() MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Moves |state_| from |RUNNING| to |BYPASSED|. Like |DieNoLock()|, this does
+  // not call |channel_->DetachEndpoint()|.
+  void BypassNoLock() MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   util::Mutex mutex_;
 
   enum class State {
@@ -187,6 +296,9 @@ class ChannelEndpoint final
     // |AttachAndRun()| has been called, but not |DetachFromChannel()|
     // (|channel_| is non-null and valid).
     RUNNING,
+    // The route via |channel_| has been bypassed and we've detached from it
+    // (|channel_| is null); messages now go via |bypass_->endpoint|.
+    BYPASSED,
     // |DetachFromChannel()| has been called (|channel_| is null).
     DEAD
   };
@@ -220,6 +332,14 @@ class ChannelEndpoint final
   // messages to the channel.
   MessageInTransitQueue channel_message_queue_ MOJO_GUARDED_BY(mutex_);
 
+  // State for a bypass (of a remote relayer) that is being set up or has been
+  // set up; null if there is none.
+  std::unique_ptr<Bypass> bypass_ MOJO_GUARDED_BY(mutex_);
+  // Set if bypass handshake messages that aren't for |bypass_| should be passed
+  // on to the client (i.e., if the client is an |EndpointRelayer| that
+  // requested a bypass, or a |BypassClient|), rather than dropped.
+  bool forwards_bypass_messages_ MOJO_GUARDED_BY(mutex_);
+
   MOJO_DISALLOW_COPY_AND_ASSIGN(ChannelEndpoint);
 };
 
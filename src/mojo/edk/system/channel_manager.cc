@@ -7,15 +7,21 @@
 #include <utility>
 
 #include "base/logging.h"
+#include "mojo/edk/embedder/ipc_stats.h"
+#include "mojo/edk/platform/io_thread.h"
 #include "mojo/edk/platform/platform_handle.h"
+#include "mojo/edk/platform/thread.h"
 #include "mojo/edk/system/channel.h"
 #include "mojo/edk/system/channel_endpoint.h"
+#include "mojo/edk/system/connection_manager.h"
 #include "mojo/edk/system/message_pipe_dispatcher.h"
+#include "mojo/edk/util/waitable_event.h"
 
 using mojo::platform::PlatformHandle;
 using mojo::platform::PlatformHandleWatcher;
 using mojo::platform::ScopedPlatformHandle;
 using mojo::platform::TaskRunner;
+using mojo::util::AutoResetWaitableEvent;
 using mojo::util::MakeRefCounted;
 using mojo::util::MutexLocker;
 using mojo::util::RefPtr;
@@ -23,18 +29,34 @@ using mojo::util::RefPtr;
 namespace mojo {
 namespace system {
 
+namespace {
+
+// Runs |callback| using |callback_thread_task_runner| if it is non-null, and
+// otherwise on the primary I/O thread (given by |primary_io_task_runner|).
+void RunCallback(const RefPtr<TaskRunner>& primary_io_task_runner,
+                 std::function<void()>&& callback,
+                 RefPtr<TaskRunner>&& callback_thread_task_runner) {
+  if (callback_thread_task_runner)
+    callback_thread_task_runner->PostTask(std::move(callback));
+  else if (!primary_io_task_runner->RunsTasksOnCurrentThread())
+    primary_io_task_runner->PostTask(std::move(callback));
+  else
+    callback();
+}
+
+}  // namespace
+
 ChannelManager::ChannelManager(embedder::PlatformSupport* platform_support,
                                RefPtr<TaskRunner>&& io_task_runner,
                                PlatformHandleWatcher* io_watcher,
                                ConnectionManager* connection_manager)
     : platform_support_(platform_support),
-      io_task_runner_(std::move(io_task_runner)),
-      io_watcher_(io_watcher),
-      connection_manager_(connection_manager) {
+      connection_manager_(connection_manager),
+      connect_context_(MakeRefCounted<ConnectContext>(this)),
+      is_shut_down_(false) {
   DCHECK(platform_support_);
-  DCHECK(io_task_runner_);
-  DCHECK(io_watcher_);
   // (|connection_manager_| may be null.)
+  AddIOThread(std::move(io_task_runner), io_watcher);
 }
 
 ChannelManager::~ChannelManager() {
@@ -45,17 +67,66 @@ ChannelManager::~ChannelManager() {
   DCHECK(channels_.empty());
 }
 
+void ChannelManager::AddIOThread(RefPtr<TaskRunner>&& io_task_runner,
+                                 PlatformHandleWatcher* io_watcher) {
+  DCHECK(io_task_runner);
+  DCHECK(io_watcher);
+
+  MutexLocker locker(&mutex_);
+  DCHECK(channels_.empty());
+  io_threads_.push_back(IOThread{std::move(io_task_runner), io_watcher});
+}
+
 void ChannelManager::ShutdownOnIOThread() {
-  // Taking this lock really shouldn't be necessary, but we do it for
-  // consistency.
-  ChannelIdToChannelMap channels;
+  DCHECK(io_threads_[0].task_runner->RunsTasksOnCurrentThread());
+
+  // Tasks posted by |AllowConnect()| and |Connect()| (which may add channels)
+  // may be running on other I/O threads; wait for them, and make sure that any
+  // that run later do nothing.
+  {
+    MutexLocker locker(&connect_context_->mutex);
+    connect_context_->channel_manager = nullptr;
+  }
+
+  ChannelIdToChannelInfoMap channels;
+  std::unique_ptr<platform::Thread> connect_thread;
   {
     MutexLocker locker(&mutex_);
     channels.swap(channels_);
+    is_shut_down_ = true;
+    connect_thread = std::move(connect_thread_);
+    pending_channels_.clear();
+  }
+
+  // This completes any |ConnectionManager| call in progress (the rest are
+  // skipped, since we're now shut down).
+  if (connect_thread)
+    connect_thread->Stop();
+  {
+    MutexLocker locker(&mutex_);
+    connect_task_runner_ = nullptr;
+  }
+
+  // Group the channels by I/O thread, so that we only have to wait for each
+  // I/O thread once.
+  std::vector<std::vector<RefPtr<Channel>>> channels_by_io_thread(
+      io_threads_.size());
+  for (auto& channel : channels) {
+    channels_by_io_thread[channel.second.io_thread_index].push_back(
+        std::move(channel.second.channel));
   }
 
-  for (auto& channel : channels)
-    channel.second->Shutdown();
+  for (size_t i = 0; i < io_threads_.size(); i++) {
+    if (channels_by_io_thread[i].empty())
+      continue;
+    // TODO(vtl): With C++14 lambda captures, we'll be able to move stuff
+    // instead of using a pointer.
+    std::vector<RefPtr<Channel>>* to_shut_down = &channels_by_io_thread[i];
+    RunOnIOThreadAndWait(io_threads_[i], [to_shut_down]() {
+      for (auto& channel : *to_shut_down)
+        channel->Shutdown();
+    });
+  }
 }
 
 void ChannelManager::Shutdown(
@@ -63,7 +134,7 @@ void ChannelManager::Shutdown(
     RefPtr<TaskRunner>&& callback_thread_task_runner) {
   // TODO(vtl): With C++14 lambda captures, we'll be able to move |callback| and
   // |callback_thread_task_runner| instead of copying them.
-  io_task_runner_->PostTask(
+  io_threads_[0].task_runner->PostTask(
       [this, callback, callback_thread_task_runner]() mutable {
         ShutdownOnIOThread();
         if (callback_thread_task_runner)
@@ -79,16 +150,15 @@ RefPtr<MessagePipeDispatcher> ChannelManager::CreateChannelOnIOThread(
   RefPtr<ChannelEndpoint> bootstrap_channel_endpoint;
   auto dispatcher = MessagePipeDispatcher::CreateRemoteMessagePipe(
       &bootstrap_channel_endpoint);
-  CreateChannelOnIOThreadHelper(channel_id, platform_handle.Pass(),
-                                std::move(bootstrap_channel_endpoint));
+  CreateChannelAndWait(channel_id, platform_handle.Pass(),
+                       std::move(bootstrap_channel_endpoint));
   return dispatcher;
 }
 
 RefPtr<Channel> ChannelManager::CreateChannelWithoutBootstrapOnIOThread(
     ChannelId channel_id,
     ScopedPlatformHandle platform_handle) {
-  return CreateChannelOnIOThreadHelper(channel_id, platform_handle.Pass(),
-                                       nullptr);
+  return CreateChannelAndWait(channel_id, platform_handle.Pass(), nullptr);
 }
 
 RefPtr<MessagePipeDispatcher> ChannelManager::CreateChannel(
@@ -105,25 +175,73 @@ RefPtr<MessagePipeDispatcher> ChannelManager::CreateChannel(
   // TODO(vtl): We have to copy or "unscope" various things due to C++11 lambda
   // capture limitations.
   PlatformHandle raw_platform_handle = platform_handle.release();
-  io_task_runner_->PostTask([this, channel_id, raw_platform_handle,
-                             bootstrap_channel_endpoint, callback,
-                             callback_thread_task_runner]() mutable {
-    CreateChannelOnIOThreadHelper(channel_id,
-                                  ScopedPlatformHandle(raw_platform_handle),
-                                  std::move(bootstrap_channel_endpoint));
-    if (callback_thread_task_runner)
-      callback_thread_task_runner->PostTask(std::move(callback));
-    else
-      callback();
-  });
+  size_t io_thread_index = GetIOThreadIndexForChannel(channel_id);
+  io_threads_[io_thread_index].task_runner->PostTask(
+      [this, channel_id, io_thread_index, raw_platform_handle,
+       bootstrap_channel_endpoint, callback,
+       callback_thread_task_runner]() mutable {
+        CreateChannelOnIOThreadHelper(channel_id, io_thread_index,
+                                      ScopedPlatformHandle(raw_platform_handle),
+                                      std::move(bootstrap_channel_endpoint));
+        RunCallback(io_threads_[0].task_runner, std::move(callback),
+                    std::move(callback_thread_task_runner));
+      });
   return dispatcher;
 }
 
+void ChannelManager::AllowConnect(const ConnectionIdentifier& connection_id,
+                                  std::function<void(bool)>&& callback) {
+  DCHECK(connection_manager_);
+  size_t io_thread_index = GetCurrentIOThreadIndex();
+
+  // TODO(vtl): With C++14 lambda captures, we'll be able to move |callback|.
+  PostConnectTask([this, connection_id, io_thread_index, callback]() {
+    bool allowed = connection_manager_->AllowConnect(connection_id);
+    PostConnectResult(io_thread_index,
+                      [callback, allowed]() { callback(allowed); });
+  });
+}
+
+void ChannelManager::CancelConnect(const ConnectionIdentifier& connection_id) {
+  DCHECK(connection_manager_);
+  PostConnectTask([this, connection_id]() {
+    connection_manager_->CancelConnect(connection_id);
+  });
+}
+
+void ChannelManager::Connect(
+    const ConnectionIdentifier& connection_id,
+    std::function<void(RefPtr<Channel>&&, bool)>&& callback) {
+  DCHECK(connection_manager_);
+  size_t io_thread_index = GetCurrentIOThreadIndex();
+
+  // TODO(vtl): With C++14 lambda captures, we'll be able to move |callback|.
+  PostConnectTask([this, connection_id, io_thread_index, callback]() mutable {
+    ConnectOnConnectThread(connection_id, io_thread_index,
+                           std::move(callback));
+  });
+}
+
 RefPtr<Channel> ChannelManager::GetChannel(ChannelId channel_id) const {
   MutexLocker locker(&mutex_);
   auto it = channels_.find(channel_id);
   DCHECK(it != channels_.end());
-  return it->second;
+  return it->second.channel;
+}
+
+void ChannelManager::GetAllChannelStats(
+    std::vector<embedder::ChannelStats>* stats) const {
+  std::vector<RefPtr<Channel>> channels;
+  {
+    MutexLocker locker(&mutex_);
+    channels.reserve(channels_.size());
+    for (const auto& entry : channels_)
+      channels.push_back(entry.second.channel);
+  }
+
+  stats->resize(channels.size());
+  for (size_t i = 0; i < channels.size(); i++)
+    channels[i]->GetStats(&(*stats)[i]);
 }
 
 void ChannelManager::WillShutdownChannel(ChannelId channel_id) {
@@ -132,14 +250,17 @@ void ChannelManager::WillShutdownChannel(ChannelId channel_id) {
 
 void ChannelManager::ShutdownChannelOnIOThread(ChannelId channel_id) {
   RefPtr<Channel> channel;
+  size_t io_thread_index;
   {
     MutexLocker locker(&mutex_);
     auto it = channels_.find(channel_id);
     DCHECK(it != channels_.end());
-    channel = std::move(it->second);
+    channel = std::move(it->second.channel);
+    io_thread_index = it->second.io_thread_index;
     channels_.erase(it);
   }
-  channel->Shutdown();
+  RunOnIOThreadAndWait(io_threads_[io_thread_index],
+                       [&channel]() { channel->Shutdown(); });
 }
 
 void ChannelManager::ShutdownChannel(
@@ -147,36 +268,230 @@ void ChannelManager::ShutdownChannel(
     std::function<void()>&& callback,
     RefPtr<TaskRunner>&& callback_thread_task_runner) {
   RefPtr<Channel> channel;
+  size_t io_thread_index;
   {
     MutexLocker locker(&mutex_);
     auto it = channels_.find(channel_id);
     DCHECK(it != channels_.end());
-    channel.swap(it->second);
+    channel.swap(it->second.channel);
+    io_thread_index = it->second.io_thread_index;
     channels_.erase(it);
   }
   channel->WillShutdownSoon();
   // TODO(vtl): With C++14 lambda captures, we'll be able to move stuff instead
   // of copying.
-  io_task_runner_->PostTask(
-      [channel, callback, callback_thread_task_runner]() mutable {
+  // Note: Don't use |this| in the task, since we may have been destroyed by
+  // the time it runs.
+  RefPtr<TaskRunner> primary_io_task_runner = io_threads_[0].task_runner;
+  io_threads_[io_thread_index].task_runner->PostTask(
+      [channel, primary_io_task_runner, callback,
+       callback_thread_task_runner]() mutable {
         channel->Shutdown();
-        if (callback_thread_task_runner)
-          callback_thread_task_runner->PostTask(std::move(callback));
-        else
-          callback();
+        RunCallback(primary_io_task_runner, std::move(callback),
+                    std::move(callback_thread_task_runner));
       });
 }
 
+size_t ChannelManager::GetIOThreadIndexForChannel(ChannelId channel_id) const {
+  // Channel IDs are typically allocated sequentially (see, e.g.,
+  // |MasterConnectionManager| and |embedder::MakeChannelId()|), so this spreads
+  // channels evenly across the I/O threads.
+  return channel_id % io_threads_.size();
+}
+
+size_t ChannelManager::GetCurrentIOThreadIndex() const {
+  for (size_t i = 0; i < io_threads_.size(); i++) {
+    if (io_threads_[i].task_runner->RunsTasksOnCurrentThread())
+      return i;
+  }
+  NOTREACHED() << "Not on an I/O thread";
+  return 0;
+}
+
+bool ChannelManager::PostConnectTask(std::function<void()>&& task) {
+  MutexLocker locker(&mutex_);
+  if (is_shut_down_)
+    return false;
+
+  if (!connect_thread_) {
+    platform::PlatformHandleWatcher* unused_watcher = nullptr;
+    connect_thread_ = platform::CreateAndStartIOThread(&connect_task_runner_,
+                                                       &unused_watcher);
+  }
+  // The task is skipped if we're shut down before it runs. (Shutdown waits for
+  // |connect_thread_|, so |this| remains valid.)
+  // TODO(vtl): With C++14 lambda captures, we'll be able to move |task|.
+  connect_task_runner_->PostTask([this, task]() {
+    {
+      MutexLocker locker(&mutex_);
+      if (is_shut_down_)
+        return;
+    }
+    task();
+  });
+  return true;
+}
+
+void ChannelManager::PostConnectResult(size_t io_thread_index,
+                                       std::function<void()>&& task) {
+  RefPtr<ConnectContext> context = connect_context_;
+  // TODO(vtl): With C++14 lambda captures, we'll be able to move |task|.
+  io_threads_[io_thread_index].task_runner->PostTask([context, task]() {
+    MutexLocker locker(&context->mutex);
+    if (context->channel_manager)
+      task();
+  });
+}
+
+void ChannelManager::ConnectOnConnectThread(
+    const ConnectionIdentifier& connection_id,
+    size_t io_thread_index,
+    std::function<void(RefPtr<Channel>&&, bool)>&& callback) {
+  ProcessIdentifier peer_process_identifier = kInvalidProcessIdentifier;
+  bool is_first = false;
+  ScopedPlatformHandle platform_handle;
+  ConnectionManager::Result result = connection_manager_->Connect(
+      connection_id, &peer_process_identifier, &is_first, &platform_handle);
+
+  RefPtr<Channel> channel;
+  switch (result) {
+    case ConnectionManager::Result::FAILURE:
+      LOG(ERROR) << "Failed to connect (connection ID "
+                 << connection_id.ToString() << ")";
+      break;
+    case ConnectionManager::Result::SUCCESS:
+      // |Connect()| shouldn't return this.
+      NOTREACHED();
+      break;
+    case ConnectionManager::Result::SUCCESS_CONNECT_SAME_PROCESS:
+      // There's no channel to ourself.
+      break;
+    case ConnectionManager::Result::SUCCESS_CONNECT_NEW_CONNECTION: {
+      // Any |Connect()| that's told to reuse this connection from now on will
+      // wait for the channel (see below).
+      {
+        MutexLocker locker(&mutex_);
+        pending_channels_[peer_process_identifier];
+      }
+      // The channel lives on the I/O thread for its ID (like channels created
+      // by |CreateChannel()|), which needn't be the calling thread; |callback|
+      // is then run back on the calling thread. We rely on |ChannelId| and
+      // |ProcessIdentifier| being identical types (see
+      // |IPCSupport::ConnectToSlave()|).
+      size_t channel_io_thread_index =
+          GetIOThreadIndexForChannel(peer_process_identifier);
+      // TODO(vtl): With C++14 lambda captures, we'll be able to move
+      // |platform_handle| and |callback|.
+      PlatformHandle raw_platform_handle = platform_handle.release();
+      PostConnectResult(channel_io_thread_index, [this, peer_process_identifier,
+                                                  channel_io_thread_index,
+                                                  io_thread_index,
+                                                  raw_platform_handle, callback,
+                                                  is_first]() {
+        RefPtr<Channel> channel = CreateChannelOnIOThreadHelper(
+            peer_process_identifier, channel_io_thread_index,
+            ScopedPlatformHandle(raw_platform_handle), nullptr);
+
+        std::vector<PendingConnect> pending_connects;
+        {
+          MutexLocker locker(&mutex_);
+          auto it = pending_channels_.find(peer_process_identifier);
+          DCHECK(it != pending_channels_.end());
+          pending_connects.swap(it->second);
+          pending_channels_.erase(it);
+        }
+        for (const auto& pending_connect : pending_connects) {
+          auto pending_callback = pending_connect.callback;
+          PostConnectResult(pending_connect.io_thread_index,
+                            [channel, pending_callback]() {
+                              pending_callback(channel.Clone(), false);
+                            });
+        }
+
+        PostConnectResult(io_thread_index, [channel, callback, is_first]() {
+          callback(channel.Clone(), is_first);
+        });
+      });
+      return;
+    }
+    case ConnectionManager::Result::SUCCESS_CONNECT_REUSE_CONNECTION: {
+      MutexLocker locker(&mutex_);
+      auto pending_it = pending_channels_.find(peer_process_identifier);
+      if (pending_it != pending_channels_.end()) {
+        pending_it->second.push_back(
+            PendingConnect{io_thread_index, std::move(callback)});
+        return;
+      }
+      auto it = channels_.find(peer_process_identifier);
+      if (it == channels_.end()) {
+        LOG(ERROR) << "No channel to reuse for process "
+                   << peer_process_identifier;
+        break;
+      }
+      channel = it->second.channel;
+      break;
+    }
+  }
+
+  // TODO(vtl): With C++14 lambda captures, we'll be able to move |channel| and
+  // |callback|.
+  PostConnectResult(io_thread_index, [channel, callback, is_first]() {
+    callback(channel.Clone(), is_first);
+  });
+}
+
+void ChannelManager::RunOnIOThreadAndWait(const IOThread& io_thread,
+                                          std::function<void()>&& task) {
+  DCHECK(io_threads_[0].task_runner->RunsTasksOnCurrentThread());
+
+  if (io_thread.task_runner->RunsTasksOnCurrentThread()) {
+    task();
+    return;
+  }
+
+  AutoResetWaitableEvent event;
+  // TODO(vtl): With C++14 lambda captures, we'll be able to move |task|.
+  io_thread.task_runner->PostTask([&task, &event]() {
+    task();
+    event.Signal();
+  });
+  event.Wait();
+}
+
+RefPtr<Channel> ChannelManager::CreateChannelAndWait(
+    ChannelId channel_id,
+    ScopedPlatformHandle platform_handle,
+    RefPtr<ChannelEndpoint>&& bootstrap_channel_endpoint) {
+  RefPtr<Channel> channel;
+  // TODO(vtl): With C++14 lambda captures, we'll be able to move
+  // |platform_handle| and |bootstrap_channel_endpoint|.
+  PlatformHandle raw_platform_handle = platform_handle.release();
+  size_t io_thread_index = GetIOThreadIndexForChannel(channel_id);
+  RunOnIOThreadAndWait(
+      io_threads_[io_thread_index],
+      [this, channel_id, io_thread_index, raw_platform_handle,
+       &bootstrap_channel_endpoint, &channel]() {
+        channel = CreateChannelOnIOThreadHelper(
+            channel_id, io_thread_index,
+            ScopedPlatformHandle(raw_platform_handle),
+            std::move(bootstrap_channel_endpoint));
+      });
+  return channel;
+}
+
 RefPtr<Channel> ChannelManager::CreateChannelOnIOThreadHelper(
     ChannelId channel_id,
+    size_t io_thread_index,
     ScopedPlatformHandle platform_handle,
     RefPtr<ChannelEndpoint>&& bootstrap_channel_endpoint) {
   DCHECK_NE(channel_id, kInvalidChannelId);
   DCHECK(platform_handle.is_valid());
 
   // Create and initialize a |Channel|.
+  const IOThread& io_thread = io_threads_[io_thread_index];
+  DCHECK(io_thread.task_runner->RunsTasksOnCurrentThread());
   auto channel = MakeRefCounted<Channel>(platform_support_);
-  channel->Init(io_task_runner_.Clone(), io_watcher_,
+  channel->Init(io_thread.task_runner.Clone(), io_thread.watcher,
                 RawChannel::Create(platform_handle.Pass()));
   if (bootstrap_channel_endpoint)
     channel->SetBootstrapEndpoint(std::move(bootstrap_channel_endpoint));
@@ -184,9 +499,9 @@ RefPtr<Channel> ChannelManager::CreateChannelOnIOThreadHelper(
   {
     MutexLocker locker(&mutex_);
     CHECK(channels_.find(channel_id) == channels_.end());
-    channels_[channel_id] = channel;
+    channels_[channel_id] = ChannelInfo{channel, io_thread_index};
   }
-  channel->SetChannelManager(this);
+  channel->SetChannelManager(this, channel_id);
   return channel;
 }
 
@@ -8,12 +8,17 @@
 #include <stdint.h>
 
 #include <functional>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include "mojo/edk/platform/scoped_platform_handle.h"
 #include "mojo/edk/platform/task_runner.h"
 #include "mojo/edk/system/channel_id.h"
+#include "mojo/edk/system/connection_identifier.h"
+#include "mojo/edk/system/process_identifier.h"
 #include "mojo/edk/util/mutex.h"
+#include "mojo/edk/util/ref_counted.h"
 #include "mojo/edk/util/ref_ptr.h"
 #include "mojo/edk/util/thread_annotations.h"
 #include "mojo/public/cpp/system/macros.h"
@@ -25,11 +30,13 @@ class TaskRunner;
 namespace mojo {
 
 namespace embedder {
+struct ChannelStats;
 class PlatformSupport;
 }
 
 namespace platform {
 class PlatformHandleWatcher;
+class Thread;
 }
 
 namespace system {
@@ -42,31 +49,43 @@ class MessagePipeDispatcher;
 // This class manages and "owns" |Channel|s (which typically connect to other
 // processes) for a given process. This class is thread-safe, except as
 // specifically noted.
+//
+// Channels may be spread across several I/O threads (see |AddIOThread()|). Each
+// channel lives on the I/O thread determined by its |ChannelId| (except for
+// those created by |Connect()|). The "primary" I/O thread is the one given to
+// the constructor; the other |...OnIOThread()| methods must be called from it
+// (and will block, waiting for another I/O thread, if the channel in question
+// lives on that thread). Callbacks that aren't given a task runner are run on
+// the primary I/O thread.
 class ChannelManager {
  public:
   // |io_task_runner| and |io_watcher| should be the |TaskRunner| and
-  // |PlatformHandleWatcher|, respectively, for the I/O thread, on which this
-  // channel manager will create all channels. |connection_manager| is optional
-  // and may be null. All arguments (if non-null) must remain alive at least
-  // until after shutdown completion.
+  // |PlatformHandleWatcher|, respectively, for the primary I/O thread.
+  // |connection_manager| is optional and may be null. All arguments (if
+  // non-null) must remain alive at least until after shutdown completion.
   ChannelManager(embedder::PlatformSupport* platform_support,
                  util::RefPtr<platform::TaskRunner>&& io_task_runner,
                  platform::PlatformHandleWatcher* io_watcher,
                  ConnectionManager* connection_manager);
   ~ChannelManager();
 
+  // Adds an additional I/O thread, on which channels may be created. This must
+  // be called before any channels are created. The I/O thread must remain alive
+  // (and continue to process tasks) until after shutdown completion.
+  void AddIOThread(util::RefPtr<platform::TaskRunner>&& io_task_runner,
+                   platform::PlatformHandleWatcher* io_watcher);
+
   // Shuts down the channel manager, including shutting down all channels (as if
   // |ShutdownChannelOnIOThread()| were called for each channel). This must be
-  // called from the I/O thread (given to the constructor) and completes
-  // synchronously. This, or |Shutdown()|, must be called before destroying this
-  // object.
+  // called from the primary I/O thread and completes synchronously. This, or
+  // |Shutdown()|, must be called before destroying this object.
   void ShutdownOnIOThread();
 
   // Like |ShutdownOnIOThread()|, but may be called from any thread. On
   // completion, will call |callback| ("on" |io_task_runner| if
   // |callback_thread_task_runner| is null else by posted using
   // |callback_thread_task_runner|). Note: This will always post a task to the
-  // I/O thread, even it is the current thread.
+  // primary I/O thread, even it is the current thread.
   // TODO(vtl): Consider if this is really necessary, since it only has one use
   // (in tests).
   void Shutdown(
@@ -74,10 +93,10 @@ class ChannelManager {
       util::RefPtr<platform::TaskRunner>&& callback_thread_task_runner);
 
   // Creates a |Channel| and adds it to the set of channels managed by this
-  // |ChannelManager|. This must be called from the I/O thread (given to the
-  // constructor). |channel_id| should be a valid |ChannelId| (i.e., nonzero)
-  // not "assigned" to any other |Channel| being managed by this
-  // |ChannelManager|.
+  // |ChannelManager|. This must be called from the primary I/O thread (though
+  // the channel will be created on, and live on, its own I/O thread).
+  // |channel_id| should be a valid |ChannelId| (i.e., nonzero) not "assigned"
+  // to any other |Channel| being managed by this |ChannelManager|.
   util::RefPtr<MessagePipeDispatcher> CreateChannelOnIOThread(
       ChannelId channel_id,
       platform::ScopedPlatformHandle platform_handle);
@@ -92,17 +111,46 @@ class ChannelManager {
 
   // Like |CreateChannelOnIOThread()|, but may be called from any thread. On
   // completion, will call |callback| (using |callback_thread_task_runner| if it
-  // is non-null, else on the I/O thread). Note: This will always post a task to
-  // the I/O thread, even if called from that thread.
+  // is non-null, else on the primary I/O thread). Note: This will always post a
+  // task to the channel's I/O thread, even if called from that thread.
   util::RefPtr<MessagePipeDispatcher> CreateChannel(
       ChannelId channel_id,
       platform::ScopedPlatformHandle platform_handle,
       std::function<void()>&& callback,
       util::RefPtr<platform::TaskRunner>&& callback_thread_task_runner);
 
+  // Asynchronous versions of the |ConnectionManager| methods of the same names
+  // (which may block, waiting for the master process). These make the calls on
+  // a separate thread, so that they never block an I/O thread. |AllowConnect()|
+  // and |Connect()| must be called from one of this channel manager's I/O
+  // threads, and run |callback| on that same thread on completion -- unless
+  // this channel manager is shut down first, in which case |callback| is never
+  // run. |CancelConnect()| may be called from any thread (and does nothing
+  // after shutdown).
+  void AllowConnect(const ConnectionIdentifier& connection_id,
+                    std::function<void(bool)>&& callback);
+  void CancelConnect(const ConnectionIdentifier& connection_id);
+  // Completes a connection to another process that was set up using the
+  // |ConnectionManager| (both processes must have called |AllowConnect()| with
+  // |connection_id|). |callback| is given the |Channel| to that process (whose
+  // ID is the peer's process identifier), or null on failure, and |is_first| as
+  // |ConnectionManager::Connect()| sets it. If a new connection is made, the
+  // |Channel| is placed on an I/O thread like any other (see
+  // |GetIOThreadIndexForChannel()|), not necessarily the calling one. If there
+  // is already a connection to the peer process, its existing |Channel| is
+  // given.
+  void Connect(
+      const ConnectionIdentifier& connection_id,
+      std::function<void(util::RefPtr<Channel>&&, bool)>&& callback);
+
   // Gets the |Channel| with the given ID (which must exist).
   util::RefPtr<Channel> GetChannel(ChannelId channel_id) const;
 
+  // Gets the statistics (see |Channel::GetStats()|) of all the channels
+  // currently managed by this channel manager (replacing the contents of
+  // |*stats|).
+  void GetAllChannelStats(std::vector<embedder::ChannelStats>* stats) const;
+
   // Informs the channel manager (and thus channel) that it will be shutdown
   // soon (by calling |ShutdownChannel()|). Calling this is optional (and may in
   // fact be called multiple times) but it will suppress certain warnings (e.g.,
@@ -113,12 +161,12 @@ class ChannelManager {
   // Shuts down the channel specified by the given ID. This, or
   // |ShutdownChannel()|, should be called once per channel (created using
   // |CreateChannelOnIOThread()| or |CreateChannel()|). This must be called from
-  // the I/O thread.
+  // the primary I/O thread.
   void ShutdownChannelOnIOThread(ChannelId channel_id);
 
   // Like |ShutdownChannelOnIOThread()|, but may be called from any thread. It
-  // will always post a task to the I/O thread, and post |callback| to
-  // |callback_thread_task_runner| (or execute it directly on the I/O thread if
+  // will always post a task to the channel's I/O thread, and post |callback| to
+  // |callback_thread_task_runner| (or run it on the primary I/O thread if
   // |callback_thread_task_runner| is null) on completion.
   void ShutdownChannel(
       ChannelId channel_id,
@@ -128,29 +176,115 @@ class ChannelManager {
   ConnectionManager* connection_manager() const { return connection_manager_; }
 
  private:
-  // Used by |CreateChannelOnIOThread()| and |CreateChannel()|. Called on the
-  // I/O thread. |bootstrap_channel_endpoint| is optional and may be null.
-  // Returns the newly-created |Channel|.
+  struct IOThread {
+    util::RefPtr<platform::TaskRunner> task_runner;
+    platform::PlatformHandleWatcher* watcher;
+  };
+
+  struct ChannelInfo {
+    util::RefPtr<Channel> channel;
+    // Index (into |io_threads_|) of the I/O thread on which |channel| lives.
+    size_t io_thread_index;
+  };
+
+  // Shared with the tasks that |AllowConnect()| and |Connect()| post back to
+  // I/O threads, which may run after shutdown (and even destruction).
+  // |channel_manager| is reset by |ShutdownOnIOThread()|; the tasks hold
+  // |mutex| while they run, and do nothing once it has been reset.
+  struct ConnectContext : public util::RefCountedThreadSafe<ConnectContext> {
+    explicit ConnectContext(ChannelManager* channel_manager)
+        : channel_manager(channel_manager) {}
+
+    util::Mutex mutex;
+    ChannelManager* channel_manager MOJO_GUARDED_BY(mutex);
+  };
+
+  // A |Connect()| that was told to reuse the connection to a peer process for
+  // which a |Channel| is still being created (by another |Connect()|).
+  struct PendingConnect {
+    size_t io_thread_index;
+    std::function<void(util::RefPtr<Channel>&&, bool)> callback;
+  };
+
+  // Gets the index of the I/O thread on which a new channel with the given ID
+  // should live.
+  size_t GetIOThreadIndexForChannel(ChannelId channel_id) const;
+
+  // Gets the index of the current thread (which must be one of |io_threads_|).
+  size_t GetCurrentIOThreadIndex() const;
+
+  // Runs |task| on the given I/O thread, waiting for it to complete if that
+  // isn't the current thread. This must only be called from the primary I/O
+  // thread (so that I/O threads never wait on each other).
+  void RunOnIOThreadAndWait(const IOThread& io_thread,
+                            std::function<void()>&& task);
+
+  // Posts |task| to the thread used to make |ConnectionManager| calls (starting
+  // it if necessary). Returns false (dropping |task|) after shutdown.
+  bool PostConnectTask(std::function<void()>&& task);
+
+  // Posts |task| to the given I/O thread, on which it will be run unless this
+  // channel manager has been shut down by then (see |ConnectContext|). Called
+  // from the thread used to make |ConnectionManager| calls.
+  void PostConnectResult(size_t io_thread_index, std::function<void()>&& task);
+
+  // Helper for |Connect()|, called on the thread used to make
+  // |ConnectionManager| calls.
+  void ConnectOnConnectThread(
+      const ConnectionIdentifier& connection_id,
+      size_t io_thread_index,
+      std::function<void(util::RefPtr<Channel>&&, bool)>&& callback);
+
+  // Used by |CreateChannelOnIOThread()| and
+  // |CreateChannelWithoutBootstrapOnIOThread()|. Called on the primary I/O
+  // thread; runs |CreateChannelOnIOThreadHelper()| on the channel's I/O thread.
+  util::RefPtr<Channel> CreateChannelAndWait(
+      ChannelId channel_id,
+      platform::ScopedPlatformHandle platform_handle,
+      util::RefPtr<ChannelEndpoint>&& bootstrap_channel_endpoint);
+
+  // Used by |CreateChannelAndWait()|, |CreateChannel()|, and |Connect()|.
+  // Called on the channel's I/O thread (given by |io_thread_index|).
+  // |bootstrap_channel_endpoint| is optional and may be null. Returns the
+  // newly-created |Channel|.
   util::RefPtr<Channel> CreateChannelOnIOThreadHelper(
       ChannelId channel_id,
+      size_t io_thread_index,
       platform::ScopedPlatformHandle platform_handle,
       util::RefPtr<ChannelEndpoint>&& bootstrap_channel_endpoint);
 
   // Note: These must not be used after shutdown.
   embedder::PlatformSupport* const platform_support_;
-  const util::RefPtr<platform::TaskRunner> io_task_runner_;
-  platform::PlatformHandleWatcher* const io_watcher_;
   ConnectionManager* const connection_manager_;
 
+  // The I/O threads; the first is the primary I/O thread. This is only
+  // modified (by |AddIOThread()|) before any channels are created.
+  std::vector<IOThread> io_threads_;
+
+  const util::RefPtr<ConnectContext> connect_context_;
+
   // Note: |Channel| methods should not be called under |mutex_|.
   // TODO(vtl): Annotate the above rule using |MOJO_ACQUIRED_{BEFORE,AFTER}()|,
   // once clang actually checks such annotations.
   // https://github.com/domokit/mojo/issues/313
   mutable util::Mutex mutex_;
 
-  using ChannelIdToChannelMap =
-      std::unordered_map<ChannelId, util::RefPtr<Channel>>;
-  ChannelIdToChannelMap channels_ MOJO_GUARDED_BY(mutex_);
+  using ChannelIdToChannelInfoMap = std::unordered_map<ChannelId, ChannelInfo>;
+  ChannelIdToChannelInfoMap channels_ MOJO_GUARDED_BY(mutex_);
+  // Set by |ShutdownOnIOThread()|, after which no more channels may be added.
+  bool is_shut_down_ MOJO_GUARDED_BY(mutex_);
+
+  // The thread used to make (blocking) |ConnectionManager| calls, started on
+  // first use. (|Connect()| relies on there being just one such thread, which
+  // makes the calls in order.)
+  std::unique_ptr<platform::Thread> connect_thread_ MOJO_GUARDED_BY(mutex_);
+  util::RefPtr<platform::TaskRunner> connect_task_runner_
+      MOJO_GUARDED_BY(mutex_);
+
+  // Peer processes to which |Connect()| is creating a |Channel| (on some I/O
+  // thread), each with the |Connect()|s waiting for that channel.
+  std::unordered_map<ProcessIdentifier, std::vector<PendingConnect>>
+      pending_channels_ MOJO_GUARDED_BY(mutex_);
 
   MOJO_DISALLOW_COPY_AND_ASSIGN(ChannelManager);
 };
@@ -16,6 +16,8 @@
 #include "mojo/edk/system/channel.h"
 #include "mojo/edk/system/channel_endpoint.h"
 #include "mojo/edk/system/message_pipe_dispatcher.h"
+#include "mojo/edk/system/test/test_io_thread.h"
+#include "mojo/edk/system/waiter.h"
 #include "mojo/edk/util/ref_ptr.h"
 #include "mojo/public/cpp/system/macros.h"
 #include "testing/gtest/include/gtest/gtest.h"
@@ -156,6 +158,57 @@ TEST_F(ChannelManagerTest, CallsFromOtherThread) {
   EXPECT_EQ(MOJO_RESULT_OK, d->Close());
 }
 
+TEST_F(ChannelManagerTest, MultipleIOThreads) {
+  test::TestIOThread io_thread(test::TestIOThread::StartMode::AUTO);
+  channel_manager().AddIOThread(io_thread.task_runner().Clone(),
+                                io_thread.platform_handle_watcher());
+
+  PlatformPipe channel_pair;
+
+  // With two I/O threads, these should be on different I/O threads.
+  const ChannelId id1 = 1;
+  RefPtr<MessagePipeDispatcher> d1 = channel_manager().CreateChannelOnIOThread(
+      id1, channel_pair.handle0.Pass());
+  const ChannelId id2 = 2;
+  RefPtr<MessagePipeDispatcher> d2 = channel_manager().CreateChannelOnIOThread(
+      id2, channel_pair.handle1.Pass());
+
+  RefPtr<Channel> ch1 = channel_manager().GetChannel(id1);
+  EXPECT_TRUE(ch1);
+  RefPtr<Channel> ch2 = channel_manager().GetChannel(id2);
+  EXPECT_TRUE(ch2);
+
+  // The bootstrap message pipes should be connected. (Write to |d2|, since
+  // |d1|'s channel is the one that's on the (running) additional I/O thread.)
+  Waiter waiter;
+  waiter.Init();
+  ASSERT_EQ(MOJO_RESULT_OK,
+            d1->AddAwakable(&waiter, MOJO_HANDLE_SIGNAL_READABLE, 0, nullptr));
+  static const char kHello[] = "hello";
+  EXPECT_EQ(MOJO_RESULT_OK,
+            d2->WriteMessage(UserPointer<const void>(kHello), sizeof(kHello),
+                             nullptr, MOJO_WRITE_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(MOJO_RESULT_OK, waiter.Wait(MOJO_DEADLINE_INDEFINITE, nullptr));
+  d1->RemoveAwakable(&waiter, nullptr);
+
+  char buffer[100] = {};
+  uint32_t buffer_size = static_cast<uint32_t>(sizeof(buffer));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            d1->ReadMessage(UserPointer<void>(buffer),
+                            MakeUserPointer(&buffer_size), nullptr, nullptr,
+                            MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(sizeof(kHello), static_cast<size_t>(buffer_size));
+  EXPECT_STREQ(kHello, buffer);
+
+  channel_manager().ShutdownChannelOnIOThread(id1);
+  EXPECT_TRUE(ch1->HasOneRef());
+  channel_manager().ShutdownChannelOnIOThread(id2);
+  EXPECT_TRUE(ch2->HasOneRef());
+
+  EXPECT_EQ(MOJO_RESULT_OK, d1->Close());
+  EXPECT_EQ(MOJO_RESULT_OK, d2->Close());
+}
+
 // TODO(vtl): Test |CreateChannelWithoutBootstrapOnIOThread()|. (This will
 // require additional functionality in |Channel|.)
 
@@ -16,11 +16,17 @@ embedder::Configuration g_configuration = {
     1000000,             // max_wait_many_num_handles
     4 * 1024 * 1024,     // max_message_num_bytes
     10000,               // max_message_num_handles
+    0,                   // default_message_pipe_max_queued_messages
+    0,                   // default_message_pipe_max_queued_num_bytes
     256 * 1024 * 1024,   // max_data_pipe_capacity_bytes
     1024 * 1024,         // default_data_pipe_capacity_bytes
     16,                  // data_pipe_buffer_alignment_bytes
+    true,                // use_shared_memory_for_remote_data_pipes
     1024 * 1024 * 1024,  // max_shared_memory_num_bytes
-    1000000};            // max_wait_set_num_entries
+    1000000,             // max_wait_set_num_entries
+    0,                   // max_channel_write_coalescing_delay_microseconds
+    1,                   // num_io_threads
+    false};              // defer_close_teardown
 
 }  // namespace internal
 }  // namespace system
@@ -0,0 +1,36 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_EDK_SYSTEM_CONFIGURATION_TEST_UTILS_H_
+#define MOJO_EDK_SYSTEM_CONFIGURATION_TEST_UTILS_H_
+
+#include "mojo/edk/embedder/configuration.h"
+#include "mojo/edk/system/configuration.h"
+#include "mojo/public/cpp/system/macros.h"
+
+namespace mojo {
+namespace system {
+namespace test {
+
+// Saves the (global) configuration on construction and restores it on
+// destruction, so that a test may modify it using |GetMutableConfiguration()|
+// without affecting later tests, even if it fails (or returns) early.
+class ScopedConfigurationRestorer {
+ public:
+  ScopedConfigurationRestorer() : saved_configuration_(GetConfiguration()) {}
+  ~ScopedConfigurationRestorer() {
+    *GetMutableConfiguration() = saved_configuration_;
+  }
+
+ private:
+  const embedder::Configuration saved_configuration_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(ScopedConfigurationRestorer);
+};
+
+}  // namespace test
+}  // namespace system
+}  // namespace mojo
+
+#endif  // MOJO_EDK_SYSTEM_CONFIGURATION_TEST_UTILS_H_
@@ -24,7 +24,9 @@
 #include "mojo/edk/system/memory.h"
 #include "mojo/edk/system/message_pipe.h"
 #include "mojo/edk/system/message_pipe_dispatcher.h"
+#include "mojo/edk/system/reclaimer.h"
 #include "mojo/edk/system/shared_buffer_dispatcher.h"
+#include "mojo/edk/system/wait_set_dispatcher.h"
 #include "mojo/edk/system/waiter.h"
 #include "mojo/public/c/system/macros.h"
 #include "mojo/public/cpp/system/macros.h"
@@ -37,6 +39,14 @@ using mojo::util::RefPtr;
 namespace mojo {
 namespace system {
 
+namespace {
+
+// Maximum number of buffers for |MojoWriteDataV()|/|MojoReadDataV()| (see
+// mojo/public/c/system/data_pipe.h).
+const uint32_t kMaxDataPipeNumBuffers = 1024;
+
+}  // namespace
+
 // Implementation notes
 //
 // Mojo primitives are implemented by the singleton |Core| object. Most calls
@@ -67,13 +77,14 @@ namespace system {
 // Thread-safety notes
 //
 // Mojo primitives calls are thread-safe. We achieve this with relatively
-// fine-grained locking. There is a global handle table lock. This lock should
-// be held as briefly as possible (TODO(vtl): a future improvement would be to
-// switch it to a reader-writer lock). Each |Dispatcher| object then has a lock
+// fine-grained locking. The handle table is internally locked; it is sharded
+// (by handle value) so that threads operating on different handles usually
+// don't contend. Its locks should be held as briefly as possible, and at most
+// one of them is held at a time. Each |Dispatcher| object then has a lock
 // (which subclasses can use to protect their data).
 //
 // The lock ordering is as follows:
-//   1. global handle table lock, global mapping table lock
+//   1. handle table (shard) locks, global mapping table lock
 //   2. |Dispatcher| locks
 //   3. secondary object locks
 //   ...
@@ -89,12 +100,14 @@ namespace system {
 
 Core::Core(embedder::PlatformSupport* platform_support)
     : platform_support_(platform_support),
-      handle_table_(GetConfiguration().max_handle_table_size) {}
+      handle_table_(GetConfiguration().max_handle_table_size) {
+  if (GetConfiguration().defer_close_teardown)
+    reclaimer_.reset(new Reclaimer());
+}
 
 Core::~Core() {}
 
 MojoHandle Core::AddHandle(Handle&& handle) {
-  MutexLocker locker(&handle_table_mutex_);
   return handle_table_.AddHandle(std::move(handle));
 }
 
@@ -102,7 +115,6 @@ MojoResult Core::GetHandle(MojoHandle handle, Handle* h) {
   if (handle == MOJO_HANDLE_INVALID)
     return MOJO_RESULT_INVALID_ARGUMENT;
 
-  MutexLocker locker(&handle_table_mutex_);
   return handle_table_.GetHandle(handle, h);
 }
 
@@ -110,7 +122,6 @@ MojoResult Core::GetAndRemoveHandle(MojoHandle handle, Handle* h) {
   if (handle == MOJO_HANDLE_INVALID)
     return MOJO_RESULT_INVALID_ARGUMENT;
 
-  MutexLocker locker(&handle_table_mutex_);
   return handle_table_.GetAndRemoveHandle(handle, h);
 }
 
@@ -162,16 +173,13 @@ MojoResult Core::Close(MojoHandle handle) {
     return MOJO_RESULT_INVALID_ARGUMENT;
 
   Handle h;
-  {
-    MutexLocker locker(&handle_table_mutex_);
-    MojoResult result = handle_table_.GetAndRemoveHandle(handle, &h);
-    if (result != MOJO_RESULT_OK)
-      return result;
-  }
+  MojoResult result = handle_table_.GetAndRemoveHandle(handle, &h);
+  if (result != MOJO_RESULT_OK)
+    return result;
 
   // The dispatcher doesn't have a say in being closed, but gets notified of it.
-  // Note: This is done outside of |handle_table_mutex_|. As a result, there's a
-  // race condition that the dispatcher must handle; see the comment in
+  // Note: This is done outside of the handle table's locks. As a result,
+  // there's a race condition that the dispatcher must handle; see the comment in
   // |Dispatcher| in dispatcher.h.
   return h.dispatcher->Close();
 }
@@ -195,13 +203,10 @@ MojoResult Core::ReplaceHandleWithReducedRights(
     return MOJO_RESULT_INVALID_ARGUMENT;
 
   MojoHandle replacement_handle_value = MOJO_HANDLE_INVALID;
-  {
-    MutexLocker locker(&handle_table_mutex_);
-    MojoResult result = handle_table_.ReplaceHandleWithReducedRights(
-        handle, rights_to_remove, &replacement_handle_value);
-    if (result != MOJO_RESULT_OK)
-      return result;
-  }
+  MojoResult result = handle_table_.ReplaceHandleWithReducedRights(
+      handle, rights_to_remove, &replacement_handle_value);
+  if (result != MOJO_RESULT_OK)
+    return result;
   DCHECK_NE(replacement_handle_value, MOJO_HANDLE_INVALID);
 
   replacement_handle.Put(replacement_handle_value);
@@ -302,15 +307,17 @@ MojoResult Core::CreateMessagePipe(
   auto dispatcher0 = MessagePipeDispatcher::Create(validated_options);
   auto dispatcher1 = MessagePipeDispatcher::Create(validated_options);
 
-  std::pair<MojoHandle, MojoHandle> handle_pair;
-  {
-    MutexLocker locker(&handle_table_mutex_);
-    handle_pair = handle_table_.AddHandlePair(
-        Handle(dispatcher0.Clone(),
-               MessagePipeDispatcher::kDefaultHandleRights),
-        Handle(dispatcher1.Clone(),
-               MessagePipeDispatcher::kDefaultHandleRights));
-  }
+  // The dispatchers must be initialized before they're added to the handle
+  // table (and so become visible to other threads).
+  auto message_pipe = MessagePipe::CreateLocalLocal();
+  message_pipe->SetQueueLimits(validated_options.max_queued_messages,
+                               validated_options.max_queued_num_bytes);
+  dispatcher0->Init(message_pipe.Clone(), 0);
+  dispatcher1->Init(std::move(message_pipe), 1);
+
+  std::pair<MojoHandle, MojoHandle> handle_pair = handle_table_.AddHandlePair(
+      Handle(dispatcher0.Clone(), MessagePipeDispatcher::kDefaultHandleRights),
+      Handle(dispatcher1.Clone(), MessagePipeDispatcher::kDefaultHandleRights));
   if (handle_pair.first == MOJO_HANDLE_INVALID) {
     DCHECK_EQ(handle_pair.second, MOJO_HANDLE_INVALID);
     LOG(ERROR) << "Handle table full";
@@ -319,10 +326,6 @@ MojoResult Core::CreateMessagePipe(
     return MOJO_RESULT_RESOURCE_EXHAUSTED;
   }
 
-  auto message_pipe = MessagePipe::CreateLocalLocal();
-  dispatcher0->Init(message_pipe.Clone(), 0);
-  dispatcher1->Init(std::move(message_pipe), 1);
-
   message_pipe_handle0.Put(handle_pair.first);
   message_pipe_handle1.Put(handle_pair.second);
   return MOJO_RESULT_OK;
@@ -354,7 +357,7 @@ MojoResult Core::WriteMessage(MojoHandle message_pipe_handle,
 
   // We have to handle |handles| here, since we have to mark them busy in the
   // global handle table. We can't delegate this to the dispatcher, since the
-  // handle table lock must be acquired before the dispatcher lock.
+  // handle table locks must be acquired before the dispatcher lock.
   //
   // (This leads to an oddity: |handles|/|num_handles| are always verified for
   // validity, even for dispatchers that don't support |WriteMessage()| and will
@@ -375,31 +378,23 @@ MojoResult Core::WriteMessage(MojoHandle message_pipe_handle,
   // When we pass handles, we have to try to take all their dispatchers' locks
   // and mark the handles as busy. If the call succeeds, we then remove the
   // handles from the handle table.
-  {
-    MutexLocker locker(&handle_table_mutex_);
-    MojoResult result = handle_table_.MarkBusyAndStartTransport(
-        message_pipe_handle, handles_reader.GetPointer(), num_handles,
-        &transports);
-    if (result != MOJO_RESULT_OK)
-      return result;
-  }
+  result = handle_table_.MarkBusyAndStartTransport(
+      message_pipe_handle, handles_reader.GetPointer(), num_handles,
+      &transports);
+  if (result != MOJO_RESULT_OK)
+    return result;
 
   result = dispatcher->WriteMessage(bytes, num_bytes, &transports, flags);
 
   // We need to release the dispatcher locks before we take the handle table
-  // lock.
+  // locks.
   for (uint32_t i = 0; i < num_handles; i++)
     transports[i].End();
 
-  {
-    MutexLocker locker(&handle_table_mutex_);
-    if (result == MOJO_RESULT_OK) {
-      handle_table_.RemoveBusyHandles(handles_reader.GetPointer(), num_handles);
-    } else {
-      handle_table_.RestoreBusyHandles(handles_reader.GetPointer(),
-                                       num_handles);
-    }
-  }
+  if (result == MOJO_RESULT_OK)
+    handle_table_.RemoveBusyHandles(handles_reader.GetPointer(), num_handles);
+  else
+    handle_table_.RestoreBusyHandles(handles_reader.GetPointer(), num_handles);
 
   return result;
 }
@@ -432,26 +427,8 @@ MojoResult Core::ReadMessage(MojoHandle message_pipe_handle,
       DCHECK(!num_handles.IsNull());
       DCHECK_LE(hs.size(), static_cast<size_t>(num_handles_value));
 
-      bool success;
-      UserPointer<MojoHandle>::Writer handles_writer(handles, hs.size());
-      {
-        MutexLocker locker(&handle_table_mutex_);
-        success =
-            handle_table_.AddHandleVector(&hs, handles_writer.GetPointer());
-      }
-      if (success) {
-        handles_writer.Commit();
-      } else {
-        LOG(ERROR) << "Received message with " << hs.size()
-                   << " handles, but handle table full";
-        // Close dispatchers (outside the lock).
-        for (size_t i = 0; i < hs.size(); i++) {
-          if (hs[i])
-            hs[i].dispatcher->Close();
-        }
-        if (result == MOJO_RESULT_OK)
-          result = MOJO_RESULT_RESOURCE_EXHAUSTED;
-      }
+      if (!AddReceivedHandles(&hs, handles))
+        result = MOJO_RESULT_RESOURCE_EXHAUSTED;
     }
   }
 
@@ -460,6 +437,118 @@ MojoResult Core::ReadMessage(MojoHandle message_pipe_handle,
   return result;
 }
 
+MojoResult Core::BeginReadMessage(MojoHandle message_pipe_handle,
+                                  UserPointer<void*> buffer,
+                                  UserPointer<uint32_t> buffer_num_bytes,
+                                  UserPointer<MojoHandle> handles,
+                                  UserPointer<uint32_t> num_handles,
+                                  MojoReadMessageFlags flags) {
+  RefPtr<Dispatcher> dispatcher;
+  MojoResult result =
+      GetDispatcherAndCheckRights(message_pipe_handle, MOJO_HANDLE_RIGHT_READ,
+                                  EntrypointClass::MESSAGE_PIPE, &dispatcher);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  uint32_t num_handles_value = num_handles.IsNull() ? 0 : num_handles.Get();
+
+  HandleVector hs;
+  result = dispatcher->BeginReadMessage(buffer, buffer_num_bytes,
+                                        num_handles_value ? &hs : nullptr,
+                                        &num_handles_value, flags);
+  if (!hs.empty()) {
+    DCHECK_EQ(result, MOJO_RESULT_OK);
+    DCHECK(!num_handles.IsNull());
+    DCHECK_LE(hs.size(), static_cast<size_t>(num_handles_value));
+
+    if (!AddReceivedHandles(&hs, handles)) {
+      // The message has been consumed, but the caller can't have it.
+      dispatcher->EndReadMessage();
+      result = MOJO_RESULT_RESOURCE_EXHAUSTED;
+    }
+  }
+
+  if (!num_handles.IsNull())
+    num_handles.Put(num_handles_value);
+  return result;
+}
+
+MojoResult Core::EndReadMessage(MojoHandle message_pipe_handle) {
+  RefPtr<Dispatcher> dispatcher;
+  MojoResult result =
+      GetDispatcherAndCheckRights(message_pipe_handle, MOJO_HANDLE_RIGHT_READ,
+                                  EntrypointClass::MESSAGE_PIPE, &dispatcher);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  return dispatcher->EndReadMessage();
+}
+
+MojoResult Core::WriteMessages(MojoHandle message_pipe_handle,
+                               UserPointer<const void> bytes,
+                               UserPointer<const uint32_t> message_num_bytes,
+                               uint32_t num_messages,
+                               UserPointer<uint32_t> num_messages_written,
+                               MojoWriteMessageFlags flags) {
+  RefPtr<Dispatcher> dispatcher;
+  MojoResult result =
+      GetDispatcherAndCheckRights(message_pipe_handle, MOJO_HANDLE_RIGHT_WRITE,
+                                  EntrypointClass::MESSAGE_PIPE, &dispatcher);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  uint32_t num_messages_written_value = 0;
+  result = dispatcher->WriteMessages(bytes, message_num_bytes, num_messages,
+                                     &num_messages_written_value, flags);
+  if (!num_messages_written.IsNull())
+    num_messages_written.Put(num_messages_written_value);
+  return result;
+}
+
+MojoResult Core::ReadMessages(MojoHandle message_pipe_handle,
+                              UserPointer<void> bytes,
+                              UserPointer<uint32_t> num_bytes,
+                              UserPointer<MojoHandle> handles,
+                              UserPointer<uint32_t> num_handles,
+                              UserPointer<uint32_t> message_num_bytes,
+                              UserPointer<uint32_t> message_num_handles,
+                              UserPointer<uint32_t> num_messages,
+                              MojoReadMessageFlags flags) {
+  RefPtr<Dispatcher> dispatcher;
+  MojoResult result =
+      GetDispatcherAndCheckRights(message_pipe_handle, MOJO_HANDLE_RIGHT_READ,
+                                  EntrypointClass::MESSAGE_PIPE, &dispatcher);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  uint32_t num_bytes_value = num_bytes.Get();
+  uint32_t num_handles_value = num_handles.IsNull() ? 0 : num_handles.Get();
+  uint32_t num_messages_value = num_messages.Get();
+  if (num_messages_value == 0)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  // All the messages' handles are added to the handle table in one go.
+  HandleVector hs;
+  result = dispatcher->ReadMessages(
+      bytes, &num_bytes_value, num_handles_value ? &hs : nullptr,
+      &num_handles_value, message_num_bytes, message_num_handles,
+      &num_messages_value, flags);
+  if (!hs.empty()) {
+    DCHECK_EQ(result, MOJO_RESULT_OK);
+    DCHECK(!num_handles.IsNull());
+    DCHECK_EQ(hs.size(), static_cast<size_t>(num_handles_value));
+
+    if (!AddReceivedHandles(&hs, handles))
+      result = MOJO_RESULT_RESOURCE_EXHAUSTED;
+  }
+
+  num_bytes.Put(num_bytes_value);
+  if (!num_handles.IsNull())
+    num_handles.Put(num_handles_value);
+  num_messages.Put(num_messages_value);
+  return result;
+}
+
 MojoResult Core::CreateDataPipe(
     UserPointer<const MojoCreateDataPipeOptions> options,
     UserPointer<MojoHandle> data_pipe_producer_handle,
@@ -473,15 +562,11 @@ MojoResult Core::CreateDataPipe(
   auto producer_dispatcher = DataPipeProducerDispatcher::Create();
   auto consumer_dispatcher = DataPipeConsumerDispatcher::Create();
 
-  std::pair<MojoHandle, MojoHandle> handle_pair;
-  {
-    MutexLocker locker(&handle_table_mutex_);
-    handle_pair = handle_table_.AddHandlePair(
-        Handle(producer_dispatcher.Clone(),
-               DataPipeProducerDispatcher::kDefaultHandleRights),
-        Handle(consumer_dispatcher.Clone(),
-               DataPipeConsumerDispatcher::kDefaultHandleRights));
-  }
+  std::pair<MojoHandle, MojoHandle> handle_pair = handle_table_.AddHandlePair(
+      Handle(producer_dispatcher.Clone(),
+             DataPipeProducerDispatcher::kDefaultHandleRights),
+      Handle(consumer_dispatcher.Clone(),
+             DataPipeConsumerDispatcher::kDefaultHandleRights));
   if (handle_pair.first == MOJO_HANDLE_INVALID) {
     DCHECK_EQ(handle_pair.second, MOJO_HANDLE_INVALID);
     LOG(ERROR) << "Handle table full";
@@ -567,6 +652,40 @@ MojoResult Core::EndWriteData(MojoHandle data_pipe_producer_handle,
   return dispatcher->EndWriteData(num_bytes_written);
 }
 
+MojoResult Core::BeginWriteDataSpans(MojoHandle data_pipe_producer_handle,
+                                     UserPointer<void*> buffers,
+                                     UserPointer<uint32_t> buffers_num_bytes,
+                                     MojoWriteDataFlags flags) {
+  RefPtr<Dispatcher> dispatcher;
+  MojoResult result = GetDispatcherAndCheckRights(
+      data_pipe_producer_handle, MOJO_HANDLE_RIGHT_WRITE,
+      EntrypointClass::DATA_PIPE_PRODUCER, &dispatcher);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  return dispatcher->BeginWriteDataSpans(buffers, buffers_num_bytes, flags);
+}
+
+MojoResult Core::WriteDataV(MojoHandle data_pipe_producer_handle,
+                            UserPointer<const void* const> buffers,
+                            UserPointer<const uint32_t> buffers_num_bytes,
+                            uint32_t num_buffers,
+                            UserPointer<uint32_t> num_bytes_written,
+                            MojoWriteDataFlags flags) {
+  RefPtr<Dispatcher> dispatcher;
+  MojoResult result = GetDispatcherAndCheckRights(
+      data_pipe_producer_handle, MOJO_HANDLE_RIGHT_WRITE,
+      EntrypointClass::DATA_PIPE_PRODUCER, &dispatcher);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  if (num_buffers > kMaxDataPipeNumBuffers)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  return dispatcher->WriteDataV(buffers, buffers_num_bytes, num_buffers,
+                                num_bytes_written, flags);
+}
+
 MojoResult Core::SetDataPipeConsumerOptions(
     MojoHandle data_pipe_consumer_handle,
     UserPointer<const MojoDataPipeConsumerOptions> options) {
@@ -634,6 +753,40 @@ MojoResult Core::EndReadData(MojoHandle data_pipe_consumer_handle,
   return dispatcher->EndReadData(num_bytes_read);
 }
 
+MojoResult Core::BeginReadDataSpans(MojoHandle data_pipe_consumer_handle,
+                                    UserPointer<const void*> buffers,
+                                    UserPointer<uint32_t> buffers_num_bytes,
+                                    MojoReadDataFlags flags) {
+  RefPtr<Dispatcher> dispatcher;
+  MojoResult result = GetDispatcherAndCheckRights(
+      data_pipe_consumer_handle, MOJO_HANDLE_RIGHT_READ,
+      EntrypointClass::DATA_PIPE_CONSUMER, &dispatcher);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  return dispatcher->BeginReadDataSpans(buffers, buffers_num_bytes, flags);
+}
+
+MojoResult Core::ReadDataV(MojoHandle data_pipe_consumer_handle,
+                           UserPointer<void* const> buffers,
+                           UserPointer<const uint32_t> buffers_num_bytes,
+                           uint32_t num_buffers,
+                           UserPointer<uint32_t> num_bytes_read,
+                           MojoReadDataFlags flags) {
+  RefPtr<Dispatcher> dispatcher;
+  MojoResult result = GetDispatcherAndCheckRights(
+      data_pipe_consumer_handle, MOJO_HANDLE_RIGHT_READ,
+      EntrypointClass::DATA_PIPE_CONSUMER, &dispatcher);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  if (num_buffers > kMaxDataPipeNumBuffers)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  return dispatcher->ReadDataV(buffers, buffers_num_bytes, num_buffers,
+                               num_bytes_read, flags);
+}
+
 MojoResult Core::CreateSharedBuffer(
     UserPointer<const MojoCreateSharedBufferOptions> options,
     uint64_t num_bytes,
@@ -717,13 +870,14 @@ MojoResult Core::MapBuffer(MojoHandle buffer_handle,
                            UserPointer<void*> buffer,
                            MojoMapBufferFlags flags) {
   RefPtr<Dispatcher> dispatcher;
-  // TODO(vtl): Currently we can only map read/write. So both
-  // |MOJO_HANDLE_RIGHT_MAP_READABLE| and |MOJO_HANDLE_RIGHT_MAP_WRITABLE| are
+  // Read-only mappings only require |MOJO_HANDLE_RIGHT_MAP_READABLE|; otherwise
+  // we map read/write, so both it and |MOJO_HANDLE_RIGHT_MAP_WRITABLE| are
   // required.
+  MojoHandleRights required_rights = MOJO_HANDLE_RIGHT_MAP_READABLE;
+  if (!(flags & MOJO_MAP_BUFFER_FLAG_READ_ONLY))
+    required_rights |= MOJO_HANDLE_RIGHT_MAP_WRITABLE;
   MojoResult result = GetDispatcherAndCheckRights(
-      buffer_handle,
-      MOJO_HANDLE_RIGHT_MAP_READABLE | MOJO_HANDLE_RIGHT_MAP_WRITABLE,
-      EntrypointClass::BUFFER, &dispatcher);
+      buffer_handle, required_rights, EntrypointClass::BUFFER, &dispatcher);
   if (result != MOJO_RESULT_OK)
     return result;
 
@@ -750,6 +904,74 @@ MojoResult Core::UnmapBuffer(UserPointer<void> buffer) {
   return mapping_table_.RemoveMapping(buffer.GetPointerValue());
 }
 
+MojoResult Core::CreateWaitSet(
+    UserPointer<const MojoCreateWaitSetOptions> options,
+    UserPointer<MojoHandle> wait_set_handle) {
+  MojoCreateWaitSetOptions validated_options = {};
+  MojoResult result =
+      WaitSetDispatcher::ValidateCreateOptions(options, &validated_options);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  auto dispatcher = WaitSetDispatcher::Create(validated_options);
+  MojoHandle handle = AddHandle(
+      Handle(dispatcher.Clone(), WaitSetDispatcher::kDefaultHandleRights));
+  if (handle == MOJO_HANDLE_INVALID) {
+    LOG(ERROR) << "Handle table full";
+    dispatcher->Close();
+    return MOJO_RESULT_RESOURCE_EXHAUSTED;
+  }
+
+  wait_set_handle.Put(handle);
+  return MOJO_RESULT_OK;
+}
+
+MojoResult Core::WaitSetAdd(UserPointer<const MojoWaitSetAddOptions> options,
+                            MojoHandle wait_set_handle,
+                            MojoHandle handle,
+                            MojoHandleSignals signals,
+                            uint64_t cookie) {
+  RefPtr<Dispatcher> dispatcher;
+  MojoResult result =
+      GetDispatcherAndCheckRights(wait_set_handle, MOJO_HANDLE_RIGHT_WRITE,
+                                  EntrypointClass::WAIT_SET, &dispatcher);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  Handle h;
+  result = GetHandle(handle, &h);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  return dispatcher->WaitSetAdd(options, std::move(h), signals, cookie);
+}
+
+MojoResult Core::WaitSetRemove(MojoHandle wait_set_handle, uint64_t cookie) {
+  RefPtr<Dispatcher> dispatcher;
+  MojoResult result =
+      GetDispatcherAndCheckRights(wait_set_handle, MOJO_HANDLE_RIGHT_WRITE,
+                                  EntrypointClass::WAIT_SET, &dispatcher);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  return dispatcher->WaitSetRemove(cookie);
+}
+
+MojoResult Core::WaitSetWait(MojoHandle wait_set_handle,
+                             MojoDeadline deadline,
+                             UserPointer<uint32_t> num_results,
+                             UserPointer<MojoWaitSetResult> results,
+                             UserPointer<uint32_t> max_results) {
+  RefPtr<Dispatcher> dispatcher;
+  MojoResult result =
+      GetDispatcherAndCheckRights(wait_set_handle, MOJO_HANDLE_RIGHT_READ,
+                                  EntrypointClass::WAIT_SET, &dispatcher);
+  if (result != MOJO_RESULT_OK)
+    return result;
+
+  return dispatcher->WaitSetWait(deadline, num_results, results, max_results);
+}
+
 // Note: We allow |handles| to repeat the same handle multiple times, since
 // different flags may be specified.
 // TODO(vtl): This incurs a performance cost in |Remove()|. Analyze this
@@ -766,33 +988,56 @@ MojoResult Core::WaitManyInternal(const MojoHandle* handles,
   DispatcherVector dispatchers;
   dispatchers.reserve(num_handles);
 
-  {
-    MutexLocker locker(&handle_table_mutex_);
-    for (uint32_t i = 0; i < num_handles; i++) {
-      if (handles[i] == MOJO_HANDLE_INVALID) {
-        *result_index = i;
-        return MOJO_RESULT_INVALID_ARGUMENT;
-      }
+  for (uint32_t i = 0; i < num_handles; i++) {
+    if (handles[i] == MOJO_HANDLE_INVALID) {
+      *result_index = i;
+      return MOJO_RESULT_INVALID_ARGUMENT;
+    }
 
-      Handle handle;
-      MojoResult result = handle_table_.GetHandle(handles[i], &handle);
-      if (result != MOJO_RESULT_OK) {
-        *result_index = i;
-        return result;
+    Handle handle;
+    MojoResult result = handle_table_.GetHandle(handles[i], &handle);
+    if (result != MOJO_RESULT_OK) {
+      *result_index = i;
+      return result;
+    }
+    dispatchers.push_back(std::move(handle.dispatcher));
+  }
+
+  // Fast path: If we can get the handles' states without taking any locks and
+  // one of them already satisfies (or can never satisfy) its signals, there's
+  // no need to add (and then remove) awakables, which takes the dispatchers'
+  // locks. The result is the same as for the slow path below.
+  for (uint32_t i = 0; i < num_handles; i++) {
+    HandleSignalsState state;
+    if (!dispatchers[i]->TryGetHandleSignalsState(&state))
+      break;
+    if (signals_states)
+      signals_states[i] = state;
+    if (!state.satisfies(signals[i]) && state.can_satisfy(signals[i]))
+      continue;
+
+    *result_index = i;
+    if (signals_states) {
+      for (uint32_t j = i + 1; j < num_handles; j++) {
+        if (!dispatchers[j]->TryGetHandleSignalsState(&signals_states[j]))
+          signals_states[j] = dispatchers[j]->GetHandleSignalsState();
       }
-      dispatchers.push_back(std::move(handle.dispatcher));
     }
+    return state.satisfies(signals[i]) ? MOJO_RESULT_OK
+                                       : MOJO_RESULT_FAILED_PRECONDITION;
   }
 
-  // TODO(vtl): Should make the waiter live (permanently) in TLS.
-  Waiter waiter;
-  waiter.Init();
+  // Note: A thread can only be in one |Wait()|/|WaitMany()| at a time, so we
+  // can reuse the same waiter (which saves constructing and destroying its
+  // mutex and condition variable on every call).
+  Waiter* waiter = Waiter::GetForCurrentThread();
+  waiter->Init();
 
   uint32_t i;
   MojoResult result = MOJO_RESULT_OK;
   for (i = 0; i < num_handles; i++) {
     result = dispatchers[i]->AddAwakable(
-        &waiter, signals[i], i, signals_states ? &signals_states[i] : nullptr);
+        waiter, signals[i], i, signals_states ? &signals_states[i] : nullptr);
     if (result != MOJO_RESULT_OK) {
       *result_index = i;
       break;
@@ -803,14 +1048,13 @@ MojoResult Core::WaitManyInternal(const MojoHandle* handles,
   if (result == MOJO_RESULT_ALREADY_EXISTS)
     result = MOJO_RESULT_OK;  // The i-th one is already "triggered".
   else if (result == MOJO_RESULT_OK)
-    result = waiter.Wait(deadline, result_index);
+    result = waiter->Wait(deadline, result_index);
 
   // Make sure no other dispatchers try to wake |waiter| for the current
-  // |Wait()|/|WaitMany()| call. (Only after doing this can |waiter| be
-  // destroyed, but this would still be required if the waiter were in TLS.)
+  // |Wait()|/|WaitMany()| call. (Only after doing this can |waiter| be reused.)
   for (i = 0; i < num_added; i++) {
     dispatchers[i]->RemoveAwakable(
-        &waiter, signals_states ? &signals_states[i] : nullptr);
+        waiter, signals_states ? &signals_states[i] : nullptr);
   }
   if (signals_states) {
     for (; i < num_handles; i++)
@@ -820,5 +1064,26 @@ MojoResult Core::WaitManyInternal(const MojoHandle* handles,
   return result;
 }
 
+bool Core::AddReceivedHandles(HandleVector* handles,
+                              UserPointer<MojoHandle> handle_values) {
+  DCHECK(!handles->empty());
+
+  UserPointer<MojoHandle>::Writer handles_writer(handle_values,
+                                                 handles->size());
+  if (handle_table_.AddHandleVector(handles, handles_writer.GetPointer())) {
+    handles_writer.Commit();
+    return true;
+  }
+
+  LOG(ERROR) << "Received message with " << handles->size()
+             << " handles, but handle table full";
+  // Close dispatchers (outside the lock).
+  for (size_t i = 0; i < handles->size(); i++) {
+    if ((*handles)[i])
+      (*handles)[i].dispatcher->Close();
+  }
+  return false;
+}
+
 }  // namespace system
 }  // namespace mojo
@@ -8,6 +8,7 @@
 #include <stdint.h>
 
 #include <functional>
+#include <memory>
 
 #include "mojo/edk/system/entrypoint_class.h"
 #include "mojo/edk/system/handle.h"
@@ -23,6 +24,7 @@
 #include "mojo/public/c/system/message_pipe.h"
 #include "mojo/public/c/system/result.h"
 #include "mojo/public/c/system/time.h"
+#include "mojo/public/c/system/wait_set.h"
 #include "mojo/public/cpp/system/macros.h"
 
 namespace mojo {
@@ -41,6 +43,8 @@ struct HandleSignalsState;
 //
 // Convention: |MojoHandle|s are referred to as |handle| or |foo_handle|,
 // whereas |Handle|s are just |h|.
+class Reclaimer;
+
 class Core {
  public:
   // ---------------------------------------------------------------------------
@@ -157,6 +161,28 @@ class Core {
                          UserPointer<MojoHandle> handles,
                          UserPointer<uint32_t> num_handles,
                          MojoReadMessageFlags flags);
+  MojoResult BeginReadMessage(MojoHandle message_pipe_handle,
+                              UserPointer<void*> buffer,
+                              UserPointer<uint32_t> buffer_num_bytes,
+                              UserPointer<MojoHandle> handles,
+                              UserPointer<uint32_t> num_handles,
+                              MojoReadMessageFlags flags);
+  MojoResult EndReadMessage(MojoHandle message_pipe_handle);
+  MojoResult WriteMessages(MojoHandle message_pipe_handle,
+                           UserPointer<const void> bytes,
+                           UserPointer<const uint32_t> message_num_bytes,
+                           uint32_t num_messages,
+                           UserPointer<uint32_t> num_messages_written,
+                           MojoWriteMessageFlags flags);
+  MojoResult ReadMessages(MojoHandle message_pipe_handle,
+                          UserPointer<void> bytes,
+                          UserPointer<uint32_t> num_bytes,
+                          UserPointer<MojoHandle> handles,
+                          UserPointer<uint32_t> num_handles,
+                          UserPointer<uint32_t> message_num_bytes,
+                          UserPointer<uint32_t> message_num_handles,
+                          UserPointer<uint32_t> num_messages,
+                          MojoReadMessageFlags flags);
 
   // These methods correspond to the API functions defined in
   // "mojo/public/c/system/data_pipe.h":
@@ -181,6 +207,16 @@ class Core {
                             MojoWriteDataFlags flags);
   MojoResult EndWriteData(MojoHandle data_pipe_producer_handle,
                           uint32_t num_bytes_written);
+  MojoResult BeginWriteDataSpans(MojoHandle data_pipe_producer_handle,
+                                 UserPointer<void*> buffers,
+                                 UserPointer<uint32_t> buffers_num_bytes,
+                                 MojoWriteDataFlags flags);
+  MojoResult WriteDataV(MojoHandle data_pipe_producer_handle,
+                        UserPointer<const void* const> buffers,
+                        UserPointer<const uint32_t> buffers_num_bytes,
+                        uint32_t num_buffers,
+                        UserPointer<uint32_t> num_bytes_written,
+                        MojoWriteDataFlags flags);
   MojoResult SetDataPipeConsumerOptions(
       MojoHandle data_pipe_consumer_handle,
       UserPointer<const MojoDataPipeConsumerOptions> options);
@@ -198,6 +234,16 @@ class Core {
                            MojoReadDataFlags flags);
   MojoResult EndReadData(MojoHandle data_pipe_consumer_handle,
                          uint32_t num_bytes_read);
+  MojoResult BeginReadDataSpans(MojoHandle data_pipe_consumer_handle,
+                                UserPointer<const void*> buffers,
+                                UserPointer<uint32_t> buffers_num_bytes,
+                                MojoReadDataFlags flags);
+  MojoResult ReadDataV(MojoHandle data_pipe_consumer_handle,
+                       UserPointer<void* const> buffers,
+                       UserPointer<const uint32_t> buffers_num_bytes,
+                       uint32_t num_buffers,
+                       UserPointer<uint32_t> num_bytes_read,
+                       MojoReadDataFlags flags);
 
   // These methods correspond to the API functions defined in
   // "mojo/public/c/system/buffer.h":
@@ -219,6 +265,22 @@ class Core {
                        MojoMapBufferFlags flags);
   MojoResult UnmapBuffer(UserPointer<void> buffer);
 
+  // These methods correspond to the API functions defined in
+  // "mojo/public/c/system/wait_set.h":
+  MojoResult CreateWaitSet(UserPointer<const MojoCreateWaitSetOptions> options,
+                           UserPointer<MojoHandle> wait_set_handle);
+  MojoResult WaitSetAdd(UserPointer<const MojoWaitSetAddOptions> options,
+                        MojoHandle wait_set_handle,
+                        MojoHandle handle,
+                        MojoHandleSignals signals,
+                        uint64_t cookie);
+  MojoResult WaitSetRemove(MojoHandle wait_set_handle, uint64_t cookie);
+  MojoResult WaitSetWait(MojoHandle wait_set_handle,
+                         MojoDeadline deadline,
+                         UserPointer<uint32_t> num_results,
+                         UserPointer<MojoWaitSetResult> results,
+                         UserPointer<uint32_t> max_results);
+
  private:
   friend bool internal::ShutdownCheckNoLeaks(Core*);
 
@@ -233,16 +295,23 @@ class Core {
                               uint64_t* result_index,
                               HandleSignalsState* signals_states);
 
+  // Adds the (non-empty) handles |*handles| received as part of a message to
+  // the handle table, writing their values to |handle_values|. If the handle
+  // table is full, closes the received handles instead and returns false.
+  bool AddReceivedHandles(HandleVector* handles,
+                          UserPointer<MojoHandle> handle_values);
+
   embedder::PlatformSupport* const platform_support_;
 
-  // TODO(vtl): |handle_table_mutex_| should be a reader-writer lock (if only we
-  // had them).
-  util::Mutex handle_table_mutex_;
-  HandleTable handle_table_ MOJO_GUARDED_BY(handle_table_mutex_);
+  // Note: |handle_table_| is thread-safe (and does its own locking).
+  HandleTable handle_table_;
 
   util::Mutex mapping_table_mutex_;
   MappingTable mapping_table_ MOJO_GUARDED_BY(mapping_table_mutex_);
 
+  // Only present if |embedder::Configuration::defer_close_teardown| is set.
+  std::unique_ptr<Reclaimer> reclaimer_;
+
   MOJO_DISALLOW_COPY_AND_ASSIGN(Core);
 };
 
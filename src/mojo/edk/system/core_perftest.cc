@@ -0,0 +1,231 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Multithreaded perf tests for |Core| entrypoints (in particular, for
+// contention on shared state, like the handle table).
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "base/logging.h"
+#include "mojo/edk/embedder/simple_platform_support.h"
+#include "mojo/edk/platform/test_stopwatch.h"
+#include "mojo/edk/system/core.h"
+#include "mojo/edk/system/test/perf_log.h"
+#include "mojo/edk/system/test/simple_test_thread.h"
+#include "mojo/edk/util/make_unique.h"
+#include "mojo/edk/util/string_printf.h"
+#include "mojo/public/cpp/system/macros.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using mojo::platform::test::Stopwatch;
+using mojo::util::MakeUnique;
+using mojo::util::StringPrintf;
+
+namespace mojo {
+namespace system {
+namespace {
+
+const unsigned kNumThreads[] = {1, 2, 4, 8};
+
+class CorePerfTest : public testing::Test {
+ public:
+  CorePerfTest()
+      : platform_support_(embedder::CreateSimplePlatformSupport()),
+        core_(platform_support_.get()) {}
+  ~CorePerfTest() override {}
+
+ protected:
+  Core* core() { return &core_; }
+
+ private:
+  std::unique_ptr<embedder::PlatformSupport> platform_support_;
+  Core core_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(CorePerfTest);
+};
+
+// Writes and then reads |num_iterations| messages on its own message pipe.
+class WriteReadThread : public test::SimpleTestThread {
+ public:
+  WriteReadThread(Core* core, unsigned num_iterations)
+      : core_(core), num_iterations_(num_iterations) {
+    CHECK_EQ(core_->CreateMessagePipe(NullUserPointer(), MakeUserPointer(&h0_),
+                                      MakeUserPointer(&h1_)),
+             MOJO_RESULT_OK);
+  }
+  ~WriteReadThread() override {
+    CHECK_EQ(core_->Close(h0_), MOJO_RESULT_OK);
+    CHECK_EQ(core_->Close(h1_), MOJO_RESULT_OK);
+  }
+
+ private:
+  void Run() override {
+    uint64_t buffer = 0;
+    for (unsigned i = 0; i < num_iterations_; i++) {
+      buffer = i;
+      CHECK_EQ(core_->WriteMessage(h0_, UserPointer<const void>(&buffer),
+                                   static_cast<uint32_t>(sizeof(buffer)),
+                                   NullUserPointer(), 0,
+                                   MOJO_WRITE_MESSAGE_FLAG_NONE),
+               MOJO_RESULT_OK);
+      uint32_t num_bytes = static_cast<uint32_t>(sizeof(buffer));
+      CHECK_EQ(core_->ReadMessage(h1_, UserPointer<void>(&buffer),
+                                  MakeUserPointer(&num_bytes),
+                                  NullUserPointer(), NullUserPointer(),
+                                  MOJO_READ_MESSAGE_FLAG_NONE),
+               MOJO_RESULT_OK);
+    }
+  }
+
+  Core* const core_;
+  const unsigned num_iterations_;
+  MojoHandle h0_;
+  MojoHandle h1_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(WriteReadThread);
+};
+
+// Each thread writes and reads messages on its own message pipe, so the only
+// contention is on state shared by all handles.
+TEST_F(CorePerfTest, MultithreadedWriteReadMessage) {
+  const unsigned kNumIterations = 100000;
+
+  for (size_t i = 0; i < MOJO_ARRAYSIZE(kNumThreads); i++) {
+    std::vector<std::unique_ptr<WriteReadThread>> threads;
+    for (unsigned j = 0; j < kNumThreads[i]; j++)
+      threads.push_back(MakeUnique<WriteReadThread>(core(), kNumIterations));
+
+    Stopwatch stopwatch;
+    stopwatch.Start();
+    for (auto& thread : threads)
+      thread->Start();
+    for (auto& thread : threads)
+      thread->Join();
+    double elapsed = stopwatch.Elapsed() / 1000000.0;
+
+    test::LogPerfResult(
+        StringPrintf("MultithreadedWriteReadMessage_%uThreads", kNumThreads[i])
+            .c_str(),
+        kNumThreads[i] * kNumIterations / elapsed, "messages/s");
+  }
+}
+
+// Each thread gets the rights of its own handle (which does nothing but look up
+// the handle).
+class GetRightsThread : public test::SimpleTestThread {
+ public:
+  GetRightsThread(Core* core, unsigned num_iterations)
+      : core_(core), num_iterations_(num_iterations) {
+    CHECK_EQ(core_->CreateMessagePipe(NullUserPointer(), MakeUserPointer(&h0_),
+                                      MakeUserPointer(&h1_)),
+             MOJO_RESULT_OK);
+  }
+  ~GetRightsThread() override {
+    CHECK_EQ(core_->Close(h0_), MOJO_RESULT_OK);
+    CHECK_EQ(core_->Close(h1_), MOJO_RESULT_OK);
+  }
+
+ private:
+  void Run() override {
+    for (unsigned i = 0; i < num_iterations_; i++) {
+      MojoHandleRights rights = MOJO_HANDLE_RIGHT_NONE;
+      CHECK_EQ(core_->GetRights(h0_, MakeUserPointer(&rights)),
+               MOJO_RESULT_OK);
+    }
+  }
+
+  Core* const core_;
+  const unsigned num_iterations_;
+  MojoHandle h0_;
+  MojoHandle h1_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(GetRightsThread);
+};
+
+TEST_F(CorePerfTest, MultithreadedGetRights) {
+  const unsigned kNumIterations = 1000000;
+
+  for (size_t i = 0; i < MOJO_ARRAYSIZE(kNumThreads); i++) {
+    std::vector<std::unique_ptr<GetRightsThread>> threads;
+    for (unsigned j = 0; j < kNumThreads[i]; j++)
+      threads.push_back(MakeUnique<GetRightsThread>(core(), kNumIterations));
+
+    Stopwatch stopwatch;
+    stopwatch.Start();
+    for (auto& thread : threads)
+      thread->Start();
+    for (auto& thread : threads)
+      thread->Join();
+    double elapsed = stopwatch.Elapsed() / 1000000.0;
+
+    test::LogPerfResult(
+        StringPrintf("MultithreadedGetRights_%uThreads", kNumThreads[i])
+            .c_str(),
+        kNumThreads[i] * kNumIterations / elapsed, "calls/s");
+  }
+}
+
+// Writes and reads messages carrying message pipe handles on a (local) message
+// pipe, resending the received handles each time.
+TEST_F(CorePerfTest, WriteReadMessageWithHandles) {
+  const unsigned kNumIterations = 10000;
+  const uint32_t kNumHandles[] = {1, 10, 100};
+
+  MojoHandle h0 = MOJO_HANDLE_INVALID;
+  MojoHandle h1 = MOJO_HANDLE_INVALID;
+  CHECK_EQ(core()->CreateMessagePipe(NullUserPointer(), MakeUserPointer(&h0),
+                                     MakeUserPointer(&h1)),
+           MOJO_RESULT_OK);
+
+  for (size_t i = 0; i < MOJO_ARRAYSIZE(kNumHandles); i++) {
+    std::vector<MojoHandle> handles(kNumHandles[i]);
+    std::vector<MojoHandle> peers(kNumHandles[i]);
+    for (uint32_t j = 0; j < kNumHandles[i]; j++) {
+      CHECK_EQ(core()->CreateMessagePipe(NullUserPointer(),
+                                         MakeUserPointer(&handles[j]),
+                                         MakeUserPointer(&peers[j])),
+               MOJO_RESULT_OK);
+    }
+
+    Stopwatch stopwatch;
+    stopwatch.Start();
+    for (unsigned j = 0; j < kNumIterations; j++) {
+      CHECK_EQ(core()->WriteMessage(h0, NullUserPointer(), 0,
+                                    MakeUserPointer(handles.data()),
+                                    kNumHandles[i],
+                                    MOJO_WRITE_MESSAGE_FLAG_NONE),
+               MOJO_RESULT_OK);
+      uint32_t num_handles = kNumHandles[i];
+      CHECK_EQ(core()->ReadMessage(h1, NullUserPointer(), NullUserPointer(),
+                                   MakeUserPointer(handles.data()),
+                                   MakeUserPointer(&num_handles),
+                                   MOJO_READ_MESSAGE_FLAG_NONE),
+               MOJO_RESULT_OK);
+      CHECK_EQ(num_handles, kNumHandles[i]);
+    }
+    double elapsed = stopwatch.Elapsed() / 1000000.0;
+
+    test::LogPerfResult(
+        StringPrintf("WriteReadMessageWith%uHandles", kNumHandles[i]).c_str(),
+        kNumIterations / elapsed, "messages/s");
+    test::LogPerfResult(
+        StringPrintf("WriteReadMessageWith%uHandles", kNumHandles[i]).c_str(),
+        kNumIterations * kNumHandles[i] / elapsed, "handles/s");
+
+    for (uint32_t j = 0; j < kNumHandles[i]; j++) {
+      CHECK_EQ(core()->Close(handles[j]), MOJO_RESULT_OK);
+      CHECK_EQ(core()->Close(peers[j]), MOJO_RESULT_OK);
+    }
+  }
+
+  CHECK_EQ(core()->Close(h0), MOJO_RESULT_OK);
+  CHECK_EQ(core()->Close(h1), MOJO_RESULT_OK);
+}
+
+}  // namespace
+}  // namespace system
+}  // namespace mojo
@@ -5,11 +5,14 @@
 #include "mojo/edk/system/core.h"
 
 #include <stdint.h>
+#include <string.h>
 
 #include <limits>
+#include <string>
 
 #include "mojo/edk/platform/thread_utils.h"
 #include "mojo/edk/system/awakable.h"
+#include "mojo/edk/system/configuration.h"
 #include "mojo/edk/system/core_test_base.h"
 #include "mojo/edk/system/test/timeouts.h"
 #include "mojo/public/cpp/system/macros.h"
@@ -1525,6 +1528,162 @@ TEST_F(CoreTest, DataPipeSetGetConsumerOptions) {
   EXPECT_EQ(MOJO_RESULT_OK, core()->Close(ch));
 }
 
+TEST_F(CoreTest, DataPipeSpansAndVectored) {
+  MojoCreateDataPipeOptions options = {
+      sizeof(MojoCreateDataPipeOptions),        // |struct_size|.
+      MOJO_CREATE_DATA_PIPE_OPTIONS_FLAG_NONE,  // |flags|.
+      2,                                        // |element_num_bytes|.
+      20                                        // |capacity_num_bytes|.
+  };
+  MojoHandle ph, ch;  // p is for producer and c is for consumer.
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->CreateDataPipe(MakeUserPointer(&options),
+                                   MakeUserPointer(&ph), MakeUserPointer(&ch)));
+
+  const char kHello[] = "hello";
+  const char kWorld[] = " world!";
+  const void* write_buffers[2] = {kHello, kWorld};
+  // "hello" + " world!" (without the terminators) is 12 bytes.
+  uint32_t write_buffers_num_bytes[2] = {5u, 7u};
+  uint32_t num_bytes = 0u;
+
+  // Wrong handle types and invalid arguments.
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->WriteDataV(ch, MakeUserPointer(write_buffers),
+                               MakeUserPointer(write_buffers_num_bytes), 2u,
+                               MakeUserPointer(&num_bytes),
+                               MOJO_WRITE_DATA_FLAG_NONE));
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->WriteDataV(ph, MakeUserPointer(write_buffers),
+                               MakeUserPointer(write_buffers_num_bytes), 1025u,
+                               MakeUserPointer(&num_bytes),
+                               MOJO_WRITE_DATA_FLAG_NONE));
+  // Not a multiple of the element size.
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->WriteDataV(ph, MakeUserPointer(write_buffers),
+                               MakeUserPointer(write_buffers_num_bytes), 1u,
+                               MakeUserPointer(&num_bytes),
+                               MOJO_WRITE_DATA_FLAG_NONE));
+  // Overflow.
+  uint32_t huge_num_bytes[2] = {0x80000000u, 0x80000000u};
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->WriteDataV(ph, MakeUserPointer(write_buffers),
+                               MakeUserPointer(huge_num_bytes), 2u,
+                               MakeUserPointer(&num_bytes),
+                               MOJO_WRITE_DATA_FLAG_NONE));
+  EXPECT_EQ(0u, num_bytes);
+
+  // Write "hello world!".
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WriteDataV(ph, MakeUserPointer(write_buffers),
+                               MakeUserPointer(write_buffers_num_bytes), 2u,
+                               MakeUserPointer(&num_bytes),
+                               MOJO_WRITE_DATA_FLAG_NONE));
+  EXPECT_EQ(12u, num_bytes);
+
+  // Read "hello wo" into two buffers.
+  char read_buffer[20] = {};
+  void* read_buffers[2] = {&read_buffer[0], &read_buffer[10]};
+  uint32_t read_buffers_num_bytes[2] = {3u, 5u};
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->ReadDataV(ph, MakeUserPointer(read_buffers),
+                              MakeUserPointer(read_buffers_num_bytes), 2u,
+                              MakeUserPointer(&num_bytes),
+                              MOJO_READ_DATA_FLAG_NONE));
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->ReadDataV(ch, MakeUserPointer(read_buffers),
+                              MakeUserPointer(read_buffers_num_bytes), 2u,
+                              MakeUserPointer(&num_bytes),
+                              MOJO_READ_DATA_FLAG_DISCARD));
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->ReadDataV(ch, MakeUserPointer(read_buffers),
+                              MakeUserPointer(read_buffers_num_bytes), 2u,
+                              MakeUserPointer(&num_bytes),
+                              MOJO_READ_DATA_FLAG_QUERY));
+  num_bytes = 0u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->ReadDataV(ch, MakeUserPointer(read_buffers),
+                              MakeUserPointer(read_buffers_num_bytes), 2u,
+                              MakeUserPointer(&num_bytes),
+                              MOJO_READ_DATA_FLAG_NONE));
+  EXPECT_EQ(8u, num_bytes);
+  EXPECT_EQ(std::string("hel"), std::string(&read_buffer[0], 3u));
+  EXPECT_EQ(std::string("lo wo"), std::string(&read_buffer[10], 5u));
+
+  // Now the free space wraps around: 8 bytes at the end and 8 at the start.
+  void* write_spans[2] = {};
+  uint32_t write_spans_num_bytes[2] = {};
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->BeginWriteDataSpans(ph, MakeUserPointer(write_spans),
+                                        MakeUserPointer(write_spans_num_bytes),
+                                        MOJO_WRITE_DATA_FLAG_ALL_OR_NONE));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->BeginWriteDataSpans(ph, MakeUserPointer(write_spans),
+                                        MakeUserPointer(write_spans_num_bytes),
+                                        MOJO_WRITE_DATA_FLAG_NONE));
+  EXPECT_EQ(8u, write_spans_num_bytes[0]);
+  EXPECT_EQ(8u, write_spans_num_bytes[1]);
+  ASSERT_TRUE(write_spans[0]);
+  ASSERT_TRUE(write_spans[1]);
+  // Can't write during a two-phase write.
+  EXPECT_EQ(MOJO_RESULT_BUSY,
+            core()->WriteDataV(ph, MakeUserPointer(write_buffers),
+                               MakeUserPointer(write_buffers_num_bytes), 2u,
+                               MakeUserPointer(&num_bytes),
+                               MOJO_WRITE_DATA_FLAG_NONE));
+  memcpy(write_spans[0], "ABCDEFGH", 8u);
+  memcpy(write_spans[1], "IJ", 2u);
+  EXPECT_EQ(MOJO_RESULT_OK, core()->EndWriteData(ph, 10u));
+
+  // Read everything with a two-phase read: "rld!" and "ABCDEFGH" at the end,
+  // "IJ" at the start.
+  const void* read_spans[2] = {};
+  uint32_t read_spans_num_bytes[2] = {};
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->BeginReadDataSpans(ch, MakeUserPointer(read_spans),
+                                       MakeUserPointer(read_spans_num_bytes),
+                                       MOJO_READ_DATA_FLAG_PEEK));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->BeginReadDataSpans(ch, MakeUserPointer(read_spans),
+                                       MakeUserPointer(read_spans_num_bytes),
+                                       MOJO_READ_DATA_FLAG_NONE));
+  ASSERT_EQ(12u, read_spans_num_bytes[0]);
+  ASSERT_EQ(2u, read_spans_num_bytes[1]);
+  EXPECT_EQ(std::string("rld!ABCDEFGH"),
+            std::string(static_cast<const char*>(read_spans[0]), 12u));
+  EXPECT_EQ(std::string("IJ"),
+            std::string(static_cast<const char*>(read_spans[1]), 2u));
+  // Can't read during a two-phase read.
+  EXPECT_EQ(MOJO_RESULT_BUSY,
+            core()->ReadDataV(ch, MakeUserPointer(read_buffers),
+                              MakeUserPointer(read_buffers_num_bytes), 2u,
+                              MakeUserPointer(&num_bytes),
+                              MOJO_READ_DATA_FLAG_NONE));
+  // Consume across the wrap point.
+  EXPECT_EQ(MOJO_RESULT_OK, core()->EndReadData(ch, 14u));
+
+  num_bytes = 0u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->ReadData(ch, NullUserPointer(), MakeUserPointer(&num_bytes),
+                             MOJO_READ_DATA_FLAG_QUERY));
+  EXPECT_EQ(0u, num_bytes);
+
+  // With no data, "all or none" should report out of range.
+  EXPECT_EQ(MOJO_RESULT_OUT_OF_RANGE,
+            core()->ReadDataV(ch, MakeUserPointer(read_buffers),
+                              MakeUserPointer(read_buffers_num_bytes), 2u,
+                              MakeUserPointer(&num_bytes),
+                              MOJO_READ_DATA_FLAG_ALL_OR_NONE));
+  EXPECT_EQ(MOJO_RESULT_SHOULD_WAIT,
+            core()->ReadDataV(ch, MakeUserPointer(read_buffers),
+                              MakeUserPointer(read_buffers_num_bytes), 2u,
+                              MakeUserPointer(&num_bytes),
+                              MOJO_READ_DATA_FLAG_NONE));
+
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(ph));
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(ch));
+}
+
 // Tests passing data pipe producer and consumer handles.
 TEST_F(CoreTest, MessagePipeBasicLocalHandlePassing2) {
   const char kHello[] = "hello";
@@ -1927,6 +2086,315 @@ TEST_F(CoreTest, MessagePipeBasicLocalHandlePassing4) {
   EXPECT_EQ(MOJO_RESULT_OK, core()->Close(h_not_transferrable));
 }
 
+TEST_F(CoreTest, MessagePipeTwoPhaseRead) {
+  const char kHello[] = "hello";
+  const uint32_t kHelloSize = static_cast<uint32_t>(sizeof(kHello));
+  MojoHandle handles[10];
+  uint32_t num_handles;
+  void* read_ptr;
+  uint32_t num_bytes;
+
+  MojoHandle h0 = MOJO_HANDLE_INVALID;
+  MojoHandle h1 = MOJO_HANDLE_INVALID;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->CreateMessagePipe(NullUserPointer(), MakeUserPointer(&h0),
+                                      MakeUserPointer(&h1)));
+
+  MojoHandle h_passed = MOJO_HANDLE_INVALID;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->CreateSharedBuffer(NullUserPointer(), 100,
+                                       MakeUserPointer(&h_passed)));
+
+  // Send |kHello| and |h_passed| from |h0| to |h1|.
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WriteMessage(h0, UserPointer<const void>(kHello),
+                                 kHelloSize, MakeUserPointer(&h_passed), 1,
+                                 MOJO_WRITE_MESSAGE_FLAG_NONE));
+
+  // Not enough space for the handle.
+  read_ptr = nullptr;
+  num_bytes = 0;
+  num_handles = 0;
+  EXPECT_EQ(MOJO_RESULT_RESOURCE_EXHAUSTED,
+            core()->BeginReadMessage(
+                h1, MakeUserPointer(&read_ptr), MakeUserPointer(&num_bytes),
+                NullUserPointer(), MakeUserPointer(&num_handles),
+                MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_FALSE(read_ptr);
+  EXPECT_EQ(kHelloSize, num_bytes);
+  EXPECT_EQ(1u, num_handles);
+
+  // Can't end a two-phase read that wasn't begun.
+  EXPECT_EQ(MOJO_RESULT_FAILED_PRECONDITION, core()->EndReadMessage(h1));
+
+  read_ptr = nullptr;
+  num_bytes = 0;
+  num_handles = MOJO_ARRAYSIZE(handles);
+  handles[0] = MOJO_HANDLE_INVALID;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->BeginReadMessage(
+                h1, MakeUserPointer(&read_ptr), MakeUserPointer(&num_bytes),
+                MakeUserPointer(handles), MakeUserPointer(&num_handles),
+                MOJO_READ_MESSAGE_FLAG_NONE));
+  ASSERT_TRUE(read_ptr);
+  EXPECT_EQ(kHelloSize, num_bytes);
+  EXPECT_STREQ(kHello, static_cast<const char*>(read_ptr));
+  EXPECT_EQ(1u, num_handles);
+  EXPECT_NE(handles[0], MOJO_HANDLE_INVALID);
+
+  // The received handle is usable while the two-phase read is in progress.
+  MojoHandleRights rights = MOJO_HANDLE_RIGHT_NONE;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->GetRights(handles[0], MakeUserPointer(&rights)));
+  EXPECT_NE(MOJO_HANDLE_RIGHT_NONE, rights);
+
+  // Only message pipe handles support two-phase reads.
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->BeginReadMessage(
+                handles[0], MakeUserPointer(&read_ptr),
+                MakeUserPointer(&num_bytes), NullUserPointer(),
+                NullUserPointer(), MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT, core()->EndReadMessage(handles[0]));
+
+  EXPECT_EQ(MOJO_RESULT_OK, core()->EndReadMessage(h1));
+
+  // The received handle outlives the two-phase read.
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(handles[0]));
+
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(h0));
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(h1));
+}
+
+TEST_F(CoreTest, MessagePipeBatchedWriteRead) {
+  const char kData[] = "abcdefghij";
+  char buffer[100];
+  MojoHandle handles[10];
+  uint32_t message_num_bytes[10];
+  uint32_t message_num_handles[10];
+  uint32_t num_bytes;
+  uint32_t num_handles;
+  uint32_t num_messages;
+
+  MojoHandle h0 = MOJO_HANDLE_INVALID;
+  MojoHandle h1 = MOJO_HANDLE_INVALID;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->CreateMessagePipe(NullUserPointer(), MakeUserPointer(&h0),
+                                      MakeUserPointer(&h1)));
+
+  // Nothing to read yet.
+  num_bytes = static_cast<uint32_t>(sizeof(buffer));
+  num_messages = MOJO_ARRAYSIZE(message_num_bytes);
+  EXPECT_EQ(MOJO_RESULT_SHOULD_WAIT,
+            core()->ReadMessages(
+                h1, UserPointer<void>(buffer), MakeUserPointer(&num_bytes),
+                NullUserPointer(), NullUserPointer(),
+                MakeUserPointer(message_num_bytes), NullUserPointer(),
+                MakeUserPointer(&num_messages), MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(0u, num_bytes);
+  EXPECT_EQ(0u, num_messages);
+
+  // Write messages "a", "bc", "def" and "ghij" in one go.
+  const uint32_t kSizes[] = {1u, 2u, 3u, 4u};
+  uint32_t num_messages_written = 0;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WriteMessages(h0, UserPointer<const void>(kData),
+                                  MakeUserPointer(kSizes), 4u,
+                                  MakeUserPointer(&num_messages_written),
+                                  MOJO_WRITE_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(4u, num_messages_written);
+
+  // Then a message with a handle.
+  MojoHandle h_passed = MOJO_HANDLE_INVALID;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->CreateSharedBuffer(NullUserPointer(), 100,
+                                       MakeUserPointer(&h_passed)));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WriteMessage(h0, UserPointer<const void>(kData), 1u,
+                                 MakeUserPointer(&h_passed), 1,
+                                 MOJO_WRITE_MESSAGE_FLAG_NONE));
+
+  // The first message doesn't fit, so nothing is read.
+  num_bytes = 0;
+  num_messages = MOJO_ARRAYSIZE(message_num_bytes);
+  message_num_bytes[0] = 123u;
+  EXPECT_EQ(MOJO_RESULT_RESOURCE_EXHAUSTED,
+            core()->ReadMessages(
+                h1, NullUserPointer(), MakeUserPointer(&num_bytes),
+                NullUserPointer(), NullUserPointer(),
+                MakeUserPointer(message_num_bytes), NullUserPointer(),
+                MakeUserPointer(&num_messages), MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(0u, num_bytes);
+  EXPECT_EQ(0u, num_messages);
+  EXPECT_EQ(1u, message_num_bytes[0]);
+
+  // Read as many messages as fit in 4 bytes: "a" and "bc".
+  num_bytes = 4u;
+  num_messages = MOJO_ARRAYSIZE(message_num_bytes);
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->ReadMessages(
+                h1, UserPointer<void>(buffer), MakeUserPointer(&num_bytes),
+                NullUserPointer(), NullUserPointer(),
+                MakeUserPointer(message_num_bytes), NullUserPointer(),
+                MakeUserPointer(&num_messages), MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(3u, num_bytes);
+  EXPECT_EQ(2u, num_messages);
+  EXPECT_EQ(1u, message_num_bytes[0]);
+  EXPECT_EQ(2u, message_num_bytes[1]);
+  EXPECT_EQ("abc", std::string(buffer, num_bytes));
+
+  // Read at most one message, discarding it: "def" is dropped.
+  num_bytes = 0;
+  num_messages = 1u;
+  EXPECT_EQ(MOJO_RESULT_RESOURCE_EXHAUSTED,
+            core()->ReadMessages(
+                h1, NullUserPointer(), MakeUserPointer(&num_bytes),
+                NullUserPointer(), NullUserPointer(),
+                MakeUserPointer(message_num_bytes), NullUserPointer(),
+                MakeUserPointer(&num_messages),
+                MOJO_READ_MESSAGE_FLAG_MAY_DISCARD));
+  EXPECT_EQ(0u, num_messages);
+  EXPECT_EQ(3u, message_num_bytes[0]);
+
+  // Without room for handles, only "ghij" is read; the message with the handle
+  // stays queued.
+  num_bytes = static_cast<uint32_t>(sizeof(buffer));
+  num_messages = MOJO_ARRAYSIZE(message_num_bytes);
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->ReadMessages(
+                h1, UserPointer<void>(buffer), MakeUserPointer(&num_bytes),
+                NullUserPointer(), NullUserPointer(),
+                MakeUserPointer(message_num_bytes),
+                MakeUserPointer(message_num_handles),
+                MakeUserPointer(&num_messages),
+                MOJO_READ_MESSAGE_FLAG_MAY_DISCARD));
+  EXPECT_EQ(4u, num_bytes);
+  EXPECT_EQ(1u, num_messages);
+  EXPECT_EQ(4u, message_num_bytes[0]);
+  EXPECT_EQ(0u, message_num_handles[0]);
+  EXPECT_EQ("ghij", std::string(buffer, num_bytes));
+
+  // Now read it, with its handle.
+  num_bytes = static_cast<uint32_t>(sizeof(buffer));
+  num_handles = MOJO_ARRAYSIZE(handles);
+  num_messages = MOJO_ARRAYSIZE(message_num_bytes);
+  handles[0] = MOJO_HANDLE_INVALID;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->ReadMessages(
+                h1, UserPointer<void>(buffer), MakeUserPointer(&num_bytes),
+                MakeUserPointer(handles), MakeUserPointer(&num_handles),
+                MakeUserPointer(message_num_bytes),
+                MakeUserPointer(message_num_handles),
+                MakeUserPointer(&num_messages), MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(1u, num_bytes);
+  EXPECT_EQ(1u, num_handles);
+  EXPECT_EQ(1u, num_messages);
+  EXPECT_EQ(1u, message_num_handles[0]);
+  EXPECT_NE(handles[0], MOJO_HANDLE_INVALID);
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(handles[0]));
+
+  // Writing stops at the first message that fails (here, because it's too
+  // big).
+  const uint32_t kBadSizes[] = {
+      1u, static_cast<uint32_t>(GetConfiguration().max_message_num_bytes + 1),
+      1u};
+  num_messages_written = 123u;
+  EXPECT_EQ(MOJO_RESULT_RESOURCE_EXHAUSTED,
+            core()->WriteMessages(h0, UserPointer<const void>(kData),
+                                  MakeUserPointer(kBadSizes), 3u,
+                                  MakeUserPointer(&num_messages_written),
+                                  MOJO_WRITE_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(1u, num_messages_written);
+
+  // Zero messages may not be read.
+  num_bytes = static_cast<uint32_t>(sizeof(buffer));
+  num_messages = 0;
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->ReadMessages(
+                h1, UserPointer<void>(buffer), MakeUserPointer(&num_bytes),
+                NullUserPointer(), NullUserPointer(),
+                MakeUserPointer(message_num_bytes), NullUserPointer(),
+                MakeUserPointer(&num_messages), MOJO_READ_MESSAGE_FLAG_NONE));
+
+  // After the peer is closed, the remaining message can still be read.
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(h0));
+  num_bytes = static_cast<uint32_t>(sizeof(buffer));
+  num_messages = MOJO_ARRAYSIZE(message_num_bytes);
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->ReadMessages(
+                h1, UserPointer<void>(buffer), MakeUserPointer(&num_bytes),
+                NullUserPointer(), NullUserPointer(),
+                MakeUserPointer(message_num_bytes), NullUserPointer(),
+                MakeUserPointer(&num_messages), MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(1u, num_messages);
+  EXPECT_EQ(1u, num_bytes);
+  num_bytes = static_cast<uint32_t>(sizeof(buffer));
+  num_messages = MOJO_ARRAYSIZE(message_num_bytes);
+  EXPECT_EQ(MOJO_RESULT_FAILED_PRECONDITION,
+            core()->ReadMessages(
+                h1, UserPointer<void>(buffer), MakeUserPointer(&num_bytes),
+                NullUserPointer(), NullUserPointer(),
+                MakeUserPointer(message_num_bytes), NullUserPointer(),
+                MakeUserPointer(&num_messages), MOJO_READ_MESSAGE_FLAG_NONE));
+
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(h1));
+}
+
+TEST_F(CoreTest, MessagePipeQueueLimits) {
+  const char kData[] = "abcd";
+  char buffer[100];
+  uint32_t num_bytes;
+
+  const MojoCreateMessagePipeOptions kOptions = {
+      static_cast<uint32_t>(sizeof(MojoCreateMessagePipeOptions)),
+      MOJO_CREATE_MESSAGE_PIPE_OPTIONS_FLAG_NONE, 3u, 0u};
+  MojoHandle h0 = MOJO_HANDLE_INVALID;
+  MojoHandle h1 = MOJO_HANDLE_INVALID;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->CreateMessagePipe(MakeUserPointer(&kOptions),
+                                      MakeUserPointer(&h0),
+                                      MakeUserPointer(&h1)));
+
+  // Only three of the four messages fit.
+  const uint32_t kSizes[] = {1u, 1u, 1u, 1u};
+  uint32_t num_messages_written = 0;
+  EXPECT_EQ(MOJO_RESULT_SHOULD_WAIT,
+            core()->WriteMessages(h0, UserPointer<const void>(kData),
+                                  MakeUserPointer(kSizes), 4u,
+                                  MakeUserPointer(&num_messages_written),
+                                  MOJO_WRITE_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(3u, num_messages_written);
+
+  MojoHandleSignalsState hss = kFullMojoHandleSignalsState;
+  EXPECT_EQ(MOJO_RESULT_DEADLINE_EXCEEDED,
+            core()->Wait(h0, MOJO_HANDLE_SIGNAL_WRITABLE, 0,
+                         MakeUserPointer(&hss)));
+  EXPECT_EQ(0u, hss.satisfied_signals);
+  EXPECT_EQ(MOJO_HANDLE_SIGNAL_READABLE | MOJO_HANDLE_SIGNAL_WRITABLE |
+                MOJO_HANDLE_SIGNAL_PEER_CLOSED,
+            hss.satisfiable_signals);
+
+  // Reading a message makes |h0| writable again.
+  num_bytes = static_cast<uint32_t>(sizeof(buffer));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->ReadMessage(
+                h1, UserPointer<void>(buffer), MakeUserPointer(&num_bytes),
+                NullUserPointer(), NullUserPointer(),
+                MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Wait(h0, MOJO_HANDLE_SIGNAL_WRITABLE, 0,
+                                         NullUserPointer()));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WriteMessage(h0, UserPointer<const void>(kData), 1u,
+                                 NullUserPointer(), 0,
+                                 MOJO_WRITE_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(MOJO_RESULT_SHOULD_WAIT,
+            core()->WriteMessage(h0, UserPointer<const void>(kData), 1u,
+                                 NullUserPointer(), 0,
+                                 MOJO_WRITE_MESSAGE_FLAG_NONE));
+
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(h0));
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(h1));
+}
+
 struct TestAsyncWaiter {
   TestAsyncWaiter() : result(MOJO_RESULT_UNKNOWN) {}
 
@@ -1959,6 +2427,211 @@ TEST_F(CoreTest, AsyncWait) {
   EXPECT_EQ(MOJO_RESULT_OK, core()->Close(h));
 }
 
+// Tests that sending a handle on a local message pipe moves its dispatcher into
+// the message (cancelling any waits on it), unless something else holds a
+// reference to it.
+TEST_F(CoreTest, MessagePipeLocalHandleTransfer) {
+  MojoHandle h0 = MOJO_HANDLE_INVALID;
+  MojoHandle h1 = MOJO_HANDLE_INVALID;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->CreateMessagePipe(NullUserPointer(), MakeUserPointer(&h0),
+                                      MakeUserPointer(&h1)));
+  MojoHandle h_passed[2] = {MOJO_HANDLE_INVALID, MOJO_HANDLE_INVALID};
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->CreateMessagePipe(NullUserPointer(),
+                                      MakeUserPointer(&h_passed[0]),
+                                      MakeUserPointer(&h_passed[1])));
+
+  Dispatcher* dispatcher = nullptr;
+  {
+    Handle h;
+    EXPECT_EQ(MOJO_RESULT_OK, core()->GetHandle(h_passed[0], &h));
+    dispatcher = h.dispatcher.get();
+  }
+
+  TestAsyncWaiter waiter;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->AsyncWait(
+                h_passed[0], MOJO_HANDLE_SIGNAL_READABLE,
+                [&waiter](MojoResult result) { waiter.Awake(result); }));
+
+  // Send |h_passed[0]|: its dispatcher is moved, and the wait is cancelled.
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WriteMessage(h0, NullUserPointer(), 0,
+                                 MakeUserPointer(&h_passed[0]), 1,
+                                 MOJO_WRITE_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(MOJO_RESULT_CANCELLED, waiter.result);
+  MojoHandle h_received = MOJO_HANDLE_INVALID;
+  uint32_t num_handles = 1;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->ReadMessage(h1, NullUserPointer(), NullUserPointer(),
+                                MakeUserPointer(&h_received),
+                                MakeUserPointer(&num_handles),
+                                MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(1u, num_handles);
+  EXPECT_NE(h_received, h_passed[0]);
+  {
+    Handle h;
+    EXPECT_EQ(MOJO_RESULT_OK, core()->GetHandle(h_received, &h));
+    EXPECT_EQ(dispatcher, h.dispatcher.get());
+    EXPECT_EQ(kDefaultMessagePipeHandleRights, h.rights);
+  }
+
+  // The received handle works.
+  const char kHello[] = "hello";
+  const uint32_t kHelloSize = static_cast<uint32_t>(sizeof(kHello));
+  char buffer[100] = {};
+  uint32_t num_bytes = static_cast<uint32_t>(sizeof(buffer));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WriteMessage(h_passed[1], UserPointer<const void>(kHello),
+                                 kHelloSize, NullUserPointer(), 0,
+                                 MOJO_WRITE_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->ReadMessage(h_received, UserPointer<void>(buffer),
+                                MakeUserPointer(&num_bytes), NullUserPointer(),
+                                NullUserPointer(),
+                                MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(kHelloSize, num_bytes);
+  EXPECT_STREQ(kHello, buffer);
+
+  // If something else holds a reference to the dispatcher (here, a wait set),
+  // an equivalent dispatcher is sent instead (and the original is closed).
+  MojoHandle ws = MOJO_HANDLE_INVALID;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->CreateWaitSet(NullUserPointer(), MakeUserPointer(&ws)));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WaitSetAdd(NullUserPointer(), ws, h_received,
+                               MOJO_HANDLE_SIGNAL_READABLE, 0u));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WriteMessage(h0, NullUserPointer(), 0,
+                                 MakeUserPointer(&h_received), 1,
+                                 MOJO_WRITE_MESSAGE_FLAG_NONE));
+  num_handles = 1;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->ReadMessage(h1, NullUserPointer(), NullUserPointer(),
+                                MakeUserPointer(&h_received),
+                                MakeUserPointer(&num_handles),
+                                MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(1u, num_handles);
+  {
+    Handle h;
+    EXPECT_EQ(MOJO_RESULT_OK, core()->GetHandle(h_received, &h));
+    EXPECT_NE(dispatcher, h.dispatcher.get());
+  }
+
+  // The wait set's entry was cancelled by closing the original dispatcher.
+  MojoWaitSetResult result = {};
+  uint32_t num_results = 1u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WaitSetWait(ws, 0, MakeUserPointer(&num_results),
+                                MakeUserPointer(&result), NullUserPointer()));
+  EXPECT_EQ(1u, num_results);
+  EXPECT_EQ(MOJO_RESULT_CANCELLED, result.wait_result);
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(ws));
+
+  // Discarding a message closes the (moved) handles attached to it.
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WriteMessage(h0, NullUserPointer(), 0,
+                                 MakeUserPointer(&h_received), 1,
+                                 MOJO_WRITE_MESSAGE_FLAG_NONE));
+  num_handles = 0;
+  EXPECT_EQ(MOJO_RESULT_RESOURCE_EXHAUSTED,
+            core()->ReadMessage(
+                h1, NullUserPointer(), NullUserPointer(), NullUserPointer(),
+                MakeUserPointer(&num_handles),
+                MOJO_READ_MESSAGE_FLAG_MAY_DISCARD));
+  EXPECT_EQ(1u, num_handles);
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->Wait(h_passed[1], MOJO_HANDLE_SIGNAL_PEER_CLOSED, 0,
+                         NullUserPointer()));
+
+  // As does closing the destination with the message still queued.
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WriteMessage(h0, NullUserPointer(), 0,
+                                 MakeUserPointer(&h_passed[1]), 1,
+                                 MOJO_WRITE_MESSAGE_FLAG_NONE));
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(h1));
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(h0));
+}
+
+TEST_F(CoreTest, WaitSet) {
+  MojoHandle ws = MOJO_HANDLE_INVALID;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->CreateWaitSet(NullUserPointer(), MakeUserPointer(&ws)));
+  EXPECT_NE(ws, MOJO_HANDLE_INVALID);
+
+  MojoHandle h[2] = {MOJO_HANDLE_INVALID, MOJO_HANDLE_INVALID};
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->CreateMessagePipe(NullUserPointer(), MakeUserPointer(&h[0]),
+                                      MakeUserPointer(&h[1])));
+
+  // Wait set functions require a wait set handle.
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->WaitSetAdd(NullUserPointer(), h[0], h[1],
+                               MOJO_HANDLE_SIGNAL_READABLE, 0u));
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT, core()->WaitSetRemove(h[0], 0u));
+  // The added handle must be valid.
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            core()->WaitSetAdd(NullUserPointer(), ws, MOJO_HANDLE_INVALID,
+                               MOJO_HANDLE_SIGNAL_READABLE, 0u));
+
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WaitSetAdd(NullUserPointer(), ws, h[0],
+                               MOJO_HANDLE_SIGNAL_READABLE, 0u));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WaitSetAdd(NullUserPointer(), ws, h[1],
+                               MOJO_HANDLE_SIGNAL_READABLE, 1u));
+
+  uint32_t num_results = 4u;
+  MojoWaitSetResult results[4] = {};
+  uint32_t max_results = 0u;
+  EXPECT_EQ(MOJO_RESULT_DEADLINE_EXCEEDED,
+            core()->WaitSetWait(ws, 0, MakeUserPointer(&num_results),
+                                MakeUserPointer(results),
+                                MakeUserPointer(&max_results)));
+
+  // Make |h[0]| readable.
+  char buffer[1] = {'x'};
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WriteMessage(h[1], UserPointer<const void>(buffer), 1,
+                                 NullUserPointer(), 0,
+                                 MOJO_WRITE_MESSAGE_FLAG_NONE));
+  num_results = 4u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WaitSetWait(ws, MOJO_DEADLINE_INDEFINITE,
+                                MakeUserPointer(&num_results),
+                                MakeUserPointer(results),
+                                MakeUserPointer(&max_results)));
+  EXPECT_EQ(1u, num_results);
+  EXPECT_EQ(1u, max_results);
+  EXPECT_EQ(0u, results[0].cookie);
+  EXPECT_EQ(MOJO_RESULT_OK, results[0].wait_result);
+  EXPECT_EQ(MOJO_HANDLE_SIGNAL_READABLE | MOJO_HANDLE_SIGNAL_WRITABLE,
+            results[0].satisfied_signals);
+
+  // Closing |h[0]| makes its entry cancelled and |h[1]|'s unsatisfiable.
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(h[0]));
+  num_results = 4u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            core()->WaitSetWait(ws, 0, MakeUserPointer(&num_results),
+                                MakeUserPointer(results), NullUserPointer()));
+  ASSERT_EQ(2u, num_results);
+  for (uint32_t i = 0; i < num_results; i++) {
+    if (results[i].cookie == 0u) {
+      EXPECT_EQ(MOJO_RESULT_CANCELLED, results[i].wait_result);
+    } else {
+      EXPECT_EQ(1u, results[i].cookie);
+      EXPECT_EQ(MOJO_RESULT_FAILED_PRECONDITION, results[i].wait_result);
+    }
+  }
+
+  EXPECT_EQ(MOJO_RESULT_OK, core()->WaitSetRemove(ws, 0u));
+  EXPECT_EQ(MOJO_RESULT_NOT_FOUND, core()->WaitSetRemove(ws, 0u));
+
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(ws));
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(h[1]));
+}
+
 // TODO(vtl): Test |CreateSharedBuffer()|, |DuplicateBufferHandle()|, and
 // |MapBuffer()|.
 
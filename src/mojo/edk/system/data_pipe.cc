@@ -12,6 +12,7 @@
 #include <utility>
 
 #include "base/logging.h"
+#include "mojo/edk/embedder/platform_support.h"
 #include "mojo/edk/platform/aligned_alloc.h"
 #include "mojo/edk/system/awakable_list.h"
 #include "mojo/edk/system/channel.h"
@@ -22,10 +23,14 @@
 #include "mojo/edk/system/memory.h"
 #include "mojo/edk/system/options_validation.h"
 #include "mojo/edk/system/remote_consumer_data_pipe_impl.h"
+#include "mojo/edk/system/remote_consumer_shared_ring_data_pipe_impl.h"
 #include "mojo/edk/system/remote_producer_data_pipe_impl.h"
+#include "mojo/edk/system/remote_producer_shared_ring_data_pipe_impl.h"
 #include "mojo/edk/util/make_unique.h"
 
 using mojo::platform::AlignedUniquePtr;
+using mojo::platform::PlatformSharedBuffer;
+using mojo::platform::PlatformSharedBufferMapping;
 using mojo::platform::ScopedPlatformHandle;
 using mojo::util::MakeUnique;
 using mojo::util::MutexLocker;
@@ -34,6 +39,134 @@ using mojo::util::RefPtr;
 namespace mojo {
 namespace system {
 
+namespace {
+
+// Takes the platform handle at |platform_handle_index| in |*platform_handles|
+// and makes (and maps) a shared memory ring buffer of size
+// |capacity_num_bytes| from it. Returns true on success.
+bool DeserializeSharedRing(
+    Channel* channel,
+    size_t capacity_num_bytes,
+    uint32_t platform_handle_index,
+    std::vector<ScopedPlatformHandle>* platform_handles,
+    RefPtr<PlatformSharedBuffer>* ring_buffer,
+    std::unique_ptr<PlatformSharedBufferMapping>* ring_mapping) {
+  if (!platform_handles || platform_handle_index >= platform_handles->size()) {
+    LOG(ERROR) << "Invalid serialized data pipe (missing shared ring handle)";
+    return false;
+  }
+
+  ScopedPlatformHandle platform_handle;
+  std::swap(platform_handle, (*platform_handles)[platform_handle_index]);
+  *ring_buffer = channel->platform_support()->CreateSharedBufferFromHandle(
+      capacity_num_bytes, std::move(platform_handle));
+  if (!*ring_buffer) {
+    LOG(ERROR) << "Invalid serialized data pipe (bad shared ring handle)";
+    return false;
+  }
+
+  *ring_mapping = (*ring_buffer)->MapNoCheck(0, capacity_num_bytes);
+  if (!*ring_mapping) {
+    LOG(ERROR) << "Unable to map data pipe shared ring";
+    return false;
+  }
+
+  return true;
+}
+
+// Gets the |num_buffers| buffer pointers and sizes (from |buffers| and
+// |buffers_num_bytes|) for a vectored read or write, and their total size.
+// Returns false if the total size overflows a |uint32_t|.
+template <typename PointerType>
+bool GetBuffers(UserPointer<PointerType const> buffers,
+                UserPointer<const uint32_t> buffers_num_bytes,
+                uint32_t num_buffers,
+                std::vector<PointerType>* buffers_vec,
+                std::vector<uint32_t>* buffers_num_bytes_vec,
+                uint32_t* total_num_bytes) {
+  buffers_vec->resize(num_buffers);
+  buffers_num_bytes_vec->resize(num_buffers);
+  if (num_buffers > 0) {
+    buffers.GetArray(buffers_vec->data(), num_buffers);
+    buffers_num_bytes.GetArray(buffers_num_bytes_vec->data(), num_buffers);
+  }
+
+  uint64_t total = 0;
+  for (uint32_t num_bytes : *buffers_num_bytes_vec)
+    total += num_bytes;
+  if (total > std::numeric_limits<uint32_t>::max())
+    return false;
+  *total_num_bytes = static_cast<uint32_t>(total);
+  return true;
+}
+
+// Copies |num_bytes| bytes from the (user) buffers |buffers| (with sizes
+// |buffers_num_bytes|, which must total at least |num_bytes|) to the two spans
+// |spans| (with sizes |spans_num_bytes|, which must also total at least
+// |num_bytes|).
+void CopyBuffersToSpans(const std::vector<const void*>& buffers,
+                        const std::vector<uint32_t>& buffers_num_bytes,
+                        void* const* spans,
+                        const uint32_t* spans_num_bytes,
+                        size_t num_bytes) {
+  size_t buffer_index = 0;
+  size_t buffer_offset = 0;
+  for (size_t i = 0; i < 2 && num_bytes > 0; i++) {
+    char* span = static_cast<char*>(spans[i]);
+    size_t span_remaining =
+        std::min(static_cast<size_t>(spans_num_bytes[i]), num_bytes);
+    num_bytes -= span_remaining;
+    while (span_remaining > 0) {
+      DCHECK_LT(buffer_index, buffers.size());
+      size_t n = std::min(
+          span_remaining, buffers_num_bytes[buffer_index] - buffer_offset);
+      MakeUserPointer(static_cast<const char*>(buffers[buffer_index]) +
+                      buffer_offset)
+          .GetArray(span, n);
+      span += n;
+      span_remaining -= n;
+      buffer_offset += n;
+      if (buffer_offset == buffers_num_bytes[buffer_index]) {
+        buffer_index++;
+        buffer_offset = 0;
+      }
+    }
+  }
+}
+
+// The reverse of |CopyBuffersToSpans()|.
+void CopySpansToBuffers(const void* const* spans,
+                        const uint32_t* spans_num_bytes,
+                        const std::vector<void*>& buffers,
+                        const std::vector<uint32_t>& buffers_num_bytes,
+                        size_t num_bytes) {
+  size_t buffer_index = 0;
+  size_t buffer_offset = 0;
+  for (size_t i = 0; i < 2 && num_bytes > 0; i++) {
+    const char* span = static_cast<const char*>(spans[i]);
+    size_t span_remaining =
+        std::min(static_cast<size_t>(spans_num_bytes[i]), num_bytes);
+    num_bytes -= span_remaining;
+    while (span_remaining > 0) {
+      DCHECK_LT(buffer_index, buffers.size());
+      size_t n = std::min(
+          span_remaining, buffers_num_bytes[buffer_index] - buffer_offset);
+      MakeUserPointer(static_cast<char*>(buffers[buffer_index]) +
+                      buffer_offset)
+          .PutArray(span, n);
+      span += n;
+      span_remaining -= n;
+      buffer_offset += n;
+      if (buffer_offset == buffers_num_bytes[buffer_index]) {
+        buffer_index++;
+        buffer_offset = 0;
+      }
+    }
+  }
+}
+
+}  // namespace
+
 // static
 MojoCreateDataPipeOptions DataPipe::GetDefaultCreateOptions() {
   MojoCreateDataPipeOptions result = {
@@ -168,10 +301,74 @@ RefPtr<DataPipe> DataPipe::CreateRemoteConsumerFromExisting(
 }
 
 // static
-bool DataPipe::ProducerDeserialize(Channel* channel,
-                                   const void* source,
-                                   size_t size,
-                                   RefPtr<DataPipe>* data_pipe) {
+RefPtr<DataPipe> DataPipe::CreateRemoteProducerSharedRingFromExisting(
+    const MojoCreateDataPipeOptions& validated_options,
+    MessageInTransitQueue* message_queue,
+    RefPtr<ChannelEndpoint>&& channel_endpoint,
+    RefPtr<PlatformSharedBuffer>&& ring_buffer,
+    std::unique_ptr<PlatformSharedBufferMapping> ring_mapping,
+    size_t start_index,
+    size_t current_num_bytes) {
+  if (!RemoteProducerSharedRingDataPipeImpl::
+          ProcessMessagesFromIncomingEndpoint(
+              validated_options, &current_num_bytes, message_queue))
+    return nullptr;
+
+  // Important: See the comment in |CreateRemoteProducerFromExisting()|.
+  RefPtr<DataPipe> data_pipe = AdoptRef(new DataPipe(
+      false, true, validated_options,
+      MakeUnique<RemoteProducerSharedRingDataPipeImpl>(
+          channel_endpoint.Clone(), std::move(ring_buffer),
+          std::move(ring_mapping), start_index, current_num_bytes)));
+  if (channel_endpoint) {
+    if (!channel_endpoint->ReplaceClient(data_pipe.Clone(), 0))
+      data_pipe->OnDetachFromChannel(0);
+  } else {
+    data_pipe->SetProducerClosed();
+  }
+  return data_pipe;
+}
+
+// static
+RefPtr<DataPipe> DataPipe::CreateRemoteConsumerSharedRingFromExisting(
+    const MojoCreateDataPipeOptions& validated_options,
+    size_t consumer_num_bytes,
+    MessageInTransitQueue* message_queue,
+    RefPtr<ChannelEndpoint>&& channel_endpoint,
+    RefPtr<PlatformSharedBuffer>&& ring_buffer,
+    std::unique_ptr<PlatformSharedBufferMapping> ring_mapping,
+    size_t start_index) {
+  // The next write goes just past the consumer's data, which doesn't move when
+  // the consumer consumes data (i.e., regardless of the messages).
+  size_t write_index = (start_index + consumer_num_bytes) %
+                       validated_options.capacity_num_bytes;
+  if (!RemoteConsumerSharedRingDataPipeImpl::
+          ProcessMessagesFromIncomingEndpoint(
+              validated_options, &consumer_num_bytes, message_queue))
+    return nullptr;
+
+  // Important: See the comment in |CreateRemoteConsumerFromExisting()|.
+  RefPtr<DataPipe> data_pipe = AdoptRef(new DataPipe(
+      true, false, validated_options,
+      MakeUnique<RemoteConsumerSharedRingDataPipeImpl>(
+          channel_endpoint.Clone(), consumer_num_bytes, std::move(ring_buffer),
+          std::move(ring_mapping), write_index)));
+  if (channel_endpoint) {
+    if (!channel_endpoint->ReplaceClient(data_pipe.Clone(), 0))
+      data_pipe->OnDetachFromChannel(0);
+  } else {
+    data_pipe->SetConsumerClosed();
+  }
+  return data_pipe;
+}
+
+// static
+bool DataPipe::ProducerDeserialize(
+    Channel* channel,
+    const void* source,
+    size_t size,
+    std::vector<ScopedPlatformHandle>* platform_handles,
+    RefPtr<DataPipe>* data_pipe) {
   DCHECK(!*data_pipe);  // Not technically wrong, but unlikely.
 
   bool consumer_open = false;
@@ -194,6 +391,12 @@ bool DataPipe::ProducerDeserialize(Channel* channel,
     LOG(ERROR) << "Invalid serialized data pipe producer (bad options)";
     return false;
   }
+  if (s->write_threshold_num_bytes % revalidated_options.element_num_bytes !=
+      0) {
+    LOG(ERROR) << "Invalid serialized data pipe producer (bad "
+                  "write_threshold_num_bytes)";
+    return false;
+  }
 
   if (!consumer_open) {
     if (s->consumer_num_bytes != static_cast<size_t>(-1)) {
@@ -206,6 +409,7 @@ bool DataPipe::ProducerDeserialize(Channel* channel,
         true, false, revalidated_options,
         MakeUnique<RemoteConsumerDataPipeImpl>(nullptr, 0, nullptr, 0)));
     (*data_pipe)->SetConsumerClosed();
+    (*data_pipe)->ProducerSetOptions(s->write_threshold_num_bytes);
 
     return true;
   }
@@ -217,6 +421,23 @@ bool DataPipe::ProducerDeserialize(Channel* channel,
     return false;
   }
 
+  RefPtr<PlatformSharedBuffer> ring_buffer;
+  std::unique_ptr<PlatformSharedBufferMapping> ring_mapping;
+  if (s->shared_ring_platform_handle_index !=
+      kNoSharedRingPlatformHandleIndex) {
+    if (s->shared_ring_start_index >= revalidated_options.capacity_num_bytes ||
+        s->shared_ring_start_index % revalidated_options.element_num_bytes !=
+            0) {
+      LOG(ERROR) << "Invalid serialized data pipe producer (bad "
+                    "shared_ring_start_index)";
+      return false;
+    }
+    if (!DeserializeSharedRing(channel, revalidated_options.capacity_num_bytes,
+                               s->shared_ring_platform_handle_index,
+                               platform_handles, &ring_buffer, &ring_mapping))
+      return false;
+  }
+
   const void* endpoint_source = static_cast<const char*>(source) +
                                 sizeof(SerializedDataPipeProducerDispatcher);
   RefPtr<IncomingEndpoint> incoming_endpoint =
@@ -224,19 +445,28 @@ bool DataPipe::ProducerDeserialize(Channel* channel,
   if (!incoming_endpoint)
     return false;
 
-  *data_pipe = incoming_endpoint->ConvertToDataPipeProducer(
-      revalidated_options, s->consumer_num_bytes);
+  if (ring_buffer) {
+    *data_pipe = incoming_endpoint->ConvertToSharedRingDataPipeProducer(
+        revalidated_options, s->consumer_num_bytes, std::move(ring_buffer),
+        std::move(ring_mapping), s->shared_ring_start_index);
+  } else {
+    *data_pipe = incoming_endpoint->ConvertToDataPipeProducer(
+        revalidated_options, s->consumer_num_bytes);
+  }
   if (!*data_pipe)
     return false;
 
+  (*data_pipe)->ProducerSetOptions(s->write_threshold_num_bytes);
   return true;
 }
 
 // static
-bool DataPipe::ConsumerDeserialize(Channel* channel,
-                                   const void* source,
-                                   size_t size,
-                                   RefPtr<DataPipe>* data_pipe) {
+bool DataPipe::ConsumerDeserialize(
+    Channel* channel,
+    const void* source,
+    size_t size,
+    std::vector<ScopedPlatformHandle>* platform_handles,
+    RefPtr<DataPipe>* data_pipe) {
   DCHECK(!*data_pipe);  // Not technically wrong, but unlikely.
 
   if (size !=
@@ -254,6 +484,30 @@ bool DataPipe::ConsumerDeserialize(Channel* channel,
     LOG(ERROR) << "Invalid serialized data pipe consumer (bad options)";
     return false;
   }
+  if (s->read_threshold_num_bytes % revalidated_options.element_num_bytes !=
+      0) {
+    LOG(ERROR) << "Invalid serialized data pipe consumer (bad "
+                  "read_threshold_num_bytes)";
+    return false;
+  }
+
+  RefPtr<PlatformSharedBuffer> ring_buffer;
+  std::unique_ptr<PlatformSharedBufferMapping> ring_mapping;
+  if (s->shared_ring_platform_handle_index !=
+      kNoSharedRingPlatformHandleIndex) {
+    if (s->shared_ring_start_index >= revalidated_options.capacity_num_bytes ||
+        s->shared_ring_start_index % revalidated_options.element_num_bytes !=
+            0 ||
+        s->shared_ring_num_bytes > revalidated_options.capacity_num_bytes ||
+        s->shared_ring_num_bytes % revalidated_options.element_num_bytes != 0) {
+      LOG(ERROR) << "Invalid serialized data pipe consumer (bad shared ring)";
+      return false;
+    }
+    if (!DeserializeSharedRing(channel, revalidated_options.capacity_num_bytes,
+                               s->shared_ring_platform_handle_index,
+                               platform_handles, &ring_buffer, &ring_mapping))
+      return false;
+  }
 
   const void* endpoint_source = static_cast<const char*>(source) +
                                 sizeof(SerializedDataPipeConsumerDispatcher);
@@ -262,11 +516,18 @@ bool DataPipe::ConsumerDeserialize(Channel* channel,
   if (!incoming_endpoint)
     return false;
 
-  *data_pipe =
-      incoming_endpoint->ConvertToDataPipeConsumer(revalidated_options);
+  if (ring_buffer) {
+    *data_pipe = incoming_endpoint->ConvertToSharedRingDataPipeConsumer(
+        revalidated_options, std::move(ring_buffer), std::move(ring_mapping),
+        s->shared_ring_start_index, s->shared_ring_num_bytes);
+  } else {
+    *data_pipe =
+        incoming_endpoint->ConvertToDataPipeConsumer(revalidated_options);
+  }
   if (!*data_pipe)
     return false;
 
+  (*data_pipe)->ConsumerSetOptions(s->read_threshold_num_bytes);
   return true;
 }
 
@@ -366,28 +627,82 @@ MojoResult DataPipe::ProducerEndWriteData(uint32_t num_bytes_written) {
   // Note: Allow successful completion of the two-phase write even if the
   // consumer has been closed.
 
-  HandleSignalsState old_consumer_state =
-      impl_->ConsumerGetHandleSignalsState();
-  MojoResult rv;
-  if (num_bytes_written > producer_two_phase_max_num_bytes_written_ ||
-      num_bytes_written % element_num_bytes() != 0) {
-    rv = MOJO_RESULT_INVALID_ARGUMENT;
-    producer_two_phase_max_num_bytes_written_ = 0;
-  } else {
-    rv = impl_->ProducerEndWriteData(num_bytes_written);
+  return ProducerEndWriteDataNoLock(num_bytes_written);
+}
+
+MojoResult DataPipe::ProducerBeginWriteDataSpans(
+    UserPointer<void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes) {
+  MutexLocker locker(&mutex_);
+  DCHECK(has_local_producer_no_lock());
+
+  if (producer_in_two_phase_write_no_lock())
+    return MOJO_RESULT_BUSY;
+  if (!consumer_open_no_lock())
+    return MOJO_RESULT_FAILED_PRECONDITION;
+
+  MojoResult rv =
+      impl_->ProducerBeginWriteDataSpans(buffers, buffers_num_bytes);
+  if (rv != MOJO_RESULT_OK)
+    return rv;
+  // See the note in |ProducerBeginWriteData()| about awakables.
+  DCHECK(producer_in_two_phase_write_no_lock());
+  return MOJO_RESULT_OK;
+}
+
+MojoResult DataPipe::ProducerWriteDataV(
+    UserPointer<const void* const> buffers,
+    UserPointer<const uint32_t> buffers_num_bytes,
+    uint32_t num_buffers,
+    UserPointer<uint32_t> num_bytes_written,
+    bool all_or_none) {
+  MutexLocker locker(&mutex_);
+  DCHECK(has_local_producer_no_lock());
+
+  if (producer_in_two_phase_write_no_lock())
+    return MOJO_RESULT_BUSY;
+  if (!consumer_open_no_lock())
+    return MOJO_RESULT_FAILED_PRECONDITION;
+
+  std::vector<const void*> buffers_vec;
+  std::vector<uint32_t> buffers_num_bytes_vec;
+  uint32_t max_num_bytes_to_write = 0;
+  if (!GetBuffers(buffers, buffers_num_bytes, num_buffers, &buffers_vec,
+                  &buffers_num_bytes_vec, &max_num_bytes_to_write) ||
+      max_num_bytes_to_write % element_num_bytes() != 0)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  if (max_num_bytes_to_write == 0) {
+    num_bytes_written.Put(0);
+    return MOJO_RESULT_OK;  // Nothing to do.
   }
-  // Two-phase write ended even on failure.
-  DCHECK(!producer_in_two_phase_write_no_lock());
-  // If we're now writable, we *became* writable (since we weren't writable
-  // during the two-phase write), so awake producer awakables.
-  HandleSignalsState new_producer_state =
-      impl_->ProducerGetHandleSignalsState();
-  if (new_producer_state.satisfies(MOJO_HANDLE_SIGNAL_WRITABLE))
-    AwakeProducerAwakablesForStateChangeNoLock(new_producer_state);
-  HandleSignalsState new_consumer_state =
-      impl_->ConsumerGetHandleSignalsState();
-  if (!new_consumer_state.equals(old_consumer_state))
-    AwakeConsumerAwakablesForStateChangeNoLock(new_consumer_state);
+
+  // Do this as an internal two-phase write (we hold |mutex_| throughout), so
+  // that the data can be copied directly into the impl's buffer.
+  void* spans[2] = {};
+  uint32_t spans_num_bytes[2] = {};
+  MojoResult rv = impl_->ProducerBeginWriteDataSpans(
+      MakeUserPointer(spans), MakeUserPointer(spans_num_bytes));
+  if (rv != MOJO_RESULT_OK) {
+    // Don't return "should wait" since you can't wait for a specified amount
+    // of space.
+    return (rv == MOJO_RESULT_SHOULD_WAIT && all_or_none)
+               ? MOJO_RESULT_OUT_OF_RANGE
+               : rv;
+  }
+
+  uint32_t num_bytes_to_write = std::min(
+      max_num_bytes_to_write, spans_num_bytes[0] + spans_num_bytes[1]);
+  if (all_or_none && num_bytes_to_write < max_num_bytes_to_write) {
+    ProducerEndWriteDataNoLock(0);
+    return MOJO_RESULT_OUT_OF_RANGE;
+  }
+
+  CopyBuffersToSpans(buffers_vec, buffers_num_bytes_vec, spans,
+                     spans_num_bytes, num_bytes_to_write);
+  rv = ProducerEndWriteDataNoLock(num_bytes_to_write);
+  if (rv == MOJO_RESULT_OK)
+    num_bytes_written.Put(num_bytes_to_write);
   return rv;
 }
 
@@ -462,6 +777,9 @@ bool DataPipe::ProducerEndSerialize(
   // changed.
   bool rv = impl_->ProducerEndSerialize(channel, destination, actual_size,
                                         platform_handles);
+  // The write threshold belongs to the producer handle, so it goes with it.
+  static_cast<SerializedDataPipeProducerDispatcher*>(destination)
+      ->write_threshold_num_bytes = producer_write_threshold_num_bytes_;
 
   ProducerCancelAllStateNoLock();
   producer_awakable_list_.reset();
@@ -597,30 +915,77 @@ MojoResult DataPipe::ConsumerEndReadData(uint32_t num_bytes_read) {
   if (!consumer_in_two_phase_read_no_lock())
     return MOJO_RESULT_FAILED_PRECONDITION;
 
-  HandleSignalsState old_consumer_state =
-      impl_->ConsumerGetHandleSignalsState();
-  HandleSignalsState old_producer_state =
-      impl_->ProducerGetHandleSignalsState();
-  MojoResult rv;
-  if (num_bytes_read > consumer_two_phase_max_num_bytes_read_ ||
-      num_bytes_read % element_num_bytes() != 0) {
-    rv = MOJO_RESULT_INVALID_ARGUMENT;
-    consumer_two_phase_max_num_bytes_read_ = 0;
-  } else {
-    rv = impl_->ConsumerEndReadData(num_bytes_read);
+  return ConsumerEndReadDataNoLock(num_bytes_read);
+}
+
+MojoResult DataPipe::ConsumerBeginReadDataSpans(
+    UserPointer<const void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes) {
+  MutexLocker locker(&mutex_);
+  DCHECK(has_local_consumer_no_lock());
+
+  if (consumer_in_two_phase_read_no_lock())
+    return MOJO_RESULT_BUSY;
+
+  MojoResult rv = impl_->ConsumerBeginReadDataSpans(buffers, buffers_num_bytes);
+  if (rv != MOJO_RESULT_OK)
+    return rv;
+  DCHECK(consumer_in_two_phase_read_no_lock());
+  return MOJO_RESULT_OK;
+}
+
+MojoResult DataPipe::ConsumerReadDataV(
+    UserPointer<void* const> buffers,
+    UserPointer<const uint32_t> buffers_num_bytes,
+    uint32_t num_buffers,
+    UserPointer<uint32_t> num_bytes_read,
+    bool all_or_none,
+    bool peek) {
+  MutexLocker locker(&mutex_);
+  DCHECK(has_local_consumer_no_lock());
+
+  if (consumer_in_two_phase_read_no_lock())
+    return MOJO_RESULT_BUSY;
+
+  std::vector<void*> buffers_vec;
+  std::vector<uint32_t> buffers_num_bytes_vec;
+  uint32_t max_num_bytes_to_read = 0;
+  if (!GetBuffers(buffers, buffers_num_bytes, num_buffers, &buffers_vec,
+                  &buffers_num_bytes_vec, &max_num_bytes_to_read) ||
+      max_num_bytes_to_read % element_num_bytes() != 0)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  if (max_num_bytes_to_read == 0) {
+    num_bytes_read.Put(0);
+    return MOJO_RESULT_OK;  // Nothing to do.
   }
-  // Two-phase read ended even on failure.
-  DCHECK(!consumer_in_two_phase_read_no_lock());
-  // If we're now readable, we *became* readable (since we weren't readable
-  // during the two-phase read), so awake consumer awakables.
-  HandleSignalsState new_consumer_state =
-      impl_->ConsumerGetHandleSignalsState();
-  if (!new_consumer_state.equals(old_consumer_state))
-    AwakeConsumerAwakablesForStateChangeNoLock(new_consumer_state);
-  HandleSignalsState new_producer_state =
-      impl_->ProducerGetHandleSignalsState();
-  if (!new_producer_state.equals(old_producer_state))
-    AwakeProducerAwakablesForStateChangeNoLock(new_producer_state);
+
+  // As in |ProducerWriteDataV()|, do this as an internal two-phase read.
+  const void* spans[2] = {};
+  uint32_t spans_num_bytes[2] = {};
+  MojoResult rv = impl_->ConsumerBeginReadDataSpans(
+      MakeUserPointer(spans), MakeUserPointer(spans_num_bytes));
+  if (rv != MOJO_RESULT_OK) {
+    // Don't return "should wait" since you can't wait for a specified amount
+    // of data.
+    return (rv == MOJO_RESULT_SHOULD_WAIT && all_or_none)
+               ? MOJO_RESULT_OUT_OF_RANGE
+               : rv;
+  }
+
+  uint32_t num_bytes_to_read = std::min(
+      max_num_bytes_to_read, spans_num_bytes[0] + spans_num_bytes[1]);
+  if (all_or_none && num_bytes_to_read < max_num_bytes_to_read) {
+    ConsumerEndReadDataNoLock(0);
+    return producer_open_no_lock() ? MOJO_RESULT_OUT_OF_RANGE
+                                   : MOJO_RESULT_FAILED_PRECONDITION;
+  }
+
+  CopySpansToBuffers(spans, spans_num_bytes, buffers_vec,
+                     buffers_num_bytes_vec, num_bytes_to_read);
+  rv = ConsumerEndReadDataNoLock(peek ? 0 : num_bytes_to_read);
+  if (rv == MOJO_RESULT_OK)
+    num_bytes_read.Put(num_bytes_to_read);
   return rv;
 }
 
@@ -695,6 +1060,9 @@ bool DataPipe::ConsumerEndSerialize(
   // changed.
   bool rv = impl_->ConsumerEndSerialize(channel, destination, actual_size,
                                         platform_handles);
+  // The read threshold belongs to the consumer handle, so it goes with it.
+  static_cast<SerializedDataPipeConsumerDispatcher*>(destination)
+      ->read_threshold_num_bytes = consumer_read_threshold_num_bytes_;
 
   ConsumerCancelAllStateNoLock();
   consumer_awakable_list_.reset();
@@ -880,5 +1248,65 @@ void DataPipe::SetConsumerClosed() {
   SetConsumerClosedNoLock();
 }
 
+MojoResult DataPipe::ProducerEndWriteDataNoLock(uint32_t num_bytes_written) {
+  mutex_.AssertHeld();
+  DCHECK(producer_in_two_phase_write_no_lock());
+
+  HandleSignalsState old_consumer_state =
+      impl_->ConsumerGetHandleSignalsState();
+  MojoResult rv;
+  if (num_bytes_written > producer_two_phase_max_num_bytes_written_ ||
+      num_bytes_written % element_num_bytes() != 0) {
+    rv = MOJO_RESULT_INVALID_ARGUMENT;
+    producer_two_phase_max_num_bytes_written_ = 0;
+  } else {
+    rv = impl_->ProducerEndWriteData(num_bytes_written);
+  }
+  // Two-phase write ended even on failure.
+  DCHECK(!producer_in_two_phase_write_no_lock());
+  // If we're now writable, we *became* writable (since we weren't writable
+  // during the two-phase write), so awake producer awakables.
+  HandleSignalsState new_producer_state =
+      impl_->ProducerGetHandleSignalsState();
+  if (new_producer_state.satisfies(MOJO_HANDLE_SIGNAL_WRITABLE))
+    AwakeProducerAwakablesForStateChangeNoLock(new_producer_state);
+  HandleSignalsState new_consumer_state =
+      impl_->ConsumerGetHandleSignalsState();
+  if (!new_consumer_state.equals(old_consumer_state))
+    AwakeConsumerAwakablesForStateChangeNoLock(new_consumer_state);
+  return rv;
+}
+
+MojoResult DataPipe::ConsumerEndReadDataNoLock(uint32_t num_bytes_read) {
+  mutex_.AssertHeld();
+  DCHECK(consumer_in_two_phase_read_no_lock());
+
+  HandleSignalsState old_consumer_state =
+      impl_->ConsumerGetHandleSignalsState();
+  HandleSignalsState old_producer_state =
+      impl_->ProducerGetHandleSignalsState();
+  MojoResult rv;
+  if (num_bytes_read > consumer_two_phase_max_num_bytes_read_ ||
+      num_bytes_read % element_num_bytes() != 0) {
+    rv = MOJO_RESULT_INVALID_ARGUMENT;
+    consumer_two_phase_max_num_bytes_read_ = 0;
+  } else {
+    rv = impl_->ConsumerEndReadData(num_bytes_read);
+  }
+  // Two-phase read ended even on failure.
+  DCHECK(!consumer_in_two_phase_read_no_lock());
+  // If we're now readable, we *became* readable (since we weren't readable
+  // during the two-phase read), so awake consumer awakables.
+  HandleSignalsState new_consumer_state =
+      impl_->ConsumerGetHandleSignalsState();
+  if (!new_consumer_state.equals(old_consumer_state))
+    AwakeConsumerAwakablesForStateChangeNoLock(new_consumer_state);
+  HandleSignalsState new_producer_state =
+      impl_->ProducerGetHandleSignalsState();
+  if (!new_producer_state.equals(old_producer_state))
+    AwakeProducerAwakablesForStateChangeNoLock(new_producer_state);
+  return rv;
+}
+
 }  // namespace system
 }  // namespace mojo
@@ -10,6 +10,7 @@
 #include <memory>
 #include <vector>
 
+#include "mojo/edk/platform/platform_shared_buffer.h"
 #include "mojo/edk/platform/scoped_platform_handle.h"
 #include "mojo/edk/system/channel_endpoint_client.h"
 #include "mojo/edk/system/handle_signals_state.h"
@@ -85,21 +86,53 @@ class DataPipe final : public ChannelEndpointClient {
       MessageInTransitQueue* message_queue,
       util::RefPtr<ChannelEndpoint>&& channel_endpoint);
 
+  // Like |CreateRemoteProducerFromExisting()|, but the data is in the shared
+  // memory ring buffer |ring_buffer| (mapped in its entirety by
+  // |ring_mapping|), instead of in messages: the current data is the
+  // |current_num_bytes| bytes (circularly) starting at |start_index|, plus
+  // whatever |message_queue| notifies of (see
+  // |RemoteProducerSharedRingDataPipeImpl|).
+  static util::RefPtr<DataPipe> CreateRemoteProducerSharedRingFromExisting(
+      const MojoCreateDataPipeOptions& validated_options,
+      MessageInTransitQueue* message_queue,
+      util::RefPtr<ChannelEndpoint>&& channel_endpoint,
+      util::RefPtr<platform::PlatformSharedBuffer>&& ring_buffer,
+      std::unique_ptr<platform::PlatformSharedBufferMapping> ring_mapping,
+      size_t start_index,
+      size_t current_num_bytes);
+
+  // Like |CreateRemoteConsumerFromExisting()|, but the data is in the shared
+  // memory ring buffer |ring_buffer| (mapped in its entirety by
+  // |ring_mapping|): the consumer's |consumer_num_bytes| bytes (circularly)
+  // start at |start_index| (see |RemoteConsumerSharedRingDataPipeImpl|).
+  static util::RefPtr<DataPipe> CreateRemoteConsumerSharedRingFromExisting(
+      const MojoCreateDataPipeOptions& validated_options,
+      size_t consumer_num_bytes,
+      MessageInTransitQueue* message_queue,
+      util::RefPtr<ChannelEndpoint>&& channel_endpoint,
+      util::RefPtr<platform::PlatformSharedBuffer>&& ring_buffer,
+      std::unique_ptr<platform::PlatformSharedBufferMapping> ring_mapping,
+      size_t start_index);
+
   // Used by |DataPipeProducerDispatcher::Deserialize()|. Returns true on
   // success (in which case, |*data_pipe| is set appropriately) and false on
   // failure (in which case |*data_pipe| may or may not be set to null).
-  static bool ProducerDeserialize(Channel* channel,
-                                  const void* source,
-                                  size_t size,
-                                  util::RefPtr<DataPipe>* data_pipe);
+  static bool ProducerDeserialize(
+      Channel* channel,
+      const void* source,
+      size_t size,
+      std::vector<platform::ScopedPlatformHandle>* platform_handles,
+      util::RefPtr<DataPipe>* data_pipe);
 
   // Used by |DataPipeConsumerDispatcher::Deserialize()|. Returns true on
   // success (in which case, |*data_pipe| is set appropriately) and false on
   // failure (in which case |*data_pipe| may or may not be set to null).
-  static bool ConsumerDeserialize(Channel* channel,
-                                  const void* source,
-                                  size_t size,
-                                  util::RefPtr<DataPipe>* data_pipe);
+  static bool ConsumerDeserialize(
+      Channel* channel,
+      const void* source,
+      size_t size,
+      std::vector<platform::ScopedPlatformHandle>* platform_handles,
+      util::RefPtr<DataPipe>* data_pipe);
 
   // These are called by the producer dispatcher to implement its methods of
   // corresponding names.
@@ -113,6 +146,16 @@ class DataPipe final : public ChannelEndpointClient {
   MojoResult ProducerBeginWriteData(UserPointer<void*> buffer,
                                     UserPointer<uint32_t> buffer_num_bytes);
   MojoResult ProducerEndWriteData(uint32_t num_bytes_written);
+  // |buffers| and |buffers_num_bytes| point to arrays of two entries.
+  MojoResult ProducerBeginWriteDataSpans(
+      UserPointer<void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes);
+  // This does not validate |num_buffers| (the caller should limit it).
+  MojoResult ProducerWriteDataV(UserPointer<const void* const> buffers,
+                                UserPointer<const uint32_t> buffers_num_bytes,
+                                uint32_t num_buffers,
+                                UserPointer<uint32_t> num_bytes_written,
+                                bool all_or_none);
   HandleSignalsState ProducerGetHandleSignalsState();
   MojoResult ProducerAddAwakable(Awakable* awakable,
                                  MojoHandleSignals signals,
@@ -151,6 +194,17 @@ class DataPipe final : public ChannelEndpointClient {
   MojoResult ConsumerBeginReadData(UserPointer<const void*> buffer,
                                    UserPointer<uint32_t> buffer_num_bytes);
   MojoResult ConsumerEndReadData(uint32_t num_bytes_read);
+  // |buffers| and |buffers_num_bytes| point to arrays of two entries.
+  MojoResult ConsumerBeginReadDataSpans(
+      UserPointer<const void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes);
+  // This does not validate |num_buffers| (the caller should limit it).
+  MojoResult ConsumerReadDataV(UserPointer<void* const> buffers,
+                               UserPointer<const uint32_t> buffers_num_bytes,
+                               uint32_t num_buffers,
+                               UserPointer<uint32_t> num_bytes_read,
+                               bool all_or_none,
+                               bool peek);
   HandleSignalsState ConsumerGetHandleSignalsState();
   MojoResult ConsumerAddAwakable(Awakable* awakable,
                                  MojoHandleSignals signals,
@@ -285,6 +339,14 @@ class DataPipe final : public ChannelEndpointClient {
   void SetProducerClosed();
   void SetConsumerClosed();
 
+  // These implement |ProducerEndWriteData()| and |ConsumerEndReadData()| (and
+  // are also used to complete the internal two-phase operations done by
+  // |ProducerWriteDataV()| and |ConsumerReadDataV()|).
+  MojoResult ProducerEndWriteDataNoLock(uint32_t num_bytes_written)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  MojoResult ConsumerEndReadDataNoLock(uint32_t num_bytes_read)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   bool has_local_producer_no_lock() const MOJO_SHARED_LOCKS_REQUIRED(mutex_) {
     mutex_.AssertHeld();
     return !!producer_awakable_list_;
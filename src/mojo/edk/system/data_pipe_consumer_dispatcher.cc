@@ -40,9 +40,11 @@ bool DataPipeConsumerDispatcher::SupportsEntrypointClass(
 RefPtr<DataPipeConsumerDispatcher> DataPipeConsumerDispatcher::Deserialize(
     Channel* channel,
     const void* source,
-    size_t size) {
+    size_t size,
+    std::vector<ScopedPlatformHandle>* platform_handles) {
   RefPtr<DataPipe> data_pipe;
-  if (!DataPipe::ConsumerDeserialize(channel, source, size, &data_pipe))
+  if (!DataPipe::ConsumerDeserialize(channel, source, size, platform_handles,
+                                     &data_pipe))
     return nullptr;
   DCHECK(data_pipe);
 
@@ -88,6 +90,15 @@ DataPipeConsumerDispatcher::CreateEquivalentDispatcherAndCloseImplNoLock(
   return dispatcher;
 }
 
+bool DataPipeConsumerDispatcher::PrepareForLocalTransferImplNoLock(
+    MessagePipe* /*message_pipe*/,
+    unsigned /*port*/) {
+  mutex().AssertHeld();
+
+  CancelAllStateNoLock();
+  return true;
+}
+
 MojoResult DataPipeConsumerDispatcher::SetDataPipeConsumerOptionsImplNoLock(
     UserPointer<const MojoDataPipeConsumerOptions> options) {
   mutex().AssertHeld();
@@ -186,6 +197,40 @@ MojoResult DataPipeConsumerDispatcher::EndReadDataImplNoLock(
   return data_pipe_->ConsumerEndReadData(num_bytes_read);
 }
 
+MojoResult DataPipeConsumerDispatcher::BeginReadDataSpansImplNoLock(
+    UserPointer<const void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes,
+    MojoReadDataFlags flags) {
+  mutex().AssertHeld();
+
+  // These flags may not be used in two-phase mode.
+  if ((flags & MOJO_READ_DATA_FLAG_ALL_OR_NONE) ||
+      (flags & MOJO_READ_DATA_FLAG_DISCARD) ||
+      (flags & MOJO_READ_DATA_FLAG_QUERY) || (flags & MOJO_READ_DATA_FLAG_PEEK))
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  return data_pipe_->ConsumerBeginReadDataSpans(buffers, buffers_num_bytes);
+}
+
+MojoResult DataPipeConsumerDispatcher::ReadDataVImplNoLock(
+    UserPointer<void* const> buffers,
+    UserPointer<const uint32_t> buffers_num_bytes,
+    uint32_t num_buffers,
+    UserPointer<uint32_t> num_bytes_read,
+    MojoReadDataFlags flags) {
+  mutex().AssertHeld();
+
+  // Discarding and querying are only supported by |ReadDataImplNoLock()|.
+  if ((flags & MOJO_READ_DATA_FLAG_DISCARD) ||
+      (flags & MOJO_READ_DATA_FLAG_QUERY))
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  return data_pipe_->ConsumerReadDataV(
+      buffers, buffers_num_bytes, num_buffers, num_bytes_read,
+      !!(flags & MOJO_READ_DATA_FLAG_ALL_OR_NONE),
+      !!(flags & MOJO_READ_DATA_FLAG_PEEK));
+}
+
 HandleSignalsState DataPipeConsumerDispatcher::GetHandleSignalsStateImplNoLock()
     const {
   mutex().AssertHeld();
@@ -38,8 +38,11 @@ class DataPipeConsumerDispatcher final : public Dispatcher {
 
   // The "opposite" of |SerializeAndClose()|. (Typically this is called by
   // |Dispatcher::Deserialize()|.)
-  static util::RefPtr<DataPipeConsumerDispatcher>
-  Deserialize(Channel* channel, const void* source, size_t size);
+  static util::RefPtr<DataPipeConsumerDispatcher> Deserialize(
+      Channel* channel,
+      const void* source,
+      size_t size,
+      std::vector<platform::ScopedPlatformHandle>* platform_handles);
 
   // Get access to the |DataPipe| for testing.
   DataPipe* GetDataPipeForTest();
@@ -54,6 +57,8 @@ class DataPipeConsumerDispatcher final : public Dispatcher {
   util::RefPtr<Dispatcher> CreateEquivalentDispatcherAndCloseImplNoLock(
       MessagePipe* message_pipe,
       unsigned port) override;
+  bool PrepareForLocalTransferImplNoLock(MessagePipe* message_pipe,
+                                         unsigned port) override;
   MojoResult SetDataPipeConsumerOptionsImplNoLock(
       UserPointer<const MojoDataPipeConsumerOptions> options) override;
   MojoResult GetDataPipeConsumerOptionsImplNoLock(
@@ -66,6 +71,15 @@ class DataPipeConsumerDispatcher final : public Dispatcher {
                                      UserPointer<uint32_t> buffer_num_bytes,
                                      MojoReadDataFlags flags) override;
   MojoResult EndReadDataImplNoLock(uint32_t num_bytes_read) override;
+  MojoResult BeginReadDataSpansImplNoLock(
+      UserPointer<const void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes,
+      MojoReadDataFlags flags) override;
+  MojoResult ReadDataVImplNoLock(UserPointer<void* const> buffers,
+                                 UserPointer<const uint32_t> buffers_num_bytes,
+                                 uint32_t num_buffers,
+                                 UserPointer<uint32_t> num_bytes_read,
+                                 MojoReadDataFlags flags) override;
   HandleSignalsState GetHandleSignalsStateImplNoLock() const override;
   MojoResult AddAwakableImplNoLock(Awakable* awakable,
                                    MojoHandleSignals signals,
@@ -16,6 +16,28 @@
 namespace mojo {
 namespace system {
 
+MojoResult DataPipeImpl::ProducerBeginWriteDataSpans(
+    UserPointer<void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes) {
+  MojoResult rv = ProducerBeginWriteData(buffers, buffers_num_bytes);
+  if (rv != MOJO_RESULT_OK)
+    return rv;
+  buffers.At(1).Put(nullptr);
+  buffers_num_bytes.At(1).Put(0);
+  return MOJO_RESULT_OK;
+}
+
+MojoResult DataPipeImpl::ConsumerBeginReadDataSpans(
+    UserPointer<const void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes) {
+  MojoResult rv = ConsumerBeginReadData(buffers, buffers_num_bytes);
+  if (rv != MOJO_RESULT_OK)
+    return rv;
+  buffers.At(1).Put(nullptr);
+  buffers_num_bytes.At(1).Put(0);
+  return MOJO_RESULT_OK;
+}
+
 void DataPipeImpl::ConvertDataToMessages(const char* buffer,
                                          size_t* start_index,
                                          size_t* current_num_bytes,
@@ -67,6 +67,13 @@ class DataPipeImpl {
       UserPointer<void*> buffer,
       UserPointer<uint32_t> buffer_num_bytes) = 0;
   virtual MojoResult ProducerEndWriteData(uint32_t num_bytes_written) = 0;
+  // Like |ProducerBeginWriteData()|, but |buffers| and |buffers_num_bytes|
+  // point to arrays of two entries: the second span (which may be empty)
+  // continues where the first leaves off, and |ProducerEndWriteData()| is given
+  // the total written. The default implementation only provides one span.
+  virtual MojoResult ProducerBeginWriteDataSpans(
+      UserPointer<void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes);
   // Note: A producer should not be writable during a two-phase write.
   virtual HandleSignalsState ProducerGetHandleSignalsState() const = 0;
   virtual void ProducerStartSerialize(Channel* channel,
@@ -94,6 +101,11 @@ class DataPipeImpl {
       UserPointer<const void*> buffer,
       UserPointer<uint32_t> buffer_num_bytes) = 0;
   virtual MojoResult ConsumerEndReadData(uint32_t num_bytes_read) = 0;
+  // Like |ConsumerBeginReadData()|, but with two spans (see
+  // |ProducerBeginWriteDataSpans()|).
+  virtual MojoResult ConsumerBeginReadDataSpans(
+      UserPointer<const void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes);
   // Note: A consumer should not be writable during a two-phase read.
   virtual HandleSignalsState ConsumerGetHandleSignalsState() const = 0;
   virtual void ConsumerStartSerialize(Channel* channel,
@@ -184,6 +196,10 @@ class DataPipeImpl {
 // TODO(vtl): This is not the ideal place for the following structs; find
 // somewhere better.
 
+// Value of |shared_ring_platform_handle_index| (below) when data is sent in
+// messages, instead of via a shared memory ring buffer.
+const uint32_t kNoSharedRingPlatformHandleIndex = static_cast<uint32_t>(-1);
+
 // Serialized form of a producer dispatcher. This will actually be followed by a
 // serialized |ChannelEndpoint|; we want to preserve alignment guarantees.
 struct MOJO_ALIGNAS(8) SerializedDataPipeProducerDispatcher {
@@ -194,6 +210,16 @@ struct MOJO_ALIGNAS(8) SerializedDataPipeProducerDispatcher {
   // |static_cast<size_t>(-1)| if the consumer is already closed, in which case
   // this will *not* be followed by a serialized |ChannelEndpoint|.
   size_t consumer_num_bytes;
+  // Index of the platform handle for the shared memory ring buffer (of size
+  // |validated_options.capacity_num_bytes|), or
+  // |kNoSharedRingPlatformHandleIndex| if there's no ring buffer.
+  uint32_t shared_ring_platform_handle_index;
+  // If there's a ring buffer, the index in it of the first of the
+  // |consumer_num_bytes| bytes enqueued to the consumer.
+  uint32_t shared_ring_start_index;
+  // The producer's write threshold, as set using
+  // |MojoSetDataPipeProducerOptions()| (0 meaning the default).
+  uint32_t write_threshold_num_bytes;
 };
 
 // Serialized form of a consumer dispatcher. This will actually be followed by a
@@ -202,6 +228,18 @@ struct MOJO_ALIGNAS(8) SerializedDataPipeConsumerDispatcher {
   // Only validated (and thus canonicalized) options should be serialized.
   // However, the deserializer must revalidate (as with everything received).
   MojoCreateDataPipeOptions validated_options;
+  // Index of the platform handle for the shared memory ring buffer (of size
+  // |validated_options.capacity_num_bytes|), or
+  // |kNoSharedRingPlatformHandleIndex| if there's no ring buffer (in which case
+  // any data is sent in messages).
+  uint32_t shared_ring_platform_handle_index;
+  // If there's a ring buffer, the index in it of the first byte of data and the
+  // number of bytes of data (already written to it).
+  uint32_t shared_ring_start_index;
+  uint32_t shared_ring_num_bytes;
+  // The consumer's read threshold, as set using
+  // |MojoSetDataPipeConsumerOptions()| (0 meaning the default).
+  uint32_t read_threshold_num_bytes;
 };
 
 }  // namespace system
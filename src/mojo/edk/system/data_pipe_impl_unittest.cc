@@ -18,6 +18,7 @@
 #include "mojo/edk/platform/thread_utils.h"
 #include "mojo/edk/system/channel.h"
 #include "mojo/edk/system/channel_endpoint.h"
+#include "mojo/edk/system/configuration.h"
 #include "mojo/edk/system/data_pipe.h"
 #include "mojo/edk/system/data_pipe_consumer_dispatcher.h"
 #include "mojo/edk/system/data_pipe_producer_dispatcher.h"
@@ -44,10 +45,10 @@ namespace {
 const uint32_t kSizeOfOptions =
     static_cast<uint32_t>(sizeof(MojoCreateDataPipeOptions));
 
-// In various places, we have to poll (since, e.g., we can't yet wait for a
-// certain amount of data to be available). This is the maximum number of
-// iterations (separated by a short sleep).
-// TODO(vtl): Get rid of this.
+// In a few places, the producer has to poll for space to become available
+// (consumers use |ConsumerWaitForData()| instead). This is the maximum number
+// of iterations (separated by a short sleep).
+// TODO(vtl): Get rid of this (using the write threshold).
 const size_t kMaxPoll = 100;
 
 // DataPipeImplTestHelper ------------------------------------------------------
@@ -139,6 +140,19 @@ class DataPipeImplTest : public testing::Test {
   MojoResult ProducerEndWriteData(uint32_t num_bytes_written) {
     return dpp()->ProducerEndWriteData(num_bytes_written);
   }
+  MojoResult ProducerBeginWriteDataSpans(
+      UserPointer<void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes) {
+    return dpp()->ProducerBeginWriteDataSpans(buffers, buffers_num_bytes);
+  }
+  MojoResult ProducerWriteDataV(UserPointer<const void* const> buffers,
+                                UserPointer<const uint32_t> buffers_num_bytes,
+                                uint32_t num_buffers,
+                                UserPointer<uint32_t> num_bytes_written,
+                                bool all_or_none) {
+    return dpp()->ProducerWriteDataV(buffers, buffers_num_bytes, num_buffers,
+                                     num_bytes_written, all_or_none);
+  }
   MojoResult ProducerAddAwakable(Awakable* awakable,
                                  MojoHandleSignals signals,
                                  bool force,
@@ -179,6 +193,20 @@ class DataPipeImplTest : public testing::Test {
   MojoResult ConsumerEndReadData(uint32_t num_bytes_read) {
     return dpc()->ConsumerEndReadData(num_bytes_read);
   }
+  MojoResult ConsumerBeginReadDataSpans(
+      UserPointer<const void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes) {
+    return dpc()->ConsumerBeginReadDataSpans(buffers, buffers_num_bytes);
+  }
+  MojoResult ConsumerReadDataV(UserPointer<void* const> buffers,
+                               UserPointer<const uint32_t> buffers_num_bytes,
+                               uint32_t num_buffers,
+                               UserPointer<uint32_t> num_bytes_read,
+                               bool all_or_none,
+                               bool peek) {
+    return dpc()->ConsumerReadDataV(buffers, buffers_num_bytes, num_buffers,
+                                    num_bytes_read, all_or_none, peek);
+  }
   MojoResult ConsumerAddAwakable(Awakable* awakable,
                                  MojoHandleSignals signals,
                                  bool force,
@@ -192,6 +220,26 @@ class DataPipeImplTest : public testing::Test {
     return dpc()->ConsumerRemoveAwakable(awakable, signals_state);
   }
 
+  // Waits (for at most |test::TinyTimeout()|) for at least |num_bytes| (which
+  // must be a multiple of the element size) to be available to the consumer,
+  // using the consumer's read threshold. Returns the number of bytes available.
+  uint32_t ConsumerWaitForData(uint32_t num_bytes) {
+    uint32_t old_read_threshold_num_bytes = 0u;
+    ConsumerGetOptions(&old_read_threshold_num_bytes);
+    EXPECT_EQ(MOJO_RESULT_OK, ConsumerSetOptions(num_bytes));
+    Waiter waiter;
+    waiter.Init();
+    if (ConsumerAddAwakable(&waiter, MOJO_HANDLE_SIGNAL_READ_THRESHOLD, false,
+                            0, nullptr) == MOJO_RESULT_OK) {
+      waiter.Wait(test::TinyTimeout(), nullptr);
+      ConsumerRemoveAwakable(&waiter, nullptr);
+    }
+    EXPECT_EQ(MOJO_RESULT_OK, ConsumerSetOptions(old_read_threshold_num_bytes));
+    uint32_t rv = 0u;
+    EXPECT_EQ(MOJO_RESULT_OK, ConsumerQueryData(MakeUserPointer(&rv)));
+    return rv;
+  }
+
  private:
   DataPipe* dpp() { return helper_->DataPipeForProducer(); }
   DataPipe* dpc() { return helper_->DataPipeForConsumer(); }
@@ -235,15 +283,24 @@ class LocalDataPipeImplTestHelper : public DataPipeImplTestHelper {
 
 // RemoteDataPipeImplTestHelper ------------------------------------------------
 
-// Base class for |Remote{Producer,Consumer}DataPipeImplTestHelper|.
+// Base class for |Remote{Producer,Consumer}DataPipeImplTestHelper|. If
+// |use_shared_ring| is true, data pipes sent over the channel will use a shared
+// memory ring buffer (i.e., |Remote{Producer,Consumer}SharedRingDataPipeImpl|);
+// otherwise, data will be sent in messages.
 class RemoteDataPipeImplTestHelper : public DataPipeImplTestHelper {
  public:
-  RemoteDataPipeImplTestHelper()
-      : platform_support_(embedder::CreateSimplePlatformSupport()),
+  explicit RemoteDataPipeImplTestHelper(bool use_shared_ring)
+      : use_shared_ring_(use_shared_ring),
+        platform_support_(embedder::CreateSimplePlatformSupport()),
         io_thread_(test::TestIOThread::StartMode::AUTO) {}
   ~RemoteDataPipeImplTestHelper() override {}
 
   void SetUp() override {
+    saved_use_shared_ring_ =
+        GetConfiguration().use_shared_memory_for_remote_data_pipes;
+    GetMutableConfiguration()->use_shared_memory_for_remote_data_pipes =
+        use_shared_ring_;
+
     RefPtr<ChannelEndpoint> ep[2];
     message_pipes_[0] = MessagePipe::CreateLocalProxy(&ep[0]);
     message_pipes_[1] = MessagePipe::CreateLocalProxy(&ep[1]);
@@ -257,6 +314,9 @@ class RemoteDataPipeImplTestHelper : public DataPipeImplTestHelper {
     EnsureMessagePipeClosed(0);
     EnsureMessagePipeClosed(1);
     io_thread_.PostTaskAndWait([this]() { TearDownOnIOThread(); });
+
+    GetMutableConfiguration()->use_shared_memory_for_remote_data_pipes =
+        saved_use_shared_ring_;
   }
 
   void Create(const MojoCreateDataPipeOptions& validated_options) override {
@@ -264,7 +324,8 @@ class RemoteDataPipeImplTestHelper : public DataPipeImplTestHelper {
     dp_ = DataPipe::CreateLocal(validated_options);
   }
 
-  bool IsStrictCircularBuffer() const override { return false; }
+  // The shared memory ring buffer is (by design) a strict circular buffer.
+  bool IsStrictCircularBuffer() const override { return use_shared_ring_; }
 
  protected:
   // Note: This has an out parameter instead of just returning a |Handle|, since
@@ -364,6 +425,8 @@ class RemoteDataPipeImplTestHelper : public DataPipeImplTestHelper {
     }
   }
 
+  const bool use_shared_ring_;
+  bool saved_use_shared_ring_ = false;
   std::unique_ptr<embedder::PlatformSupport> platform_support_;
   test::TestIOThread io_thread_;
   RefPtr<Channel> channels_[2];
@@ -382,7 +445,8 @@ class RemoteDataPipeImplTestHelper : public DataPipeImplTestHelper {
 class RemoteProducerDataPipeImplTestHelper
     : public RemoteDataPipeImplTestHelper {
  public:
-  RemoteProducerDataPipeImplTestHelper() {}
+  explicit RemoteProducerDataPipeImplTestHelper(bool use_shared_ring = false)
+      : RemoteDataPipeImplTestHelper(use_shared_ring) {}
   ~RemoteProducerDataPipeImplTestHelper() override {}
 
   void DoTransfer() override {
@@ -435,7 +499,8 @@ class RemoteProducerDataPipeImplTestHelper
 class RemoteConsumerDataPipeImplTestHelper
     : public RemoteDataPipeImplTestHelper {
  public:
-  RemoteConsumerDataPipeImplTestHelper() {}
+  explicit RemoteConsumerDataPipeImplTestHelper(bool use_shared_ring = false)
+      : RemoteDataPipeImplTestHelper(use_shared_ring) {}
   ~RemoteConsumerDataPipeImplTestHelper() override {}
 
   void DoTransfer() override {
@@ -493,7 +558,8 @@ class RemoteConsumerDataPipeImplTestHelper
 class RemoteProducerDataPipeImplTestHelper2
     : public RemoteProducerDataPipeImplTestHelper {
  public:
-  RemoteProducerDataPipeImplTestHelper2() {}
+  explicit RemoteProducerDataPipeImplTestHelper2(bool use_shared_ring = false)
+      : RemoteProducerDataPipeImplTestHelper(use_shared_ring) {}
   ~RemoteProducerDataPipeImplTestHelper2() override {}
 
   void DoTransfer() override {
@@ -543,7 +609,8 @@ class RemoteProducerDataPipeImplTestHelper2
 class RemoteConsumerDataPipeImplTestHelper2
     : public RemoteConsumerDataPipeImplTestHelper {
  public:
-  RemoteConsumerDataPipeImplTestHelper2() {}
+  explicit RemoteConsumerDataPipeImplTestHelper2(bool use_shared_ring = false)
+      : RemoteConsumerDataPipeImplTestHelper(use_shared_ring) {}
   ~RemoteConsumerDataPipeImplTestHelper2() override {}
 
   void DoTransfer() override {
@@ -580,13 +647,86 @@ class RemoteConsumerDataPipeImplTestHelper2
   MOJO_DISALLOW_COPY_AND_ASSIGN(RemoteConsumerDataPipeImplTestHelper2);
 };
 
+// RemoteProducerSharedRingDataPipeImplTestHelper ------------------------------
+
+// Note about naming confusion: This class is named after the "local" class,
+// i.e., |dp_| will have a |RemoteProducerSharedRingDataPipeImpl|. The remote
+// side, of course, will have a |RemoteConsumerSharedRingDataPipeImpl|.
+class RemoteProducerSharedRingDataPipeImplTestHelper
+    : public RemoteProducerDataPipeImplTestHelper {
+ public:
+  RemoteProducerSharedRingDataPipeImplTestHelper()
+      : RemoteProducerDataPipeImplTestHelper(true) {}
+  ~RemoteProducerSharedRingDataPipeImplTestHelper() override {}
+
+ private:
+  MOJO_DISALLOW_COPY_AND_ASSIGN(RemoteProducerSharedRingDataPipeImplTestHelper);
+};
+
+// RemoteConsumerSharedRingDataPipeImplTestHelper ------------------------------
+
+// Note about naming confusion: This class is named after the "local" class,
+// i.e., |dp_| will have a |RemoteConsumerSharedRingDataPipeImpl|. The remote
+// side, of course, will have a |RemoteProducerSharedRingDataPipeImpl|.
+class RemoteConsumerSharedRingDataPipeImplTestHelper
+    : public RemoteConsumerDataPipeImplTestHelper {
+ public:
+  RemoteConsumerSharedRingDataPipeImplTestHelper()
+      : RemoteConsumerDataPipeImplTestHelper(true) {}
+  ~RemoteConsumerSharedRingDataPipeImplTestHelper() override {}
+
+ private:
+  MOJO_DISALLOW_COPY_AND_ASSIGN(RemoteConsumerSharedRingDataPipeImplTestHelper);
+};
+
+// RemoteProducerSharedRingDataPipeImplTestHelper2 -----------------------------
+
+// This is like |RemoteProducerSharedRingDataPipeImplTestHelper|, but does a
+// second transfer (see |RemoteProducerDataPipeImplTestHelper2|). This tests
+// |RemoteConsumerSharedRingDataPipeImpl|'s |ProducerEndSerialize()| (which
+// passes on the ring buffer).
+class RemoteProducerSharedRingDataPipeImplTestHelper2
+    : public RemoteProducerDataPipeImplTestHelper2 {
+ public:
+  RemoteProducerSharedRingDataPipeImplTestHelper2()
+      : RemoteProducerDataPipeImplTestHelper2(true) {}
+  ~RemoteProducerSharedRingDataPipeImplTestHelper2() override {}
+
+ private:
+  MOJO_DISALLOW_COPY_AND_ASSIGN(
+      RemoteProducerSharedRingDataPipeImplTestHelper2);
+};
+
+// RemoteConsumerSharedRingDataPipeImplTestHelper2 -----------------------------
+
+// This is like |RemoteConsumerSharedRingDataPipeImplTestHelper|, but does a
+// second transfer (see |RemoteConsumerDataPipeImplTestHelper2|). This tests
+// |RemoteProducerSharedRingDataPipeImpl|'s |ConsumerEndSerialize()| (which
+// passes on the ring buffer).
+class RemoteConsumerSharedRingDataPipeImplTestHelper2
+    : public RemoteConsumerDataPipeImplTestHelper2 {
+ public:
+  RemoteConsumerSharedRingDataPipeImplTestHelper2()
+      : RemoteConsumerDataPipeImplTestHelper2(true) {}
+  ~RemoteConsumerSharedRingDataPipeImplTestHelper2() override {}
+
+ private:
+  MOJO_DISALLOW_COPY_AND_ASSIGN(
+      RemoteConsumerSharedRingDataPipeImplTestHelper2);
+};
+
 // Test case instantiation -----------------------------------------------------
 
-using HelperTypes = testing::Types<LocalDataPipeImplTestHelper,
-                                   RemoteProducerDataPipeImplTestHelper,
-                                   RemoteConsumerDataPipeImplTestHelper,
-                                   RemoteProducerDataPipeImplTestHelper2,
-                                   RemoteConsumerDataPipeImplTestHelper2>;
+using HelperTypes =
+    testing::Types<LocalDataPipeImplTestHelper,
+                   RemoteProducerDataPipeImplTestHelper,
+                   RemoteConsumerDataPipeImplTestHelper,
+                   RemoteProducerDataPipeImplTestHelper2,
+                   RemoteConsumerDataPipeImplTestHelper2,
+                   RemoteProducerSharedRingDataPipeImplTestHelper,
+                   RemoteConsumerSharedRingDataPipeImplTestHelper,
+                   RemoteProducerSharedRingDataPipeImplTestHelper2,
+                   RemoteConsumerSharedRingDataPipeImplTestHelper2>;
 
 TYPED_TEST_CASE(DataPipeImplTest, HelperTypes);
 
@@ -1558,10 +1698,6 @@ TYPED_TEST(DataPipeImplTest, AllOrNone) {
   EXPECT_EQ(5u * sizeof(int32_t), num_bytes);
 
   // Wait for data.
-  // TODO(vtl): There's no real guarantee that all the data will become
-  // available at once (except that in current implementations, with reasonable
-  // limits, it will). Eventually, we'll be able to wait for a specified amount
-  // of data to become available.
   EXPECT_EQ(MOJO_RESULT_OK, waiter.Wait(test::TinyTimeout(), nullptr));
   hss = HandleSignalsState();
   this->ConsumerRemoveAwakable(&waiter, &hss);
@@ -1571,10 +1707,8 @@ TYPED_TEST(DataPipeImplTest, AllOrNone) {
                 MOJO_HANDLE_SIGNAL_READ_THRESHOLD,
             hss.satisfiable_signals);
 
-  // Half full.
-  num_bytes = 0u;
-  EXPECT_EQ(MOJO_RESULT_OK,
-            this->ConsumerQueryData(MakeUserPointer(&num_bytes)));
+  // Half full (once all the data has arrived).
+  num_bytes = this->ConsumerWaitForData(5u * sizeof(int32_t));
   EXPECT_EQ(5u * sizeof(int32_t), num_bytes);
 
   // Too much.
@@ -1615,17 +1749,7 @@ TYPED_TEST(DataPipeImplTest, AllOrNone) {
                                     MakeUserPointer(&num_bytes), true));
   EXPECT_EQ(3u * sizeof(int32_t), num_bytes);
 
-  // TODO(vtl): Hack (see also the TODO above): We can't currently wait for a
-  // specified amount of data to be available, so poll.
-  for (size_t i = 0; i < kMaxPoll; i++) {
-    num_bytes = 0u;
-    EXPECT_EQ(MOJO_RESULT_OK,
-              this->ConsumerQueryData(MakeUserPointer(&num_bytes)));
-    if (num_bytes >= 10u * sizeof(int32_t))
-      break;
-
-    ThreadSleep(test::EpsilonTimeout());
-  }
+  num_bytes = this->ConsumerWaitForData(10u * sizeof(int32_t));
   EXPECT_EQ(10u * sizeof(int32_t), num_bytes);
 
   // Read half.
@@ -1819,17 +1943,7 @@ TYPED_TEST(DataPipeImplTest, WrapAround) {
   }
   EXPECT_EQ(90u, total_num_bytes);
 
-  // TODO(vtl): (See corresponding TODO in TwoPhaseAllOrNone.)
-  for (size_t i = 0; i < kMaxPoll; i++) {
-    // We have 100.
-    num_bytes = 0u;
-    EXPECT_EQ(MOJO_RESULT_OK,
-              this->ConsumerQueryData(MakeUserPointer(&num_bytes)));
-    if (num_bytes >= 100u)
-      break;
-
-    ThreadSleep(test::EpsilonTimeout());
-  }
+  num_bytes = this->ConsumerWaitForData(100u);
   EXPECT_EQ(100u, num_bytes);
 
   if (this->IsStrictCircularBuffer()) {
@@ -1860,6 +1974,182 @@ TYPED_TEST(DataPipeImplTest, WrapAround) {
   this->ConsumerClose();
 }
 
+// Like |WrapAround|, but uses two-phase spans and vectored reads/writes, which
+// should be able to use all the space/data even when it wraps around.
+TYPED_TEST(DataPipeImplTest, WrapAroundSpansAndVectored) {
+  unsigned char test_data[1000];
+  for (size_t i = 0; i < MOJO_ARRAYSIZE(test_data); i++)
+    test_data[i] = static_cast<unsigned char>(i);
+
+  const MojoCreateDataPipeOptions options = {
+      kSizeOfOptions,                           // |struct_size|.
+      MOJO_CREATE_DATA_PIPE_OPTIONS_FLAG_NONE,  // |flags|.
+      1u,                                       // |element_num_bytes|.
+      100u                                      // |capacity_num_bytes|.
+  };
+  MojoCreateDataPipeOptions validated_options = {};
+  // This test won't be valid if |ValidateCreateOptions()| decides to give the
+  // pipe more space.
+  EXPECT_EQ(MOJO_RESULT_OK, DataPipe::ValidateCreateOptions(
+                                MakeUserPointer(&options), &validated_options));
+  ASSERT_EQ(100u, validated_options.capacity_num_bytes);
+  this->Create(options);
+  this->DoTransfer();
+
+  // Write 20 bytes, from two buffers.
+  const void* write_buffers[2] = {&test_data[0], &test_data[5]};
+  uint32_t write_buffers_num_bytes[2] = {5u, 15u};
+  uint32_t num_bytes = 0u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            this->ProducerWriteDataV(MakeUserPointer(write_buffers),
+                                     MakeUserPointer(write_buffers_num_bytes),
+                                     2u, MakeUserPointer(&num_bytes), false));
+  EXPECT_EQ(20u, num_bytes);
+
+  num_bytes = this->ConsumerWaitForData(20u);
+  EXPECT_EQ(20u, num_bytes);
+
+  // Read 10 bytes, into three buffers.
+  unsigned char read_buffer[1000] = {0};
+  void* read_buffers[3] = {&read_buffer[0], &read_buffer[3], &read_buffer[6]};
+  uint32_t read_buffers_num_bytes[3] = {3u, 3u, 4u};
+  num_bytes = 0u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            this->ConsumerReadDataV(MakeUserPointer(read_buffers),
+                                    MakeUserPointer(read_buffers_num_bytes),
+                                    3u, MakeUserPointer(&num_bytes), false,
+                                    false));
+  EXPECT_EQ(10u, num_bytes);
+  EXPECT_EQ(0, memcmp(read_buffer, &test_data[0], 10u));
+
+  // A two-phase write should (eventually) get all 90 bytes of free space.
+  void* write_spans[2] = {};
+  uint32_t write_spans_num_bytes[2] = {};
+  // TODO(vtl): (See corresponding TODO in TwoPhaseAllOrNone.)
+  for (size_t i = 0; i < kMaxPoll; i++) {
+    EXPECT_EQ(MOJO_RESULT_OK, this->ProducerBeginWriteDataSpans(
+                                  MakeUserPointer(write_spans),
+                                  MakeUserPointer(write_spans_num_bytes)));
+    if (write_spans_num_bytes[0] + write_spans_num_bytes[1] >= 90u)
+      break;
+    EXPECT_EQ(MOJO_RESULT_OK, this->ProducerEndWriteData(0u));
+
+    ThreadSleep(test::EpsilonTimeout());
+  }
+  ASSERT_EQ(90u, write_spans_num_bytes[0] + write_spans_num_bytes[1]);
+  if (this->IsStrictCircularBuffer()) {
+    // The free space wraps around. (This checks an implementation detail.)
+    EXPECT_EQ(80u, write_spans_num_bytes[0]);
+    EXPECT_EQ(10u, write_spans_num_bytes[1]);
+  }
+  memcpy(write_spans[0], &test_data[20], write_spans_num_bytes[0]);
+  if (write_spans_num_bytes[1] > 0u) {
+    memcpy(write_spans[1], &test_data[20 + write_spans_num_bytes[0]],
+           write_spans_num_bytes[1]);
+  }
+  EXPECT_EQ(MOJO_RESULT_OK, this->ProducerEndWriteData(90u));
+
+  num_bytes = this->ConsumerWaitForData(100u);
+  EXPECT_EQ(100u, num_bytes);
+
+  // A two-phase read should get all 100 bytes.
+  const void* read_spans[2] = {};
+  uint32_t read_spans_num_bytes[2] = {};
+  EXPECT_EQ(MOJO_RESULT_OK, this->ConsumerBeginReadDataSpans(
+                                MakeUserPointer(read_spans),
+                                MakeUserPointer(read_spans_num_bytes)));
+  ASSERT_EQ(100u, read_spans_num_bytes[0] + read_spans_num_bytes[1]);
+  if (this->IsStrictCircularBuffer()) {
+    // The data wraps around. (This checks an implementation detail.)
+    EXPECT_EQ(90u, read_spans_num_bytes[0]);
+    EXPECT_EQ(10u, read_spans_num_bytes[1]);
+  }
+  EXPECT_EQ(0, memcmp(read_spans[0], &test_data[10], read_spans_num_bytes[0]));
+  if (read_spans_num_bytes[1] > 0u) {
+    EXPECT_EQ(0, memcmp(read_spans[1], &test_data[10 + read_spans_num_bytes[0]],
+                        read_spans_num_bytes[1]));
+  }
+  EXPECT_EQ(MOJO_RESULT_OK, this->ConsumerEndReadData(100u));
+
+  // Writing more than the capacity "all or none" should fail.
+  write_buffers[0] = &test_data[0];
+  write_buffers_num_bytes[0] = 50u;
+  write_buffers[1] = &test_data[50];
+  write_buffers_num_bytes[1] = 51u;
+  num_bytes = 123u;
+  EXPECT_EQ(MOJO_RESULT_OUT_OF_RANGE,
+            this->ProducerWriteDataV(MakeUserPointer(write_buffers),
+                                     MakeUserPointer(write_buffers_num_bytes),
+                                     2u, MakeUserPointer(&num_bytes), true));
+  EXPECT_EQ(123u, num_bytes);
+
+  // Reading from an empty data pipe "all or none" should fail.
+  read_buffers_num_bytes[0] = 1u;
+  EXPECT_EQ(MOJO_RESULT_OUT_OF_RANGE,
+            this->ConsumerReadDataV(MakeUserPointer(read_buffers),
+                                    MakeUserPointer(read_buffers_num_bytes),
+                                    1u, MakeUserPointer(&num_bytes), true,
+                                    false));
+  EXPECT_EQ(123u, num_bytes);
+
+  // Write 4 bytes "all or none" (once there's space).
+  write_buffers_num_bytes[0] = 1u;
+  write_buffers_num_bytes[1] = 3u;
+  // TODO(vtl): (See corresponding TODO in TwoPhaseAllOrNone.)
+  MojoResult result = MOJO_RESULT_INTERNAL;
+  for (size_t i = 0; i < kMaxPoll; i++) {
+    result = this->ProducerWriteDataV(MakeUserPointer(write_buffers),
+                                      MakeUserPointer(write_buffers_num_bytes),
+                                      2u, MakeUserPointer(&num_bytes), true);
+    if (result == MOJO_RESULT_OK)
+      break;
+    EXPECT_EQ(MOJO_RESULT_OUT_OF_RANGE, result);
+
+    ThreadSleep(test::EpsilonTimeout());
+  }
+  EXPECT_EQ(MOJO_RESULT_OK, result);
+  EXPECT_EQ(4u, num_bytes);
+
+  num_bytes = this->ConsumerWaitForData(4u);
+  EXPECT_EQ(4u, num_bytes);
+
+  // Peek them, into two buffers.
+  memset(read_buffer, 0, sizeof(read_buffer));
+  read_buffers_num_bytes[0] = 2u;
+  read_buffers_num_bytes[1] = 2u;
+  read_buffers[1] = &read_buffer[2];
+  num_bytes = 0u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            this->ConsumerReadDataV(MakeUserPointer(read_buffers),
+                                    MakeUserPointer(read_buffers_num_bytes),
+                                    2u, MakeUserPointer(&num_bytes), true,
+                                    true));
+  EXPECT_EQ(4u, num_bytes);
+  EXPECT_EQ(test_data[0], read_buffer[0]);
+  EXPECT_EQ(0, memcmp(&read_buffer[1], &test_data[50], 3u));
+
+  // Then read them (asking for more, not "all or none").
+  memset(read_buffer, 0, sizeof(read_buffer));
+  read_buffers_num_bytes[1] = 10u;
+  num_bytes = 0u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            this->ConsumerReadDataV(MakeUserPointer(read_buffers),
+                                    MakeUserPointer(read_buffers_num_bytes),
+                                    2u, MakeUserPointer(&num_bytes), false,
+                                    false));
+  EXPECT_EQ(4u, num_bytes);
+  EXPECT_EQ(test_data[0], read_buffer[0]);
+  EXPECT_EQ(0, memcmp(&read_buffer[1], &test_data[50], 3u));
+
+  num_bytes = 0u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            this->ConsumerQueryData(MakeUserPointer(&num_bytes)));
+  EXPECT_EQ(0u, num_bytes);
+
+  this->ProducerClose();
+  this->ConsumerClose();
+}
+
 // Tests the behavior of writing (simple and two-phase), closing the producer,
 // then reading (simple and two-phase).
 TYPED_TEST(DataPipeImplTest, WriteCloseProducerRead) {
@@ -1898,16 +2188,7 @@ TYPED_TEST(DataPipeImplTest, WriteCloseProducerRead) {
   EXPECT_TRUE(write_buffer_ptr);
   EXPECT_GT(num_bytes, 0u);
 
-  // TODO(vtl): (See corresponding TODO in TwoPhaseAllOrNone.)
-  for (size_t i = 0; i < kMaxPoll; i++) {
-    num_bytes = 0u;
-    EXPECT_EQ(MOJO_RESULT_OK,
-              this->ConsumerQueryData(MakeUserPointer(&num_bytes)));
-    if (num_bytes >= 2u * kTestDataSize)
-      break;
-
-    ThreadSleep(test::EpsilonTimeout());
-  }
+  num_bytes = this->ConsumerWaitForData(2u * kTestDataSize);
   EXPECT_EQ(2u * kTestDataSize, num_bytes);
 
   // Start two-phase read.
@@ -2552,17 +2833,7 @@ TYPED_TEST(DataPipeImplTest, WriteCloseProducerTwoPhaseReadAllData) {
                                     MakeUserPointer(&num_bytes), false));
   EXPECT_EQ(kTestDataSize, num_bytes);
 
-  // TODO(vtl): Hack: We can't currently wait for a specified amount of data to
-  // be available, so poll.
-  for (size_t i = 0; i < kMaxPoll; i++) {
-    num_bytes = 0u;
-    EXPECT_EQ(MOJO_RESULT_OK,
-              this->ConsumerQueryData(MakeUserPointer(&num_bytes)));
-    if (num_bytes >= kTestDataSize)
-      break;
-
-    ThreadSleep(test::EpsilonTimeout());
-  }
+  num_bytes = this->ConsumerWaitForData(kTestDataSize);
   EXPECT_EQ(kTestDataSize, num_bytes);
 
   const void* read_buffer_ptr = nullptr;
@@ -2750,6 +3021,80 @@ TYPED_TEST(DataPipeImplTest, WriteThreshold) {
   this->ProducerClose();
 }
 
+TYPED_TEST(DataPipeImplTest, ThresholdsAndTransfer) {
+  const MojoCreateDataPipeOptions options = {
+      kSizeOfOptions,                           // |struct_size|.
+      MOJO_CREATE_DATA_PIPE_OPTIONS_FLAG_NONE,  // |flags|.
+      2u,                                       // |element_num_bytes|.
+      100u                                      // |capacity_num_bytes|.
+  };
+  this->Create(options);
+
+  // Set the thresholds before (possibly) transferring.
+  EXPECT_EQ(MOJO_RESULT_OK, this->ProducerSetOptions(10u));
+  EXPECT_EQ(MOJO_RESULT_OK, this->ConsumerSetOptions(6u));
+  this->DoTransfer();
+
+  // The thresholds should have been preserved.
+  uint32_t write_threshold_num_bytes = 123u;
+  this->ProducerGetOptions(&write_threshold_num_bytes);
+  EXPECT_EQ(10u, write_threshold_num_bytes);
+  uint32_t read_threshold_num_bytes = 123u;
+  this->ConsumerGetOptions(&read_threshold_num_bytes);
+  EXPECT_EQ(6u, read_threshold_num_bytes);
+
+  Waiter waiter;
+  HandleSignalsState hss;
+
+  // Add a waiter.
+  waiter.Init();
+  ASSERT_EQ(MOJO_RESULT_OK,
+            this->ConsumerAddAwakable(
+                &waiter, MOJO_HANDLE_SIGNAL_READ_THRESHOLD, false, 0, nullptr));
+
+  // Write 4 bytes: not enough to reach the read threshold.
+  const char kTestData[] = {'a', 'b', 'c', 'd', 'e', 'f'};
+  uint32_t num_bytes = 4u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            this->ProducerWriteData(UserPointer<const void>(kTestData),
+                                    MakeUserPointer(&num_bytes), false));
+  EXPECT_EQ(4u, num_bytes);
+  EXPECT_EQ(MOJO_RESULT_DEADLINE_EXCEEDED,
+            waiter.Wait(test::EpsilonTimeout(), nullptr));
+  hss = HandleSignalsState();
+  this->ConsumerRemoveAwakable(&waiter, &hss);
+  EXPECT_FALSE(hss.satisfies(MOJO_HANDLE_SIGNAL_READ_THRESHOLD));
+
+  // Add a waiter.
+  waiter.Init();
+  ASSERT_EQ(MOJO_RESULT_OK,
+            this->ConsumerAddAwakable(
+                &waiter, MOJO_HANDLE_SIGNAL_READ_THRESHOLD, false, 0, nullptr));
+
+  // Write 2 more bytes; the waiter should now be woken.
+  num_bytes = 2u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            this->ProducerWriteData(UserPointer<const void>(&kTestData[4]),
+                                    MakeUserPointer(&num_bytes), false));
+  EXPECT_EQ(2u, num_bytes);
+  EXPECT_EQ(MOJO_RESULT_OK, waiter.Wait(test::TinyTimeout(), nullptr));
+  hss = HandleSignalsState();
+  this->ConsumerRemoveAwakable(&waiter, &hss);
+  EXPECT_EQ(MOJO_HANDLE_SIGNAL_READABLE | MOJO_HANDLE_SIGNAL_READ_THRESHOLD,
+            hss.satisfied_signals);
+
+  // Read everything.
+  char read_buffer[sizeof(kTestData)] = {};
+  num_bytes = static_cast<uint32_t>(sizeof(read_buffer));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            this->ConsumerReadData(UserPointer<void>(read_buffer),
+                                   MakeUserPointer(&num_bytes), true, false));
+  EXPECT_EQ(0, memcmp(read_buffer, kTestData, sizeof(kTestData)));
+
+  this->ProducerClose();
+  this->ConsumerClose();
+}
+
 TYPED_TEST(DataPipeImplTest, ReadThreshold) {
   const MojoCreateDataPipeOptions options = {
       kSizeOfOptions,                           // |struct_size|.
@@ -39,9 +39,11 @@ bool DataPipeProducerDispatcher::SupportsEntrypointClass(
 RefPtr<DataPipeProducerDispatcher> DataPipeProducerDispatcher::Deserialize(
     Channel* channel,
     const void* source,
-    size_t size) {
+    size_t size,
+    std::vector<ScopedPlatformHandle>* platform_handles) {
   RefPtr<DataPipe> data_pipe;
-  if (!DataPipe::ProducerDeserialize(channel, source, size, &data_pipe))
+  if (!DataPipe::ProducerDeserialize(channel, source, size, platform_handles,
+                                     &data_pipe))
     return nullptr;
   DCHECK(data_pipe);
 
@@ -87,6 +89,15 @@ DataPipeProducerDispatcher::CreateEquivalentDispatcherAndCloseImplNoLock(
   return dispatcher;
 }
 
+bool DataPipeProducerDispatcher::PrepareForLocalTransferImplNoLock(
+    MessagePipe* /*message_pipe*/,
+    unsigned /*port*/) {
+  mutex().AssertHeld();
+
+  CancelAllStateNoLock();
+  return true;
+}
+
 MojoResult DataPipeProducerDispatcher::SetDataPipeProducerOptionsImplNoLock(
     UserPointer<const MojoDataPipeProducerOptions> options) {
   mutex().AssertHeld();
@@ -161,6 +172,31 @@ MojoResult DataPipeProducerDispatcher::EndWriteDataImplNoLock(
   return data_pipe_->ProducerEndWriteData(num_bytes_written);
 }
 
+MojoResult DataPipeProducerDispatcher::BeginWriteDataSpansImplNoLock(
+    UserPointer<void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes,
+    MojoWriteDataFlags flags) {
+  mutex().AssertHeld();
+
+  // This flag may not be used in two-phase mode.
+  if ((flags & MOJO_WRITE_DATA_FLAG_ALL_OR_NONE))
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  return data_pipe_->ProducerBeginWriteDataSpans(buffers, buffers_num_bytes);
+}
+
+MojoResult DataPipeProducerDispatcher::WriteDataVImplNoLock(
+    UserPointer<const void* const> buffers,
+    UserPointer<const uint32_t> buffers_num_bytes,
+    uint32_t num_buffers,
+    UserPointer<uint32_t> num_bytes_written,
+    MojoWriteDataFlags flags) {
+  mutex().AssertHeld();
+  return data_pipe_->ProducerWriteDataV(
+      buffers, buffers_num_bytes, num_buffers, num_bytes_written,
+      (flags & MOJO_WRITE_DATA_FLAG_ALL_OR_NONE));
+}
+
 HandleSignalsState DataPipeProducerDispatcher::GetHandleSignalsStateImplNoLock()
     const {
   mutex().AssertHeld();
@@ -38,8 +38,11 @@ class DataPipeProducerDispatcher final : public Dispatcher {
 
   // The "opposite" of |SerializeAndClose()|. (Typically this is called by
   // |Dispatcher::Deserialize()|.)
-  static util::RefPtr<DataPipeProducerDispatcher>
-  Deserialize(Channel* channel, const void* source, size_t size);
+  static util::RefPtr<DataPipeProducerDispatcher> Deserialize(
+      Channel* channel,
+      const void* source,
+      size_t size,
+      std::vector<platform::ScopedPlatformHandle>* platform_handles);
 
   // Get access to the |DataPipe| for testing.
   DataPipe* GetDataPipeForTest();
@@ -54,6 +57,8 @@ class DataPipeProducerDispatcher final : public Dispatcher {
   util::RefPtr<Dispatcher> CreateEquivalentDispatcherAndCloseImplNoLock(
       MessagePipe* message_pipe,
       unsigned port) override;
+  bool PrepareForLocalTransferImplNoLock(MessagePipe* message_pipe,
+                                         unsigned port) override;
   MojoResult SetDataPipeProducerOptionsImplNoLock(
       UserPointer<const MojoDataPipeProducerOptions> options) override;
   MojoResult GetDataPipeProducerOptionsImplNoLock(
@@ -66,6 +71,15 @@ class DataPipeProducerDispatcher final : public Dispatcher {
                                       UserPointer<uint32_t> buffer_num_bytes,
                                       MojoWriteDataFlags flags) override;
   MojoResult EndWriteDataImplNoLock(uint32_t num_bytes_written) override;
+  MojoResult BeginWriteDataSpansImplNoLock(
+      UserPointer<void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes,
+      MojoWriteDataFlags flags) override;
+  MojoResult WriteDataVImplNoLock(UserPointer<const void* const> buffers,
+                                  UserPointer<const uint32_t> buffers_num_bytes,
+                                  uint32_t num_buffers,
+                                  UserPointer<uint32_t> num_bytes_written,
+                                  MojoWriteDataFlags flags) override;
   HandleSignalsState GetHandleSignalsStateImplNoLock() const override;
   MojoResult AddAwakableImplNoLock(Awakable* awakable,
                                    MojoHandleSignals signals,
@@ -4,6 +4,8 @@
 
 #include "mojo/edk/system/dispatcher.h"
 
+#include <utility>
+
 #include "base/logging.h"
 #include "mojo/edk/system/configuration.h"
 #include "mojo/edk/system/data_pipe_consumer_dispatcher.h"
@@ -49,6 +51,15 @@ HandleTransport Dispatcher::HandleTableAccess::TryStartTransport(
   return HandleTransport(handle);
 }
 
+// static
+HandleTransport Dispatcher::HandleTableAccess::TryStartTransport(
+    Handle* handle) {
+  HandleTransport transport = TryStartTransport(*handle);
+  if (transport.is_valid())
+    transport.handle_ = handle;
+  return transport;
+}
+
 // static
 void Dispatcher::TransportDataAccess::StartSerialize(
     Dispatcher* dispatcher,
@@ -85,9 +96,11 @@ RefPtr<Dispatcher> Dispatcher::TransportDataAccess::Deserialize(
     case Type::MESSAGE_PIPE:
       return MessagePipeDispatcher::Deserialize(channel, source, size);
     case Type::DATA_PIPE_PRODUCER:
-      return DataPipeProducerDispatcher::Deserialize(channel, source, size);
+      return DataPipeProducerDispatcher::Deserialize(channel, source, size,
+                                                     platform_handles);
     case Type::DATA_PIPE_CONSUMER:
-      return DataPipeConsumerDispatcher::Deserialize(channel, source, size);
+      return DataPipeConsumerDispatcher::Deserialize(channel, source, size,
+                                                     platform_handles);
     case Type::SHARED_BUFFER:
       return SharedBufferDispatcher::Deserialize(channel, source, size,
                                                  platform_handles);
@@ -150,6 +163,117 @@ MojoResult Dispatcher::ReadMessage(UserPointer<void> bytes,
   return ReadMessageImplNoLock(bytes, num_bytes, handles, num_handles, flags);
 }
 
+MojoResult Dispatcher::BeginReadMessage(UserPointer<void*> buffer,
+                                        UserPointer<uint32_t> buffer_num_bytes,
+                                        HandleVector* handles,
+                                        uint32_t* num_handles,
+                                        MojoReadMessageFlags flags) {
+  DCHECK(!num_handles || *num_handles == 0 || (handles && handles->empty()));
+
+  MutexLocker locker(&mutex_);
+  if (is_closed_)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  return BeginReadMessageImplNoLock(buffer, buffer_num_bytes, handles,
+                                    num_handles, flags);
+}
+
+MojoResult Dispatcher::EndReadMessage() {
+  MutexLocker locker(&mutex_);
+  if (is_closed_)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  return EndReadMessageImplNoLock();
+}
+
+MojoResult Dispatcher::WriteMessages(
+    UserPointer<const void> bytes,
+    UserPointer<const uint32_t> message_num_bytes,
+    uint32_t num_messages,
+    uint32_t* num_messages_written,
+    MojoWriteMessageFlags flags) {
+  DCHECK(num_messages_written);
+  *num_messages_written = 0;
+
+  MutexLocker locker(&mutex_);
+  if (is_closed_)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  size_t offset = 0;
+  for (uint32_t i = 0; i < num_messages; i++) {
+    uint32_t num_bytes = message_num_bytes.At(i).Get();
+    MojoResult result =
+        WriteMessageImplNoLock(bytes.At(offset), num_bytes, nullptr, flags);
+    if (result != MOJO_RESULT_OK)
+      return result;
+    offset += num_bytes;
+    (*num_messages_written)++;
+  }
+  return MOJO_RESULT_OK;
+}
+
+MojoResult Dispatcher::ReadMessages(UserPointer<void> bytes,
+                                    uint32_t* num_bytes,
+                                    HandleVector* handles,
+                                    uint32_t* num_handles,
+                                    UserPointer<uint32_t> message_num_bytes,
+                                    UserPointer<uint32_t> message_num_handles,
+                                    uint32_t* num_messages,
+                                    MojoReadMessageFlags flags) {
+  DCHECK(num_bytes);
+  DCHECK(num_handles);
+  DCHECK(*num_handles == 0 || (handles && handles->empty()));
+  DCHECK(num_messages);
+  DCHECK_GT(*num_messages, 0u);
+
+  const uint32_t max_num_bytes = *num_bytes;
+  const uint32_t max_num_handles = *num_handles;
+  const uint32_t max_num_messages = *num_messages;
+  *num_bytes = 0;
+  *num_handles = 0;
+  *num_messages = 0;
+
+  MutexLocker locker(&mutex_);
+  if (is_closed_)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  HandleVector message_handles;
+  for (uint32_t i = 0; i < max_num_messages; i++) {
+    uint32_t message_num_bytes_value = max_num_bytes - *num_bytes;
+    uint32_t message_num_handles_value = max_num_handles - *num_handles;
+    // Only the first message may be discarded: later messages that don't fit
+    // are left for the next read.
+    MojoResult result = ReadMessageImplNoLock(
+        bytes.At(*num_bytes), MakeUserPointer(&message_num_bytes_value),
+        message_num_handles_value ? &message_handles : nullptr,
+        &message_num_handles_value,
+        i == 0 ? flags : (flags & ~MOJO_READ_MESSAGE_FLAG_MAY_DISCARD));
+    if (result != MOJO_RESULT_OK) {
+      if (i > 0)
+        break;
+      if (result == MOJO_RESULT_RESOURCE_EXHAUSTED) {
+        message_num_bytes.Put(message_num_bytes_value);
+        if (!message_num_handles.IsNull())
+          message_num_handles.Put(message_num_handles_value);
+      }
+      return result;
+    }
+
+    message_num_bytes.At(i).Put(message_num_bytes_value);
+    if (!message_num_handles.IsNull())
+      message_num_handles.At(i).Put(message_num_handles_value);
+    *num_bytes += message_num_bytes_value;
+    *num_handles += message_num_handles_value;
+    (*num_messages)++;
+    if (!message_handles.empty()) {
+      for (auto& handle : message_handles)
+        handles->push_back(std::move(handle));
+      message_handles.clear();
+    }
+  }
+  return MOJO_RESULT_OK;
+}
+
 MojoResult Dispatcher::SetDataPipeProducerOptions(
     UserPointer<const MojoDataPipeProducerOptions> options) {
   MutexLocker locker(&mutex_);
@@ -197,6 +321,30 @@ MojoResult Dispatcher::EndWriteData(uint32_t num_bytes_written) {
   return EndWriteDataImplNoLock(num_bytes_written);
 }
 
+MojoResult Dispatcher::BeginWriteDataSpans(
+    UserPointer<void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes,
+    MojoWriteDataFlags flags) {
+  MutexLocker locker(&mutex_);
+  if (is_closed_)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  return BeginWriteDataSpansImplNoLock(buffers, buffers_num_bytes, flags);
+}
+
+MojoResult Dispatcher::WriteDataV(UserPointer<const void* const> buffers,
+                                  UserPointer<const uint32_t> buffers_num_bytes,
+                                  uint32_t num_buffers,
+                                  UserPointer<uint32_t> num_bytes_written,
+                                  MojoWriteDataFlags flags) {
+  MutexLocker locker(&mutex_);
+  if (is_closed_)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  return WriteDataVImplNoLock(buffers, buffers_num_bytes, num_buffers,
+                              num_bytes_written, flags);
+}
+
 MojoResult Dispatcher::SetDataPipeConsumerOptions(
     UserPointer<const MojoDataPipeConsumerOptions> options) {
   MutexLocker locker(&mutex_);
@@ -244,6 +392,30 @@ MojoResult Dispatcher::EndReadData(uint32_t num_bytes_read) {
   return EndReadDataImplNoLock(num_bytes_read);
 }
 
+MojoResult Dispatcher::BeginReadDataSpans(
+    UserPointer<const void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes,
+    MojoReadDataFlags flags) {
+  MutexLocker locker(&mutex_);
+  if (is_closed_)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  return BeginReadDataSpansImplNoLock(buffers, buffers_num_bytes, flags);
+}
+
+MojoResult Dispatcher::ReadDataV(UserPointer<void* const> buffers,
+                                 UserPointer<const uint32_t> buffers_num_bytes,
+                                 uint32_t num_buffers,
+                                 UserPointer<uint32_t> num_bytes_read,
+                                 MojoReadDataFlags flags) {
+  MutexLocker locker(&mutex_);
+  if (is_closed_)
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  return ReadDataVImplNoLock(buffers, buffers_num_bytes, num_buffers,
+                             num_bytes_read, flags);
+}
+
 MojoResult Dispatcher::DuplicateBufferHandle(
     UserPointer<const MojoDuplicateBufferHandleOptions> options,
     RefPtr<Dispatcher>* new_dispatcher) {
@@ -298,6 +470,11 @@ MojoResult Dispatcher::WaitSetWait(MojoDeadline deadline,
   return WaitSetWaitImpl(deadline, num_results, results, max_results);
 }
 
+bool Dispatcher::TryGetHandleSignalsState(
+    HandleSignalsState* signals_state) const {
+  return TryGetHandleSignalsStateImpl(signals_state);
+}
+
 HandleSignalsState Dispatcher::GetHandleSignalsState() const {
   MutexLocker locker(&mutex_);
   if (is_closed_)
@@ -393,6 +570,15 @@ MojoResult Dispatcher::DuplicateDispatcherImplNoLock(
   return MOJO_RESULT_INTERNAL;
 }
 
+bool Dispatcher::PrepareForLocalTransferImplNoLock(
+    MessagePipe* /*message_pipe*/,
+    unsigned /*port*/) {
+  mutex_.AssertHeld();
+  DCHECK(!is_closed_);
+  // By default, this is not supported.
+  return false;
+}
+
 MojoResult Dispatcher::WriteMessageImplNoLock(
     UserPointer<const void> /*bytes*/,
     uint32_t /*num_bytes*/,
@@ -416,6 +602,25 @@ MojoResult Dispatcher::ReadMessageImplNoLock(
   return MOJO_RESULT_INVALID_ARGUMENT;
 }
 
+MojoResult Dispatcher::BeginReadMessageImplNoLock(
+    UserPointer<void*> /*buffer*/,
+    UserPointer<uint32_t> /*buffer_num_bytes*/,
+    HandleVector* /*handles*/,
+    uint32_t* /*num_handles*/,
+    MojoReadMessageFlags /*flags*/) {
+  mutex_.AssertHeld();
+  DCHECK(!is_closed_);
+  // By default, not supported. Only needed for message pipe dispatchers.
+  return MOJO_RESULT_INVALID_ARGUMENT;
+}
+
+MojoResult Dispatcher::EndReadMessageImplNoLock() {
+  mutex_.AssertHeld();
+  DCHECK(!is_closed_);
+  // By default, not supported. Only needed for message pipe dispatchers.
+  return MOJO_RESULT_INVALID_ARGUMENT;
+}
+
 MojoResult Dispatcher::SetDataPipeProducerOptionsImplNoLock(
     UserPointer<const MojoDataPipeProducerOptions> /*options*/) {
   mutex_.AssertHeld();
@@ -459,6 +664,28 @@ MojoResult Dispatcher::EndWriteDataImplNoLock(uint32_t /*num_bytes_written*/) {
   return MOJO_RESULT_INVALID_ARGUMENT;
 }
 
+MojoResult Dispatcher::BeginWriteDataSpansImplNoLock(
+    UserPointer<void*> /*buffers*/,
+    UserPointer<uint32_t> /*buffers_num_bytes*/,
+    MojoWriteDataFlags /*flags*/) {
+  mutex_.AssertHeld();
+  DCHECK(!is_closed_);
+  // By default, not supported. Only needed for data pipe producer dispatchers.
+  return MOJO_RESULT_INVALID_ARGUMENT;
+}
+
+MojoResult Dispatcher::WriteDataVImplNoLock(
+    UserPointer<const void* const> /*buffers*/,
+    UserPointer<const uint32_t> /*buffers_num_bytes*/,
+    uint32_t /*num_buffers*/,
+    UserPointer<uint32_t> /*num_bytes_written*/,
+    MojoWriteDataFlags /*flags*/) {
+  mutex_.AssertHeld();
+  DCHECK(!is_closed_);
+  // By default, not supported. Only needed for data pipe producer dispatchers.
+  return MOJO_RESULT_INVALID_ARGUMENT;
+}
+
 MojoResult Dispatcher::SetDataPipeConsumerOptionsImplNoLock(
     UserPointer<const MojoDataPipeConsumerOptions> /*options*/) {
   mutex_.AssertHeld();
@@ -502,6 +729,28 @@ MojoResult Dispatcher::EndReadDataImplNoLock(uint32_t /*num_bytes_read*/) {
   return MOJO_RESULT_INVALID_ARGUMENT;
 }
 
+MojoResult Dispatcher::BeginReadDataSpansImplNoLock(
+    UserPointer<const void*> /*buffers*/,
+    UserPointer<uint32_t> /*buffers_num_bytes*/,
+    MojoReadDataFlags /*flags*/) {
+  mutex_.AssertHeld();
+  DCHECK(!is_closed_);
+  // By default, not supported. Only needed for data pipe consumer dispatchers.
+  return MOJO_RESULT_INVALID_ARGUMENT;
+}
+
+MojoResult Dispatcher::ReadDataVImplNoLock(
+    UserPointer<void* const> /*buffers*/,
+    UserPointer<const uint32_t> /*buffers_num_bytes*/,
+    uint32_t /*num_buffers*/,
+    UserPointer<uint32_t> /*num_bytes_read*/,
+    MojoReadDataFlags /*flags*/) {
+  mutex_.AssertHeld();
+  DCHECK(!is_closed_);
+  // By default, not supported. Only needed for data pipe consumer dispatchers.
+  return MOJO_RESULT_INVALID_ARGUMENT;
+}
+
 MojoResult Dispatcher::DuplicateBufferHandleImplNoLock(
     UserPointer<const MojoDuplicateBufferHandleOptions> /*options*/,
     RefPtr<Dispatcher>* /*new_dispatcher*/) {
@@ -559,6 +808,12 @@ MojoResult Dispatcher::WaitSetWaitImpl(
   return MOJO_RESULT_INVALID_ARGUMENT;
 }
 
+bool Dispatcher::TryGetHandleSignalsStateImpl(
+    HandleSignalsState* /*signals_state*/) const {
+  // By default, there's no lock-free way of getting the state.
+  return false;
+}
+
 HandleSignalsState Dispatcher::GetHandleSignalsStateImplNoLock() const {
   mutex_.AssertHeld();
   DCHECK(!is_closed_);
@@ -644,6 +899,19 @@ RefPtr<Dispatcher> Dispatcher::CreateEquivalentDispatcherAndCloseNoLock(
   return CreateEquivalentDispatcherAndCloseImplNoLock(message_pipe, port);
 }
 
+bool Dispatcher::PrepareForLocalTransferNoLock(MessagePipe* message_pipe,
+                                               unsigned port) {
+  mutex_.AssertHeld();
+  DCHECK(!is_closed_);
+  DCHECK(message_pipe);
+
+  // If only the handle table holds a reference, nothing else can observe that
+  // we're not closed: it won't give out any more references (the handle is
+  // busy, and will be removed), there are no |Core| calls in progress using the
+  // old handle, and we're not in any wait set.
+  return HasOneRef() && PrepareForLocalTransferImplNoLock(message_pipe, port);
+}
+
 void Dispatcher::StartSerialize(Channel* channel,
                                 size_t* max_size,
                                 size_t* max_platform_handles) {
@@ -125,6 +125,37 @@ class Dispatcher : public util::RefCountedThreadSafe<Dispatcher> {
                          HandleVector* handles,
                          uint32_t* num_handles,
                          MojoReadMessageFlags flags);
+  // Like |ReadMessage()|, but on success lends the message's data (via
+  // |*buffer|) until |EndReadMessage()| is called, instead of copying it.
+  MojoResult BeginReadMessage(UserPointer<void*> buffer,
+                              UserPointer<uint32_t> buffer_num_bytes,
+                              HandleVector* handles,
+                              uint32_t* num_handles,
+                              MojoReadMessageFlags flags);
+  MojoResult EndReadMessage();
+  // Writes |num_messages| messages without handles (whose data is packed in
+  // |bytes|, with sizes given by |message_num_bytes|) under a single
+  // acquisition of |mutex_|, stopping at the first failure. On return,
+  // |*num_messages_written| is the number of messages written.
+  MojoResult WriteMessages(UserPointer<const void> bytes,
+                           UserPointer<const uint32_t> message_num_bytes,
+                           uint32_t num_messages,
+                           uint32_t* num_messages_written,
+                           MojoWriteMessageFlags flags);
+  // Reads up to |*num_messages| messages (which must be nonzero) under a single
+  // acquisition of |mutex_|, stopping at the first message that doesn't fit in
+  // what remains of |*num_bytes| bytes and |*num_handles| handles. On return,
+  // |*num_messages|, |*num_bytes| and |*num_handles| are the number of
+  // messages, bytes and handles read, respectively. |handles| is as for
+  // |ReadMessage()|; it receives the handles of all the messages read.
+  MojoResult ReadMessages(UserPointer<void> bytes,
+                          uint32_t* num_bytes,
+                          HandleVector* handles,
+                          uint32_t* num_handles,
+                          UserPointer<uint32_t> message_num_bytes,
+                          UserPointer<uint32_t> message_num_handles,
+                          uint32_t* num_messages,
+                          MojoReadMessageFlags flags);
 
   // |EntrypointClass::DATA_PIPE_PRODUCER|:
   MojoResult SetDataPipeProducerOptions(
@@ -139,6 +170,14 @@ class Dispatcher : public util::RefCountedThreadSafe<Dispatcher> {
                             UserPointer<uint32_t> buffer_num_bytes,
                             MojoWriteDataFlags flags);
   MojoResult EndWriteData(uint32_t num_bytes_written);
+  MojoResult BeginWriteDataSpans(UserPointer<void*> buffers,
+                                 UserPointer<uint32_t> buffers_num_bytes,
+                                 MojoWriteDataFlags flags);
+  MojoResult WriteDataV(UserPointer<const void* const> buffers,
+                        UserPointer<const uint32_t> buffers_num_bytes,
+                        uint32_t num_buffers,
+                        UserPointer<uint32_t> num_bytes_written,
+                        MojoWriteDataFlags flags);
 
   // |EntrypointClass::DATA_PIPE_CONSUMER|:
   MojoResult SetDataPipeConsumerOptions(
@@ -153,6 +192,14 @@ class Dispatcher : public util::RefCountedThreadSafe<Dispatcher> {
                            UserPointer<uint32_t> buffer_num_bytes,
                            MojoReadDataFlags flags);
   MojoResult EndReadData(uint32_t num_bytes_read);
+  MojoResult BeginReadDataSpans(UserPointer<const void*> buffers,
+                                UserPointer<uint32_t> buffers_num_bytes,
+                                MojoReadDataFlags flags);
+  MojoResult ReadDataV(UserPointer<void* const> buffers,
+                       UserPointer<const uint32_t> buffers_num_bytes,
+                       uint32_t num_buffers,
+                       UserPointer<uint32_t> num_bytes_read,
+                       MojoReadDataFlags flags);
 
   // |EntrypointClass::BUFFER|:
   // |options| may be null. |new_dispatcher| must not be null, but
@@ -188,6 +235,14 @@ class Dispatcher : public util::RefCountedThreadSafe<Dispatcher> {
   // threads.
   HandleSignalsState GetHandleSignalsState() const;
 
+  // Like |GetHandleSignalsState()|, but without taking any locks: if the
+  // current state can be read cheaply, sets |*signals_state| to it and returns
+  // true; otherwise (including if the dispatcher is closed, or for dispatchers
+  // that don't support this) returns false, and the caller must take the slow
+  // path. This lets |Core| avoid adding awakables when a wait is already
+  // satisfied.
+  bool TryGetHandleSignalsState(HandleSignalsState* signals_state) const;
+
   // Adds an awakable to this dispatcher, which will be woken up when this
   // object changes state to satisfy |signals| with context |context|. It will
   // also be woken up when it becomes impossible for the object to ever satisfy
@@ -247,10 +302,16 @@ class Dispatcher : public util::RefCountedThreadSafe<Dispatcher> {
     // Tests also need this, to avoid needing |Core|.
     friend HandleTransport test::HandleTryStartTransport(const Handle&);
 
-    // This must be called under the handle table lock and only if the handle
-    // table entry is not marked busy. The caller must maintain a reference to
-    // |dispatcher| until |HandleTransport::End()| is called.
+    // This must be called either under the handle table entry's (shard) lock,
+    // if the entry is not marked busy, or (without the lock) by whoever marked
+    // the entry busy. The caller must maintain a reference to |dispatcher|
+    // until |HandleTransport::End()| is called.
     static HandleTransport TryStartTransport(const Handle& handle);
+    // Like the above, but for a busy entry that will be removed if the
+    // transport succeeds: the transport may move |*handle| (leaving it null)
+    // into a message (see
+    // |HandleTransport::TransferHandleOrCreateEquivalentAndClose()|).
+    static HandleTransport TryStartTransport(Handle* handle);
   };
 
   // A |TransportData| may serialize dispatchers that are given to it (and which
@@ -325,6 +386,18 @@ class Dispatcher : public util::RefCountedThreadSafe<Dispatcher> {
       MessagePipe* message_pipe,
       unsigned port) MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_) = 0;
 
+  // This is called by |PrepareForLocalTransferNoLock()| when this dispatcher
+  // itself may be moved into a message on a local message pipe. If supported,
+  // it should cancel all state exactly as
+  // |CreateEquivalentDispatcherAndCloseImplNoLock()| would (but keep the
+  // resource) and return true; otherwise, it should do nothing and return
+  // false (in which case an equivalent dispatcher will be created instead). The
+  // default implementation returns false. (|message_pipe|/|port| are as for
+  // |CreateEquivalentDispatcherAndCloseImplNoLock()|, but are never null.)
+  virtual bool PrepareForLocalTransferImplNoLock(MessagePipe* message_pipe,
+                                                 unsigned port)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // These are to be overridden by subclasses (if necessary). They are never
   // called after the dispatcher has been closed. See the descriptions of the
   // methods without the "ImplNoLock" for more information.
@@ -339,6 +412,14 @@ class Dispatcher : public util::RefCountedThreadSafe<Dispatcher> {
                                            uint32_t* num_handles,
                                            MojoReadMessageFlags flags)
       MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  virtual MojoResult BeginReadMessageImplNoLock(
+      UserPointer<void*> buffer,
+      UserPointer<uint32_t> buffer_num_bytes,
+      HandleVector* handles,
+      uint32_t* num_handles,
+      MojoReadMessageFlags flags) MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  virtual MojoResult EndReadMessageImplNoLock()
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   virtual MojoResult SetDataPipeProducerOptionsImplNoLock(
       UserPointer<const MojoDataPipeProducerOptions> options)
       MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -355,6 +436,16 @@ class Dispatcher : public util::RefCountedThreadSafe<Dispatcher> {
       MojoWriteDataFlags flags) MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   virtual MojoResult EndWriteDataImplNoLock(uint32_t num_bytes_written)
       MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  virtual MojoResult BeginWriteDataSpansImplNoLock(
+      UserPointer<void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes,
+      MojoWriteDataFlags flags) MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  virtual MojoResult WriteDataVImplNoLock(
+      UserPointer<const void* const> buffers,
+      UserPointer<const uint32_t> buffers_num_bytes,
+      uint32_t num_buffers,
+      UserPointer<uint32_t> num_bytes_written,
+      MojoWriteDataFlags flags) MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   virtual MojoResult SetDataPipeConsumerOptionsImplNoLock(
       UserPointer<const MojoDataPipeConsumerOptions> options)
       MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -371,6 +462,16 @@ class Dispatcher : public util::RefCountedThreadSafe<Dispatcher> {
       MojoReadDataFlags flags) MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   virtual MojoResult EndReadDataImplNoLock(uint32_t num_bytes_read)
       MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  virtual MojoResult BeginReadDataSpansImplNoLock(
+      UserPointer<const void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes,
+      MojoReadDataFlags flags) MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  virtual MojoResult ReadDataVImplNoLock(
+      UserPointer<void* const> buffers,
+      UserPointer<const uint32_t> buffers_num_bytes,
+      uint32_t num_buffers,
+      UserPointer<uint32_t> num_bytes_read,
+      MojoReadDataFlags flags) MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   virtual MojoResult DuplicateBufferHandleImplNoLock(
       UserPointer<const MojoDuplicateBufferHandleOptions> options,
       util::RefPtr<Dispatcher>* new_dispatcher)
@@ -398,6 +499,10 @@ class Dispatcher : public util::RefCountedThreadSafe<Dispatcher> {
                                      UserPointer<uint32_t> num_results,
                                      UserPointer<MojoWaitSetResult> results,
                                      UserPointer<uint32_t> max_results);
+  // Similarly, this is *not* called under |mutex_|, but it must not lock it
+  // either (and should just return false if it can't avoid doing so).
+  virtual bool TryGetHandleSignalsStateImpl(
+      HandleSignalsState* signals_state) const;
   virtual HandleSignalsState GetHandleSignalsStateImplNoLock() const
       MOJO_SHARED_LOCKS_REQUIRED(mutex_);
   virtual MojoResult AddAwakableImplNoLock(Awakable* awakable,
@@ -466,6 +571,17 @@ class Dispatcher : public util::RefCountedThreadSafe<Dispatcher> {
       MessagePipe* message_pipe,
       unsigned port) MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // For a dispatcher being put into a message on a message pipe whose
+  // destination endpoint is local: if the only reference to this dispatcher is
+  // its (busy) handle table entry's (so that nothing else can use it), and the
+  // implementation supports it, cancels all state (as
+  // |CreateEquivalentDispatcherAndCloseNoLock()| would) and returns true, in
+  // which case the caller may move that reference into the message instead of
+  // creating an equivalent dispatcher. Otherwise, does nothing and returns
+  // false.
+  bool PrepareForLocalTransferNoLock(MessagePipe* message_pipe, unsigned port)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // API to serialize dispatchers to a |Channel|, exposed to only
   // |TransportData| (via |TransportData|). They may only be called on a
   // dispatcher attached to a |MessageInTransit| (and in particular not in
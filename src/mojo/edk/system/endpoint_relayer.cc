@@ -37,6 +37,16 @@ void EndpointRelayer::SetFilter(std::unique_ptr<Filter> filter) {
   filter_ = std::move(filter);
 }
 
+void EndpointRelayer::RequestBypass(const ConnectionIdentifier& connection_id) {
+  // Do this under |mutex_|, so that a reply relayed from one side can't
+  // overtake the request to the other side.
+  MutexLocker locker(&mutex_);
+  if (!endpoints_[0] || !endpoints_[1])
+    return;
+  endpoints_[0]->RequestBypass(connection_id);
+  endpoints_[1]->RequestBypass(connection_id);
+}
+
 bool EndpointRelayer::OnReadMessage(unsigned port, MessageInTransit* message) {
   DCHECK(message);
 
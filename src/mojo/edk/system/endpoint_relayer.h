@@ -8,6 +8,7 @@
 #include <memory>
 
 #include "mojo/edk/system/channel_endpoint_client.h"
+#include "mojo/edk/system/connection_identifier.h"
 #include "mojo/edk/util/mutex.h"
 #include "mojo/edk/util/ref_ptr.h"
 #include "mojo/edk/util/thread_annotations.h"
@@ -75,6 +76,11 @@ class EndpointRelayer final : public ChannelEndpointClient {
   // |Type::ENDPOINT_CLIENT| messages (see |Filter| above).
   void SetFilter(std::unique_ptr<Filter> filter);
 
+  // Asks the remote sides of both endpoints to connect to each other directly
+  // (using the given connection ID), after which this relayer will no longer be
+  // needed. See |ChannelEndpoint::RequestBypass()|.
+  void RequestBypass(const ConnectionIdentifier& connection_id);
+
   // |ChannelEndpointClient| methods:
   bool OnReadMessage(unsigned port, MessageInTransit* message) override;
   void OnDetachFromChannel(unsigned port) override;
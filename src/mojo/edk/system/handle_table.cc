@@ -12,6 +12,7 @@
 #include "mojo/edk/system/dispatcher.h"
 #include "mojo/edk/system/handle_transport.h"
 
+using mojo::util::MutexLocker;
 using mojo::util::RefPtr;
 
 namespace mojo {
@@ -26,9 +27,17 @@ HandleTable::Entry::~Entry() {
   DCHECK(!busy);
 }
 
+HandleTable::Shard::Shard() {}
+
+HandleTable::Shard::~Shard() {}
+
 HandleTable::HandleTable(size_t max_handle_table_size)
     : max_handle_table_size_(max_handle_table_size),
-      next_handle_value_(MOJO_HANDLE_INVALID + 1) {}
+      size_(0u),
+      next_handle_value_(MOJO_HANDLE_INVALID + 1) {
+  for (size_t i = 0; i < kNumShards; i++)
+    shards_[i].reset(new Shard());
+}
 
 HandleTable::~HandleTable() {
   // This should usually not be reached (the only instance should be owned by
@@ -39,8 +48,11 @@ MojoResult HandleTable::GetHandle(MojoHandle handle_value, Handle* handle) {
   DCHECK_NE(handle_value, MOJO_HANDLE_INVALID);
   DCHECK(handle);
 
-  HandleToEntryMap::iterator it = handle_to_entry_map_.find(handle_value);
-  if (it == handle_to_entry_map_.end())
+  Shard* shard = GetShard(handle_value);
+  MutexLocker locker(&shard->mutex);
+  HandleToEntryMap::iterator it =
+      shard->handle_to_entry_map.find(handle_value);
+  if (it == shard->handle_to_entry_map.end())
     return MOJO_RESULT_INVALID_ARGUMENT;
   if (it->second.busy)
     return MOJO_RESULT_BUSY;
@@ -54,32 +66,38 @@ MojoResult HandleTable::GetAndRemoveHandle(MojoHandle handle_value,
   DCHECK_NE(handle_value, MOJO_HANDLE_INVALID);
   DCHECK(handle);
 
-  HandleToEntryMap::iterator it = handle_to_entry_map_.find(handle_value);
-  if (it == handle_to_entry_map_.end())
+  Shard* shard = GetShard(handle_value);
+  MutexLocker locker(&shard->mutex);
+  HandleToEntryMap::iterator it =
+      shard->handle_to_entry_map.find(handle_value);
+  if (it == shard->handle_to_entry_map.end())
     return MOJO_RESULT_INVALID_ARGUMENT;
   if (it->second.busy)
     return MOJO_RESULT_BUSY;
   *handle = std::move(it->second.handle);
-  handle_to_entry_map_.erase(it);
+  shard->handle_to_entry_map.erase(it);
+  size_.fetch_sub(1u, std::memory_order_relaxed);
 
   return MOJO_RESULT_OK;
 }
 
 MojoHandle HandleTable::AddHandle(Handle&& handle) {
   DCHECK(handle);
-  return (handle_to_entry_map_.size() < max_handle_table_size_)
-             ? AddHandleNoSizeCheck(std::move(handle))
-             : MOJO_HANDLE_INVALID;
+  return TryReserve(1u) ? AddHandleNoSizeCheck(std::move(handle))
+                        : MOJO_HANDLE_INVALID;
 }
 
 std::pair<MojoHandle, MojoHandle> HandleTable::AddHandlePair(Handle&& handle0,
                                                              Handle&& handle1) {
   DCHECK(handle0);
   DCHECK(handle1);
-  return (handle_to_entry_map_.size() + 1u < max_handle_table_size_)
-             ? std::make_pair(AddHandleNoSizeCheck(std::move(handle0)),
-                              AddHandleNoSizeCheck(std::move(handle1)))
-             : std::make_pair(MOJO_HANDLE_INVALID, MOJO_HANDLE_INVALID);
+  if (!TryReserve(2u))
+    return std::make_pair(MOJO_HANDLE_INVALID, MOJO_HANDLE_INVALID);
+  // Note: Don't put both calls in the |std::make_pair()|, since the order of
+  // evaluation of arguments is unspecified.
+  MojoHandle handle_value0 = AddHandleNoSizeCheck(std::move(handle0));
+  MojoHandle handle_value1 = AddHandleNoSizeCheck(std::move(handle1));
+  return std::make_pair(handle_value0, handle_value1);
 }
 
 bool HandleTable::AddHandleVector(HandleVector* handles,
@@ -94,17 +112,20 @@ bool HandleTable::AddHandleVector(HandleVector* handles,
       std::numeric_limits<size_t>::max())
       << "Addition may overflow";
 
-  if (handle_to_entry_map_.size() + handles->size() > max_handle_table_size_)
+  if (!TryReserve(handles->size()))
     return false;
 
+  size_t num_invalid = 0;
   for (size_t i = 0; i < handles->size(); i++) {
     if (handles->at(i)) {
       handle_values[i] = AddHandleNoSizeCheck(std::move(handles->at(i)));
     } else {
       LOG(WARNING) << "Invalid dispatcher at index " << i;
       handle_values[i] = MOJO_HANDLE_INVALID;
+      num_invalid++;
     }
   }
+  size_.fetch_sub(num_invalid, std::memory_order_relaxed);
   return true;
 }
 
@@ -115,35 +136,41 @@ MojoResult HandleTable::ReplaceHandleWithReducedRights(
   DCHECK_NE(handle_value, MOJO_HANDLE_INVALID);
   DCHECK(replacement_handle_value);
 
-  HandleToEntryMap::iterator it = handle_to_entry_map_.find(handle_value);
-  if (it == handle_to_entry_map_.end())
-    return MOJO_RESULT_INVALID_ARGUMENT;
-
-  Entry entry = it->second;
-  if (entry.busy)
-    return MOJO_RESULT_BUSY;
-  // We don't need to mark the entry as busy, since we do everything under the
-  // handle table lock (unlike sending messages).
-
-  // Try to start the transport. (This just tries to take the dispatcher's
-  // lock.)
-  HandleTransport transport =
-      Dispatcher::HandleTableAccess::TryStartTransport(entry.handle);
-  if (!transport.is_valid())
-    return MOJO_RESULT_BUSY;
+  Handle replacement_handle;
+  {
+    Shard* shard = GetShard(handle_value);
+    MutexLocker locker(&shard->mutex);
+    HandleToEntryMap::iterator it =
+        shard->handle_to_entry_map.find(handle_value);
+    if (it == shard->handle_to_entry_map.end())
+      return MOJO_RESULT_INVALID_ARGUMENT;
+
+    Entry entry = it->second;
+    if (entry.busy)
+      return MOJO_RESULT_BUSY;
+    // We don't need to mark the entry as busy, since we do everything under
+    // the shard lock (unlike sending messages).
+
+    // Try to start the transport. (This just tries to take the dispatcher's
+    // lock.)
+    HandleTransport transport =
+        Dispatcher::HandleTableAccess::TryStartTransport(entry.handle);
+    if (!transport.is_valid())
+      return MOJO_RESULT_BUSY;
 
-  // We don't need to check the capacity of the handle table, since we're just
-  // going to replace the old handle. (Nothing below can fail, so we won't need
-  // to unwind.)
+    // We don't need to check the capacity of the handle table, since we're
+    // just going to replace the old handle (so we just keep its space
+    // reserved). (Nothing below can fail, so we won't need to unwind.)
 
-  Handle replacement_handle =
-      transport.CreateEquivalentHandleAndClose(nullptr, 0);
-  replacement_handle.rights &= ~rights_to_remove;
-  transport.End();
+    replacement_handle = transport.CreateEquivalentHandleAndClose(nullptr, 0);
+    replacement_handle.rights &= ~rights_to_remove;
+    transport.End();
 
-  // |it| is still valid here.
-  handle_to_entry_map_.erase(it);
+    // |it| is still valid here.
+    shard->handle_to_entry_map.erase(it);
+  }
 
+  // Note: This may use a different shard, so we can't hold the above lock.
   *replacement_handle_value =
       AddHandleNoSizeCheck(std::move(replacement_handle));
   return MOJO_RESULT_OK;
@@ -160,9 +187,10 @@ MojoResult HandleTable::MarkBusyAndStartTransport(
   DCHECK(transports);
   DCHECK_EQ(transports->size(), num_handles);
 
+  // First verify all the handle values and mark them as busy. (Once an entry is
+  // marked as busy, it won't be removed or modified by anyone else, so it's
+  // safe to use it after releasing the shard lock: the maps' nodes are stable.)
   std::vector<Entry*> entries(num_handles);
-
-  // First verify all the handle values and get their dispatchers.
   uint32_t i;
   MojoResult error_result = MOJO_RESULT_INTERNAL;
   for (i = 0; i < num_handles; i++) {
@@ -173,8 +201,11 @@ MojoResult HandleTable::MarkBusyAndStartTransport(
       break;
     }
 
-    HandleToEntryMap::iterator it = handle_to_entry_map_.find(handle_values[i]);
-    if (it == handle_to_entry_map_.end()) {
+    Shard* shard = GetShard(handle_values[i]);
+    MutexLocker locker(&shard->mutex);
+    HandleToEntryMap::iterator it =
+        shard->handle_to_entry_map.find(handle_values[i]);
+    if (it == shard->handle_to_entry_map.end()) {
       error_result = MOJO_RESULT_INVALID_ARGUMENT;
       break;
     }
@@ -192,64 +223,82 @@ MojoResult HandleTable::MarkBusyAndStartTransport(
     // Note: By marking the handle as busy here, we're also preventing the
     // same handle from being sent multiple times in the same message.
     entries[i]->busy = true;
-
-    // Try to start the transport.
-    HandleTransport transport =
-        Dispatcher::HandleTableAccess::TryStartTransport(entries[i]->handle);
-    if (!transport.is_valid()) {
-      // Only log for Debug builds, since this is not a problem with the system
-      // code, but with user code.
-      DLOG(WARNING) << "Likely race condition in user code detected: attempt "
-                       "to transfer handle "
-                    << handle_values[i]
-                    << " while it is in use on a different thread";
-
-      // Unset the busy flag (since it won't be unset below).
-      entries[i]->busy = false;
-      error_result = MOJO_RESULT_BUSY;
-      break;
-    }
-
-    // Hang on to the transport (which we'll need to end the transport).
-    (*transports)[i] = transport;
   }
-  if (i < num_handles) {
-    DCHECK_NE(error_result, MOJO_RESULT_INTERNAL);
-
-    // Unset the busy flags and release the locks.
-    for (uint32_t j = 0; j < i; j++) {
-      DCHECK(entries[j]->busy);
-      entries[j]->busy = false;
-      (*transports)[j].End();
+  uint32_t num_busy = i;
+
+  // Then try to start the transports. This is done without holding any shard
+  // locks, since (as in |Core|) dispatcher locks must be taken after the handle
+  // table's locks.
+  uint32_t num_transports = 0;
+  if (num_busy == num_handles) {
+    for (; num_transports < num_handles; num_transports++) {
+      HandleTransport transport =
+          Dispatcher::HandleTableAccess::TryStartTransport(
+              &entries[num_transports]->handle);
+      if (!transport.is_valid()) {
+        // Only log for Debug builds, since this is not a problem with the
+        // system code, but with user code.
+        DLOG(WARNING) << "Likely race condition in user code detected: attempt "
+                         "to transfer handle "
+                      << handle_values[num_transports]
+                      << " while it is in use on a different thread";
+        error_result = MOJO_RESULT_BUSY;
+        break;
+      }
+
+      // Hang on to the transport (which we'll need to end the transport).
+      (*transports)[num_transports] = transport;
     }
-    return error_result;
+    if (num_transports == num_handles)
+      return MOJO_RESULT_OK;
   }
 
-  return MOJO_RESULT_OK;
+  DCHECK_NE(error_result, MOJO_RESULT_INTERNAL);
+
+  // Release the locks (before taking the shard locks) and unset the busy flags.
+  for (uint32_t j = 0; j < num_transports; j++)
+    (*transports)[j].End();
+  for (uint32_t j = 0; j < num_busy; j++) {
+    Shard* shard = GetShard(handle_values[j]);
+    MutexLocker locker(&shard->mutex);
+    DCHECK(entries[j]->busy);
+    entries[j]->busy = false;
+  }
+  return error_result;
+}
+
+bool HandleTable::TryReserve(size_t count) {
+  size_t size = size_.load(std::memory_order_relaxed);
+  do {
+    if (count > max_handle_table_size_ - size)
+      return false;
+  } while (!size_.compare_exchange_weak(size, size + count,
+                                        std::memory_order_relaxed));
+  return true;
 }
 
 MojoHandle HandleTable::AddHandleNoSizeCheck(Handle&& handle) {
   DCHECK(handle);
-  DCHECK_LT(handle_to_entry_map_.size(), max_handle_table_size_);
-  DCHECK_NE(next_handle_value_, MOJO_HANDLE_INVALID);
+  DCHECK_LE(size_.load(std::memory_order_relaxed), max_handle_table_size_);
 
   // TODO(vtl): Maybe we want to do something different/smarter. (Or maybe try
   // assigning randomly?)
-  while (handle_to_entry_map_.find(next_handle_value_) !=
-         handle_to_entry_map_.end()) {
-    next_handle_value_++;
-    if (next_handle_value_ == MOJO_HANDLE_INVALID)
-      next_handle_value_++;
+  while (true) {
+    MojoHandle new_handle_value =
+        next_handle_value_.fetch_add(1u, std::memory_order_relaxed);
+    if (new_handle_value == MOJO_HANDLE_INVALID)
+      continue;
+
+    Shard* shard = GetShard(new_handle_value);
+    MutexLocker locker(&shard->mutex);
+    // Handle values may be in use if |next_handle_value_| wrapped around.
+    if (shard->handle_to_entry_map.find(new_handle_value) !=
+        shard->handle_to_entry_map.end())
+      continue;
+
+    shard->handle_to_entry_map[new_handle_value] = Entry(std::move(handle));
+    return new_handle_value;
   }
-
-  MojoHandle new_handle_value = next_handle_value_;
-  handle_to_entry_map_[new_handle_value] = Entry(std::move(handle));
-
-  next_handle_value_++;
-  if (next_handle_value_ == MOJO_HANDLE_INVALID)
-    next_handle_value_++;
-
-  return new_handle_value;
 }
 
 void HandleTable::RemoveBusyHandles(const MojoHandle* handle_values,
@@ -258,11 +307,15 @@ void HandleTable::RemoveBusyHandles(const MojoHandle* handle_values,
   DCHECK_LE(num_handles, GetConfiguration().max_message_num_handles);
 
   for (uint32_t i = 0; i < num_handles; i++) {
-    HandleToEntryMap::iterator it = handle_to_entry_map_.find(handle_values[i]);
-    DCHECK(it != handle_to_entry_map_.end());
+    Shard* shard = GetShard(handle_values[i]);
+    MutexLocker locker(&shard->mutex);
+    HandleToEntryMap::iterator it =
+        shard->handle_to_entry_map.find(handle_values[i]);
+    DCHECK(it != shard->handle_to_entry_map.end());
     DCHECK(it->second.busy);
     it->second.busy = false;  // For the sake of a |DCHECK()|.
-    handle_to_entry_map_.erase(it);
+    shard->handle_to_entry_map.erase(it);
+    size_.fetch_sub(1u, std::memory_order_relaxed);
   }
 }
 
@@ -272,9 +325,15 @@ void HandleTable::RestoreBusyHandles(const MojoHandle* handle_values,
   DCHECK_LE(num_handles, GetConfiguration().max_message_num_handles);
 
   for (uint32_t i = 0; i < num_handles; i++) {
-    HandleToEntryMap::iterator it = handle_to_entry_map_.find(handle_values[i]);
-    DCHECK(it != handle_to_entry_map_.end());
+    Shard* shard = GetShard(handle_values[i]);
+    MutexLocker locker(&shard->mutex);
+    HandleToEntryMap::iterator it =
+        shard->handle_to_entry_map.find(handle_values[i]);
+    DCHECK(it != shard->handle_to_entry_map.end());
     DCHECK(it->second.busy);
+    // The handle must not have been moved out (see
+    // |HandleTransport::TransferHandleOrCreateEquivalentAndClose()|).
+    DCHECK(it->second.handle.dispatcher);
     it->second.busy = false;
   }
 }
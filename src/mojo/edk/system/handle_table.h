@@ -7,12 +7,16 @@
 
 #include <stddef.h>
 
+#include <atomic>
+#include <memory>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "mojo/edk/system/handle.h"
+#include "mojo/edk/util/mutex.h"
 #include "mojo/edk/util/ref_ptr.h"
+#include "mojo/edk/util/thread_annotations.h"
 #include "mojo/public/c/system/handle.h"
 #include "mojo/public/c/system/result.h"
 #include "mojo/public/cpp/system/macros.h"
@@ -34,9 +38,12 @@ bool ShutdownCheckNoLeaks(Core*);
 // (valid) |MojoHandle|s to |Handle|s (basically, |Dispatcher|s plus rights).
 // This is abstracted so that, e.g., caching may be added.
 //
-// This class is NOT thread-safe; locking is left to |Core| (since it may need
-// to make several changes -- "atomically" or in rapid successsion, in which
-// case the extra locking/unlocking would be unnecessary overhead).
+// This class is thread-safe. So that threads using different handles don't
+// contend on a single lock, the table is split into |kNumShards| shards, each
+// with its own lock; the shard for a handle value is determined by its low
+// bits. Operations on multiple handles (e.g., |MarkBusyAndStartTransport()|)
+// take the shard locks one at a time (never more than one at once), relying on
+// the "busy" flag (see below) for exclusion.
 class HandleTable {
  public:
   explicit HandleTable(size_t max_handle_table_size);
@@ -112,12 +119,12 @@ class HandleTable {
   // lock.
   //
   // For example, if |Core::WriteMessage()| is called with a handle to be sent,
-  // (under the handle table lock) it must first check that that handle is not
-  // busy (if it is busy, then it fails with |MOJO_RESULT_BUSY|) and then marks
-  // it as busy. To avoid deadlock, it should also try to acquire the locks for
-  // all the dispatchers for the handles that it is sending (and fail with
-  // |MOJO_RESULT_BUSY| if the attempt fails). At this point, it can release the
-  // handle table lock.
+  // (under the handle table lock for that handle) it must first check that
+  // that handle is not busy (if it is busy, then it fails with
+  // |MOJO_RESULT_BUSY|) and then marks it as busy. At this point, it can
+  // release the handle table lock. To avoid deadlock, it should then only try
+  // to acquire the locks for all the dispatchers for the handles that it is
+  // sending (and fail with |MOJO_RESULT_BUSY| if the attempt fails).
   //
   // If |Core::Close()| is simultaneously called on that handle, it too checks
   // if the handle is marked busy. If it is, it fails (with |MOJO_RESULT_BUSY|).
@@ -133,12 +140,39 @@ class HandleTable {
   };
   using HandleToEntryMap = std::unordered_map<MojoHandle, Entry>;
 
-  // Adds the given handle to the handle table, not doing any size checks.
+  // Must be a power of 2.
+  static const size_t kNumShards = 16;
+
+  struct Shard {
+    Shard();
+    ~Shard();
+
+    util::Mutex mutex;
+    HandleToEntryMap handle_to_entry_map MOJO_GUARDED_BY(mutex);
+  };
+
+  Shard* GetShard(MojoHandle handle_value) {
+    return shards_[handle_value & (kNumShards - 1)].get();
+  }
+
+  // Tries to reserve space for |count| handles in the table (see |size_|),
+  // returning true on success.
+  bool TryReserve(size_t count);
+
+  // Adds the given handle to the handle table, not doing any size checks (space
+  // should have been reserved using |TryReserve()|).
   MojoHandle AddHandleNoSizeCheck(Handle&& handle);
 
   const size_t max_handle_table_size_;
-  HandleToEntryMap handle_to_entry_map_;
-  MojoHandle next_handle_value_;  // Invariant: never |MOJO_HANDLE_INVALID|.
+  // Each shard is allocated separately, so that shards' locks don't share
+  // cache lines.
+  std::unique_ptr<Shard> shards_[kNumShards];
+  // The number of entries in the table (including reserved entries that are
+  // about to be added); always at most |max_handle_table_size_|.
+  std::atomic<size_t> size_;
+  // The next handle value to try to assign. (This may be
+  // |MOJO_HANDLE_INVALID|, which is skipped when assigning.)
+  std::atomic<MojoHandle> next_handle_value_;
 
   MOJO_DISALLOW_COPY_AND_ASSIGN(HandleTable);
 };
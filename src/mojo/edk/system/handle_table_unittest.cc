@@ -4,14 +4,19 @@
 
 #include "mojo/edk/system/handle_table.h"
 
+#include <memory>
 #include <vector>
 
 #include "mojo/edk/system/dispatcher.h"
 #include "mojo/edk/system/handle.h"
 #include "mojo/edk/system/mock_simple_dispatcher.h"
+#include "mojo/edk/system/test/simple_test_thread.h"
+#include "mojo/edk/util/make_unique.h"
+#include "mojo/public/cpp/system/macros.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
 using mojo::util::MakeRefCounted;
+using mojo::util::MakeUnique;
 using mojo::util::RefPtr;
 
 namespace mojo {
@@ -247,6 +252,90 @@ TEST(HandleTableTest, AddHandleVectorTooMany) {
     EXPECT_EQ(MOJO_RESULT_OK, handles[i].dispatcher->Close()) << i;
 }
 
+// Repeatedly adds and removes (its own) handles to/from a handle table.
+class AddRemoveThread : public test::SimpleTestThread {
+ public:
+  AddRemoveThread(HandleTable* ht, const Handle& h)
+      : ht_(ht), h_(h.Clone()), num_failed_adds_(0u) {}
+  ~AddRemoveThread() override {}
+
+  std::vector<MojoHandle>& handle_values() { return handle_values_; }
+  unsigned num_failed_adds() const { return num_failed_adds_; }
+
+ private:
+  void Run() override {
+    for (unsigned i = 0; i < 1000u; i++) {
+      MojoHandle hv = ht_->AddHandle(h_.Clone());
+      if (hv == MOJO_HANDLE_INVALID) {
+        num_failed_adds_++;
+        continue;
+      }
+
+      Handle h;
+      EXPECT_EQ(MOJO_RESULT_OK, ht_->GetHandle(hv, &h));
+      EXPECT_EQ(h_, h);
+      // Keep every 10th handle.
+      if (i % 10u == 0u) {
+        handle_values_.push_back(hv);
+        continue;
+      }
+      h.reset();
+      EXPECT_EQ(MOJO_RESULT_OK, ht_->GetAndRemoveHandle(hv, &h));
+      EXPECT_EQ(h_, h);
+    }
+  }
+
+  HandleTable* const ht_;
+  const Handle h_;
+  std::vector<MojoHandle> handle_values_;
+  unsigned num_failed_adds_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(AddRemoveThread);
+};
+
+TEST(HandleTableTest, Threaded) {
+  static const unsigned kNumThreads = 8u;
+  // Each thread keeps 100 handles (and has at most one other handle in the
+  // table at a time), so none of the adds should fail.
+  HandleTable ht(1000u);
+
+  std::vector<Handle> handles;
+  std::vector<std::unique_ptr<AddRemoveThread>> threads;
+  for (unsigned i = 0u; i < kNumThreads; i++) {
+    handles.push_back(Handle(MakeRefCounted<test::MockSimpleDispatcher>(),
+                             MOJO_HANDLE_RIGHT_TRANSFER));
+    threads.push_back(MakeUnique<AddRemoveThread>(&ht, handles.back()));
+  }
+  for (auto& thread : threads)
+    thread->Start();
+  for (auto& thread : threads)
+    thread->Join();
+
+  // Fill up the table.
+  for (unsigned i = 0u; i < 1000u - kNumThreads * 100u; i++)
+    EXPECT_NE(MOJO_HANDLE_INVALID, ht.AddHandle(handles[0].Clone()));
+  EXPECT_EQ(MOJO_HANDLE_INVALID, ht.AddHandle(handles[0].Clone()));
+
+  // All the remaining handle values should be valid (and hence distinct).
+  for (unsigned i = 0u; i < kNumThreads; i++) {
+    EXPECT_EQ(0u, threads[i]->num_failed_adds());
+    EXPECT_EQ(100u, threads[i]->handle_values().size());
+    for (MojoHandle hv : threads[i]->handle_values()) {
+      Handle h;
+      ASSERT_EQ(MOJO_RESULT_OK, ht.GetAndRemoveHandle(hv, &h));
+      EXPECT_EQ(handles[i], h);
+    }
+  }
+
+  // There should now be room for exactly that many handles.
+  for (unsigned i = 0u; i < kNumThreads * 100u; i++)
+    EXPECT_NE(MOJO_HANDLE_INVALID, ht.AddHandle(handles[0].Clone()));
+  EXPECT_EQ(MOJO_HANDLE_INVALID, ht.AddHandle(handles[0].Clone()));
+
+  for (auto& h : handles)
+    EXPECT_EQ(MOJO_RESULT_OK, h.dispatcher->Close());
+}
+
 // TODO(vtl): Figure out how to test |MarkBusyAndStartTransport()|.
 
 }  // namespace
@@ -4,6 +4,8 @@
 
 #include "mojo/edk/system/handle_transport.h"
 
+#include <utility>
+
 #include "base/logging.h"
 
 namespace mojo {
@@ -11,8 +13,30 @@ namespace system {
 
 void HandleTransport::End() {
   DCHECK(dispatcher_);
-  dispatcher_->mutex_.Unlock();
+  // If transferred, |dispatcher_| has already been unlocked (and may have been
+  // destroyed).
+  if (!transferred_)
+    dispatcher_->mutex_.Unlock();
   dispatcher_ = nullptr;
+  transferred_ = false;
+}
+
+Handle HandleTransport::TransferHandleOrCreateEquivalentAndClose(
+    MessagePipe* message_pipe,
+    unsigned port) {
+  DCHECK(dispatcher_);
+  DCHECK(!transferred_);
+  if (!handle_ ||
+      !dispatcher_->PrepareForLocalTransferNoLock(message_pipe, port))
+    return CreateEquivalentHandleAndClose(message_pipe, port);
+
+  DCHECK_EQ(handle_->dispatcher.get(), dispatcher_);
+  // Take the handle table's reference. Once the message is enqueued, whoever
+  // reads it may use (or destroy) |dispatcher_|, so unlock it now.
+  Handle handle(std::move(*handle_));
+  dispatcher_->mutex_.Unlock();
+  transferred_ = true;
+  return handle;
 }
 
 }  // namespace system
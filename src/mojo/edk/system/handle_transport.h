@@ -23,12 +23,16 @@ class MessagePipe;
 // for more details.
 //
 // Note: This class is deliberately "thin" -- no more expensive than a struct
-// containing a |Dispatcher*| and a |MojoHandleRights|.
+// containing a |Dispatcher*|, a |MojoHandleRights|, a |Handle*|, and a flag.
 class HandleTransport final {
  public:
   // Constructs a "null"/invalid |HandleTransport|. No methods other than
   // |is_valid()| may be called on the resulting instance.
-  HandleTransport() : dispatcher_(nullptr), rights_(MOJO_HANDLE_RIGHT_NONE) {}
+  HandleTransport()
+      : dispatcher_(nullptr),
+        rights_(MOJO_HANDLE_RIGHT_NONE),
+        handle_(nullptr),
+        transferred_(false) {}
 
   // Ends transport. This must be called exactly once (on the result, or one of
   // the copies thereof) if |Dispatcher::HandleTableAccess::TryStartTransport()|
@@ -47,6 +51,16 @@ class HandleTransport final {
                       message_pipe, port),
                   rights_);
   }
+  // Like |CreateEquivalentHandleAndClose()|, but for sending on a message pipe
+  // whose destination endpoint is local: moves the dispatcher itself into the
+  // resulting handle if possible, i.e., if the transport was started on a
+  // handle table entry that will be removed (which is then left null) and
+  // |Dispatcher::PrepareForLocalTransferNoLock()| succeeds. In that case, the
+  // dispatcher is unlocked immediately (since it may be used via the resulting
+  // handle as soon as the message is enqueued), and |End()| will not touch it.
+  Handle TransferHandleOrCreateEquivalentAndClose(MessagePipe* message_pipe,
+                                                  unsigned port)
+      MOJO_NOT_THREAD_SAFE;
 
   bool is_valid() const { return !!dispatcher_; }
 
@@ -54,10 +68,19 @@ class HandleTransport final {
   friend class Dispatcher::HandleTableAccess;
 
   explicit HandleTransport(const Handle& handle)
-      : dispatcher_(handle.dispatcher.get()), rights_(handle.rights) {}
+      : dispatcher_(handle.dispatcher.get()),
+        rights_(handle.rights),
+        handle_(nullptr),
+        transferred_(false) {}
 
   Dispatcher* dispatcher_;
   MojoHandleRights rights_;
+  // The handle table's handle for |dispatcher_|, if it may be moved (see
+  // |Dispatcher::HandleTableAccess::TryStartTransport(Handle*)|); else null.
+  Handle* handle_;
+  // Set if |*handle_| was moved (and |dispatcher_| unlocked) by
+  // |TransferHandleOrCreateEquivalentAndClose()|.
+  bool transferred_;
 
   // Copy and assign allowed.
 };
@@ -13,6 +13,8 @@
 #include "mojo/edk/system/message_pipe.h"
 #include "mojo/edk/system/remote_producer_data_pipe_impl.h"
 
+using mojo::platform::PlatformSharedBuffer;
+using mojo::platform::PlatformSharedBufferMapping;
 using mojo::util::MakeRefCounted;
 using mojo::util::MutexLocker;
 using mojo::util::RefPtr;
@@ -54,6 +56,63 @@ RefPtr<DataPipe> IncomingEndpoint::ConvertToDataPipeConsumer(
   return data_pipe;
 }
 
+RefPtr<DataPipe> IncomingEndpoint::ConvertToSharedRingDataPipeProducer(
+    const MojoCreateDataPipeOptions& validated_options,
+    size_t consumer_num_bytes,
+    RefPtr<PlatformSharedBuffer>&& ring_buffer,
+    std::unique_ptr<PlatformSharedBufferMapping> ring_mapping,
+    size_t start_index) {
+  MutexLocker locker(&mutex_);
+  auto data_pipe = DataPipe::CreateRemoteConsumerSharedRingFromExisting(
+      validated_options, consumer_num_bytes, &message_queue_,
+      std::move(endpoint_), std::move(ring_buffer), std::move(ring_mapping),
+      start_index);
+  DCHECK(message_queue_.IsEmpty());
+  return data_pipe;
+}
+
+RefPtr<DataPipe> IncomingEndpoint::ConvertToSharedRingDataPipeConsumer(
+    const MojoCreateDataPipeOptions& validated_options,
+    RefPtr<PlatformSharedBuffer>&& ring_buffer,
+    std::unique_ptr<PlatformSharedBufferMapping> ring_mapping,
+    size_t start_index,
+    size_t current_num_bytes) {
+  MutexLocker locker(&mutex_);
+  auto data_pipe = DataPipe::CreateRemoteProducerSharedRingFromExisting(
+      validated_options, &message_queue_, std::move(endpoint_),
+      std::move(ring_buffer), std::move(ring_mapping), start_index,
+      current_num_bytes);
+  DCHECK(message_queue_.IsEmpty());
+  return data_pipe;
+}
+
+RefPtr<ChannelEndpoint> IncomingEndpoint::ConvertToClient(
+    RefPtr<ChannelEndpointClient>&& client,
+    unsigned client_port) {
+  DCHECK(client);
+
+  MutexLocker locker(&mutex_);
+  if (!endpoint_)
+    return nullptr;
+
+  // Messages received from now on (and any racing with this) go to |client|
+  // directly, after these (see |OnReadMessage()|).
+  while (!message_queue_.IsEmpty()) {
+    std::unique_ptr<MessageInTransit> message = message_queue_.GetMessage();
+    if (client->OnReadMessage(client_port, message.get()))
+      ignore_result(message.release());
+  }
+
+  RefPtr<ChannelEndpoint> endpoint = std::move(endpoint_);
+  if (!endpoint->ReplaceClient(client.Clone(), client_port)) {
+    // It's been detached from its channel (and we'll get the spurious
+    // |OnDetachFromChannel()|), so we're done with it.
+    endpoint->DetachFromClient();
+    return nullptr;
+  }
+  return endpoint;
+}
+
 void IncomingEndpoint::Close() {
   MutexLocker locker(&mutex_);
   if (endpoint_) {
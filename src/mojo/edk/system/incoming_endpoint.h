@@ -7,6 +7,9 @@
 
 #include <stddef.h>
 
+#include <memory>
+
+#include "mojo/edk/platform/platform_shared_buffer.h"
 #include "mojo/edk/system/channel_endpoint_client.h"
 #include "mojo/edk/system/message_in_transit_queue.h"
 #include "mojo/edk/util/mutex.h"
@@ -39,9 +42,31 @@ class IncomingEndpoint final : public ChannelEndpointClient {
       size_t consumer_num_bytes);
   util::RefPtr<DataPipe> ConvertToDataPipeConsumer(
       const MojoCreateDataPipeOptions& validated_options);
-
-  // Must be called before destroying this object if |ConvertToMessagePipe()|
-  // wasn't called (but |Init()| was).
+  // Like the above, but for data pipes whose data is in a shared memory ring
+  // buffer (see |DataPipe::Create{Producer,Consumer}SharedRingFromExisting()|).
+  util::RefPtr<DataPipe> ConvertToSharedRingDataPipeProducer(
+      const MojoCreateDataPipeOptions& validated_options,
+      size_t consumer_num_bytes,
+      util::RefPtr<platform::PlatformSharedBuffer>&& ring_buffer,
+      std::unique_ptr<platform::PlatformSharedBufferMapping> ring_mapping,
+      size_t start_index);
+  util::RefPtr<DataPipe> ConvertToSharedRingDataPipeConsumer(
+      const MojoCreateDataPipeOptions& validated_options,
+      util::RefPtr<platform::PlatformSharedBuffer>&& ring_buffer,
+      std::unique_ptr<platform::PlatformSharedBufferMapping> ring_mapping,
+      size_t start_index,
+      size_t current_num_bytes);
+
+  // Gives the endpoint to |client| (at |client_port|) in place of this object,
+  // first passing on (via |client->OnReadMessage()|, which must accept them)
+  // the messages received so far. Returns the endpoint, or null if it has
+  // already been closed (e.g., detached from its channel).
+  util::RefPtr<ChannelEndpoint> ConvertToClient(
+      util::RefPtr<ChannelEndpointClient>&& client,
+      unsigned client_port);
+
+  // Must be called before destroying this object if it wasn't converted (using
+  // one of the above methods), but |Init()| was called.
   void Close();
 
   // |ChannelEndpointClient| methods:
@@ -10,7 +10,10 @@
 #include "base/logging.h"
 #include "mojo/edk/embedder/master_process_delegate.h"
 #include "mojo/edk/embedder/slave_process_delegate.h"
+#include "mojo/edk/platform/io_thread.h"
+#include "mojo/edk/platform/thread.h"
 #include "mojo/edk/system/channel_manager.h"
+#include "mojo/edk/system/configuration.h"
 #include "mojo/edk/system/master_connection_manager.h"
 #include "mojo/edk/system/message_pipe_dispatcher.h"
 #include "mojo/edk/system/slave_connection_manager.h"
@@ -70,6 +73,14 @@ IPCSupport::IPCSupport(embedder::PlatformSupport* platform_support,
   channel_manager_.reset(
       new ChannelManager(platform_support, io_task_runner_.Clone(), io_watcher_,
                          connection_manager_.get()));
+  for (size_t i = 1; i < GetConfiguration().num_io_threads; i++) {
+    RefPtr<TaskRunner> additional_io_task_runner;
+    PlatformHandleWatcher* additional_io_watcher = nullptr;
+    additional_io_threads_.push_back(platform::CreateAndStartIOThread(
+        &additional_io_task_runner, &additional_io_watcher));
+    channel_manager_->AddIOThread(std::move(additional_io_task_runner),
+                                  additional_io_watcher);
+  }
 }
 
 IPCSupport::~IPCSupport() {
@@ -82,6 +93,12 @@ void IPCSupport::ShutdownOnIOThread() {
   channel_manager_->ShutdownOnIOThread();
   channel_manager_.reset();
 
+  // All the channels have been shut down, so nothing should be using the
+  // additional I/O threads anymore.
+  for (auto& io_thread : additional_io_threads_)
+    io_thread->Stop();
+  additional_io_threads_.clear();
+
   if (connection_manager_) {
     connection_manager_->Shutdown();
     connection_manager_.reset();
@@ -7,6 +7,7 @@
 
 #include <functional>
 #include <memory>
+#include <vector>
 
 #include "mojo/edk/embedder/process_type.h"
 #include "mojo/edk/embedder/slave_info.h"
@@ -28,6 +29,7 @@ class ProcessDelegate;
 
 namespace platform {
 class PlatformHandleWatcher;
+class Thread;
 }
 
 namespace system {
@@ -50,6 +52,10 @@ void MultiprocessMasterSlaveInternalTestChildTest();
 // Each "process" must have an |embedder::PlatformSupport| and a suitable
 // |embedder::ProcessDelegate|, together with an I/O thread and a thread on
 // which to call delegate methods (which may be the same as the I/O thread).
+// If |embedder::Configuration::num_io_threads| is greater than 1, additional
+// I/O threads are created (and owned) by this class and channels are spread
+// across all the I/O threads (see |ChannelManager|); the I/O thread given to
+// the constructor remains the "primary" one.
 //
 // For testing purposes within a single real process, except for the I/O thread,
 // these may be shared between "processes" (i.e., instances of |IPCSupport|) --
@@ -146,6 +152,9 @@ class IPCSupport {
   FRIEND_TEST_ALL_PREFIXES(IPCSupportTest, MasterSlaveInternal);
   FRIEND_TEST_ALL_PREFIXES(IPCSupportTest, MultiprocessMasterSlaveInternal);
   friend void MultiprocessMasterSlaveInternalTestChildTest();
+  // These check the master's pending connections (via |connection_manager()|).
+  FRIEND_TEST_ALL_PREFIXES(IPCSupportTest, CancelConnect);
+  FRIEND_TEST_ALL_PREFIXES(IPCSupportTest, ConnectTwoSlavesCloseRacingConnect);
 
   // Helper for |ConnectToSlave()|. Connects (using the connection manager) to
   // the slave using |platform_handle| (a handle to an OS "pipe" between master
@@ -178,6 +187,9 @@ class IPCSupport {
 
   std::unique_ptr<ConnectionManager> connection_manager_;
   std::unique_ptr<ChannelManager> channel_manager_;
+  // Additional I/O threads, owned by us (see
+  // |embedder::Configuration::num_io_threads|).
+  std::vector<std::unique_ptr<platform::Thread>> additional_io_threads_;
 
   MOJO_DISALLOW_COPY_AND_ASSIGN(IPCSupport);
 };
@@ -13,11 +13,16 @@
 #include "mojo/edk/embedder/simple_platform_support.h"
 #include "mojo/edk/embedder/slave_process_delegate.h"
 #include "mojo/edk/platform/platform_pipe.h"
+#include "mojo/edk/platform/thread_utils.h"
+#include "mojo/edk/system/channel.h"
 #include "mojo/edk/system/channel_manager.h"
+#include "mojo/edk/system/configuration.h"
+#include "mojo/edk/system/configuration_test_utils.h"
 #include "mojo/edk/system/connection_identifier.h"
 #include "mojo/edk/system/dispatcher.h"
 #include "mojo/edk/system/handle.h"
 #include "mojo/edk/system/handle_transport.h"
+#include "mojo/edk/system/master_connection_manager.h"
 #include "mojo/edk/system/message_pipe.h"
 #include "mojo/edk/system/message_pipe_dispatcher.h"
 #include "mojo/edk/system/process_identifier.h"
@@ -34,6 +39,7 @@
 
 using mojo::platform::PlatformPipe;
 using mojo::platform::ScopedPlatformHandle;
+using mojo::platform::ThreadSleep;
 using mojo::util::AutoResetWaitableEvent;
 using mojo::util::ManualResetWaitableEvent;
 using mojo::util::RefPtr;
@@ -210,6 +216,9 @@ class TestSlaveConnection {
 
   const ConnectionIdentifier& connection_id() const { return connection_id_; }
 
+  // Note: |ChannelId|s and |ProcessIdentifier|s are interchangeable.
+  ProcessIdentifier slave_id() const { return slave_id_; }
+
  private:
   test::TestIOThread* const test_io_thread_;
   IPCSupport* const master_ipc_support_;
@@ -273,6 +282,10 @@ class TestSlave {
         [this]() { slave_ipc_support_.ShutdownOnIOThread(); });
   }
 
+  ChannelManager* channel_manager() {
+    return slave_ipc_support_.channel_manager();
+  }
+
  private:
   test::TestIOThread* const test_io_thread_;
   TestSlaveProcessDelegate slave_process_delegate_;
@@ -416,6 +429,76 @@ class IPCSupportTest : public testing::Test {
 using MessagePipeDispatcherPair =
     std::pair<RefPtr<MessagePipeDispatcher>, RefPtr<MessagePipeDispatcher>>;
 
+// Waits (polling) until |channel| has exactly |num_endpoints| endpoints
+// (including zombies). Returns false on timeout.
+bool WaitForNumEndpoints(Channel* channel, size_t num_endpoints) {
+  for (MojoDeadline elapsed = 0; elapsed < test::ActionTimeout();
+       elapsed += test::EpsilonTimeout()) {
+    if (channel->GetNumEndpointsForTest() == num_endpoints)
+      return true;
+    ThreadSleep(test::EpsilonTimeout());
+  }
+  return false;
+}
+
+// Waits (polling) until the master's channel to the given slave has only its
+// bootstrap endpoint, i.e., all relayed message pipes have been rerouted around
+// the master (and all their removals acked). Returns false on timeout.
+bool WaitForOnlyBootstrapEndpoint(IPCSupport* master_ipc_support,
+                                  TestSlaveSetup* s) {
+  return WaitForNumEndpoints(
+      master_ipc_support->channel_manager()
+          ->GetChannel(s->slave_connection()->slave_id())
+          .get(),
+      1u);
+}
+
+// Writes a message containing just |value| to |mp|.
+void WriteUint32Message(MessagePipeDispatcher* mp, uint32_t value) {
+  CHECK_EQ(mp->WriteMessage(UserPointer<const void>(&value),
+                            static_cast<uint32_t>(sizeof(value)), nullptr,
+                            MOJO_WRITE_MESSAGE_FLAG_NONE),
+           MOJO_RESULT_OK);
+}
+
+// Waits for a message containing just a |uint32_t| to arrive at |mp|, and reads
+// it.
+uint32_t ReadUint32Message(MessagePipeDispatcher* mp) {
+  Waiter waiter;
+  waiter.Init();
+  MojoResult result =
+      mp->AddAwakable(&waiter, MOJO_HANDLE_SIGNAL_READABLE, 0, nullptr);
+  if (result == MOJO_RESULT_OK) {
+    CHECK_EQ(waiter.Wait(test::ActionTimeout(), nullptr), MOJO_RESULT_OK);
+    mp->RemoveAwakable(&waiter, nullptr);
+  } else {
+    CHECK_EQ(result, MOJO_RESULT_ALREADY_EXISTS);
+  }
+
+  uint32_t value = 0;
+  uint32_t num_bytes = static_cast<uint32_t>(sizeof(value));
+  CHECK_EQ(mp->ReadMessage(UserPointer<void>(&value),
+                           MakeUserPointer(&num_bytes), 0, nullptr,
+                           MOJO_READ_MESSAGE_FLAG_NONE),
+           MOJO_RESULT_OK);
+  CHECK_EQ(num_bytes, sizeof(value));
+  return value;
+}
+
+// Waits for |mp|'s peer to be closed. Returns false on timeout.
+bool WaitForPeerClosed(MessagePipeDispatcher* mp) {
+  Waiter waiter;
+  waiter.Init();
+  HandleSignalsState hss;
+  if (mp->AddAwakable(&waiter, MOJO_HANDLE_SIGNAL_PEER_CLOSED, 0, &hss) ==
+      MOJO_RESULT_OK) {
+    if (waiter.Wait(test::ActionTimeout(), nullptr) != MOJO_RESULT_OK)
+      return false;
+    mp->RemoveAwakable(&waiter, &hss);
+  }
+  return hss.satisfies(MOJO_HANDLE_SIGNAL_PEER_CLOSED);
+}
+
 MessagePipeDispatcherPair CreateMessagePipe() {
   MessagePipeDispatcherPair rv;
   rv.first = MessagePipeDispatcher::Create(
@@ -448,10 +531,50 @@ TEST_F(IPCSupportTest, MasterSlave) {
   ShutdownMasterIPCSupport();
 }
 
+// Like |IPCSupportTest.MasterSlave|, but with several slaves and several I/O
+// threads (so that the channels, in the master and in the slaves, are spread
+// across I/O threads). (This can't use |IPCSupportTest|, since the
+// configuration must be changed before the master's |IPCSupport| is created.)
+TEST(IPCSupportMultipleIOThreadsTest, MasterSlaves) {
+  const size_t kNumSlaves = 5;
+
+  test::ScopedConfigurationRestorer configuration_restorer;
+  GetMutableConfiguration()->num_io_threads = 3;
+
+  {
+    std::unique_ptr<embedder::PlatformSupport> platform_support(
+        embedder::CreateSimplePlatformSupport());
+    test::TestIOThread test_io_thread(test::TestIOThread::StartMode::AUTO);
+    TestMasterProcessDelegate master_process_delegate;
+    IPCSupport master_ipc_support(
+        platform_support.get(), embedder::ProcessType::MASTER,
+        test_io_thread.task_runner().Clone(), &master_process_delegate,
+        test_io_thread.task_runner().Clone(),
+        test_io_thread.platform_handle_watcher(), ScopedPlatformHandle());
+
+    std::vector<std::unique_ptr<TestSlaveSetup>> slaves;
+    for (size_t i = 0; i < kNumSlaves; i++) {
+      slaves.push_back(std::unique_ptr<TestSlaveSetup>(
+          new TestSlaveSetup(platform_support.get(), &test_io_thread,
+                             &master_process_delegate, &master_ipc_support)));
+      slaves.back()->Init();
+    }
+
+    for (auto& s : slaves)
+      s->TestConnection();
+
+    for (auto& s : slaves)
+      s->Shutdown();
+
+    test_io_thread.PostTaskAndWait(
+        [&master_ipc_support]() { master_ipc_support.ShutdownOnIOThread(); });
+  }
+}
+
 // Simulates a master and two slaves. Initially, there are just message pipes
 // from the master to the slaves. This tests the master creating a message pipe
 // and sending an end to each slave, which should result in a direct connection
-// between the two slaves (TODO(vtl): this part doesn't happen yet).
+// between the two slaves (and the master dropping out of the route).
 // TODO(vtl): There are various other similar scenarios we'll need to test, so
 // we'll need to factor out some of the code.
 // TODO(vtl): In this scenario, we can't test the intermediary (the master)
@@ -474,6 +597,15 @@ TEST_F(IPCSupportTest, ConnectTwoSlaves) {
   TestWriteReadMessage(slave1_received_mp.get(), slave2_received_mp.get());
   TestWriteReadMessage(slave2_received_mp.get(), slave1_received_mp.get());
 
+  // The master should drop out of the route, leaving only the bootstrap
+  // endpoints on its channels to the slaves.
+  EXPECT_TRUE(WaitForOnlyBootstrapEndpoint(&master_ipc_support(), s1.get()));
+  EXPECT_TRUE(WaitForOnlyBootstrapEndpoint(&master_ipc_support(), s2.get()));
+
+  // They should still be connected.
+  TestWriteReadMessage(slave1_received_mp.get(), slave2_received_mp.get());
+  TestWriteReadMessage(slave2_received_mp.get(), slave1_received_mp.get());
+
   s1->PassMasterMessagePipe()->Close();
   s2->PassMasterMessagePipe()->Close();
   s1->PassSlaveMessagePipe()->Close();
@@ -537,6 +669,58 @@ TEST_F(IPCSupportTest, ConnectTwoSlavesTwice) {
   ShutdownMasterIPCSupport();
 }
 
+// Writes messages in both directions while the master is being bypassed (which
+// starts as soon as the second end is sent), and checks that they arrive in
+// order.
+TEST_F(IPCSupportTest, ConnectTwoSlavesMessageOrder) {
+  static const uint32_t kNumMessages = 100;
+
+  std::unique_ptr<TestSlaveSetup> s1(SetupSlave());
+  std::unique_ptr<TestSlaveSetup> s2(SetupSlave());
+  s1->TestConnection();
+  s2->TestConnection();
+
+  MessagePipeDispatcherPair send_mp = CreateMessagePipe();
+  RefPtr<MessagePipeDispatcher> slave1_received_mp = SendMessagePipeDispatcher(
+      s1->master_mp(), s1->slave_mp(), std::move(send_mp.first));
+  RefPtr<MessagePipeDispatcher> slave2_received_mp = SendMessagePipeDispatcher(
+      s2->master_mp(), s2->slave_mp(), std::move(send_mp.second));
+
+  for (uint32_t i = 0; i < kNumMessages; i++) {
+    WriteUint32Message(slave1_received_mp.get(), i);
+    WriteUint32Message(slave2_received_mp.get(), kNumMessages + i);
+    // Interleave reads, so that some messages are read before the switch.
+    if (i % 10 == 9) {
+      for (uint32_t j = i - 9; j <= i; j++) {
+        EXPECT_EQ(j, ReadUint32Message(slave2_received_mp.get()));
+        EXPECT_EQ(kNumMessages + j,
+                  ReadUint32Message(slave1_received_mp.get()));
+      }
+    }
+  }
+
+  EXPECT_TRUE(WaitForOnlyBootstrapEndpoint(&master_ipc_support(), s1.get()));
+  EXPECT_TRUE(WaitForOnlyBootstrapEndpoint(&master_ipc_support(), s2.get()));
+
+  // Messages sent after the switch should also arrive in order.
+  for (uint32_t i = 0; i < kNumMessages; i++) {
+    WriteUint32Message(slave1_received_mp.get(), i);
+    WriteUint32Message(slave2_received_mp.get(), kNumMessages + i);
+  }
+  for (uint32_t i = 0; i < kNumMessages; i++) {
+    EXPECT_EQ(i, ReadUint32Message(slave2_received_mp.get()));
+    EXPECT_EQ(kNumMessages + i, ReadUint32Message(slave1_received_mp.get()));
+  }
+
+  slave1_received_mp->Close();
+  slave2_received_mp->Close();
+
+  s1->Shutdown();
+  s2->Shutdown();
+
+  ShutdownMasterIPCSupport();
+}
+
 // Creates a message pipe in the slave, which sends both ends (in separate
 // messages) to the master.
 TEST_F(IPCSupportTest, SlavePassBackToMaster) {
@@ -626,6 +810,127 @@ TEST_F(IPCSupportTest, MasterSlaveInternal) {
   ShutdownMasterIPCSupport();
 }
 
+// Tests that a cancelled connection is no longer pending in the master, and
+// that a subsequent |Connect()| fails.
+// Note: This test isn't in an anonymous namespace, since it needs to be
+// friended by |IPCSupport|.
+TEST_F(IPCSupportTest, CancelConnect) {
+  MasterConnectionManager* master_connection_manager =
+      static_cast<MasterConnectionManager*>(
+          master_ipc_support().connection_manager());
+  ChannelManager* channel_manager = master_ipc_support().channel_manager();
+  ConnectionIdentifier connection_id =
+      master_ipc_support().GenerateConnectionIdentifier();
+  AutoResetWaitableEvent event;
+
+  bool allowed = false;
+  test_io_thread().PostTaskAndWait([&]() {
+    channel_manager->AllowConnect(connection_id, [&](bool result) {
+      allowed = result;
+      event.Signal();
+    });
+  });
+  EXPECT_FALSE(event.WaitWithTimeout(test::ActionTimeout()));
+  EXPECT_TRUE(allowed);
+  EXPECT_EQ(1u, master_connection_manager->GetNumPendingConnectsForTest());
+
+  // Connection tasks are run in order, so the |Connect()| will see the
+  // cancellation.
+  bool connected = true;
+  test_io_thread().PostTaskAndWait([&]() {
+    channel_manager->CancelConnect(connection_id);
+    channel_manager->Connect(
+        connection_id, [&](RefPtr<Channel>&& channel, bool /*is_first*/) {
+          EXPECT_FALSE(channel);
+          connected = false;
+          event.Signal();
+        });
+  });
+  EXPECT_FALSE(event.WaitWithTimeout(test::ActionTimeout()));
+  EXPECT_FALSE(connected);
+  EXPECT_EQ(0u, master_connection_manager->GetNumPendingConnectsForTest());
+
+  ShutdownMasterIPCSupport();
+}
+
+// Closes one end of a message pipe between two slaves while the master is being
+// bypassed (repeatedly, alternating ends and with varying delays, to hit
+// different points in the handshake). The other end should see its peer closed,
+// and nothing should be left behind: neither endpoints (including zombies) on
+// any of the channels nor pending connections in the master.
+// Note: This test isn't in an anonymous namespace, since it needs to be
+// friended by |IPCSupport|.
+TEST_F(IPCSupportTest, ConnectTwoSlavesCloseRacingConnect) {
+  static const unsigned kNumIterations = 20;
+
+  MasterConnectionManager* master_connection_manager =
+      static_cast<MasterConnectionManager*>(
+          master_ipc_support().connection_manager());
+  std::unique_ptr<TestSlaveSetup> s1(SetupSlave());
+  std::unique_ptr<TestSlaveSetup> s2(SetupSlave());
+  s1->TestConnection();
+  s2->TestConnection();
+
+  for (unsigned i = 0; i < kNumIterations; i++) {
+    MessagePipeDispatcherPair send_mp = CreateMessagePipe();
+    RefPtr<MessagePipeDispatcher> slave1_received_mp =
+        SendMessagePipeDispatcher(s1->master_mp(), s1->slave_mp(),
+                                  std::move(send_mp.first));
+    RefPtr<MessagePipeDispatcher> slave2_received_mp =
+        SendMessagePipeDispatcher(s2->master_mp(), s2->slave_mp(),
+                                  std::move(send_mp.second));
+
+    if (i / 2 > 0)
+      ThreadSleep(test::DeadlineFromMilliseconds(i / 2));
+    if (i % 2 == 0) {
+      slave1_received_mp->Close();
+      EXPECT_TRUE(WaitForPeerClosed(slave2_received_mp.get()));
+      slave2_received_mp->Close();
+    } else {
+      slave2_received_mp->Close();
+      EXPECT_TRUE(WaitForPeerClosed(slave1_received_mp.get()));
+      slave1_received_mp->Close();
+    }
+  }
+
+  EXPECT_TRUE(WaitForOnlyBootstrapEndpoint(&master_ipc_support(), s1.get()));
+  EXPECT_TRUE(WaitForOnlyBootstrapEndpoint(&master_ipc_support(), s2.get()));
+
+  // A final (completed) connection makes sure that the slaves have a channel
+  // to each other, and flushes any handshakes still in progress there.
+  MessagePipeDispatcherPair send_mp = CreateMessagePipe();
+  RefPtr<MessagePipeDispatcher> slave1_received_mp = SendMessagePipeDispatcher(
+      s1->master_mp(), s1->slave_mp(), std::move(send_mp.first));
+  RefPtr<MessagePipeDispatcher> slave2_received_mp = SendMessagePipeDispatcher(
+      s2->master_mp(), s2->slave_mp(), std::move(send_mp.second));
+  EXPECT_TRUE(WaitForOnlyBootstrapEndpoint(&master_ipc_support(), s1.get()));
+  EXPECT_TRUE(WaitForOnlyBootstrapEndpoint(&master_ipc_support(), s2.get()));
+  TestWriteReadMessage(slave1_received_mp.get(), slave2_received_mp.get());
+  TestWriteReadMessage(slave2_received_mp.get(), slave1_received_mp.get());
+  slave1_received_mp->Close();
+  slave2_received_mp->Close();
+
+  EXPECT_EQ(0u, master_connection_manager->GetNumPendingConnectsForTest());
+  // Note: |ChannelId|s and |ProcessIdentifier|s are interchangeable.
+  EXPECT_TRUE(WaitForNumEndpoints(
+      s1->slave()
+          ->channel_manager()
+          ->GetChannel(s2->slave_connection()->slave_id())
+          .get(),
+      0u));
+  EXPECT_TRUE(WaitForNumEndpoints(
+      s2->slave()
+          ->channel_manager()
+          ->GetChannel(s1->slave_connection()->slave_id())
+          .get(),
+      0u));
+
+  s1->Shutdown();
+  s2->Shutdown();
+
+  ShutdownMasterIPCSupport();
+}
+
 // This is a true multiprocess version of IPCSupportTest.MasterSlaveInternal.
 // Note: This test isn't in an anonymous namespace, since it needs to be
 // friended by |IPCSupport|.
@@ -16,16 +16,21 @@
 #include <utility>
 
 #include "base/logging.h"
+#include "mojo/edk/embedder/platform_support.h"
 #include "mojo/edk/system/channel.h"
 #include "mojo/edk/system/configuration.h"
 #include "mojo/edk/system/data_pipe.h"
 #include "mojo/edk/system/message_in_transit.h"
 #include "mojo/edk/system/message_in_transit_queue.h"
 #include "mojo/edk/system/remote_consumer_data_pipe_impl.h"
+#include "mojo/edk/system/remote_consumer_shared_ring_data_pipe_impl.h"
 #include "mojo/edk/system/remote_producer_data_pipe_impl.h"
+#include "mojo/edk/system/remote_producer_shared_ring_data_pipe_impl.h"
 #include "mojo/edk/util/make_unique.h"
 
 using mojo::platform::AlignedAlloc;
+using mojo::platform::PlatformSharedBuffer;
+using mojo::platform::PlatformSharedBufferMapping;
 using mojo::platform::ScopedPlatformHandle;
 using mojo::util::MakeUnique;
 using mojo::util::RefPtr;
@@ -132,6 +137,32 @@ MojoResult LocalDataPipeImpl::ProducerBeginWriteData(
   return MOJO_RESULT_OK;
 }
 
+MojoResult LocalDataPipeImpl::ProducerBeginWriteDataSpans(
+    UserPointer<void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes) {
+  DCHECK(consumer_open());
+
+  size_t write_index =
+      (start_index_ + current_num_bytes_) % capacity_num_bytes();
+
+  size_t max_num_bytes_to_write = GetMaxNumBytesToWrite();
+  // Don't go into a two-phase write if there's no room.
+  if (max_num_bytes_to_write == 0)
+    return MOJO_RESULT_SHOULD_WAIT;
+  // Any remaining free space is at the beginning of the buffer.
+  size_t num_bytes_wrapped =
+      capacity_num_bytes() - current_num_bytes_ - max_num_bytes_to_write;
+
+  EnsureBuffer();
+  buffers.At(0).Put(buffer_.get() + write_index);
+  buffers_num_bytes.At(0).Put(static_cast<uint32_t>(max_num_bytes_to_write));
+  buffers.At(1).Put(num_bytes_wrapped ? buffer_.get() : nullptr);
+  buffers_num_bytes.At(1).Put(static_cast<uint32_t>(num_bytes_wrapped));
+  set_producer_two_phase_max_num_bytes_written(
+      static_cast<uint32_t>(max_num_bytes_to_write + num_bytes_wrapped));
+  return MOJO_RESULT_OK;
+}
+
 MojoResult LocalDataPipeImpl::ProducerEndWriteData(uint32_t num_bytes_written) {
   DCHECK_LE(num_bytes_written, producer_two_phase_max_num_bytes_written());
   DCHECK_EQ(num_bytes_written % element_num_bytes(), 0u);
@@ -168,17 +199,19 @@ void LocalDataPipeImpl::ProducerStartSerialize(Channel* channel,
                                                size_t* max_platform_handles) {
   *max_size = sizeof(SerializedDataPipeProducerDispatcher) +
               channel->GetSerializedEndpointSize();
-  *max_platform_handles = 0;
+  *max_platform_handles = 1;
 }
 
 bool LocalDataPipeImpl::ProducerEndSerialize(
     Channel* channel,
     void* destination,
     size_t* actual_size,
-    std::vector<ScopedPlatformHandle>* /*platform_handles*/) {
+    std::vector<ScopedPlatformHandle>* platform_handles) {
   SerializedDataPipeProducerDispatcher* s =
       static_cast<SerializedDataPipeProducerDispatcher*>(destination);
   s->validated_options = validated_options();
+  s->shared_ring_platform_handle_index = kNoSharedRingPlatformHandleIndex;
+  s->shared_ring_start_index = 0;
   void* destination_for_endpoint = static_cast<char*>(destination) +
                                    sizeof(SerializedDataPipeProducerDispatcher);
 
@@ -189,10 +222,42 @@ bool LocalDataPipeImpl::ProducerEndSerialize(
     return true;
   }
 
-  // Case 2: The consumer isn't closed. We'll replace ourselves with a
-  // |RemoteProducerDataPipeImpl|.
-
   s->consumer_num_bytes = current_num_bytes_;
+
+  // Case 2: The consumer isn't closed. If possible, we'll move the data into a
+  // shared memory ring buffer and replace ourselves with a
+  // |RemoteProducerSharedRingDataPipeImpl|. (We can't do this during a
+  // two-phase read, since the consumer is reading directly from |buffer_|.)
+  RefPtr<PlatformSharedBuffer> ring_buffer;
+  std::unique_ptr<PlatformSharedBufferMapping> ring_mapping;
+  if (!consumer_in_two_phase_read() &&
+      CreateSharedRing(channel, &ring_buffer, &ring_mapping, platform_handles,
+                       &s->shared_ring_platform_handle_index)) {
+    s->shared_ring_start_index = static_cast<uint32_t>(start_index_);
+    // Note: We don't use |port|.
+    RefPtr<ChannelEndpoint> channel_endpoint =
+        channel->SerializeEndpointWithLocalPeer(
+            destination_for_endpoint, nullptr,
+            RefPtr<ChannelEndpointClient>(channel_endpoint_client()), 0);
+    // The data is now in the ring buffer, so we no longer need |buffer_|.
+    size_t start_index = start_index_;
+    size_t current_num_bytes = current_num_bytes_;
+    DestroyBuffer();
+    // Note: Keep |*this| alive until the end of this method, to make things
+    // slightly easier on ourselves.
+    std::unique_ptr<DataPipeImpl> self(
+        ReplaceImpl(MakeUnique<RemoteProducerSharedRingDataPipeImpl>(
+            std::move(channel_endpoint), std::move(ring_buffer),
+            std::move(ring_mapping), start_index, current_num_bytes)));
+
+    *actual_size = sizeof(SerializedDataPipeProducerDispatcher) +
+                   channel->GetSerializedEndpointSize();
+    return true;
+  }
+
+  // Case 3: Otherwise (we couldn't use a ring buffer), we'll replace ourselves
+  // with a |RemoteProducerDataPipeImpl|.
+
   // Note: We don't use |port|.
   RefPtr<ChannelEndpoint> channel_endpoint =
       channel->SerializeEndpointWithLocalPeer(
@@ -311,10 +376,30 @@ MojoResult LocalDataPipeImpl::ConsumerBeginReadData(
   return MOJO_RESULT_OK;
 }
 
+MojoResult LocalDataPipeImpl::ConsumerBeginReadDataSpans(
+    UserPointer<const void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes) {
+  size_t max_num_bytes_to_read = GetMaxNumBytesToRead();
+  // Don't go into a two-phase read if there's no data.
+  if (max_num_bytes_to_read == 0) {
+    return producer_open() ? MOJO_RESULT_SHOULD_WAIT
+                           : MOJO_RESULT_FAILED_PRECONDITION;
+  }
+  // Any remaining data is at the beginning of the buffer.
+  size_t num_bytes_wrapped = current_num_bytes_ - max_num_bytes_to_read;
+
+  buffers.At(0).Put(buffer_.get() + start_index_);
+  buffers_num_bytes.At(0).Put(static_cast<uint32_t>(max_num_bytes_to_read));
+  buffers.At(1).Put(num_bytes_wrapped ? buffer_.get() : nullptr);
+  buffers_num_bytes.At(1).Put(static_cast<uint32_t>(num_bytes_wrapped));
+  set_consumer_two_phase_max_num_bytes_read(
+      static_cast<uint32_t>(max_num_bytes_to_read + num_bytes_wrapped));
+  return MOJO_RESULT_OK;
+}
+
 MojoResult LocalDataPipeImpl::ConsumerEndReadData(uint32_t num_bytes_read) {
   DCHECK_LE(num_bytes_read, consumer_two_phase_max_num_bytes_read());
   DCHECK_EQ(num_bytes_read % element_num_bytes(), 0u);
-  DCHECK_LE(start_index_ + num_bytes_read, capacity_num_bytes());
   MarkDataAsConsumed(num_bytes_read);
   set_consumer_two_phase_max_num_bytes_read(0);
   return MOJO_RESULT_OK;
@@ -351,27 +436,64 @@ void LocalDataPipeImpl::ConsumerStartSerialize(Channel* channel,
                                                size_t* max_platform_handles) {
   *max_size = sizeof(SerializedDataPipeConsumerDispatcher) +
               channel->GetSerializedEndpointSize();
-  *max_platform_handles = 0;
+  *max_platform_handles = 1;
 }
 
 bool LocalDataPipeImpl::ConsumerEndSerialize(
     Channel* channel,
     void* destination,
     size_t* actual_size,
-    std::vector<ScopedPlatformHandle>* /*platform_handles*/) {
+    std::vector<ScopedPlatformHandle>* platform_handles) {
   SerializedDataPipeConsumerDispatcher* s =
       static_cast<SerializedDataPipeConsumerDispatcher*>(destination);
   s->validated_options = validated_options();
+  s->shared_ring_platform_handle_index = kNoSharedRingPlatformHandleIndex;
+  s->shared_ring_start_index = 0;
+  s->shared_ring_num_bytes = 0;
   void* destination_for_endpoint = static_cast<char*>(destination) +
                                    sizeof(SerializedDataPipeConsumerDispatcher);
 
+  // Case 1: The producer isn't closed. If possible, we'll move the data into a
+  // shared memory ring buffer and replace ourselves with a
+  // |RemoteConsumerSharedRingDataPipeImpl|. (We can't do this during a
+  // two-phase write, since the producer is writing directly to |buffer_|.)
+  RefPtr<PlatformSharedBuffer> ring_buffer;
+  std::unique_ptr<PlatformSharedBufferMapping> ring_mapping;
+  if (producer_open() && !producer_in_two_phase_write() &&
+      CreateSharedRing(channel, &ring_buffer, &ring_mapping, platform_handles,
+                       &s->shared_ring_platform_handle_index)) {
+    s->shared_ring_start_index = static_cast<uint32_t>(start_index_);
+    s->shared_ring_num_bytes = static_cast<uint32_t>(current_num_bytes_);
+    // Note: We don't use |port|.
+    RefPtr<ChannelEndpoint> channel_endpoint =
+        channel->SerializeEndpointWithLocalPeer(
+            destination_for_endpoint, nullptr,
+            RefPtr<ChannelEndpointClient>(channel_endpoint_client()), 0);
+    // The data is now in the ring buffer, so we no longer need |buffer_|.
+    size_t consumer_num_bytes = current_num_bytes_;
+    size_t write_index =
+        (start_index_ + current_num_bytes_) % capacity_num_bytes();
+    DestroyBuffer();
+    // Note: Keep |*this| alive until the end of this method, to make things
+    // slightly easier on ourselves.
+    std::unique_ptr<DataPipeImpl> self(
+        ReplaceImpl(MakeUnique<RemoteConsumerSharedRingDataPipeImpl>(
+            std::move(channel_endpoint), consumer_num_bytes,
+            std::move(ring_buffer), std::move(ring_mapping), write_index)));
+
+    *actual_size = sizeof(SerializedDataPipeConsumerDispatcher) +
+                   channel->GetSerializedEndpointSize();
+    return true;
+  }
+
+  // Otherwise, we'll send the data in messages.
   size_t old_num_bytes = current_num_bytes_;
   MessageInTransitQueue message_queue;
   ConvertDataToMessages(buffer_.get(), &start_index_, &current_num_bytes_,
                         &message_queue);
 
   if (!producer_open()) {
-    // Case 1: The producer is closed.
+    // Case 2: The producer is closed.
     DestroyBuffer();
     channel->SerializeEndpointWithClosedPeer(destination_for_endpoint,
                                              &message_queue);
@@ -380,8 +502,8 @@ bool LocalDataPipeImpl::ConsumerEndSerialize(
     return true;
   }
 
-  // Case 2: The producer isn't closed. We'll replace ourselves with a
-  // |RemoteConsumerDataPipeImpl|.
+  // Case 3: The producer isn't closed (but we couldn't use a ring buffer).
+  // We'll replace ourselves with a |RemoteConsumerDataPipeImpl|.
 
   // Note: We don't use |port|.
   RefPtr<ChannelEndpoint> channel_endpoint =
@@ -432,6 +554,46 @@ void LocalDataPipeImpl::DestroyBuffer() {
   current_num_bytes_ = 0;
 }
 
+bool LocalDataPipeImpl::CreateSharedRing(
+    Channel* channel,
+    RefPtr<PlatformSharedBuffer>* ring_buffer,
+    std::unique_ptr<PlatformSharedBufferMapping>* ring_mapping,
+    std::vector<ScopedPlatformHandle>* platform_handles,
+    uint32_t* platform_handle_index) {
+  if (!GetConfiguration().use_shared_memory_for_remote_data_pipes)
+    return false;
+
+  RefPtr<PlatformSharedBuffer> new_ring_buffer =
+      channel->platform_support()->CreateSharedBuffer(capacity_num_bytes());
+  if (!new_ring_buffer)
+    return false;
+  std::unique_ptr<PlatformSharedBufferMapping> new_ring_mapping =
+      new_ring_buffer->MapNoCheck(0, capacity_num_bytes());
+  if (!new_ring_mapping)
+    return false;
+  ScopedPlatformHandle platform_handle(
+      new_ring_buffer->DuplicatePlatformHandle());
+  if (!platform_handle.is_valid())
+    return false;
+
+  if (current_num_bytes_ > 0) {
+    char* ring = static_cast<char*>(new_ring_mapping->GetBase());
+    size_t num_bytes_first =
+        std::min(current_num_bytes_, capacity_num_bytes() - start_index_);
+    memcpy(ring + start_index_, buffer_.get() + start_index_, num_bytes_first);
+    if (num_bytes_first < current_num_bytes_) {
+      // The "second index" is zero.
+      memcpy(ring, buffer_.get(), current_num_bytes_ - num_bytes_first);
+    }
+  }
+
+  *ring_buffer = std::move(new_ring_buffer);
+  *ring_mapping = std::move(new_ring_mapping);
+  *platform_handle_index = static_cast<uint32_t>(platform_handles->size());
+  platform_handles->push_back(std::move(platform_handle));
+  return true;
+}
+
 size_t LocalDataPipeImpl::GetMaxNumBytesToWrite() {
   size_t next_index = start_index_ + current_num_bytes_;
   if (next_index >= capacity_num_bytes()) {
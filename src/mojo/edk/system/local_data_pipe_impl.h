@@ -5,10 +5,15 @@
 #ifndef MOJO_EDK_SYSTEM_LOCAL_DATA_PIPE_IMPL_H_
 #define MOJO_EDK_SYSTEM_LOCAL_DATA_PIPE_IMPL_H_
 
+#include <stdint.h>
+
 #include <memory>
+#include <vector>
 
 #include "mojo/edk/platform/aligned_alloc.h"
+#include "mojo/edk/platform/platform_shared_buffer.h"
 #include "mojo/edk/system/data_pipe_impl.h"
+#include "mojo/edk/util/ref_ptr.h"
 #include "mojo/public/cpp/system/macros.h"
 
 namespace mojo {
@@ -35,6 +40,9 @@ class LocalDataPipeImpl final : public DataPipeImpl {
       UserPointer<void*> buffer,
       UserPointer<uint32_t> buffer_num_bytes) override;
   MojoResult ProducerEndWriteData(uint32_t num_bytes_written) override;
+  MojoResult ProducerBeginWriteDataSpans(
+      UserPointer<void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes) override;
   HandleSignalsState ProducerGetHandleSignalsState() const override;
   void ProducerStartSerialize(Channel* channel,
                               size_t* max_size,
@@ -58,6 +66,9 @@ class LocalDataPipeImpl final : public DataPipeImpl {
       UserPointer<const void*> buffer,
       UserPointer<uint32_t> buffer_num_bytes) override;
   MojoResult ConsumerEndReadData(uint32_t num_bytes_read) override;
+  MojoResult ConsumerBeginReadDataSpans(
+      UserPointer<const void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes) override;
   HandleSignalsState ConsumerGetHandleSignalsState() const override;
   void ConsumerStartSerialize(Channel* channel,
                               size_t* max_size,
@@ -73,6 +84,21 @@ class LocalDataPipeImpl final : public DataPipeImpl {
   void EnsureBuffer();
   void DestroyBuffer();
 
+  // Used when serializing one side: If enabled (see
+  // |embedder::Configuration::use_shared_memory_for_remote_data_pipes|), tries
+  // to create a shared memory ring buffer (of size |capacity_num_bytes()|) and
+  // copies the current data into it (at the same indices). On success, sets
+  // |*ring_buffer| and |*ring_mapping|, adds (a duplicate of) the ring buffer's
+  // handle to |*platform_handles|, sets |*platform_handle_index| to its index,
+  // and returns true. Otherwise, returns false (in which case the data should
+  // be sent in messages instead).
+  bool CreateSharedRing(
+      Channel* channel,
+      util::RefPtr<platform::PlatformSharedBuffer>* ring_buffer,
+      std::unique_ptr<platform::PlatformSharedBufferMapping>* ring_mapping,
+      std::vector<platform::ScopedPlatformHandle>* platform_handles,
+      uint32_t* platform_handle_index);
+
   // Get the maximum (single) write/read size right now (in number of elements);
   // result fits in a |uint32_t|.
   size_t GetMaxNumBytesToWrite();
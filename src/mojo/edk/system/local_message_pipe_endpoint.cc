@@ -10,15 +10,26 @@
 
 #include "base/logging.h"
 #include "mojo/edk/system/message_in_transit.h"
+#include "mojo/edk/system/message_in_transit_queue.h"
+#include "mojo/edk/system/reclaimer.h"
 
 namespace mojo {
 namespace system {
 
 LocalMessagePipeEndpoint::LocalMessagePipeEndpoint(
     MessageInTransitQueue* message_queue)
-    : is_open_(true), is_peer_open_(true) {
+    : is_open_(true),
+      is_peer_open_(true),
+      is_peer_queue_full_(false),
+      ack_request_id_(0),
+      has_removed_message_(false),
+      removed_message_num_bytes_(0),
+      num_messages_read_(0),
+      num_bytes_read_(0),
+      num_handles_read_(0),
+      has_awakables_(false) {
   if (message_queue)
-    message_queue_.Swap(message_queue);
+    message_queue_.AddMessages(message_queue);
 }
 
 LocalMessagePipeEndpoint::~LocalMessagePipeEndpoint() {
@@ -38,32 +49,41 @@ bool LocalMessagePipeEndpoint::OnPeerClose() {
   is_peer_open_ = false;
   HandleSignalsState new_state = GetHandleSignalsState();
 
-  if (!new_state.equals(old_state))
+  if (!new_state.equals(old_state)) {
     awakable_list_.AwakeForStateChange(new_state);
+    UpdateHasAwakables();
+  }
 
   return true;
 }
 
 void LocalMessagePipeEndpoint::EnqueueMessage(
     std::unique_ptr<MessageInTransit> message) {
-  DCHECK(is_open_);
-  DCHECK(is_peer_open_);
-
-  bool was_empty = message_queue_.IsEmpty();
-  message_queue_.AddMessage(std::move(message));
-  if (was_empty)
-    awakable_list_.AwakeForStateChange(GetHandleSignalsState());
+  if (EnqueueMessageNoAwake(std::move(message)))
+    AwakeForNewMessages();
 }
 
 void LocalMessagePipeEndpoint::Close() {
   DCHECK(is_open_);
   is_open_ = false;
+  if (Reclaimer* reclaimer = Reclaimer::Get()) {
+    // Let the reclaimer destroy any remaining messages (and close the handles
+    // attached to them), since that may be expensive.
+    MessageInTransitQueue messages;
+    if (two_phase_read_message_)
+      messages.AddMessage(std::move(two_phase_read_message_));
+    message_queue_.GetMessages(&messages);
+    reclaimer->ReclaimMessages(&messages);
+    return;
+  }
   message_queue_.Clear();
+  two_phase_read_message_.reset();
 }
 
 void LocalMessagePipeEndpoint::CancelAllState() {
   DCHECK(is_open_);
   awakable_list_.CancelAll();
+  UpdateHasAwakables();
 }
 
 MojoResult LocalMessagePipeEndpoint::ReadMessage(
@@ -78,15 +98,22 @@ MojoResult LocalMessagePipeEndpoint::ReadMessage(
   const uint32_t max_bytes = num_bytes.IsNull() ? 0 : num_bytes.Get();
   const uint32_t max_num_handles = num_handles ? *num_handles : 0;
 
+  // Note: We may not have the lock, so we must check |is_peer_open_| before
+  // checking for messages. (If the queue is empty now, it was also empty when
+  // we checked |is_peer_open_|, since only we can remove messages.)
+  bool is_peer_open = is_peer_open_;
   if (message_queue_.IsEmpty()) {
-    return is_peer_open_ ? MOJO_RESULT_SHOULD_WAIT
-                         : MOJO_RESULT_FAILED_PRECONDITION;
+    return is_peer_open ? MOJO_RESULT_SHOULD_WAIT
+                        : MOJO_RESULT_FAILED_PRECONDITION;
   }
 
   // TODO(vtl): If |flags & MOJO_READ_MESSAGE_FLAG_MAY_DISCARD|, we could pop
   // and release the lock immediately.
   bool enough_space = true;
   MessageInTransit* message = message_queue_.PeekMessage();
+  const uint32_t message_num_bytes = message->num_bytes();
+  const size_t message_num_handles =
+      message->handles() ? message->handles()->size() : 0;
   if (!num_bytes.IsNull())
     num_bytes.Put(message->num_bytes());
   if (message->num_bytes() <= max_bytes)
@@ -112,17 +139,92 @@ MojoResult LocalMessagePipeEndpoint::ReadMessage(
       *num_handles = 0;
   }
 
+  const uint32_t ack_request_id = message->ack_request_id();
   message = nullptr;
 
-  if (enough_space || (flags & MOJO_READ_MESSAGE_FLAG_MAY_DISCARD)) {
+  // Note: If the queue becomes empty (thus no longer readable), we don't awake
+  // awakables (which would need the lock): anything waiting for readability
+  // will already have been awoken, and becoming unreadable can't satisfy any
+  // other signal.
+  if (enough_space) {
     message_queue_.DiscardMessage();
+    ack_request_id_ = ack_request_id;
+    has_removed_message_ = true;
+    removed_message_num_bytes_ = message_num_bytes;
+  } else if (flags & MOJO_READ_MESSAGE_FLAG_MAY_DISCARD) {
+    // It still has its handles, so leave destroying it to our caller (see
+    // |TakeDiscardedMessage()|).
+    discarded_message_ = message_queue_.GetMessage();
+    ack_request_id_ = ack_request_id;
+    has_removed_message_ = true;
+    removed_message_num_bytes_ = message_num_bytes;
+  }
+
+  if (!enough_space)
+    return MOJO_RESULT_RESOURCE_EXHAUSTED;
+
+  RecordRead(message_num_bytes, message_num_handles);
+  return MOJO_RESULT_OK;
+}
+
+MojoResult LocalMessagePipeEndpoint::BeginReadMessage(
+    UserPointer<void*> buffer,
+    UserPointer<uint32_t> buffer_num_bytes,
+    HandleVector* handles,
+    uint32_t* num_handles,
+    MojoReadMessageFlags flags) {
+  DCHECK(is_open_);
+  DCHECK(!handles || handles->empty());
 
-    // Now it's empty, thus no longer readable.
-    if (message_queue_.IsEmpty()) {
-      // It's currently not possible to wait for non-readability, but we should
-      // do the state change anyway.
-      awakable_list_.AwakeForStateChange(GetHandleSignalsState());
+  if (two_phase_read_message_)
+    return MOJO_RESULT_BUSY;
+
+  const uint32_t max_num_handles = num_handles ? *num_handles : 0;
+
+  // See |ReadMessage()|.
+  bool is_peer_open = is_peer_open_;
+  if (message_queue_.IsEmpty()) {
+    return is_peer_open ? MOJO_RESULT_SHOULD_WAIT
+                        : MOJO_RESULT_FAILED_PRECONDITION;
+  }
+
+  // Unlike |ReadMessage()|, the data always "fits", so only the handles can
+  // keep us from taking the message.
+  bool enough_space = true;
+  MessageInTransit* message = message_queue_.PeekMessage();
+  buffer_num_bytes.Put(message->num_bytes());
+  if (HandleVector* queued_handles = message->handles()) {
+    if (num_handles)
+      *num_handles = static_cast<uint32_t>(queued_handles->size());
+    if (queued_handles->empty()) {
+      // Nothing to do.
+    } else if (queued_handles->size() <= max_num_handles) {
+      DCHECK(handles);
+      handles->swap(*queued_handles);
+    } else {
+      enough_space = false;
     }
+  } else {
+    if (num_handles)
+      *num_handles = 0;
+  }
+
+  message = nullptr;
+
+  if (enough_space) {
+    two_phase_read_message_ = message_queue_.GetMessage();
+    buffer.Put(two_phase_read_message_->bytes());
+    ack_request_id_ = two_phase_read_message_->ack_request_id();
+    has_removed_message_ = true;
+    removed_message_num_bytes_ = two_phase_read_message_->num_bytes();
+    RecordRead(two_phase_read_message_->num_bytes(),
+               handles ? handles->size() : 0);
+  } else if (flags & MOJO_READ_MESSAGE_FLAG_MAY_DISCARD) {
+    // See |ReadMessage()|.
+    discarded_message_ = message_queue_.GetMessage();
+    ack_request_id_ = discarded_message_->ack_request_id();
+    has_removed_message_ = true;
+    removed_message_num_bytes_ = discarded_message_->num_bytes();
   }
 
   if (!enough_space)
@@ -131,14 +233,31 @@ MojoResult LocalMessagePipeEndpoint::ReadMessage(
   return MOJO_RESULT_OK;
 }
 
+MojoResult LocalMessagePipeEndpoint::EndReadMessage() {
+  DCHECK(is_open_);
+
+  if (!two_phase_read_message_)
+    return MOJO_RESULT_FAILED_PRECONDITION;
+
+  two_phase_read_message_.reset();
+  return MOJO_RESULT_OK;
+}
+
 HandleSignalsState LocalMessagePipeEndpoint::GetHandleSignalsState() const {
+  // This may be called without the lock (by a holder of the consumer bit; see
+  // |MessagePipe::TryGetHandleSignalsState()|), so, as in |ReadMessage()|, we
+  // must check |is_peer_open_| before checking for messages. (Otherwise we
+  // might miss the last messages from a peer that has since been closed and
+  // report that readability can't be satisfied.)
+  bool is_peer_open = is_peer_open_;
   HandleSignalsState rv;
   if (!message_queue_.IsEmpty()) {
     rv.satisfied_signals |= MOJO_HANDLE_SIGNAL_READABLE;
     rv.satisfiable_signals |= MOJO_HANDLE_SIGNAL_READABLE;
   }
-  if (is_peer_open_) {
-    rv.satisfied_signals |= MOJO_HANDLE_SIGNAL_WRITABLE;
+  if (is_peer_open) {
+    if (!is_peer_queue_full_)
+      rv.satisfied_signals |= MOJO_HANDLE_SIGNAL_WRITABLE;
     rv.satisfiable_signals |=
         MOJO_HANDLE_SIGNAL_READABLE | MOJO_HANDLE_SIGNAL_WRITABLE;
   } else {
@@ -156,22 +275,27 @@ MojoResult LocalMessagePipeEndpoint::AddAwakable(
     HandleSignalsState* signals_state) {
   DCHECK(is_open_);
 
+  // Set |has_awakables_| before checking the state: a producer making the queue
+  // nonempty (without the lock) will then either see it (and awake us) or we'll
+  // see its message.
+  has_awakables_ = true;
+
+  MojoResult rv = MOJO_RESULT_OK;
   HandleSignalsState state = GetHandleSignalsState();
   if (state.satisfies(signals)) {
     if (force)
       awakable_list_.Add(awakable, signals, context);
-    if (signals_state)
-      *signals_state = state;
-    return MOJO_RESULT_ALREADY_EXISTS;
-  }
-  if (!state.can_satisfy(signals)) {
-    if (signals_state)
-      *signals_state = state;
-    return MOJO_RESULT_FAILED_PRECONDITION;
+    rv = MOJO_RESULT_ALREADY_EXISTS;
+  } else if (!state.can_satisfy(signals)) {
+    rv = MOJO_RESULT_FAILED_PRECONDITION;
+  } else {
+    awakable_list_.Add(awakable, signals, context);
   }
+  UpdateHasAwakables();
 
-  awakable_list_.Add(awakable, signals, context);
-  return MOJO_RESULT_OK;
+  if (rv != MOJO_RESULT_OK && signals_state)
+    *signals_state = state;
+  return rv;
 }
 
 void LocalMessagePipeEndpoint::RemoveAwakable(
@@ -179,6 +303,7 @@ void LocalMessagePipeEndpoint::RemoveAwakable(
     HandleSignalsState* signals_state) {
   DCHECK(is_open_);
   awakable_list_.Remove(awakable);
+  UpdateHasAwakables();
   if (signals_state)
     *signals_state = GetHandleSignalsState();
 }
@@ -189,9 +314,86 @@ void LocalMessagePipeEndpoint::RemoveAwakableWithContext(
     HandleSignalsState* signals_state) {
   DCHECK(is_open_);
   awakable_list_.RemoveWithContext(awakable, context);
+  UpdateHasAwakables();
   if (signals_state)
     *signals_state = GetHandleSignalsState();
 }
 
+bool LocalMessagePipeEndpoint::EnqueueMessageNoAwake(
+    std::unique_ptr<MessageInTransit> message) {
+  DCHECK(is_open_);
+  DCHECK(is_peer_open_);
+
+  // See |AddAwakable()| regarding |has_awakables_|.
+  return message_queue_.AddMessage(std::move(message)) && has_awakables_;
+}
+
+void LocalMessagePipeEndpoint::AwakeForNewMessages() {
+  awakable_list_.AwakeForStateChange(GetHandleSignalsState());
+  UpdateHasAwakables();
+}
+
+void LocalMessagePipeEndpoint::TakeMessages(
+    MessageInTransitQueue* message_queue) {
+  message_queue_.GetMessages(message_queue);
+}
+
+std::unique_ptr<MessageInTransit>
+LocalMessagePipeEndpoint::TakeDiscardedMessage() {
+  return std::move(discarded_message_);
+}
+
+void LocalMessagePipeEndpoint::SetPeerQueueFull(bool is_peer_queue_full) {
+  DCHECK(is_open_);
+  if (is_peer_queue_full == is_peer_queue_full_)
+    return;
+
+  is_peer_queue_full_ = is_peer_queue_full;
+  awakable_list_.AwakeForStateChange(GetHandleSignalsState());
+  UpdateHasAwakables();
+}
+
+uint32_t LocalMessagePipeEndpoint::TakeAckRequestId() {
+  uint32_t rv = ack_request_id_;
+  ack_request_id_ = 0;
+  return rv;
+}
+
+bool LocalMessagePipeEndpoint::TakeRemovedMessageNumBytes(uint32_t* num_bytes) {
+  if (!has_removed_message_)
+    return false;
+  *num_bytes = removed_message_num_bytes_;
+  has_removed_message_ = false;
+  removed_message_num_bytes_ = 0;
+  return true;
+}
+
+void LocalMessagePipeEndpoint::GetReadStats(uint64_t* num_messages,
+                                            uint64_t* num_bytes,
+                                            uint64_t* num_handles) const {
+  *num_messages = num_messages_read_.load(std::memory_order_relaxed);
+  *num_bytes = num_bytes_read_.load(std::memory_order_relaxed);
+  *num_handles = num_handles_read_.load(std::memory_order_relaxed);
+}
+
+void LocalMessagePipeEndpoint::UpdateHasAwakables() {
+  has_awakables_ = !awakable_list_.IsEmpty();
+}
+
+void LocalMessagePipeEndpoint::RecordRead(uint32_t num_bytes,
+                                          size_t num_handles) {
+  // Only the consumer modifies these, so there's no need for an atomic
+  // read-modify-write.
+  num_messages_read_.store(
+      num_messages_read_.load(std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed);
+  num_bytes_read_.store(num_bytes_read_.load(std::memory_order_relaxed) +
+                            num_bytes,
+                        std::memory_order_relaxed);
+  num_handles_read_.store(num_handles_read_.load(std::memory_order_relaxed) +
+                              num_handles,
+                          std::memory_order_relaxed);
+}
+
 }  // namespace system
 }  // namespace mojo
@@ -5,15 +5,26 @@
 #ifndef MOJO_EDK_SYSTEM_LOCAL_MESSAGE_PIPE_ENDPOINT_H_
 #define MOJO_EDK_SYSTEM_LOCAL_MESSAGE_PIPE_ENDPOINT_H_
 
+#include <atomic>
+#include <memory>
+
 #include "mojo/edk/system/awakable_list.h"
 #include "mojo/edk/system/handle_signals_state.h"
-#include "mojo/edk/system/message_in_transit_queue.h"
 #include "mojo/edk/system/message_pipe_endpoint.h"
+#include "mojo/edk/system/spsc_message_in_transit_queue.h"
 #include "mojo/public/cpp/system/macros.h"
 
 namespace mojo {
 namespace system {
 
+class MessageInTransitQueue;
+
+// Unlike the other methods, which must be called under the |MessagePipe|'s
+// lock, the methods that add messages to or read messages from the queue
+// (|EnqueueMessageNoAwake()|, |ReadMessage()|, |BeginReadMessage()|, and
+// |EndReadMessage()|) may be called without it (see the comment above
+// |MessagePipe::queue_states_|), provided that there's only one "producer" and
+// one "consumer" at a time.
 class LocalMessagePipeEndpoint final : public MessagePipeEndpoint {
  public:
   // If |message_queue| is non-null, its contents will be taken as the queue of
@@ -36,6 +47,12 @@ class LocalMessagePipeEndpoint final : public MessagePipeEndpoint {
                          HandleVector* handles,
                          uint32_t* num_handles,
                          MojoReadMessageFlags flags) override;
+  MojoResult BeginReadMessage(UserPointer<void*> buffer,
+                              UserPointer<uint32_t> buffer_num_bytes,
+                              HandleVector* handles,
+                              uint32_t* num_handles,
+                              MojoReadMessageFlags flags) override;
+  MojoResult EndReadMessage() override;
   HandleSignalsState GetHandleSignalsState() const override;
   MojoResult AddAwakable(Awakable* awakable,
                          MojoHandleSignals signals,
@@ -48,16 +65,80 @@ class LocalMessagePipeEndpoint final : public MessagePipeEndpoint {
                                  uint64_t context,
                                  HandleSignalsState* signals_state) override;
 
-  // This is only to be used by |MessagePipe|:
-  MessageInTransitQueue* message_queue() { return &message_queue_; }
+  // These are only to be used by |MessagePipe|:
+  // Like |EnqueueMessage()|, but doesn't awake awakables, and so doesn't need
+  // the lock. Returns true if the queue was empty and there may be awakables
+  // to awake, in which case the caller must call |AwakeForNewMessages()| (under
+  // the lock).
+  bool EnqueueMessageNoAwake(std::unique_ptr<MessageInTransit> message);
+  void AwakeForNewMessages();
+  // Moves all the messages in the queue to |*message_queue|.
+  void TakeMessages(MessageInTransitQueue* message_queue);
+  // The number of messages, and their total size, in the queue. These may be
+  // called without the lock (see |SpscMessageInTransitQueue::Size()|).
+  size_t GetNumQueuedMessages() const { return message_queue_.Size(); }
+  size_t GetNumQueuedBytes() const { return message_queue_.NumBytes(); }
+  // Sets whether the peer's queue is full, i.e., whether the peer can be
+  // written to (i.e., |MOJO_HANDLE_SIGNAL_WRITABLE|), awaking awakables as
+  // appropriate.
+  void SetPeerQueueFull(bool is_peer_queue_full);
+  // Returns the |MessageInTransit::ack_request_id()| of the last message
+  // consumed by |ReadMessage()| or |BeginReadMessage()| (and resets it to 0).
+  // This is a consumer method: it may be called without the lock.
+  uint32_t TakeAckRequestId();
+  // If the last |ReadMessage()| or |BeginReadMessage()| removed a message from
+  // the queue (by reading or discarding it), sets |*num_bytes| to its size and
+  // returns true (and resets this state); otherwise returns false. This is a
+  // consumer method.
+  bool TakeRemovedMessageNumBytes(uint32_t* num_bytes);
+  // Returns the message discarded by the last |ReadMessage()| or
+  // |BeginReadMessage()| with |MOJO_READ_MESSAGE_FLAG_MAY_DISCARD| (and resets
+  // it to null), which the caller should destroy without the lock (since that
+  // closes the handles attached to it). This is a consumer method.
+  std::unique_ptr<MessageInTransit> TakeDiscardedMessage();
+  // Gets the number of messages successfully read (by |ReadMessage()| or
+  // |BeginReadMessage()|), and their total size and number of handles. This may
+  // be called without the lock.
+  void GetReadStats(uint64_t* num_messages,
+                    uint64_t* num_bytes,
+                    uint64_t* num_handles) const;
 
  private:
+  // Sets |has_awakables_| from |awakable_list_|; must be called whenever the
+  // latter is modified.
+  void UpdateHasAwakables();
+
+  // Updates the statistics for |GetReadStats()|. Only called by the consumer.
+  void RecordRead(uint32_t num_bytes, size_t num_handles);
+
   bool is_open_;
-  bool is_peer_open_;
+  // This is only modified under the lock, but may be read by the consumer
+  // without it.
+  std::atomic<bool> is_peer_open_;
+  // Similarly, this is only modified under the lock, but may be read by
+  // |GetHandleSignalsState()| without it.
+  std::atomic<bool> is_peer_queue_full_;
 
   // Queue of incoming messages.
-  MessageInTransitQueue message_queue_;
+  SpscMessageInTransitQueue message_queue_;
+  // The message whose data is lent out during a two-phase read (already
+  // removed from |message_queue_|); null if there's no two-phase read.
+  std::unique_ptr<MessageInTransit> two_phase_read_message_;
+  // See |TakeAckRequestId()|. Only accessed by the consumer.
+  uint32_t ack_request_id_;
+  // See |TakeRemovedMessageNumBytes()|. Only accessed by the consumer.
+  bool has_removed_message_;
+  uint32_t removed_message_num_bytes_;
+  // See |TakeDiscardedMessage()|. Only accessed by the consumer.
+  std::unique_ptr<MessageInTransit> discarded_message_;
+  // See |GetReadStats()|. Only modified by the consumer.
+  std::atomic<uint64_t> num_messages_read_;
+  std::atomic<uint64_t> num_bytes_read_;
+  std::atomic<uint64_t> num_handles_read_;
   AwakableList awakable_list_;
+  // Whether |awakable_list_| is nonempty, so that the producer knows whether it
+  // needs to take the lock after making the queue nonempty.
+  std::atomic<bool> has_awakables_;
 
   MOJO_DISALLOW_COPY_AND_ASSIGN(LocalMessagePipeEndpoint);
 };
@@ -452,6 +452,11 @@ ConnectionManager::Result MasterConnectionManager::Connect(
                      peer_process_identifier, is_first, platform_handle);
 }
 
+size_t MasterConnectionManager::GetNumPendingConnectsForTest() {
+  MutexLocker locker(&mutex_);
+  return pending_connects_.size();
+}
+
 bool MasterConnectionManager::AllowConnectImpl(
     ProcessIdentifier process_identifier,
     const ConnectionIdentifier& connection_id) {
@@ -89,6 +89,11 @@ class MasterConnectionManager final : public ConnectionManager {
                  bool* is_first,
                  platform::ScopedPlatformHandle* platform_handle) override;
 
+  // Returns the number of connections for which |AllowConnect()| has been
+  // called (by at least one party) but which haven't yet been completed (by
+  // both parties calling |Connect()|) or cancelled.
+  size_t GetNumPendingConnectsForTest();
+
  private:
   class Helper;
 
@@ -0,0 +1,257 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mojo/edk/system/message_buffer_pool.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "base/logging.h"
+#include "mojo/edk/platform/aligned_alloc.h"
+#include "mojo/edk/util/mutex.h"
+#include "mojo/edk/util/thread_annotations.h"
+
+using mojo::platform::RawAlignedAlloc;
+using mojo::platform::RawAlignedFree;
+using mojo::util::Mutex;
+using mojo::util::MutexLocker;
+
+namespace mojo {
+namespace system {
+
+const size_t MessageBufferPool::kAlignment;
+const size_t MessageBufferPool::kMaxPooledBufferSize;
+
+namespace {
+
+// Size classes are the powers of 2 from 2^|kMinSizeClassLog2| up to
+// |MessageBufferPool::kMaxPooledBufferSize|.
+const size_t kMinSizeClassLog2 = 6;  // 64 bytes.
+const size_t kMaxSizeClassLog2 = 16;
+static_assert(MessageBufferPool::kMaxPooledBufferSize ==
+                  static_cast<size_t>(1) << kMaxSizeClassLog2,
+              "kMaxSizeClassLog2 doesn't match kMaxPooledBufferSize");
+const unsigned kNumSizeClasses =
+    static_cast<unsigned>(kMaxSizeClassLog2 - kMinSizeClassLog2 + 1);
+// "Size class" for buffers that are too big to be pooled.
+const unsigned kUnpooledSizeClass = kNumSizeClasses;
+
+// Approximate maximum number of bytes cached per size class per thread; the
+// shared free list for each size class may hold |kSharedCacheMultiplier| times
+// as much.
+const size_t kMaxThreadCacheBytes = 256 * 1024;
+const size_t kMaxThreadCacheCount = 64;
+const size_t kMinThreadCacheCount = 4;
+const size_t kSharedCacheMultiplier = 8;
+
+// Each buffer is preceded by a header (of size |kAlignment|, so that the buffer
+// itself is aligned), which records its size class.
+struct BufferHeader {
+  unsigned size_class;
+};
+static_assert(sizeof(BufferHeader) <= MessageBufferPool::kAlignment,
+              "BufferHeader too big");
+
+// Free buffers are kept in singly-linked lists, with the link stored in the
+// buffer itself.
+struct FreeBuffer {
+  FreeBuffer* next;
+};
+
+struct FreeList {
+  FreeBuffer* head = nullptr;
+  size_t count = 0;
+
+  void Push(FreeBuffer* buffer) {
+    buffer->next = head;
+    head = buffer;
+    count++;
+  }
+
+  FreeBuffer* Pop() {
+    DCHECK(head);
+    FreeBuffer* buffer = head;
+    head = buffer->next;
+    count--;
+    return buffer;
+  }
+};
+
+std::atomic<uint64_t> g_num_system_allocations{0};
+std::atomic<uint64_t> g_num_system_frees{0};
+
+size_t SizeForSizeClass(unsigned size_class) {
+  DCHECK_LT(size_class, kNumSizeClasses);
+  return static_cast<size_t>(1) << (kMinSizeClassLog2 + size_class);
+}
+
+unsigned SizeClassForSize(size_t size) {
+  DCHECK_GT(size, 0u);
+  if (size > MessageBufferPool::kMaxPooledBufferSize)
+    return kUnpooledSizeClass;
+  if (size <= SizeForSizeClass(0))
+    return 0;
+  // The smallest |n| such that |2^n >= size| is the number of significant bits
+  // in |size - 1|.
+  unsigned log2 = static_cast<unsigned>(
+      8 * sizeof(unsigned long long) -
+      __builtin_clzll(static_cast<unsigned long long>(size - 1)));
+  return log2 - static_cast<unsigned>(kMinSizeClassLog2);
+}
+
+size_t MaxThreadCacheCount(unsigned size_class) {
+  return std::max(kMinThreadCacheCount,
+                  std::min(kMaxThreadCacheCount,
+                           kMaxThreadCacheBytes / SizeForSizeClass(size_class)));
+}
+
+void* SystemAlloc(unsigned size_class, size_t size) {
+  g_num_system_allocations.fetch_add(1u, std::memory_order_relaxed);
+  char* raw = static_cast<char*>(RawAlignedAlloc(
+      MessageBufferPool::kAlignment, MessageBufferPool::kAlignment + size));
+  reinterpret_cast<BufferHeader*>(raw)->size_class = size_class;
+  return raw + MessageBufferPool::kAlignment;
+}
+
+void SystemFree(void* buffer) {
+  g_num_system_frees.fetch_add(1u, std::memory_order_relaxed);
+  RawAlignedFree(static_cast<char*>(buffer) - MessageBufferPool::kAlignment);
+}
+
+// The shared free lists (one for each size class). Intentionally leaked.
+class SharedCache {
+ public:
+  static SharedCache* Get() {
+    static SharedCache* cache = new SharedCache();
+    return cache;
+  }
+
+  // Moves up to |max_count| buffers from the shared free list to |list|.
+  void Take(unsigned size_class, size_t max_count, FreeList* list) {
+    Shard& shard = shards_[size_class];
+    MutexLocker locker(&shard.mutex);
+    for (size_t i = 0; i < max_count && shard.list.head; i++)
+      list->Push(shard.list.Pop());
+  }
+
+  // Moves |count| buffers from |list| to the shared free list, freeing those
+  // that don't fit.
+  void Give(unsigned size_class, size_t count, FreeList* list) {
+    const size_t max_shared_count =
+        kSharedCacheMultiplier * MaxThreadCacheCount(size_class);
+    FreeList excess;
+    {
+      Shard& shard = shards_[size_class];
+      MutexLocker locker(&shard.mutex);
+      for (size_t i = 0; i < count; i++) {
+        if (shard.list.count < max_shared_count)
+          shard.list.Push(list->Pop());
+        else
+          excess.Push(list->Pop());
+      }
+    }
+    while (excess.head)
+      SystemFree(excess.Pop());
+  }
+
+ private:
+  struct Shard {
+    Mutex mutex;
+    FreeList list MOJO_GUARDED_BY(mutex);
+  };
+
+  SharedCache() {}
+  ~SharedCache() = delete;
+
+  Shard shards_[kNumSizeClasses];
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(SharedCache);
+};
+
+// A thread's cache of free buffers.
+struct ThreadCache {
+  FreeList lists[kNumSizeClasses];
+};
+
+pthread_once_t g_thread_cache_key_once = PTHREAD_ONCE_INIT;
+pthread_key_t g_thread_cache_key;
+
+void DeleteThreadCache(void* thread_cache) {
+  ThreadCache* cache = static_cast<ThreadCache*>(thread_cache);
+  for (unsigned i = 0; i < kNumSizeClasses; i++) {
+    if (cache->lists[i].count)
+      SharedCache::Get()->Give(i, cache->lists[i].count, &cache->lists[i]);
+  }
+  delete cache;
+}
+
+void CreateThreadCacheKey() {
+  int error = pthread_key_create(&g_thread_cache_key, &DeleteThreadCache);
+  CHECK_EQ(error, 0);
+}
+
+ThreadCache* GetThreadCache() {
+  pthread_once(&g_thread_cache_key_once, &CreateThreadCacheKey);
+  ThreadCache* cache =
+      static_cast<ThreadCache*>(pthread_getspecific(g_thread_cache_key));
+  if (!cache) {
+    cache = new ThreadCache();
+    int error = pthread_setspecific(g_thread_cache_key, cache);
+    CHECK_EQ(error, 0);
+  }
+  return cache;
+}
+
+}  // namespace
+
+// static
+void* MessageBufferPool::Alloc(size_t size) {
+  unsigned size_class = SizeClassForSize(size);
+  if (size_class == kUnpooledSizeClass)
+    return SystemAlloc(size_class, size);
+
+  FreeList* list = &GetThreadCache()->lists[size_class];
+  if (!list->head) {
+    // Refill half of the thread's cache, so that the next few allocations (or
+    // frees) don't have to go to the shared cache.
+    SharedCache::Get()->Take(size_class, MaxThreadCacheCount(size_class) / 2,
+                             list);
+    if (!list->head)
+      return SystemAlloc(size_class, SizeForSizeClass(size_class));
+  }
+  return list->Pop();
+}
+
+// static
+void MessageBufferPool::Free(void* buffer) {
+  DCHECK(buffer);
+  unsigned size_class = reinterpret_cast<BufferHeader*>(
+                            static_cast<char*>(buffer) - kAlignment)
+                            ->size_class;
+  if (size_class == kUnpooledSizeClass) {
+    SystemFree(buffer);
+    return;
+  }
+  DCHECK_LT(size_class, kNumSizeClasses);
+
+  FreeList* list = &GetThreadCache()->lists[size_class];
+  list->Push(static_cast<FreeBuffer*>(buffer));
+  size_t max_count = MaxThreadCacheCount(size_class);
+  if (list->count > max_count)
+    SharedCache::Get()->Give(size_class, list->count - max_count / 2, list);
+}
+
+// static
+MessageBufferPool::Stats MessageBufferPool::GetStats() {
+  Stats stats;
+  stats.num_system_allocations =
+      g_num_system_allocations.load(std::memory_order_relaxed);
+  stats.num_system_frees = g_num_system_frees.load(std::memory_order_relaxed);
+  return stats;
+}
+
+}  // namespace system
+}  // namespace mojo
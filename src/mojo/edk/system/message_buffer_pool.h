@@ -0,0 +1,79 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_EDK_SYSTEM_MESSAGE_BUFFER_POOL_H_
+#define MOJO_EDK_SYSTEM_MESSAGE_BUFFER_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "mojo/public/cpp/system/macros.h"
+
+namespace mojo {
+namespace system {
+
+// |MessageBufferPool| is a process-wide allocator for the (short-lived) buffers
+// and objects that make up a message in transit (i.e., |MessageInTransit|s,
+// their main buffers, and |TransportData|s and their buffers). These are
+// allocated and freed at a high rate, typically on different threads (e.g., a
+// message is allocated by the writing thread and freed on the reading thread or
+// by the |RawChannel| after it has been written).
+//
+// Buffers are rounded up to a power-of-2 size class. Each thread has a small
+// cache of free buffers for each size class, which is refilled from (or spilled
+// to) a shared free list in batches, so that the common cases take no locks and
+// make no calls to the system allocator. Buffers that are too big to be pooled
+// are allocated directly.
+//
+// All buffers are aligned to |kAlignment| bytes.
+class MessageBufferPool {
+ public:
+  static const size_t kAlignment = 16;
+  // Buffers bigger than this aren't pooled.
+  static const size_t kMaxPooledBufferSize = 64 * 1024;
+
+  // Counts of calls to the system allocator. (Allocations satisfied from the
+  // pool aren't counted, so the number of messages per system allocation
+  // measures the effectiveness of the pool.)
+  struct Stats {
+    uint64_t num_system_allocations;
+    uint64_t num_system_frees;
+  };
+
+  // Deleter for buffers allocated using |Alloc()|, for use with
+  // |std::unique_ptr|.
+  struct Deleter {
+    void operator()(void* buffer) const { Free(buffer); }
+  };
+
+  // Allocates a buffer of size at least |size| (which must be nonzero). This
+  // never fails (it aborts if out of memory).
+  static void* Alloc(size_t size);
+
+  // Frees a buffer allocated using |Alloc()| (which may have been allocated on
+  // a different thread). |buffer| must be non-null.
+  static void Free(void* buffer);
+
+  // Like |Alloc()|, but returns a |std::unique_ptr| with |Deleter|.
+  static std::unique_ptr<char, Deleter> AllocBuffer(size_t size) {
+    return std::unique_ptr<char, Deleter>(static_cast<char*>(Alloc(size)));
+  }
+
+  static Stats GetStats();
+
+ private:
+  MessageBufferPool() = delete;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(MessageBufferPool);
+};
+
+// Type of a (unique) pointer to a buffer allocated from |MessageBufferPool|.
+using MessageBufferPtr = std::unique_ptr<char, MessageBufferPool::Deleter>;
+
+}  // namespace system
+}  // namespace mojo
+
+#endif  // MOJO_EDK_SYSTEM_MESSAGE_BUFFER_POOL_H_
@@ -0,0 +1,110 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mojo/edk/system/message_buffer_pool.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "mojo/edk/system/test/simple_test_thread.h"
+#include "mojo/public/cpp/system/macros.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace mojo {
+namespace system {
+namespace {
+
+TEST(MessageBufferPoolTest, Alignment) {
+  static const size_t kSizes[] = {
+      1u, 8u, 63u, 64u, 65u, 1000u, 4096u, 64u * 1024u, 64u * 1024u + 1u,
+      1024u * 1024u};
+  for (size_t i = 0; i < MOJO_ARRAYSIZE(kSizes); i++) {
+    void* buffer = MessageBufferPool::Alloc(kSizes[i]);
+    ASSERT_TRUE(buffer);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(buffer) %
+                      MessageBufferPool::kAlignment);
+    // The entire buffer should be usable.
+    memset(buffer, 'x', kSizes[i]);
+    MessageBufferPool::Free(buffer);
+  }
+}
+
+TEST(MessageBufferPoolTest, Reuse) {
+  // Prime this thread's cache.
+  void* buffer = MessageBufferPool::Alloc(100);
+  MessageBufferPool::Free(buffer);
+
+  MessageBufferPool::Stats stats = MessageBufferPool::GetStats();
+  for (size_t i = 0; i < 1000; i++) {
+    // Buffers in the same size class should be reused.
+    void* buffer2 = MessageBufferPool::Alloc(128);
+    EXPECT_EQ(buffer, buffer2);
+    MessageBufferPool::Free(buffer2);
+  }
+  EXPECT_EQ(stats.num_system_allocations,
+            MessageBufferPool::GetStats().num_system_allocations);
+  EXPECT_EQ(stats.num_system_frees,
+            MessageBufferPool::GetStats().num_system_frees);
+}
+
+TEST(MessageBufferPoolTest, Unpooled) {
+  MessageBufferPool::Stats stats = MessageBufferPool::GetStats();
+  MessageBufferPtr buffer = MessageBufferPool::AllocBuffer(
+      MessageBufferPool::kMaxPooledBufferSize + 1);
+  EXPECT_EQ(stats.num_system_allocations + 1,
+            MessageBufferPool::GetStats().num_system_allocations);
+  buffer.reset();
+  EXPECT_EQ(stats.num_system_frees + 1,
+            MessageBufferPool::GetStats().num_system_frees);
+}
+
+class FreeingThread : public test::SimpleTestThread {
+ public:
+  explicit FreeingThread(std::vector<void*>* buffers) : buffers_(buffers) {}
+  ~FreeingThread() override {}
+
+ private:
+  void Run() override {
+    for (void* buffer : *buffers_)
+      MessageBufferPool::Free(buffer);
+    buffers_->clear();
+  }
+
+  std::vector<void*>* const buffers_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(FreeingThread);
+};
+
+// Buffers freed on another thread should (mostly) make their way back to the
+// allocating thread.
+TEST(MessageBufferPoolTest, CrossThread) {
+  static const size_t kNumBuffers = 100;
+
+  std::vector<void*> buffers;
+  for (size_t i = 0; i < kNumBuffers; i++)
+    buffers.push_back(MessageBufferPool::Alloc(1000));
+
+  {
+    FreeingThread thread(&buffers);
+    thread.Start();
+    thread.Join();
+  }
+  EXPECT_TRUE(buffers.empty());
+
+  MessageBufferPool::Stats stats = MessageBufferPool::GetStats();
+  for (size_t i = 0; i < kNumBuffers; i++)
+    buffers.push_back(MessageBufferPool::Alloc(1000));
+  EXPECT_LT(MessageBufferPool::GetStats().num_system_allocations -
+                stats.num_system_allocations,
+            kNumBuffers);
+
+  for (void* buffer : buffers)
+    MessageBufferPool::Free(buffer);
+}
+
+}  // namespace
+}  // namespace system
+}  // namespace mojo
@@ -13,8 +13,6 @@
 #include "mojo/edk/system/dispatcher.h"
 #include "mojo/edk/system/transport_data.h"
 
-using mojo::platform::AlignedAlloc;
-
 namespace mojo {
 namespace system {
 
@@ -24,6 +22,9 @@ struct MessageInTransit::PrivateStructForCompileAsserts {
   // The size of |Header| must be a multiple of the alignment.
   static_assert(sizeof(Header) % kMessageAlignment == 0,
                 "sizeof(MessageInTransit::Header) invalid");
+  // Buffers from the |MessageBufferPool| must be sufficiently aligned.
+  static_assert(MessageBufferPool::kAlignment % kMessageAlignment == 0,
+                "MessageBufferPool::kAlignment insufficient");
 };
 
 MessageInTransit::View::View(size_t message_size, const void* buffer)
@@ -75,7 +76,7 @@ MessageInTransit::MessageInTransit(Type type,
                                    uint32_t num_bytes,
                                    const void* bytes)
     : main_buffer_size_(RoundUpMessageAlignment(sizeof(Header) + num_bytes)),
-      main_buffer_(AlignedAlloc<char>(kMessageAlignment, main_buffer_size_)) {
+      main_buffer_(MessageBufferPool::AllocBuffer(main_buffer_size_)) {
   ConstructorHelper(type, subtype, num_bytes);
   if (bytes) {
     memcpy(MessageInTransit::bytes(), bytes, num_bytes);
@@ -91,7 +92,7 @@ MessageInTransit::MessageInTransit(Type type,
                                    uint32_t num_bytes,
                                    UserPointer<const void> bytes)
     : main_buffer_size_(RoundUpMessageAlignment(sizeof(Header) + num_bytes)),
-      main_buffer_(AlignedAlloc<char>(kMessageAlignment, main_buffer_size_)) {
+      main_buffer_(MessageBufferPool::AllocBuffer(main_buffer_size_)) {
   ConstructorHelper(type, subtype, num_bytes);
   bytes.GetArray(MessageInTransit::bytes(), num_bytes);
   memset(static_cast<char*>(MessageInTransit::bytes()) + num_bytes, 0,
@@ -100,7 +101,7 @@ MessageInTransit::MessageInTransit(Type type,
 
 MessageInTransit::MessageInTransit(const View& message_view)
     : main_buffer_size_(message_view.main_buffer_size()),
-      main_buffer_(AlignedAlloc<char>(kMessageAlignment, main_buffer_size_)) {
+      main_buffer_(MessageBufferPool::AllocBuffer(main_buffer_size_)) {
   DCHECK_GE(main_buffer_size_, sizeof(Header));
   DCHECK_EQ(main_buffer_size_ % kMessageAlignment, 0u);
 
@@ -190,7 +191,7 @@ void MessageInTransit::ConstructorHelper(Type type,
   header()->source_id = ChannelEndpointId();
   header()->destination_id = ChannelEndpointId();
   header()->num_bytes = num_bytes;
-  header()->unused = 0;
+  header()->ack_request_id = 0;
   // Note: If handles are subsequently attached, then |total_size| will have to
   // be adjusted.
   UpdateTotalSize();
@@ -12,10 +12,10 @@
 #include <ostream>
 #include <vector>
 
-#include "mojo/edk/platform/aligned_alloc.h"
 #include "mojo/edk/system/channel_endpoint_id.h"
 #include "mojo/edk/system/handle.h"
 #include "mojo/edk/system/memory.h"
+#include "mojo/edk/system/message_buffer_pool.h"
 #include "mojo/public/cpp/system/macros.h"
 
 namespace mojo {
@@ -66,8 +66,28 @@ class MessageInTransit {
     // Data pipe: consumer -> producer message that data was consumed. Payload
     // is |RemoteDataPipeAck|.
     ENDPOINT_CLIENT_DATA_PIPE_ACK = 1,
+    // Data pipe (using a shared memory ring buffer): producer -> consumer
+    // message that data was written to the ring buffer. Payload is
+    // |RemoteDataPipeWrite|.
+    ENDPOINT_CLIENT_DATA_PIPE_WRITE = 2,
+    // Messages between the two |ChannelEndpoint|s that are establishing a
+    // direct route (bypassing an |EndpointRelayer|; see
+    // |ChannelEndpoint::RequestBypass()|). These are consumed by the
+    // |ChannelEndpoint| taking part in the bypass with the given connection ID
+    // (and passed on by relayers). Payload is |ChannelEndpointBypassData|.
+    ENDPOINT_CLIENT_BYPASS_ALLOWED = 3,
+    ENDPOINT_CLIENT_BYPASS_CANCEL = 4,
+    ENDPOINT_CLIENT_BYPASS_ATTACH = 5,
+    ENDPOINT_CLIENT_BYPASS_SWITCH = 6,
+    // Message pipe: reader -> writer message that a message that requested an
+    // acknowledgement (see |MessageInTransit::ack_request_id()|) was read.
+    // Payload is |RemoteMessagePipeAck|.
+    ENDPOINT_CLIENT_MESSAGE_PIPE_ACK = 7,
     // Subtypes for type |Type::ENDPOINT|:
-    // TODO(vtl): Nothing yet.
+    // Sent by a |ChannelEndpoint| whose client is an |EndpointRelayer| to ask
+    // the remote endpoint to connect directly to the other side of the relayer.
+    // Payload is |ChannelEndpointBypassData|.
+    ENDPOINT_BYPASS_REQUEST = 0,
     // Subtypes for type |Type::CHANNEL|:
     CHANNEL_ATTACH_AND_RUN_ENDPOINT = 0,
     CHANNEL_REMOVE_ENDPOINT = 1,
@@ -172,6 +192,12 @@ class MessageInTransit {
 
   ~MessageInTransit();
 
+  // |MessageInTransit|s are allocated from the |MessageBufferPool|.
+  static void* operator new(size_t size) {
+    return MessageBufferPool::Alloc(size);
+  }
+  static void operator delete(void* ptr) { MessageBufferPool::Free(ptr); }
+
   // Gets the size of the next message from |buffer|, which has |buffer_size|
   // bytes currently available, returning true and setting |*next_message_size|
   // on success. |buffer| should be aligned on a |kMessageAlignment| boundary
@@ -229,6 +255,13 @@ class MessageInTransit {
     header()->destination_id = destination_id;
   }
 
+  // For message pipe data messages: If nonzero, the reader should acknowledge
+  // (to the writer) having read this message (see |MessagePipe|).
+  uint32_t ack_request_id() const { return header()->ack_request_id; }
+  void set_ack_request_id(uint32_t ack_request_id) {
+    header()->ack_request_id = ack_request_id;
+  }
+
   // Gets the handles attached to this message; this may return null if there
   // are none. Note that the caller may mutate the set of handles (e.g., take
   // ownership of all the handles, leaving the vector empty).
@@ -261,7 +294,8 @@ class MessageInTransit {
     ChannelEndpointId destination_id;  // 4 bytes.
     // Size of actual message data.
     uint32_t num_bytes;
-    uint32_t unused;
+    // See |ack_request_id()|.
+    uint32_t ack_request_id;
   };
 
   const Header* header() const {
@@ -274,7 +308,7 @@ class MessageInTransit {
 
   const size_t main_buffer_size_;
   // Never null.
-  const platform::AlignedUniquePtr<char> main_buffer_;
+  const MessageBufferPtr main_buffer_;
 
   std::unique_ptr<TransportData> transport_data_;  // May be null.
 
@@ -37,6 +37,10 @@ class MessageInTransitQueue {
   const MessageInTransit* PeekMessage() const { return queue_.front(); }
   MessageInTransit* PeekMessage() { return queue_.front(); }
 
+  // Like |PeekMessage()|, but gets the |i|-th message (the front message being
+  // the 0-th); |i| must be less than |Size()|.
+  const MessageInTransit* PeekMessageAt(size_t i) const { return queue_[i]; }
+
   void DiscardMessage() {
     delete queue_.front();
     queue_.pop_front();
@@ -4,10 +4,13 @@
 
 #include "mojo/edk/system/message_pipe.h"
 
+#include <algorithm>
 #include <memory>
 #include <utility>
 
 #include "base/logging.h"
+#include "mojo/edk/embedder/ipc_stats.h"
+#include "mojo/edk/platform/thread_utils.h"
 #include "mojo/edk/system/channel.h"
 #include "mojo/edk/system/channel_endpoint.h"
 #include "mojo/edk/system/channel_endpoint_id.h"
@@ -15,12 +18,16 @@
 #include "mojo/edk/system/incoming_endpoint.h"
 #include "mojo/edk/system/local_message_pipe_endpoint.h"
 #include "mojo/edk/system/message_in_transit.h"
+#include "mojo/edk/system/message_in_transit_queue.h"
 #include "mojo/edk/system/message_pipe_dispatcher.h"
 #include "mojo/edk/system/message_pipe_endpoint.h"
 #include "mojo/edk/system/proxy_message_pipe_endpoint.h"
+#include "mojo/edk/system/reclaimer.h"
+#include "mojo/edk/system/remote_message_pipe_ack.h"
 #include "mojo/edk/util/make_unique.h"
 
 using mojo::platform::ScopedPlatformHandle;
+using mojo::platform::ThreadYield;
 using mojo::util::MakeRefCounted;
 using mojo::util::MakeUnique;
 using mojo::util::MutexLocker;
@@ -29,12 +36,23 @@ using mojo::util::RefPtr;
 namespace mojo {
 namespace system {
 
+namespace {
+
+// Bits of |MessagePipe::queue_states_[port]|.
+const uint32_t kQueueLockFree = 1u << 0;
+const uint32_t kQueueProducer = 1u << 1;
+const uint32_t kQueueConsumer = 1u << 2;
+
+}  // namespace
+
 // static
 RefPtr<MessagePipe> MessagePipe::CreateLocalLocal()
     MOJO_NO_THREAD_SAFETY_ANALYSIS {
   RefPtr<MessagePipe> message_pipe = AdoptRef(new MessagePipe());
   message_pipe->endpoints_[0].reset(new LocalMessagePipeEndpoint());
   message_pipe->endpoints_[1].reset(new LocalMessagePipeEndpoint());
+  message_pipe->EnableLockFreeQueueNoLock(0);
+  message_pipe->EnableLockFreeQueueNoLock(1);
   return message_pipe;
 }
 
@@ -44,6 +62,7 @@ RefPtr<MessagePipe> MessagePipe::CreateLocalProxy(
   DCHECK(!*channel_endpoint);  // Not technically wrong, but unlikely.
   RefPtr<MessagePipe> message_pipe = AdoptRef(new MessagePipe());
   message_pipe->endpoints_[0].reset(new LocalMessagePipeEndpoint());
+  message_pipe->EnableLockFreeQueueNoLock(0);
   *channel_endpoint = MakeRefCounted<ChannelEndpoint>(message_pipe.Clone(), 1);
   message_pipe->endpoints_[1].reset(
       new ProxyMessagePipeEndpoint(channel_endpoint->Clone()));
@@ -55,9 +74,20 @@ RefPtr<MessagePipe> MessagePipe::CreateLocalProxyFromExisting(
     MessageInTransitQueue* message_queue,
     RefPtr<ChannelEndpoint>&& channel_endpoint) MOJO_NO_THREAD_SAFETY_ANALYSIS {
   DCHECK(message_queue);
+  // Only data messages are for the local endpoint: acknowledgements are for
+  // messages written by the endpoint's previous incarnation, which took its
+  // flow control state with it.
+  MessageInTransitQueue data_messages;
+  while (!message_queue->IsEmpty()) {
+    std::unique_ptr<MessageInTransit> message = message_queue->GetMessage();
+    if (message->subtype() == MessageInTransit::Subtype::ENDPOINT_CLIENT_DATA)
+      data_messages.AddMessage(std::move(message));
+  }
+
   RefPtr<MessagePipe> message_pipe = AdoptRef(new MessagePipe());
   message_pipe->endpoints_[0].reset(
-      new LocalMessagePipeEndpoint(message_queue));
+      new LocalMessagePipeEndpoint(&data_messages));
+  message_pipe->EnableLockFreeQueueNoLock(0);
   if (channel_endpoint) {
     bool attached_to_channel = channel_endpoint->ReplaceClient(message_pipe, 1);
     message_pipe->endpoints_[1].reset(
@@ -83,6 +113,7 @@ RefPtr<MessagePipe> MessagePipe::CreateProxyLocal(
   message_pipe->endpoints_[0].reset(
       new ProxyMessagePipeEndpoint(channel_endpoint->Clone()));
   message_pipe->endpoints_[1].reset(new LocalMessagePipeEndpoint());
+  message_pipe->EnableLockFreeQueueNoLock(1);
   return message_pipe;
 }
 
@@ -124,6 +155,47 @@ MessagePipeEndpoint::Type MessagePipe::GetType(unsigned port) {
   return endpoints_[port]->GetType();
 }
 
+void MessagePipe::GetQueueLimits(uint32_t* max_queued_messages,
+                                 uint32_t* max_queued_num_bytes) const {
+  *max_queued_messages = max_queued_messages_.load(std::memory_order_relaxed);
+  *max_queued_num_bytes = max_queued_num_bytes_.load(std::memory_order_relaxed);
+}
+
+void MessagePipe::SetQueueLimits(uint32_t max_queued_messages,
+                                 uint32_t max_queued_num_bytes) {
+  max_queued_messages_.store(max_queued_messages, std::memory_order_relaxed);
+  max_queued_num_bytes_.store(max_queued_num_bytes, std::memory_order_relaxed);
+
+  MutexLocker locker(&mutex_);
+  UpdateWritableNoLock(0);
+  UpdateWritableNoLock(1);
+}
+
+void MessagePipe::GetStats(unsigned port,
+                           embedder::MessagePipeStats* stats) const {
+  DCHECK(port == 0 || port == 1);
+
+  *stats = embedder::MessagePipeStats();
+  const WriteCounts& write_counts = write_counts_[port];
+  stats->num_messages_written =
+      write_counts.num_messages.load(std::memory_order_relaxed);
+  stats->num_bytes_written =
+      write_counts.num_bytes.load(std::memory_order_relaxed);
+  stats->num_handles_written =
+      write_counts.num_handles.load(std::memory_order_relaxed);
+
+  MutexLocker locker(&mutex_);
+  DCHECK(endpoints_[port]);
+  if (endpoints_[port]->GetType() != MessagePipeEndpoint::kTypeLocal)
+    return;
+  const LocalMessagePipeEndpoint* endpoint =
+      static_cast<const LocalMessagePipeEndpoint*>(endpoints_[port].get());
+  endpoint->GetReadStats(&stats->num_messages_read, &stats->num_bytes_read,
+                         &stats->num_handles_read);
+  stats->num_messages_queued = endpoint->GetNumQueuedMessages();
+  stats->num_bytes_queued = endpoint->GetNumQueuedBytes();
+}
+
 void MessagePipe::CancelAllState(unsigned port) {
   MutexLocker locker(&mutex_);
   CancelAllStateNoLock(port);
@@ -134,18 +206,39 @@ void MessagePipe::Close(unsigned port) {
 
   unsigned peer_port = GetPeerPort(port);
 
-  MutexLocker locker(&mutex_);
-  // The endpoint's |OnPeerClose()| may have been called first and returned
-  // false, which would have resulted in its destruction.
-  if (!endpoints_[port])
-    return;
+  // Messages left in the queue are destroyed after releasing |mutex_|, since
+  // that closes the dispatchers attached to them (which takes their locks), and
+  // a dispatcher moved into a message (see |AttachTransportsNoLock()|) was
+  // locked before |mutex_| when it was sent.
+  MessageInTransitQueue messages;
+  {
+    MutexLocker locker(&mutex_);
+    // The endpoint's |OnPeerClose()| may have been called first and returned
+    // false, which would have resulted in its destruction.
+    if (!endpoints_[port])
+      return;
+
+    DisableLockFreeQueueNoLock(port);
+    if (endpoints_[port]->GetType() == MessagePipeEndpoint::kTypeLocal) {
+      static_cast<LocalMessagePipeEndpoint*>(endpoints_[port].get())
+          ->TakeMessages(&messages);
+    }
+    endpoints_[port]->Close();
+    if (endpoints_[peer_port]) {
+      if (!endpoints_[peer_port]->OnPeerClose()) {
+        DisableLockFreeQueueNoLock(peer_port);
+        endpoints_[peer_port].reset();
+      }
+    }
+    endpoints_[port].reset();
+  }
 
-  endpoints_[port]->Close();
-  if (endpoints_[peer_port]) {
-    if (!endpoints_[peer_port]->OnPeerClose())
-      endpoints_[peer_port].reset();
+  // As in |LocalMessagePipeEndpoint::Close()|, let the reclaimer destroy them
+  // if there is one. (Otherwise, they're destroyed along with |messages|.)
+  if (!messages.IsEmpty()) {
+    if (Reclaimer* reclaimer = Reclaimer::Get())
+      reclaimer->ReclaimMessages(&messages);
   }
-  endpoints_[port].reset();
 }
 
 // TODO(vtl): Handle flags.
@@ -156,13 +249,54 @@ MojoResult MessagePipe::WriteMessage(unsigned port,
                                      MojoWriteMessageFlags flags) {
   DCHECK(port == 0 || port == 1);
 
+  unsigned peer_port = GetPeerPort(port);
+  std::unique_ptr<MessageInTransit> message(MakeUnique<MessageInTransit>(
+      MessageInTransit::Type::ENDPOINT_CLIENT,
+      MessageInTransit::Subtype::ENDPOINT_CLIENT_DATA, num_bytes, bytes));
+
+  // Fast path: A message without handles to a local endpoint.
+  if (!transports && TryAcquireQueue(peer_port, kQueueProducer)) {
+    LocalMessagePipeEndpoint* peer_endpoint = local_endpoints_[peer_port];
+    // Only we add messages, so the queue can't become full behind our back
+    // (but it may become not full, in which case the consumer will update our
+    // writability).
+    if (IsLocalQueueFull(peer_endpoint)) {
+      ReleaseQueue(peer_port, kQueueProducer);
+      return MOJO_RESULT_SHOULD_WAIT;
+    }
+    bool should_awake =
+        peer_endpoint->EnqueueMessageNoAwake(std::move(message));
+    bool is_full = IsLocalQueueFull(peer_endpoint);
+    ReleaseQueue(peer_port, kQueueProducer);
+    CountWrite(port, num_bytes, 0);
+    if (should_awake || is_full) {
+      MutexLocker locker(&mutex_);
+      // The peer may have been closed (or serialized) in the meantime, in which
+      // case its awakables will have been dealt with.
+      if (should_awake && local_endpoints_[peer_port])
+        local_endpoints_[peer_port]->AwakeForNewMessages();
+      if (is_full)
+        UpdateWritableNoLock(port);
+    }
+    return MOJO_RESULT_OK;
+  }
+
   MutexLocker locker(&mutex_);
-  return EnqueueMessageNoLock(
-      GetPeerPort(port),
-      MakeUnique<MessageInTransit>(
-          MessageInTransit::Type::ENDPOINT_CLIENT,
-          MessageInTransit::Subtype::ENDPOINT_CLIENT_DATA, num_bytes, bytes),
-      transports);
+  // If the peer is closed, |EnqueueMessageNoLock()| will fail (and that takes
+  // precedence).
+  if (endpoints_[peer_port]) {
+    if (IsPeerQueueFullNoLock(port))
+      return MOJO_RESULT_SHOULD_WAIT;
+    if (endpoints_[peer_port]->GetType() == MessagePipeEndpoint::kTypeProxy)
+      OnWriteToRemoteNoLock(port, message.get());
+  }
+  MojoResult result =
+      EnqueueMessageNoLock(peer_port, std::move(message), transports);
+  if (result == MOJO_RESULT_OK) {
+    UpdateWritableNoLock(port);
+    CountWrite(port, num_bytes, transports ? transports->size() : 0);
+  }
+  return result;
 }
 
 MojoResult MessagePipe::ReadMessage(unsigned port,
@@ -173,11 +307,39 @@ MojoResult MessagePipe::ReadMessage(unsigned port,
                                     MojoReadMessageFlags flags) {
   DCHECK(port == 0 || port == 1);
 
-  MutexLocker locker(&mutex_);
-  DCHECK(endpoints_[port]);
+  return ReadMessageImpl(port, [&](LocalMessagePipeEndpoint* endpoint) {
+    return endpoint->ReadMessage(bytes, num_bytes, handles, num_handles, flags);
+  });
+}
+
+MojoResult MessagePipe::BeginReadMessage(unsigned port,
+                                         UserPointer<void*> buffer,
+                                         UserPointer<uint32_t> buffer_num_bytes,
+                                         HandleVector* handles,
+                                         uint32_t* num_handles,
+                                         MojoReadMessageFlags flags) {
+  DCHECK(port == 0 || port == 1);
+
+  return ReadMessageImpl(port, [&](LocalMessagePipeEndpoint* endpoint) {
+    return endpoint->BeginReadMessage(buffer, buffer_num_bytes, handles,
+                                      num_handles, flags);
+  });
+}
+
+MojoResult MessagePipe::EndReadMessage(unsigned port) {
+  DCHECK(port == 0 || port == 1);
 
-  return endpoints_[port]->ReadMessage(bytes, num_bytes, handles, num_handles,
-                                       flags);
+  MojoResult rv;
+  if (TryAcquireQueue(port, kQueueConsumer)) {
+    rv = local_endpoints_[port]->EndReadMessage();
+  } else {
+    MutexLocker locker(&mutex_);
+    DCHECK(endpoints_[port]);
+    AcquireQueueNoLock(port, kQueueConsumer);
+    rv = endpoints_[port]->EndReadMessage();
+  }
+  ReleaseQueue(port, kQueueConsumer);
+  return rv;
 }
 
 HandleSignalsState MessagePipe::GetHandleSignalsState(unsigned port) const {
@@ -189,6 +351,19 @@ HandleSignalsState MessagePipe::GetHandleSignalsState(unsigned port) const {
   return endpoints_[port]->GetHandleSignalsState();
 }
 
+bool MessagePipe::TryGetHandleSignalsState(unsigned port,
+                                           HandleSignalsState* signals_state) {
+  DCHECK(port == 0 || port == 1);
+
+  // The consumer bit keeps |local_endpoints_[port]| from being closed or
+  // replaced while we look at it.
+  if (!TryAcquireQueue(port, kQueueConsumer))
+    return false;
+  *signals_state = local_endpoints_[port]->GetHandleSignalsState();
+  ReleaseQueue(port, kQueueConsumer);
+  return true;
+}
+
 MojoResult MessagePipe::AddAwakable(unsigned port,
                                     Awakable* awakable,
                                     MojoHandleSignals signals,
@@ -250,9 +425,11 @@ bool MessagePipe::EndSerialize(
   DCHECK_EQ(endpoints_[port]->GetType(), MessagePipeEndpoint::kTypeLocal);
 
   unsigned peer_port = GetPeerPort(port);
-  MessageInTransitQueue* message_queue =
-      static_cast<LocalMessagePipeEndpoint*>(endpoints_[port].get())
-          ->message_queue();
+  DisableLockFreeQueueNoLock(port);
+  MessageInTransitQueue message_queue_storage;
+  MessageInTransitQueue* message_queue = &message_queue_storage;
+  static_cast<LocalMessagePipeEndpoint*>(endpoints_[port].get())
+      ->TakeMessages(message_queue);
   // The replacement for |endpoints_[port]|, if any.
   MessagePipeEndpoint* replacement_endpoint = nullptr;
 
@@ -273,6 +450,9 @@ bool MessagePipe::EndSerialize(
             port);
     replacement_endpoint =
         new ProxyMessagePipeEndpoint(std::move(channel_endpoint));
+    // The peer port now writes to a remote queue (starting afresh, since the
+    // messages queued here go with |port|).
+    remote_queue_states_[peer_port] = RemoteQueueState();
   } else {
     // Case 3: remote peer port. We get the |peer_port|'s |ChannelEndpoint| and
     // pass it to the |Channel|. There's no reason for us to continue to exist
@@ -286,11 +466,14 @@ bool MessagePipe::EndSerialize(
     channel->SerializeEndpointWithRemotePeer(destination, message_queue,
                                              std::move(peer_channel_endpoint));
     // No need to call |Close()| after |ReleaseChannelEndpoint()|.
+    DisableLockFreeQueueNoLock(peer_port);
     endpoints_[peer_port].reset();
   }
 
   endpoints_[port]->Close();
   endpoints_[port].reset(replacement_endpoint);
+  if (endpoints_[peer_port])
+    UpdateWritableNoLock(peer_port);
 
   *actual_size = channel->GetSerializedEndpointSize();
   return true;
@@ -318,9 +501,20 @@ bool MessagePipe::OnReadMessage(unsigned port, MessageInTransit* message) {
   // This is called when the |ChannelEndpoint| for the
   // |ProxyMessagePipeEndpoint| |port| receives a message (from the |Channel|).
   // We need to pass this message on to its peer port (typically a
-  // |LocalMessagePipeEndpoint|).
+  // |LocalMessagePipeEndpoint|), unless it's an acknowledgement of messages
+  // written by the peer port.
+  unsigned peer_port = GetPeerPort(port);
+  if (message->subtype() ==
+          MessageInTransit::Subtype::ENDPOINT_CLIENT_MESSAGE_PIPE_ACK &&
+      endpoints_[peer_port] &&
+      endpoints_[peer_port]->GetType() == MessagePipeEndpoint::kTypeLocal) {
+    std::unique_ptr<MessageInTransit> owned_message(message);
+    OnAckNoLock(peer_port, *owned_message);
+    return true;
+  }
+
   MojoResult result = EnqueueMessageNoLock(
-      GetPeerPort(port), std::unique_ptr<MessageInTransit>(message), nullptr);
+      peer_port, std::unique_ptr<MessageInTransit>(message), nullptr);
   DLOG_IF(WARNING, result != MOJO_RESULT_OK)
       << "EnqueueMessageNoLock() failed (result  = " << result << ")";
   return true;
@@ -330,7 +524,19 @@ void MessagePipe::OnDetachFromChannel(unsigned port) {
   Close(port);
 }
 
-MessagePipe::MessagePipe() {}
+MessagePipe::MessagePipe() {
+  for (unsigned port = 0; port < 2; port++) {
+    queue_states_[port] = 0u;
+    local_endpoints_[port] = nullptr;
+  }
+
+  MojoCreateMessagePipeOptions default_options = {};
+  MojoResult result = MessagePipeDispatcher::ValidateCreateOptions(
+      NullUserPointer(), &default_options);
+  DCHECK_EQ(result, MOJO_RESULT_OK);
+  max_queued_messages_ = default_options.max_queued_messages;
+  max_queued_num_bytes_ = default_options.max_queued_num_bytes;
+}
 
 MessagePipe::~MessagePipe() {
   // Owned by the dispatchers. The owning dispatchers should only release us via
@@ -361,7 +567,9 @@ MojoResult MessagePipe::EnqueueMessageNoLock(
   }
 
   // The endpoint's |EnqueueMessage()| may not report failure.
+  AcquireQueueNoLock(port, kQueueProducer);
   endpoints_[port]->EnqueueMessage(std::move(message));
+  ReleaseQueue(port, kQueueProducer);
   return MOJO_RESULT_OK;
 }
 
@@ -371,6 +579,11 @@ MojoResult MessagePipe::AttachTransportsNoLock(
     std::vector<HandleTransport>* transports) {
   DCHECK(!message->has_handles());
 
+  // If the destination is local, the message goes straight into its queue, so
+  // we can try to move the dispatchers into it instead of cloning them.
+  bool is_local =
+      endpoints_[port]->GetType() == MessagePipeEndpoint::kTypeLocal;
+
   // Clone the handles and attach them to the message. (This must be done as a
   // separate loop, since we want to leave the handles alone on failure.)
   std::unique_ptr<HandleVector> handles(new HandleVector());
@@ -378,7 +591,10 @@ MojoResult MessagePipe::AttachTransportsNoLock(
   for (size_t i = 0; i < transports->size(); i++) {
     if ((*transports)[i].is_valid()) {
       handles->push_back(
-          transports->at(i).CreateEquivalentHandleAndClose(this, port));
+          is_local
+              ? transports->at(i).TransferHandleOrCreateEquivalentAndClose(
+                    this, port)
+              : transports->at(i).CreateEquivalentHandleAndClose(this, port));
     } else {
       LOG(WARNING) << "Enqueueing null dispatcher";
       handles->push_back(Handle());
@@ -388,5 +604,235 @@ MojoResult MessagePipe::AttachTransportsNoLock(
   return MOJO_RESULT_OK;
 }
 
+template <typename ReadFunction>
+MojoResult MessagePipe::ReadMessageImpl(unsigned port,
+                                        const ReadFunction& read_function) {
+  // Whether the queue went from full to not full, and the message's request
+  // for acknowledgement (if any); these need |mutex_| to deal with, so are
+  // dealt with after releasing the consumer bit.
+  bool drained = false;
+  uint32_t ack_request_id = 0;
+  // A discarded message must be destroyed after releasing |mutex_| (see
+  // |Close()|), so this is declared before the |MutexLocker|s below.
+  std::unique_ptr<MessageInTransit> discarded_message;
+  MojoResult rv;
+  if (TryAcquireQueue(port, kQueueConsumer)) {
+    LocalMessagePipeEndpoint* endpoint = local_endpoints_[port];
+    rv = read_function(endpoint);
+    drained = TakeLocalQueueDrained(endpoint);
+    ack_request_id = endpoint->TakeAckRequestId();
+    discarded_message = endpoint->TakeDiscardedMessage();
+    ReleaseQueue(port, kQueueConsumer);
+    if (!drained && !ack_request_id)
+      return rv;
+
+    MutexLocker locker(&mutex_);
+    OnMessageConsumedNoLock(port, drained, ack_request_id);
+    return rv;
+  }
+
+  MutexLocker locker(&mutex_);
+  DCHECK(endpoints_[port]);
+  DCHECK_EQ(endpoints_[port]->GetType(), MessagePipeEndpoint::kTypeLocal);
+  LocalMessagePipeEndpoint* endpoint =
+      static_cast<LocalMessagePipeEndpoint*>(endpoints_[port].get());
+  AcquireQueueNoLock(port, kQueueConsumer);
+  rv = read_function(endpoint);
+  drained = TakeLocalQueueDrained(endpoint);
+  ack_request_id = endpoint->TakeAckRequestId();
+  discarded_message = endpoint->TakeDiscardedMessage();
+  ReleaseQueue(port, kQueueConsumer);
+  if (drained || ack_request_id)
+    OnMessageConsumedNoLock(port, drained, ack_request_id);
+  return rv;
+}
+
+bool MessagePipe::IsQueueFull(uint64_t num_messages, uint64_t num_bytes) const {
+  uint32_t max_messages = max_queued_messages_.load(std::memory_order_relaxed);
+  uint32_t max_num_bytes =
+      max_queued_num_bytes_.load(std::memory_order_relaxed);
+  return (max_messages && num_messages >= max_messages) ||
+         (max_num_bytes && num_bytes >= max_num_bytes);
+}
+
+bool MessagePipe::IsLocalQueueFull(
+    const LocalMessagePipeEndpoint* endpoint) const {
+  return IsQueueFull(endpoint->GetNumQueuedMessages(),
+                     endpoint->GetNumQueuedBytes());
+}
+
+bool MessagePipe::TakeLocalQueueDrained(
+    LocalMessagePipeEndpoint* endpoint) const {
+  uint32_t removed_num_bytes = 0;
+  if (!endpoint->TakeRemovedMessageNumBytes(&removed_num_bytes))
+    return false;
+
+  // Note: The producer may have added messages since the removal (but only we
+  // remove messages), so this may overestimate the queue's size just before the
+  // removal. That's fine: a spurious "drained" just means that we take |mutex_|
+  // and recompute writability unnecessarily. What we mustn't do is compare
+  // against a sample taken before the read, since the producer may fill the
+  // queue (and mark itself not writable) in between.
+  uint64_t num_messages = endpoint->GetNumQueuedMessages();
+  uint64_t num_bytes = endpoint->GetNumQueuedBytes();
+  return IsQueueFull(num_messages + 1, num_bytes + removed_num_bytes) &&
+         !IsQueueFull(num_messages, num_bytes);
+}
+
+bool MessagePipe::IsPeerQueueFullNoLock(unsigned port) const {
+  mutex_.AssertHeld();
+  const MessagePipeEndpoint* peer_endpoint =
+      endpoints_[GetPeerPort(port)].get();
+  if (!peer_endpoint)
+    return false;
+  if (peer_endpoint->GetType() == MessagePipeEndpoint::kTypeLocal) {
+    return IsLocalQueueFull(
+        static_cast<const LocalMessagePipeEndpoint*>(peer_endpoint));
+  }
+  const RemoteQueueState& state = remote_queue_states_[port];
+  return IsQueueFull(state.num_messages_written - state.num_messages_acked,
+                     state.num_bytes_written - state.num_bytes_acked);
+}
+
+void MessagePipe::UpdateWritableNoLock(unsigned port) {
+  mutex_.AssertHeld();
+  if (!endpoints_[port] ||
+      endpoints_[port]->GetType() != MessagePipeEndpoint::kTypeLocal)
+    return;
+  static_cast<LocalMessagePipeEndpoint*>(endpoints_[port].get())
+      ->SetPeerQueueFull(IsPeerQueueFullNoLock(port));
+}
+
+void MessagePipe::OnMessageConsumedNoLock(unsigned port,
+                                          bool drained,
+                                          uint32_t ack_request_id) {
+  mutex_.AssertHeld();
+  unsigned peer_port = GetPeerPort(port);
+  if (!endpoints_[port] || !endpoints_[peer_port])
+    return;
+
+  if (endpoints_[peer_port]->GetType() == MessagePipeEndpoint::kTypeLocal) {
+    if (drained)
+      UpdateWritableNoLock(peer_port);
+    return;
+  }
+
+  if (ack_request_id) {
+    RemoteMessagePipeAck ack = {ack_request_id};
+    endpoints_[peer_port]->EnqueueMessage(MakeUnique<MessageInTransit>(
+        MessageInTransit::Type::ENDPOINT_CLIENT,
+        MessageInTransit::Subtype::ENDPOINT_CLIENT_MESSAGE_PIPE_ACK,
+        static_cast<uint32_t>(sizeof(ack)), &ack));
+  }
+}
+
+void MessagePipe::OnWriteToRemoteNoLock(unsigned port,
+                                        MessageInTransit* message) {
+  mutex_.AssertHeld();
+  RemoteQueueState& state = remote_queue_states_[port];
+  state.num_messages_written++;
+  state.num_bytes_written += message->num_bytes();
+
+  // Request an acknowledgement if this message half fills the peer's queue and
+  // none is outstanding (so that acknowledgements usually arrive before the
+  // queue is full), or if it fills the queue (so that we'll learn when it
+  // drains).
+  uint64_t num_unacked_messages =
+      state.num_messages_written - state.num_messages_acked;
+  uint64_t num_unacked_bytes = state.num_bytes_written - state.num_bytes_acked;
+  if (!IsQueueFull(2 * num_unacked_messages, 2 * num_unacked_bytes))
+    return;
+  if (!state.ack_requests.empty() &&
+      !IsQueueFull(num_unacked_messages, num_unacked_bytes))
+    return;
+
+  uint32_t id = state.next_ack_request_id++;
+  if (!state.next_ack_request_id)
+    state.next_ack_request_id = 1;
+  message->set_ack_request_id(id);
+  state.ack_requests.push_back(
+      {id, state.num_messages_written, state.num_bytes_written});
+}
+
+void MessagePipe::OnAckNoLock(unsigned port, const MessageInTransit& message) {
+  mutex_.AssertHeld();
+  if (message.num_bytes() != sizeof(RemoteMessagePipeAck)) {
+    LOG(WARNING) << "Incorrect message size: " << message.num_bytes()
+                 << " bytes (expected: " << sizeof(RemoteMessagePipeAck)
+                 << " bytes)";
+    return;
+  }
+  uint32_t id = static_cast<const RemoteMessagePipeAck*>(message.bytes())
+                    ->ack_request_id;
+
+  // Unknown IDs may legitimately arrive (e.g., for messages written before the
+  // peer was transferred), and are ignored.
+  RemoteQueueState& state = remote_queue_states_[port];
+  auto it = std::find_if(
+      state.ack_requests.begin(), state.ack_requests.end(),
+      [id](const AckRequest& request) { return request.id == id; });
+  if (it == state.ack_requests.end())
+    return;
+
+  state.num_messages_acked = it->num_messages_written;
+  state.num_bytes_acked = it->num_bytes_written;
+  state.ack_requests.erase(state.ack_requests.begin(), it + 1);
+  UpdateWritableNoLock(port);
+}
+
+void MessagePipe::CountWrite(unsigned port,
+                             uint32_t num_bytes,
+                             size_t num_handles) {
+  WriteCounts& write_counts = write_counts_[port];
+  write_counts.num_messages.fetch_add(1, std::memory_order_relaxed);
+  write_counts.num_bytes.fetch_add(num_bytes, std::memory_order_relaxed);
+  if (num_handles)
+    write_counts.num_handles.fetch_add(num_handles, std::memory_order_relaxed);
+}
+
+bool MessagePipe::TryAcquireQueue(unsigned port, uint32_t bit) {
+  uint32_t state = queue_states_[port].load(std::memory_order_relaxed);
+  do {
+    if (!(state & kQueueLockFree) || (state & bit))
+      return false;
+  } while (!queue_states_[port].compare_exchange_weak(
+      state, state | bit, std::memory_order_acquire,
+      std::memory_order_relaxed));
+  return true;
+}
+
+void MessagePipe::AcquireQueueNoLock(unsigned port, uint32_t bit) {
+  mutex_.AssertHeld();
+  // Other holders of |bit| must be on the fast path, which is short (and never
+  // waits for anything).
+  while (queue_states_[port].fetch_or(bit, std::memory_order_acquire) & bit)
+    ThreadYield();
+}
+
+void MessagePipe::ReleaseQueue(unsigned port, uint32_t bit) {
+  DCHECK(queue_states_[port].load(std::memory_order_relaxed) & bit);
+  queue_states_[port].fetch_and(~bit, std::memory_order_release);
+}
+
+void MessagePipe::EnableLockFreeQueueNoLock(unsigned port) {
+  DCHECK(endpoints_[port]);
+  DCHECK_EQ(endpoints_[port]->GetType(), MessagePipeEndpoint::kTypeLocal);
+  DCHECK(!local_endpoints_[port]);
+  local_endpoints_[port] =
+      static_cast<LocalMessagePipeEndpoint*>(endpoints_[port].get());
+  queue_states_[port].fetch_or(kQueueLockFree, std::memory_order_release);
+}
+
+void MessagePipe::DisableLockFreeQueueNoLock(unsigned port) {
+  if (!(queue_states_[port].fetch_and(~kQueueLockFree,
+                                      std::memory_order_relaxed) &
+        kQueueLockFree))
+    return;
+  while (queue_states_[port].load(std::memory_order_acquire) &
+         (kQueueProducer | kQueueConsumer))
+    ThreadYield();
+  local_endpoints_[port] = nullptr;
+}
+
 }  // namespace system
 }  // namespace mojo
@@ -8,6 +8,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <atomic>
+#include <deque>
 #include <memory>
 #include <vector>
 
@@ -28,11 +30,17 @@
 #include "mojo/public/cpp/system/macros.h"
 
 namespace mojo {
+
+namespace embedder {
+struct MessagePipeStats;
+}
+
 namespace system {
 
 class Awakable;
 class Channel;
 class ChannelEndpoint;
+class LocalMessagePipeEndpoint;
 class MessageInTransitQueue;
 
 // |MessagePipe| is the secondary object implementing a message pipe (see the
@@ -81,6 +89,20 @@ class MessagePipe final : public ChannelEndpointClient {
   // Gets the type of the endpoint (used for assertions, etc.).
   MessagePipeEndpoint::Type GetType(unsigned port);
 
+  // Sets the maximum number of messages and total number of bytes of message
+  // data that may be queued at each port (zero meaning no limit); see
+  // |MojoCreateMessagePipeOptions|. Writing to a port whose queue is full fails
+  // with |MOJO_RESULT_SHOULD_WAIT|. (A newly-created message pipe has the
+  // default limits from the |embedder::Configuration|.)
+  void SetQueueLimits(uint32_t max_queued_messages,
+                      uint32_t max_queued_num_bytes);
+  void GetQueueLimits(uint32_t* max_queued_messages,
+                      uint32_t* max_queued_num_bytes) const;
+
+  // Gets statistics for the given port (see |embedder::GetMessagePipeStats()|).
+  // The port |port| must be open.
+  void GetStats(unsigned port, embedder::MessagePipeStats* stats) const;
+
   // These are called by the dispatcher to implement its methods of
   // corresponding names. In all cases, the port |port| must be open.
   void CancelAllState(unsigned port);
@@ -98,7 +120,20 @@ class MessagePipe final : public ChannelEndpointClient {
                          HandleVector* handles,
                          uint32_t* num_handles,
                          MojoReadMessageFlags flags);
+  MojoResult BeginReadMessage(unsigned port,
+                              UserPointer<void*> buffer,
+                              UserPointer<uint32_t> buffer_num_bytes,
+                              HandleVector* handles,
+                              uint32_t* num_handles,
+                              MojoReadMessageFlags flags);
+  MojoResult EndReadMessage(unsigned port);
   HandleSignalsState GetHandleSignalsState(unsigned port) const;
+  // Like |GetHandleSignalsState()|, but doesn't take |mutex_|; returns false
+  // (without setting |*signals_state|) if that's not possible, e.g., if the
+  // queue of |port| isn't marked lock-free (see |queue_states_|) or is being
+  // read.
+  bool TryGetHandleSignalsState(unsigned port,
+                                HandleSignalsState* signals_state);
   MojoResult AddAwakable(unsigned port,
                          Awakable* awakable,
                          MojoHandleSignals signals,
@@ -151,9 +186,125 @@ class MessagePipe final : public ChannelEndpointClient {
                                     std::vector<HandleTransport>* transports)
       MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Implements |ReadMessage()| and |BeginReadMessage()|: |read_function| is
+  // called with |port|'s (local) endpoint, with the consumer bit held.
+  template <typename ReadFunction>
+  MojoResult ReadMessageImpl(unsigned port, const ReadFunction& read_function);
+
+  // Helpers for queue limits (see |SetQueueLimits()|):
+  // Whether a queue with the given contents is full.
+  bool IsQueueFull(uint64_t num_messages, uint64_t num_bytes) const;
+  bool IsLocalQueueFull(const LocalMessagePipeEndpoint* endpoint) const;
+  // Whether the message (if any) just removed from |endpoint|'s queue took it
+  // from full to not full. Must be called with the consumer bit held.
+  bool TakeLocalQueueDrained(LocalMessagePipeEndpoint* endpoint) const;
+  // Whether |port|'s peer's queue is full (as far as |port| knows).
+  bool IsPeerQueueFullNoLock(unsigned port) const
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Updates whether |port| (if local) is writable, i.e., whether its peer's
+  // queue is full.
+  void UpdateWritableNoLock(unsigned port)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Called after a message has been consumed from |port|'s queue: if
+  // |drained|, the queue is no longer full; if |ack_request_id| is nonzero,
+  // the message's writer must be sent an acknowledgement.
+  void OnMessageConsumedNoLock(unsigned port,
+                               bool drained,
+                               uint32_t ack_request_id)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Accounts for |message| being written from |port| to a remote peer,
+  // requesting an acknowledgement for it if appropriate.
+  void OnWriteToRemoteNoLock(unsigned port, MessageInTransit* message)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Handles an acknowledgement (received by |port|'s remote peer) of messages
+  // written from |port|.
+  void OnAckNoLock(unsigned port, const MessageInTransit& message)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Updates |write_counts_| for a message successfully written from |port|.
+  void CountWrite(unsigned port, uint32_t num_bytes, size_t num_handles);
+
+  // Helpers for the lock-free fast path (see |queue_states_|); |bit| is the
+  // producer or consumer bit.
+  // Tries to acquire |bit| for |port|'s queue without |mutex_|. Fails if the
+  // queue isn't marked lock-free or if |bit| is already held.
+  bool TryAcquireQueue(unsigned port, uint32_t bit);
+  // Acquires |bit| for |port|'s queue, waiting for any lock-free holder of it.
+  void AcquireQueueNoLock(unsigned port, uint32_t bit)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void ReleaseQueue(unsigned port, uint32_t bit);
+  // Marks |port|'s queue as lock-free; |port|'s endpoint must be local.
+  void EnableLockFreeQueueNoLock(unsigned port)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Unmarks |port|'s queue as lock-free, waiting for any lock-free producer or
+  // consumer to finish. This must be called before |port|'s endpoint is closed
+  // or replaced.
+  void DisableLockFreeQueueNoLock(unsigned port)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   mutable util::Mutex mutex_;
   std::unique_ptr<MessagePipeEndpoint> endpoints_[2] MOJO_GUARDED_BY(mutex_);
 
+  // Lock-free fast path: A local endpoint's message queue is
+  // single-producer/single-consumer (see |SpscMessageInTransitQueue|), so
+  // writing a message (without handles) to a local endpoint and reading from
+  // one don't need |mutex_|. (The writer only needs |mutex_| if it makes the
+  // queue nonempty while something is waiting on it.)
+  //
+  // Each port's |queue_states_| has a "lock-free" bit, which is set while its
+  // endpoint is local (and not being closed or serialized), and "producer" and
+  // "consumer" bits, which must be held to add messages to, respectively read
+  // messages from, its queue. The fast path acquires these bits without
+  // |mutex_| only if the queue is marked lock-free (otherwise falling back to
+  // taking |mutex_|); under |mutex_|, they're acquired unconditionally (waiting
+  // for any fast-path holder).
+  std::atomic<uint32_t> queue_states_[2];
+  // The local endpoints corresponding to |endpoints_| whose queues are marked
+  // lock-free (or null). These are only modified under |mutex_| while the
+  // corresponding queue isn't marked lock-free, so may be used by holders of a
+  // bit acquired by |TryAcquireQueue()|.
+  LocalMessagePipeEndpoint* local_endpoints_[2];
+
+  // Queue limits (see |SetQueueLimits()|); zero means no limit. These may be
+  // read without |mutex_| (by the fast path).
+  std::atomic<uint32_t> max_queued_messages_;
+  std::atomic<uint32_t> max_queued_num_bytes_;
+
+  // A port whose peer is remote can't see its peer's queue. Instead, it counts
+  // the messages that it has written, and asks for some of them (see
+  // |MessageInTransit::ack_request_id()|) to be acknowledged when they're read;
+  // an acknowledgement means that that message and all the ones before it have
+  // been consumed. The peer's queue is taken to be full when the unacknowledged
+  // messages reach the queue limits.
+  struct AckRequest {
+    uint32_t id;
+    // Totals written up to and including the message with this request.
+    uint64_t num_messages_written;
+    uint64_t num_bytes_written;
+  };
+  struct RemoteQueueState {
+    uint64_t num_messages_written = 0;
+    uint64_t num_bytes_written = 0;
+    uint64_t num_messages_acked = 0;
+    uint64_t num_bytes_acked = 0;
+    // Nonzero (zero means "no request").
+    uint32_t next_ack_request_id = 1;
+    // Outstanding requests, oldest first.
+    std::deque<AckRequest> ack_requests;
+  };
+  // Indexed by the writing port.
+  RemoteQueueState remote_queue_states_[2] MOJO_GUARDED_BY(mutex_);
+
+  // Messages (and their total size and number of handles) successfully
+  // written, indexed by the writing port, for |GetStats()|. These are updated
+  // without |mutex_| (by the fast path).
+  struct WriteCounts {
+    std::atomic<uint64_t> num_messages{0};
+    std::atomic<uint64_t> num_bytes{0};
+    std::atomic<uint64_t> num_handles{0};
+  };
+  WriteCounts write_counts_[2];
+
   MOJO_DISALLOW_COPY_AND_ASSIGN(MessagePipe);
 };
 
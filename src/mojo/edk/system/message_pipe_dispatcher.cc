@@ -4,6 +4,8 @@
 
 #include "mojo/edk/system/message_pipe_dispatcher.h"
 
+#include <algorithm>
+#include <limits>
 #include <utility>
 
 #include "base/logging.h"
@@ -16,6 +18,7 @@
 #include "mojo/edk/system/proxy_message_pipe_endpoint.h"
 
 using mojo::platform::ScopedPlatformHandle;
+using mojo::util::MutexLocker;
 using mojo::util::RefPtr;
 
 namespace mojo {
@@ -23,6 +26,21 @@ namespace system {
 
 const unsigned kInvalidPort = static_cast<unsigned>(-1);
 
+namespace {
+
+uint32_t ClampToUint32(size_t value) {
+  const size_t kMaxUint32 = std::numeric_limits<uint32_t>::max();
+  return static_cast<uint32_t>(std::min(value, kMaxUint32));
+}
+
+// Written before the serialized |MessagePipe|.
+struct SerializedMessagePipeDispatcher {
+  uint32_t max_queued_messages;
+  uint32_t max_queued_num_bytes;
+};
+
+}  // namespace
+
 // MessagePipeDispatcher -------------------------------------------------------
 
 // static
@@ -32,7 +50,7 @@ constexpr MojoHandleRights MessagePipeDispatcher::kDefaultHandleRights;
 const MojoCreateMessagePipeOptions
     MessagePipeDispatcher::kDefaultCreateOptions = {
         static_cast<uint32_t>(sizeof(MojoCreateMessagePipeOptions)),
-        MOJO_CREATE_MESSAGE_PIPE_OPTIONS_FLAG_NONE};
+        MOJO_CREATE_MESSAGE_PIPE_OPTIONS_FLAG_NONE, 0u, 0u};
 
 // static
 MojoResult MessagePipeDispatcher::ValidateCreateOptions(
@@ -42,6 +60,11 @@ MojoResult MessagePipeDispatcher::ValidateCreateOptions(
       MOJO_CREATE_MESSAGE_PIPE_OPTIONS_FLAG_NONE;
 
   *out_options = kDefaultCreateOptions;
+  const embedder::Configuration& config = GetConfiguration();
+  out_options->max_queued_messages =
+      ClampToUint32(config.default_message_pipe_max_queued_messages);
+  out_options->max_queued_num_bytes =
+      ClampToUint32(config.default_message_pipe_max_queued_num_bytes);
   if (in_options.IsNull())
     return MOJO_RESULT_OK;
 
@@ -57,7 +80,18 @@ MojoResult MessagePipeDispatcher::ValidateCreateOptions(
 
   // Checks for fields beyond |flags|:
 
-  // (Nothing here yet.)
+  // Zero means "use the default" (and a zero default means "no limit").
+  if (!OPTIONS_STRUCT_HAS_MEMBER(MojoCreateMessagePipeOptions,
+                                 max_queued_messages, reader))
+    return MOJO_RESULT_OK;
+  if (reader.options().max_queued_messages)
+    out_options->max_queued_messages = reader.options().max_queued_messages;
+
+  if (!OPTIONS_STRUCT_HAS_MEMBER(MojoCreateMessagePipeOptions,
+                                 max_queued_num_bytes, reader))
+    return MOJO_RESULT_OK;
+  if (reader.options().max_queued_num_bytes)
+    out_options->max_queued_num_bytes = reader.options().max_queued_num_bytes;
 
   return MOJO_RESULT_OK;
 }
@@ -67,6 +101,8 @@ void MessagePipeDispatcher::Init(RefPtr<MessagePipe>&& message_pipe,
   DCHECK(message_pipe);
   DCHECK(port == 0 || port == 1);
 
+  lock_free_message_pipe_ = message_pipe.Clone();
+  lock_free_port_ = port;
   message_pipe_ = std::move(message_pipe);
   port_ = port;
 }
@@ -81,6 +117,15 @@ bool MessagePipeDispatcher::SupportsEntrypointClass(
           entrypoint_class == EntrypointClass::MESSAGE_PIPE);
 }
 
+MojoResult MessagePipeDispatcher::GetStats(embedder::MessagePipeStats* stats) {
+  MutexLocker locker(&mutex());
+  if (is_closed_no_lock())
+    return MOJO_RESULT_INVALID_ARGUMENT;
+
+  message_pipe_->GetStats(port_, stats);
+  return MOJO_RESULT_OK;
+}
+
 // static
 RefPtr<MessagePipeDispatcher> MessagePipeDispatcher::CreateRemoteMessagePipe(
     RefPtr<ChannelEndpoint>* channel_endpoint) {
@@ -95,19 +140,34 @@ RefPtr<MessagePipeDispatcher> MessagePipeDispatcher::Deserialize(
     Channel* channel,
     const void* source,
     size_t size) {
+  if (size < sizeof(SerializedMessagePipeDispatcher)) {
+    LOG(ERROR) << "Invalid serialized message pipe dispatcher";
+    return nullptr;
+  }
+  const SerializedMessagePipeDispatcher* s =
+      static_cast<const SerializedMessagePipeDispatcher*>(source);
+
   unsigned port = kInvalidPort;
   RefPtr<MessagePipe> message_pipe;
-  if (!MessagePipe::Deserialize(channel, source, size, &message_pipe, &port))
+  if (!MessagePipe::Deserialize(
+          channel,
+          static_cast<const char*>(source) +
+              sizeof(SerializedMessagePipeDispatcher),
+          size - sizeof(SerializedMessagePipeDispatcher), &message_pipe,
+          &port))
     return nullptr;
   DCHECK(message_pipe);
   DCHECK(port == 0 || port == 1);
+  message_pipe->SetQueueLimits(s->max_queued_messages,
+                               s->max_queued_num_bytes);
 
   auto dispatcher = MessagePipeDispatcher::Create(kDefaultCreateOptions);
   dispatcher->Init(std::move(message_pipe), port);
   return dispatcher;
 }
 
-MessagePipeDispatcher::MessagePipeDispatcher() : port_(kInvalidPort) {
+MessagePipeDispatcher::MessagePipeDispatcher()
+    : port_(kInvalidPort), lock_free_port_(kInvalidPort) {
 }
 
 MessagePipeDispatcher::~MessagePipeDispatcher() {
@@ -143,6 +203,31 @@ MessagePipeDispatcher::CreateEquivalentDispatcherAndCloseImplNoLock(
     unsigned port) {
   mutex().AssertHeld();
 
+  CancelAllStateForTransportNoLock(message_pipe, port);
+
+  // TODO(vtl): Currently, there are no options, so we just use
+  // |kDefaultCreateOptions|. Eventually, we'll have to duplicate the options
+  // too.
+  auto dispatcher = MessagePipeDispatcher::Create(kDefaultCreateOptions);
+  dispatcher->Init(std::move(message_pipe_), port_);
+  port_ = kInvalidPort;
+  return dispatcher;
+}
+
+bool MessagePipeDispatcher::PrepareForLocalTransferImplNoLock(
+    MessagePipe* message_pipe,
+    unsigned port) {
+  mutex().AssertHeld();
+
+  CancelAllStateForTransportNoLock(message_pipe, port);
+  return true;
+}
+
+void MessagePipeDispatcher::CancelAllStateForTransportNoLock(
+    MessagePipe* message_pipe,
+    unsigned port) {
+  mutex().AssertHeld();
+
   // "We" are being sent over our peer.
   // If |message_pipe| is null, the |if| condition below should be false.
   DCHECK(message_pipe_.get());
@@ -155,14 +240,6 @@ MessagePipeDispatcher::CreateEquivalentDispatcherAndCloseImplNoLock(
   } else {
     CancelAllStateNoLock();
   }
-
-  // TODO(vtl): Currently, there are no options, so we just use
-  // |kDefaultCreateOptions|. Eventually, we'll have to duplicate the options
-  // too.
-  auto dispatcher = MessagePipeDispatcher::Create(kDefaultCreateOptions);
-  dispatcher->Init(std::move(message_pipe_), port_);
-  port_ = kInvalidPort;
-  return dispatcher;
 }
 
 MojoResult MessagePipeDispatcher::WriteMessageImplNoLock(
@@ -194,6 +271,29 @@ MojoResult MessagePipeDispatcher::ReadMessageImplNoLock(
                                     num_handles, flags);
 }
 
+MojoResult MessagePipeDispatcher::BeginReadMessageImplNoLock(
+    UserPointer<void*> buffer,
+    UserPointer<uint32_t> buffer_num_bytes,
+    HandleVector* handles,
+    uint32_t* num_handles,
+    MojoReadMessageFlags flags) {
+  mutex().AssertHeld();
+  return message_pipe_->BeginReadMessage(port_, buffer, buffer_num_bytes,
+                                         handles, num_handles, flags);
+}
+
+MojoResult MessagePipeDispatcher::EndReadMessageImplNoLock() {
+  mutex().AssertHeld();
+  return message_pipe_->EndReadMessage(port_);
+}
+
+bool MessagePipeDispatcher::TryGetHandleSignalsStateImpl(
+    HandleSignalsState* signals_state) const {
+  return lock_free_message_pipe_ &&
+         lock_free_message_pipe_->TryGetHandleSignalsState(lock_free_port_,
+                                                           signals_state);
+}
+
 HandleSignalsState MessagePipeDispatcher::GetHandleSignalsStateImplNoLock()
     const {
   mutex().AssertHeld();
@@ -232,8 +332,9 @@ void MessagePipeDispatcher::StartSerializeImplNoLock(
     size_t* max_size,
     size_t* max_platform_handles) {
   AssertHasOneRef();  // Only one ref => no need to take the lock.
-  return message_pipe_->StartSerialize(port_, channel, max_size,
-                                       max_platform_handles);
+  message_pipe_->StartSerialize(port_, channel, max_size,
+                                max_platform_handles);
+  *max_size += sizeof(SerializedMessagePipeDispatcher);
 }
 
 bool MessagePipeDispatcher::EndSerializeAndCloseImplNoLock(
@@ -243,8 +344,16 @@ bool MessagePipeDispatcher::EndSerializeAndCloseImplNoLock(
     std::vector<ScopedPlatformHandle>* platform_handles) {
   AssertHasOneRef();  // Only one ref => no need to take the lock.
 
-  bool rv = message_pipe_->EndSerialize(port_, channel, destination,
-                                        actual_size, platform_handles);
+  // The queue limits go with the message pipe.
+  SerializedMessagePipeDispatcher* s =
+      static_cast<SerializedMessagePipeDispatcher*>(destination);
+  message_pipe_->GetQueueLimits(&s->max_queued_messages,
+                                &s->max_queued_num_bytes);
+  bool rv = message_pipe_->EndSerialize(
+      port_, channel,
+      static_cast<char*>(destination) + sizeof(SerializedMessagePipeDispatcher),
+      actual_size, platform_handles);
+  *actual_size += sizeof(SerializedMessagePipeDispatcher);
   message_pipe_ = nullptr;
   port_ = kInvalidPort;
   return rv;
@@ -12,6 +12,11 @@
 #include "mojo/public/cpp/system/macros.h"
 
 namespace mojo {
+
+namespace embedder {
+struct MessagePipeStats;
+}
+
 namespace system {
 
 class ChannelEndpoint;
@@ -54,6 +59,11 @@ class MessagePipeDispatcher final : public Dispatcher {
   Type GetType() const override;
   bool SupportsEntrypointClass(EntrypointClass entrypoint_class) const override;
 
+  // Gets statistics for this message pipe endpoint (see
+  // |embedder::GetMessagePipeStats()|). Returns
+  // |MOJO_RESULT_INVALID_ARGUMENT| if this dispatcher has been closed.
+  MojoResult GetStats(embedder::MessagePipeStats* stats);
+
   // Creates a |MessagePipe| with a local endpoint (at port 0) and a proxy
   // endpoint, and creates/initializes a |MessagePipeDispatcher| (attached to
   // the message pipe, port 0).
@@ -86,6 +96,8 @@ class MessagePipeDispatcher final : public Dispatcher {
   util::RefPtr<Dispatcher> CreateEquivalentDispatcherAndCloseImplNoLock(
       MessagePipe* message_pipe,
       unsigned port) override;
+  bool PrepareForLocalTransferImplNoLock(MessagePipe* message_pipe,
+                                         unsigned port) override;
   MojoResult WriteMessageImplNoLock(UserPointer<const void> bytes,
                                     uint32_t num_bytes,
                                     std::vector<HandleTransport>* transports,
@@ -95,6 +107,14 @@ class MessagePipeDispatcher final : public Dispatcher {
                                    HandleVector* handles,
                                    uint32_t* num_handles,
                                    MojoReadMessageFlags flags) override;
+  MojoResult BeginReadMessageImplNoLock(UserPointer<void*> buffer,
+                                        UserPointer<uint32_t> buffer_num_bytes,
+                                        HandleVector* handles,
+                                        uint32_t* num_handles,
+                                        MojoReadMessageFlags flags) override;
+  MojoResult EndReadMessageImplNoLock() override;
+  bool TryGetHandleSignalsStateImpl(
+      HandleSignalsState* signals_state) const override;
   HandleSignalsState GetHandleSignalsStateImplNoLock() const override;
   MojoResult AddAwakableImplNoLock(Awakable* awakable,
                                    MojoHandleSignals signals,
@@ -118,9 +138,23 @@ class MessagePipeDispatcher final : public Dispatcher {
       std::vector<platform::ScopedPlatformHandle>* platform_handles) override
       MOJO_NOT_THREAD_SAFE;
 
+  // Cancels all state in preparation for "us" being sent over the given port of
+  // |message_pipe| (which may be our own message pipe, in which case its mutex
+  // must already be held).
+  void CancelAllStateForTransportNoLock(MessagePipe* message_pipe,
+                                        unsigned port)
+      MOJO_EXCLUSIVE_LOCKS_REQUIRED(mutex());
+
   // This will be null if closed.
   util::RefPtr<MessagePipe> message_pipe_ MOJO_GUARDED_BY(mutex());
   unsigned port_ MOJO_GUARDED_BY(mutex());
+  // Like |message_pipe_| and |port_|, but set only by |Init()| (which must be
+  // called before the dispatcher is shared with other threads) and never reset,
+  // so that |TryGetHandleSignalsStateImpl()| can use them without |mutex()|.
+  // (This only races with closing the handle, in which case the result is as
+  // if the wait had happened first.)
+  util::RefPtr<MessagePipe> lock_free_message_pipe_;
+  unsigned lock_free_port_;
 
   MOJO_DISALLOW_COPY_AND_ASSIGN(MessagePipeDispatcher);
 };
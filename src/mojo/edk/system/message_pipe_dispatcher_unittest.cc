@@ -384,6 +384,52 @@ TEST(MessagePipeDispatcherTest, BasicClosed) {
   }
 }
 
+// Tests that |TryGetHandleSignalsState()| gets the same state as
+// |GetHandleSignalsState()| while the dispatcher is open.
+TEST(MessagePipeDispatcherTest, TryGetHandleSignalsState) {
+  int32_t buffer[1] = {123456789};
+  const uint32_t kBufferSize = static_cast<uint32_t>(sizeof(buffer));
+
+  auto d0 = MessagePipeDispatcher::Create(
+      MessagePipeDispatcher::kDefaultCreateOptions);
+  auto d1 = MessagePipeDispatcher::Create(
+      MessagePipeDispatcher::kDefaultCreateOptions);
+  {
+    auto mp = MessagePipe::CreateLocalLocal();
+    d0->Init(mp.Clone(), 0);
+    d1->Init(std::move(mp), 1);
+  }
+
+  HandleSignalsState hss;
+  EXPECT_TRUE(d0->TryGetHandleSignalsState(&hss));
+  EXPECT_TRUE(hss.equals(d0->GetHandleSignalsState()));
+  EXPECT_EQ(MOJO_HANDLE_SIGNAL_WRITABLE, hss.satisfied_signals);
+
+  EXPECT_EQ(MOJO_RESULT_OK,
+            d1->WriteMessage(UserPointer<const void>(buffer), kBufferSize,
+                             nullptr, MOJO_WRITE_MESSAGE_FLAG_NONE));
+  hss = HandleSignalsState();
+  EXPECT_TRUE(d0->TryGetHandleSignalsState(&hss));
+  EXPECT_TRUE(hss.equals(d0->GetHandleSignalsState()));
+  EXPECT_EQ(MOJO_HANDLE_SIGNAL_READABLE | MOJO_HANDLE_SIGNAL_WRITABLE,
+            hss.satisfied_signals);
+
+  // The message is still readable after the peer is closed.
+  EXPECT_EQ(MOJO_RESULT_OK, d1->Close());
+  hss = HandleSignalsState();
+  EXPECT_TRUE(d0->TryGetHandleSignalsState(&hss));
+  EXPECT_TRUE(hss.equals(d0->GetHandleSignalsState()));
+  EXPECT_EQ(MOJO_HANDLE_SIGNAL_READABLE | MOJO_HANDLE_SIGNAL_PEER_CLOSED,
+            hss.satisfied_signals);
+  EXPECT_EQ(MOJO_HANDLE_SIGNAL_READABLE | MOJO_HANDLE_SIGNAL_PEER_CLOSED,
+            hss.satisfiable_signals);
+
+  // Once closed, it must fail (so that callers take the slow path, which
+  // reports that the dispatcher is closed).
+  EXPECT_EQ(MOJO_RESULT_OK, d0->Close());
+  EXPECT_FALSE(d0->TryGetHandleSignalsState(&hss));
+}
+
 TEST(MessagePipeDispatcherTest, BasicThreaded) {
   Stopwatch stopwatch;
   int32_t buffer[1];
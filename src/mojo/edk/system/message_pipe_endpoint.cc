@@ -22,6 +22,21 @@ MojoResult MessagePipeEndpoint::ReadMessage(UserPointer<void> /*bytes*/,
   return MOJO_RESULT_INTERNAL;
 }
 
+MojoResult MessagePipeEndpoint::BeginReadMessage(
+    UserPointer<void*> /*buffer*/,
+    UserPointer<uint32_t> /*buffer_num_bytes*/,
+    HandleVector* /*handles*/,
+    uint32_t* /*num_handles*/,
+    MojoReadMessageFlags /*flags*/) {
+  NOTREACHED();
+  return MOJO_RESULT_INTERNAL;
+}
+
+MojoResult MessagePipeEndpoint::EndReadMessage() {
+  NOTREACHED();
+  return MOJO_RESULT_INTERNAL;
+}
+
 HandleSignalsState MessagePipeEndpoint::GetHandleSignalsState() const {
   NOTREACHED();
   return HandleSignalsState();
@@ -64,6 +64,12 @@ class MessagePipeEndpoint {
                                  HandleVector* handles,
                                  uint32_t* num_handles,
                                  MojoReadMessageFlags flags);
+  virtual MojoResult BeginReadMessage(UserPointer<void*> buffer,
+                                      UserPointer<uint32_t> buffer_num_bytes,
+                                      HandleVector* handles,
+                                      uint32_t* num_handles,
+                                      MojoReadMessageFlags flags);
+  virtual MojoResult EndReadMessage();
   virtual HandleSignalsState GetHandleSignalsState() const;
   virtual MojoResult AddAwakable(Awakable* awakable,
                                  MojoHandleSignals signals,
@@ -12,11 +12,16 @@
 #include "mojo/edk/embedder/simple_platform_support.h"
 #include "mojo/edk/platform/scoped_platform_handle.h"
 #include "mojo/edk/platform/test_stopwatch.h"
+#include "mojo/edk/platform/thread_utils.h"
+#include "mojo/edk/system/core.h"
 #include "mojo/edk/system/local_message_pipe_endpoint.h"
+#include "mojo/edk/system/message_buffer_pool.h"
 #include "mojo/edk/system/message_pipe.h"
 #include "mojo/edk/system/message_pipe_test_utils.h"
 #include "mojo/edk/system/proxy_message_pipe_endpoint.h"
 #include "mojo/edk/system/test/perf_log.h"
+#include "mojo/edk/system/test/simple_test_thread.h"
+#include "mojo/edk/system/test/timeouts.h"
 #include "mojo/edk/test/test_utils.h"
 #include "mojo/edk/util/ref_ptr.h"
 #include "mojo/edk/util/string_printf.h"
@@ -25,6 +30,7 @@
 
 using mojo::platform::test::Stopwatch;
 using mojo::platform::ScopedPlatformHandle;
+using mojo::platform::ThreadYield;
 using mojo::util::RefPtr;
 using mojo::util::StringPrintf;
 
@@ -74,11 +80,21 @@ class MultiprocessMessagePipePerfTest
     std::string test_name = StringPrintf("IPC_Perf_%dx_%u", message_count_,
                                          static_cast<unsigned>(message_size_));
     Stopwatch stopwatch;
+    MessageBufferPool::Stats stats = MessageBufferPool::GetStats();
 
     stopwatch.Start();
     for (int i = 0; i < message_count_; ++i)
       WriteWaitThenRead(mp);
     test::LogPerfResult(test_name.c_str(), stopwatch.Elapsed() / 1000.0, "ms");
+
+    // Messages' buffers should mostly come from the pool.
+    uint64_t num_system_allocations =
+        MessageBufferPool::GetStats().num_system_allocations -
+        stats.num_system_allocations;
+    test::LogPerfResult((test_name + "_SystemAllocations").c_str(),
+                        static_cast<double>(num_system_allocations) /
+                            static_cast<double>(message_count_),
+                        "allocations/round trip");
   }
 
  private:
@@ -167,6 +183,320 @@ TEST_F(MultiprocessMessagePipePerfTest, MAYBE_PingPong) {
   EXPECT_EQ(0, helper()->WaitForChildShutdown());
 }
 
+// Message allocation ---------------------------------------------------------
+
+// Round trips over a local message pipe (on a single thread), which measures
+// the cost of creating and destroying messages. Also reports the number of
+// allocations of message buffers (including |MessageInTransit|s themselves)
+// that fell through to the system allocator.
+TEST(MessagePipeAllocationPerfTest, LocalRoundTrip) {
+  static const size_t kMessageSizes[] = {12, 1728, 20736};
+  static const int kNumRoundTrips = 100000;
+
+  auto mp = MessagePipe::CreateLocalLocal();
+  for (size_t i = 0; i < MOJO_ARRAYSIZE(kMessageSizes); i++) {
+    std::string payload(kMessageSizes[i], '*');
+    std::string read_buffer(kMessageSizes[i], '\0');
+
+    MessageBufferPool::Stats stats = MessageBufferPool::GetStats();
+    Stopwatch stopwatch;
+    stopwatch.Start();
+    for (int j = 0; j < kNumRoundTrips; j++) {
+      for (unsigned port = 0; port < 2; port++) {
+        CHECK_EQ(mp->WriteMessage(port, UserPointer<const void>(payload.data()),
+                                  static_cast<uint32_t>(payload.size()),
+                                  nullptr, MOJO_WRITE_MESSAGE_FLAG_NONE),
+                 MOJO_RESULT_OK);
+        uint32_t read_size = static_cast<uint32_t>(read_buffer.size());
+        CHECK_EQ(mp->ReadMessage(1 - port, UserPointer<void>(&read_buffer[0]),
+                                 MakeUserPointer(&read_size), nullptr, nullptr,
+                                 MOJO_READ_MESSAGE_FLAG_NONE),
+                 MOJO_RESULT_OK);
+      }
+    }
+    double elapsed = stopwatch.Elapsed() / 1000000.0;
+    uint64_t num_system_allocations =
+        MessageBufferPool::GetStats().num_system_allocations -
+        stats.num_system_allocations;
+
+    std::string test_name = StringPrintf(
+        "LocalRoundTrip_%u", static_cast<unsigned>(kMessageSizes[i]));
+    test::LogPerfResult(test_name.c_str(), kNumRoundTrips / elapsed,
+                        "round trips/s");
+    test::LogPerfResult((test_name + "_SystemAllocations").c_str(),
+                        static_cast<double>(num_system_allocations) /
+                            kNumRoundTrips,
+                        "allocations/round trip");
+  }
+
+  mp->Close(0);
+  mp->Close(1);
+}
+
+// Local ping-pong ------------------------------------------------------------
+
+// Reads messages from port 1 of |mp| (polling, without waiting) and echoes them
+// back, until it gets an empty message.
+class PollingEchoThread : public test::SimpleTestThread {
+ public:
+  explicit PollingEchoThread(MessagePipe* mp) : mp_(mp) {}
+  ~PollingEchoThread() override {}
+
+ private:
+  void Run() override {
+    std::string buffer(100000, '\0');
+    while (true) {
+      uint32_t read_size = static_cast<uint32_t>(buffer.size());
+      MojoResult result = mp_->ReadMessage(
+          1, UserPointer<void>(&buffer[0]), MakeUserPointer(&read_size),
+          nullptr, nullptr, MOJO_READ_MESSAGE_FLAG_NONE);
+      if (result == MOJO_RESULT_SHOULD_WAIT) {
+        ThreadYield();
+        continue;
+      }
+      CHECK_EQ(result, MOJO_RESULT_OK);
+      if (!read_size)
+        break;
+      CHECK_EQ(mp_->WriteMessage(1, UserPointer<const void>(&buffer[0]),
+                                 read_size, nullptr,
+                                 MOJO_WRITE_MESSAGE_FLAG_NONE),
+               MOJO_RESULT_OK);
+    }
+  }
+
+  MessagePipe* const mp_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(PollingEchoThread);
+};
+
+// Round trips over a local message pipe between two threads, both of which poll
+// (so that this measures the cost of the message pipe itself, including any
+// contention between the two ends, rather than that of waking up threads).
+TEST(MessagePipePerfTest, LocalPingPong) {
+  static const size_t kMessageSizes[] = {12, 1728, 20736};
+
+  auto mp = MessagePipe::CreateLocalLocal();
+  PollingEchoThread thread(mp.get());
+  thread.Start();
+
+  for (size_t i = 0; i < MOJO_ARRAYSIZE(kMessageSizes); i++) {
+    std::string payload(kMessageSizes[i], '*');
+    std::string read_buffer(kMessageSizes[i], '\0');
+
+    uint64_t iterations = 0;
+    Stopwatch stopwatch;
+    stopwatch.Start();
+    do {
+      for (size_t j = 0; j < 100; j++, iterations++) {
+        CHECK_EQ(mp->WriteMessage(0, UserPointer<const void>(payload.data()),
+                                  static_cast<uint32_t>(payload.size()),
+                                  nullptr, MOJO_WRITE_MESSAGE_FLAG_NONE),
+                 MOJO_RESULT_OK);
+        while (true) {
+          uint32_t read_size = static_cast<uint32_t>(read_buffer.size());
+          MojoResult result = mp->ReadMessage(
+              0, UserPointer<void>(&read_buffer[0]),
+              MakeUserPointer(&read_size), nullptr, nullptr,
+              MOJO_READ_MESSAGE_FLAG_NONE);
+          if (result == MOJO_RESULT_OK)
+            break;
+          CHECK_EQ(result, MOJO_RESULT_SHOULD_WAIT);
+          ThreadYield();
+        }
+      }
+    } while (stopwatch.Elapsed() < test::DeadlineFromMilliseconds(1000));
+    double elapsed = stopwatch.Elapsed() / 1000000.0;
+
+    test::LogPerfResult(StringPrintf("LocalPingPong_%u",
+                                     static_cast<unsigned>(kMessageSizes[i]))
+                            .c_str(),
+                        iterations / elapsed, "round trips/s");
+  }
+
+  // An empty message tells |thread| to quit.
+  CHECK_EQ(mp->WriteMessage(0, NullUserPointer(), 0, nullptr,
+                            MOJO_WRITE_MESSAGE_FLAG_NONE),
+           MOJO_RESULT_OK);
+  thread.Join();
+
+  mp->Close(0);
+  mp->Close(1);
+}
+
+// Wait latency ---------------------------------------------------------------
+
+// These measure the cost of |Core::Wait()|/|Core::WaitMany()| themselves (with
+// local message pipes), rather than of message transport.
+class MessagePipeWaitPerfTest : public testing::Test {
+ public:
+  MessagePipeWaitPerfTest()
+      : platform_support_(embedder::CreateSimplePlatformSupport()),
+        core_(platform_support_.get()) {}
+  ~MessagePipeWaitPerfTest() override {}
+
+ protected:
+  Core* core() { return &core_; }
+
+  void CreateMessagePipe(MojoHandle* h0, MojoHandle* h1) {
+    CHECK_EQ(core()->CreateMessagePipe(NullUserPointer(), MakeUserPointer(h0),
+                                       MakeUserPointer(h1)),
+             MOJO_RESULT_OK);
+  }
+
+  void WriteEmptyMessage(MojoHandle h) {
+    CHECK_EQ(core()->WriteMessage(h, NullUserPointer(), 0, NullUserPointer(), 0,
+                                  MOJO_WRITE_MESSAGE_FLAG_NONE),
+             MOJO_RESULT_OK);
+  }
+
+  void ReadEmptyMessage(MojoHandle h) {
+    CHECK_EQ(core()->ReadMessage(h, NullUserPointer(), NullUserPointer(),
+                                 NullUserPointer(), NullUserPointer(),
+                                 MOJO_READ_MESSAGE_FLAG_NONE),
+             MOJO_RESULT_OK);
+  }
+
+ private:
+  std::unique_ptr<embedder::PlatformSupport> platform_support_;
+  Core core_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(MessagePipeWaitPerfTest);
+};
+
+// |MojoWait()| on a handle that's already readable (so it never blocks).
+TEST_F(MessagePipeWaitPerfTest, WaitAlreadySatisfied) {
+  MojoHandle h0 = MOJO_HANDLE_INVALID;
+  MojoHandle h1 = MOJO_HANDLE_INVALID;
+  CreateMessagePipe(&h0, &h1);
+  WriteEmptyMessage(h1);
+
+  uint64_t iterations = 0;
+  Stopwatch stopwatch;
+  stopwatch.Start();
+  do {
+    for (size_t i = 0; i < 1000; i++, iterations++) {
+      CHECK_EQ(core()->Wait(h0, MOJO_HANDLE_SIGNAL_READABLE,
+                            MOJO_DEADLINE_INDEFINITE, NullUserPointer()),
+               MOJO_RESULT_OK);
+    }
+  } while (stopwatch.Elapsed() < test::DeadlineFromMilliseconds(1000));
+  double elapsed = stopwatch.Elapsed() / 1000000.0;
+
+  test::LogPerfResult("WaitAlreadySatisfied", iterations / elapsed,
+                      "iterations/s");
+
+  CHECK_EQ(core()->Close(h0), MOJO_RESULT_OK);
+  CHECK_EQ(core()->Close(h1), MOJO_RESULT_OK);
+}
+
+// |MojoWaitMany()| on several handles, only the last of which is readable (so
+// the waiter has to be added to, then removed from, the others).
+TEST_F(MessagePipeWaitPerfTest, WaitManyLastSatisfied) {
+  static const uint32_t kNumHandles = 8;
+  MojoHandle handles[kNumHandles] = {};
+  MojoHandle peers[kNumHandles] = {};
+  MojoHandleSignals signals[kNumHandles] = {};
+  for (uint32_t i = 0; i < kNumHandles; i++) {
+    CreateMessagePipe(&handles[i], &peers[i]);
+    signals[i] = MOJO_HANDLE_SIGNAL_READABLE;
+  }
+  WriteEmptyMessage(peers[kNumHandles - 1]);
+
+  uint64_t iterations = 0;
+  Stopwatch stopwatch;
+  stopwatch.Start();
+  do {
+    for (size_t i = 0; i < 1000; i++, iterations++) {
+      CHECK_EQ(core()->WaitMany(MakeUserPointer(handles),
+                                MakeUserPointer(signals), kNumHandles,
+                                MOJO_DEADLINE_INDEFINITE, NullUserPointer(),
+                                NullUserPointer()),
+               MOJO_RESULT_OK);
+    }
+  } while (stopwatch.Elapsed() < test::DeadlineFromMilliseconds(1000));
+  double elapsed = stopwatch.Elapsed() / 1000000.0;
+
+  test::LogPerfResult(
+      StringPrintf("WaitManyLastSatisfied_%u", kNumHandles).c_str(),
+      iterations / elapsed, "iterations/s");
+
+  for (uint32_t i = 0; i < kNumHandles; i++) {
+    CHECK_EQ(core()->Close(handles[i]), MOJO_RESULT_OK);
+    CHECK_EQ(core()->Close(peers[i]), MOJO_RESULT_OK);
+  }
+}
+
+// Echoes messages from |h| (waiting with |MojoWait()|) until it sees a
+// non-empty message.
+class WaitEchoThread : public test::SimpleTestThread {
+ public:
+  WaitEchoThread(Core* core, MojoHandle h) : core_(core), h_(h) {}
+  ~WaitEchoThread() override {}
+
+ private:
+  void Run() override {
+    char buffer[1] = {};
+    while (true) {
+      CHECK_EQ(core_->Wait(h_, MOJO_HANDLE_SIGNAL_READABLE,
+                           MOJO_DEADLINE_INDEFINITE, NullUserPointer()),
+               MOJO_RESULT_OK);
+      uint32_t num_bytes = static_cast<uint32_t>(sizeof(buffer));
+      CHECK_EQ(core_->ReadMessage(h_, UserPointer<void>(buffer),
+                                  MakeUserPointer(&num_bytes),
+                                  NullUserPointer(), NullUserPointer(),
+                                  MOJO_READ_MESSAGE_FLAG_NONE),
+               MOJO_RESULT_OK);
+      if (num_bytes)
+        break;
+      CHECK_EQ(core_->WriteMessage(h_, NullUserPointer(), 0, NullUserPointer(),
+                                   0, MOJO_WRITE_MESSAGE_FLAG_NONE),
+               MOJO_RESULT_OK);
+    }
+  }
+
+  Core* const core_;
+  const MojoHandle h_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(WaitEchoThread);
+};
+
+// Round trips between two threads, each of which blocks in |MojoWait()| (so
+// this measures the wake-up latency).
+TEST_F(MessagePipeWaitPerfTest, WaitPingPong) {
+  MojoHandle h0 = MOJO_HANDLE_INVALID;
+  MojoHandle h1 = MOJO_HANDLE_INVALID;
+  CreateMessagePipe(&h0, &h1);
+
+  WaitEchoThread thread(core(), h1);
+  thread.Start();
+
+  uint64_t iterations = 0;
+  Stopwatch stopwatch;
+  stopwatch.Start();
+  do {
+    for (size_t i = 0; i < 100; i++, iterations++) {
+      WriteEmptyMessage(h0);
+      CHECK_EQ(core()->Wait(h0, MOJO_HANDLE_SIGNAL_READABLE,
+                            MOJO_DEADLINE_INDEFINITE, NullUserPointer()),
+               MOJO_RESULT_OK);
+      ReadEmptyMessage(h0);
+    }
+  } while (stopwatch.Elapsed() < test::DeadlineFromMilliseconds(1000));
+  double elapsed = stopwatch.Elapsed() / 1000000.0;
+
+  test::LogPerfResult("WaitPingPong", iterations / elapsed, "round trips/s");
+
+  const char kQuit[1] = {'q'};
+  CHECK_EQ(core()->WriteMessage(h0, UserPointer<const void>(kQuit), 1,
+                                NullUserPointer(), 0,
+                                MOJO_WRITE_MESSAGE_FLAG_NONE),
+           MOJO_RESULT_OK);
+  thread.Join();
+
+  CHECK_EQ(core()->Close(h0), MOJO_RESULT_OK);
+  CHECK_EQ(core()->Close(h1), MOJO_RESULT_OK);
+}
+
 }  // namespace
 }  // namespace system
 }  // namespace mojo
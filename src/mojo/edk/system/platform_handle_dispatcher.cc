@@ -97,6 +97,15 @@ PlatformHandleDispatcher::CreateEquivalentDispatcherAndCloseImplNoLock(
   return Create(platform_handle_.Pass());
 }
 
+bool PlatformHandleDispatcher::PrepareForLocalTransferImplNoLock(
+    MessagePipe* /*message_pipe*/,
+    unsigned /*port*/) {
+  mutex().AssertHeld();
+
+  CancelAllStateNoLock();
+  return true;
+}
+
 void PlatformHandleDispatcher::StartSerializeImplNoLock(
     Channel* /*channel*/,
     size_t* max_size,
@@ -54,6 +54,8 @@ class PlatformHandleDispatcher final : public SimpleDispatcher {
   util::RefPtr<Dispatcher> CreateEquivalentDispatcherAndCloseImplNoLock(
       MessagePipe* message_pipe,
       unsigned port) override;
+  bool PrepareForLocalTransferImplNoLock(MessagePipe* message_pipe,
+                                         unsigned port) override;
   void StartSerializeImplNoLock(Channel* channel,
                                 size_t* max_size,
                                 size_t* max_platform_handles) override
@@ -6,13 +6,16 @@
 
 #include <string.h>
 
-#include <algorithm>
 #include <utility>
 
 #include "base/logging.h"
+#include "mojo/edk/platform/time_ticks.h"
+#include "mojo/edk/system/configuration.h"
+#include "mojo/edk/system/message_buffer_pool.h"
 #include "mojo/edk/system/message_in_transit.h"
 #include "mojo/edk/system/transport_data.h"
 
+using mojo::platform::GetTimeTicks;
 using mojo::platform::PlatformHandle;
 using mojo::platform::PlatformHandleWatcher;
 using mojo::platform::ScopedPlatformHandle;
@@ -23,24 +26,86 @@ using mojo::util::RefPtr;
 namespace mojo {
 namespace system {
 
+// Minimum amount of space to read into.
 const size_t kReadSize = 4096;
 
+namespace {
+
+// Size of the read buffer slabs, which come from the |MessageBufferPool| (like
+// messages' buffers). Since |RawChannel|s only hold on to a slab while they
+// have undispatched data, idle channels don't hold on to any memory, and busy
+// channels don't have to allocate. Reads are made into all the free space in
+// the slab, so this is also the maximum amount read per read operation (unless
+// a larger buffer is needed for a large message).
+const size_t kReadSlabSize = MessageBufferPool::kMaxPooledBufferSize;
+
+}  // namespace
+
 // RawChannel::ReadBuffer ------------------------------------------------------
 
-RawChannel::ReadBuffer::ReadBuffer() : buffer_(kReadSize), num_valid_bytes_(0) {
-}
+RawChannel::ReadBuffer::ReadBuffer()
+    : buffer_size_(0), data_offset_(0), num_valid_bytes_(0) {}
 
 RawChannel::ReadBuffer::~ReadBuffer() {
+  num_valid_bytes_ = 0;
+  ReleaseIfEmpty();
 }
 
 void RawChannel::ReadBuffer::GetBuffer(char** addr, size_t* size) {
-  DCHECK_GE(buffer_.size(), num_valid_bytes_ + kReadSize);
-  *addr = &buffer_[0] + num_valid_bytes_;
-  *size = kReadSize;
+  if (!buffer_) {
+    DCHECK_EQ(num_valid_bytes_, 0u);
+    buffer_ = MessageBufferPool::AllocBuffer(kReadSlabSize);
+    buffer_size_ = kReadSlabSize;
+    data_offset_ = 0;
+  } else if (buffer_size_ - data_offset_ - num_valid_bytes_ < kReadSize) {
+    if (buffer_size_ - num_valid_bytes_ >= kReadSize) {
+      // Move the (partial) undispatched data back to the start.
+      memmove(buffer_.get(), data(), num_valid_bytes_);
+    } else {
+      // Use power-of-2 buffer sizes.
+      // TODO(vtl): Make sure the buffer doesn't get too large (and enforce the
+      // maximum message size to whatever extent necessary).
+      // TODO(vtl): We may often be able to peek at the header and get the real
+      // required extra space (which may be much bigger than |kReadSize|).
+      size_t new_size = buffer_size_;
+      while (new_size < num_valid_bytes_ + kReadSize)
+        new_size *= 2;
+
+      MessageBufferPtr new_buffer = MessageBufferPool::AllocBuffer(new_size);
+      memcpy(new_buffer.get(), data(), num_valid_bytes_);
+      buffer_ = std::move(new_buffer);
+      buffer_size_ = new_size;
+    }
+    data_offset_ = 0;
+  }
+
+  DCHECK_GE(buffer_size_ - data_offset_ - num_valid_bytes_, kReadSize);
+  *addr = buffer_.get() + data_offset_ + num_valid_bytes_;
+  *size = buffer_size_ - data_offset_ - num_valid_bytes_;
+}
+
+void RawChannel::ReadBuffer::Discard(size_t num_bytes) {
+  DCHECK_LE(num_bytes, num_valid_bytes_);
+  data_offset_ += num_bytes;
+  num_valid_bytes_ -= num_bytes;
+  if (num_valid_bytes_ == 0)
+    data_offset_ = 0;
+}
+
+void RawChannel::ReadBuffer::ReleaseIfEmpty() {
+  if (!buffer_ || num_valid_bytes_ > 0)
+    return;
+
+  buffer_.reset();
+  buffer_size_ = 0;
+  data_offset_ = 0;
 }
 
 // RawChannel::WriteBuffer -----------------------------------------------------
 
+// static
+const size_t RawChannel::WriteBuffer::kMaxBufferCount;
+
 RawChannel::WriteBuffer::WriteBuffer(size_t serialized_platform_handle_size)
     : serialized_platform_handle_size_(serialized_platform_handle_size),
       platform_handles_offset_(0),
@@ -104,55 +169,49 @@ void RawChannel::WriteBuffer::GetPlatformHandlesToSend(
 void RawChannel::WriteBuffer::GetBuffers(std::vector<Buffer>* buffers) const {
   buffers->clear();
 
-  if (message_queue_.IsEmpty())
-    return;
+  size_t offset = data_offset_;
+  for (size_t i = 0;
+       i < message_queue_.Size() && buffers->size() < kMaxBufferCount; i++) {
+    const MessageInTransit* message = message_queue_.PeekMessageAt(i);
+    if (i > 0) {
+      // Stop at the next message with platform handles, since they have to be
+      // sent with (the start of) that message's data.
+      const TransportData* transport_data = message->transport_data();
+      if (transport_data && transport_data->platform_handles() &&
+          !transport_data->platform_handles()->empty())
+        break;
+      // Leave room for both of the message's buffers.
+      if (buffers->size() + 2 > kMaxBufferCount)
+        break;
+    }
 
-  const MessageInTransit* message = message_queue_.PeekMessage();
-  DCHECK_LT(data_offset_, message->total_size());
-  size_t bytes_to_write = message->total_size() - data_offset_;
-
-  size_t transport_data_buffer_size =
-      message->transport_data() ? message->transport_data()->buffer_size() : 0;
-
-  if (!transport_data_buffer_size) {
-    // Only write from the main buffer.
-    DCHECK_LT(data_offset_, message->main_buffer_size());
-    DCHECK_LE(bytes_to_write, message->main_buffer_size());
-    Buffer buffer = {
-        static_cast<const char*>(message->main_buffer()) + data_offset_,
-        bytes_to_write};
-    buffers->push_back(buffer);
-    return;
-  }
+    DCHECK_LT(offset, message->total_size());
+    size_t transport_data_buffer_size =
+        message->transport_data() ? message->transport_data()->buffer_size()
+                                  : 0;
 
-  if (data_offset_ >= message->main_buffer_size()) {
-    // Only write from the transport data buffer.
-    DCHECK_LT(data_offset_ - message->main_buffer_size(),
-              transport_data_buffer_size);
-    DCHECK_LE(bytes_to_write, transport_data_buffer_size);
-    Buffer buffer = {
-        static_cast<const char*>(message->transport_data()->buffer()) +
-            (data_offset_ - message->main_buffer_size()),
-        bytes_to_write};
-    buffers->push_back(buffer);
-    return;
-  }
+    if (offset < message->main_buffer_size()) {
+      Buffer buffer = {
+          static_cast<const char*>(message->main_buffer()) + offset,
+          message->main_buffer_size() - offset};
+      buffers->push_back(buffer);
+    }
+    if (transport_data_buffer_size) {
+      size_t transport_data_offset =
+          offset > message->main_buffer_size()
+              ? offset - message->main_buffer_size()
+              : 0;
+      DCHECK_LT(transport_data_offset, transport_data_buffer_size);
+      Buffer buffer = {
+          static_cast<const char*>(message->transport_data()->buffer()) +
+              transport_data_offset,
+          transport_data_buffer_size - transport_data_offset};
+      buffers->push_back(buffer);
+    }
 
-  // TODO(vtl): We could actually send out buffers from multiple messages, with
-  // the "stopping" condition being reaching a message with platform handles
-  // attached.
-
-  // Write from both buffers.
-  DCHECK_EQ(bytes_to_write, message->main_buffer_size() - data_offset_ +
-                                transport_data_buffer_size);
-  Buffer buffer1 = {
-      static_cast<const char*>(message->main_buffer()) + data_offset_,
-      message->main_buffer_size() - data_offset_};
-  buffers->push_back(buffer1);
-  Buffer buffer2 = {
-      static_cast<const char*>(message->transport_data()->buffer()),
-      transport_data_buffer_size};
-  buffers->push_back(buffer2);
+    // Only the first message may have been partially written.
+    offset = 0;
+  }
 }
 
 // RawChannel ------------------------------------------------------------------
@@ -162,6 +221,14 @@ RawChannel::RawChannel()
       delegate_(nullptr),
       set_on_shutdown_(nullptr),
       write_stopped_(false),
+      writes_delayed_(false),
+      writes_delayed_time_(0),
+      last_write_time_(0),
+      write_stats_(),
+      num_reads_(0),
+      num_messages_read_(0),
+      num_bytes_read_(0),
+      num_platform_handles_read_(0),
       weak_ptr_factory_(this) {}
 
 RawChannel::~RawChannel() {
@@ -216,6 +283,12 @@ void RawChannel::Shutdown() {
 
   MutexLocker locker(&write_mutex_);
 
+  // Don't drop messages just because they were being held back.
+  if (writes_delayed_) {
+    writes_delayed_ = false;
+    StartWriteNoLock();
+  }
+
   LOG_IF(WARNING, !write_buffer_->message_queue_.IsEmpty())
       << "Shutting down RawChannel with write buffer nonempty";
 
@@ -239,22 +312,41 @@ bool RawChannel::WriteMessage(std::unique_ptr<MessageInTransit> message) {
   if (write_stopped_)
     return false;
 
+  const MojoTimeTicks max_delay = static_cast<MojoTimeTicks>(
+      GetConfiguration().max_channel_write_coalescing_delay_microseconds);
+  MojoTimeTicks now = max_delay ? GetTimeTicks() : 0;
+
   if (!write_buffer_->message_queue_.IsEmpty()) {
+    // Either a write is pending or messages are being held back. In either
+    // case, this message will be written together with the queued ones.
     EnqueueMessageNoLock(std::move(message));
-    return true;
+    // Don't hold messages back for longer than |max_delay|, even if
+    // |FlushDelayedWrites()| hasn't run yet.
+    if (!writes_delayed_ || now - writes_delayed_time_ < max_delay)
+      return true;
+    writes_delayed_ = false;
+  } else {
+    EnqueueMessageNoLock(std::move(message));
+
+    // If we're writing messages in quick succession, hold this one back (for
+    // now), so that it can be written together with later ones.
+    if (max_delay && now - last_write_time_ < max_delay) {
+      last_write_time_ = now;
+      writes_delayed_ = true;
+      writes_delayed_time_ = now;
+      write_stats_.num_coalescing_delays++;
+      auto weak_self = weak_ptr_factory_.GetWeakPtr();
+      io_task_runner_->PostTask([weak_self]() {
+        if (weak_self)
+          weak_self->FlushDelayedWrites();
+      });
+      return true;
+    }
+    last_write_time_ = now;
   }
 
-  EnqueueMessageNoLock(std::move(message));
   DCHECK_EQ(write_buffer_->data_offset_, 0u);
-
-  size_t platform_handles_written = 0;
-  size_t bytes_written = 0;
-  IOResult io_result = WriteNoLock(&platform_handles_written, &bytes_written);
-  if (io_result == IO_PENDING)
-    return true;
-
-  bool result = OnWriteCompletedNoLock(io_result, platform_handles_written,
-                                       bytes_written);
+  bool result = StartWriteNoLock();
   if (!result) {
     // Even if we're on the I/O thread, don't call |OnError()| in the nested
     // context.
@@ -275,6 +367,33 @@ bool RawChannel::IsWriteBufferEmpty() {
   return write_buffer_->message_queue_.IsEmpty();
 }
 
+// Reminder: This must be thread-safe.
+void RawChannel::GetWriteStats(WriteStats* write_stats) {
+  MutexLocker locker(&write_mutex_);
+  *write_stats = write_stats_;
+
+  // After |Shutdown()|, there's no write buffer (and nothing pending).
+  write_stats->num_messages_pending = 0;
+  write_stats->num_bytes_pending = 0;
+  if (!write_buffer_)
+    return;
+  const MessageInTransitQueue& queue = write_buffer_->message_queue_;
+  for (size_t i = 0; i < queue.Size(); i++)
+    write_stats->num_bytes_pending += queue.PeekMessageAt(i)->total_size();
+  write_stats->num_messages_pending = queue.Size();
+  write_stats->num_bytes_pending -= write_buffer_->data_offset_;
+}
+
+// Reminder: This must be thread-safe.
+void RawChannel::GetReadStats(ReadStats* read_stats) {
+  read_stats->num_reads = num_reads_.load(std::memory_order_relaxed);
+  read_stats->num_messages_read =
+      num_messages_read_.load(std::memory_order_relaxed);
+  read_stats->num_bytes_read = num_bytes_read_.load(std::memory_order_relaxed);
+  read_stats->num_platform_handles_read =
+      num_platform_handles_read_.load(std::memory_order_relaxed);
+}
+
 void RawChannel::OnReadCompleted(IOResult io_result, size_t bytes_read) {
   DCHECK(io_task_runner_->RunsTasksOnCurrentThread());
 
@@ -297,28 +416,32 @@ void RawChannel::OnReadCompleted(IOResult io_result, size_t bytes_read) {
         return;
     }
 
+    num_reads_.fetch_add(1, std::memory_order_relaxed);
+    num_bytes_read_.fetch_add(bytes_read, std::memory_order_relaxed);
     read_buffer_->num_valid_bytes_ += bytes_read;
-
-    // Dispatch all the messages that we can.
+    // If the read filled all the space it was given, there's probably more to
+    // read.
+    bool filled_read_buffer =
+        read_buffer_->buffer_ &&
+        read_buffer_->data_offset_ + read_buffer_->num_valid_bytes_ ==
+            read_buffer_->buffer_size_;
+
+    // Dispatch all the messages that we can. The message views point directly
+    // into |read_buffer_|.
     bool did_dispatch_message = false;
-    // Tracks the offset of the first undispatched message in |read_buffer_|.
-    // Currently, we copy data to ensure that this is zero at the beginning.
-    size_t read_buffer_start = 0;
-    size_t remaining_bytes = read_buffer_->num_valid_bytes_;
     size_t message_size;
     // Note that we rely on short-circuit evaluation here:
-    //   - |read_buffer_start| may be an invalid index into
-    //     |read_buffer_->buffer_| if |remaining_bytes| is zero.
+    //   - |read_buffer_->data()| may be invalid if |num_valid_bytes_| is zero.
     //   - |message_size| is only valid if |GetNextMessageSize()| returns true.
     // TODO(vtl): Use |message_size| more intelligently (e.g., to request the
     // next read).
     // TODO(vtl): Validate that |message_size| is sane.
-    while (remaining_bytes > 0 && MessageInTransit::GetNextMessageSize(
-                                      &read_buffer_->buffer_[read_buffer_start],
-                                      remaining_bytes, &message_size) &&
-           remaining_bytes >= message_size) {
-      MessageInTransit::View message_view(
-          message_size, &read_buffer_->buffer_[read_buffer_start]);
+    while (read_buffer_->num_valid_bytes_ > 0 &&
+           MessageInTransit::GetNextMessageSize(read_buffer_->data(),
+                                                read_buffer_->num_valid_bytes_,
+                                                &message_size) &&
+           read_buffer_->num_valid_bytes_ >= message_size) {
+      MessageInTransit::View message_view(message_size, read_buffer_->data());
       DCHECK_EQ(message_view.total_size(), message_size);
 
       const char* error_message = nullptr;
@@ -330,6 +453,7 @@ void RawChannel::OnReadCompleted(IOResult io_result, size_t bytes_read) {
         return;  // |this| may have been destroyed in |CallOnError()|.
       }
 
+      num_messages_read_.fetch_add(1, std::memory_order_relaxed);
       if (message_view.type() == MessageInTransit::Type::RAW_CHANNEL) {
         if (!OnReadMessageForRawChannel(message_view)) {
           CallOnError(Delegate::ERROR_READ_BAD_MESSAGE);
@@ -352,6 +476,8 @@ void RawChannel::OnReadCompleted(IOResult io_result, size_t bytes_read) {
               CallOnError(Delegate::ERROR_READ_BAD_MESSAGE);
               return;  // |this| may have been destroyed in |CallOnError()|.
             }
+            num_platform_handles_read_.fetch_add(num_platform_handles,
+                                                 std::memory_order_relaxed);
           }
         }
 
@@ -373,34 +499,8 @@ void RawChannel::OnReadCompleted(IOResult io_result, size_t bytes_read) {
 
       did_dispatch_message = true;
 
-      // Update our state.
-      read_buffer_start += message_size;
-      remaining_bytes -= message_size;
-    }
-
-    if (read_buffer_start > 0) {
-      // Move data back to start.
-      read_buffer_->num_valid_bytes_ = remaining_bytes;
-      if (read_buffer_->num_valid_bytes_ > 0) {
-        memmove(&read_buffer_->buffer_[0],
-                &read_buffer_->buffer_[read_buffer_start], remaining_bytes);
-      }
-      read_buffer_start = 0;
-    }
-
-    if (read_buffer_->buffer_.size() - read_buffer_->num_valid_bytes_ <
-        kReadSize) {
-      // Use power-of-2 buffer sizes.
-      // TODO(vtl): Make sure the buffer doesn't get too large (and enforce the
-      // maximum message size to whatever extent necessary).
-      // TODO(vtl): We may often be able to peek at the header and get the real
-      // required extra space (which may be much bigger than |kReadSize|).
-      size_t new_size = std::max(read_buffer_->buffer_.size(), kReadSize);
-      while (new_size < read_buffer_->num_valid_bytes_ + kReadSize)
-        new_size *= 2;
-
-      // TODO(vtl): It's suboptimal to zero out the fresh memory.
-      read_buffer_->buffer_.resize(new_size, 0);
+      // Update our state. (This doesn't move any data.)
+      read_buffer_->Discard(message_size);
     }
 
     // (1) If we dispatched any messages, stop reading for now (and let the
@@ -409,10 +509,16 @@ void RawChannel::OnReadCompleted(IOResult io_result, size_t bytes_read) {
     // a single message. Risks: slower, more complex if we want to avoid lots of
     // copying. ii. Keep reading until there's no more data and dispatch all the
     // messages we can. Risks: starvation of other users of the message loop.)
-    // (2) If we didn't max out |kReadSize|, stop reading for now.
-    bool schedule_for_later = did_dispatch_message || bytes_read < kReadSize;
+    // (2) If we didn't fill the read buffer, stop reading for now.
+    bool schedule_for_later = did_dispatch_message || !filled_read_buffer;
     bytes_read = 0;
-    io_result = schedule_for_later ? ScheduleRead() : Read(&bytes_read);
+    if (schedule_for_later) {
+      // Don't hold on to the read buffer while waiting, unless we have to.
+      read_buffer_->ReleaseIfEmpty();
+      io_result = ScheduleRead();
+    } else {
+      io_result = Read(&bytes_read);
+    }
   } while (io_result != IO_PENDING);
 }
 
@@ -483,6 +589,42 @@ void RawChannel::CallOnError(Delegate::Error error) {
   }
 }
 
+void RawChannel::FlushDelayedWrites() {
+  DCHECK(io_task_runner_->RunsTasksOnCurrentThread());
+
+  bool did_fail = false;
+  {
+    MutexLocker locker(&write_mutex_);
+    // The messages may already have been written (see |WriteMessage()|).
+    if (!writes_delayed_)
+      return;
+    writes_delayed_ = false;
+    did_fail = !StartWriteNoLock();
+  }
+
+  if (did_fail) {
+    CallOnError(Delegate::ERROR_WRITE);
+    return;  // |this| may have been destroyed in |CallOnError()|.
+  }
+}
+
+bool RawChannel::StartWriteNoLock() {
+  write_mutex_.AssertHeld();
+
+  DCHECK(!write_stopped_);
+  DCHECK(!write_buffer_->message_queue_.IsEmpty());
+  DCHECK(!writes_delayed_);
+
+  size_t platform_handles_written = 0;
+  size_t bytes_written = 0;
+  IOResult io_result = WriteNoLock(&platform_handles_written, &bytes_written);
+  if (io_result == IO_PENDING)
+    return true;
+
+  return OnWriteCompletedNoLock(io_result, platform_handles_written,
+                                bytes_written);
+}
+
 bool RawChannel::OnWriteCompletedNoLock(IOResult io_result,
                                         size_t platform_handles_written,
                                         size_t bytes_written) {
@@ -492,19 +634,31 @@ bool RawChannel::OnWriteCompletedNoLock(IOResult io_result,
   DCHECK(!write_buffer_->message_queue_.IsEmpty());
 
   if (io_result == IO_SUCCEEDED) {
+    write_stats_.num_writes++;
+    write_stats_.num_bytes_written += bytes_written;
+    write_stats_.num_platform_handles_written += platform_handles_written;
+
     write_buffer_->platform_handles_offset_ += platform_handles_written;
     write_buffer_->data_offset_ += bytes_written;
 
-    MessageInTransit* message = write_buffer_->message_queue_.PeekMessage();
-    if (write_buffer_->data_offset_ >= message->total_size()) {
+    // Discard the messages that were completely written (there may be several,
+    // since |GetBuffers()| may provide buffers from several messages).
+    while (!write_buffer_->message_queue_.IsEmpty()) {
+      size_t message_size =
+          write_buffer_->message_queue_.PeekMessage()->total_size();
+      if (write_buffer_->data_offset_ < message_size)
+        break;
+
       // Complete write.
-      CHECK_EQ(write_buffer_->data_offset_, message->total_size());
       write_buffer_->message_queue_.DiscardMessage();
       write_buffer_->platform_handles_offset_ = 0;
-      write_buffer_->data_offset_ = 0;
+      write_buffer_->data_offset_ -= message_size;
+      write_stats_.num_messages_written++;
+    }
 
-      if (write_buffer_->message_queue_.IsEmpty())
-        return true;
+    if (write_buffer_->message_queue_.IsEmpty()) {
+      CHECK_EQ(write_buffer_->data_offset_, 0u);
+      return true;
     }
 
     // Schedule the next write.
@@ -5,6 +5,9 @@
 #ifndef MOJO_EDK_SYSTEM_RAW_CHANNEL_H_
 #define MOJO_EDK_SYSTEM_RAW_CHANNEL_H_
 
+#include <stdint.h>
+
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -12,12 +15,14 @@
 #include "mojo/edk/platform/platform_handle_watcher.h"
 #include "mojo/edk/platform/scoped_platform_handle.h"
 #include "mojo/edk/platform/task_runner.h"
+#include "mojo/edk/system/message_buffer_pool.h"
 #include "mojo/edk/system/message_in_transit.h"
 #include "mojo/edk/system/message_in_transit_queue.h"
 #include "mojo/edk/util/mutex.h"
 #include "mojo/edk/util/ref_ptr.h"
 #include "mojo/edk/util/thread_annotations.h"
 #include "mojo/edk/util/weak_ptr.h"
+#include "mojo/public/c/system/time.h"
 #include "mojo/public/cpp/system/macros.h"
 
 namespace mojo {
@@ -35,9 +40,10 @@ namespace system {
 // OS-specific implementation subclasses are to be instantiated using the
 // |Create()| static factory method.
 //
-// With the exception of |WriteMessage()| and |IsWriteBufferEmpty()|, this class
-// is thread-unsafe (and in general its methods should only be used on the I/O
-// thread, i.e., the thread on which |Init()| is called).
+// With the exception of |WriteMessage()|, |IsWriteBufferEmpty()|, and the
+// statistics getters, this class is thread-unsafe (and in general its methods
+// should only be used on the I/O thread, i.e., the thread on which |Init()| is
+// called).
 class RawChannel {
  public:
   // This object may be destroyed on any thread (if |Init()| was called, after
@@ -110,6 +116,50 @@ class RawChannel {
   // becomes empty (or something like that).
   bool IsWriteBufferEmpty();
 
+  // Statistics about writes. (The average number of messages per write system
+  // call is |num_messages_written / num_writes|.)
+  struct WriteStats {
+    // Number of (successful) write operations (i.e., system calls).
+    uint64_t num_writes;
+    // Number of messages completely written. (This includes any
+    // implementation-specific control messages.)
+    uint64_t num_messages_written;
+    // Number of bytes written.
+    uint64_t num_bytes_written;
+    // Number of times a message was held back (to be written together with
+    // later messages); see
+    // |embedder::Configuration::max_channel_write_coalescing_delay_microseconds|.
+    uint64_t num_coalescing_delays;
+    // Number of platform handles written.
+    uint64_t num_platform_handles_written;
+    // Number of messages (and bytes of them) queued but not yet (completely)
+    // written, at the time of |GetWriteStats()|.
+    uint64_t num_messages_pending;
+    uint64_t num_bytes_pending;
+  };
+
+  // Gets the write statistics (so far). This method is thread-safe and may be
+  // called from any thread.
+  void GetWriteStats(WriteStats* write_stats);
+
+  // Statistics about reads. (The average number of messages per read system
+  // call is |num_messages_read / num_reads|.)
+  struct ReadStats {
+    // Number of (successful) read operations (i.e., system calls).
+    uint64_t num_reads;
+    // Number of messages read and dispatched. (This includes any
+    // implementation-specific control messages.)
+    uint64_t num_messages_read;
+    // Number of bytes read.
+    uint64_t num_bytes_read;
+    // Number of platform handles received with messages.
+    uint64_t num_platform_handles_read;
+  };
+
+  // Gets the read statistics (so far). Like |GetWriteStats()|, this method is
+  // thread-safe and may be called from any thread.
+  void GetReadStats(ReadStats* read_stats);
+
   // Returns the amount of space needed in the |MessageInTransit|'s
   // |TransportData|'s "platform handle table" per platform handle (to be
   // attached to a message). (This amount may be zero.)
@@ -133,16 +183,34 @@ class RawChannel {
     ReadBuffer();
     ~ReadBuffer();
 
+    // Gets the space to read into (which is just after any data that has been
+    // read but not yet dispatched), getting a buffer if necessary. |*size| will
+    // be at least |kReadSize| (and typically much larger).
     void GetBuffer(char** addr, size_t* size);
 
    private:
     friend class RawChannel;
 
-    // We store data from |[Schedule]Read()|s in |buffer_|. The start of
-    // |buffer_| is always aligned with a message boundary (we will copy memory
-    // to ensure this), but |buffer_| may be larger than the actual number of
-    // bytes we have.
-    std::vector<char> buffer_;
+    // Gets the start of the data that has been read but not yet dispatched.
+    // This is always at a message boundary.
+    const char* data() const { return buffer_.get() + data_offset_; }
+
+    // Marks |num_bytes| at the start of |data()| as dispatched.
+    void Discard(size_t num_bytes);
+
+    // Returns |buffer_| to the |MessageBufferPool| if there's no data in it.
+    void ReleaseIfEmpty();
+
+    // We store data from |[Schedule]Read()|s in |buffer_| (which has size
+    // |buffer_size_|), which comes from the |MessageBufferPool|. The data that
+    // hasn't been dispatched yet is at |[data_offset_, data_offset_ +
+    // num_valid_bytes_)|. Dispatched messages aren't removed from the buffer;
+    // only once there isn't enough space left to read into do we copy the
+    // (partial) undispatched data to the start of |buffer_| (or to a larger
+    // buffer). |buffer_| may be null if there's no data.
+    MessageBufferPtr buffer_;
+    size_t buffer_size_;
+    size_t data_offset_;
     size_t num_valid_bytes_;
 
     MOJO_DISALLOW_COPY_AND_ASSIGN(ReadBuffer);
@@ -176,10 +244,15 @@ class RawChannel {
                                   platform::PlatformHandle** platform_handles,
                                   void** serialization_data);
 
-    // Gets buffers to be written. These buffers will always come from the front
-    // of |message_queue_|. Once they are completely written, the front
-    // |MessageInTransit| should be popped (and destroyed); this is done in
-    // |OnWriteCompletedNoLock()|.
+    // Maximum number of buffers that |GetBuffers()| will provide.
+    static const size_t kMaxBufferCount = 64;
+
+    // Gets buffers to be written (at most |kMaxBufferCount|). These buffers
+    // will always come from the front of |message_queue_|, starting with the
+    // first message and continuing with following messages (up to, but not
+    // including, the next message with platform handles attached). Once they
+    // are completely written, the messages should be popped (and destroyed);
+    // this is done in |OnWriteCompletedNoLock()|.
     void GetBuffers(std::vector<Buffer>* buffers) const;
 
    private:
@@ -309,6 +382,15 @@ class RawChannel {
   // object may be destroyed by this call.
   void CallOnError(Delegate::Error error) MOJO_LOCKS_EXCLUDED(write_mutex_);
 
+  // Writes the messages that were held back (see |WriteMessage()|), if they
+  // haven't been written already. Must be called on the I/O thread. This object
+  // may be destroyed by this call.
+  void FlushDelayedWrites() MOJO_LOCKS_EXCLUDED(write_mutex_);
+
+  // Starts writing |write_buffer_| (which must be nonempty, with no write
+  // pending), returning false on failure (see |OnWriteCompletedNoLock()|).
+  bool StartWriteNoLock() MOJO_EXCLUSIVE_LOCKS_REQUIRED(write_mutex_);
+
   // If |io_result| is |IO_SUCCESS|, updates the write buffer and schedules a
   // write operation to run later if there is more to write. If |io_result| is
   // failure or any other error occurs, cancels pending writes and returns
@@ -331,6 +413,21 @@ class RawChannel {
   util::Mutex write_mutex_;  // Protects the following members.
   bool write_stopped_ MOJO_GUARDED_BY(write_mutex_);
   std::unique_ptr<WriteBuffer> write_buffer_ MOJO_GUARDED_BY(write_mutex_);
+  // If true, the messages in |write_buffer_| are being held back (and there's
+  // no pending write); |FlushDelayedWrites()| has been posted to write them.
+  bool writes_delayed_ MOJO_GUARDED_BY(write_mutex_);
+  // When the messages started being held back (valid if |writes_delayed_|).
+  MojoTimeTicks writes_delayed_time_ MOJO_GUARDED_BY(write_mutex_);
+  // When |WriteMessage()| last started a write (or held back a message).
+  MojoTimeTicks last_write_time_ MOJO_GUARDED_BY(write_mutex_);
+  WriteStats write_stats_ MOJO_GUARDED_BY(write_mutex_);
+
+  // Only updated on the I/O thread, but may be read (by |GetReadStats()|) on
+  // any thread.
+  std::atomic<uint64_t> num_reads_;
+  std::atomic<uint64_t> num_messages_read_;
+  std::atomic<uint64_t> num_bytes_read_;
+  std::atomic<uint64_t> num_platform_handles_read_;
 
   // This is used for posting tasks from write threads to the I/O thread. The
   // weak pointers it produces are only used/invalidated on the I/O thread.
@@ -239,9 +239,9 @@ RawChannel::IOResult RawChannelPosix::WriteNoLock(
     std::vector<WriteBuffer::Buffer> buffers;
     write_buffer_no_lock()->GetBuffers(&buffers);
     DCHECK(!buffers.empty());
-    const size_t kMaxBufferCount = 10;
-    iovec iov[kMaxBufferCount];
-    size_t buffer_count = std::min(buffers.size(), kMaxBufferCount);
+    iovec iov[WriteBuffer::kMaxBufferCount];
+    size_t buffer_count =
+        std::min(buffers.size(), WriteBuffer::kMaxBufferCount);
     for (size_t i = 0; i < buffer_count; ++i) {
       iov[i].iov_base = const_cast<char*>(buffers[i].addr);
       iov[i].iov_len = buffers[i].size;
@@ -262,9 +262,9 @@ RawChannel::IOResult RawChannelPosix::WriteNoLock(
       write_result =
           PlatformPipeWrite(fd_.get(), buffers[0].addr, buffers[0].size);
     } else {
-      const size_t kMaxBufferCount = 10;
-      iovec iov[kMaxBufferCount];
-      size_t buffer_count = std::min(buffers.size(), kMaxBufferCount);
+      iovec iov[WriteBuffer::kMaxBufferCount];
+      size_t buffer_count =
+          std::min(buffers.size(), WriteBuffer::kMaxBufferCount);
       for (size_t i = 0; i < buffer_count; ++i) {
         iov[i].iov_base = const_cast<char*>(buffers[i].addr);
         iov[i].iov_len = buffers[i].size;
@@ -18,6 +18,8 @@
 #include "mojo/edk/platform/platform_pipe.h"
 #include "mojo/edk/platform/scoped_platform_handle.h"
 #include "mojo/edk/platform/thread_utils.h"
+#include "mojo/edk/system/configuration.h"
+#include "mojo/edk/system/configuration_test_utils.h"
 #include "mojo/edk/system/message_in_transit.h"
 #include "mojo/edk/system/test/random.h"
 #include "mojo/edk/system/test/scoped_test_dir.h"
@@ -221,6 +223,85 @@ TEST_F(RawChannelTest, WriteMessage) {
   io_thread()->PostTaskAndWait([&rc]() { rc->Shutdown(); });
 }
 
+// RawChannelTest.WriteMessageCoalescing ---------------------------------------
+
+// Tests that messages written in quick succession are written together if
+// |max_channel_write_coalescing_delay_microseconds| is set.
+TEST_F(RawChannelTest, WriteMessageCoalescing) {
+  const size_t kNumMessages = 100;
+
+  test::ScopedConfigurationRestorer configuration_restorer;
+  // Large enough that all the messages below are written "in quick
+  // succession".
+  GetMutableConfiguration()->max_channel_write_coalescing_delay_microseconds =
+      static_cast<size_t>(test::ActionTimeout());
+
+  WriteOnlyRawChannelDelegate delegate;
+  std::unique_ptr<RawChannel> rc(RawChannel::Create(handles[0].Pass()));
+  TestMessageReaderAndChecker checker(handles[1].get());
+  io_thread()->PostTaskAndWait([this, &rc, &delegate]() {
+    rc->Init(io_thread()->task_runner().Clone(),
+             io_thread()->platform_handle_watcher(), &delegate);
+  });
+
+  // Write all the messages from a single task on the I/O thread, so that the
+  // delayed write can't happen until they've all been written.
+  io_thread()->PostTaskAndWait([&rc]() {
+    for (size_t i = 0; i < kNumMessages; i++) {
+      EXPECT_TRUE(
+          rc->WriteMessage(MakeTestMessage(static_cast<uint32_t>(i + 1))));
+    }
+  });
+  for (size_t i = 0; i < kNumMessages; i++) {
+    EXPECT_TRUE(checker.ReadAndCheckNextMessage(static_cast<uint32_t>(i + 1)))
+        << i;
+  }
+
+  RawChannel::WriteStats write_stats = {};
+  rc->GetWriteStats(&write_stats);
+  EXPECT_EQ(kNumMessages, write_stats.num_messages_written);
+  // The first message is written immediately. The rest are held back and then
+  // written in as few writes as possible (which depends on
+  // |WriteBuffer::kMaxBufferCount|).
+  EXPECT_EQ(1u, write_stats.num_coalescing_delays);
+  EXPECT_LE(write_stats.num_writes, 3u);
+
+  io_thread()->PostTaskAndWait([&rc]() { rc->Shutdown(); });
+}
+
+// Tests that, by default, messages aren't held back.
+TEST_F(RawChannelTest, WriteMessageNoCoalescing) {
+  const size_t kNumMessages = 10;
+
+  ASSERT_EQ(0u,
+            GetConfiguration().max_channel_write_coalescing_delay_microseconds);
+
+  WriteOnlyRawChannelDelegate delegate;
+  std::unique_ptr<RawChannel> rc(RawChannel::Create(handles[0].Pass()));
+  TestMessageReaderAndChecker checker(handles[1].get());
+  io_thread()->PostTaskAndWait([this, &rc, &delegate]() {
+    rc->Init(io_thread()->task_runner().Clone(),
+             io_thread()->platform_handle_watcher(), &delegate);
+  });
+
+  for (size_t i = 0; i < kNumMessages; i++) {
+    EXPECT_TRUE(
+        rc->WriteMessage(MakeTestMessage(static_cast<uint32_t>(i + 1))));
+  }
+  for (size_t i = 0; i < kNumMessages; i++) {
+    EXPECT_TRUE(checker.ReadAndCheckNextMessage(static_cast<uint32_t>(i + 1)))
+        << i;
+  }
+
+  RawChannel::WriteStats write_stats = {};
+  rc->GetWriteStats(&write_stats);
+  EXPECT_EQ(kNumMessages, write_stats.num_messages_written);
+  EXPECT_EQ(0u, write_stats.num_coalescing_delays);
+  EXPECT_GE(write_stats.num_writes, 1u);
+
+  io_thread()->PostTaskAndWait([&rc]() { rc->Shutdown(); });
+}
+
 // RawChannelTest.OnReadMessage ------------------------------------------------
 
 class ReadCheckerRawChannelDelegate : public RawChannel::Delegate {
@@ -313,6 +394,117 @@ TEST_F(RawChannelTest, OnReadMessage) {
   io_thread()->PostTaskAndWait([&rc]() { rc->Shutdown(); });
 }
 
+// Tests the read and write statistics.
+TEST_F(RawChannelTest, ReadAndWriteStats) {
+  // Large enough that it can't be written all at once.
+  const uint32_t kLargeMessageSize = 1000 * 1000;
+
+  ReadCheckerRawChannelDelegate delegate;
+  std::unique_ptr<RawChannel> rc(RawChannel::Create(handles[0].Pass()));
+  TestMessageReaderAndChecker checker(handles[1].get());
+  io_thread()->PostTaskAndWait([this, &rc, &delegate]() {
+    rc->Init(io_thread()->task_runner().Clone(),
+             io_thread()->platform_handle_watcher(), &delegate);
+  });
+
+  std::unique_ptr<MessageInTransit> message(MakeTestMessage(kLargeMessageSize));
+  const uint64_t large_message_total_size = message->total_size();
+  EXPECT_TRUE(rc->WriteMessage(std::move(message)));
+
+  // Nothing has been read from the other end, so (at least some of) the
+  // message must still be pending.
+  RawChannel::WriteStats write_stats = {};
+  rc->GetWriteStats(&write_stats);
+  EXPECT_EQ(0u, write_stats.num_messages_written);
+  EXPECT_EQ(1u, write_stats.num_messages_pending);
+  EXPECT_GT(write_stats.num_bytes_pending, 0u);
+  EXPECT_EQ(large_message_total_size,
+            write_stats.num_bytes_written + write_stats.num_bytes_pending);
+
+  EXPECT_TRUE(checker.ReadAndCheckNextMessage(kLargeMessageSize));
+  // The write completes asynchronously (on the I/O thread).
+  io_thread()->PostTaskAndWait([]() {});
+  for (int i = 0; i < 1000; i++) {
+    rc->GetWriteStats(&write_stats);
+    if (!write_stats.num_messages_pending)
+      break;
+    ThreadSleep(test::DeadlineFromMilliseconds(1));
+  }
+  EXPECT_EQ(1u, write_stats.num_messages_written);
+  EXPECT_EQ(large_message_total_size, write_stats.num_bytes_written);
+  EXPECT_EQ(0u, write_stats.num_messages_pending);
+  EXPECT_EQ(0u, write_stats.num_bytes_pending);
+  EXPECT_GT(write_stats.num_writes, 1u);
+  EXPECT_EQ(0u, write_stats.num_platform_handles_written);
+
+  RawChannel::ReadStats read_stats = {};
+  rc->GetReadStats(&read_stats);
+  EXPECT_EQ(0u, read_stats.num_reads);
+  EXPECT_EQ(0u, read_stats.num_messages_read);
+  EXPECT_EQ(0u, read_stats.num_bytes_read);
+
+  const uint32_t kSizes[] = {1, 10, 100, 1000};
+  uint64_t total_size = 0;
+  for (uint32_t size : kSizes)
+    total_size += MakeTestMessage(size)->total_size();
+  delegate.SetExpectedSizes(
+      std::vector<uint32_t>(kSizes, kSizes + MOJO_ARRAYSIZE(kSizes)));
+  for (uint32_t size : kSizes)
+    EXPECT_TRUE(WriteTestMessageToHandle(handles[1].get(), size));
+  delegate.Wait();
+
+  rc->GetReadStats(&read_stats);
+  EXPECT_GE(read_stats.num_reads, 1u);
+  EXPECT_LE(read_stats.num_reads, MOJO_ARRAYSIZE(kSizes));
+  EXPECT_EQ(MOJO_ARRAYSIZE(kSizes), read_stats.num_messages_read);
+  EXPECT_EQ(total_size, read_stats.num_bytes_read);
+  EXPECT_EQ(0u, read_stats.num_platform_handles_read);
+
+  io_thread()->PostTaskAndWait([&rc]() { rc->Shutdown(); });
+
+  // The statistics are still available after shutdown.
+  rc->GetWriteStats(&write_stats);
+  EXPECT_EQ(1u, write_stats.num_messages_written);
+  EXPECT_EQ(0u, write_stats.num_messages_pending);
+  rc->GetReadStats(&read_stats);
+  EXPECT_EQ(MOJO_ARRAYSIZE(kSizes), read_stats.num_messages_read);
+}
+
+// Tests reading many small messages that were all written before the reader
+// was set up (so that they get read in large batches, with messages spanning
+// the reads).
+TEST_F(RawChannelTest, OnReadManySmallMessages) {
+  const size_t kNumMessages = 1000;
+
+  // Write all the messages at once (writing them one at a time may fill up the
+  // socket's buffer, even though there's relatively little data).
+  std::vector<uint32_t> expected_sizes;
+  std::vector<char> all_messages;
+  for (size_t i = 0; i < kNumMessages; i++) {
+    uint32_t size = static_cast<uint32_t>(1 + i % 100);
+    expected_sizes.push_back(size);
+    std::unique_ptr<MessageInTransit> message(MakeTestMessage(size));
+    const char* bytes = static_cast<const char*>(message->main_buffer());
+    all_messages.insert(all_messages.end(), bytes,
+                        bytes + message->main_buffer_size());
+  }
+  size_t write_size = 0;
+  mojo::test::BlockingWrite(handles[1].get(), &all_messages[0],
+                            all_messages.size(), &write_size);
+  EXPECT_EQ(all_messages.size(), write_size);
+
+  ReadCheckerRawChannelDelegate delegate;
+  delegate.SetExpectedSizes(expected_sizes);
+  std::unique_ptr<RawChannel> rc(RawChannel::Create(handles[0].Pass()));
+  io_thread()->PostTaskAndWait([this, &rc, &delegate]() {
+    rc->Init(io_thread()->task_runner().Clone(),
+             io_thread()->platform_handle_watcher(), &delegate);
+  });
+  delegate.Wait();
+
+  io_thread()->PostTaskAndWait([&rc]() { rc->Shutdown(); });
+}
+
 // RawChannelTest.WriteMessageAndOnReadMessage ---------------------------------
 
 class ReadCountdownRawChannelDelegate : public RawChannel::Delegate {
@@ -0,0 +1,73 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mojo/edk/system/reclaimer.h"
+
+#include "base/logging.h"
+#include "mojo/edk/platform/io_thread.h"
+#include "mojo/edk/platform/thread.h"
+#include "mojo/edk/system/message_in_transit_queue.h"
+#include "mojo/edk/util/waitable_event.h"
+
+using mojo::util::AutoResetWaitableEvent;
+
+namespace mojo {
+namespace system {
+
+// static
+std::atomic<Reclaimer*> Reclaimer::current_{nullptr};
+
+Reclaimer::Reclaimer()
+    : thread_platform_handle_watcher_(nullptr), num_pending_(0u) {
+  thread_ = platform::CreateAndStartIOThread(&thread_task_runner_,
+                                             &thread_platform_handle_watcher_);
+
+  Reclaimer* old_current = nullptr;
+  bool was_unset = current_.compare_exchange_strong(old_current, this);
+  DCHECK(was_unset) << "Only one Reclaimer may exist at a time";
+}
+
+Reclaimer::~Reclaimer() {
+  DCHECK(!thread_task_runner_->RunsTasksOnCurrentThread());
+
+  Flush();
+  // From now on, anything closed is torn down synchronously.
+  current_.store(nullptr, std::memory_order_release);
+
+  thread_->Stop();
+  thread_.reset();
+  thread_task_runner_ = nullptr;
+  thread_platform_handle_watcher_ = nullptr;
+}
+
+void Reclaimer::ReclaimMessages(MessageInTransitQueue* message_queue) {
+  DCHECK(message_queue);
+  if (message_queue->IsEmpty())
+    return;
+
+  // TODO(vtl): With C++14 lambda captures, we'll be able to move a
+  // |std::unique_ptr|.
+  MessageInTransitQueue* messages = new MessageInTransitQueue();
+  messages->Swap(message_queue);
+  num_pending_.fetch_add(1u, std::memory_order_relaxed);
+  thread_task_runner_->PostTask([this, messages]() {
+    delete messages;
+    num_pending_.fetch_sub(1u, std::memory_order_release);
+  });
+}
+
+void Reclaimer::Flush() {
+  DCHECK(!thread_task_runner_->RunsTasksOnCurrentThread());
+
+  // Destroying things may hand more things to us (which are posted after our
+  // task), so keep going until there's nothing left.
+  AutoResetWaitableEvent event;
+  do {
+    thread_task_runner_->PostTask([&event]() { event.Signal(); });
+    event.Wait();
+  } while (num_pending_.load(std::memory_order_acquire) > 0u);
+}
+
+}  // namespace system
+}  // namespace mojo
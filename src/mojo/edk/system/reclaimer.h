@@ -0,0 +1,78 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_EDK_SYSTEM_RECLAIMER_H_
+#define MOJO_EDK_SYSTEM_RECLAIMER_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <memory>
+
+#include "mojo/edk/platform/task_runner.h"
+#include "mojo/edk/util/ref_ptr.h"
+#include "mojo/public/cpp/system/macros.h"
+
+namespace mojo {
+
+namespace platform {
+class PlatformHandleWatcher;
+class Thread;
+}
+
+namespace system {
+
+class MessageInTransitQueue;
+
+// |Reclaimer| destroys things handed to it on a private thread, so that threads
+// closing handles don't have to do potentially expensive teardown themselves.
+// Currently, this is used for the messages still queued on a message pipe
+// endpoint when it is closed: destroying them closes any handles attached to
+// them (which may themselves be message pipes with queued messages, and so on).
+// The closing itself (e.g., the peer of a closed message pipe endpoint becoming
+// "peer closed") still happens synchronously.
+//
+// At most one |Reclaimer| may exist at a time; it is owned by |Core| (if
+// |embedder::Configuration::defer_close_teardown| is set) and found via
+// |Get()|. It must not be destroyed while handles may be being closed on other
+// threads.
+//
+// This class is thread-safe.
+class Reclaimer final {
+ public:
+  Reclaimer();
+  // Destroys everything that has been handed to this reclaimer, and stops its
+  // thread. Must not be called on the reclaimer's thread.
+  ~Reclaimer();
+
+  // Gets the current reclaimer, or null if there is none.
+  static Reclaimer* Get() { return current_.load(std::memory_order_acquire); }
+
+  // Takes the messages in |*message_queue| (leaving it empty) and destroys them
+  // on the reclaimer's thread.
+  void ReclaimMessages(MessageInTransitQueue* message_queue);
+
+  // Waits until everything handed to this reclaimer has been destroyed,
+  // including things handed to it while doing so (e.g., the messages queued on
+  // message pipe endpoints attached to reclaimed messages). Must not be called
+  // on the reclaimer's thread.
+  void Flush();
+
+ private:
+  static std::atomic<Reclaimer*> current_;
+
+  std::unique_ptr<platform::Thread> thread_;
+  util::RefPtr<platform::TaskRunner> thread_task_runner_;
+  platform::PlatformHandleWatcher* thread_platform_handle_watcher_;
+
+  // Number of |ReclaimMessages()| whose messages haven't been destroyed yet.
+  std::atomic<size_t> num_pending_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(Reclaimer);
+};
+
+}  // namespace system
+}  // namespace mojo
+
+#endif  // MOJO_EDK_SYSTEM_RECLAIMER_H_
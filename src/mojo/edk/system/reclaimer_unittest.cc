@@ -0,0 +1,136 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mojo/edk/system/reclaimer.h"
+
+#include <memory>
+
+#include "mojo/edk/embedder/platform_support.h"
+#include "mojo/edk/embedder/simple_platform_support.h"
+#include "mojo/edk/system/configuration.h"
+#include "mojo/edk/system/core.h"
+#include "mojo/edk/system/memory.h"
+#include "mojo/edk/system/message_in_transit_queue.h"
+#include "mojo/edk/system/message_in_transit_test_utils.h"
+#include "mojo/public/cpp/system/macros.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using mojo::system::test::MakeTestMessage;
+
+namespace mojo {
+namespace system {
+namespace {
+
+TEST(ReclaimerTest, Basic) {
+  EXPECT_FALSE(Reclaimer::Get());
+
+  {
+    Reclaimer reclaimer;
+    EXPECT_EQ(&reclaimer, Reclaimer::Get());
+
+    // Nothing to do.
+    reclaimer.Flush();
+    MessageInTransitQueue message_queue;
+    reclaimer.ReclaimMessages(&message_queue);
+
+    for (unsigned i = 0; i < 10u; i++)
+      message_queue.AddMessage(MakeTestMessage(i));
+    reclaimer.ReclaimMessages(&message_queue);
+    EXPECT_TRUE(message_queue.IsEmpty());
+    reclaimer.Flush();
+
+    // Destroying the reclaimer should destroy anything outstanding.
+    for (unsigned i = 0; i < 10u; i++)
+      message_queue.AddMessage(MakeTestMessage(i));
+    reclaimer.ReclaimMessages(&message_queue);
+    EXPECT_TRUE(message_queue.IsEmpty());
+  }
+
+  EXPECT_FALSE(Reclaimer::Get());
+}
+
+// Tests closing a message pipe endpoint with (nested) handles in its queue,
+// with |defer_close_teardown| set.
+class ReclaimerCoreTest : public testing::Test {
+ public:
+  ReclaimerCoreTest()
+      : platform_support_(embedder::CreateSimplePlatformSupport()) {}
+  ~ReclaimerCoreTest() override {}
+
+  void SetUp() override {
+    old_defer_close_teardown_ = GetConfiguration().defer_close_teardown;
+    GetMutableConfiguration()->defer_close_teardown = true;
+    core_.reset(new Core(platform_support_.get()));
+  }
+
+  void TearDown() override {
+    core_.reset();
+    GetMutableConfiguration()->defer_close_teardown =
+        old_defer_close_teardown_;
+  }
+
+ protected:
+  Core* core() { return core_.get(); }
+
+  void CreateMessagePipe(MojoHandle* h0, MojoHandle* h1) {
+    ASSERT_EQ(MOJO_RESULT_OK,
+              core()->CreateMessagePipe(NullUserPointer(), MakeUserPointer(h0),
+                                        MakeUserPointer(h1)));
+  }
+
+  // Writes a message to |h| with |h_attached| attached.
+  void WriteMessageWithHandle(MojoHandle h, MojoHandle h_attached) {
+    const char kHello[] = "hello";
+    ASSERT_EQ(MOJO_RESULT_OK,
+              core()->WriteMessage(
+                  h, UserPointer<const void>(kHello),
+                  static_cast<uint32_t>(sizeof(kHello)),
+                  MakeUserPointer(&h_attached), 1u,
+                  MOJO_WRITE_MESSAGE_FLAG_NONE));
+  }
+
+  bool IsPeerClosed(MojoHandle h) {
+    return core()->Wait(h, MOJO_HANDLE_SIGNAL_PEER_CLOSED, 0,
+                        NullUserPointer()) == MOJO_RESULT_OK;
+  }
+
+ private:
+  std::unique_ptr<embedder::PlatformSupport> platform_support_;
+  std::unique_ptr<Core> core_;
+  bool old_defer_close_teardown_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(ReclaimerCoreTest);
+};
+
+TEST_F(ReclaimerCoreTest, DeferredCloseTeardown) {
+  Reclaimer* reclaimer = Reclaimer::Get();
+  ASSERT_TRUE(reclaimer);
+
+  MojoHandle a0, a1, b0, b1, c0, c1;
+  CreateMessagePipe(&a0, &a1);
+  CreateMessagePipe(&b0, &b1);
+  CreateMessagePipe(&c0, &c1);
+
+  // Queue |c1| on |b1|, and then |b1| on |a1|.
+  WriteMessageWithHandle(b0, c1);
+  WriteMessageWithHandle(a0, b1);
+
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(a1));
+  // The peer of the closed endpoint sees it closed immediately.
+  EXPECT_TRUE(IsPeerClosed(a0));
+
+  // Once the reclaimer is done, the handles that were queued (even indirectly)
+  // have been closed.
+  reclaimer->Flush();
+  EXPECT_TRUE(IsPeerClosed(b0));
+  EXPECT_TRUE(IsPeerClosed(c0));
+
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(a0));
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(b0));
+  EXPECT_EQ(MOJO_RESULT_OK, core()->Close(c0));
+}
+
+}  // namespace
+}  // namespace system
+}  // namespace mojo
@@ -293,6 +293,8 @@ bool RemoteConsumerDataPipeImpl::ProducerEndSerialize(
   SerializedDataPipeProducerDispatcher* s =
       static_cast<SerializedDataPipeProducerDispatcher*>(destination);
   s->validated_options = validated_options();
+  s->shared_ring_platform_handle_index = kNoSharedRingPlatformHandleIndex;
+  s->shared_ring_start_index = 0;
   void* destination_for_endpoint = static_cast<char*>(destination) +
                                    sizeof(SerializedDataPipeProducerDispatcher);
 
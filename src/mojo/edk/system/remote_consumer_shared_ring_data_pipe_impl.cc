@@ -0,0 +1,444 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mojo/edk/system/remote_consumer_shared_ring_data_pipe_impl.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include "base/logging.h"
+#include "mojo/edk/system/channel.h"
+#include "mojo/edk/system/channel_endpoint.h"
+#include "mojo/edk/system/data_pipe.h"
+#include "mojo/edk/system/message_in_transit.h"
+#include "mojo/edk/system/message_in_transit_queue.h"
+#include "mojo/edk/system/remote_data_pipe_ack.h"
+
+using mojo::platform::PlatformSharedBuffer;
+using mojo::platform::PlatformSharedBufferMapping;
+using mojo::platform::ScopedPlatformHandle;
+using mojo::util::RefPtr;
+
+namespace mojo {
+namespace system {
+
+namespace {
+
+// TODO(vtl): Copied from remote_consumer_data_pipe_impl.cc.
+bool ValidateIncomingMessage(size_t element_num_bytes,
+                             size_t capacity_num_bytes,
+                             size_t consumer_num_bytes,
+                             const MessageInTransit* message) {
+  // We should only receive endpoint client messages.
+  DCHECK_EQ(message->type(), MessageInTransit::Type::ENDPOINT_CLIENT);
+
+  // But we should check the subtype; only take data pipe acks.
+  if (message->subtype() !=
+      MessageInTransit::Subtype::ENDPOINT_CLIENT_DATA_PIPE_ACK) {
+    LOG(WARNING) << "Received message of unexpected subtype: "
+                 << message->subtype();
+    return false;
+  }
+
+  if (message->num_bytes() != sizeof(RemoteDataPipeAck)) {
+    LOG(WARNING) << "Incorrect message size: " << message->num_bytes()
+                 << " bytes (expected: " << sizeof(RemoteDataPipeAck)
+                 << " bytes)";
+    return false;
+  }
+
+  const RemoteDataPipeAck* ack =
+      static_cast<const RemoteDataPipeAck*>(message->bytes());
+  size_t num_bytes_consumed = ack->num_bytes_consumed;
+
+  if (num_bytes_consumed > consumer_num_bytes) {
+    LOG(WARNING) << "Number of bytes consumed too large: " << num_bytes_consumed
+                 << " bytes (outstanding: " << consumer_num_bytes << " bytes)";
+    return false;
+  }
+
+  if (num_bytes_consumed % element_num_bytes != 0) {
+    LOG(WARNING) << "Number of bytes consumed not a multiple of element size: "
+                 << num_bytes_consumed
+                 << " bytes (element size: " << element_num_bytes << " bytes)";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+RemoteConsumerSharedRingDataPipeImpl::RemoteConsumerSharedRingDataPipeImpl(
+    RefPtr<ChannelEndpoint>&& channel_endpoint,
+    size_t consumer_num_bytes,
+    RefPtr<PlatformSharedBuffer>&& ring_buffer,
+    std::unique_ptr<PlatformSharedBufferMapping> ring_mapping,
+    size_t write_index)
+    : channel_endpoint_(std::move(channel_endpoint)),
+      consumer_num_bytes_(consumer_num_bytes),
+      ring_buffer_(std::move(ring_buffer)),
+      ring_mapping_(std::move(ring_mapping)),
+      write_index_(write_index) {
+  DCHECK(ring_buffer_);
+  DCHECK(ring_mapping_);
+}
+
+RemoteConsumerSharedRingDataPipeImpl::~RemoteConsumerSharedRingDataPipeImpl() {
+}
+
+// static
+bool RemoteConsumerSharedRingDataPipeImpl::ProcessMessagesFromIncomingEndpoint(
+    const MojoCreateDataPipeOptions& validated_options,
+    size_t* consumer_num_bytes,
+    MessageInTransitQueue* messages) {
+  const size_t element_num_bytes = validated_options.element_num_bytes;
+  const size_t capacity_num_bytes = validated_options.capacity_num_bytes;
+
+  if (messages) {
+    while (!messages->IsEmpty()) {
+      std::unique_ptr<MessageInTransit> message(messages->GetMessage());
+      if (!ValidateIncomingMessage(element_num_bytes, capacity_num_bytes,
+                                   *consumer_num_bytes, message.get())) {
+        messages->Clear();
+        return false;
+      }
+
+      const RemoteDataPipeAck* ack =
+          static_cast<const RemoteDataPipeAck*>(message->bytes());
+      *consumer_num_bytes -= ack->num_bytes_consumed;
+    }
+  }
+
+  return true;
+}
+
+void RemoteConsumerSharedRingDataPipeImpl::ProducerClose() {
+  if (consumer_open())
+    Disconnect();
+  DestroyRing();
+}
+
+MojoResult RemoteConsumerSharedRingDataPipeImpl::ProducerWriteData(
+    UserPointer<const void> elements,
+    UserPointer<uint32_t> num_bytes,
+    uint32_t max_num_bytes_to_write,
+    uint32_t min_num_bytes_to_write) {
+  DCHECK_EQ(max_num_bytes_to_write % element_num_bytes(), 0u);
+  DCHECK_EQ(min_num_bytes_to_write % element_num_bytes(), 0u);
+  DCHECK_GT(max_num_bytes_to_write, 0u);
+  DCHECK_GE(max_num_bytes_to_write, min_num_bytes_to_write);
+  DCHECK(consumer_open());
+  DCHECK(channel_endpoint_);
+
+  DCHECK_LE(consumer_num_bytes_, capacity_num_bytes());
+  DCHECK_EQ(consumer_num_bytes_ % element_num_bytes(), 0u);
+
+  if (min_num_bytes_to_write > capacity_num_bytes() - consumer_num_bytes_)
+    return MOJO_RESULT_OUT_OF_RANGE;
+
+  size_t num_bytes_to_write =
+      std::min(static_cast<size_t>(max_num_bytes_to_write),
+               capacity_num_bytes() - consumer_num_bytes_);
+  if (num_bytes_to_write == 0)
+    return MOJO_RESULT_SHOULD_WAIT;
+
+  // The amount we can write in our first copy.
+  size_t num_bytes_to_write_first =
+      std::min(num_bytes_to_write, GetMaxNumBytesToWrite());
+  // Do the first (and possibly only) copy.
+  elements.GetArray(ring() + write_index_, num_bytes_to_write_first);
+
+  if (num_bytes_to_write_first < num_bytes_to_write) {
+    // The "second write index" is zero.
+    elements.At(num_bytes_to_write_first)
+        .GetArray(ring(), num_bytes_to_write - num_bytes_to_write_first);
+  }
+
+  MarkDataAsWritten(num_bytes_to_write);
+  // As with |RemoteConsumerDataPipeImpl|, we report |num_bytes_to_write| even
+  // if we failed to notify the consumer.
+  num_bytes.Put(static_cast<uint32_t>(num_bytes_to_write));
+  return MOJO_RESULT_OK;
+}
+
+MojoResult RemoteConsumerSharedRingDataPipeImpl::ProducerBeginWriteData(
+    UserPointer<void*> buffer,
+    UserPointer<uint32_t> buffer_num_bytes) {
+  DCHECK(consumer_open());
+  DCHECK(channel_endpoint_);
+
+  size_t max_num_bytes_to_write = GetMaxNumBytesToWrite();
+  // Don't go into a two-phase write if there's no room.
+  if (max_num_bytes_to_write == 0)
+    return MOJO_RESULT_SHOULD_WAIT;
+
+  buffer.Put(ring() + write_index_);
+  buffer_num_bytes.Put(static_cast<uint32_t>(max_num_bytes_to_write));
+  set_producer_two_phase_max_num_bytes_written(
+      static_cast<uint32_t>(max_num_bytes_to_write));
+  return MOJO_RESULT_OK;
+}
+
+MojoResult RemoteConsumerSharedRingDataPipeImpl::ProducerBeginWriteDataSpans(
+    UserPointer<void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes) {
+  DCHECK(consumer_open());
+  DCHECK(channel_endpoint_);
+
+  size_t max_num_bytes_to_write = GetMaxNumBytesToWrite();
+  // Don't go into a two-phase write if there's no room.
+  if (max_num_bytes_to_write == 0)
+    return MOJO_RESULT_SHOULD_WAIT;
+  // Any remaining free space is at the beginning of the ring.
+  size_t num_bytes_wrapped =
+      capacity_num_bytes() - consumer_num_bytes_ - max_num_bytes_to_write;
+
+  buffers.At(0).Put(ring() + write_index_);
+  buffers_num_bytes.At(0).Put(static_cast<uint32_t>(max_num_bytes_to_write));
+  buffers.At(1).Put(num_bytes_wrapped ? ring() : nullptr);
+  buffers_num_bytes.At(1).Put(static_cast<uint32_t>(num_bytes_wrapped));
+  set_producer_two_phase_max_num_bytes_written(
+      static_cast<uint32_t>(max_num_bytes_to_write + num_bytes_wrapped));
+  return MOJO_RESULT_OK;
+}
+
+MojoResult RemoteConsumerSharedRingDataPipeImpl::ProducerEndWriteData(
+    uint32_t num_bytes_written) {
+  DCHECK_LE(num_bytes_written, producer_two_phase_max_num_bytes_written());
+  DCHECK_EQ(num_bytes_written % element_num_bytes(), 0u);
+  DCHECK_LE(num_bytes_written, capacity_num_bytes() - consumer_num_bytes_);
+
+  set_producer_two_phase_max_num_bytes_written(0);
+  if (!consumer_open()) {
+    DestroyRing();
+    return MOJO_RESULT_OK;
+  }
+
+  MarkDataAsWritten(num_bytes_written);
+  return MOJO_RESULT_OK;
+}
+
+HandleSignalsState
+RemoteConsumerSharedRingDataPipeImpl::ProducerGetHandleSignalsState() const {
+  HandleSignalsState rv;
+  if (consumer_open()) {
+    if (!producer_in_two_phase_write()) {
+      // |producer_write_threshold_num_bytes()| is always at least 1.
+      if (capacity_num_bytes() - consumer_num_bytes_ >=
+          producer_write_threshold_num_bytes()) {
+        rv.satisfied_signals |=
+            MOJO_HANDLE_SIGNAL_WRITABLE | MOJO_HANDLE_SIGNAL_WRITE_THRESHOLD;
+      } else if (consumer_num_bytes_ < capacity_num_bytes()) {
+        rv.satisfied_signals |= MOJO_HANDLE_SIGNAL_WRITABLE;
+      }
+    }
+    rv.satisfiable_signals |=
+        MOJO_HANDLE_SIGNAL_WRITABLE | MOJO_HANDLE_SIGNAL_WRITE_THRESHOLD;
+  } else {
+    rv.satisfied_signals |= MOJO_HANDLE_SIGNAL_PEER_CLOSED;
+  }
+  rv.satisfiable_signals |= MOJO_HANDLE_SIGNAL_PEER_CLOSED;
+  return rv;
+}
+
+void RemoteConsumerSharedRingDataPipeImpl::ProducerStartSerialize(
+    Channel* channel,
+    size_t* max_size,
+    size_t* max_platform_handles) {
+  *max_size = sizeof(SerializedDataPipeProducerDispatcher) +
+              channel->GetSerializedEndpointSize();
+  *max_platform_handles = 1;
+}
+
+bool RemoteConsumerSharedRingDataPipeImpl::ProducerEndSerialize(
+    Channel* channel,
+    void* destination,
+    size_t* actual_size,
+    std::vector<ScopedPlatformHandle>* platform_handles) {
+  SerializedDataPipeProducerDispatcher* s =
+      static_cast<SerializedDataPipeProducerDispatcher*>(destination);
+  s->validated_options = validated_options();
+  s->shared_ring_platform_handle_index = kNoSharedRingPlatformHandleIndex;
+  s->shared_ring_start_index = 0;
+  void* destination_for_endpoint = static_cast<char*>(destination) +
+                                   sizeof(SerializedDataPipeProducerDispatcher);
+
+  if (!consumer_open()) {
+    // Case 1: The consumer is closed.
+    DestroyRing();
+    s->consumer_num_bytes = static_cast<size_t>(-1);
+    *actual_size = sizeof(SerializedDataPipeProducerDispatcher);
+    return true;
+  }
+
+  // Case 2: The consumer isn't closed. We pass |channel_endpoint| back to the
+  // |Channel|, along with (a duplicate of) the ring buffer's handle; the new
+  // producer continues writing to the same ring buffer. There's no reason for
+  // us to continue to exist afterwards.
+  ScopedPlatformHandle platform_handle(ring_buffer_->DuplicatePlatformHandle());
+  if (!platform_handle.is_valid()) {
+    LOG(ERROR) << "Failed to duplicate data pipe ring buffer handle";
+    Disconnect();
+    DestroyRing();
+    return false;
+  }
+  s->consumer_num_bytes = consumer_num_bytes_;
+  s->shared_ring_platform_handle_index =
+      static_cast<uint32_t>(platform_handles->size());
+  platform_handles->push_back(std::move(platform_handle));
+  s->shared_ring_start_index = static_cast<uint32_t>(
+      (write_index_ + capacity_num_bytes() - consumer_num_bytes_) %
+      capacity_num_bytes());
+
+  // Note: We don't use |port|.
+  RefPtr<ChannelEndpoint> channel_endpoint;
+  channel_endpoint.swap(channel_endpoint_);
+  channel->SerializeEndpointWithRemotePeer(destination_for_endpoint, nullptr,
+                                           std::move(channel_endpoint));
+  SetConsumerClosed();
+  DestroyRing();
+
+  *actual_size = sizeof(SerializedDataPipeProducerDispatcher) +
+                 channel->GetSerializedEndpointSize();
+  return true;
+}
+
+void RemoteConsumerSharedRingDataPipeImpl::ConsumerClose() {
+  NOTREACHED();
+}
+
+MojoResult RemoteConsumerSharedRingDataPipeImpl::ConsumerReadData(
+    UserPointer<void> /*elements*/,
+    UserPointer<uint32_t> /*num_bytes*/,
+    uint32_t /*max_num_bytes_to_read*/,
+    uint32_t /*min_num_bytes_to_read*/,
+    bool /*peek*/) {
+  NOTREACHED();
+  return MOJO_RESULT_INTERNAL;
+}
+
+MojoResult RemoteConsumerSharedRingDataPipeImpl::ConsumerDiscardData(
+    UserPointer<uint32_t> /*num_bytes*/,
+    uint32_t /*max_num_bytes_to_discard*/,
+    uint32_t /*min_num_bytes_to_discard*/) {
+  NOTREACHED();
+  return MOJO_RESULT_INTERNAL;
+}
+
+MojoResult RemoteConsumerSharedRingDataPipeImpl::ConsumerQueryData(
+    UserPointer<uint32_t> /*num_bytes*/) {
+  NOTREACHED();
+  return MOJO_RESULT_INTERNAL;
+}
+
+MojoResult RemoteConsumerSharedRingDataPipeImpl::ConsumerBeginReadData(
+    UserPointer<const void*> /*buffer*/,
+    UserPointer<uint32_t> /*buffer_num_bytes*/) {
+  NOTREACHED();
+  return MOJO_RESULT_INTERNAL;
+}
+
+MojoResult RemoteConsumerSharedRingDataPipeImpl::ConsumerEndReadData(
+    uint32_t /*num_bytes_read*/) {
+  NOTREACHED();
+  return MOJO_RESULT_INTERNAL;
+}
+
+HandleSignalsState
+RemoteConsumerSharedRingDataPipeImpl::ConsumerGetHandleSignalsState() const {
+  return HandleSignalsState();
+}
+
+void RemoteConsumerSharedRingDataPipeImpl::ConsumerStartSerialize(
+    Channel* /*channel*/,
+    size_t* /*max_size*/,
+    size_t* /*max_platform_handles*/) {
+  NOTREACHED();
+}
+
+bool RemoteConsumerSharedRingDataPipeImpl::ConsumerEndSerialize(
+    Channel* /*channel*/,
+    void* /*destination*/,
+    size_t* /*actual_size*/,
+    std::vector<ScopedPlatformHandle>* /*platform_handles*/) {
+  NOTREACHED();
+  return false;
+}
+
+bool RemoteConsumerSharedRingDataPipeImpl::OnReadMessage(
+    unsigned /*port*/,
+    MessageInTransit* message) {
+  // Always take ownership of the message. (This means that we should always
+  // return true.)
+  std::unique_ptr<MessageInTransit> msg(message);
+
+  if (!ValidateIncomingMessage(element_num_bytes(), capacity_num_bytes(),
+                               consumer_num_bytes_, msg.get())) {
+    Disconnect();
+    return true;
+  }
+
+  const RemoteDataPipeAck* ack =
+      static_cast<const RemoteDataPipeAck*>(msg->bytes());
+  consumer_num_bytes_ -= ack->num_bytes_consumed;
+  return true;
+}
+
+void RemoteConsumerSharedRingDataPipeImpl::OnDetachFromChannel(
+    unsigned /*port*/) {
+  if (!consumer_open()) {
+    DCHECK(!channel_endpoint_);
+    return;
+  }
+
+  Disconnect();
+}
+
+void RemoteConsumerSharedRingDataPipeImpl::DestroyRing() {
+  ring_mapping_.reset();
+  ring_buffer_ = nullptr;
+}
+
+size_t RemoteConsumerSharedRingDataPipeImpl::GetMaxNumBytesToWrite() {
+  DCHECK_LE(consumer_num_bytes_, capacity_num_bytes());
+  return std::min(capacity_num_bytes() - consumer_num_bytes_,
+                  capacity_num_bytes() - write_index_);
+}
+
+void RemoteConsumerSharedRingDataPipeImpl::MarkDataAsWritten(
+    size_t num_bytes) {
+  DCHECK_LE(num_bytes, capacity_num_bytes() - consumer_num_bytes_);
+  if (num_bytes == 0)
+    return;
+
+  write_index_ += num_bytes;
+  write_index_ %= capacity_num_bytes();
+  consumer_num_bytes_ += num_bytes;
+
+  RemoteDataPipeWrite write_data = {};
+  write_data.num_bytes_written = static_cast<uint32_t>(num_bytes);
+  std::unique_ptr<MessageInTransit> message(new MessageInTransit(
+      MessageInTransit::Type::ENDPOINT_CLIENT,
+      MessageInTransit::Subtype::ENDPOINT_CLIENT_DATA_PIPE_WRITE,
+      static_cast<uint32_t>(sizeof(write_data)), &write_data));
+  if (!channel_endpoint_->EnqueueMessage(std::move(message)))
+    Disconnect();
+}
+
+void RemoteConsumerSharedRingDataPipeImpl::Disconnect() {
+  DCHECK(consumer_open());
+  DCHECK(channel_endpoint_);
+  SetConsumerClosed();
+  channel_endpoint_->DetachFromClient();
+  channel_endpoint_ = nullptr;
+  // During a two-phase write, the producer may still be writing to the ring
+  // buffer.
+  if (!producer_in_two_phase_write())
+    DestroyRing();
+}
+
+}  // namespace system
+}  // namespace mojo
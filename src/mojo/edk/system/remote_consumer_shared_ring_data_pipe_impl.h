@@ -0,0 +1,139 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_EDK_SYSTEM_REMOTE_CONSUMER_SHARED_RING_DATA_PIPE_IMPL_H_
+#define MOJO_EDK_SYSTEM_REMOTE_CONSUMER_SHARED_RING_DATA_PIPE_IMPL_H_
+
+#include <memory>
+
+#include "mojo/edk/platform/platform_shared_buffer.h"
+#include "mojo/edk/system/channel_endpoint.h"
+#include "mojo/edk/system/data_pipe_impl.h"
+#include "mojo/edk/util/ref_ptr.h"
+#include "mojo/public/cpp/system/macros.h"
+
+namespace mojo {
+namespace system {
+
+class MessageInTransitQueue;
+
+// |RemoteConsumerSharedRingDataPipeImpl| is a subclass that "implements"
+// |DataPipe| for data pipes whose producer is local and whose consumer is
+// remote, with the data in a circular buffer in shared memory (which is also
+// mapped by the consumer). Data is written directly into the ring buffer (for
+// two-phase writes, the caller writes into it directly), and only notifications
+// of data written (to the consumer) and data consumed (from the consumer) are
+// sent over the channel. See |DataPipeImpl| for more details.
+class RemoteConsumerSharedRingDataPipeImpl final : public DataPipeImpl {
+ public:
+  // |ring_buffer| must have size |capacity_num_bytes()| and be mapped in its
+  // entirety by |ring_mapping|. The consumer has |consumer_num_bytes| bytes of
+  // data, which (circularly) end just before |write_index|.
+  RemoteConsumerSharedRingDataPipeImpl(
+      util::RefPtr<ChannelEndpoint>&& channel_endpoint,
+      size_t consumer_num_bytes,
+      util::RefPtr<platform::PlatformSharedBuffer>&& ring_buffer,
+      std::unique_ptr<platform::PlatformSharedBufferMapping> ring_mapping,
+      size_t write_index);
+  ~RemoteConsumerSharedRingDataPipeImpl() override;
+
+  // Processes messages that were received and queued by an |IncomingEndpoint|.
+  // |*consumer_num_bytes| should be set to the number of bytes enqueued to the
+  // consumer (before the messages were sent); on success, it will be updated
+  // appropriately. Returns true on success and false on failure. Always clears
+  // |*messages|.
+  static bool ProcessMessagesFromIncomingEndpoint(
+      const MojoCreateDataPipeOptions& validated_options,
+      size_t* consumer_num_bytes,
+      MessageInTransitQueue* messages);
+
+ private:
+  // |DataPipeImpl| implementation:
+  void ProducerClose() override;
+  MojoResult ProducerWriteData(UserPointer<const void> elements,
+                               UserPointer<uint32_t> num_bytes,
+                               uint32_t max_num_bytes_to_write,
+                               uint32_t min_num_bytes_to_write) override;
+  MojoResult ProducerBeginWriteData(
+      UserPointer<void*> buffer,
+      UserPointer<uint32_t> buffer_num_bytes) override;
+  MojoResult ProducerEndWriteData(uint32_t num_bytes_written) override;
+  MojoResult ProducerBeginWriteDataSpans(
+      UserPointer<void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes) override;
+  HandleSignalsState ProducerGetHandleSignalsState() const override;
+  void ProducerStartSerialize(Channel* channel,
+                              size_t* max_size,
+                              size_t* max_platform_handles) override;
+  bool ProducerEndSerialize(
+      Channel* channel,
+      void* destination,
+      size_t* actual_size,
+      std::vector<platform::ScopedPlatformHandle>* platform_handles) override;
+  // Note: None of the |Consumer...()| methods should be called, except
+  // |ConsumerGetHandleSignalsState()|.
+  void ConsumerClose() override;
+  MojoResult ConsumerReadData(UserPointer<void> elements,
+                              UserPointer<uint32_t> num_bytes,
+                              uint32_t max_num_bytes_to_read,
+                              uint32_t min_num_bytes_to_read,
+                              bool peek) override;
+  MojoResult ConsumerDiscardData(UserPointer<uint32_t> num_bytes,
+                                 uint32_t max_num_bytes_to_discard,
+                                 uint32_t min_num_bytes_to_discard) override;
+  MojoResult ConsumerQueryData(UserPointer<uint32_t> num_bytes) override;
+  MojoResult ConsumerBeginReadData(
+      UserPointer<const void*> buffer,
+      UserPointer<uint32_t> buffer_num_bytes) override;
+  MojoResult ConsumerEndReadData(uint32_t num_bytes_read) override;
+  HandleSignalsState ConsumerGetHandleSignalsState() const override;
+  void ConsumerStartSerialize(Channel* channel,
+                              size_t* max_size,
+                              size_t* max_platform_handles) override;
+  bool ConsumerEndSerialize(
+      Channel* channel,
+      void* destination,
+      size_t* actual_size,
+      std::vector<platform::ScopedPlatformHandle>* platform_handles) override;
+  bool OnReadMessage(unsigned port, MessageInTransit* message) override;
+  void OnDetachFromChannel(unsigned port) override;
+
+  char* ring() const {
+    return static_cast<char*>(ring_mapping_->GetBase());
+  }
+
+  void DestroyRing();
+
+  // Get the maximum (single) write size right now (in number of elements);
+  // result fits in a |uint32_t|.
+  size_t GetMaxNumBytesToWrite();
+
+  // Marks the given number of bytes (just written to the ring buffer at
+  // |write_index_|) as written. This will send a message to the remote
+  // consumer.
+  void MarkDataAsWritten(size_t num_bytes);
+
+  void Disconnect();
+
+  // Should be valid if and only if |consumer_open()| returns true.
+  util::RefPtr<ChannelEndpoint> channel_endpoint_;
+
+  // The number of bytes we've sent the consumer, but don't *know* have been
+  // consumed.
+  size_t consumer_num_bytes_;
+
+  // These are valid while the consumer is open (and possibly afterwards, during
+  // a two-phase write).
+  util::RefPtr<platform::PlatformSharedBuffer> ring_buffer_;
+  std::unique_ptr<platform::PlatformSharedBufferMapping> ring_mapping_;
+  // Index in the ring buffer at which the next data will be written.
+  size_t write_index_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(RemoteConsumerSharedRingDataPipeImpl);
+};
+
+}  // namespace system
+}  // namespace mojo
+
+#endif  // MOJO_EDK_SYSTEM_REMOTE_CONSUMER_SHARED_RING_DATA_PIPE_IMPL_H_
@@ -16,6 +16,12 @@ struct RemoteDataPipeAck {
   uint32_t num_bytes_consumed;
 };
 
+// Data payload for |MessageInTransit::Subtype::ENDPOINT_CLIENT_DATA_PIPE_WRITE|
+// messages.
+struct RemoteDataPipeWrite {
+  uint32_t num_bytes_written;
+};
+
 }  // namespace system
 }  // namespace mojo
 
@@ -0,0 +1,23 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_EDK_SYSTEM_REMOTE_MESSAGE_PIPE_ACK_H_
+#define MOJO_EDK_SYSTEM_REMOTE_MESSAGE_PIPE_ACK_H_
+
+#include <stdint.h>
+
+namespace mojo {
+namespace system {
+
+// Data payload for
+// |MessageInTransit::Subtype::ENDPOINT_CLIENT_MESSAGE_PIPE_ACK| messages.
+struct RemoteMessagePipeAck {
+  // The |ack_request_id()| of the message that was read.
+  uint32_t ack_request_id;
+};
+
+}  // namespace system
+}  // namespace mojo
+
+#endif  // MOJO_EDK_SYSTEM_REMOTE_MESSAGE_PIPE_ACK_H_
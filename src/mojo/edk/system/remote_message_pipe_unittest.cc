@@ -314,6 +314,75 @@ TEST_F(RemoteMessagePipeTest, PeerClosed) {
   mp1->Close(1);
 }
 
+// Tests that queue limits are enforced (by the writer) across a channel, with
+// the reader's acknowledgements making the writer writable again.
+TEST_F(RemoteMessagePipeTest, QueueLimits) {
+  static const char kHello[] = "hello";
+  char buffer[100] = {0};
+  uint32_t buffer_size = static_cast<uint32_t>(sizeof(buffer));
+  Waiter read_waiter;
+  Waiter write_waiter;
+  HandleSignalsState hss;
+  uint64_t context = 0;
+
+  // Connect message pipes as in the |Basic| test. Only the writer (MP 0) needs
+  // to know the limits.
+  RefPtr<ChannelEndpoint> ep0;
+  auto mp0 = MessagePipe::CreateLocalProxy(&ep0);
+  mp0->SetQueueLimits(2u, 0u);
+  RefPtr<ChannelEndpoint> ep1;
+  auto mp1 = MessagePipe::CreateProxyLocal(&ep1);
+  BootstrapChannelEndpoints(std::move(ep0), std::move(ep1));
+
+  read_waiter.Init();
+  ASSERT_EQ(MOJO_RESULT_OK,
+            mp1->AddAwakable(1, &read_waiter, MOJO_HANDLE_SIGNAL_READABLE,
+                             false, 123, nullptr));
+
+  // Write two messages to MP 0, port 0; the third doesn't fit.
+  for (unsigned i = 0; i < 2; i++) {
+    EXPECT_EQ(
+        MOJO_RESULT_OK,
+        mp0->WriteMessage(0, UserPointer<const void>(kHello), sizeof(kHello),
+                          nullptr, MOJO_WRITE_MESSAGE_FLAG_NONE));
+  }
+  EXPECT_EQ(
+      MOJO_RESULT_SHOULD_WAIT,
+      mp0->WriteMessage(0, UserPointer<const void>(kHello), sizeof(kHello),
+                        nullptr, MOJO_WRITE_MESSAGE_FLAG_NONE));
+
+  write_waiter.Init();
+  ASSERT_EQ(MOJO_RESULT_OK,
+            mp0->AddAwakable(0, &write_waiter, MOJO_HANDLE_SIGNAL_WRITABLE,
+                             false, 456, nullptr));
+
+  // Read one message from MP 1, port 1.
+  EXPECT_EQ(MOJO_RESULT_OK,
+            read_waiter.Wait(MOJO_DEADLINE_INDEFINITE, &context));
+  EXPECT_EQ(123u, context);
+  mp1->RemoveAwakable(1, &read_waiter, nullptr);
+  EXPECT_EQ(MOJO_RESULT_OK,
+            mp1->ReadMessage(1, UserPointer<void>(buffer),
+                             MakeUserPointer(&buffer_size), nullptr, nullptr,
+                             MOJO_READ_MESSAGE_FLAG_NONE));
+  EXPECT_STREQ(kHello, buffer);
+
+  // Its acknowledgement makes MP 0, port 0 writable again.
+  EXPECT_EQ(MOJO_RESULT_OK,
+            write_waiter.Wait(MOJO_DEADLINE_INDEFINITE, &context));
+  EXPECT_EQ(456u, context);
+  hss = HandleSignalsState();
+  mp0->RemoveAwakable(0, &write_waiter, &hss);
+  EXPECT_EQ(MOJO_HANDLE_SIGNAL_WRITABLE, hss.satisfied_signals);
+  EXPECT_EQ(
+      MOJO_RESULT_OK,
+      mp0->WriteMessage(0, UserPointer<const void>(kHello), sizeof(kHello),
+                        nullptr, MOJO_WRITE_MESSAGE_FLAG_NONE));
+
+  mp0->Close(0);
+  mp1->Close(1);
+}
+
 TEST_F(RemoteMessagePipeTest, Multiplex) {
   static const char kHello[] = "hello";
   static const char kWorld[] = "world!!!1!!!1!";
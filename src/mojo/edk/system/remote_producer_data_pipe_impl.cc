@@ -268,11 +268,31 @@ MojoResult RemoteProducerDataPipeImpl::ConsumerBeginReadData(
   return MOJO_RESULT_OK;
 }
 
+MojoResult RemoteProducerDataPipeImpl::ConsumerBeginReadDataSpans(
+    UserPointer<const void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes) {
+  size_t max_num_bytes_to_read = GetMaxNumBytesToRead();
+  // Don't go into a two-phase read if there's no data.
+  if (max_num_bytes_to_read == 0) {
+    return producer_open() ? MOJO_RESULT_SHOULD_WAIT
+                           : MOJO_RESULT_FAILED_PRECONDITION;
+  }
+  // Any remaining data is at the beginning of the buffer.
+  size_t num_bytes_wrapped = current_num_bytes_ - max_num_bytes_to_read;
+
+  buffers.At(0).Put(buffer_.get() + start_index_);
+  buffers_num_bytes.At(0).Put(static_cast<uint32_t>(max_num_bytes_to_read));
+  buffers.At(1).Put(num_bytes_wrapped ? buffer_.get() : nullptr);
+  buffers_num_bytes.At(1).Put(static_cast<uint32_t>(num_bytes_wrapped));
+  set_consumer_two_phase_max_num_bytes_read(
+      static_cast<uint32_t>(max_num_bytes_to_read + num_bytes_wrapped));
+  return MOJO_RESULT_OK;
+}
+
 MojoResult RemoteProducerDataPipeImpl::ConsumerEndReadData(
     uint32_t num_bytes_read) {
   DCHECK_LE(num_bytes_read, consumer_two_phase_max_num_bytes_read());
   DCHECK_EQ(num_bytes_read % element_num_bytes(), 0u);
-  DCHECK_LE(start_index_ + num_bytes_read, capacity_num_bytes());
   MarkDataAsConsumed(num_bytes_read);
   set_consumer_two_phase_max_num_bytes_read(0);
   return MOJO_RESULT_OK;
@@ -322,6 +342,9 @@ bool RemoteProducerDataPipeImpl::ConsumerEndSerialize(
   SerializedDataPipeConsumerDispatcher* s =
       static_cast<SerializedDataPipeConsumerDispatcher*>(destination);
   s->validated_options = validated_options();
+  s->shared_ring_platform_handle_index = kNoSharedRingPlatformHandleIndex;
+  s->shared_ring_start_index = 0;
+  s->shared_ring_num_bytes = 0;
   void* destination_for_endpoint = static_cast<char*>(destination) +
                                    sizeof(SerializedDataPipeConsumerDispatcher);
 
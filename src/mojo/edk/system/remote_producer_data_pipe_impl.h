@@ -77,6 +77,9 @@ class RemoteProducerDataPipeImpl final : public DataPipeImpl {
       UserPointer<const void*> buffer,
       UserPointer<uint32_t> buffer_num_bytes) override;
   MojoResult ConsumerEndReadData(uint32_t num_bytes_read) override;
+  MojoResult ConsumerBeginReadDataSpans(
+      UserPointer<const void*> buffers,
+      UserPointer<uint32_t> buffers_num_bytes) override;
   HandleSignalsState ConsumerGetHandleSignalsState() const override;
   void ConsumerStartSerialize(Channel* channel,
                               size_t* max_size,
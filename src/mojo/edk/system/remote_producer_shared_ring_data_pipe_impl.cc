@@ -0,0 +1,481 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mojo/edk/system/remote_producer_shared_ring_data_pipe_impl.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include "base/logging.h"
+#include "mojo/edk/system/channel.h"
+#include "mojo/edk/system/channel_endpoint.h"
+#include "mojo/edk/system/data_pipe.h"
+#include "mojo/edk/system/message_in_transit.h"
+#include "mojo/edk/system/message_in_transit_queue.h"
+#include "mojo/edk/system/remote_data_pipe_ack.h"
+
+using mojo::platform::PlatformSharedBuffer;
+using mojo::platform::PlatformSharedBufferMapping;
+using mojo::platform::ScopedPlatformHandle;
+using mojo::util::RefPtr;
+
+namespace mojo {
+namespace system {
+
+namespace {
+
+bool ValidateIncomingMessage(size_t element_num_bytes,
+                             size_t capacity_num_bytes,
+                             size_t current_num_bytes,
+                             const MessageInTransit* message) {
+  // We should only receive endpoint client messages.
+  DCHECK_EQ(message->type(), MessageInTransit::Type::ENDPOINT_CLIENT);
+
+  // But we should check the subtype; only take data written notifications.
+  if (message->subtype() !=
+      MessageInTransit::Subtype::ENDPOINT_CLIENT_DATA_PIPE_WRITE) {
+    LOG(WARNING) << "Received message of unexpected subtype: "
+                 << message->subtype();
+    return false;
+  }
+
+  if (message->num_bytes() != sizeof(RemoteDataPipeWrite)) {
+    LOG(WARNING) << "Incorrect message size: " << message->num_bytes()
+                 << " bytes (expected: " << sizeof(RemoteDataPipeWrite)
+                 << " bytes)";
+    return false;
+  }
+
+  const RemoteDataPipeWrite* write =
+      static_cast<const RemoteDataPipeWrite*>(message->bytes());
+  size_t num_bytes_written = write->num_bytes_written;
+
+  const size_t max_num_bytes = capacity_num_bytes - current_num_bytes;
+  if (num_bytes_written > max_num_bytes) {
+    LOG(WARNING) << "Received too much data: " << num_bytes_written
+                 << " bytes (maximum: " << max_num_bytes << " bytes)";
+    return false;
+  }
+
+  if (num_bytes_written % element_num_bytes != 0) {
+    LOG(WARNING) << "Received data not a multiple of element size: "
+                 << num_bytes_written
+                 << " bytes (element size: " << element_num_bytes << " bytes)";
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+RemoteProducerSharedRingDataPipeImpl::RemoteProducerSharedRingDataPipeImpl(
+    RefPtr<ChannelEndpoint>&& channel_endpoint,
+    RefPtr<PlatformSharedBuffer>&& ring_buffer,
+    std::unique_ptr<PlatformSharedBufferMapping> ring_mapping,
+    size_t start_index,
+    size_t current_num_bytes)
+    : channel_endpoint_(std::move(channel_endpoint)),
+      ring_buffer_(std::move(ring_buffer)),
+      ring_mapping_(std::move(ring_mapping)),
+      start_index_(start_index),
+      current_num_bytes_(current_num_bytes) {
+  DCHECK(ring_buffer_);
+  DCHECK(ring_mapping_);
+}
+
+RemoteProducerSharedRingDataPipeImpl::~RemoteProducerSharedRingDataPipeImpl() {
+}
+
+// static
+bool RemoteProducerSharedRingDataPipeImpl::ProcessMessagesFromIncomingEndpoint(
+    const MojoCreateDataPipeOptions& validated_options,
+    size_t* current_num_bytes,
+    MessageInTransitQueue* messages) {
+  const size_t element_num_bytes = validated_options.element_num_bytes;
+  const size_t capacity_num_bytes = validated_options.capacity_num_bytes;
+
+  if (messages) {
+    while (!messages->IsEmpty()) {
+      std::unique_ptr<MessageInTransit> message(messages->GetMessage());
+      if (!ValidateIncomingMessage(element_num_bytes, capacity_num_bytes,
+                                   *current_num_bytes, message.get())) {
+        messages->Clear();
+        return false;
+      }
+
+      const RemoteDataPipeWrite* write =
+          static_cast<const RemoteDataPipeWrite*>(message->bytes());
+      *current_num_bytes += write->num_bytes_written;
+    }
+  }
+
+  return true;
+}
+
+void RemoteProducerSharedRingDataPipeImpl::ProducerClose() {
+  NOTREACHED();
+}
+
+MojoResult RemoteProducerSharedRingDataPipeImpl::ProducerWriteData(
+    UserPointer<const void> /*elements*/,
+    UserPointer<uint32_t> /*num_bytes*/,
+    uint32_t /*max_num_bytes_to_write*/,
+    uint32_t /*min_num_bytes_to_write*/) {
+  NOTREACHED();
+  return MOJO_RESULT_INTERNAL;
+}
+
+MojoResult RemoteProducerSharedRingDataPipeImpl::ProducerBeginWriteData(
+    UserPointer<void*> /*buffer*/,
+    UserPointer<uint32_t> /*buffer_num_bytes*/) {
+  NOTREACHED();
+  return MOJO_RESULT_INTERNAL;
+}
+
+MojoResult RemoteProducerSharedRingDataPipeImpl::ProducerEndWriteData(
+    uint32_t /*num_bytes_written*/) {
+  NOTREACHED();
+  return MOJO_RESULT_INTERNAL;
+}
+
+HandleSignalsState
+RemoteProducerSharedRingDataPipeImpl::ProducerGetHandleSignalsState() const {
+  return HandleSignalsState();
+}
+
+void RemoteProducerSharedRingDataPipeImpl::ProducerStartSerialize(
+    Channel* /*channel*/,
+    size_t* /*max_size*/,
+    size_t* /*max_platform_handles*/) {
+  NOTREACHED();
+}
+
+bool RemoteProducerSharedRingDataPipeImpl::ProducerEndSerialize(
+    Channel* /*channel*/,
+    void* /*destination*/,
+    size_t* /*actual_size*/,
+    std::vector<ScopedPlatformHandle>* /*platform_handles*/) {
+  NOTREACHED();
+  return false;
+}
+
+void RemoteProducerSharedRingDataPipeImpl::ConsumerClose() {
+  if (producer_open())
+    Disconnect();
+  DestroyRing();
+}
+
+MojoResult RemoteProducerSharedRingDataPipeImpl::ConsumerReadData(
+    UserPointer<void> elements,
+    UserPointer<uint32_t> num_bytes,
+    uint32_t max_num_bytes_to_read,
+    uint32_t min_num_bytes_to_read,
+    bool peek) {
+  DCHECK_EQ(max_num_bytes_to_read % element_num_bytes(), 0u);
+  DCHECK_EQ(min_num_bytes_to_read % element_num_bytes(), 0u);
+  DCHECK_GT(max_num_bytes_to_read, 0u);
+
+  if (min_num_bytes_to_read > current_num_bytes_) {
+    // Don't return "should wait" since you can't wait for a specified amount of
+    // data.
+    return producer_open() ? MOJO_RESULT_OUT_OF_RANGE
+                           : MOJO_RESULT_FAILED_PRECONDITION;
+  }
+
+  size_t num_bytes_to_read =
+      std::min(static_cast<size_t>(max_num_bytes_to_read), current_num_bytes_);
+  if (num_bytes_to_read == 0) {
+    return producer_open() ? MOJO_RESULT_SHOULD_WAIT
+                           : MOJO_RESULT_FAILED_PRECONDITION;
+  }
+
+  // The amount we can read in our first copy.
+  size_t num_bytes_to_read_first =
+      std::min(num_bytes_to_read, GetMaxNumBytesToRead());
+  elements.PutArray(ring() + start_index_, num_bytes_to_read_first);
+
+  if (num_bytes_to_read_first < num_bytes_to_read) {
+    // The "second read index" is zero.
+    elements.At(num_bytes_to_read_first)
+        .PutArray(ring(), num_bytes_to_read - num_bytes_to_read_first);
+  }
+
+  if (!peek)
+    MarkDataAsConsumed(num_bytes_to_read);
+  num_bytes.Put(static_cast<uint32_t>(num_bytes_to_read));
+  return MOJO_RESULT_OK;
+}
+
+MojoResult RemoteProducerSharedRingDataPipeImpl::ConsumerDiscardData(
+    UserPointer<uint32_t> num_bytes,
+    uint32_t max_num_bytes_to_discard,
+    uint32_t min_num_bytes_to_discard) {
+  DCHECK_EQ(max_num_bytes_to_discard % element_num_bytes(), 0u);
+  DCHECK_EQ(min_num_bytes_to_discard % element_num_bytes(), 0u);
+  DCHECK_GT(max_num_bytes_to_discard, 0u);
+
+  if (min_num_bytes_to_discard > current_num_bytes_) {
+    // Don't return "should wait" since you can't wait for a specified amount of
+    // data.
+    return producer_open() ? MOJO_RESULT_OUT_OF_RANGE
+                           : MOJO_RESULT_FAILED_PRECONDITION;
+  }
+
+  // Be consistent with other operations; error if no data available.
+  if (current_num_bytes_ == 0) {
+    return producer_open() ? MOJO_RESULT_SHOULD_WAIT
+                           : MOJO_RESULT_FAILED_PRECONDITION;
+  }
+
+  size_t num_bytes_to_discard = std::min(
+      static_cast<size_t>(max_num_bytes_to_discard), current_num_bytes_);
+  MarkDataAsConsumed(num_bytes_to_discard);
+  num_bytes.Put(static_cast<uint32_t>(num_bytes_to_discard));
+  return MOJO_RESULT_OK;
+}
+
+MojoResult RemoteProducerSharedRingDataPipeImpl::ConsumerQueryData(
+    UserPointer<uint32_t> num_bytes) {
+  // Note: This cast is safe, since the capacity fits into a |uint32_t|.
+  num_bytes.Put(static_cast<uint32_t>(current_num_bytes_));
+  return MOJO_RESULT_OK;
+}
+
+MojoResult RemoteProducerSharedRingDataPipeImpl::ConsumerBeginReadData(
+    UserPointer<const void*> buffer,
+    UserPointer<uint32_t> buffer_num_bytes) {
+  size_t max_num_bytes_to_read = GetMaxNumBytesToRead();
+  // Don't go into a two-phase read if there's no data.
+  if (max_num_bytes_to_read == 0) {
+    return producer_open() ? MOJO_RESULT_SHOULD_WAIT
+                           : MOJO_RESULT_FAILED_PRECONDITION;
+  }
+
+  buffer.Put(ring() + start_index_);
+  buffer_num_bytes.Put(static_cast<uint32_t>(max_num_bytes_to_read));
+  set_consumer_two_phase_max_num_bytes_read(
+      static_cast<uint32_t>(max_num_bytes_to_read));
+  return MOJO_RESULT_OK;
+}
+
+MojoResult RemoteProducerSharedRingDataPipeImpl::ConsumerBeginReadDataSpans(
+    UserPointer<const void*> buffers,
+    UserPointer<uint32_t> buffers_num_bytes) {
+  size_t max_num_bytes_to_read = GetMaxNumBytesToRead();
+  // Don't go into a two-phase read if there's no data.
+  if (max_num_bytes_to_read == 0) {
+    return producer_open() ? MOJO_RESULT_SHOULD_WAIT
+                           : MOJO_RESULT_FAILED_PRECONDITION;
+  }
+  // Any remaining data is at the beginning of the buffer.
+  size_t num_bytes_wrapped = current_num_bytes_ - max_num_bytes_to_read;
+
+  buffers.At(0).Put(ring() + start_index_);
+  buffers_num_bytes.At(0).Put(static_cast<uint32_t>(max_num_bytes_to_read));
+  buffers.At(1).Put(num_bytes_wrapped ? ring() : nullptr);
+  buffers_num_bytes.At(1).Put(static_cast<uint32_t>(num_bytes_wrapped));
+  set_consumer_two_phase_max_num_bytes_read(
+      static_cast<uint32_t>(max_num_bytes_to_read + num_bytes_wrapped));
+  return MOJO_RESULT_OK;
+}
+
+MojoResult RemoteProducerSharedRingDataPipeImpl::ConsumerEndReadData(
+    uint32_t num_bytes_read) {
+  DCHECK_LE(num_bytes_read, consumer_two_phase_max_num_bytes_read());
+  DCHECK_EQ(num_bytes_read % element_num_bytes(), 0u);
+  MarkDataAsConsumed(num_bytes_read);
+  set_consumer_two_phase_max_num_bytes_read(0);
+  return MOJO_RESULT_OK;
+}
+
+HandleSignalsState
+RemoteProducerSharedRingDataPipeImpl::ConsumerGetHandleSignalsState() const {
+  HandleSignalsState rv;
+  // |consumer_read_threshold_num_bytes()| is always at least 1.
+  if (current_num_bytes_ >= consumer_read_threshold_num_bytes()) {
+    if (!consumer_in_two_phase_read()) {
+      rv.satisfied_signals |=
+          MOJO_HANDLE_SIGNAL_READABLE | MOJO_HANDLE_SIGNAL_READ_THRESHOLD;
+    }
+    rv.satisfiable_signals |=
+        MOJO_HANDLE_SIGNAL_READABLE | MOJO_HANDLE_SIGNAL_READ_THRESHOLD;
+  } else if (current_num_bytes_ > 0u) {
+    if (!consumer_in_two_phase_read())
+      rv.satisfied_signals |= MOJO_HANDLE_SIGNAL_READABLE;
+    rv.satisfiable_signals |= MOJO_HANDLE_SIGNAL_READABLE;
+  }
+  if (producer_open()) {
+    rv.satisfiable_signals |= MOJO_HANDLE_SIGNAL_READABLE |
+                              MOJO_HANDLE_SIGNAL_PEER_CLOSED |
+                              MOJO_HANDLE_SIGNAL_READ_THRESHOLD;
+  } else {
+    rv.satisfied_signals |= MOJO_HANDLE_SIGNAL_PEER_CLOSED;
+    rv.satisfiable_signals |= MOJO_HANDLE_SIGNAL_PEER_CLOSED;
+  }
+  return rv;
+}
+
+void RemoteProducerSharedRingDataPipeImpl::ConsumerStartSerialize(
+    Channel* channel,
+    size_t* max_size,
+    size_t* max_platform_handles) {
+  *max_size = sizeof(SerializedDataPipeConsumerDispatcher) +
+              channel->GetSerializedEndpointSize();
+  *max_platform_handles = 1;
+}
+
+bool RemoteProducerSharedRingDataPipeImpl::ConsumerEndSerialize(
+    Channel* channel,
+    void* destination,
+    size_t* actual_size,
+    std::vector<ScopedPlatformHandle>* platform_handles) {
+  SerializedDataPipeConsumerDispatcher* s =
+      static_cast<SerializedDataPipeConsumerDispatcher*>(destination);
+  s->validated_options = validated_options();
+  s->shared_ring_platform_handle_index = kNoSharedRingPlatformHandleIndex;
+  s->shared_ring_start_index = 0;
+  s->shared_ring_num_bytes = 0;
+  void* destination_for_endpoint = static_cast<char*>(destination) +
+                                   sizeof(SerializedDataPipeConsumerDispatcher);
+
+  if (!producer_open()) {
+    // Case 1: The producer is closed. Send any remaining data in messages.
+    MessageInTransitQueue message_queue;
+    if (ring_mapping_) {
+      ConvertDataToMessages(ring(), &start_index_, &current_num_bytes_,
+                            &message_queue);
+    }
+    DestroyRing();
+    channel->SerializeEndpointWithClosedPeer(destination_for_endpoint,
+                                             &message_queue);
+    *actual_size = sizeof(SerializedDataPipeConsumerDispatcher) +
+                   channel->GetSerializedEndpointSize();
+    return true;
+  }
+
+  // Case 2: The producer isn't closed. We pass |channel_endpoint| back to the
+  // |Channel|, along with (a duplicate of) the ring buffer's handle; the
+  // producer keeps writing to the same ring buffer. There's no reason for us to
+  // continue to exist afterwards.
+  ScopedPlatformHandle platform_handle(ring_buffer_->DuplicatePlatformHandle());
+  if (!platform_handle.is_valid()) {
+    LOG(ERROR) << "Failed to duplicate data pipe ring buffer handle";
+    Disconnect();
+    DestroyRing();
+    return false;
+  }
+  s->shared_ring_platform_handle_index =
+      static_cast<uint32_t>(platform_handles->size());
+  platform_handles->push_back(std::move(platform_handle));
+  s->shared_ring_start_index = static_cast<uint32_t>(start_index_);
+  s->shared_ring_num_bytes = static_cast<uint32_t>(current_num_bytes_);
+
+  // Note: We don't use |port|.
+  RefPtr<ChannelEndpoint> channel_endpoint;
+  channel_endpoint.swap(channel_endpoint_);
+  channel->SerializeEndpointWithRemotePeer(destination_for_endpoint, nullptr,
+                                           std::move(channel_endpoint));
+  SetProducerClosed();
+  DestroyRing();
+
+  *actual_size = sizeof(SerializedDataPipeConsumerDispatcher) +
+                 channel->GetSerializedEndpointSize();
+  return true;
+}
+
+bool RemoteProducerSharedRingDataPipeImpl::OnReadMessage(
+    unsigned /*port*/,
+    MessageInTransit* message) {
+  if (!producer_open()) {
+    // This will happen only on the rare occasion that the call to
+    // |OnReadMessage()| is racing with us calling
+    // |ChannelEndpoint::ReplaceClient()|, in which case we reject the message,
+    // and the |ChannelEndpoint| can retry (calling the new client's
+    // |OnReadMessage()|).
+    DCHECK(!channel_endpoint_);
+    return false;
+  }
+
+  // Otherwise, we take ownership of the message. (This means that we should
+  // always return true below.)
+  std::unique_ptr<MessageInTransit> msg(message);
+
+  if (!ValidateIncomingMessage(element_num_bytes(), capacity_num_bytes(),
+                               current_num_bytes_, msg.get())) {
+    Disconnect();
+    return true;
+  }
+
+  // The data itself is already in the ring buffer.
+  const RemoteDataPipeWrite* write =
+      static_cast<const RemoteDataPipeWrite*>(msg->bytes());
+  current_num_bytes_ += write->num_bytes_written;
+  DCHECK_LE(current_num_bytes_, capacity_num_bytes());
+  return true;
+}
+
+void RemoteProducerSharedRingDataPipeImpl::OnDetachFromChannel(
+    unsigned /*port*/) {
+  if (!producer_open()) {
+    DCHECK(!channel_endpoint_);
+    return;
+  }
+
+  Disconnect();
+}
+
+void RemoteProducerSharedRingDataPipeImpl::DestroyRing() {
+  ring_mapping_.reset();
+  ring_buffer_ = nullptr;
+  start_index_ = 0;
+  current_num_bytes_ = 0;
+}
+
+size_t RemoteProducerSharedRingDataPipeImpl::GetMaxNumBytesToRead() {
+  if (start_index_ + current_num_bytes_ > capacity_num_bytes())
+    return capacity_num_bytes() - start_index_;
+  return current_num_bytes_;
+}
+
+void RemoteProducerSharedRingDataPipeImpl::MarkDataAsConsumed(
+    size_t num_bytes) {
+  DCHECK_LE(num_bytes, current_num_bytes_);
+  start_index_ += num_bytes;
+  start_index_ %= capacity_num_bytes();
+  current_num_bytes_ -= num_bytes;
+
+  if (!producer_open()) {
+    DCHECK(!channel_endpoint_);
+    return;
+  }
+
+  RemoteDataPipeAck ack_data = {};
+  ack_data.num_bytes_consumed = static_cast<uint32_t>(num_bytes);
+  std::unique_ptr<MessageInTransit> message(new MessageInTransit(
+      MessageInTransit::Type::ENDPOINT_CLIENT,
+      MessageInTransit::Subtype::ENDPOINT_CLIENT_DATA_PIPE_ACK,
+      static_cast<uint32_t>(sizeof(ack_data)), &ack_data));
+  if (!channel_endpoint_->EnqueueMessage(std::move(message)))
+    Disconnect();
+}
+
+void RemoteProducerSharedRingDataPipeImpl::Disconnect() {
+  DCHECK(producer_open());
+  DCHECK(channel_endpoint_);
+  SetProducerClosed();
+  channel_endpoint_->DetachFromClient();
+  channel_endpoint_ = nullptr;
+  // If the consumer is still open and we still have data, we have to keep the
+  // ring buffer around (as with |RemoteProducerDataPipeImpl|, we won't free it
+  // even if it empties later).
+  if (!consumer_open() || !current_num_bytes_)
+    DestroyRing();
+}
+
+}  // namespace system
+}  // namespace mojo
@@ -240,6 +240,15 @@ SharedBufferDispatcher::CreateEquivalentDispatcherAndCloseImplNoLock(
   return CreateInternal(std::move(shared_buffer_));
 }
 
+bool SharedBufferDispatcher::PrepareForLocalTransferImplNoLock(
+    MessagePipe* /*message_pipe*/,
+    unsigned /*port*/) {
+  mutex().AssertHeld();
+
+  CancelAllStateNoLock();
+  return true;
+}
+
 MojoResult SharedBufferDispatcher::DuplicateBufferHandleImplNoLock(
     UserPointer<const MojoDuplicateBufferHandleOptions> options,
     RefPtr<Dispatcher>* new_dispatcher) {
@@ -286,6 +295,10 @@ MojoResult SharedBufferDispatcher::MapBufferImplNoLock(
   mutex().AssertHeld();
   DCHECK(shared_buffer_);
 
+  const MojoMapBufferFlags kKnownFlags = MOJO_MAP_BUFFER_FLAG_READ_ONLY;
+  if ((flags & ~kKnownFlags))
+    return MOJO_RESULT_UNIMPLEMENTED;
+
   if (offset > static_cast<uint64_t>(std::numeric_limits<size_t>::max()))
     return MOJO_RESULT_INVALID_ARGUMENT;
   if (num_bytes > static_cast<uint64_t>(std::numeric_limits<size_t>::max()))
@@ -296,8 +309,13 @@ MojoResult SharedBufferDispatcher::MapBufferImplNoLock(
     return MOJO_RESULT_INVALID_ARGUMENT;
 
   DCHECK(mapping);
-  *mapping = shared_buffer_->MapNoCheck(static_cast<size_t>(offset),
-                                        static_cast<size_t>(num_bytes));
+  if ((flags & MOJO_MAP_BUFFER_FLAG_READ_ONLY)) {
+    *mapping = shared_buffer_->MapReadOnlyNoCheck(
+        static_cast<size_t>(offset), static_cast<size_t>(num_bytes));
+  } else {
+    *mapping = shared_buffer_->MapNoCheck(static_cast<size_t>(offset),
+                                          static_cast<size_t>(num_bytes));
+  }
   if (!*mapping)
     return MOJO_RESULT_RESOURCE_EXHAUSTED;
 
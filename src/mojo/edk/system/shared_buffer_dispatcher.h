@@ -100,6 +100,8 @@ class SharedBufferDispatcher final : public SimpleDispatcher {
   util::RefPtr<Dispatcher> CreateEquivalentDispatcherAndCloseImplNoLock(
       MessagePipe* message_pipe,
       unsigned port) override;
+  bool PrepareForLocalTransferImplNoLock(MessagePipe* message_pipe,
+                                         unsigned port) override;
   MojoResult DuplicateBufferHandleImplNoLock(
       UserPointer<const MojoDuplicateBufferHandleOptions> options,
       util::RefPtr<Dispatcher>* new_dispatcher) override;
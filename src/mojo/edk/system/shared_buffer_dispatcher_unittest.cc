@@ -383,6 +383,41 @@ TEST_F(SharedBufferDispatcherTest, MapBufferInvalidArguments) {
             dispatcher->MapBuffer(0, 0, MOJO_MAP_BUFFER_FLAG_NONE, &mapping));
   EXPECT_FALSE(mapping);
 
+  // Unknown flag.
+  EXPECT_EQ(MOJO_RESULT_UNIMPLEMENTED,
+            dispatcher->MapBuffer(0, 100, ~MOJO_MAP_BUFFER_FLAG_READ_ONLY,
+                                  &mapping));
+  EXPECT_FALSE(mapping);
+
+  EXPECT_EQ(MOJO_RESULT_OK, dispatcher->Close());
+}
+
+TEST_F(SharedBufferDispatcherTest, MapBufferReadOnly) {
+  MojoResult result = MOJO_RESULT_INTERNAL;
+  auto dispatcher = SharedBufferDispatcher::Create(
+      platform_support(), SharedBufferDispatcher::kDefaultCreateOptions, 100,
+      &result);
+  EXPECT_EQ(MOJO_RESULT_OK, result);
+
+  std::unique_ptr<PlatformSharedBufferMapping> mapping1;
+  EXPECT_EQ(MOJO_RESULT_OK, dispatcher->MapBuffer(0, 100,
+                                                  MOJO_MAP_BUFFER_FLAG_NONE,
+                                                  &mapping1));
+  ASSERT_TRUE(mapping1);
+  static_cast<char*>(mapping1->GetBase())[50] = 'x';
+
+  std::unique_ptr<PlatformSharedBufferMapping> mapping2;
+  EXPECT_EQ(MOJO_RESULT_OK, dispatcher->MapBuffer(
+                                50, 50, MOJO_MAP_BUFFER_FLAG_READ_ONLY,
+                                &mapping2));
+  ASSERT_TRUE(mapping2);
+  EXPECT_EQ(50u, mapping2->GetLength());
+  EXPECT_EQ('x', static_cast<const char*>(mapping2->GetBase())[0]);
+
+  // Writes via the read/write mapping are visible via the read-only one.
+  static_cast<char*>(mapping1->GetBase())[51] = 'y';
+  EXPECT_EQ('y', static_cast<const char*>(mapping2->GetBase())[1]);
+
   EXPECT_EQ(MOJO_RESULT_OK, dispatcher->Close());
 }
 
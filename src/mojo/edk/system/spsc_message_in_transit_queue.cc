@@ -0,0 +1,105 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mojo/edk/system/spsc_message_in_transit_queue.h"
+
+#include "base/logging.h"
+#include "mojo/edk/system/message_in_transit_queue.h"
+
+namespace mojo {
+namespace system {
+
+namespace {
+
+const size_t kSegmentSize = 32;
+
+}  // namespace
+
+struct SpscMessageInTransitQueue::Segment {
+  // Set by the producer before it adds anything to the following segment.
+  Segment* next = nullptr;
+  MessageInTransit* messages[kSegmentSize];
+};
+
+SpscMessageInTransitQueue::SpscMessageInTransitQueue()
+    : head_segment_(new Segment()),
+      head_index_(0),
+      tail_segment_(head_segment_),
+      tail_index_(0),
+      size_(0),
+      num_bytes_(0),
+      spare_segment_(nullptr) {}
+
+SpscMessageInTransitQueue::~SpscMessageInTransitQueue() {
+  if (!IsEmpty()) {
+    LOG(WARNING) << "Destroying nonempty message queue";
+    Clear();
+  }
+  DCHECK_EQ(head_segment_, tail_segment_);
+  delete head_segment_;
+  delete spare_segment_.load();
+}
+
+bool SpscMessageInTransitQueue::AddMessage(
+    std::unique_ptr<MessageInTransit> message) {
+  if (tail_index_ == kSegmentSize) {
+    Segment* segment = NewSegment();
+    tail_segment_->next = segment;
+    tail_segment_ = segment;
+    tail_index_ = 0;
+  }
+  num_bytes_.fetch_add(message->num_bytes(), std::memory_order_relaxed);
+  tail_segment_->messages[tail_index_++] = message.release();
+  // This publishes the above writes to the consumer.
+  return size_.fetch_add(1u) == 0u;
+}
+
+std::unique_ptr<MessageInTransit> SpscMessageInTransitQueue::GetMessage() {
+  MessageInTransit* message = PeekMessage();
+  head_index_++;
+  num_bytes_.fetch_sub(message->num_bytes(), std::memory_order_relaxed);
+  size_.fetch_sub(1u);
+  return std::unique_ptr<MessageInTransit>(message);
+}
+
+MessageInTransit* SpscMessageInTransitQueue::PeekMessage() {
+  DCHECK(!IsEmpty());
+  if (head_index_ == kSegmentSize) {
+    // The producer has moved on to the next segment (since the queue isn't
+    // empty), so it's done with this one.
+    Segment* segment = head_segment_;
+    DCHECK(segment->next);
+    head_segment_ = segment->next;
+    head_index_ = 0;
+    segment->next = nullptr;
+    delete spare_segment_.exchange(segment);
+  }
+  return head_segment_->messages[head_index_];
+}
+
+void SpscMessageInTransitQueue::Clear() {
+  while (!IsEmpty())
+    DiscardMessage();
+}
+
+void SpscMessageInTransitQueue::AddMessages(
+    MessageInTransitQueue* message_queue) {
+  while (!message_queue->IsEmpty())
+    AddMessage(message_queue->GetMessage());
+}
+
+void SpscMessageInTransitQueue::GetMessages(
+    MessageInTransitQueue* message_queue) {
+  while (!IsEmpty())
+    message_queue->AddMessage(GetMessage());
+}
+
+SpscMessageInTransitQueue::Segment* SpscMessageInTransitQueue::NewSegment() {
+  if (Segment* segment = spare_segment_.exchange(nullptr))
+    return segment;
+  return new Segment();
+}
+
+}  // namespace system
+}  // namespace mojo
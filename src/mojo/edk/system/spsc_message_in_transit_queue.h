@@ -0,0 +1,102 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_EDK_SYSTEM_SPSC_MESSAGE_IN_TRANSIT_QUEUE_H_
+#define MOJO_EDK_SYSTEM_SPSC_MESSAGE_IN_TRANSIT_QUEUE_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <memory>
+
+#include "mojo/edk/system/message_in_transit.h"
+#include "mojo/public/cpp/system/macros.h"
+
+namespace mojo {
+namespace system {
+
+class MessageInTransitQueue;
+
+// A lock-free, unbounded, single-producer/single-consumer queue for
+// |MessageInTransit|s (that owns its messages). One thread at a time may call
+// the "producer" methods and one thread at a time may call the "consumer"
+// methods, concurrently and without any locking. (The user is responsible for
+// ensuring that there's at most one producer and one consumer at a time, and
+// for providing the necessary synchronization if these change.)
+//
+// Messages are stored in fixed-size segments; the consumer recycles exhausted
+// segments back to the producer, so that the steady state makes no
+// allocations.
+class SpscMessageInTransitQueue {
+ public:
+  SpscMessageInTransitQueue();
+  // No producer or consumer may be active.
+  ~SpscMessageInTransitQueue();
+
+  // These may be called from any thread. Unless called by the consumer, the
+  // result may be stale. (If called by the consumer, the queue may have become
+  // nonempty, but not empty, since.)
+  bool IsEmpty() const { return size_.load() == 0u; }
+  size_t Size() const { return size_.load(); }
+  // Total size of the data of the messages in the queue, in bytes.
+  size_t NumBytes() const { return num_bytes_.load(); }
+
+  // Producer methods ----------------------------------------------------------
+
+  // Adds |message| to the back of the queue. Returns true if the queue was
+  // (seen to be) empty beforehand.
+  bool AddMessage(std::unique_ptr<MessageInTransit> message);
+
+  // Consumer methods ----------------------------------------------------------
+
+  // These may only be called if the queue is not empty.
+  std::unique_ptr<MessageInTransit> GetMessage();
+  MessageInTransit* PeekMessage();
+  void DiscardMessage() { GetMessage(); }
+
+  // Methods for which neither a producer nor a consumer may be active ---------
+
+  void Clear();
+
+  // Moves all of |*message_queue|'s messages to the back of this queue.
+  void AddMessages(MessageInTransitQueue* message_queue);
+  // Moves all of this queue's messages to the back of |*message_queue|.
+  void GetMessages(MessageInTransitQueue* message_queue);
+
+ private:
+  struct Segment;
+
+  // Gets a segment from |spare_segment_| or allocates a new one.
+  Segment* NewSegment();
+
+  // Consumer state. The consumer reads from |head_segment_| at |head_index_|.
+  Segment* head_segment_;
+  size_t head_index_;
+
+  // Keep the producer's and consumer's states on different cache lines.
+  char padding1_[64];
+
+  // Producer state. The producer writes to |tail_segment_| at |tail_index_|.
+  Segment* tail_segment_;
+  size_t tail_index_;
+
+  char padding2_[64];
+
+  // The number of messages in the queue. This is incremented by the producer
+  // after it adds a message and decremented by the consumer after it removes
+  // one, and orders the producer's writes before the consumer's reads.
+  std::atomic<size_t> size_;
+  // Sum of |num_bytes()| over the messages in the queue. This is updated before
+  // |size_| (and is only for accounting, so doesn't order anything).
+  std::atomic<size_t> num_bytes_;
+  // An exhausted segment that the producer may reuse (or null).
+  std::atomic<Segment*> spare_segment_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(SpscMessageInTransitQueue);
+};
+
+}  // namespace system
+}  // namespace mojo
+
+#endif  // MOJO_EDK_SYSTEM_SPSC_MESSAGE_IN_TRANSIT_QUEUE_H_
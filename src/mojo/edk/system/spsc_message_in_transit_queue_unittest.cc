@@ -0,0 +1,123 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mojo/edk/system/spsc_message_in_transit_queue.h"
+
+#include "mojo/edk/platform/thread_utils.h"
+#include "mojo/edk/system/message_in_transit_queue.h"
+#include "mojo/edk/system/message_in_transit_test_utils.h"
+#include "mojo/edk/system/test/simple_test_thread.h"
+#include "mojo/public/cpp/system/macros.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using mojo::platform::ThreadYield;
+
+namespace mojo {
+namespace system {
+namespace {
+
+TEST(SpscMessageInTransitQueueTest, Basic) {
+  SpscMessageInTransitQueue queue;
+  EXPECT_TRUE(queue.IsEmpty());
+  EXPECT_EQ(0u, queue.NumBytes());
+
+  EXPECT_TRUE(queue.AddMessage(test::MakeTestMessage(1)));
+  ASSERT_FALSE(queue.IsEmpty());
+  EXPECT_EQ(1u, queue.Size());
+  EXPECT_EQ(sizeof(unsigned), queue.NumBytes());
+
+  test::VerifyTestMessage(queue.PeekMessage(), 1);
+  EXPECT_EQ(1u, queue.Size());
+
+  EXPECT_FALSE(queue.AddMessage(test::MakeTestMessage(2)));
+  EXPECT_FALSE(queue.AddMessage(test::MakeTestMessage(3)));
+  EXPECT_EQ(3u, queue.Size());
+  EXPECT_EQ(3 * sizeof(unsigned), queue.NumBytes());
+
+  test::VerifyTestMessage(queue.GetMessage().get(), 1);
+  EXPECT_EQ(2u, queue.Size());
+  EXPECT_EQ(2 * sizeof(unsigned), queue.NumBytes());
+
+  test::VerifyTestMessage(queue.PeekMessage(), 2);
+  queue.DiscardMessage();
+  EXPECT_EQ(1u, queue.Size());
+
+  test::VerifyTestMessage(queue.GetMessage().get(), 3);
+  EXPECT_TRUE(queue.IsEmpty());
+  EXPECT_EQ(0u, queue.NumBytes());
+
+  // Add and remove enough messages to use several segments.
+  for (unsigned i = 0; i < 1000; i++)
+    queue.AddMessage(test::MakeTestMessage(i));
+  EXPECT_EQ(1000u, queue.Size());
+  for (unsigned i = 0; i < 500; i++)
+    test::VerifyTestMessage(queue.GetMessage().get(), i);
+  for (unsigned i = 1000; i < 1100; i++)
+    queue.AddMessage(test::MakeTestMessage(i));
+  for (unsigned i = 500; i < 1100; i++)
+    test::VerifyTestMessage(queue.GetMessage().get(), i);
+  EXPECT_TRUE(queue.IsEmpty());
+
+  // The destructor should free any remaining messages.
+  queue.AddMessage(test::MakeTestMessage(4));
+}
+
+TEST(SpscMessageInTransitQueueTest, AddAndGetMessages) {
+  MessageInTransitQueue message_queue;
+  message_queue.AddMessage(test::MakeTestMessage(1));
+  message_queue.AddMessage(test::MakeTestMessage(2));
+
+  SpscMessageInTransitQueue queue;
+  queue.AddMessage(test::MakeTestMessage(0));
+  queue.AddMessages(&message_queue);
+  EXPECT_TRUE(message_queue.IsEmpty());
+  EXPECT_EQ(3u, queue.Size());
+
+  queue.GetMessages(&message_queue);
+  EXPECT_TRUE(queue.IsEmpty());
+  ASSERT_EQ(3u, message_queue.Size());
+  test::VerifyTestMessage(message_queue.GetMessage().get(), 0);
+  test::VerifyTestMessage(message_queue.GetMessage().get(), 1);
+  test::VerifyTestMessage(message_queue.GetMessage().get(), 2);
+}
+
+class ProducerThread : public test::SimpleTestThread {
+ public:
+  ProducerThread(SpscMessageInTransitQueue* queue, unsigned num_messages)
+      : queue_(queue), num_messages_(num_messages) {}
+  ~ProducerThread() override { Join(); }
+
+ private:
+  void Run() override {
+    for (unsigned i = 0; i < num_messages_; i++)
+      queue_->AddMessage(test::MakeTestMessage(i));
+  }
+
+  SpscMessageInTransitQueue* const queue_;
+  const unsigned num_messages_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(ProducerThread);
+};
+
+TEST(SpscMessageInTransitQueueTest, Concurrent) {
+  static const unsigned kNumMessages = 100000;
+
+  SpscMessageInTransitQueue queue;
+  ProducerThread thread(&queue, kNumMessages);
+  thread.Start();
+
+  for (unsigned i = 0; i < kNumMessages; i++) {
+    while (queue.IsEmpty())
+      ThreadYield();
+    unsigned id = 0;
+    ASSERT_TRUE(test::IsTestMessage(queue.PeekMessage(), &id));
+    ASSERT_EQ(i, id);
+    queue.DiscardMessage();
+  }
+  EXPECT_TRUE(queue.IsEmpty());
+}
+
+}  // namespace
+}  // namespace system
+}  // namespace mojo
@@ -10,10 +10,10 @@
 #include <memory>
 #include <vector>
 
-#include "mojo/edk/platform/aligned_alloc.h"
 #include "mojo/edk/platform/scoped_platform_handle.h"
 #include "mojo/edk/system/dispatcher.h"
 #include "mojo/edk/system/handle.h"
+#include "mojo/edk/system/message_buffer_pool.h"
 #include "mojo/public/c/system/handle.h"
 #include "mojo/public/cpp/system/macros.h"
 
@@ -101,10 +101,19 @@ class TransportData {
 
   ~TransportData();
 
+  // |TransportData|s are allocated from the |MessageBufferPool|.
+  static void* operator new(size_t size) {
+    return MessageBufferPool::Alloc(size);
+  }
+  static void operator delete(void* ptr) { MessageBufferPool::Free(ptr); }
+
   const void* buffer() const { return buffer_.get(); }
   void* buffer() { return buffer_.get(); }
   size_t buffer_size() const { return buffer_size_; }
 
+  // The number of (serialized) handles.
+  uint32_t num_handles() const { return header()->num_handles; }
+
   uint32_t platform_handle_table_offset() const {
     return header()->platform_handle_table_offset;
   }
@@ -175,7 +184,7 @@ class TransportData {
   }
 
   size_t buffer_size_;
-  platform::AlignedUniquePtr<char> buffer_;  // Never null.
+  MessageBufferPtr buffer_;  // Never null.
 
   // Any platform-specific handles attached to this message (for inter-process
   // transport). The vector (if any) owns the handles that it contains (and is
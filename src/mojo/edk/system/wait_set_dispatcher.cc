@@ -4,15 +4,146 @@
 
 #include "mojo/edk/system/wait_set_dispatcher.h"
 
+#include <utility>
+#include <vector>
+
 #include "base/logging.h"
+#include "mojo/edk/platform/time_ticks.h"
+#include "mojo/edk/system/awakable.h"
+#include "mojo/edk/system/handle_signals_state.h"
 #include "mojo/edk/system/options_validation.h"
+#include "mojo/edk/util/ref_counted.h"
 
+using mojo::platform::GetTimeTicks;
+using mojo::util::MakeRefCounted;
 using mojo::util::MutexLocker;
 using mojo::util::RefPtr;
 
 namespace mojo {
 namespace system {
 
+// WaitSetDispatcher::Entry ----------------------------------------------------
+
+// An |Entry| is registered (as an |Awakable|, with context equal to its cookie)
+// with the dispatcher for the entry's handle. Since it may be awoken (and have
+// to be unregistered) under that dispatcher's lock (or its secondary object's
+// lock), and since it may outlive its wait set (the wait set can't unregister
+// its entries when it's closed, since |CloseImplNoLock()| is called under the
+// wait set's mutex), an |Entry| keeps a reference to itself while it's
+// registered and it can be "detached" from its wait set.
+//
+// Lock ordering: wait set |mutex()| -> |Entry::mutex_| -> wait set
+// |awakable_mutex_|. (|Entry::mutex_| may also be taken under other
+// dispatchers' locks, in |Awake()|.)
+class WaitSetDispatcher::Entry final
+    : public Awakable,
+      public util::RefCountedThreadSafe<Entry> {
+ public:
+  uint64_t cookie() const { return cookie_; }
+  MojoHandleSignals signals() const { return signals_; }
+
+  // Must be called before the entry is registered with a dispatcher (e.g.,
+  // using |Dispatcher::AddAwakableUnconditional()|).
+  void WillRegister() {
+    MutexLocker locker(&mutex_);
+    DCHECK(!registration_ref_);
+    registration_ref_ = RefPtr<Entry>(this);
+  }
+
+  // Must be called after the entry has been unregistered (e.g., after
+  // |Dispatcher::RemoveAwakableWithContext()|) or if registration failed. This
+  // may be called even if the entry was already implicitly unregistered (due to
+  // |Awake()| returning false).
+  void DidUnregister() {
+    // Note: This is declared before |locker|, so that it's released after
+    // |mutex_| is unlocked.
+    RefPtr<Entry> self_ref;
+    MutexLocker locker(&mutex_);
+    self_ref = std::move(registration_ref_);
+  }
+
+  // Detaches this entry from its wait set. After this, it will no longer call
+  // its wait set and will unregister itself the next time it's awoken.
+  void Detach() {
+    MutexLocker locker(&mutex_);
+    wait_set_ = nullptr;
+  }
+
+  bool IsDetached() {
+    MutexLocker locker(&mutex_);
+    return !wait_set_;
+  }
+
+  // Tells the wait set that this entry may be ready (without being awoken by a
+  // dispatcher).
+  void MarkMaybeReady() {
+    MutexLocker locker(&mutex_);
+    if (wait_set_)
+      wait_set_->OnEntryAwoken(this, MOJO_RESULT_OK);
+  }
+
+  // |Awakable| implementation:
+  bool Awake(MojoResult result, uint64_t context) override {
+    DCHECK_EQ(context, cookie_);
+
+    // Note: This is declared before |locker|, so that it's released (possibly
+    // destroying |this|) after |mutex_| is unlocked.
+    RefPtr<Entry> self_ref;
+    MutexLocker locker(&mutex_);
+    // Note: |AwakableList::CancelAll()| always removes us, regardless of our
+    // return value.
+    bool keep = (result != MOJO_RESULT_CANCELLED);
+    if (wait_set_)
+      wait_set_->OnEntryAwoken(this, result);
+    else
+      keep = false;
+    if (!keep)
+      self_ref = std::move(registration_ref_);
+    return keep;
+  }
+
+  // The following members are protected by the wait set's |awakable_mutex_|
+  // (and must only be accessed by the wait set):
+  bool is_ready;
+  bool is_cancelled;
+  // Valid only if |is_ready| is true.
+  std::list<RefPtr<Entry>>::iterator ready_list_it;
+
+ private:
+  FRIEND_MAKE_REF_COUNTED(Entry);
+  FRIEND_REF_COUNTED_THREAD_SAFE(Entry);
+
+  Entry(WaitSetDispatcher* wait_set, uint64_t cookie, MojoHandleSignals signals)
+      : is_ready(false),
+        is_cancelled(false),
+        cookie_(cookie),
+        signals_(signals),
+        wait_set_(wait_set) {}
+  ~Entry() override { DCHECK(!registration_ref_); }
+
+  const uint64_t cookie_;
+  const MojoHandleSignals signals_;
+
+  util::Mutex mutex_;
+  // Null if detached.
+  WaitSetDispatcher* wait_set_ MOJO_GUARDED_BY(mutex_);
+  // Set while this entry is (or may be) registered with a dispatcher.
+  RefPtr<Entry> registration_ref_ MOJO_GUARDED_BY(mutex_);
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(Entry);
+};
+
+// WaitSetDispatcher::EntryInfo ------------------------------------------------
+
+WaitSetDispatcher::EntryInfo::EntryInfo(RefPtr<Entry>&& entry, Handle&& handle)
+    : entry(std::move(entry)), handle(std::move(handle)) {}
+
+WaitSetDispatcher::EntryInfo::EntryInfo(EntryInfo&&) = default;
+
+WaitSetDispatcher::EntryInfo::~EntryInfo() {}
+
+// WaitSetDispatcher -----------------------------------------------------------
+
 // static
 constexpr MojoHandleRights WaitSetDispatcher::kDefaultHandleRights;
 
@@ -90,9 +221,12 @@ bool WaitSetDispatcher::SupportsEntrypointClass(
           entrypoint_class == EntrypointClass::WAIT_SET);
 }
 
-WaitSetDispatcher::WaitSetDispatcher() {}
+WaitSetDispatcher::WaitSetDispatcher() : awakable_closed_(false) {}
 
-WaitSetDispatcher::~WaitSetDispatcher() {}
+WaitSetDispatcher::~WaitSetDispatcher() {
+  DCHECK(entries_.empty());
+  DCHECK(ready_list_.empty());
+}
 
 RefPtr<Dispatcher>
 WaitSetDispatcher::CreateEquivalentDispatcherAndCloseImplNoLock(
@@ -108,27 +242,90 @@ MojoResult WaitSetDispatcher::WaitSetAddImpl(
     Handle&& handle,
     MojoHandleSignals signals,
     uint64_t cookie) {
-  MutexLocker locker(&mutex());
-  if (is_closed_no_lock())
-    return MOJO_RESULT_INVALID_ARGUMENT;
-  MojoWaitSetAddOptions validated_options;
-  MojoResult result = ValidateWaitSetAddOptions(options, &validated_options);
-  if (result != MOJO_RESULT_OK)
-    return result;
-
-  // TODO(vtl)
-  NOTIMPLEMENTED();
-  return MOJO_RESULT_UNIMPLEMENTED;
+  DCHECK(handle);
+
+  RefPtr<Dispatcher> dispatcher = handle.dispatcher.Clone();
+  RefPtr<Entry> entry;
+  {
+    MutexLocker locker(&mutex());
+    if (is_closed_no_lock())
+      return MOJO_RESULT_INVALID_ARGUMENT;
+    MojoWaitSetAddOptions validated_options;
+    MojoResult result = ValidateWaitSetAddOptions(options, &validated_options);
+    if (result != MOJO_RESULT_OK)
+      return result;
+
+    if (entries_.find(cookie) != entries_.end())
+      return MOJO_RESULT_ALREADY_EXISTS;
+
+    entry = MakeRefCounted<Entry>(this, cookie, signals);
+    entries_.insert(
+        std::make_pair(cookie, EntryInfo(entry.Clone(), std::move(handle))));
+  }
+
+  // We can't hold |mutex()| while registering with |dispatcher|, since that
+  // takes |dispatcher|'s lock. Thus we may race with |WaitSetRemoveImpl()| and
+  // |CloseImplNoLock()|; they'll detach |entry|, which we check for below.
+  entry->WillRegister();
+  MojoResult result =
+      dispatcher->AddAwakableUnconditional(entry.get(), signals, cookie, nullptr);
+  switch (result) {
+    case MOJO_RESULT_OK:
+      break;
+    case MOJO_RESULT_ALREADY_EXISTS:
+      // Registered, but already satisfied.
+      entry->MarkMaybeReady();
+      break;
+    case MOJO_RESULT_FAILED_PRECONDITION:
+      // Not registered, since it'll never be satisfied. It'll remain on the
+      // ready list (and be reported as such) until it's removed.
+      entry->DidUnregister();
+      entry->MarkMaybeReady();
+      break;
+    default:
+      // The handle was closed out from under us.
+      DCHECK_EQ(result, MOJO_RESULT_INVALID_ARGUMENT);
+      entry->DidUnregister();
+      RemoveEntry(cookie, entry.get());
+      return result;
+  }
+
+  if (entry->IsDetached()) {
+    // We raced with |WaitSetRemoveImpl()| or |CloseImplNoLock()|, which may
+    // have tried to unregister |entry| before we registered it.
+    dispatcher->RemoveAwakableWithContext(entry.get(), cookie, nullptr);
+    entry->DidUnregister();
+  }
+  return MOJO_RESULT_OK;
 }
 
 MojoResult WaitSetDispatcher::WaitSetRemoveImpl(uint64_t cookie) {
-  MutexLocker locker(&mutex());
-  if (is_closed_no_lock())
-    return MOJO_RESULT_INVALID_ARGUMENT;
-
-  // TODO(vtl)
-  NOTIMPLEMENTED();
-  return MOJO_RESULT_UNIMPLEMENTED;
+  RefPtr<Entry> entry;
+  RefPtr<Dispatcher> dispatcher;
+  {
+    MutexLocker locker(&mutex());
+    if (is_closed_no_lock())
+      return MOJO_RESULT_INVALID_ARGUMENT;
+
+    auto it = entries_.find(cookie);
+    if (it == entries_.end())
+      return MOJO_RESULT_NOT_FOUND;
+    entry = std::move(it->second.entry);
+    dispatcher = std::move(it->second.handle.dispatcher);
+    entries_.erase(it);
+    entry->Detach();
+  }
+
+  // As in |WaitSetAddImpl()|, we can't unregister under |mutex()|.
+  dispatcher->RemoveAwakableWithContext(entry.get(), cookie, nullptr);
+  entry->DidUnregister();
+
+  MutexLocker locker(&awakable_mutex_);
+  if (entry->is_ready) {
+    entry->is_ready = false;
+    ready_list_.erase(entry->ready_list_it);
+  }
+  return MOJO_RESULT_OK;
 }
 
 MojoResult WaitSetDispatcher::WaitSetWaitImpl(
@@ -136,13 +333,200 @@ MojoResult WaitSetDispatcher::WaitSetWaitImpl(
     UserPointer<uint32_t> num_results,
     UserPointer<MojoWaitSetResult> results,
     UserPointer<uint32_t> max_results) {
-  MutexLocker locker(&mutex());
-  if (is_closed_no_lock())
-    return MOJO_RESULT_INVALID_ARGUMENT;
+  {
+    MutexLocker locker(&mutex());
+    if (is_closed_no_lock())
+      return MOJO_RESULT_INVALID_ARGUMENT;
+  }
+
+  uint32_t num_results_value = num_results.Get();
+  std::vector<MojoWaitSetResult> results_value;
+  uint32_t max_results_value = 0;
+  while (true) {
+    std::list<RefPtr<Entry>> ready_entries;
+    MojoResult result = WaitForReadyEntries(&deadline, &ready_entries);
+    if (result != MOJO_RESULT_OK)
+      return result;
+
+    // Find the dispatchers for the (possibly) ready entries. (Entries may have
+    // been removed, or even removed and replaced, in the meantime.)
+    std::vector<RefPtr<Dispatcher>> dispatchers;
+    dispatchers.reserve(ready_entries.size());
+    {
+      MutexLocker locker(&mutex());
+      if (is_closed_no_lock())
+        return MOJO_RESULT_CANCELLED;
+      for (const auto& entry : ready_entries) {
+        auto it = entries_.find(entry->cookie());
+        dispatchers.push_back((it != entries_.end() && it->second.entry == entry)
+                                  ? it->second.handle.dispatcher.Clone()
+                                  : nullptr);
+      }
+    }
+
+    // Recheck their states (this takes the dispatchers' locks, so we can't hold
+    // any of our locks).
+    std::vector<HandleSignalsState> signals_states(dispatchers.size());
+    for (size_t i = 0; i < dispatchers.size(); i++) {
+      if (dispatchers[i])
+        signals_states[i] = dispatchers[i]->GetHandleSignalsState();
+    }
+
+    // Collect results and put the entries that are still ready back on the
+    // ready list (unless they were awoken again in the meantime). Entries that
+    // we report go behind the ones that we don't (because |num_results| was too
+    // small), so that the next wait reports the latter first.
+    {
+      MutexLocker locker(&awakable_mutex_);
+      std::list<RefPtr<Entry>> reported_entries;
+      size_t i = 0;
+      for (auto& entry : ready_entries) {
+        if (!dispatchers[i]) {
+          i++;
+          continue;
+        }
+
+        const HandleSignalsState& state = signals_states[i++];
+        MojoWaitSetResult entry_result = {entry->cookie(), MOJO_RESULT_OK, 0u,
+                                          MOJO_HANDLE_SIGNAL_NONE,
+                                          MOJO_HANDLE_SIGNAL_NONE};
+        if (entry->is_cancelled) {
+          entry_result.wait_result = MOJO_RESULT_CANCELLED;
+        } else if (state.satisfies(entry->signals())) {
+          entry_result.satisfied_signals = state.satisfied_signals;
+          entry_result.satisfiable_signals = state.satisfiable_signals;
+        } else if (!state.can_satisfy(entry->signals())) {
+          entry_result.wait_result = MOJO_RESULT_FAILED_PRECONDITION;
+          entry_result.satisfied_signals = state.satisfied_signals;
+          entry_result.satisfiable_signals = state.satisfiable_signals;
+        } else {
+          // No longer ready; it'll be put back on the ready list when it's next
+          // awoken.
+          continue;
+        }
+
+        max_results_value++;
+        bool reported = results_value.size() < num_results_value;
+        if (reported)
+          results_value.push_back(entry_result);
+
+        if (!entry->is_ready && !awakable_closed_) {
+          entry->is_ready = true;
+          if (reported) {
+            entry->ready_list_it =
+                reported_entries.insert(reported_entries.end(), entry);
+          } else {
+            entry->ready_list_it = ready_list_.insert(ready_list_.end(), entry);
+          }
+        }
+      }
+      // (Splicing doesn't invalidate the entries' |ready_list_it|s.)
+      ready_list_.splice(ready_list_.end(), reported_entries);
+      // Other waiters may want the entries that we've put back.
+      if (!ready_list_.empty())
+        cv_.Signal();
+    }
+
+    if (max_results_value > 0)
+      break;
+    // Otherwise, all the entries were stale, so wait again.
+  }
+
+  if (!results_value.empty())
+    results.PutArray(results_value.data(), results_value.size());
+  num_results.Put(static_cast<uint32_t>(results_value.size()));
+  if (!max_results.IsNull())
+    max_results.Put(max_results_value);
+  return MOJO_RESULT_OK;
+}
+
+void WaitSetDispatcher::CloseImplNoLock() {
+  mutex().AssertHeld();
+
+  // We can't unregister our entries here (since we're under |mutex()|), so
+  // detach them instead. They'll unregister themselves the next time they're
+  // awoken (or when their dispatchers are closed).
+  for (auto& p : entries_)
+    p.second.entry->Detach();
+  entries_.clear();
+
+  MutexLocker locker(&awakable_mutex_);
+  awakable_closed_ = true;
+  for (auto& entry : ready_list_)
+    entry->is_ready = false;
+  ready_list_.clear();
+  cv_.SignalAll();
+}
+
+void WaitSetDispatcher::OnEntryAwoken(Entry* entry, MojoResult result) {
+  MutexLocker locker(&awakable_mutex_);
+  if (awakable_closed_)
+    return;
+
+  if (result == MOJO_RESULT_CANCELLED)
+    entry->is_cancelled = true;
+  if (entry->is_ready)
+    return;
 
-  // TODO(vtl)
-  NOTIMPLEMENTED();
-  return MOJO_RESULT_UNIMPLEMENTED;
+  entry->is_ready = true;
+  entry->ready_list_it =
+      ready_list_.insert(ready_list_.end(), RefPtr<Entry>(entry));
+  cv_.Signal();
+}
+
+MojoResult WaitSetDispatcher::WaitForReadyEntries(
+    MojoDeadline* deadline,
+    std::list<RefPtr<Entry>>* ready_entries) {
+  DCHECK(ready_entries->empty());
+
+  MutexLocker locker(&awakable_mutex_);
+  if (*deadline == MOJO_DEADLINE_INDEFINITE) {
+    while (ready_list_.empty() && !awakable_closed_)
+      cv_.Wait(&awakable_mutex_);
+  } else if (ready_list_.empty() && !awakable_closed_ && *deadline > 0) {
+    // We may get spurious wakeups (and we may be woken for entries that are
+    // taken by other waiters), so track the remaining timeout.
+    MojoTimeTicks start = GetTimeTicks();
+    uint64_t wait_remaining = *deadline;
+    while (ready_list_.empty() && !awakable_closed_) {
+      if (cv_.WaitWithTimeout(&awakable_mutex_, wait_remaining)) {
+        wait_remaining = 0;  // Definitely timed out.
+        break;
+      }
+
+      MojoTimeTicks now = GetTimeTicks();
+      DCHECK_GE(now, start);
+      uint64_t elapsed = static_cast<uint64_t>(now - start);
+      if (elapsed >= *deadline) {
+        wait_remaining = 0;
+        break;
+      }
+      wait_remaining = *deadline - elapsed;
+    }
+    *deadline = wait_remaining;
+  }
+
+  if (awakable_closed_)
+    return MOJO_RESULT_CANCELLED;
+  if (ready_list_.empty())
+    return MOJO_RESULT_DEADLINE_EXCEEDED;
+
+  ready_entries->swap(ready_list_);
+  for (auto& entry : *ready_entries)
+    entry->is_ready = false;
+  return MOJO_RESULT_OK;
+}
+
+void WaitSetDispatcher::RemoveEntry(uint64_t cookie, Entry* entry) {
+  Handle handle;
+  MutexLocker locker(&mutex());
+  auto it = entries_.find(cookie);
+  if (it == entries_.end() || it->second.entry.get() != entry)
+    return;
+  // Keep the handle alive until we release |mutex()|.
+  handle = std::move(it->second.handle);
+  entries_.erase(it);
+  entry->Detach();
 }
 
 }  // namespace system
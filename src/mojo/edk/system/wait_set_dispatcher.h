@@ -5,7 +5,17 @@
 #ifndef MOJO_EDK_SYSTEM_WAIT_SET_DISPATCHER_H_
 #define MOJO_EDK_SYSTEM_WAIT_SET_DISPATCHER_H_
 
+#include <stdint.h>
+
+#include <list>
+#include <unordered_map>
+
 #include "mojo/edk/system/dispatcher.h"
+#include "mojo/edk/system/handle.h"
+#include "mojo/edk/util/cond_var.h"
+#include "mojo/edk/util/mutex.h"
+#include "mojo/edk/util/ref_ptr.h"
+#include "mojo/edk/util/thread_annotations.h"
 #include "mojo/public/cpp/system/macros.h"
 
 namespace mojo {
@@ -13,6 +23,19 @@ namespace system {
 
 // This is the |Dispatcher| implementation for wait sets (created by the Mojo
 // primitive |MojoCreateWaitSet()|). This class is thread-safe.
+//
+// Unlike |Core::WaitMany()|, which registers a |Waiter| with every handle on
+// each call, a wait set registers an awakable (an |Entry|) with each added
+// handle once, when the entry is added, and keeps it registered until the entry
+// is removed (or the wait set is closed). Entries that are awoken are put on a
+// "ready list", so |WaitSetWait()| only has to look at entries that may be
+// ready, i.e., it costs O(number of ready entries) rather than O(number of
+// entries).
+//
+// The ready list is only a hint: it is maintained "edge-triggered" (entries are
+// added when awoken), but |WaitSetWait()| provides level-triggered semantics by
+// rechecking the state of each entry on the ready list (and dropping those that
+// are no longer ready, which will be re-added when next awoken).
 class WaitSetDispatcher final : public Dispatcher {
  public:
   // The default/standard rights for a wait set handle. Note that they are not
@@ -68,6 +91,46 @@ class WaitSetDispatcher final : public Dispatcher {
                              UserPointer<uint32_t> num_results,
                              UserPointer<MojoWaitSetResult> results,
                              UserPointer<uint32_t> max_results) override;
+  void CloseImplNoLock() override;
+
+  // The |Awakable| registered with the handle for each entry (defined in the
+  // .cc file).
+  class Entry;
+
+  // Called by |Entry::Awake()| (under |entry|'s mutex, and various other
+  // locks). This only takes |awakable_mutex_|.
+  void OnEntryAwoken(Entry* entry, MojoResult result);
+
+  // Waits until |ready_list_| is nonempty, moving its contents to
+  // |*ready_entries|. Returns |MOJO_RESULT_OK| on success, or
+  // |MOJO_RESULT_DEADLINE_EXCEEDED| or |MOJO_RESULT_CANCELLED| (if the wait set
+  // was closed). |*deadline| is updated to reflect the time remaining.
+  MojoResult WaitForReadyEntries(MojoDeadline* deadline,
+                                 std::list<util::RefPtr<Entry>>* ready_entries);
+
+  // Removes the entry for |cookie| if it is |entry| (and detaches it).
+  void RemoveEntry(uint64_t cookie, Entry* entry);
+
+  struct EntryInfo {
+    EntryInfo(util::RefPtr<Entry>&& entry, Handle&& handle);
+    EntryInfo(EntryInfo&&);
+    ~EntryInfo();
+
+    util::RefPtr<Entry> entry;
+    // Note: This is kept here (instead of in |Entry|), since |Entry|s may be
+    // destroyed under other dispatchers' locks.
+    Handle handle;
+  };
+
+  // Map of cookies to entries.
+  std::unordered_map<uint64_t, EntryInfo> entries_ MOJO_GUARDED_BY(mutex());
+
+  // |awakable_mutex_| is an "INF"-level lock (see core.cc), which protects the
+  // following members and the "ready" state of all our |Entry|s.
+  util::Mutex awakable_mutex_;
+  util::CondVar cv_;  // Associated to |awakable_mutex_|.
+  bool awakable_closed_ MOJO_GUARDED_BY(awakable_mutex_);
+  std::list<util::RefPtr<Entry>> ready_list_ MOJO_GUARDED_BY(awakable_mutex_);
 
   MOJO_DISALLOW_COPY_AND_ASSIGN(WaitSetDispatcher);
 };
@@ -0,0 +1,364 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// NOTE(vtl): Some of these tests are inherently flaky (e.g., if run on a
+// heavily-loaded system). Sorry. |test::EpsilonTimeout()| may be increased to
+// increase tolerance and reduce observed flakiness (though doing so reduces the
+// meaningfulness of the test).
+
+#include "mojo/edk/system/wait_set_dispatcher.h"
+
+#include "mojo/edk/platform/test_stopwatch.h"
+#include "mojo/edk/platform/thread_utils.h"
+#include "mojo/edk/system/handle.h"
+#include "mojo/edk/system/mock_simple_dispatcher.h"
+#include "mojo/edk/system/test/simple_test_thread.h"
+#include "mojo/edk/system/test/timeouts.h"
+#include "mojo/edk/util/ref_ptr.h"
+#include "mojo/public/cpp/system/macros.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using mojo::platform::test::Stopwatch;
+using mojo::platform::ThreadSleep;
+using mojo::util::MakeRefCounted;
+using mojo::util::RefPtr;
+
+namespace mojo {
+namespace system {
+namespace {
+
+const MojoHandleRights kTestRights = MOJO_HANDLE_RIGHT_READ |
+                                     MOJO_HANDLE_RIGHT_WRITE;
+
+RefPtr<WaitSetDispatcher> CreateWaitSet() {
+  MojoCreateWaitSetOptions validated_options = {};
+  EXPECT_EQ(MOJO_RESULT_OK, WaitSetDispatcher::ValidateCreateOptions(
+                                NullUserPointer(), &validated_options));
+  return WaitSetDispatcher::Create(validated_options);
+}
+
+// Sets |d|'s satisfied signals to |signals| after sleeping for |sleep_time|.
+class SetSignalsThread final : public test::SimpleTestThread {
+ public:
+  SetSignalsThread(RefPtr<test::MockSimpleDispatcher> d,
+                   MojoDeadline sleep_time,
+                   MojoHandleSignals signals)
+      : d_(d), sleep_time_(sleep_time), signals_(signals) {}
+  ~SetSignalsThread() override {}
+
+ private:
+  void Run() override {
+    ThreadSleep(sleep_time_);
+    d_->SetSatisfiedSignals(signals_);
+  }
+
+  const RefPtr<test::MockSimpleDispatcher> d_;
+  const MojoDeadline sleep_time_;
+  const MojoHandleSignals signals_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(SetSignalsThread);
+};
+
+TEST(WaitSetDispatcherTest, Basic) {
+  auto wait_set = CreateWaitSet();
+  EXPECT_EQ(Dispatcher::Type::WAIT_SET, wait_set->GetType());
+  auto d0 = MakeRefCounted<test::MockSimpleDispatcher>();
+  auto d1 = MakeRefCounted<test::MockSimpleDispatcher>();
+
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetAdd(NullUserPointer(),
+                                 Handle(d0.Clone(), kTestRights),
+                                 MOJO_HANDLE_SIGNAL_READABLE, 123u));
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetAdd(NullUserPointer(),
+                                 Handle(d1.Clone(), kTestRights),
+                                 MOJO_HANDLE_SIGNAL_WRITABLE, 456u));
+  // Duplicate cookie.
+  EXPECT_EQ(MOJO_RESULT_ALREADY_EXISTS,
+            wait_set->WaitSetAdd(NullUserPointer(),
+                                 Handle(d1.Clone(), kTestRights),
+                                 MOJO_HANDLE_SIGNAL_READABLE, 123u));
+
+  // Nothing is ready.
+  uint32_t num_results = 10u;
+  MojoWaitSetResult results[10] = {};
+  uint32_t max_results = 789u;
+  EXPECT_EQ(MOJO_RESULT_DEADLINE_EXCEEDED,
+            wait_set->WaitSetWait(0, MakeUserPointer(&num_results),
+                                  MakeUserPointer(results),
+                                  MakeUserPointer(&max_results)));
+  EXPECT_EQ(10u, num_results);
+  EXPECT_EQ(789u, max_results);
+
+  // Make |d1| writable.
+  d1->SetSatisfiedSignals(MOJO_HANDLE_SIGNAL_WRITABLE);
+  num_results = 10u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetWait(0, MakeUserPointer(&num_results),
+                                  MakeUserPointer(results),
+                                  MakeUserPointer(&max_results)));
+  EXPECT_EQ(1u, num_results);
+  EXPECT_EQ(1u, max_results);
+  EXPECT_EQ(456u, results[0].cookie);
+  EXPECT_EQ(MOJO_RESULT_OK, results[0].wait_result);
+  EXPECT_EQ(0u, results[0].reserved);
+  EXPECT_EQ(MOJO_HANDLE_SIGNAL_WRITABLE, results[0].satisfied_signals);
+  EXPECT_EQ(MOJO_HANDLE_SIGNAL_READABLE | MOJO_HANDLE_SIGNAL_WRITABLE,
+            results[0].satisfiable_signals);
+
+  // It's still writable, so it should be reported again.
+  num_results = 10u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetWait(0, MakeUserPointer(&num_results),
+                                  MakeUserPointer(results), NullUserPointer()));
+  EXPECT_EQ(1u, num_results);
+  EXPECT_EQ(456u, results[0].cookie);
+
+  // But not after it stops being writable.
+  d1->SetSatisfiedSignals(MOJO_HANDLE_SIGNAL_NONE);
+  num_results = 10u;
+  EXPECT_EQ(MOJO_RESULT_DEADLINE_EXCEEDED,
+            wait_set->WaitSetWait(0, MakeUserPointer(&num_results),
+                                  MakeUserPointer(results), NullUserPointer()));
+
+  // Make both ready, and check that |num_results| is respected.
+  d0->SetSatisfiedSignals(MOJO_HANDLE_SIGNAL_READABLE);
+  d1->SetSatisfiedSignals(MOJO_HANDLE_SIGNAL_WRITABLE);
+  num_results = 1u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetWait(0, MakeUserPointer(&num_results),
+                                  MakeUserPointer(results),
+                                  MakeUserPointer(&max_results)));
+  EXPECT_EQ(1u, num_results);
+  EXPECT_EQ(2u, max_results);
+
+  EXPECT_EQ(MOJO_RESULT_NOT_FOUND, wait_set->WaitSetRemove(789u));
+  EXPECT_EQ(MOJO_RESULT_OK, wait_set->WaitSetRemove(456u));
+  EXPECT_EQ(MOJO_RESULT_NOT_FOUND, wait_set->WaitSetRemove(456u));
+
+  num_results = 10u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetWait(0, MakeUserPointer(&num_results),
+                                  MakeUserPointer(results),
+                                  MakeUserPointer(&max_results)));
+  EXPECT_EQ(1u, num_results);
+  EXPECT_EQ(1u, max_results);
+  EXPECT_EQ(123u, results[0].cookie);
+  EXPECT_EQ(MOJO_RESULT_OK, results[0].wait_result);
+
+  EXPECT_EQ(MOJO_RESULT_OK, wait_set->Close());
+  EXPECT_EQ(MOJO_RESULT_OK, d0->Close());
+  EXPECT_EQ(MOJO_RESULT_OK, d1->Close());
+}
+
+// Checks that when more entries are ready than fit in |num_results|, the ones
+// that weren't reported are reported by the following waits (i.e., that the
+// first few ready entries don't starve the rest).
+TEST(WaitSetDispatcherTest, MoreReadyThanResults) {
+  static const uint64_t kNumEntries = 5u;
+  static const uint32_t kNumResults = 2u;
+
+  auto wait_set = CreateWaitSet();
+  RefPtr<test::MockSimpleDispatcher> dispatchers[kNumEntries];
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    dispatchers[i] = MakeRefCounted<test::MockSimpleDispatcher>(
+        MOJO_HANDLE_SIGNAL_READABLE, MOJO_HANDLE_SIGNAL_READABLE);
+    EXPECT_EQ(MOJO_RESULT_OK,
+              wait_set->WaitSetAdd(NullUserPointer(),
+                                   Handle(dispatchers[i].Clone(), kTestRights),
+                                   MOJO_HANDLE_SIGNAL_READABLE, i));
+  }
+
+  // Everything stays ready, so every entry should be reported once in the first
+  // (|kNumEntries| + |kNumResults| - 1) / |kNumResults| waits.
+  bool reported[kNumEntries] = {};
+  for (uint64_t i = 0; i < (kNumEntries + kNumResults - 1) / kNumResults;
+       i++) {
+    uint32_t num_results = kNumResults;
+    MojoWaitSetResult results[kNumResults] = {};
+    uint32_t max_results = 0u;
+    EXPECT_EQ(MOJO_RESULT_OK,
+              wait_set->WaitSetWait(0, MakeUserPointer(&num_results),
+                                    MakeUserPointer(results),
+                                    MakeUserPointer(&max_results)));
+    EXPECT_EQ(kNumResults, num_results);
+    EXPECT_EQ(kNumEntries, max_results);
+    for (uint32_t j = 0; j < num_results; j++) {
+      ASSERT_LT(results[j].cookie, kNumEntries);
+      EXPECT_EQ(MOJO_RESULT_OK, results[j].wait_result);
+      reported[results[j].cookie] = true;
+    }
+  }
+  for (uint64_t i = 0; i < kNumEntries; i++)
+    EXPECT_TRUE(reported[i]) << i;
+
+  EXPECT_EQ(MOJO_RESULT_OK, wait_set->Close());
+  for (auto& d : dispatchers)
+    EXPECT_EQ(MOJO_RESULT_OK, d->Close());
+}
+
+TEST(WaitSetDispatcherTest, Unsatisfiable) {
+  auto wait_set = CreateWaitSet();
+  auto d = MakeRefCounted<test::MockSimpleDispatcher>();
+
+  // Already unsatisfiable when added.
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetAdd(NullUserPointer(),
+                                 Handle(d.Clone(), kTestRights),
+                                 MOJO_HANDLE_SIGNAL_PEER_CLOSED, 1u));
+  // Becomes unsatisfiable later.
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetAdd(NullUserPointer(),
+                                 Handle(d.Clone(), kTestRights),
+                                 MOJO_HANDLE_SIGNAL_WRITABLE, 2u));
+
+  uint32_t num_results = 10u;
+  MojoWaitSetResult results[10] = {};
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetWait(0, MakeUserPointer(&num_results),
+                                  MakeUserPointer(results), NullUserPointer()));
+  ASSERT_EQ(1u, num_results);
+  EXPECT_EQ(1u, results[0].cookie);
+  EXPECT_EQ(MOJO_RESULT_FAILED_PRECONDITION, results[0].wait_result);
+
+  d->SetSatisfiableSignals(MOJO_HANDLE_SIGNAL_READABLE);
+  num_results = 10u;
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetWait(0, MakeUserPointer(&num_results),
+                                  MakeUserPointer(results), NullUserPointer()));
+  ASSERT_EQ(2u, num_results);
+  EXPECT_EQ(MOJO_RESULT_FAILED_PRECONDITION, results[0].wait_result);
+  EXPECT_EQ(MOJO_RESULT_FAILED_PRECONDITION, results[1].wait_result);
+  EXPECT_EQ(3u, results[0].cookie + results[1].cookie);
+
+  EXPECT_EQ(MOJO_RESULT_OK, wait_set->Close());
+  EXPECT_EQ(MOJO_RESULT_OK, d->Close());
+}
+
+TEST(WaitSetDispatcherTest, HandleClosed) {
+  auto wait_set = CreateWaitSet();
+  auto d = MakeRefCounted<test::MockSimpleDispatcher>();
+
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetAdd(NullUserPointer(),
+                                 Handle(d.Clone(), kTestRights),
+                                 MOJO_HANDLE_SIGNAL_READABLE, 1u));
+  EXPECT_EQ(MOJO_RESULT_OK, d->Close());
+
+  uint32_t num_results = 10u;
+  MojoWaitSetResult results[10] = {};
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetWait(0, MakeUserPointer(&num_results),
+                                  MakeUserPointer(results), NullUserPointer()));
+  ASSERT_EQ(1u, num_results);
+  EXPECT_EQ(1u, results[0].cookie);
+  EXPECT_EQ(MOJO_RESULT_CANCELLED, results[0].wait_result);
+  EXPECT_EQ(MOJO_HANDLE_SIGNAL_NONE, results[0].satisfied_signals);
+  EXPECT_EQ(MOJO_HANDLE_SIGNAL_NONE, results[0].satisfiable_signals);
+
+  EXPECT_EQ(MOJO_RESULT_OK, wait_set->WaitSetRemove(1u));
+
+  // Adding a closed handle fails.
+  EXPECT_EQ(MOJO_RESULT_INVALID_ARGUMENT,
+            wait_set->WaitSetAdd(NullUserPointer(),
+                                 Handle(d.Clone(), kTestRights),
+                                 MOJO_HANDLE_SIGNAL_READABLE, 1u));
+  EXPECT_EQ(MOJO_RESULT_NOT_FOUND, wait_set->WaitSetRemove(1u));
+
+  EXPECT_EQ(MOJO_RESULT_OK, wait_set->Close());
+}
+
+TEST(WaitSetDispatcherTest, Threaded) {
+  Stopwatch stopwatch;
+  auto wait_set = CreateWaitSet();
+  auto d = MakeRefCounted<test::MockSimpleDispatcher>();
+
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetAdd(NullUserPointer(),
+                                 Handle(d.Clone(), kTestRights),
+                                 MOJO_HANDLE_SIGNAL_READABLE, 1u));
+
+  // Timeout.
+  uint32_t num_results = 10u;
+  MojoWaitSetResult results[10] = {};
+  stopwatch.Start();
+  EXPECT_EQ(MOJO_RESULT_DEADLINE_EXCEEDED,
+            wait_set->WaitSetWait(2 * test::EpsilonTimeout(),
+                                  MakeUserPointer(&num_results),
+                                  MakeUserPointer(results), NullUserPointer()));
+  MojoDeadline elapsed = stopwatch.Elapsed();
+  EXPECT_GT(elapsed, (2 - 1) * test::EpsilonTimeout());
+  EXPECT_LT(elapsed, (2 + 1) * test::EpsilonTimeout());
+
+  // Woken from another thread.
+  {
+    SetSignalsThread thread(d.Clone(), 2 * test::EpsilonTimeout(),
+                            MOJO_HANDLE_SIGNAL_READABLE);
+    stopwatch.Start();
+    thread.Start();
+    num_results = 10u;
+    EXPECT_EQ(MOJO_RESULT_OK,
+              wait_set->WaitSetWait(MOJO_DEADLINE_INDEFINITE,
+                                    MakeUserPointer(&num_results),
+                                    MakeUserPointer(results),
+                                    NullUserPointer()));
+    elapsed = stopwatch.Elapsed();
+    EXPECT_GT(elapsed, (2 - 1) * test::EpsilonTimeout());
+    EXPECT_LT(elapsed, (2 + 1) * test::EpsilonTimeout());
+    EXPECT_EQ(1u, num_results);
+    EXPECT_EQ(1u, results[0].cookie);
+    thread.Join();
+  }
+
+  EXPECT_EQ(MOJO_RESULT_OK, wait_set->Close());
+  EXPECT_EQ(MOJO_RESULT_OK, d->Close());
+}
+
+// Closes the given wait set after sleeping for |sleep_time|.
+class CloseThread final : public test::SimpleTestThread {
+ public:
+  CloseThread(RefPtr<Dispatcher> d, MojoDeadline sleep_time)
+      : d_(d), sleep_time_(sleep_time) {}
+  ~CloseThread() override {}
+
+ private:
+  void Run() override {
+    ThreadSleep(sleep_time_);
+    EXPECT_EQ(MOJO_RESULT_OK, d_->Close());
+  }
+
+  const RefPtr<Dispatcher> d_;
+  const MojoDeadline sleep_time_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(CloseThread);
+};
+
+TEST(WaitSetDispatcherTest, CloseWhileWaiting) {
+  auto wait_set = CreateWaitSet();
+  auto d = MakeRefCounted<test::MockSimpleDispatcher>();
+
+  EXPECT_EQ(MOJO_RESULT_OK,
+            wait_set->WaitSetAdd(NullUserPointer(),
+                                 Handle(d.Clone(), kTestRights),
+                                 MOJO_HANDLE_SIGNAL_READABLE, 1u));
+
+  CloseThread thread(wait_set.Clone(), test::EpsilonTimeout());
+  thread.Start();
+  uint32_t num_results = 10u;
+  MojoWaitSetResult results[10] = {};
+  EXPECT_EQ(MOJO_RESULT_CANCELLED,
+            wait_set->WaitSetWait(MOJO_DEADLINE_INDEFINITE,
+                                  MakeUserPointer(&num_results),
+                                  MakeUserPointer(results), NullUserPointer()));
+  EXPECT_EQ(10u, num_results);
+  thread.Join();
+
+  // The (detached) entry must not wake anything after the wait set is closed.
+  d->SetSatisfiedSignals(MOJO_HANDLE_SIGNAL_READABLE);
+  EXPECT_EQ(MOJO_RESULT_OK, d->Close());
+}
+
+}  // namespace
+}  // namespace system
+}  // namespace mojo
@@ -4,6 +4,8 @@
 
 #include "mojo/edk/system/waiter.h"
 
+#include <pthread.h>
+
 #include "base/logging.h"
 #include "mojo/edk/platform/time_ticks.h"
 
@@ -13,6 +15,35 @@ using mojo::util::MutexLocker;
 namespace mojo {
 namespace system {
 
+namespace {
+
+pthread_once_t g_thread_waiter_key_once = PTHREAD_ONCE_INIT;
+pthread_key_t g_thread_waiter_key;
+
+void DeleteThreadWaiter(void* waiter) {
+  delete static_cast<Waiter*>(waiter);
+}
+
+void CreateThreadWaiterKey() {
+  int error = pthread_key_create(&g_thread_waiter_key, &DeleteThreadWaiter);
+  CHECK_EQ(error, 0);
+}
+
+}  // namespace
+
+// static
+Waiter* Waiter::GetForCurrentThread() {
+  pthread_once(&g_thread_waiter_key_once, &CreateThreadWaiterKey);
+  Waiter* waiter =
+      static_cast<Waiter*>(pthread_getspecific(g_thread_waiter_key));
+  if (!waiter) {
+    waiter = new Waiter();
+    int error = pthread_setspecific(g_thread_waiter_key, waiter);
+    CHECK_EQ(error, 0);
+  }
+  return waiter;
+}
+
 Waiter::Waiter()
     :
 #ifndef NDEBUG
@@ -29,14 +60,29 @@ void Waiter::Init() {
 #ifndef NDEBUG
   initialized_ = true;
 #endif
-  awoken_ = false;
+  awoken_.store(false, std::memory_order_relaxed);
   // NOTE(vtl): If performance ever becomes an issue, we can disable the setting
   // of |awake_result_| (except the first one in |Awake()|) in Release builds.
   awake_result_ = MOJO_RESULT_INTERNAL;
 }
 
-// TODO(vtl): Fast-path the |deadline == 0| case?
 MojoResult Waiter::Wait(MojoDeadline deadline, uint64_t* context) {
+  // Fast-path the already-awoken case (without taking |mutex_|):
+  if (awoken_.load(std::memory_order_acquire)) {
+#ifndef NDEBUG
+    {
+      MutexLocker locker(&mutex_);
+      DCHECK(initialized_);
+      // It'll need to be re-initialized after this.
+      initialized_ = false;
+    }
+#endif
+    DCHECK_NE(awake_result_, MOJO_RESULT_INTERNAL);
+    if (context)
+      *context = awake_context_;
+    return awake_result_;
+  }
+
   MutexLocker locker(&mutex_);
 
 #ifndef NDEBUG
@@ -45,18 +91,23 @@ MojoResult Waiter::Wait(MojoDeadline deadline, uint64_t* context) {
   initialized_ = false;
 #endif
 
-  // Fast-path the already-awoken case:
-  if (awoken_) {
+  if (awoken_.load(std::memory_order_relaxed)) {
     DCHECK_NE(awake_result_, MOJO_RESULT_INTERNAL);
     if (context)
       *context = awake_context_;
     return awake_result_;
   }
 
+  if (deadline == 0)
+    return MOJO_RESULT_DEADLINE_EXCEEDED;
+
+  // Since we hold |mutex_|, any |Awake()| that sets |awoken_| must wait for us
+  // to release it (in |cv_.Wait()|/|cv_.WaitWithTimeout()|), so relaxed loads
+  // suffice below.
   if (deadline == MOJO_DEADLINE_INDEFINITE) {
     do {
       cv_.Wait(&mutex_);
-    } while (!awoken_);
+    } while (!awoken_.load(std::memory_order_relaxed));
   } else {
     // We may get spurious wakeups, so record the start time and track the
     // remaining timeout.
@@ -69,7 +120,7 @@ MojoResult Waiter::Wait(MojoDeadline deadline, uint64_t* context) {
         return MOJO_RESULT_DEADLINE_EXCEEDED;  // Definitely timed out.
 
       // Otherwise, we may have been awoken.
-      if (awoken_)
+      if (awoken_.load(std::memory_order_relaxed))
         break;
 
       // Or the wakeup may have been spurious.
@@ -92,14 +143,19 @@ MojoResult Waiter::Wait(MojoDeadline deadline, uint64_t* context) {
 }
 
 bool Waiter::Awake(MojoResult result, uint64_t context) {
+  // Fast-path the already-awoken case (e.g., for |MojoWaitMany()|, when
+  // multiple handles become satisfied).
+  if (awoken_.load(std::memory_order_acquire))
+    return true;
+
   MutexLocker locker(&mutex_);
 
-  if (awoken_)
+  if (awoken_.load(std::memory_order_relaxed))
     return true;
 
-  awoken_ = true;
   awake_result_ = result;
   awake_context_ = context;
+  awoken_.store(true, std::memory_order_release);
   cv_.Signal();
   // |cv_.Wait()|/|cv_.WaitWithTimeout()| will return after |mutex_| is
   // released.
@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 
+#include <atomic>
+
 #include "mojo/edk/system/awakable.h"
 #include "mojo/edk/util/cond_var.h"
 #include "mojo/edk/util/mutex.h"
@@ -22,11 +24,22 @@ namespace system {
 // under other locks, in particular, |Dispatcher::lock_|s, so |Waiter| methods
 // must never call out to other objects (in particular, |Dispatcher|s). This
 // class is thread-safe.
+//
+// Note that once a waiter has been awoken (until it's re-|Init()|ed), |Wait()|
+// and |Awake()| don't need to take its mutex, so a |Waiter| that is reused
+// (e.g., by |Core|, which keeps one per thread) is cheap in the
+// already-satisfied case.
 class Waiter final : public Awakable {
  public:
   Waiter();
   ~Waiter() override;
 
+  // Gets the calling thread's |Waiter|, creating it if necessary (it'll be
+  // destroyed when the thread exits). A given thread may only use its |Waiter|
+  // for one wait at a time, and must remove it from all the things it was added
+  // to before finishing with it.
+  static Waiter* GetForCurrentThread();
+
   // A |Waiter| can be used multiple times; |Init()| should be called before
   // each time it's used.
   void Init() MOJO_NOT_THREAD_SAFE;
@@ -67,9 +80,13 @@ class Waiter final : public Awakable {
 #ifndef NDEBUG
   bool initialized_ MOJO_GUARDED_BY(mutex_);
 #endif
-  bool awoken_ MOJO_GUARDED_BY(mutex_);
-  MojoResult awake_result_ MOJO_GUARDED_BY(mutex_);
-  uint64_t awake_context_ MOJO_GUARDED_BY(mutex_);
+  // Only set (to true) under |mutex_|, but may be read without it. If it's
+  // true (as read with acquire semantics), then |awake_result_| and
+  // |awake_context_| may also be read without |mutex_|, since they won't be
+  // modified again until the next |Init()|.
+  std::atomic<bool> awoken_;
+  MojoResult awake_result_;
+  uint64_t awake_context_;
 
   MOJO_DISALLOW_COPY_AND_ASSIGN(Waiter);
 };
@@ -299,6 +299,48 @@ TEST(WaiterTest, MultipleAwakes) {
   }
 }
 
+// Gets (and uses) the |Waiter| for its thread.
+class GetWaiterThread : public test::SimpleTestThread {
+ public:
+  GetWaiterThread() : waiter_(nullptr) {}
+  ~GetWaiterThread() override {}
+
+  Waiter* waiter() const { return waiter_; }
+
+ private:
+  void Run() override {
+    waiter_ = Waiter::GetForCurrentThread();
+    // It should be usable (and reusable).
+    for (uint64_t i = 0; i < 3; i++) {
+      waiter_->Init();
+      waiter_->Awake(MOJO_RESULT_OK, i);
+      uint64_t context = static_cast<uint64_t>(-1);
+      EXPECT_EQ(MOJO_RESULT_OK, waiter_->Wait(MOJO_DEADLINE_INDEFINITE,
+                                              &context));
+      EXPECT_EQ(i, context);
+    }
+  }
+
+  Waiter* waiter_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(GetWaiterThread);
+};
+
+TEST(WaiterTest, GetForCurrentThread) {
+  Waiter* waiter = Waiter::GetForCurrentThread();
+  ASSERT_TRUE(waiter);
+  EXPECT_EQ(waiter, Waiter::GetForCurrentThread());
+
+  waiter->Init();
+  EXPECT_EQ(MOJO_RESULT_DEADLINE_EXCEEDED, waiter->Wait(0, nullptr));
+
+  GetWaiterThread thread;
+  thread.Start();
+  thread.Join();
+  EXPECT_TRUE(thread.waiter());
+  EXPECT_NE(waiter, thread.waiter());
+}
+
 }  // namespace
 }  // namespace system
 }  // namespace mojo
@@ -103,8 +103,14 @@ void CondVar::Wait(Mutex* mutex) {
   INTERNAL_DCHECK(mutex);
   mutex->AssertHeld();
 
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  mutex->StopHoldTimer();
+#endif
   int error = pthread_cond_wait(&impl_, &mutex->impl_);
   INTERNAL_DCHECK_WITH_ERRNO(!error, "pthread_cond_wait", error);
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  mutex->StartHoldTimer();
+#endif
 }
 
 bool CondVar::WaitWithTimeout(Mutex* mutex, uint64_t timeout_microseconds) {
@@ -130,7 +136,14 @@ bool CondVar::WaitWithTimeout(Mutex* mutex, uint64_t timeout_microseconds) {
   timeout_rel.tv_nsec =
       static_cast<long>((timeout_microseconds % kMicrosecondsPerSecond) *
                         kNanosecondsPerMicrosecond);
-  return RelativeTimedWait(timeout_rel, &impl_, &mutex->impl_);
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  mutex->StopHoldTimer();
+#endif
+  bool timed_out = RelativeTimedWait(timeout_rel, &impl_, &mutex->impl_);
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  mutex->StartHoldTimer();
+#endif
+  return timed_out;
 }
 
 void CondVar::Signal() {
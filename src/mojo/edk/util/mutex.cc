@@ -4,15 +4,110 @@
 
 #include "mojo/edk/util/mutex.h"
 
-#if !defined(NDEBUG) || defined(DCHECK_ALWAYS_ON)
 #include <errno.h>
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+
+#include "build/build_config.h"
 #include "mojo/edk/util/logging_internal.h"
 
 namespace mojo {
 namespace util {
 
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+namespace internal {
+
+// The (live) statistics for a lock site (see |MutexContentionStats|). These are
+// never destroyed.
+struct MutexContentionSite {
+  explicit MutexContentionSite(const void* site) : site(site) {}
+
+  const void* const site;
+  std::atomic<uint64_t> num_mutexes{0};
+  std::atomic<uint64_t> num_acquisitions{0};
+  std::atomic<uint64_t> num_contended_acquisitions{0};
+  std::atomic<uint64_t> total_wait_nanoseconds{0};
+  std::atomic<uint64_t> total_hold_nanoseconds{0};
+  std::atomic<uint64_t> max_waiters{0};
+};
+
+}  // namespace internal
+
+namespace {
+
+using SiteMap = std::unordered_map<const void*, internal::MutexContentionSite*>;
+
+// Protects |g_sites|. (This is a plain pthreads mutex, since a |Mutex| would
+// need |g_sites| itself.)
+pthread_mutex_t g_sites_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Leaked (along with its values), since |Mutex|es may outlive static
+// destructors.
+SiteMap* g_sites = nullptr;
+
+internal::MutexContentionSite* GetContentionSite(const void* site) {
+  pthread_mutex_lock(&g_sites_mutex);
+  if (!g_sites)
+    g_sites = new SiteMap();
+  internal::MutexContentionSite*& result = (*g_sites)[site];
+  if (!result)
+    result = new internal::MutexContentionSite(site);
+  pthread_mutex_unlock(&g_sites_mutex);
+  return result;
+}
+
+uint64_t NowNanoseconds() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+void UpdateMax(std::atomic<uint64_t>* max, uint64_t value) {
+  uint64_t old_max = max->load(std::memory_order_relaxed);
+  while (value > old_max &&
+         !max->compare_exchange_weak(old_max, value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace
+#endif  // defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+
+#if defined(MOJO_EDK_ADAPTIVE_MUTEX)
+namespace {
+
+// Upper bound on the number of times a contended |Lock()| spins before
+// blocking.
+const int kMaxSpinCount = 100;
+
+// Spinning is pointless if there's only one processor (the holder of the lock
+// can't run while we spin).
+bool ShouldSpin() {
+  static const bool should_spin = std::thread::hardware_concurrency() != 1u;
+  return should_spin;
+}
+
+// Hints to the processor that we're in a spin loop.
+inline void CpuRelax() {
+#if defined(ARCH_CPU_X86_FAMILY)
+  __asm__ __volatile__("pause");
+#elif defined(ARCH_CPU_ARM_FAMILY)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+}  // namespace
+#endif  // defined(MOJO_EDK_ADAPTIVE_MUTEX)
+
+#if !defined(NDEBUG) || defined(DCHECK_ALWAYS_ON) || \
+    defined(MOJO_EDK_ADAPTIVE_MUTEX) ||              \
+    defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+
 Mutex::Mutex() {
+#if !defined(NDEBUG) || defined(DCHECK_ALWAYS_ON)
   pthread_mutexattr_t attr;
   int error = pthread_mutexattr_init(&attr);
   INTERNAL_DCHECK_WITH_ERRNO(!error, "pthread_mutexattr_init", error);
@@ -22,6 +117,21 @@ Mutex::Mutex() {
   INTERNAL_DCHECK_WITH_ERRNO(!error, "pthread_mutex_init", error);
   error = pthread_mutexattr_destroy(&attr);
   INTERNAL_DCHECK_WITH_ERRNO(!error, "pthread_mutexattr_destroy", error);
+#else
+  pthread_mutex_init(&impl_, nullptr);
+#endif
+
+#if defined(MOJO_EDK_ADAPTIVE_MUTEX)
+  spin_count_.store(0, std::memory_order_relaxed);
+#endif
+
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  // The lock site is our caller.
+  site_ = GetContentionSite(__builtin_return_address(0));
+  site_->num_mutexes.fetch_add(1u, std::memory_order_relaxed);
+  num_waiters_.store(0u, std::memory_order_relaxed);
+  hold_start_nanoseconds_ = 0u;
+#endif
 }
 
 Mutex::~Mutex() {
@@ -30,11 +140,26 @@ Mutex::~Mutex() {
 }
 
 void Mutex::Lock() MOJO_EXCLUSIVE_LOCK_FUNCTION() {
+#if defined(MOJO_EDK_ADAPTIVE_MUTEX) || defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  int error = pthread_mutex_trylock(&impl_);
+  if (error) {
+    INTERNAL_DCHECK_WITH_ERRNO(error == EBUSY, "pthread_mutex_trylock", error);
+    LockContended();
+  }
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  site_->num_acquisitions.fetch_add(1u, std::memory_order_relaxed);
+  StartHoldTimer();
+#endif
+#else
   int error = pthread_mutex_lock(&impl_);
   INTERNAL_DCHECK_WITH_ERRNO(!error, "pthread_mutex_lock", error);
+#endif
 }
 
 void Mutex::Unlock() MOJO_UNLOCK_FUNCTION() {
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  StopHoldTimer();
+#endif
   int error = pthread_mutex_unlock(&impl_);
   INTERNAL_DCHECK_WITH_ERRNO(!error, "pthread_mutex_unlock", error);
 }
@@ -43,15 +168,121 @@ bool Mutex::TryLock() MOJO_EXCLUSIVE_TRYLOCK_FUNCTION(true) {
   int error = pthread_mutex_trylock(&impl_);
   INTERNAL_DCHECK_WITH_ERRNO(!error || error == EBUSY, "pthread_mutex_trylock",
                              error);
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  if (!error) {
+    site_->num_acquisitions.fetch_add(1u, std::memory_order_relaxed);
+    StartHoldTimer();
+  }
+#endif
   return !error;
 }
 
 void Mutex::AssertHeld() MOJO_ASSERT_EXCLUSIVE_LOCK() {
+#if !defined(NDEBUG) || defined(DCHECK_ALWAYS_ON)
   int error = pthread_mutex_lock(&impl_);
   INTERNAL_DCHECK_WITH_ERRNO(error == EDEADLK, "pthread_mutex_lock", error);
+#endif
+}
+
+#endif  // !defined(NDEBUG) || defined(DCHECK_ALWAYS_ON) || ...
+
+#if defined(MOJO_EDK_ADAPTIVE_MUTEX) || defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+void Mutex::LockContended() {
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  uint64_t wait_start_nanoseconds = NowNanoseconds();
+  uint32_t num_waiters =
+      num_waiters_.fetch_add(1u, std::memory_order_relaxed) + 1u;
+  UpdateMax(&site_->max_waiters, num_waiters);
+#endif
+
+  bool acquired = false;
+#if defined(MOJO_EDK_ADAPTIVE_MUTEX)
+  if (ShouldSpin()) {
+    // Spin for up to about twice as long as it recently took, so that we adapt
+    // to how long the lock is typically held.
+    int max_spins = std::min(
+        kMaxSpinCount, spin_count_.load(std::memory_order_relaxed) * 2 + 10);
+    int spins = 0;
+    for (; spins < max_spins; spins++) {
+      CpuRelax();
+      if (!pthread_mutex_trylock(&impl_)) {
+        acquired = true;
+        break;
+      }
+    }
+    // We hold the lock when updating |spin_count_| (below, if we didn't
+    // acquire it while spinning).
+    if (acquired) {
+      int spin_count = spin_count_.load(std::memory_order_relaxed);
+      spin_count_.store(spin_count + (spins - spin_count) / 8,
+                        std::memory_order_relaxed);
+    } else {
+      int error = pthread_mutex_lock(&impl_);
+      INTERNAL_DCHECK_WITH_ERRNO(!error, "pthread_mutex_lock", error);
+      acquired = true;
+      int spin_count = spin_count_.load(std::memory_order_relaxed);
+      spin_count_.store(spin_count + (max_spins - spin_count) / 8,
+                        std::memory_order_relaxed);
+    }
+  }
+#endif  // defined(MOJO_EDK_ADAPTIVE_MUTEX)
+  if (!acquired) {
+    int error = pthread_mutex_lock(&impl_);
+    INTERNAL_DCHECK_WITH_ERRNO(!error, "pthread_mutex_lock", error);
+  }
+
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  num_waiters_.fetch_sub(1u, std::memory_order_relaxed);
+  site_->num_contended_acquisitions.fetch_add(1u, std::memory_order_relaxed);
+  site_->total_wait_nanoseconds.fetch_add(
+      NowNanoseconds() - wait_start_nanoseconds, std::memory_order_relaxed);
+#endif
+}
+#endif  // defined(MOJO_EDK_ADAPTIVE_MUTEX) || ...
+
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+void Mutex::StartHoldTimer() {
+  hold_start_nanoseconds_ = NowNanoseconds();
+}
+
+void Mutex::StopHoldTimer() {
+  site_->total_hold_nanoseconds.fetch_add(
+      NowNanoseconds() - hold_start_nanoseconds_, std::memory_order_relaxed);
+}
+#endif  // defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+
+std::vector<MutexContentionStats> GetMutexContentionStats() {
+  std::vector<MutexContentionStats> result;
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  pthread_mutex_lock(&g_sites_mutex);
+  if (g_sites) {
+    result.reserve(g_sites->size());
+    for (const auto& entry : *g_sites) {
+      const internal::MutexContentionSite& site = *entry.second;
+      MutexContentionStats stats = {};
+      stats.site = site.site;
+      stats.num_mutexes = site.num_mutexes.load(std::memory_order_relaxed);
+      stats.num_acquisitions =
+          site.num_acquisitions.load(std::memory_order_relaxed);
+      stats.num_contended_acquisitions =
+          site.num_contended_acquisitions.load(std::memory_order_relaxed);
+      stats.total_wait_nanoseconds =
+          site.total_wait_nanoseconds.load(std::memory_order_relaxed);
+      stats.total_hold_nanoseconds =
+          site.total_hold_nanoseconds.load(std::memory_order_relaxed);
+      stats.max_waiters = site.max_waiters.load(std::memory_order_relaxed);
+      result.push_back(stats);
+    }
+  }
+  pthread_mutex_unlock(&g_sites_mutex);
+
+  std::sort(result.begin(), result.end(),
+            [](const MutexContentionStats& a, const MutexContentionStats& b) {
+              return a.total_wait_nanoseconds > b.total_wait_nanoseconds;
+            });
+#endif
+  return result;
 }
 
 }  // namespace util
 }  // namespace mojo
-
-#endif  // !defined(NDEBUG) || defined(DCHECK_ALWAYS_ON)
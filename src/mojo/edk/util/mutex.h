@@ -4,12 +4,26 @@
 
 // A mutex class, with support for thread annotations.
 //
+// Two build-time options (set via GN args; see BUILD.gn) change how |Mutex|
+// behaves under contention:
+//   - |MOJO_EDK_ADAPTIVE_MUTEX|: |Lock()| spins for a while (adapting to how
+//     long the lock has recently been held) before blocking.
+//   - |MOJO_EDK_MUTEX_CONTENTION_STATS|: contention statistics are recorded
+//     per lock site (see |GetMutexContentionStats()| below).
+//
 // TODO(vtl): Add support for non-exclusive (reader) locks.
 
 #ifndef MOJO_EDK_UTIL_MUTEX_H_
 #define MOJO_EDK_UTIL_MUTEX_H_
 
 #include <pthread.h>
+#include <stdint.h>
+
+#if defined(MOJO_EDK_ADAPTIVE_MUTEX) || defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+#include <atomic>
+#endif
+
+#include <vector>
 
 #include "mojo/edk/util/thread_annotations.h"
 #include "mojo/public/cpp/system/macros.h"
@@ -21,9 +35,15 @@ namespace util {
 
 class CondVar;
 
+namespace internal {
+struct MutexContentionSite;
+}  // namespace internal
+
 class MOJO_LOCKABLE Mutex final {
  public:
-#if defined(NDEBUG) && !defined(DCHECK_ALWAYS_ON)
+#if defined(NDEBUG) && !defined(DCHECK_ALWAYS_ON) && \
+    !defined(MOJO_EDK_ADAPTIVE_MUTEX) &&             \
+    !defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
   Mutex() { pthread_mutex_init(&impl_, nullptr); }
   ~Mutex() { pthread_mutex_destroy(&impl_); }
 
@@ -51,13 +71,40 @@ class MOJO_LOCKABLE Mutex final {
   bool TryLock() MOJO_EXCLUSIVE_TRYLOCK_FUNCTION(true);
 
   void AssertHeld() MOJO_ASSERT_EXCLUSIVE_LOCK();
-#endif  // defined(NDEBUG) && !defined(DCHECK_ALWAYS_ON)
+#endif
 
  private:
   friend class CondVar;
 
+#if defined(MOJO_EDK_ADAPTIVE_MUTEX) || defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  // Called by |Lock()| if the lock couldn't be taken immediately.
+  void LockContended();
+#endif
+
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  // Called (with the lock held) when the lock is taken, or retaken after a wait
+  // on a |CondVar|, and just before it is released, or released for a wait on a
+  // |CondVar|, respectively.
+  void StartHoldTimer();
+  void StopHoldTimer();
+#endif
+
   pthread_mutex_t impl_;
 
+#if defined(MOJO_EDK_ADAPTIVE_MUTEX)
+  // Exponentially-weighted average of the number of spins it took for contended
+  // |Lock()|s to succeed; only modified with the lock held.
+  std::atomic<int> spin_count_;
+#endif
+
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+  internal::MutexContentionSite* site_;
+  // Number of threads blocked (or spinning) in |Lock()|.
+  std::atomic<uint32_t> num_waiters_;
+  // When the lock was (last) taken; only accessed with the lock held.
+  uint64_t hold_start_nanoseconds_;
+#endif
+
   MOJO_DISALLOW_COPY_AND_ASSIGN(Mutex);
 };
 
@@ -77,6 +124,37 @@ class MOJO_SCOPED_LOCKABLE MutexLocker final {
   MOJO_DISALLOW_COPY_AND_ASSIGN(MutexLocker);
 };
 
+// Contention statistics -------------------------------------------------------
+
+// Statistics for all the |Mutex|es created at a given "lock site", i.e., by a
+// given caller of |Mutex|'s constructor (typically the constructor of the class
+// that contains the |Mutex| as a member).
+struct MutexContentionStats {
+  // Address of the code that constructed the |Mutex|es (symbolize it to get the
+  // file and line).
+  const void* site;
+
+  // Number of |Mutex|es created at this site.
+  uint64_t num_mutexes;
+
+  // Number of successful |Lock()|s and |TryLock()|s, and the number of
+  // |Lock()|s that couldn't take the lock immediately.
+  uint64_t num_acquisitions;
+  uint64_t num_contended_acquisitions;
+
+  // Total time spent in contended |Lock()|s, and with the lock held.
+  uint64_t total_wait_nanoseconds;
+  uint64_t total_hold_nanoseconds;
+
+  // Maximum number of threads waiting for a single |Mutex| at once.
+  uint64_t max_waiters;
+};
+
+// Gets the contention statistics for all lock sites, sorted by decreasing
+// |total_wait_nanoseconds| (so that the most contended sites come first). This
+// is always empty unless built with |MOJO_EDK_MUTEX_CONTENTION_STATS|.
+std::vector<MutexContentionStats> GetMutexContentionStats();
+
 }  // namespace util
 }  // namespace mojo
 
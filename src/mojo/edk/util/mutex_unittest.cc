@@ -7,10 +7,12 @@
 #include <stdlib.h>
 
 #include <thread>
+#include <vector>
 
 #include "build/build_config.h"
 #include "mojo/edk/platform/thread_utils.h"
 #include "mojo/edk/system/test/timeouts.h"
+#include "mojo/edk/util/waitable_event.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
 using mojo::platform::ThreadSleep;
@@ -208,6 +210,92 @@ TEST(MutexTest, MutexLocker) {
   mutex.Unlock();
 }
 
+// Contention statistics -------------------------------------------------------
+
+#if defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+// Gets the statistics for the lock site |site|, or returns false if there are
+// none.
+bool GetStatsForSite(const void* site, MutexContentionStats* stats) {
+  for (const auto& s : GetMutexContentionStats()) {
+    if (s.site == site) {
+      *stats = s;
+      return true;
+    }
+  }
+  return false;
+}
+
+TEST(MutexTest, ContentionStats) MOJO_NO_THREAD_SAFETY_ANALYSIS {
+  std::vector<MutexContentionStats> stats_before = GetMutexContentionStats();
+
+  Mutex mutex;
+
+  // Find the lock site for |mutex|: it's the one with one more |Mutex|.
+  const void* site = nullptr;
+  for (const auto& s : GetMutexContentionStats()) {
+    uint64_t num_mutexes_before = 0u;
+    for (const auto& b : stats_before) {
+      if (b.site == s.site)
+        num_mutexes_before = b.num_mutexes;
+    }
+    if (s.num_mutexes == num_mutexes_before + 1u) {
+      EXPECT_FALSE(site);
+      site = s.site;
+    }
+  }
+  ASSERT_TRUE(site);
+
+  // The statistics for |site| accumulate over repeated runs of this test, so
+  // only look at how they change during this run.
+  MutexContentionStats before = {};
+  ASSERT_TRUE(GetStatsForSite(site, &before));
+
+  // Uncontended.
+  mutex.Lock();
+  mutex.Unlock();
+  ASSERT_TRUE(mutex.TryLock());
+  mutex.Unlock();
+
+  // Contended: hold |mutex| until (probably) after the other thread has started
+  // waiting for it, and retry until it actually had to wait.
+  MutexContentionStats stats = {};
+  uint64_t num_attempts = 0u;
+  do {
+    num_attempts++;
+    AutoResetWaitableEvent about_to_lock;
+    mutex.Lock();
+    auto thread = std::thread([&mutex, &about_to_lock]() {
+      about_to_lock.Signal();
+      mutex.Lock();
+      mutex.Unlock();
+    });
+    about_to_lock.Wait();
+    ThreadSleep(DeadlineFromMilliseconds(1u));
+    mutex.Unlock();
+    thread.join();
+    ASSERT_TRUE(GetStatsForSite(site, &stats));
+  } while (stats.num_contended_acquisitions ==
+           before.num_contended_acquisitions);
+
+  EXPECT_EQ(before.num_acquisitions + 2u + 2u * num_attempts,
+            stats.num_acquisitions);
+  EXPECT_EQ(before.num_contended_acquisitions + 1u,
+            stats.num_contended_acquisitions);
+  EXPECT_GT(stats.total_wait_nanoseconds, before.total_wait_nanoseconds);
+  EXPECT_GT(stats.total_hold_nanoseconds, before.total_hold_nanoseconds);
+  EXPECT_GE(stats.max_waiters, 1u);
+}
+#else
+TEST(MutexTest, ContentionStats) {
+  Mutex mutex;
+  mutex.Lock();
+  mutex.Unlock();
+
+  // Statistics are only collected if enabled at build time.
+  EXPECT_TRUE(GetMutexContentionStats().empty());
+}
+#endif  // defined(MOJO_EDK_MUTEX_CONTENTION_STATS)
+
 }  // namespace
 }  // namespace util
 }  // namespace mojo
@@ -87,10 +87,14 @@ MOJO_STATIC_ASSERT(sizeof(struct MojoBufferInformation) == 16,
 
 // |MojoMapBufferFlags|: Used to specify different modes to |MojoMapBuffer()|.
 //   |MOJO_MAP_BUFFER_FLAG_NONE| - No flags; default mode.
+//   |MOJO_MAP_BUFFER_FLAG_READ_ONLY| - Map the buffer read-only. (Writing to
+//       the resulting memory is undefined behavior, and typically crashes.)
+//       This only requires the |MOJO_HANDLE_RIGHT_MAP_READABLE| right.
 
 typedef uint32_t MojoMapBufferFlags;
 
 #define MOJO_MAP_BUFFER_FLAG_NONE ((MojoMapBufferFlags)0)
+#define MOJO_MAP_BUFFER_FLAG_READ_ONLY ((MojoMapBufferFlags)1 << 0)
 
 MOJO_BEGIN_EXTERN_C
 
@@ -182,11 +186,11 @@ MojoResult MojoGetBufferInformation(MojoHandle buffer_handle,            // In.
 
 // |MojoMapBuffer()|: Maps the part (at offset |offset| of length |num_bytes|)
 // of the buffer given by |buffer_handle| (which must have both the
-// |MOJO_HANDLE_RIGHT_MAP_READABLE| and |MOJO_HANDLE_RIGHT_MAP_WRITABLE| rights)
-// into memory, with options specified by |flags|. |offset + num_bytes| must be
-// less than or equal to the size of the buffer. On success, |*buffer| points to
-// memory with the requested part of the buffer. (On failure, it is not
-// modified.)
+// |MOJO_HANDLE_RIGHT_MAP_READABLE| and |MOJO_HANDLE_RIGHT_MAP_WRITABLE| rights,
+// or just the former if |MOJO_MAP_BUFFER_FLAG_READ_ONLY| is set) into memory,
+// with options specified by |flags|. |offset + num_bytes| must be less than or
+// equal to the size of the buffer. On success, |*buffer| points to memory with
+// the requested part of the buffer. (On failure, it is not modified.)
 //
 // A single buffer handle may have multiple active mappings (possibly depending
 // on the buffer type). The permissions (e.g., writable or executable) of the
@@ -204,12 +208,14 @@ MojoResult MojoGetBufferInformation(MojoHandle buffer_handle,            // In.
 //       |offset| and |num_bytes| is not valid).
 //   |MOJO_RESULT_PERMISSION_DENIED| if |buffer_handle| does not have both the
 //       |MOJO_HANDLE_RIGHT_MAP_READABLE| and |MOJO_HANDLE_RIGHT_MAP_WRITABLE|
-//       rights.
+//       rights (or, if |MOJO_MAP_BUFFER_FLAG_READ_ONLY| is set, does not have
+//       the |MOJO_HANDLE_RIGHT_MAP_READABLE| right).
 //   |MOJO_RESULT_RESOURCE_EXHAUSTED| if the mapping operation itself failed
 //       (e.g., due to not having appropriate address space available).
 //   |MOJO_RESULT_BUSY| if |buffer_handle| is currently in use in some
 //       transaction (that, e.g., may result in it being invalidated, such as
 //       being sent in a message).
+//   |MOJO_RESULT_UNIMPLEMENTED| if an unsupported flag was set in |flags|.
 MojoResult MojoMapBuffer(MojoHandle buffer_handle,   // In.
                          uint64_t offset,            // In.
                          uint64_t num_bytes,         // In.
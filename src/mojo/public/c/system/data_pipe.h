@@ -170,6 +170,9 @@ MojoResult MojoCreateDataPipe(
 // satisfied or satisfiable) of the |MOJO_HANDLE_SIGNAL_WRITE_THRESHOLD| handle
 // signal being changed.
 //
+// The options stay with the handle, including if it is sent over a message
+// pipe.
+//
 // Returns:
 //   |MOJO_RESULT_OK| on success.
 //   |MOJO_RESULT_INVALID_ARGUMENT| if some argument was invalid (e.g.,
@@ -326,6 +329,52 @@ MojoResult MojoBeginWriteData(MojoHandle data_pipe_producer_handle,      // In.
 MojoResult MojoEndWriteData(MojoHandle data_pipe_producer_handle,  // In.
                             uint32_t num_bytes_written);           // In.
 
+// |MojoBeginWriteDataSpans()|: Like |MojoBeginWriteData()|, but exposes all the
+// space currently available to be written, which (if the data pipe's buffer is
+// a ring buffer and the free space wraps around its end) may consist of two
+// discontiguous spans. |buffers| and |buffers_num_bytes| must each point to
+// arrays of two entries. On success, |buffers[0]| will be a pointer to which
+// the caller can write |buffers_num_bytes[0]| (which will be nonzero) bytes of
+// data, and |buffers[1]| will be a pointer to which it can write a further
+// |buffers_num_bytes[1]| bytes (which may be zero, in which case |buffers[1]|
+// will be null). Both sizes will be multiples of the element size.
+//
+// The two-phase write is ended by |MojoEndWriteData()|, with
+// |num_bytes_written| being the total amount of data written. The first span
+// must be filled before the second: the data written is taken to be the first
+// |num_bytes_written| bytes of the concatenation of the two spans.
+//
+// Returns: As for |MojoBeginWriteData()|.
+MojoResult MojoBeginWriteDataSpans(
+    MojoHandle data_pipe_producer_handle,       // In.
+    void** MOJO_RESTRICT buffers,               // Out.
+    uint32_t* MOJO_RESTRICT buffers_num_bytes,  // Out.
+    MojoWriteDataFlags flags);                  // In.
+
+// |MojoWriteDataV()|: Like |MojoWriteData()|, but gathers the data to be
+// written from |num_buffers| buffers: |buffers[i]| should point to
+// |buffers_num_bytes[i]| bytes of data, for each |i| less than |num_buffers|
+// (which must be at most 1024). Individual buffers need not be multiples of the
+// element size, but their total must be. On success, |*num_bytes_written| is
+// set to the total amount of data written (from the buffers, in order); if
+// |flags| has |MOJO_WRITE_DATA_FLAG_ALL_OR_NONE| set, this will either write
+// all the data or none of it.
+//
+// This is typically used to write, e.g., a header and a payload from separate
+// buffers without an intermediate copy (and atomically, using
+// |MOJO_WRITE_DATA_FLAG_ALL_OR_NONE|).
+//
+// Returns: As for |MojoWriteData()|. (|MOJO_RESULT_INVALID_ARGUMENT| is also
+// returned if |num_buffers| is too large or the total number of bytes overflows
+// a |uint32_t|.)
+MojoResult MojoWriteDataV(
+    MojoHandle data_pipe_producer_handle,             // In.
+    const void* const* MOJO_RESTRICT buffers,         // In.
+    const uint32_t* MOJO_RESTRICT buffers_num_bytes,  // In.
+    uint32_t num_buffers,                             // In.
+    uint32_t* MOJO_RESTRICT num_bytes_written,        // Out.
+    MojoWriteDataFlags flags);                        // In.
+
 // |MojoSetDataPipeConsumerOptions()|: Sets options for the data pipe consumer
 // handle |data_pipe_consumer_handle| (which must have the
 // |MOJO_HANDLE_RIGHT_SET_OPTIONS| right).
@@ -336,6 +385,9 @@ MojoResult MojoEndWriteData(MojoHandle data_pipe_producer_handle,  // In.
 // satisfied or satisfiable) of the |MOJO_HANDLE_SIGNAL_READ_THRESHOLD| handle
 // signal being changed.
 //
+// The options stay with the handle, including if it is sent over a message
+// pipe.
+//
 // Returns:
 //   |MOJO_RESULT_OK| on success.
 //   |MOJO_RESULT_INVALID_ARGUMENT| if some argument was invalid (e.g.,
@@ -506,6 +558,50 @@ MojoResult MojoBeginReadData(MojoHandle data_pipe_consumer_handle,      // In.
 MojoResult MojoEndReadData(MojoHandle data_pipe_consumer_handle,  // In.
                            uint32_t num_bytes_read);              // In.
 
+// |MojoBeginReadDataSpans()|: Like |MojoBeginReadData()|, but exposes all the
+// data currently available to be read, which (if the data pipe's buffer is a
+// ring buffer and the data wraps around its end) may consist of two
+// discontiguous spans. |buffers| and |buffers_num_bytes| must each point to
+// arrays of two entries. On success, |buffers[0]| will be a pointer from which
+// the caller can read |buffers_num_bytes[0]| (which will be nonzero) bytes of
+// data, and |buffers[1]| will be a pointer from which it can read the
+// following |buffers_num_bytes[1]| bytes (which may be zero, in which case
+// |buffers[1]| will be null). Both sizes will be multiples of the element size.
+//
+// The two-phase read is ended by |MojoEndReadData()|, with |num_bytes_read|
+// being the total amount of data consumed (from the first span, then from the
+// second).
+//
+// Returns: As for |MojoBeginReadData()|.
+MojoResult MojoBeginReadDataSpans(
+    MojoHandle data_pipe_consumer_handle,       // In.
+    const void** MOJO_RESTRICT buffers,         // Out.
+    uint32_t* MOJO_RESTRICT buffers_num_bytes,  // Out.
+    MojoReadDataFlags flags);                   // In.
+
+// |MojoReadDataV()|: Like |MojoReadData()|, but scatters the data read into
+// |num_buffers| buffers: |buffers[i]| should point to a buffer of
+// |buffers_num_bytes[i]| bytes, for each |i| less than |num_buffers| (which
+// must be at most 1024). Individual buffers need not be multiples of the
+// element size, but their total must be. The buffers are filled in order, and
+// on success |*num_bytes_read| is set to the total amount of data read.
+//
+// |flags| may have |MOJO_READ_DATA_FLAG_ALL_OR_NONE| (which then applies to
+// the total size of the buffers) and/or |MOJO_READ_DATA_FLAG_PEEK| set, with
+// the same meanings as for |MojoReadData()|. |MOJO_READ_DATA_FLAG_DISCARD| and
+// |MOJO_READ_DATA_FLAG_QUERY| are not allowed (use |MojoReadData()| instead).
+//
+// Returns: As for |MojoReadData()|. (|MOJO_RESULT_INVALID_ARGUMENT| is also
+// returned if |num_buffers| is too large or the total number of bytes overflows
+// a |uint32_t|.)
+MojoResult MojoReadDataV(
+    MojoHandle data_pipe_consumer_handle,             // In.
+    void* const* MOJO_RESTRICT buffers,               // In.
+    const uint32_t* MOJO_RESTRICT buffers_num_bytes,  // In.
+    uint32_t num_buffers,                             // In.
+    uint32_t* MOJO_RESTRICT num_bytes_read,           // Out.
+    MojoReadDataFlags flags);                         // In.
+
 MOJO_END_EXTERN_C
 
 #endif  // MOJO_PUBLIC_C_SYSTEM_DATA_PIPE_H_
@@ -20,6 +20,20 @@
 //       extensions.)
 //   |MojoCreateMessagePipeOptionsFlags flags|: Reserved for future use.
 //       |MOJO_CREATE_MESSAGE_PIPE_OPTIONS_FLAG_NONE|: No flags; default mode.
+//   |uint32_t max_queued_messages|: The maximum number of messages that may be
+//       queued (i.e., written but not yet read) at either endpoint. Once this
+//       many messages are queued at an endpoint, writes to it (from its peer)
+//       will fail with |MOJO_RESULT_SHOULD_WAIT| and the peer will not be
+//       signaled |MOJO_HANDLE_SIGNAL_WRITABLE| until some are read. Set to zero
+//       to opt for the system default (which may be "no limit").
+//   |uint32_t max_queued_num_bytes|: The maximum total size, in bytes, of the
+//       message data that may be queued at either endpoint; otherwise as for
+//       |max_queued_messages|. (A single message larger than this may still be
+//       written to an endpoint with an empty queue.)
+//   Across processes, these limits are enforced approximately (the writer
+//   learns that messages have been read asynchronously), and they apply to the
+//   message pipe, staying with its endpoints if they are sent over a message
+//   pipe.
 
 typedef uint32_t MojoCreateMessagePipeOptionsFlags;
 
@@ -30,8 +44,10 @@ MOJO_STATIC_ASSERT(MOJO_ALIGNOF(int64_t) == 8, "int64_t has weird alignment");
 struct MOJO_ALIGNAS(8) MojoCreateMessagePipeOptions {
   uint32_t struct_size;
   MojoCreateMessagePipeOptionsFlags flags;
+  uint32_t max_queued_messages;
+  uint32_t max_queued_num_bytes;
 };
-MOJO_STATIC_ASSERT(sizeof(struct MojoCreateMessagePipeOptions) == 8,
+MOJO_STATIC_ASSERT(sizeof(struct MojoCreateMessagePipeOptions) == 16,
                    "MojoCreateMessagePipeOptions has wrong size");
 
 // |MojoWriteMessageFlags|: Used to specify different modes to
@@ -115,6 +131,10 @@ MojoResult MojoCreateMessagePipe(
 //       transaction (that, e.g., may result in it being invalidated, such as
 //       being sent in a message), or if some handle to be sent is currently in
 //       use.
+//   |MOJO_RESULT_SHOULD_WAIT| if the other endpoint's queue is full (see
+//       |MojoCreateMessagePipeOptions|). Wait for
+//       |MOJO_HANDLE_SIGNAL_WRITABLE|, which is raised again once the queue
+//       has drained, and retry.
 //
 // Note: |MOJO_RESULT_BUSY| is generally "preferred" over
 // |MOJO_RESULT_PERMISSION_DENIED|. E.g., if a handle to be sent both is busy
@@ -124,9 +144,6 @@ MojoResult MojoCreateMessagePipe(
 // producer/consumer) handle to be sent is in a two-phase write/read). But
 // should we? (For comparison, there's no such provision in |MojoClose()|.)
 // https://github.com/domokit/mojo/issues/782
-//
-// TODO(vtl): Add a notion of capacity for message pipes, and return
-// |MOJO_RESULT_SHOULD_WAIT| if the message pipe is full.
 MojoResult MojoWriteMessage(MojoHandle message_pipe_handle,  // In.
                             const void* bytes,               // Optional in.
                             uint32_t num_bytes,              // In.
@@ -179,6 +196,140 @@ MojoResult MojoReadMessage(
     uint32_t* MOJO_RESTRICT num_handles,  // Optional in/out.
     MojoReadMessageFlags flags);          // In.
 
+// |MojoBeginReadMessage()|: Begins a two-phase read of the next message from
+// the message pipe endpoint given by |message_pipe_handle| (which must have the
+// |MOJO_HANDLE_RIGHT_READ| right). On success, |*buffer| will be a pointer to
+// the message's data, which is owned by the system, and |*buffer_num_bytes|
+// will be set to its size; this avoids copying the data into a caller-provided
+// buffer. The caller may read and modify the data until it calls
+// |MojoEndReadMessage()| (or closes or transfers |message_pipe_handle|).
+//
+// The message is removed from the queue when the read begins. Its handles are
+// received at that point, exactly as for |MojoReadMessage()|: |handles| and
+// |num_handles| have the same meaning, and if the message has more handles
+// than fit in |handles|, the read does not begin and the message remains
+// enqueued (or is discarded, if |MOJO_READ_MESSAGE_FLAG_MAY_DISCARD| was
+// passed). |*buffer_num_bytes| is set to the size of the message even in that
+// case.
+//
+// During a two-phase read, |MojoReadMessage()| may still be used to read
+// subsequent messages, but another two-phase read may not be started.
+//
+// Returns:
+//   |MOJO_RESULT_OK| on success (i.e., a two-phase read was begun).
+//   |MOJO_RESULT_INVALID_ARGUMENT| if some argument was invalid.
+//   |MOJO_RESULT_FAILED_PRECONDITION| if the other endpoint has been closed
+//       (and there are no more messages).
+//   |MOJO_RESULT_PERMISSION_DENIED| if |message_pipe_handle| does not have the
+//       |MOJO_HANDLE_RIGHT_READ| right.
+//   |MOJO_RESULT_RESOURCE_EXHAUSTED| if the message's handles do not fit in
+//       |handles|.
+//   |MOJO_RESULT_SHOULD_WAIT| if no message was available to be read.
+//   |MOJO_RESULT_BUSY| if there is already a two-phase read ongoing with
+//       |message_pipe_handle| (or if |message_pipe_handle| is currently in use
+//       in some transaction).
+MojoResult MojoBeginReadMessage(
+    MojoHandle message_pipe_handle,            // In.
+    void** MOJO_RESTRICT buffer,               // Out.
+    uint32_t* MOJO_RESTRICT buffer_num_bytes,  // Out.
+    MojoHandle* MOJO_RESTRICT handles,         // Optional out.
+    uint32_t* MOJO_RESTRICT num_handles,       // Optional in/out.
+    MojoReadMessageFlags flags);               // In.
+
+// |MojoEndReadMessage()|: Ends a two-phase read from the message pipe endpoint
+// given by |message_pipe_handle| (which must have the |MOJO_HANDLE_RIGHT_READ|
+// right) that was begun by a call to |MojoBeginReadMessage()| on the same
+// handle. The buffer returned by |MojoBeginReadMessage()| is invalid after this
+// call.
+//
+// Returns:
+//   |MOJO_RESULT_OK| on success.
+//   |MOJO_RESULT_INVALID_ARGUMENT| if |message_pipe_handle| is not a valid
+//       message pipe handle.
+//   |MOJO_RESULT_PERMISSION_DENIED| if |message_pipe_handle| does not have the
+//       |MOJO_HANDLE_RIGHT_READ| right.
+//   |MOJO_RESULT_FAILED_PRECONDITION| if no two-phase read was in progress.
+//   |MOJO_RESULT_BUSY| if |message_pipe_handle| is currently in use in some
+//       transaction.
+MojoResult MojoEndReadMessage(MojoHandle message_pipe_handle);  // In.
+
+// |MojoWriteMessages()|: Writes |num_messages| messages, none of which may have
+// handles attached, to the message pipe endpoint given by
+// |message_pipe_handle| (which must have the |MOJO_HANDLE_RIGHT_WRITE| right).
+// This is equivalent to calling |MojoWriteMessage()| for each message in turn
+// (with no handles), but is cheaper since it only enters the system once. The
+// messages' data is packed back-to-back in |bytes|, and |message_num_bytes|
+// must point to an array of |num_messages| sizes (the first message is the
+// first |message_num_bytes[0]| bytes of |bytes|, and so on).
+//
+// Messages are written in order, stopping at the first message that cannot be
+// written. If |num_messages_written| is non-null, |*num_messages_written| will
+// be set to the number of messages that were written (even on failure).
+//
+// Returns:
+//   |MOJO_RESULT_OK| if all the messages were written.
+//   Otherwise, the result for the first message that could not be written (as
+//       for |MojoWriteMessage()|); the messages before it will have been
+//       written.
+MojoResult MojoWriteMessages(
+    MojoHandle message_pipe_handle,                   // In.
+    const void* MOJO_RESTRICT bytes,                  // Optional in.
+    const uint32_t* MOJO_RESTRICT message_num_bytes,  // Optional in.
+    uint32_t num_messages,                            // In.
+    uint32_t* MOJO_RESTRICT num_messages_written,     // Optional out.
+    MojoWriteMessageFlags flags);                     // In.
+
+// |MojoReadMessages()|: Reads as many of the next messages from the message
+// pipe endpoint given by |message_pipe_handle| (which must have the
+// |MOJO_HANDLE_RIGHT_READ| right) as are available and fit in the provided
+// buffers, up to a maximum number. This is equivalent to calling
+// |MojoReadMessage()| repeatedly, but is cheaper since it only enters the
+// system once.
+//
+// On input, |*num_bytes| and |*num_handles| must be set to the sizes of the
+// |bytes| and |handles| arrays, and |*num_messages| to the maximum number of
+// messages to read (which must be at least 1), which is also the size of the
+// |message_num_bytes| and |message_num_handles| arrays. On output,
+// |*num_messages| will be set to the number of messages read and |*num_bytes|
+// and |*num_handles| to the total number of bytes and handles read. The
+// messages' data and handles are packed back-to-back in |bytes| and |handles|,
+// respectively; the size of each message and its number of handles are stored
+// in the corresponding entries of |message_num_bytes| and (if non-null)
+// |message_num_handles|. |num_handles| may be null if no handles are expected,
+// in which case |handles| must also be null. (The contents of |bytes| and
+// |handles| beyond what was read are unspecified.)
+//
+// Messages are read entirely or not at all. If the first message does not fit,
+// nothing is read, the first entries of |message_num_bytes| and (if non-null)
+// |message_num_handles| are set to its size, and it is left in the queue or
+// discarded as for |MojoReadMessage()| (|flags| only applies to the first
+// message). If a later message does not fit, reading simply stops and it
+// remains in the queue.
+//
+// Returns:
+//   |MOJO_RESULT_OK| on success (i.e., at least one message was read).
+//   |MOJO_RESULT_INVALID_ARGUMENT| if some argument was invalid.
+//   |MOJO_RESULT_FAILED_PRECONDITION| if the other endpoint has been closed
+//       (and there are no more messages).
+//   |MOJO_RESULT_PERMISSION_DENIED| if |message_pipe_handle| does not have the
+//       |MOJO_HANDLE_RIGHT_READ| right.
+//   |MOJO_RESULT_RESOURCE_EXHAUSTED| if the first message was too large to fit
+//       in the provided buffer(s).
+//   |MOJO_RESULT_SHOULD_WAIT| if no message was available to be read.
+//   |MOJO_RESULT_BUSY| if |message_pipe_handle| is currently in use in some
+//       transaction (that, e.g., may result in it being invalidated, such as
+//       being sent in a message).
+MojoResult MojoReadMessages(
+    MojoHandle message_pipe_handle,               // In.
+    void* MOJO_RESTRICT bytes,                    // Optional out.
+    uint32_t* MOJO_RESTRICT num_bytes,            // In/out.
+    MojoHandle* MOJO_RESTRICT handles,            // Optional out.
+    uint32_t* MOJO_RESTRICT num_handles,          // Optional in/out.
+    uint32_t* MOJO_RESTRICT message_num_bytes,    // Out.
+    uint32_t* MOJO_RESTRICT message_num_handles,  // Optional out.
+    uint32_t* MOJO_RESTRICT num_messages,         // In/out.
+    MojoReadMessageFlags flags);                  // In.
+
 MOJO_END_EXTERN_C
 
 #endif  // MOJO_PUBLIC_C_SYSTEM_MESSAGE_PIPE_H_
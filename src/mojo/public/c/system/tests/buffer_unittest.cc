@@ -127,6 +127,21 @@ TEST(BufferTest, MAYBE_Basic) {
   EXPECT_EQ(MOJO_RESULT_PERMISSION_DENIED, MojoDuplicateHandle(h2, &h3));
   EXPECT_EQ(MOJO_HANDLE_INVALID, h3);
 
+  // Without |MOJO_HANDLE_RIGHT_MAP_WRITABLE|, |h2| may only be mapped
+  // read-only.
+  EXPECT_EQ(MOJO_RESULT_OK, MojoReplaceHandleWithReducedRights(
+                                h2, MOJO_HANDLE_RIGHT_MAP_WRITABLE, &h2));
+  pointer = nullptr;
+  EXPECT_EQ(MOJO_RESULT_PERMISSION_DENIED,
+            MojoMapBuffer(h2, 50, 50, &pointer, MOJO_MAP_BUFFER_FLAG_NONE));
+  EXPECT_FALSE(pointer);
+  EXPECT_EQ(MOJO_RESULT_OK, MojoMapBuffer(h2, 50, 50, &pointer,
+                                          MOJO_MAP_BUFFER_FLAG_READ_ONLY));
+  ASSERT_TRUE(pointer);
+  EXPECT_EQ('x', static_cast<const char*>(pointer)[0]);
+  EXPECT_EQ('y', static_cast<const char*>(pointer)[1]);
+  EXPECT_EQ(MOJO_RESULT_OK, MojoUnmapBuffer(pointer));
+
   EXPECT_EQ(MOJO_RESULT_OK, MojoClose(h1));
   EXPECT_EQ(MOJO_RESULT_OK, MojoClose(h2));
 }
@@ -0,0 +1,51 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_PUBLIC_CPP_BINDINGS_ARRAY_DATA_VIEW_H_
+#define MOJO_PUBLIC_CPP_BINDINGS_ARRAY_DATA_VIEW_H_
+
+#include <stddef.h>
+
+#include <type_traits>
+
+#include "mojo/public/cpp/bindings/lib/array_internal.h"
+
+namespace mojo {
+
+// A read-only view of a serialized (and validated) mojom array of a numeric
+// type or of bools. It does not own the memory it refers to, and is only valid
+// for as long as the message it was obtained from. Arrays of other types are
+// read through the generated |Read...()| accessors instead.
+template <typename T>
+class ArrayDataView {
+ public:
+  static_assert(std::is_arithmetic<T>::value,
+                "ArrayDataView only supports arrays of numbers and bools");
+
+  using Data_ = internal::Array_Data<T>;
+
+  ArrayDataView() : data_(nullptr) {}
+  explicit ArrayDataView(const Data_* data) : data_(data) {}
+
+  bool is_null() const { return !data_; }
+
+  size_t size() const { return data_ ? data_->size() : 0u; }
+
+  typename Data_::ConstRef operator[](size_t offset) const {
+    return data_->at(offset);
+  }
+
+  // Note: For arrays of bools, the storage is a bit vector (see
+  // |internal::ArrayDataTraits<bool>|).
+  const typename Data_::StorageType* storage() const {
+    return data_ ? data_->storage() : nullptr;
+  }
+
+ private:
+  const Data_* data_;
+};
+
+}  // namespace mojo
+
+#endif  // MOJO_PUBLIC_CPP_BINDINGS_ARRAY_DATA_VIEW_H_
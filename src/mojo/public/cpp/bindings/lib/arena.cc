@@ -0,0 +1,135 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mojo/public/cpp/bindings/lib/arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+
+#include "mojo/public/cpp/environment/logging.h"
+
+namespace mojo {
+namespace internal {
+namespace {
+
+// The usable size of each block.
+const size_t kBlockSize = 4096u;
+
+// Larger objects are allocated from the heap, so as not to waste (much of) a
+// block.
+const size_t kMaxArenaObjectSize = kBlockSize / 4;
+
+// Each object is preceded by a header holding the block it was allocated from
+// (or null, if it was allocated from the heap). This keeps objects 8-byte
+// aligned.
+const size_t kObjectHeaderSize = 8u;
+static_assert(sizeof(void*) <= kObjectHeaderSize, "Object header too small");
+
+// While an arena allocates from a block, the block's reference count is
+// biased by this (instead of being incremented for each object allocated).
+const size_t kArenaReference = SIZE_MAX / 2;
+
+size_t AlignObjectSize(size_t size) {
+  return (size + 7u) & ~static_cast<size_t>(7u);
+}
+
+}  // namespace
+
+struct Arena::Block {
+  // The number of objects from this block that haven't been freed yet, plus
+  // |kArenaReference| less the number of objects allocated so far while the
+  // arena is still allocating from it.
+  std::atomic<size_t> ref_count;
+};
+
+Arena::Arena()
+    : block_(nullptr),
+      next_(nullptr),
+      end_(nullptr),
+      num_objects_(0u),
+      num_blocks_(0u) {}
+
+Arena::~Arena() {
+  ReleaseBlock();
+}
+
+void* Arena::AllocateObject(size_t num_bytes) {
+  char* header = static_cast<char*>(Allocate(num_bytes));
+  if (!header)
+    return AllocateHeapObject(num_bytes);
+  return header + kObjectHeaderSize;
+}
+
+// static
+void* Arena::AllocateHeapObject(size_t num_bytes) {
+  char* header = static_cast<char*>(malloc(kObjectHeaderSize + num_bytes));
+  MOJO_CHECK(header);
+  *reinterpret_cast<Block**>(header) = nullptr;
+  return header + kObjectHeaderSize;
+}
+
+// static
+void Arena::FreeObject(void* object) {
+  if (!object)
+    return;
+
+  char* header = static_cast<char*>(object) - kObjectHeaderSize;
+  Block* block = *reinterpret_cast<Block**>(header);
+  if (!block) {
+    free(header);
+    return;
+  }
+  if (block->ref_count.fetch_sub(1u) == 1u) {
+    block->~Block();
+    free(block);
+  }
+}
+
+void* Arena::Allocate(size_t num_bytes) {
+  if (num_bytes > kMaxArenaObjectSize)
+    return nullptr;
+
+  size_t size = AlignObjectSize(kObjectHeaderSize + num_bytes);
+  if (static_cast<size_t>(end_ - next_) < size) {
+    ReleaseBlock();
+
+    size_t block_header_size = AlignObjectSize(sizeof(Block));
+    char* memory = static_cast<char*>(malloc(block_header_size + kBlockSize));
+    MOJO_CHECK(memory);
+    block_ = new (memory) Block();
+    block_->ref_count = kArenaReference;
+    next_ = memory + block_header_size;
+    end_ = next_ + kBlockSize;
+    num_objects_ = 0u;
+    num_blocks_++;
+  }
+
+  char* header = next_;
+  *reinterpret_cast<Block**>(header) = block_;
+  next_ += size;
+  num_objects_++;
+  return header;
+}
+
+void Arena::ReleaseBlock() {
+  if (!block_)
+    return;
+
+  // Replace our bias with the number of objects allocated from the block; if
+  // they've all been freed already, that leaves nothing.
+  size_t released = kArenaReference - num_objects_;
+  if (block_->ref_count.fetch_sub(released) == released) {
+    block_->~Block();
+    free(block_);
+  }
+  block_ = nullptr;
+  next_ = nullptr;
+  end_ = nullptr;
+}
+
+}  // namespace internal
+}  // namespace mojo
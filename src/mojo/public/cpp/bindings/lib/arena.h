@@ -0,0 +1,80 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_PUBLIC_CPP_BINDINGS_LIB_ARENA_H_
+#define MOJO_PUBLIC_CPP_BINDINGS_LIB_ARENA_H_
+
+#include <stddef.h>
+
+#include "mojo/public/cpp/system/macros.h"
+
+namespace mojo {
+namespace internal {
+
+// Arena serves the allocations of mojom structs and unions (i.e., of the
+// objects owned by |StructPtr|s) that are explicitly made from it, by carving
+// them out of large blocks instead of allocating each one from the heap. The
+// generated stubs of interfaces with the [CppArena=true] attribute pass an
+// arena to |Deserialize_()| (and |ValidateAndDeserialize_()|) for each
+// message's parameters, so that the request's objects are allocated and freed
+// a block at a time. Everything else (e.g., |Foo::New()|) uses the heap, via
+// |AllocateHeapObject()|, so that |FreeObject()| can free any object owned by
+// a |StructPtr| (without it having to remember where the object came from).
+//
+// Objects may safely outlive the arena (e.g., if an implementation keeps part
+// of a request), and be freed on any thread: each block is freed once the
+// arena is gone and the last object allocated from it has been freed. (So
+// keeping a single object may keep a whole block alive.)
+//
+// Typical usage:
+//
+//   FooPtr foo;
+//   {
+//     Arena arena;
+//     foo = Foo::New();  // From the heap.
+//     Deserialize_(data, foo.get(), &arena);  // |foo|'s fields from |arena|.
+//   }
+//   // The objects |foo| owns are freed with the arena's blocks.
+class Arena {
+ public:
+  Arena();
+  ~Arena();
+
+  // Returns |num_bytes| of (uninitialized, 8-byte aligned) memory for an
+  // object, allocated from this arena (or from the heap, if it's too large).
+  // The memory must be freed using |FreeObject()|.
+  void* AllocateObject(size_t num_bytes);
+  // Like |AllocateObject()|, but always allocates from the heap.
+  static void* AllocateHeapObject(size_t num_bytes);
+  static void FreeObject(void* object);
+
+  // Returns the number of blocks this arena has allocated.
+  size_t num_blocks() const { return num_blocks_; }
+
+ private:
+  struct Block;
+
+  // Returns memory for an object (including its header), or null if it's too
+  // large to be allocated from a block.
+  void* Allocate(size_t num_bytes);
+
+  // Gives up the arena's hold on |block_|, leaving it to be freed along with
+  // the last object allocated from it.
+  void ReleaseBlock();
+
+  Block* block_;
+  // The unused part of |block_|.
+  char* next_;
+  char* end_;
+  // The number of objects allocated from |block_|.
+  size_t num_objects_;
+  size_t num_blocks_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(Arena);
+};
+
+}  // namespace internal
+}  // namespace mojo
+
+#endif  // MOJO_PUBLIC_CPP_BINDINGS_LIB_ARENA_H_
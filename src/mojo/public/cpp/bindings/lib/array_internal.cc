@@ -70,5 +70,23 @@ void ArraySerializationHelper<Handle, true, false>::DecodePointersAndHandles(
     DecodeHandle(&elements[i], handles);
 }
 
+// static
+void ArraySerializationHelper<Interface_Data, false, false>::
+    EncodePointersAndHandles(const ArrayHeader* header,
+                             ElementType* elements,
+                             std::vector<Handle>* handles) {
+  for (uint32_t i = 0; i < header->num_elements; ++i)
+    EncodeHandle(&elements[i], handles);
+}
+
+// static
+void ArraySerializationHelper<Interface_Data, false, false>::
+    DecodePointersAndHandles(const ArrayHeader* header,
+                             ElementType* elements,
+                             std::vector<Handle>* handles) {
+  for (uint32_t i = 0; i < header->num_elements; ++i)
+    DecodeHandle(&elements[i], handles);
+}
+
 }  // namespace internal
 }  // namespace mojo
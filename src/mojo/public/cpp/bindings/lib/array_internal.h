@@ -149,7 +149,10 @@ struct ArrayDataTraits<bool> {
   typedef bool ConstRef;
 
   static uint32_t GetStorageSize(uint32_t num_elements) {
-    return sizeof(ArrayHeader) + ((num_elements + 7) / 8);
+    // Widen before rounding up so that |num_elements| near |kMaxUint32|
+    // doesn't wrap around to a tiny size.
+    return sizeof(ArrayHeader) +
+           static_cast<uint32_t>((static_cast<uint64_t>(num_elements) + 7) / 8);
   }
   static BitRef ToRef(StorageType* storage, size_t offset) {
     return BitRef(&storage[offset / 8], 1 << (offset % 8));
@@ -262,6 +265,46 @@ struct ArraySerializationHelper<H, true, false> {
   }
 };
 
+// Arrays of interfaces hold each interface's handle (and version) inline.
+template <>
+struct ArraySerializationHelper<Interface_Data, false, false> {
+  typedef ArrayDataTraits<Interface_Data>::StorageType ElementType;
+
+  static void EncodePointersAndHandles(const ArrayHeader* header,
+                                       ElementType* elements,
+                                       std::vector<Handle>* handles);
+
+  static void DecodePointersAndHandles(const ArrayHeader* header,
+                                       ElementType* elements,
+                                       std::vector<Handle>* handles);
+
+  static ValidationError ValidateElements(
+      const ArrayHeader* header,
+      const ElementType* elements,
+      BoundsChecker* bounds_checker,
+      const ArrayValidateParams* validate_params,
+      std::string* err) {
+    MOJO_DCHECK(!validate_params->element_validate_params)
+        << "Interface type should not have array validate params";
+
+    for (uint32_t i = 0; i < header->num_elements; ++i) {
+      if (!validate_params->element_is_nullable &&
+          elements[i].handle.value() == kEncodedInvalidHandleValue) {
+        MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err)
+            << "invalid interface in array expecting valid interfaces (array "
+               "size="
+            << header->num_elements << ", index = " << i << ")";
+        return ValidationError::UNEXPECTED_INVALID_HANDLE;
+      }
+      if (!bounds_checker->ClaimHandle(elements[i].handle)) {
+        MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err) << "";
+        return ValidationError::ILLEGAL_HANDLE;
+      }
+    }
+    return ValidationError::NONE;
+  }
+};
+
 template <typename P>
 struct ArraySerializationHelper<P*, false, false> {
   typedef typename ArrayDataTraits<P*>::StorageType ElementType;
@@ -419,6 +462,25 @@ class Array_Data {
                                   std::string* err) {
     if (!data)
       return ValidationError::NONE;
+
+    ValidationError retval = ValidateHeaderAndClaimMemory(
+        data, bounds_checker, validate_params, err);
+    if (retval != ValidationError::NONE)
+      return retval;
+
+    const Array_Data<T>* object = static_cast<const Array_Data<T>*>(data);
+    return Helper::ValidateElements(&object->header_, object->storage(),
+                                    bounds_checker, validate_params, err);
+  }
+
+  // Validates the header of the (non-null) array at |data| and claims its
+  // memory, i.e., does everything |Validate()| does except for validating the
+  // elements.
+  static ValidationError ValidateHeaderAndClaimMemory(
+      const void* data,
+      BoundsChecker* bounds_checker,
+      const ArrayValidateParams* validate_params,
+      std::string* err) {
     if (!IsAligned(data)) {
       MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err) << "";
       return ValidationError::MISALIGNED_OBJECT;
@@ -450,9 +512,7 @@ class Array_Data {
       return ValidationError::ILLEGAL_MEMORY_RANGE;
     }
 
-    const Array_Data<T>* object = static_cast<const Array_Data<T>*>(data);
-    return Helper::ValidateElements(&object->header_, object->storage(),
-                                    bounds_checker, validate_params, err);
+    return ValidationError::NONE;
   }
 
   size_t size() const { return header_.num_elements; }
@@ -17,8 +17,11 @@
 #include <vector>
 
 #include "mojo/public/c/system/macros.h"
+#include "mojo/public/cpp/bindings/lib/arena.h"
 #include "mojo/public/cpp/bindings/lib/array_internal.h"
 #include "mojo/public/cpp/bindings/lib/bindings_internal.h"
+#include "mojo/public/cpp/bindings/lib/bindings_serialization.h"
+#include "mojo/public/cpp/bindings/lib/fixed_buffer.h"
 #include "mojo/public/cpp/bindings/lib/iterator_util.h"
 #include "mojo/public/cpp/bindings/lib/map_data_internal.h"
 #include "mojo/public/cpp/bindings/lib/map_serialization_forward.h"
@@ -29,6 +32,32 @@ namespace mojo {
 
 namespace internal {
 
+// Validates the encoded handle |*handle| at |index| of an array of
+// |num_elements| handles (as |Array_Data<Handle>::Validate()| does), and then
+// decodes it, taking it from |handles|.
+inline ValidationError ValidateAndDecodeArrayHandle(
+    Handle* handle,
+    uint32_t num_elements,
+    uint32_t index,
+    const ArrayValidateParams* validate_params,
+    BoundsChecker* bounds_checker,
+    std::vector<Handle>* handles,
+    std::string* err) {
+  if (!validate_params->element_is_nullable &&
+      handle->value() == kEncodedInvalidHandleValue) {
+    MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err)
+        << "invalid handle in array expecting valid handles (array size="
+        << num_elements << ", index = " << index << ")";
+    return ValidationError::UNEXPECTED_INVALID_HANDLE;
+  }
+  if (!bounds_checker->ClaimHandle(*handle)) {
+    MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err) << "";
+    return ValidationError::ILLEGAL_HANDLE;
+  }
+  DecodeHandle(handle, handles);
+  return ValidationError::NONE;
+}
+
 // The ArraySerializer template contains static methods for serializing |Array|s
 // of various types.  These methods include:
 //   * size_t GetSerializedSize(..)
@@ -38,6 +67,10 @@ namespace internal {
 //   * void DeserializeElements(..)
 //       Takes a pointer to an |Array_Data| and deserializes it into a given
 //       |Array|.
+//   * ValidationError ValidateAndDeserializeElements(..)
+//       Takes a pointer to an (unvalidated, still encoded) |Array_Data| whose
+//       header has been validated, and validates and deserializes its elements
+//       in a single pass (taking their handles from a vector of handles).
 //
 // Note: The enable template parameter exists only to allow partial
 // specializations to disable instantiation using logic based on E and F.
@@ -107,12 +140,30 @@ struct ArraySerializer<
     return ValidationError::NONE;
   }
 
-  static void DeserializeElements(Array_Data<F>* input, Array<E>* output) {
+  static void DeserializeElements(Array_Data<F>* input,
+                                  Array<E>* output,
+                                  Arena* /*arena*/) {
     std::vector<E> result(input->size());
     if (input->size())
       memcpy(&result[0], input->storage(), input->size() * sizeof(E));
     output->Swap(&result);
   }
+
+  static ValidationError ValidateAndDeserializeElements(
+      const Array_Data<F>* input,
+      Array<E>* output,
+      const ArrayValidateParams* validate_params,
+      BoundsChecker* bounds_checker,
+      std::vector<Handle>* handles,
+      std::string* err,
+      Arena* arena) {
+    MOJO_DCHECK(!validate_params->element_is_nullable)
+        << "Primitive type should be non-nullable";
+    MOJO_DCHECK(!validate_params->element_validate_params)
+        << "Primitive type should not have array validate params";
+    DeserializeElements(const_cast<Array_Data<F>*>(input), output, arena);
+    return ValidationError::NONE;
+  }
 };
 
 // Serializes and deserializes arrays of bools.
@@ -142,13 +193,30 @@ struct ArraySerializer<bool, bool, false> {
   }
 
   static void DeserializeElements(Array_Data<bool>* input,
-                                  Array<bool>* output) {
+                                  Array<bool>* output,
+                                  Arena* /*arena*/) {
     auto result = Array<bool>::New(input->size());
     // TODO(darin): Can this be a memcpy somehow instead of a bit-by-bit copy?
     for (size_t i = 0; i < input->size(); ++i)
       result.at(i) = input->at(i);
     output->Swap(&result);
   }
+
+  static ValidationError ValidateAndDeserializeElements(
+      const Array_Data<bool>* input,
+      Array<bool>* output,
+      const ArrayValidateParams* validate_params,
+      BoundsChecker* bounds_checker,
+      std::vector<Handle>* handles,
+      std::string* err,
+      Arena* arena) {
+    MOJO_DCHECK(!validate_params->element_is_nullable)
+        << "Primitive type should be non-nullable";
+    MOJO_DCHECK(!validate_params->element_validate_params)
+        << "Primitive type should not have array validate params";
+    DeserializeElements(const_cast<Array_Data<bool>*>(input), output, arena);
+    return ValidationError::NONE;
+  }
 };
 
 // Serializes and deserializes arrays of handles.
@@ -179,18 +247,45 @@ struct ArraySerializer<ScopedHandleBase<H>, H, false> {
                 i));
         return ValidationError::UNEXPECTED_INVALID_HANDLE;
       }
+      EncodeHandleInline(buf, &output->at(i));
     }
 
     return ValidationError::NONE;
   }
 
   static void DeserializeElements(Array_Data<H>* input,
-                                  Array<ScopedHandleBase<H>>* output) {
+                                  Array<ScopedHandleBase<H>>* output,
+                                  Arena* /*arena*/) {
     auto result = Array<ScopedHandleBase<H>>::New(input->size());
     for (size_t i = 0; i < input->size(); ++i)
       result.at(i) = MakeScopedHandle(FetchAndReset(&input->at(i)));
     output->Swap(&result);
   }
+
+  static ValidationError ValidateAndDeserializeElements(
+      const Array_Data<H>* input,
+      Array<ScopedHandleBase<H>>* output,
+      const ArrayValidateParams* validate_params,
+      BoundsChecker* bounds_checker,
+      std::vector<Handle>* handles,
+      std::string* err,
+      Arena* arena) {
+    MOJO_DCHECK(!validate_params->element_validate_params)
+        << "Handle type should not have array validate params";
+
+    auto result = Array<ScopedHandleBase<H>>::New(input->size());
+    for (uint32_t i = 0; i < input->size(); ++i) {
+      H handle = input->at(i);
+      auto retval = ValidateAndDecodeArrayHandle(
+          &handle, input->size(), i, validate_params, bounds_checker, handles,
+          err);
+      if (retval != ValidationError::NONE)
+        return retval;
+      result.at(i) = MakeScopedHandle(handle);
+    }
+    output->Swap(&result);
+    return ValidationError::NONE;
+  }
 };
 
 // Serializes and deserializes arrays of interface requests.
@@ -222,13 +317,15 @@ struct ArraySerializer<InterfaceRequest<I>, MessagePipeHandle, false> {
                 num_elements, i));
         return ValidationError::UNEXPECTED_INVALID_HANDLE;
       }
+      EncodeHandleInline(buf, &output->at(i));
     }
 
     return ValidationError::NONE;
   }
 
   static void DeserializeElements(Array_Data<MessagePipeHandle>* input,
-                                  Array<InterfaceRequest<I>>* output) {
+                                  Array<InterfaceRequest<I>>* output,
+                                  Arena* /*arena*/) {
     auto result = Array<InterfaceRequest<I>>::New(input->size());
     for (size_t i = 0; i < input->size(); ++i)
       result.at(i) =
@@ -236,6 +333,31 @@ struct ArraySerializer<InterfaceRequest<I>, MessagePipeHandle, false> {
               .Pass();
     output->Swap(&result);
   }
+
+  static ValidationError ValidateAndDeserializeElements(
+      const Array_Data<MessagePipeHandle>* input,
+      Array<InterfaceRequest<I>>* output,
+      const ArrayValidateParams* validate_params,
+      BoundsChecker* bounds_checker,
+      std::vector<Handle>* handles,
+      std::string* err,
+      Arena* arena) {
+    MOJO_DCHECK(!validate_params->element_validate_params)
+        << "Handle type should not have array validate params";
+
+    auto result = Array<InterfaceRequest<I>>::New(input->size());
+    for (uint32_t i = 0; i < input->size(); ++i) {
+      MessagePipeHandle handle = input->at(i);
+      auto retval = ValidateAndDecodeArrayHandle(
+          &handle, input->size(), i, validate_params, bounds_checker, handles,
+          err);
+      if (retval != ValidationError::NONE)
+        return retval;
+      result.at(i) = InterfaceRequest<I>(MakeScopedHandle(handle)).Pass();
+    }
+    output->Swap(&result);
+    return ValidationError::NONE;
+  }
 };
 
 // Serializes and deserializes arrays of interfaces (interface handles).
@@ -269,18 +391,45 @@ struct ArraySerializer<InterfaceHandle<Interface>, Interface_Data, false> {
                 i));
         return ValidationError::UNEXPECTED_INVALID_HANDLE;
       }
+      EncodeHandleInline(buf, &output->at(i));
     }
 
     return ValidationError::NONE;
   }
 
   static void DeserializeElements(Array_Data<Interface_Data>* input,
-                                  Array<InterfaceHandle<Interface>>* output) {
+                                  Array<InterfaceHandle<Interface>>* output,
+                                  Arena* /*arena*/) {
     auto result = Array<InterfaceHandle<Interface>>::New(input->size());
     for (size_t i = 0; i < input->size(); ++i)
       internal::InterfaceDataToHandle(&input->at(i), &result.at(i));
     output->Swap(&result);
   }
+
+  static ValidationError ValidateAndDeserializeElements(
+      const Array_Data<Interface_Data>* input,
+      Array<InterfaceHandle<Interface>>* output,
+      const ArrayValidateParams* validate_params,
+      BoundsChecker* bounds_checker,
+      std::vector<Handle>* handles,
+      std::string* err,
+      Arena* arena) {
+    MOJO_DCHECK(!validate_params->element_validate_params)
+        << "Interface type should not have array validate params";
+
+    auto result = Array<InterfaceHandle<Interface>>::New(input->size());
+    for (uint32_t i = 0; i < input->size(); ++i) {
+      Interface_Data interface_data = input->at(i);
+      auto retval = ValidateAndDecodeArrayHandle(
+          &interface_data.handle, input->size(), i, validate_params,
+          bounds_checker, handles, err);
+      if (retval != ValidationError::NONE)
+        return retval;
+      internal::InterfaceDataToHandle(&interface_data, &result.at(i));
+    }
+    output->Swap(&result);
+    return ValidationError::NONE;
+  }
 };
 
 // This template must only apply to pointer mojo entity (structs, arrays,
@@ -296,11 +445,20 @@ struct ArraySerializer<
   typedef
       typename std::remove_pointer<typename WrapperTraits<S>::DataType>::type
           S_Data;
+  // Elements of pointer-free struct types are all the same size, and point to
+  // nothing else, so arrays of them are serialized with all their (non-null)
+  // elements in one block, allocated up front.
+  static const bool kIsPointerFree = IsPointerFreeStructDataType<S_Data>::value;
+
   static size_t GetSerializedSize(const Array<S>& input) {
     size_t size = sizeof(Array_Data<S_Data*>) +
                   input.size() * sizeof(StructPointer<S_Data>);
     for (size_t i = 0; i < input.size(); ++i) {
-      if (!input[i].is_null())
+      if (input[i].is_null())
+        continue;
+      if (kIsPointerFree)
+        size += sizeof(S_Data);
+      else
         size += GetSerializedSize_(*(UnwrapConstStructPtr<S>::value(input[i])));
     }
     return size;
@@ -313,14 +471,20 @@ struct ArraySerializer<
       Buffer* buf,
       Array_Data<S_Data*>* output,
       const ArrayValidateParams* validate_params) {
+    FixedBuffer block_buf;
+    Buffer* element_buf =
+        kIsPointerFree ? AllocateElementBlock(it, num_elements, buf, &block_buf)
+                       : buf;
     for (size_t i = 0; i < num_elements; ++i, ++it) {
       S_Data* element;
-      auto retval = SerializeCaller::Run(
-          &(*it), buf, &element, validate_params->element_validate_params);
+      auto retval =
+          SerializeCaller::Run(&(*it), element_buf, &element,
+                               validate_params->element_validate_params);
       if (retval != ValidationError::NONE)
         return retval;
 
       output->at(i) = element;
+      EncodePointerInline(buf, &output->storage()[i]);
       if (!validate_params->element_is_nullable && !element) {
         MOJO_INTERNAL_DLOG_SERIALIZATION_WARNING(
             ValidationError::UNEXPECTED_NULL_POINTER,
@@ -334,15 +498,69 @@ struct ArraySerializer<
   }
 
   static void DeserializeElements(Array_Data<S_Data*>* input,
-                                  Array<S>* output) {
+                                  Array<S>* output,
+                                  Arena* arena) {
     auto result = Array<S>::New(input->size());
     for (size_t i = 0; i < input->size(); ++i) {
-      DeserializeCaller::Run(input->at(i), &result[i]);
+      DeserializeCaller::Run(input->at(i), &result[i], arena);
+    }
+    output->Swap(&result);
+  }
+
+  static ValidationError ValidateAndDeserializeElements(
+      const Array_Data<S_Data*>* input,
+      Array<S>* output,
+      const ArrayValidateParams* validate_params,
+      BoundsChecker* bounds_checker,
+      std::vector<Handle>* handles,
+      std::string* err,
+      Arena* arena) {
+    auto result = Array<S>::New(input->size());
+    for (uint32_t i = 0; i < input->size(); ++i) {
+      const uint64_t* offset = &input->storage()[i].offset;
+      if (!validate_params->element_is_nullable && !*offset) {
+        MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err)
+            << "null in array expecting valid pointers (size="
+            << input->size() << ", index = " << i << ")";
+        return ValidationError::UNEXPECTED_NULL_POINTER;
+      }
+
+      if (!ValidateEncodedPointer(offset)) {
+        MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err) << "";
+        return ValidationError::ILLEGAL_POINTER;
+      }
+
+      auto retval = ValidateAndDeserializeCaller::Run(
+          DecodePointerRaw(offset), &result[i],
+          validate_params->element_validate_params, bounds_checker, handles,
+          err, arena);
+      if (retval != ValidationError::NONE)
+        return retval;
     }
     output->Swap(&result);
+    return ValidationError::NONE;
   }
 
  private:
+  // Allocates space from |buf| for the non-null elements in the range starting
+  // at |it|, and returns |block_buf| set up to hand it out (or |buf|, if they
+  // are all null).
+  template <typename Iterator>
+  static Buffer* AllocateElementBlock(Iterator it,
+                                      size_t num_elements,
+                                      Buffer* buf,
+                                      FixedBuffer* block_buf) {
+    size_t num_bytes = 0;
+    for (size_t i = 0; i < num_elements; ++i, ++it) {
+      if (!(*it).is_null())
+        num_bytes += sizeof(S_Data);
+    }
+    if (!num_bytes)
+      return buf;
+    block_buf->Initialize(buf->Allocate(num_bytes), num_bytes);
+    return block_buf;
+  }
+
   // SerializeCaller template is used by |ArraySerializer| to dispatch a
   // serialize call on a non-POD type.  This template is defined outside
   // |ArraySerializer| since you cannot specialize a struct within a class
@@ -395,33 +613,85 @@ struct ArraySerializer<
 
   struct DeserializeCaller {
     template <typename T>
-    static void Run(typename WrapperTraits<T>::DataType input, T* output) {
-      Deserialize_(input, output);
+    static void Run(typename WrapperTraits<T>::DataType input,
+                    T* output,
+                    Arena* arena) {
+      Deserialize_(input, output, arena);
     }
 
     // Since Deserialize_ takes in a |Struct*| (not |StructPtr|), we need to
     // initialize the |StructPtr| here before deserializing into its underlying
     // data.
-    // TODO(vardhan):  Either all containers, or just Deserialize_(), should
-    // support taking in an allocator.
     template <typename T>
     static void Run(typename WrapperTraits<StructPtr<T>>::DataType input,
-                    StructPtr<T>* output) {
+                    StructPtr<T>* output,
+                    Arena* arena) {
       if (input) {
-        *output = T::New();
-        Deserialize_(input, output->get());
+        StructHelper<T>::Initialize(output, arena);
+        Deserialize_(input, output->get(), arena);
       }
     }
 
     template <typename T>
     static void Run(typename WrapperTraits<InlinedStructPtr<T>>::DataType input,
-                    InlinedStructPtr<T>* output) {
+                    InlinedStructPtr<T>* output,
+                    Arena* arena) {
       if (input) {
-        *output = T::New();
-        Deserialize_(input, output->get());
+        StructHelper<T>::Initialize(output, arena);
+        Deserialize_(input, output->get(), arena);
       }
     }
   };
+
+  // Like |DeserializeCaller|, but for validating and deserializing (possibly
+  // null) encoded data in one pass.
+  struct ValidateAndDeserializeCaller {
+    template <typename T>
+    static ValidationError Run(const void* data,
+                               T* output,
+                               const ArrayValidateParams* validate_params,
+                               BoundsChecker* bounds_checker,
+                               std::vector<Handle>* handles,
+                               std::string* err,
+                               Arena* arena) {
+      return ValidateAndDeserialize_(data, output, validate_params,
+                                     bounds_checker, handles, err, arena);
+    }
+
+    template <typename T>
+    static ValidationError Run(const void* data,
+                               StructPtr<T>* output,
+                               const ArrayValidateParams* validate_params,
+                               BoundsChecker* bounds_checker,
+                               std::vector<Handle>* handles,
+                               std::string* err,
+                               Arena* arena) {
+      MOJO_DCHECK(!validate_params)
+          << "Struct type should not have array validate params";
+      if (!data)
+        return ValidationError::NONE;
+      StructHelper<T>::Initialize(output, arena);
+      return ValidateAndDeserialize_(data, output->get(), bounds_checker,
+                                     handles, err, arena);
+    }
+
+    template <typename T>
+    static ValidationError Run(const void* data,
+                               InlinedStructPtr<T>* output,
+                               const ArrayValidateParams* validate_params,
+                               BoundsChecker* bounds_checker,
+                               std::vector<Handle>* handles,
+                               std::string* err,
+                               Arena* arena) {
+      MOJO_DCHECK(!validate_params)
+          << "Struct type should not have array validate params";
+      if (!data)
+        return ValidationError::NONE;
+      StructHelper<T>::Initialize(output, arena);
+      return ValidateAndDeserialize_(data, output->get(), bounds_checker,
+                                     handles, err, arena);
+    }
+  };
 };
 
 // Handles serialization and deserialization of arrays of unions.
@@ -462,18 +732,56 @@ struct ArraySerializer<U, U_Data, true> {
     return ValidationError::NONE;
   }
 
-  static void DeserializeElements(Array_Data<U_Data>* input, Array<U>* output) {
+  static void DeserializeElements(Array_Data<U_Data>* input,
+                                  Array<U>* output,
+                                  Arena* arena) {
     auto result = Array<U>::New(input->size());
     for (size_t i = 0; i < input->size(); ++i) {
       auto& elem = input->at(i);
       if (!elem.is_null()) {
         using UnwrapedUnionType = typename RemoveStructPtr<U>::type;
-        result[i] = UnwrapedUnionType::New();
-        Deserialize_(&elem, result[i].get());
+        StructHelper<UnwrapedUnionType>::Initialize(&result[i], arena);
+        Deserialize_(&elem, result[i].get(), arena);
       }
     }
     output->Swap(&result);
   }
+
+  static ValidationError ValidateAndDeserializeElements(
+      const Array_Data<U_Data>* input,
+      Array<U>* output,
+      const ArrayValidateParams* validate_params,
+      BoundsChecker* bounds_checker,
+      std::vector<Handle>* handles,
+      std::string* err,
+      Arena* arena) {
+    MOJO_DCHECK(!validate_params->element_validate_params)
+        << "Union type should not have array validate params";
+
+    auto result = Array<U>::New(input->size());
+    for (uint32_t i = 0; i < input->size(); ++i) {
+      const U_Data& elem = input->storage()[i];
+      if (!validate_params->element_is_nullable && elem.is_null()) {
+        MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err)
+            << "null union in array expecting non-null unions (size="
+            << input->size() << ", index = " << i << ")";
+        return ValidationError::UNEXPECTED_NULL_UNION;
+      }
+
+      if (elem.is_null())
+        continue;
+
+      using UnwrapedUnionType = typename RemoveStructPtr<U>::type;
+      StructHelper<UnwrapedUnionType>::Initialize(&result[i], arena);
+      auto retval = ValidateAndDeserialize_(&elem, result[i].get(), true,
+                                            bounds_checker, handles, err,
+                                            arena);
+      if (retval != ValidationError::NONE)
+        return retval;
+    }
+    output->Swap(&result);
+    return ValidationError::NONE;
+  }
 };
 
 }  // namespace internal
@@ -525,15 +833,50 @@ inline internal::ValidationError SerializeArray_(
   return internal::ValidationError::NONE;
 }
 
+// Deserializes |input| into |output|. If |arena| is non-null, structs and
+// unions in the array are allocated from it (see |internal::Arena|).
 template <typename E, typename F>
-inline void Deserialize_(internal::Array_Data<F>* input, Array<E>* output) {
+inline void Deserialize_(internal::Array_Data<F>* input,
+                         Array<E>* output,
+                         internal::Arena* arena = nullptr) {
   if (input) {
-    internal::ArraySerializer<E, F>::DeserializeElements(input, output);
+    internal::ArraySerializer<E, F>::DeserializeElements(input, output, arena);
   } else {
     output->reset();
   }
 }
 
+// ValidateAndDeserialize_ validates the (still encoded) array at |data|, which
+// may be null, against |validate_params| and |bounds_checker| exactly as
+// |Array_Data<F>::Validate()| would, while deserializing it into |output| and
+// taking its handles from |handles|; this saves separate validation and
+// decoding passes over the message. On failure, |output| is left in an
+// unspecified state. |arena| is as for |Deserialize_()|.
+template <typename E>
+inline internal::ValidationError ValidateAndDeserialize_(
+    const void* data,
+    Array<E>* output,
+    const internal::ArrayValidateParams* validate_params,
+    internal::BoundsChecker* bounds_checker,
+    std::vector<Handle>* handles,
+    std::string* err,
+    internal::Arena* arena = nullptr) {
+  if (!data) {
+    output->reset();
+    return internal::ValidationError::NONE;
+  }
+
+  using F = typename internal::WrapperTraits<E>::DataType;
+  auto retval = internal::Array_Data<F>::ValidateHeaderAndClaimMemory(
+      data, bounds_checker, validate_params, err);
+  if (retval != internal::ValidationError::NONE)
+    return retval;
+
+  return internal::ArraySerializer<E, F>::ValidateAndDeserializeElements(
+      static_cast<const internal::Array_Data<F>*>(data), output,
+      validate_params, bounds_checker, handles, err, arena);
+}
+
 }  // namespace mojo
 
 #endif  // MOJO_PUBLIC_CPP_BINDINGS_LIB_ARRAY_SERIALIZATION_H_
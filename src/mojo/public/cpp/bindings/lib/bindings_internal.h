@@ -175,6 +175,19 @@ struct IsUnionDataType {
       sizeof(Test<T>(0)) == sizeof(YesType) && !std::is_const<T>::value;
 };
 
+// True for the serialized data types of structs whose fields are all numbers,
+// bools or enums (which the generated code marks as such).
+template <typename T>
+struct IsPointerFreeStructDataType {
+  template <typename U>
+  static YesType Test(const typename U::MojomPointerFreeStructDataType*);
+
+  template <typename U>
+  static NoType Test(...);
+
+  static const bool value = sizeof(Test<T>(0)) == sizeof(YesType);
+};
+
 // To introduce a new mojom type, you must define (partial or full) template
 // specializations for the following traits templates, which operate on the C++
 // wrapper types representing a mojom type:
@@ -9,6 +9,7 @@
 
 #include "mojo/public/c/system/handle.h"
 #include "mojo/public/cpp/bindings/lib/bindings_internal.h"
+#include "mojo/public/cpp/bindings/lib/chunked_buffer.h"
 #include "mojo/public/cpp/system/handle.h"
 
 namespace mojo {
@@ -74,6 +75,22 @@ inline void Decode(T* obj, std::vector<Handle>* handles) {
     obj->ptr->DecodePointersAndHandles(handles);
 }
 
+// When serializing into a buffer that |encodes_inline()| (i.e., a
+// |ChunkedBuffer|), these are called right after writing the object pointer
+// |obj| (as passed to |Encode()|) or |handle|, to encode it. For other buffers
+// they do nothing, leaving it to |EncodePointersAndHandles()|.
+template <typename T>
+inline void EncodePointerInline(Buffer* buf, T* obj) {
+  if (buf->encodes_inline())
+    static_cast<ChunkedBuffer*>(buf)->EncodePointer(obj->ptr, &obj->offset);
+}
+
+template <typename H>
+inline void EncodeHandleInline(Buffer* buf, H* handle) {
+  if (buf->encodes_inline())
+    EncodeHandle(handle, static_cast<ChunkedBuffer*>(buf)->handles());
+}
+
 template <typename T>
 inline void InterfaceHandleToData(InterfaceHandle<T> input,
                                   Interface_Data* output) {
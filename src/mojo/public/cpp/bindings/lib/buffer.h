@@ -14,8 +14,20 @@ namespace internal {
 // zero-initialized. Allocations remain valid for the lifetime of the Buffer.
 class Buffer {
  public:
+  Buffer() : encodes_inline_(false) {}
   virtual ~Buffer() {}
   virtual void* Allocate(size_t num_bytes) = 0;
+
+  // True if serializers should encode pointers and handles as soon as they
+  // have written them (see |ChunkedBuffer|), rather than leave them to a
+  // separate |EncodePointersAndHandles()| pass.
+  bool encodes_inline() const { return encodes_inline_; }
+
+ protected:
+  explicit Buffer(bool encodes_inline) : encodes_inline_(encodes_inline) {}
+
+ private:
+  const bool encodes_inline_;
 };
 
 }  // namespace internal
@@ -0,0 +1,130 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "mojo/public/cpp/bindings/lib/chunked_buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "mojo/public/cpp/bindings/lib/bindings_serialization.h"
+#include "mojo/public/cpp/environment/logging.h"
+
+namespace mojo {
+namespace internal {
+
+ChunkedBuffer::ChunkedBuffer(size_t initial_capacity,
+                             std::vector<Handle>* handles)
+    : Buffer(true),
+      initial_capacity_(Align(initial_capacity)),
+      handles_(handles),
+      num_chunks_(0),
+      owns_first_chunk_(true),
+      bytes_used_(0) {
+  MOJO_DCHECK(handles_);
+}
+
+ChunkedBuffer::ChunkedBuffer(void* initial_chunk,
+                             size_t initial_chunk_size,
+                             std::vector<Handle>* handles)
+    : Buffer(true),
+      initial_capacity_(initial_chunk_size),
+      handles_(handles),
+      num_chunks_(1),
+      owns_first_chunk_(false),
+      bytes_used_(0) {
+  MOJO_DCHECK(handles_);
+  MOJO_DCHECK(IsAligned(initial_chunk));
+  chunks_[0].data = static_cast<char*>(initial_chunk);
+  chunks_[0].size = initial_chunk_size;
+  chunks_[0].start = 0;
+}
+
+ChunkedBuffer::~ChunkedBuffer() {
+  FreeChunks();
+}
+
+void* ChunkedBuffer::Allocate(size_t num_bytes) {
+  num_bytes = Align(num_bytes);
+
+  if (!num_chunks_) {
+    AddChunk(num_bytes);
+  } else {
+    const Chunk& chunk = chunks_[num_chunks_ - 1];
+    if (num_bytes > chunk.start + chunk.size - bytes_used_)
+      AddChunk(num_bytes);
+  }
+
+  const Chunk& chunk = chunks_[num_chunks_ - 1];
+  char* result = chunk.data + (bytes_used_ - chunk.start);
+  memset(result, 0, num_bytes);
+  bytes_used_ += num_bytes;
+  return result;
+}
+
+void* ChunkedBuffer::Leak() {
+  char* result = nullptr;
+  if (num_chunks_ == 1 && owns_first_chunk_) {
+    result = chunks_[0].data;
+    num_chunks_ = 0;
+  } else if (bytes_used_) {
+    result = static_cast<char*>(malloc(bytes_used_));
+    MOJO_CHECK(result);
+    for (size_t i = 0; i < num_chunks_; ++i) {
+      size_t end = i + 1 < num_chunks_ ? chunks_[i + 1].start : bytes_used_;
+      memcpy(result + chunks_[i].start, chunks_[i].data,
+             end - chunks_[i].start);
+    }
+  }
+  FreeChunks();
+  bytes_used_ = 0;
+  return result;
+}
+
+void ChunkedBuffer::AddChunk(size_t min_size) {
+  MOJO_CHECK(num_chunks_ < kMaxChunks);
+  Chunk& chunk = chunks_[num_chunks_];
+  size_t size =
+      num_chunks_ ? 2 * chunks_[num_chunks_ - 1].size : initial_capacity_;
+  chunk.size = std::max(size, min_size);
+  chunk.data = static_cast<char*>(malloc(chunk.size));
+  MOJO_CHECK(chunk.data);
+  chunk.start = bytes_used_;
+  num_chunks_++;
+}
+
+void ChunkedBuffer::EncodePointerAcrossChunks(const void* ptr,
+                                              uint64_t* offset) {
+  size_t ptr_offset = GetLayoutOffset(ptr);
+  size_t slot_offset = GetLayoutOffset(offset);
+  MOJO_DCHECK(ptr_offset > slot_offset);
+
+  *offset = static_cast<uint64_t>(ptr_offset - slot_offset);
+}
+
+size_t ChunkedBuffer::GetLayoutOffset(const void* ptr) const {
+  uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+  // Look through the most recent chunks first, since that's where new objects
+  // (and the objects pointing to them) usually are.
+  for (size_t i = num_chunks_; i > 0; --i) {
+    const Chunk& chunk = chunks_[i - 1];
+    uintptr_t chunk_offset = address - reinterpret_cast<uintptr_t>(chunk.data);
+    if (chunk_offset < chunk.size)
+      return chunk.start + chunk_offset;
+  }
+  MOJO_CHECK(false) << "Pointer not allocated from this buffer";
+  return 0;
+}
+
+void ChunkedBuffer::FreeChunks() {
+  for (size_t i = owns_first_chunk_ ? 0 : 1; i < num_chunks_; ++i)
+    free(chunks_[i].data);
+  num_chunks_ = 0;
+  // Any chunks allocated from now on are our own.
+  owns_first_chunk_ = true;
+}
+
+}  // namespace internal
+}  // namespace mojo
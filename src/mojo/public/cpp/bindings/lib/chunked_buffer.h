@@ -0,0 +1,132 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_PUBLIC_CPP_BINDINGS_LIB_CHUNKED_BUFFER_H_
+#define MOJO_PUBLIC_CPP_BINDINGS_LIB_CHUNKED_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "mojo/public/cpp/bindings/lib/buffer.h"
+#include "mojo/public/cpp/system/handle.h"
+#include "mojo/public/cpp/system/macros.h"
+
+namespace mojo {
+namespace internal {
+
+// ChunkedBuffer is a growable |Buffer|, which lets an object graph be
+// serialized in a single pass without first computing its serialized size.
+// Memory is allocated from a list of chunks, each twice the size of the one
+// before it, so objects never move once allocated. Allocations are laid out as
+// if the chunks were concatenated, and the serializers encode pointers (using
+// |EncodePointer()|) and handles as soon as they have written them, so that
+// the result is ready to send once |Leak()| has made it contiguous.
+//
+// Typical usage:
+//
+//   {
+//     std::vector<Handle> handles;
+//     ChunkedBuffer buf(kExpectedSize, &handles);
+//
+//     Foo_Data* data;
+//     Serialize_(foo, &buf, &data);
+//
+//     size_t size = buf.BytesUsed();
+//     void* contiguous_data = buf.Leak();
+//     Send(contiguous_data, size, &handles);
+//
+//     free(contiguous_data);
+//   }
+class ChunkedBuffer : public Buffer {
+ public:
+  // |initial_capacity| is the size of the first chunk, so it should be a good
+  // guess at the total size needed. Encoded handles are appended to |handles|,
+  // which must outlive this buffer.
+  ChunkedBuffer(size_t initial_capacity, std::vector<Handle>* handles);
+  // Like the above, but uses the caller's |initial_chunk| (which must be 8-byte
+  // aligned, and outlive this buffer) as the first chunk, e.g. to build small
+  // objects on the stack. |Leak()| then always copies.
+  ChunkedBuffer(void* initial_chunk,
+                size_t initial_chunk_size,
+                std::vector<Handle>* handles);
+  ~ChunkedBuffer() override;
+
+  // Returns the number of bytes allocated so far.
+  size_t BytesUsed() const { return bytes_used_; }
+
+  size_t num_chunks() const { return num_chunks_; }
+
+  std::vector<Handle>* handles() { return handles_; }
+
+  // Returns a pointer to |num_bytes| of zero-filled memory, 8-byte aligned and
+  // following the previous allocation in the contiguous layout. This never
+  // fails.
+  void* Allocate(size_t num_bytes) override;
+
+  // Like |internal::EncodePointer()|, but |ptr| and |offset| may be in
+  // different chunks (both must have been allocated from this buffer). The
+  // resulting offset is relative to the contiguous layout.
+  void EncodePointer(const void* ptr, uint64_t* offset) {
+    if (!ptr) {
+      *offset = 0;
+      return;
+    }
+    // |ptr| was allocated after |offset|, so if |offset| is in the current
+    // chunk then so is |ptr|, and their layout offsets differ by as much as
+    // their addresses.
+    const Chunk& chunk = chunks_[num_chunks_ - 1];
+    if (reinterpret_cast<uintptr_t>(offset) -
+            reinterpret_cast<uintptr_t>(chunk.data) >=
+        chunk.size) {
+      EncodePointerAcrossChunks(ptr, offset);
+      return;
+    }
+    *offset = static_cast<uint64_t>(static_cast<const char*>(ptr) -
+                                    reinterpret_cast<const char*>(offset));
+  }
+
+  // Returns everything allocated so far as one contiguous block of
+  // |BytesUsed()| bytes, which the caller must |free()|, and empties the
+  // buffer. This doesn't copy if everything fit in a first chunk allocated by
+  // this buffer. Returns null if nothing was allocated.
+  void* Leak();
+
+ private:
+  struct Chunk {
+    char* data;
+    size_t size;
+    // The offset of |data| in the contiguous layout.
+    size_t start;
+  };
+
+  // Since each chunk is at least twice the size of the one before it, this is
+  // enough for any message.
+  static const size_t kMaxChunks = 32;
+
+  void AddChunk(size_t min_size);
+
+  void EncodePointerAcrossChunks(const void* ptr, uint64_t* offset);
+
+  // Returns the offset of |ptr| in the contiguous layout.
+  size_t GetLayoutOffset(const void* ptr) const;
+
+  void FreeChunks();
+
+  const size_t initial_capacity_;
+  std::vector<Handle>* const handles_;
+  Chunk chunks_[kMaxChunks];
+  size_t num_chunks_;
+  // False if the first chunk was provided by the caller.
+  bool owns_first_chunk_;
+  size_t bytes_used_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(ChunkedBuffer);
+};
+
+}  // namespace internal
+}  // namespace mojo
+
+#endif  // MOJO_PUBLIC_CPP_BINDINGS_LIB_CHUNKED_BUFFER_H_
@@ -4,6 +4,8 @@
 
 #include "mojo/public/cpp/bindings/lib/connector.h"
 
+#include <memory>
+
 #include "mojo/public/cpp/environment/logging.h"
 #include "mojo/public/cpp/system/macros.h"
 #include "mojo/public/cpp/system/wait.h"
@@ -11,6 +13,83 @@
 namespace mojo {
 namespace internal {
 
+// Messages read from the message pipe in one go, using |MojoReadMessages()|,
+// that are yet to be dispatched.
+class Connector::MessageBatch {
+ public:
+  MessageBatch()
+      : bytes_(new uint8_t[kMaxNumBytes]),
+        num_handles_(0),
+        num_messages_(0),
+        next_message_(0),
+        next_bytes_offset_(0),
+        next_handles_offset_(0) {}
+  ~MessageBatch() { MOJO_DCHECK(next_handles_offset_ == num_handles_); }
+
+  MojoResult Read(MessagePipeHandle message_pipe) {
+    MOJO_DCHECK(!num_messages_);
+    uint32_t num_bytes = kMaxNumBytes;
+    num_handles_ = kMaxNumHandles;
+    num_messages_ = kMaxNumMessages;
+    MojoResult rv = ReadMessagesRaw(
+        message_pipe, bytes_.get(), &num_bytes, handles_, &num_handles_,
+        message_num_bytes_, message_num_handles_, &num_messages_,
+        MOJO_READ_MESSAGE_FLAG_NONE);
+    if (rv != MOJO_RESULT_OK) {
+      // Note: With |MOJO_RESULT_RESOURCE_EXHAUSTED|, messages may have been
+      // read (but their handles lost).
+      num_handles_ = 0;
+      if (rv != MOJO_RESULT_RESOURCE_EXHAUSTED)
+        num_messages_ = 0;
+    }
+    return rv;
+  }
+
+  bool HasNext() const { return next_message_ < num_messages_; }
+
+  // Makes |message| (which should be empty) borrow the next message's data and
+  // take its handles.
+  void TakeNext(Message* message) {
+    MOJO_DCHECK(HasNext());
+    message->BorrowData(MessagePipeHandle(), bytes_.get() + next_bytes_offset_,
+                        message_num_bytes_[next_message_]);
+    for (uint32_t i = 0; i < message_num_handles_[next_message_]; i++) {
+      message->mutable_handles()->push_back(
+          Handle(handles_[next_handles_offset_ + i]));
+    }
+    next_bytes_offset_ += message_num_bytes_[next_message_];
+    next_handles_offset_ += message_num_handles_[next_message_];
+    next_message_++;
+  }
+
+  // Drops the messages that haven't been taken.
+  void CloseRemainingHandles() {
+    for (; next_handles_offset_ < num_handles_; next_handles_offset_++)
+      CloseRaw(Handle(handles_[next_handles_offset_]));
+    next_message_ = num_messages_;
+  }
+
+ private:
+  // Limits on the messages read at once. (A message that doesn't fit on its
+  // own is read by itself.)
+  static const uint32_t kMaxNumBytes = 16 * 1024;
+  static const uint32_t kMaxNumHandles = 64;
+  static const uint32_t kMaxNumMessages = 64;
+
+  std::unique_ptr<uint8_t[]> bytes_;
+  MojoHandle handles_[kMaxNumHandles];
+  uint32_t message_num_bytes_[kMaxNumMessages];
+  uint32_t message_num_handles_[kMaxNumMessages];
+  uint32_t num_handles_;
+  uint32_t num_messages_;
+
+  uint32_t next_message_;
+  uint32_t next_bytes_offset_;
+  uint32_t next_handles_offset_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(MessageBatch);
+};
+
 // ----------------------------------------------------------------------------
 
 Connector::Connector(ScopedMessagePipeHandle message_pipe,
@@ -22,7 +101,10 @@ Connector::Connector(ScopedMessagePipeHandle message_pipe,
       error_(false),
       drop_writes_(false),
       enforce_errors_from_incoming_receiver_(true),
-      destroyed_flag_(nullptr) {
+      batch_reads_(false),
+      destroyed_flag_(nullptr),
+      pending_batch_(nullptr),
+      deferred_close_pipe_(nullptr) {
   // Even though we don't have an incoming receiver, we still want to monitor
   // the message pipe to know if is closed or encounters an error.
   WaitToReadMore();
@@ -33,14 +115,21 @@ Connector::~Connector() {
     *destroyed_flag_ = true;
 
   CancelWait();
+  if (deferred_close_pipe_ && message_pipe_.is_valid())
+    *deferred_close_pipe_ = message_pipe_.Pass();
 }
 
 void Connector::CloseMessagePipe() {
   CancelWait();
-  Close(message_pipe_.Pass());
+  if (deferred_close_pipe_ && message_pipe_.is_valid())
+    *deferred_close_pipe_ = message_pipe_.Pass();
+  else
+    Close(message_pipe_.Pass());
 }
 
 ScopedMessagePipeHandle Connector::PassMessagePipe() {
+  MOJO_DCHECK(!pending_batch_ || !pending_batch_->HasNext())
+      << "Passing the message pipe on would drop messages already read from it";
   CancelWait();
   return message_pipe_.Pass();
 }
@@ -49,6 +138,14 @@ bool Connector::WaitForIncomingMessage(MojoDeadline deadline) {
   if (error_)
     return false;
 
+  // If a message was already read (while dispatching a batch of messages), it
+  // is the next one.
+  if (pending_batch_ && pending_batch_->HasNext()) {
+    MojoResult rv;
+    ignore_result(ReadSingleMessage(&rv));
+    return (rv == MOJO_RESULT_OK);
+  }
+
   MojoResult rv =
       Wait(message_pipe_.get(), MOJO_HANDLE_SIGNAL_READABLE, deadline, nullptr);
   if (rv == MOJO_RESULT_SHOULD_WAIT || rv == MOJO_RESULT_DEADLINE_EXCEEDED)
@@ -149,8 +246,28 @@ bool Connector::ReadSingleMessage(MojoResult* read_result) {
   bool* previous_destroyed_flag = destroyed_flag_;
   destroyed_flag_ = &was_destroyed_during_dispatch;
 
-  MojoResult rv = ReadAndDispatchMessage(
-      message_pipe_.get(), incoming_receiver_, &receiver_result);
+  MojoResult rv;
+  if (pending_batch_ && pending_batch_->HasNext()) {
+    // Messages that were already read (in a batch) come first.
+    Message message;
+    pending_batch_->TakeNext(&message);
+    rv = MOJO_RESULT_OK;
+    if (incoming_receiver_)
+      receiver_result = incoming_receiver_->Accept(&message);
+  } else {
+    // The message may borrow its data from the message pipe (see
+    // |ReadMessageNoCopy()|), so if the message pipe is closed (or |this| is
+    // destroyed) during dispatch, actually closing it is deferred until the
+    // message is gone.
+    ScopedMessagePipeHandle deferred_close_pipe;
+    bool defers_close = !deferred_close_pipe_;
+    if (defers_close)
+      deferred_close_pipe_ = &deferred_close_pipe;
+    rv = ReadAndDispatchMessage(message_pipe_.get(), incoming_receiver_,
+                                &receiver_result);
+    if (defers_close && !was_destroyed_during_dispatch)
+      deferred_close_pipe_ = nullptr;
+  }
   if (read_result)
     *read_result = rv;
 
@@ -172,12 +289,60 @@ bool Connector::ReadSingleMessage(MojoResult* read_result) {
   return true;
 }
 
+bool Connector::ReadMessageBatch(MojoResult* read_result) {
+  MOJO_DCHECK(!pending_batch_);
+
+  MessageBatch batch;
+  MojoResult rv = batch.Read(message_pipe_.get());
+  // If the next message is too big for a batch (or batched reads aren't
+  // supported), read it by itself.
+  if ((rv == MOJO_RESULT_RESOURCE_EXHAUSTED && !batch.HasNext()) ||
+      rv == MOJO_RESULT_UNIMPLEMENTED)
+    return ReadSingleMessage(read_result);
+
+  *read_result = rv;
+  if (rv == MOJO_RESULT_SHOULD_WAIT)
+    return true;
+  if (rv != MOJO_RESULT_OK) {
+    NotifyError();
+    return false;
+  }
+
+  // Dispatch the messages one at a time. |batch| outlives the messages (whose
+  // data it owns) even if |this| is destroyed during dispatch.
+  bool was_destroyed_during_dispatch = false;
+  bool* previous_destroyed_flag = destroyed_flag_;
+  destroyed_flag_ = &was_destroyed_during_dispatch;
+  pending_batch_ = &batch;
+
+  bool ok = true;
+  while (ok && batch.HasNext() && message_pipe_.is_valid())
+    ok = ReadSingleMessage(read_result);
+  // The message pipe may have been closed or passed on during dispatch, in
+  // which case the rest of the batch can't be delivered.
+  batch.CloseRemainingHandles();
+
+  if (was_destroyed_during_dispatch) {
+    if (previous_destroyed_flag)
+      *previous_destroyed_flag = true;  // Propagate flag.
+    return false;
+  }
+  destroyed_flag_ = previous_destroyed_flag;
+  pending_batch_ = nullptr;
+
+  return ok && message_pipe_.is_valid();
+}
+
 void Connector::ReadAllAvailableMessages() {
   while (!error_) {
     MojoResult rv;
 
     // Return immediately if |this| was destroyed. Do not touch any members!
-    if (!ReadSingleMessage(&rv))
+    if (batch_reads_ ? !ReadMessageBatch(&rv) : !ReadSingleMessage(&rv))
+      return;
+
+    // The message pipe may have been closed or passed on during dispatch.
+    if (!message_pipe_.is_valid())
       return;
 
     if (rv == MOJO_RESULT_SHOULD_WAIT) {
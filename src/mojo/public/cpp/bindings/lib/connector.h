@@ -52,6 +52,13 @@ class Connector : public MessageReceiver {
     connection_error_handler_ = error_handler;
   }
 
+  // If set, messages are read from the pipe in batches (see
+  // |MojoReadMessages()|), which is cheaper when they arrive in bursts. The
+  // messages of a batch that are yet to be dispatched are lost if the pipe is
+  // passed on during dispatch (see |PassMessagePipe()|), so this must only be
+  // set if the incoming receiver never does that. Defaults to false.
+  void set_batch_reads(bool batch_reads) { batch_reads_ = batch_reads; }
+
   // Returns true if an error was encountered while reading from the pipe or
   // waiting to read from the pipe.
   bool encountered_error() const { return error_; }
@@ -90,6 +97,15 @@ class Connector : public MessageReceiver {
   // Returns false if |this| was destroyed during message dispatch.
   MOJO_WARN_UNUSED_RESULT bool ReadSingleMessage(MojoResult* read_result);
 
+  // Reads the next messages (as many as fit in a batch, using
+  // |MojoReadMessages()|) and dispatches them in order (reentrant reads get
+  // the rest of the batch first). Returns false if |this| was destroyed during
+  // message dispatch or if no more messages should be read (e.g., because of
+  // an error). If |this| is destroyed, or the message pipe is closed or passed
+  // on, during dispatch, the rest of the batch is dropped (and its handles
+  // closed). Only used if |batch_reads_| is set.
+  MOJO_WARN_UNUSED_RESULT bool ReadMessageBatch(MojoResult* read_result);
+
   // |this| can be destroyed during message dispatch.
   void ReadAllAvailableMessages();
 
@@ -98,6 +114,8 @@ class Connector : public MessageReceiver {
   // Cancels any calls made to |waiter_|.
   void CancelWait();
 
+  class MessageBatch;
+
   Closure connection_error_handler_;
   const MojoAsyncWaiter* waiter_;
 
@@ -108,12 +126,20 @@ class Connector : public MessageReceiver {
   bool error_;
   bool drop_writes_;
   bool enforce_errors_from_incoming_receiver_;
+  bool batch_reads_;
 
   // If non-null, this will be set to true when the Connector is destroyed.  We
   // use this flag to allow for the Connector to be destroyed as a side-effect
   // of dispatching an incoming message.
   bool* destroyed_flag_;
 
+  // Non-null while the messages of a batch are being dispatched.
+  MessageBatch* pending_batch_;
+
+  // If non-null, the message pipe is moved here instead of being closed (see
+  // |ReadSingleMessage()|).
+  ScopedMessagePipeHandle* deferred_close_pipe_;
+
   MOJO_DISALLOW_COPY_AND_ASSIGN(Connector);
 };
 
@@ -66,17 +66,11 @@ class Map_Data {
       return ValidationError::NONE;
 
     ValidationError retval =
-        ValidateStructHeaderAndClaimMemory(data, bounds_checker, err);
+        ValidateHeaderAndClaimMemory(data, bounds_checker, err);
     if (retval != ValidationError::NONE)
       return retval;
 
     const Map_Data* object = static_cast<const Map_Data*>(data);
-    if (object->header_.num_bytes != sizeof(Map_Data) ||
-        object->header_.version != 0) {
-      MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err) << "";
-      return ValidationError::UNEXPECTED_STRUCT_HEADER;
-    }
-
     if (!ValidateEncodedPointer(&object->keys.offset)) {
       MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err) << "";
       return ValidationError::ILLEGAL_POINTER;
@@ -124,6 +118,28 @@ class Map_Data {
     return ValidationError::NONE;
   }
 
+  // Validates the struct header of the (non-null) map at |data| and claims its
+  // memory, i.e., does everything |Validate()| does before validating the key
+  // and value arrays.
+  static ValidationError ValidateHeaderAndClaimMemory(
+      const void* data,
+      BoundsChecker* bounds_checker,
+      std::string* err) {
+    ValidationError retval =
+        ValidateStructHeaderAndClaimMemory(data, bounds_checker, err);
+    if (retval != ValidationError::NONE)
+      return retval;
+
+    const Map_Data* object = static_cast<const Map_Data*>(data);
+    if (object->header_.num_bytes != sizeof(Map_Data) ||
+        object->header_.version != 0) {
+      MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err) << "";
+      return ValidationError::UNEXPECTED_STRUCT_HEADER;
+    }
+
+    return ValidationError::NONE;
+  }
+
   StructHeader header_;
 
   ArrayPointer<Key> keys;
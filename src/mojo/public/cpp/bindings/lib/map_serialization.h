@@ -5,7 +5,9 @@
 #ifndef MOJO_PUBLIC_CPP_BINDINGS_LIB_MAP_SERIALIZATION_H_
 #define MOJO_PUBLIC_CPP_BINDINGS_LIB_MAP_SERIALIZATION_H_
 
+#include <string>
 #include <type_traits>
+#include <vector>
 
 #include "mojo/public/cpp/bindings/lib/array_internal.h"
 #include "mojo/public/cpp/bindings/lib/array_serialization.h"
@@ -165,8 +167,9 @@ inline internal::ValidationError SerializeMap_(
 
   auto keys_retval =
       internal::ArraySerializer<MapKey, DataKey>::SerializeElements(
-          key_iter.begin(), input->size(), buf, result->keys.ptr,
+          key_iter.begin(), input->size(), buf, keys_data,
           key_validate_params);
+  internal::EncodePointerInline(buf, &result->keys);
   if (keys_retval != internal::ValidationError::NONE)
     return keys_retval;
 
@@ -179,8 +182,9 @@ inline internal::ValidationError SerializeMap_(
 
   auto values_retval =
       internal::ArraySerializer<MapValue, DataValue>::SerializeElements(
-          value_iter.begin(), input->size(), buf, result->values.ptr,
+          value_iter.begin(), input->size(), buf, values_data,
           value_validate_params);
+  internal::EncodePointerInline(buf, &result->values);
   if (values_retval != internal::ValidationError::NONE)
     return values_retval;
 
@@ -193,13 +197,14 @@ template <typename MapKey,
           typename DataKey,
           typename DataValue>
 inline void Deserialize_(internal::Map_Data<DataKey, DataValue>* input,
-                         Map<MapKey, MapValue>* output) {
+                         Map<MapKey, MapValue>* output,
+                         internal::Arena* arena) {
   if (input) {
     Array<MapKey> keys;
     Array<MapValue> values;
 
-    Deserialize_(input->keys.ptr, &keys);
-    Deserialize_(input->values.ptr, &values);
+    Deserialize_(input->keys.ptr, &keys, arena);
+    Deserialize_(input->values.ptr, &values, arena);
 
     *output = Map<MapKey, MapValue>(keys.Pass(), values.Pass());
   } else {
@@ -207,6 +212,74 @@ inline void Deserialize_(internal::Map_Data<DataKey, DataValue>* input,
   }
 }
 
+// Validates and deserializes the (still encoded) map at |data|, which may be
+// null, in a single pass; see the |Array| version in array_serialization.h.
+template <typename MapKey, typename MapValue>
+inline internal::ValidationError ValidateAndDeserialize_(
+    const void* data,
+    Map<MapKey, MapValue>* output,
+    const internal::ArrayValidateParams* value_validate_params,
+    internal::BoundsChecker* bounds_checker,
+    std::vector<Handle>* handles,
+    std::string* err,
+    internal::Arena* arena) {
+  if (!data) {
+    output->reset();
+    return internal::ValidationError::NONE;
+  }
+
+  typedef typename internal::WrapperTraits<MapKey>::DataType DataKey;
+  typedef typename internal::WrapperTraits<MapValue>::DataType DataValue;
+  typedef internal::Map_Data<DataKey, DataValue> Data;
+  auto retval = Data::ValidateHeaderAndClaimMemory(data, bounds_checker, err);
+  if (retval != internal::ValidationError::NONE)
+    return retval;
+
+  const Data* object = static_cast<const Data*>(data);
+  if (!internal::ValidateEncodedPointer(&object->keys.offset)) {
+    MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err) << "";
+    return internal::ValidationError::ILLEGAL_POINTER;
+  }
+
+  if (!object->keys.offset) {
+    MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err) << "null key array in map struct";
+    return internal::ValidationError::UNEXPECTED_NULL_POINTER;
+  }
+
+  Array<MapKey> keys;
+  retval = ValidateAndDeserialize_(
+      internal::DecodePointerRaw(&object->keys.offset), &keys,
+      internal::MapKeyValidateParamsFactory<DataKey>::Get(), bounds_checker,
+      handles, err, arena);
+  if (retval != internal::ValidationError::NONE)
+    return retval;
+
+  if (!internal::ValidateEncodedPointer(&object->values.offset)) {
+    MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err) << "";
+    return internal::ValidationError::ILLEGAL_POINTER;
+  }
+
+  if (!object->values.offset) {
+    MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err) << "null value array in map struct";
+    return internal::ValidationError::UNEXPECTED_NULL_POINTER;
+  }
+
+  Array<MapValue> values;
+  retval = ValidateAndDeserialize_(
+      internal::DecodePointerRaw(&object->values.offset), &values,
+      value_validate_params, bounds_checker, handles, err, arena);
+  if (retval != internal::ValidationError::NONE)
+    return retval;
+
+  if (keys.size() != values.size()) {
+    MOJO_INTERNAL_DEBUG_SET_ERROR_MSG(err) << "";
+    return internal::ValidationError::DIFFERENT_SIZED_ARRAYS_IN_MAP;
+  }
+
+  *output = Map<MapKey, MapValue>(keys.Pass(), values.Pass());
+  return internal::ValidationError::NONE;
+}
+
 }  // namespace mojo
 
 #endif  // MOJO_PUBLIC_CPP_BINDINGS_LIB_MAP_SERIALIZATION_H_
@@ -8,10 +8,15 @@
 #ifndef MOJO_PUBLIC_CPP_BINDINGS_LIB_MAP_SERIALIZATION_FORWARD_H_
 #define MOJO_PUBLIC_CPP_BINDINGS_LIB_MAP_SERIALIZATION_FORWARD_H_
 
+#include <string>
+#include <vector>
+
 namespace mojo {
 namespace internal {
 
+class Arena;
 class ArrayValidateParams;
+class BoundsChecker;
 class Buffer;
 
 template <typename Key, typename Value>
@@ -19,6 +24,8 @@ class Map_Data;
 
 }  // namespace internal
 
+class Handle;
+
 template <typename Key, typename Value>
 class Map;
 
@@ -39,7 +46,18 @@ template <typename MapKey,
           typename DataKey,
           typename DataValue>
 void Deserialize_(internal::Map_Data<DataKey, DataValue>* input,
-                  Map<MapKey, MapValue>* output);
+                  Map<MapKey, MapValue>* output,
+                  internal::Arena* arena = nullptr);
+
+template <typename MapKey, typename MapValue>
+internal::ValidationError ValidateAndDeserialize_(
+    const void* data,
+    Map<MapKey, MapValue>* output,
+    const internal::ArrayValidateParams* value_validate_params,
+    internal::BoundsChecker* bounds_checker,
+    std::vector<Handle>* handles,
+    std::string* err,
+    internal::Arena* arena = nullptr);
 
 }  // namespace mojo
 
@@ -5,6 +5,7 @@
 #include "mojo/public/cpp/bindings/message.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <algorithm>
 
@@ -39,14 +40,43 @@ void Message::AllocUninitializedData(uint32_t num_bytes) {
   data_ = static_cast<internal::MessageData*>(malloc(num_bytes));
 }
 
+void Message::AdoptData(uint32_t num_bytes, void* data) {
+  MOJO_DCHECK(!data_);
+  data_num_bytes_ = num_bytes;
+  data_ = static_cast<internal::MessageData*>(data);
+}
+
+void Message::BorrowData(MessagePipeHandle message_pipe,
+                         void* data,
+                         uint32_t num_bytes) {
+  MOJO_DCHECK(!data_);
+  data_num_bytes_ = num_bytes;
+  data_ = static_cast<internal::MessageData*>(data);
+  data_is_borrowed_ = true;
+  borrowed_from_ = message_pipe;
+}
+
 void Message::MoveTo(Message* destination) {
   MOJO_DCHECK(this != destination);
 
   destination->FreeDataAndCloseHandles();
 
-  // No copy needed.
-  destination->data_num_bytes_ = data_num_bytes_;
-  destination->data_ = data_;
+  if (data_is_borrowed_) {
+    destination->Initialize();
+    destination->AllocUninitializedData(data_num_bytes_);
+    memcpy(destination->data_, data_, data_num_bytes_);
+    if (borrowed_from_.is_valid()) {
+      MojoResult result = EndReadMessageRaw(borrowed_from_);
+      MOJO_ALLOW_UNUSED_LOCAL(result);
+      MOJO_DCHECK(result == MOJO_RESULT_OK);
+    }
+  } else {
+    // No copy needed.
+    destination->data_num_bytes_ = data_num_bytes_;
+    destination->data_ = data_;
+    destination->data_is_borrowed_ = false;
+    destination->borrowed_from_ = MessagePipeHandle();
+  }
   std::swap(destination->handles_, handles_);
 
   handles_.clear();
@@ -56,10 +86,19 @@ void Message::MoveTo(Message* destination) {
 void Message::Initialize() {
   data_num_bytes_ = 0;
   data_ = nullptr;
+  data_is_borrowed_ = false;
+  borrowed_from_ = MessagePipeHandle();
 }
 
 void Message::FreeDataAndCloseHandles() {
-  free(data_);
+  if (data_is_borrowed_) {
+    // This fails harmlessly if the message pipe was closed (which also ends
+    // the two-phase read).
+    if (borrowed_from_.is_valid())
+      EndReadMessageRaw(borrowed_from_);
+  } else {
+    free(data_);
+  }
 
   for (std::vector<Handle>::iterator it = handles_.begin();
        it != handles_.end(); ++it) {
@@ -99,11 +138,46 @@ MojoResult ReadMessage(MessagePipeHandle handle, Message* message) {
   return rv;
 }
 
+MojoResult ReadMessageNoCopy(MessagePipeHandle handle, Message* message) {
+  MOJO_DCHECK(handle.is_valid());
+  MOJO_DCHECK(message);
+  MOJO_DCHECK(message->handles()->empty());
+  MOJO_DCHECK(message->data_num_bytes() == 0);
+
+  void* buffer = nullptr;
+  uint32_t num_bytes = 0;
+  uint32_t num_handles = 0;
+  MojoResult rv = BeginReadMessageRaw(handle, &buffer, &num_bytes, nullptr,
+                                      &num_handles,
+                                      MOJO_READ_MESSAGE_FLAG_NONE);
+  if (rv == MOJO_RESULT_RESOURCE_EXHAUSTED) {
+    // The message has handles, so we need to provide space for them.
+    message->mutable_handles()->resize(num_handles);
+    uint32_t num_handles_actual = num_handles;
+    rv = BeginReadMessageRaw(
+        handle, &buffer, &num_bytes,
+        reinterpret_cast<MojoHandle*>(&message->mutable_handles()->front()),
+        &num_handles_actual, MOJO_READ_MESSAGE_FLAG_NONE);
+    MOJO_DCHECK(rv != MOJO_RESULT_OK || num_handles == num_handles_actual);
+    if (rv != MOJO_RESULT_OK)
+      message->mutable_handles()->clear();
+  }
+
+  // Two-phase reads may be unavailable (e.g., under NaCl).
+  if (rv == MOJO_RESULT_BUSY || rv == MOJO_RESULT_UNIMPLEMENTED)
+    return ReadMessage(handle, message);
+  if (rv != MOJO_RESULT_OK)
+    return rv;
+
+  message->BorrowData(handle, buffer, num_bytes);
+  return MOJO_RESULT_OK;
+}
+
 MojoResult ReadAndDispatchMessage(MessagePipeHandle handle,
                                   MessageReceiver* receiver,
                                   bool* receiver_result) {
   Message message;
-  MojoResult rv = ReadMessage(handle, &message);
+  MojoResult rv = ReadMessageNoCopy(handle, &message);
   if (receiver && rv == MOJO_RESULT_OK)
     *receiver_result = receiver->Accept(&message);
 
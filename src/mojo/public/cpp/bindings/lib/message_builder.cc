@@ -35,6 +35,36 @@ MessageWithRequestIDBuilder::MessageWithRequestIDBuilder(uint32_t name,
   header->request_id = request_id;
 }
 
+ChunkedMessageBuilder::ChunkedMessageBuilder(uint32_t name)
+    : buf_(inline_chunk_, sizeof(inline_chunk_), message_.mutable_handles()) {
+  MessageHeader* header;
+  Allocate(&buf_, &header);
+  header->version = 0;
+  header->name = name;
+  header->flags = 0;
+}
+
+ChunkedMessageBuilder::ChunkedMessageBuilder(uint32_t name,
+                                             uint32_t flags,
+                                             uint64_t request_id)
+    : buf_(inline_chunk_, sizeof(inline_chunk_), message_.mutable_handles()) {
+  MessageHeaderWithRequestID* header;
+  Allocate(&buf_, &header);
+  header->version = 1;
+  header->name = name;
+  header->flags = flags;
+  header->request_id = request_id;
+}
+
+ChunkedMessageBuilder::~ChunkedMessageBuilder() {
+}
+
+Message* ChunkedMessageBuilder::Finish() {
+  uint32_t num_bytes = static_cast<uint32_t>(buf_.BytesUsed());
+  message_.AdoptData(num_bytes, buf_.Leak());
+  return &message_;
+}
+
 }  // namespace internal
 
 MessageBuilder::MessageBuilder(uint32_t name, size_t payload_size) {
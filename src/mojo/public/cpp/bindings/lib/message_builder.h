@@ -8,8 +8,10 @@
 #ifndef MOJO_PUBLIC_CPP_BINDINGS_LIB_MESSAGE_BUILDER_H_
 #define MOJO_PUBLIC_CPP_BINDINGS_LIB_MESSAGE_BUILDER_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include "mojo/public/cpp/bindings/lib/chunked_buffer.h"
 #include "mojo/public/cpp/bindings/lib/fixed_buffer.h"
 #include "mojo/public/cpp/bindings/lib/message_internal.h"
 #include "mojo/public/cpp/bindings/message.h"
@@ -56,6 +58,42 @@ class MessageWithRequestIDBuilder : public MessageBuilder {
                               uint64_t request_id);
 };
 
+// ChunkedMessageBuilder frames a |mojo::Message| like the other builders here,
+// but doesn't need to know the payload size upfront: the header and payload
+// are serialized in a single pass into a |ChunkedBuffer| (which encodes
+// pointers and handles as they are written), and then copied into the message
+// by |Finish()|. This is what the generated C++ bindings use to build
+// messages.
+//
+// The first |kInlineChunkSize| bytes are built in the builder itself (usually
+// on the stack), so that most messages need no allocations other than the
+// message's own.
+class ChunkedMessageBuilder {
+ public:
+  // Builds a message without a request id, like |MessageBuilder|.
+  explicit ChunkedMessageBuilder(uint32_t name);
+  // Builds a message with a request id, like |RequestMessageBuilder| or
+  // |ResponseMessageBuilder|.
+  ChunkedMessageBuilder(uint32_t name, uint32_t flags, uint64_t request_id);
+  ~ChunkedMessageBuilder();
+
+  Buffer* buffer() { return &buf_; }
+
+  // Moves everything allocated from |buffer()| into the message, and returns
+  // the message. |buffer()| may not be used afterwards.
+  Message* Finish();
+
+  static const size_t kInlineChunkSize = 4096u;
+
+ private:
+  Message message_;
+  // (|uint64_t|s, for alignment.)
+  uint64_t inline_chunk_[kInlineChunkSize / sizeof(uint64_t)];
+  ChunkedBuffer buf_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(ChunkedMessageBuilder);
+};
+
 }  // namespace internal
 
 // Builds a |mojo::Message| that is a "request" message that expects a response
@@ -38,6 +38,11 @@ class Router : public MessageReceiverWithResponder {
     connector_.set_connection_error_handler(error_handler);
   }
 
+  // See |Connector::set_batch_reads()|.
+  void set_batch_reads(bool batch_reads) {
+    connector_.set_batch_reads(batch_reads);
+  }
+
   // Returns true if an error was encountered while reading from the pipe or
   // waiting to read from the pipe.
   bool encountered_error() const { return connector_.encountered_error(); }
@@ -28,7 +28,9 @@ void SerializeString_(const String& input,
   }
 }
 
-void Deserialize_(internal::String_Data* input, String* output) {
+void Deserialize_(internal::String_Data* input,
+                  String* output,
+                  internal::Arena* /*arena*/) {
   if (input) {
     String result(input->storage(), input->size());
     result.Swap(output);
@@ -37,4 +39,31 @@ void Deserialize_(internal::String_Data* input, String* output) {
   }
 }
 
+internal::ValidationError ValidateAndDeserialize_(
+    const void* data,
+    String* output,
+    const internal::ArrayValidateParams* validate_params,
+    internal::BoundsChecker* bounds_checker,
+    std::vector<Handle>* handles,
+    std::string* err,
+    internal::Arena* /*arena*/) {
+  if (!data) {
+    output->reset();
+    return internal::ValidationError::NONE;
+  }
+
+  // Strings have no elements to validate beyond their header.
+  internal::ValidationError retval =
+      internal::String_Data::ValidateHeaderAndClaimMemory(data, bounds_checker,
+                                                          validate_params, err);
+  if (retval != internal::ValidationError::NONE)
+    return retval;
+
+  const internal::String_Data* input =
+      static_cast<const internal::String_Data*>(data);
+  String result(input->storage(), input->size());
+  result.Swap(output);
+  return internal::ValidationError::NONE;
+}
+
 }  // namespace mojo
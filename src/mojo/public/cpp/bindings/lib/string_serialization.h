@@ -5,17 +5,38 @@
 #ifndef MOJO_PUBLIC_CPP_BINDINGS_LIB_STRING_SERIALIZATION_H_
 #define MOJO_PUBLIC_CPP_BINDINGS_LIB_STRING_SERIALIZATION_H_
 
+#include <string>
+#include <vector>
+
 #include "mojo/public/cpp/bindings/lib/array_internal.h"
 #include "mojo/public/cpp/bindings/string.h"
 
 namespace mojo {
+namespace internal {
+class Arena;
+}  // namespace internal
 
 size_t GetSerializedSize_(const String& input);
 void SerializeString_(const String& input,
                       internal::Buffer* buffer,
                       internal::String_Data** output);
 
-void Deserialize_(internal::String_Data* input, String* output);
+// Strings are never allocated from |arena|; it is accepted so that containers
+// can pass it along uniformly.
+void Deserialize_(internal::String_Data* input,
+                  String* output,
+                  internal::Arena* arena = nullptr);
+
+// Validates the encoded string at |data| (which may be null) and deserializes
+// it into |output|; see the |Array| version in array_serialization.h.
+internal::ValidationError ValidateAndDeserialize_(
+    const void* data,
+    String* output,
+    const internal::ArrayValidateParams* validate_params,
+    internal::BoundsChecker* bounds_checker,
+    std::vector<Handle>* handles,
+    std::string* err,
+    internal::Arena* arena = nullptr);
 
 }  // namespace mojo
 
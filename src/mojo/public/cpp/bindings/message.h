@@ -9,6 +9,7 @@
 
 #include "mojo/public/cpp/bindings/lib/message_internal.h"
 #include "mojo/public/cpp/environment/logging.h"
+#include "mojo/public/cpp/system/message_pipe.h"
 
 namespace mojo {
 
@@ -16,6 +17,13 @@ namespace mojo {
 // Message owns its data and handles, but a consumer of Message is free to
 // mutate the data and handles. The message's data is comprised of a header
 // followed by payload.
+//
+// A received message may instead wrap data lent by the system during a
+// two-phase read (see |MojoBeginReadMessage()|), in which case the read is
+// completed when the data is freed. Such data is only valid while the message
+// pipe it was read from remains open. It may also wrap data lent by its
+// creator (e.g., part of a buffer filled by |MojoReadMessages()|), which is
+// only valid for as long as the creator says.
 class Message {
  public:
   Message();
@@ -26,7 +34,18 @@ class Message {
   void AllocData(uint32_t num_bytes);
   void AllocUninitializedData(uint32_t num_bytes);
 
-  // Transfers data and handles to |destination|.
+  // Takes ownership of the |num_bytes| bytes of data at |data|, which must have
+  // been allocated with |malloc()|.
+  void AdoptData(uint32_t num_bytes, void* data);
+
+  // Wraps the |num_bytes| bytes of data at |data|, lent by a two-phase read
+  // begun on |message_pipe|, or by the caller if |message_pipe| is invalid.
+  void BorrowData(MessagePipeHandle message_pipe,
+                  void* data,
+                  uint32_t num_bytes);
+
+  // Transfers data and handles to |destination|. If the data is borrowed, it
+  // is copied (so that |destination| doesn't depend on the message pipe).
   void MoveTo(Message* destination);
 
   uint32_t data_num_bytes() const { return data_num_bytes_; }
@@ -79,6 +98,10 @@ class Message {
   uint32_t data_num_bytes_;
   internal::MessageData* data_;
   std::vector<Handle> handles_;
+  // True if |data_| isn't owned by this message.
+  bool data_is_borrowed_;
+  // Valid if |data_| was lent by a two-phase read on this message pipe.
+  MessagePipeHandle borrowed_from_;
 
   MOJO_DISALLOW_COPY_AND_ASSIGN(Message);
 };
@@ -154,13 +177,20 @@ class MessageReceiverWithResponderStatus : public MessageReceiver {
 // NOTE: The message isn't validated and may be malformed!
 MojoResult ReadMessage(MessagePipeHandle handle, Message* message);
 
+// Like |ReadMessage()|, but avoids copying the message's data if possible by
+// having |message| borrow it using a two-phase read (see
+// |MojoBeginReadMessage()|). This falls back to |ReadMessage()| if a two-phase
+// read is already in progress on |handle| (e.g., on reentrant reads) or if
+// two-phase reads aren't supported.
+MojoResult ReadMessageNoCopy(MessagePipeHandle handle, Message* message);
+
 // Read a single message from the pipe and dispatch to the given receiver.
 // |handle| must be valid. |receiver| may be null, in which case the read
 // message is simply discarded. If |receiver| is not null, then
 // |receiver_result| should be non-null, and will be set the receiver's return
 // value.
 //
-// This method calls into |MojoReadMessage()| and propagates any errors it
+// This method calls into |ReadMessageNoCopy()| and propagates any errors it
 // produces. See mojo/public/c/system/message_pipe.h for a description of its
 // possible return values.
 MojoResult ReadAndDispatchMessage(MessagePipeHandle handle,
@@ -0,0 +1,38 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MOJO_PUBLIC_CPP_BINDINGS_STRING_DATA_VIEW_H_
+#define MOJO_PUBLIC_CPP_BINDINGS_STRING_DATA_VIEW_H_
+
+#include <stddef.h>
+
+#include <string>
+
+#include "mojo/public/cpp/bindings/lib/array_internal.h"
+
+namespace mojo {
+
+// A read-only view of a serialized (and validated) mojom string. It does not
+// own the memory it refers to, and is only valid for as long as the message it
+// was obtained from. Unlike |String|, it may not be NUL-terminated.
+class StringDataView {
+ public:
+  StringDataView() : data_(nullptr) {}
+  explicit StringDataView(const internal::String_Data* data) : data_(data) {}
+
+  bool is_null() const { return !data_; }
+
+  size_t size() const { return data_ ? data_->size() : 0u; }
+  const char* storage() const { return data_ ? data_->storage() : nullptr; }
+
+  // Copies the contents out (a null view yields an empty string).
+  std::string ToString() const { return std::string(storage(), size()); }
+
+ private:
+  const internal::String_Data* data_;
+};
+
+}  // namespace mojo
+
+#endif  // MOJO_PUBLIC_CPP_BINDINGS_STRING_DATA_VIEW_H_
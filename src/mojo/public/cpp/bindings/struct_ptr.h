@@ -9,6 +9,7 @@
 #include <memory>
 #include <new>
 
+#include "mojo/public/cpp/bindings/lib/arena.h"
 #include "mojo/public/cpp/bindings/type_converter.h"
 #include "mojo/public/cpp/environment/logging.h"
 #include "mojo/public/cpp/system/macros.h"
@@ -23,6 +24,28 @@ class StructHelper {
   static void Initialize(Ptr* ptr) {
     ptr->Initialize();
   }
+
+  // Replaces |*ptr|'s object (if any) with a new one, allocated from |arena|
+  // if it's non-null (and otherwise as by |Initialize()|). This is used by
+  // deserialization, to which the stubs of [CppArena] interfaces pass an arena.
+  template <typename Ptr>
+  static void Initialize(Ptr* ptr, Arena* arena) {
+    *ptr = nullptr;
+    ptr->Initialize(arena);
+  }
+};
+
+// Deletes the object owned by a |StructPtr|. Such objects are always allocated
+// by |Arena::AllocateObject()| or |Arena::AllocateHeapObject()|, whose header
+// records where the memory came from, so this needn't have any state (which
+// keeps |StructPtr| pointer-sized).
+class StructDeleter {
+ public:
+  template <typename Struct>
+  void operator()(Struct* object) const {
+    object->~Struct();
+    Arena::FreeObject(object);
+  }
 };
 
 }  // namespace internal
@@ -84,9 +107,13 @@ class StructPtr {
 
  private:
   friend class internal::StructHelper<Struct>;
-  void Initialize() {
+  void Initialize() { Initialize(nullptr); }
+  void Initialize(internal::Arena* arena) {
+    static_assert(alignof(Struct) <= 8u, "Struct too aligned for Arena");
     MOJO_DCHECK(!ptr_);
-    ptr_.reset(new Struct());
+    void* memory = arena ? arena->AllocateObject(sizeof(Struct))
+                         : internal::Arena::AllocateHeapObject(sizeof(Struct));
+    ptr_.reset(new (memory) Struct());
   }
 
   void Take(StructPtr* other) {
@@ -94,7 +121,7 @@ class StructPtr {
     Swap(other);
   }
 
-  std::unique_ptr<Struct> ptr_;
+  std::unique_ptr<Struct, internal::StructDeleter> ptr_;
 
   MOJO_MOVE_ONLY_TYPE(StructPtr);
 };
@@ -163,6 +190,8 @@ class InlinedStructPtr {
  private:
   friend class internal::StructHelper<Struct>;
   void Initialize() { is_null_ = false; }
+  // There's nothing to allocate.
+  void Initialize(internal::Arena* /*arena*/) { Initialize(); }
 
   void Take(InlinedStructPtr* other) {
     reset();
@@ -0,0 +1,197 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "mojo/public/cpp/bindings/binding.h"
+#include "mojo/public/cpp/bindings/lib/arena.h"
+#include "mojo/public/cpp/bindings/lib/fixed_buffer.h"
+#include "mojo/public/cpp/utility/run_loop.h"
+#include "mojo/public/interfaces/bindings/tests/test_arena.mojom.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace mojo {
+namespace test {
+namespace {
+
+ArenaItemPtr MakeArenaItem(int32_t id) {
+  ArenaItemPtr item(ArenaItem::New());
+  item->id = id;
+  item->label = "item";
+  return item;
+}
+
+ArenaRegionPtr MakeArenaRegion(const char* name, size_t num_items) {
+  ArenaRegionPtr region(ArenaRegion::New());
+  region->name = name;
+  region->items = Array<ArenaItemPtr>::New(num_items);
+  for (size_t i = 0; i < num_items; ++i)
+    region->items[i] = MakeArenaItem(static_cast<int32_t>(i));
+  region->named_items.insert("first", MakeArenaItem(-1));
+  return region;
+}
+
+// Deserializes a copy of |region| with structs allocated from |arena|.
+ArenaRegionPtr CopyIntoArena(ArenaRegion* region,
+                             mojo::internal::Arena* arena) {
+  mojo::internal::FixedBufferForTesting buf(GetSerializedSize_(*region));
+  internal::ArenaRegion_Data* data;
+  EXPECT_EQ(mojo::internal::ValidationError::NONE,
+            Serialize_(region, &buf, &data));
+
+  ArenaRegionPtr copy;
+  mojo::internal::StructHelper<ArenaRegion>::Initialize(&copy, arena);
+  Deserialize_(data, copy.get(), arena);
+  return copy;
+}
+
+// Tests that creating structs with |New()| never uses an arena.
+TEST(ArenaTest, NewUsesHeap) {
+  mojo::internal::Arena arena;
+  ArenaRegionPtr region = MakeArenaRegion("region", 10);
+  EXPECT_EQ(0u, arena.num_blocks());
+}
+
+// Supporting arenas mustn't make |StructPtr| any bigger.
+static_assert(sizeof(ArenaRegionPtr) == sizeof(ArenaRegion*),
+              "StructPtr should be pointer-sized");
+
+// Tests that structs are allocated from the arena passed to |Deserialize_()|,
+// a block at a time.
+TEST(ArenaTest, AllocatesStructsFromBlocks) {
+  ArenaRegionPtr region = MakeArenaRegion("region", 10);
+  mojo::internal::Arena arena;
+  EXPECT_EQ(0u, arena.num_blocks());
+  ArenaRegionPtr copy = CopyIntoArena(region.get(), &arena);
+  EXPECT_EQ(1u, arena.num_blocks());
+  EXPECT_TRUE(copy.Equals(region));
+
+  // Freeing objects doesn't return memory to the arena.
+  copy.reset();
+  for (size_t i = 0; i < 10; ++i)
+    CopyIntoArena(region.get(), &arena);
+  EXPECT_LT(1u, arena.num_blocks());
+  size_t num_blocks = arena.num_blocks();
+
+  // Large objects are allocated from the heap.
+  void* large = arena.AllocateObject(16 * 1024);
+  EXPECT_EQ(num_blocks, arena.num_blocks());
+  mojo::internal::Arena::FreeObject(large);
+}
+
+// Tests that objects allocated from an arena remain valid after it's gone.
+TEST(ArenaTest, ObjectsOutliveArena) {
+  ArenaRegionPtr region;
+  {
+    mojo::internal::Arena arena;
+    region = CopyIntoArena(MakeArenaRegion("region", 300).get(), &arena);
+    EXPECT_LT(1u, arena.num_blocks());
+  }
+
+  EXPECT_EQ("region", region->name);
+  ASSERT_EQ(300u, region->items.size());
+  EXPECT_EQ(299, region->items[299]->id);
+  EXPECT_EQ("item", region->items[299]->label);
+  EXPECT_EQ(-1, region->named_items.at("first")->id);
+}
+
+// Tests that cloning an arena-allocated struct yields a heap-allocated copy.
+TEST(ArenaTest, Clone) {
+  ArenaRegionPtr region;
+  ArenaRegionPtr clone;
+  {
+    mojo::internal::Arena arena;
+    region = CopyIntoArena(MakeArenaRegion("region", 5).get(), &arena);
+    clone = region.Clone();
+    EXPECT_EQ(1u, arena.num_blocks());
+  }
+  region.reset();
+  EXPECT_EQ("region", clone->name);
+  ASSERT_EQ(5u, clone->items.size());
+  EXPECT_EQ(4, clone->items[4]->id);
+}
+
+class ArenaServiceImpl : public ArenaService {
+ public:
+  explicit ArenaServiceImpl(InterfaceRequest<ArenaService> request)
+      : binding_(this, request.Pass()) {}
+  ~ArenaServiceImpl() override {}
+
+  const std::vector<ArenaRegionPtr>& kept_regions() const {
+    return kept_regions_;
+  }
+
+  // |ArenaService| implementation:
+  void Keep(ArenaRegionPtr region) override {
+    kept_regions_.push_back(region.Pass());
+  }
+  void CountItems(Array<ArenaRegionPtr> regions,
+                  const CountItemsCallback& callback) override {
+    uint32_t count = 0u;
+    for (size_t i = 0; i < regions.size(); ++i)
+      count += static_cast<uint32_t>(regions[i]->items.size());
+    callback.Run(count);
+  }
+
+ private:
+  Binding<ArenaService> binding_;
+  std::vector<ArenaRegionPtr> kept_regions_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(ArenaServiceImpl);
+};
+
+class ArenaServiceTest : public testing::Test {
+ public:
+  ArenaServiceTest() {}
+  ~ArenaServiceTest() override { loop_.RunUntilIdle(); }
+
+  void PumpMessages() { loop_.RunUntilIdle(); }
+
+ private:
+  RunLoop loop_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(ArenaServiceTest);
+};
+
+TEST_F(ArenaServiceTest, DeserializesRequests) {
+  ArenaServicePtr service;
+  ArenaServiceImpl impl(GetProxy(&service));
+
+  Array<ArenaRegionPtr> regions = Array<ArenaRegionPtr>::New(3);
+  for (size_t i = 0; i < regions.size(); ++i)
+    regions[i] = MakeArenaRegion("region", 100 * i);
+  uint32_t count = 0u;
+  service->CountItems(regions.Pass(),
+                      [&count](uint32_t result) { count = result; });
+  PumpMessages();
+  EXPECT_EQ(300u, count);
+}
+
+TEST_F(ArenaServiceTest, ImplementationKeepsRequest) {
+  ArenaServicePtr service;
+  ArenaServiceImpl impl(GetProxy(&service));
+
+  service->Keep(MakeArenaRegion("first", 200));
+  PumpMessages();
+  // Send more requests, which would reuse the first one's memory if it had
+  // been freed.
+  service->Keep(MakeArenaRegion("second", 10));
+  service->Keep(MakeArenaRegion("third", 50));
+  PumpMessages();
+
+  ASSERT_EQ(3u, impl.kept_regions().size());
+  const ArenaRegionPtr& first = impl.kept_regions()[0];
+  EXPECT_EQ("first", first->name);
+  ASSERT_EQ(200u, first->items.size());
+  EXPECT_EQ(199, first->items[199]->id);
+  EXPECT_EQ("item", first->items[199]->label);
+  EXPECT_EQ(-1, first->named_items.at("first")->id);
+  EXPECT_EQ("third", impl.kept_regions()[2]->name);
+}
+
+}  // namespace
+}  // namespace test
+}  // namespace mojo
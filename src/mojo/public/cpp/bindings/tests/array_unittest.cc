@@ -819,6 +819,59 @@ TEST(ArrayTest, Serialization_ArrayOfStructPtr) {
   }
 }
 
+// Tests that the non-null elements of an array of pointer-free structs are
+// serialized back to back, in order, and still validate.
+TEST(ArrayTest, Serialization_ArrayOfPointerFreeStructs) {
+  EXPECT_TRUE(
+      mojo::internal::IsPointerFreeStructDataType<Rect::Data_>::value);
+  EXPECT_FALSE(
+      mojo::internal::IsPointerFreeStructDataType<RectPair::Data_>::value);
+  EXPECT_FALSE(
+      mojo::internal::IsPointerFreeStructDataType<NamedRegion::Data_>::value);
+
+  Array<RectPtr> array = Array<RectPtr>::New(4);
+  for (size_t i = 0; i < array.size(); ++i) {
+    if (i == 1)
+      continue;
+    array[i] = Rect::New();
+    array[i]->x = static_cast<int32_t>(i);
+  }
+
+  size_t size = GetSerializedSize_(array);
+  EXPECT_EQ(8U + 4 * 8U + 3 * (8U + 4 * 4U), size);
+
+  FixedBufferForTesting buf(size);
+  Array_Data<Rect::Data_*>* data = nullptr;
+  ArrayValidateParams validate_params(0, true, nullptr);
+  EXPECT_EQ(mojo::internal::ValidationError::NONE,
+            SerializeArray_(&array, &buf, &data, &validate_params));
+  EXPECT_EQ(size, buf.BytesUsed());
+
+  const char* elements = reinterpret_cast<const char*>(data->storage() + 4);
+  EXPECT_EQ(elements, reinterpret_cast<const char*>(data->at(0)));
+  EXPECT_FALSE(data->at(1));
+  EXPECT_EQ(elements + sizeof(Rect::Data_),
+            reinterpret_cast<const char*>(data->at(2)));
+  EXPECT_EQ(elements + 2 * sizeof(Rect::Data_),
+            reinterpret_cast<const char*>(data->at(3)));
+
+  std::vector<Handle> handles;
+  data->EncodePointersAndHandles(&handles);
+  mojo::internal::BoundsChecker bounds_checker(data, size, 0);
+  EXPECT_EQ(mojo::internal::ValidationError::NONE,
+            Array_Data<Rect::Data_*>::Validate(data, &bounds_checker,
+                                               &validate_params, nullptr));
+  data->DecodePointersAndHandles(&handles);
+
+  Array<RectPtr> array2;
+  Deserialize_(data, &array2);
+  ASSERT_EQ(4U, array2.size());
+  EXPECT_TRUE(array2[1].is_null());
+  EXPECT_EQ(0, array2[0]->x);
+  EXPECT_EQ(2, array2[2]->x);
+  EXPECT_EQ(3, array2[3]->x);
+}
+
 }  // namespace
 }  // namespace test
 }  // namespace mojo
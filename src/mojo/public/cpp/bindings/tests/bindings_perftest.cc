@@ -2,10 +2,21 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <string.h>
+
+#include <string>
+#include <vector>
+
 #include "mojo/public/cpp/bindings/binding.h"
+#include "mojo/public/cpp/bindings/lib/arena.h"
+#include "mojo/public/cpp/bindings/lib/bounds_checker.h"
+#include "mojo/public/cpp/bindings/lib/fixed_buffer.h"
+#include "mojo/public/cpp/bindings/lib/message_builder.h"
 #include "mojo/public/cpp/test_support/test_support.h"
 #include "mojo/public/cpp/utility/run_loop.h"
 #include "mojo/public/interfaces/bindings/tests/ping_service.mojom.h"
+#include "mojo/public/interfaces/bindings/tests/test_arena.mojom.h"
+#include "mojo/public/interfaces/bindings/tests/test_structs.mojom.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
 namespace mojo {
@@ -81,11 +92,208 @@ struct BoundPingService {
   Binding<test::PingService> binding;
 };
 
+test::RectPtr MakeRect(int32_t i) {
+  test::RectPtr rect(test::Rect::New());
+  rect->x = i;
+  rect->y = i + 1;
+  rect->width = 10;
+  rect->height = 20;
+  return rect;
+}
+
+test::NamedRegionPtr MakeNamedRegion(size_t num_rects) {
+  test::NamedRegionPtr region(test::NamedRegion::New());
+  region->name = "region";
+  region->rects = Array<test::RectPtr>::New(num_rects);
+  for (size_t i = 0; i < num_rects; ++i)
+    region->rects[i] = MakeRect(static_cast<int32_t>(i));
+  return region;
+}
+
+test::StructOfStructsPtr MakeStructOfStructs(size_t num_entries) {
+  test::StructOfStructsPtr output(test::StructOfStructs::New());
+  output->nr = MakeNamedRegion(num_entries);
+  output->a_nr = Array<test::NamedRegionPtr>::New(num_entries);
+  output->a_rp = Array<test::RectPairPtr>::New(num_entries);
+  output->m_ndfv.mark_non_null();
+  for (size_t i = 0; i < num_entries; ++i) {
+    output->a_nr[i] = MakeNamedRegion(num_entries);
+    output->a_rp[i] = test::RectPair::New();
+    output->a_rp[i]->first = MakeRect(static_cast<int32_t>(i));
+    output->a_rp[i]->second = MakeRect(static_cast<int32_t>(i));
+    test::HandleStructPtr handle_struct(test::HandleStruct::New());
+    handle_struct->array_h = Array<ScopedMessagePipeHandle>::New(0);
+    output->m_hs.insert(static_cast<int64_t>(i), handle_struct.Pass());
+  }
+  return output;
+}
+
+// Builds a message from |input| the way the generated bindings used to: by
+// computing its size, serializing it into a fixed-size buffer and then
+// encoding its pointers and handles in a separate pass.
+template <typename T>
+void BuildMessageInThreePasses(T* input) {
+  MessageBuilder builder(1u, GetSerializedSize_(*input));
+  typename T::Data_* data;
+  Serialize_(input, builder.buffer(), &data);
+  data->EncodePointersAndHandles(builder.message()->mutable_handles());
+}
+
+// Builds a message from |input| the way the generated bindings do now: by
+// serializing (and encoding) it in a single pass into a growable buffer.
+template <typename T>
+void BuildMessageInOnePass(T* input) {
+  internal::ChunkedMessageBuilder builder(1u);
+  typename T::Data_* data;
+  Serialize_(input, builder.buffer(), &data);
+  builder.Finish();
+}
+
+// Logs how many messages per second can be built from |input| each way.
+// |input| must not contain handles, so that it can be serialized repeatedly.
+template <typename T>
+void MeasureBuildMessage(const char* shape,
+                         T* input,
+                         unsigned int iterations) {
+  MojoTimeTicks start_time = MojoGetTimeTicksNow();
+  for (unsigned int i = 0; i < iterations; ++i)
+    BuildMessageInThreePasses(input);
+  MojoTimeTicks end_time = MojoGetTimeTicksNow();
+  test::LogPerfResult(shape, "ThreePasses",
+                      iterations / MojoTicksToSeconds(end_time - start_time),
+                      "messages/second");
+
+  start_time = MojoGetTimeTicksNow();
+  for (unsigned int i = 0; i < iterations; ++i)
+    BuildMessageInOnePass(input);
+  end_time = MojoGetTimeTicksNow();
+  test::LogPerfResult(shape, "OnePass",
+                      iterations / MojoTicksToSeconds(end_time - start_time),
+                      "messages/second");
+}
+
 class MojoBindingsPerftest : public testing::Test {
  protected:
   RunLoop run_loop_;
 };
 
+test::ArenaRegionPtr MakeArenaRegion(size_t num_items) {
+  test::ArenaRegionPtr region(test::ArenaRegion::New());
+  region->name = "region";
+  region->items = Array<test::ArenaItemPtr>::New(num_items);
+  for (size_t i = 0; i < num_items; ++i) {
+    region->items[i] = test::ArenaItem::New();
+    region->items[i]->id = static_cast<int32_t>(i);
+    region->items[i]->label = "item";
+  }
+  region->named_items.mark_non_null();
+  return region;
+}
+
+// Deserializes |data| and frees the result, the way the generated stubs do.
+template <typename T>
+void DeserializeFromHeap(typename T::Data_* data) {
+  decltype(T::New()) output = T::New();
+  Deserialize_(data, output.get());
+}
+
+// Like |DeserializeFromHeap()|, but the way the stubs of interfaces with the
+// [CppArena] attribute do.
+template <typename T>
+void DeserializeFromArena(typename T::Data_* data) {
+  decltype(T::New()) output;
+  {
+    internal::Arena arena;
+    internal::StructHelper<T>::Initialize(&output, &arena);
+    Deserialize_(data, output.get(), &arena);
+  }
+}
+
+template <typename T>
+void MeasureDeserialize(const char* shape, T* input, unsigned int iterations) {
+  internal::FixedBufferForTesting buf(GetSerializedSize_(*input));
+  typename T::Data_* data;
+  Serialize_(input, &buf, &data);
+
+  MojoTimeTicks start_time = MojoGetTimeTicksNow();
+  for (unsigned int i = 0; i < iterations; ++i)
+    DeserializeFromHeap<T>(data);
+  MojoTimeTicks end_time = MojoGetTimeTicksNow();
+  test::LogPerfResult(shape, "Heap",
+                      iterations / MojoTicksToSeconds(end_time - start_time),
+                      "messages/second");
+
+  start_time = MojoGetTimeTicksNow();
+  for (unsigned int i = 0; i < iterations; ++i)
+    DeserializeFromArena<T>(data);
+  end_time = MojoGetTimeTicksNow();
+  test::LogPerfResult(shape, "Arena",
+                      iterations / MojoTicksToSeconds(end_time - start_time),
+                      "messages/second");
+}
+
+// Validates, decodes and deserializes the encoded |data| (which is clobbered)
+// the way the generated stubs do by default: in separate passes.
+template <typename T>
+void ValidateAndDeserializeInThreePasses(void* data, size_t num_bytes) {
+  std::vector<Handle> handles;
+  internal::BoundsChecker bounds_checker(data, num_bytes, 0);
+  internal::ValidationError error =
+      T::Data_::Validate(data, &bounds_checker, nullptr);
+  MOJO_CHECK(error == internal::ValidationError::NONE);
+  auto decoded = static_cast<typename T::Data_*>(data);
+  decoded->DecodePointersAndHandles(&handles);
+  DeserializeFromHeap<T>(decoded);
+}
+
+// Like |ValidateAndDeserializeInThreePasses()|, but the way the stubs of
+// interfaces with the [CppFusedValidation] attribute do: in a single pass,
+// leaving |data| as it is.
+template <typename T>
+void ValidateAndDeserializeInOnePass(void* data, size_t num_bytes) {
+  std::vector<Handle> handles;
+  internal::BoundsChecker bounds_checker(data, num_bytes, 0);
+  decltype(T::New()) output = T::New();
+  internal::ValidationError error = ValidateAndDeserialize_(
+      data, output.get(), &bounds_checker, &handles, nullptr);
+  MOJO_CHECK(error == internal::ValidationError::NONE);
+}
+
+// |input| must not contain handles. Both ways are timed on a fresh copy of the
+// encoded message each iteration, since decoding happens in place.
+template <typename T>
+void MeasureValidateAndDeserialize(const char* shape,
+                                   T* input,
+                                   unsigned int iterations) {
+  size_t num_bytes = GetSerializedSize_(*input);
+  internal::FixedBufferForTesting buf(num_bytes);
+  typename T::Data_* data;
+  Serialize_(input, &buf, &data);
+  std::vector<Handle> handles;
+  data->EncodePointersAndHandles(&handles);
+  std::vector<uint64_t> copy((num_bytes + 7) / 8);
+
+  MojoTimeTicks start_time = MojoGetTimeTicksNow();
+  for (unsigned int i = 0; i < iterations; ++i) {
+    memcpy(copy.data(), data, num_bytes);
+    ValidateAndDeserializeInThreePasses<T>(copy.data(), num_bytes);
+  }
+  MojoTimeTicks end_time = MojoGetTimeTicksNow();
+  test::LogPerfResult(shape, "ThreePasses",
+                      iterations / MojoTicksToSeconds(end_time - start_time),
+                      "messages/second");
+
+  start_time = MojoGetTimeTicksNow();
+  for (unsigned int i = 0; i < iterations; ++i) {
+    memcpy(copy.data(), data, num_bytes);
+    ValidateAndDeserializeInOnePass<T>(copy.data(), num_bytes);
+  }
+  end_time = MojoGetTimeTicksNow();
+  test::LogPerfResult(shape, "OnePass",
+                      iterations / MojoTicksToSeconds(end_time - start_time),
+                      "messages/second");
+}
+
 TEST_F(MojoBindingsPerftest, InProcessPingPong) {
   test::PingServicePtr service;
   PingServiceImpl impl;
@@ -121,5 +329,43 @@ TEST_F(MojoBindingsPerftest, InProcessPingPong) {
   }
 }
 
+TEST(MojoSerializationPerftest, BuildMessage) {
+  // A small struct with no pointers.
+  test::RectPtr rect = MakeRect(1);
+  MeasureBuildMessage("BuildMessage_Flat", rect.get(), 1000000);
+
+  // An array of small structs.
+  test::NamedRegionPtr region = MakeNamedRegion(100);
+  MeasureBuildMessage("BuildMessage_ArrayOfStructs", region.get(), 100000);
+
+  // Nested structs, arrays and maps. The larger one outgrows the first chunk
+  // of the single-pass buffer many times over.
+  test::StructOfStructsPtr small_nested = MakeStructOfStructs(4);
+  MeasureBuildMessage("BuildMessage_NestedSmall", small_nested.get(), 100000);
+  test::StructOfStructsPtr large_nested = MakeStructOfStructs(32);
+  MeasureBuildMessage("BuildMessage_NestedLarge", large_nested.get(), 10000);
+}
+
+TEST(MojoSerializationPerftest, Deserialize) {
+  // Many small structs that aren't inlined in their |StructPtr|s.
+  test::ArenaRegionPtr small_region = MakeArenaRegion(10);
+  MeasureDeserialize("Deserialize_Structs10", small_region.get(), 100000);
+  test::ArenaRegionPtr large_region = MakeArenaRegion(1000);
+  MeasureDeserialize("Deserialize_Structs1000", large_region.get(), 1000);
+}
+
+TEST(MojoSerializationPerftest, ValidateAndDeserialize) {
+  test::RectPtr rect = MakeRect(1);
+  MeasureValidateAndDeserialize("ValidateAndDeserialize_Flat", rect.get(),
+                                1000000);
+
+  test::ArenaRegionPtr small_region = MakeArenaRegion(10);
+  MeasureValidateAndDeserialize("ValidateAndDeserialize_Structs10",
+                                small_region.get(), 100000);
+  test::ArenaRegionPtr large_region = MakeArenaRegion(1000);
+  MeasureValidateAndDeserialize("ValidateAndDeserialize_Structs1000",
+                                large_region.get(), 1000);
+}
+
 }  // namespace
 }  // namespace mojo
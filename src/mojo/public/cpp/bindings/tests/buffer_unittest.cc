@@ -2,9 +2,15 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <limits>
+#include <string>
+#include <vector>
 
 #include "mojo/public/cpp/bindings/lib/bindings_serialization.h"
+#include "mojo/public/cpp/bindings/lib/chunked_buffer.h"
 #include "mojo/public/cpp/bindings/lib/fixed_buffer.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
@@ -94,6 +100,109 @@ TEST(FixedBufferTest, TooBig) {
 }
 #endif
 
+// Tests that ChunkedBuffer allocates zero-filled, 8-byte aligned memory, and
+// lays it out contiguously when it's leaked, even once it has grown.
+TEST(ChunkedBufferTest, GrowAndLeak) {
+  std::vector<Handle> handles;
+  internal::ChunkedBuffer buf(16, &handles);
+  EXPECT_TRUE(buf.encodes_inline());
+
+  char* a = static_cast<char*>(buf.Allocate(10));
+  EXPECT_TRUE(IsZero(a, 10));
+  EXPECT_EQ(0, reinterpret_cast<ptrdiff_t>(a) % 8);
+  memset(a, 'a', 10);
+  EXPECT_EQ(1u, buf.num_chunks());
+
+  // This doesn't fit in what's left of the first chunk.
+  char* b = static_cast<char*>(buf.Allocate(24));
+  EXPECT_TRUE(IsZero(b, 24));
+  EXPECT_EQ(0, reinterpret_cast<ptrdiff_t>(b) % 8);
+  memset(b, 'b', 24);
+  EXPECT_EQ(2u, buf.num_chunks());
+
+  // Nor does this, which is bigger than the doubled chunk size.
+  char* c = static_cast<char*>(buf.Allocate(100));
+  EXPECT_TRUE(IsZero(c, 100));
+  memset(c, 'c', 100);
+  EXPECT_EQ(3u, buf.num_chunks());
+  EXPECT_EQ(16u + 24u + 104u, buf.BytesUsed());
+
+  char* data = static_cast<char*>(buf.Leak());
+  ASSERT_TRUE(data);
+  EXPECT_EQ(std::string(10, 'a'), std::string(data, 10));
+  EXPECT_TRUE(IsZero(data + 10, 6));
+  EXPECT_EQ(std::string(24, 'b'), std::string(data + 16, 24));
+  EXPECT_EQ(std::string(100, 'c'), std::string(data + 40, 100));
+  free(data);
+
+  EXPECT_EQ(0u, buf.BytesUsed());
+  EXPECT_FALSE(buf.Leak());
+}
+
+// Tests that ChunkedBuffer::Leak() hands over the first chunk if everything
+// fit in it.
+TEST(ChunkedBufferTest, LeakWithoutCopying) {
+  std::vector<Handle> handles;
+  internal::ChunkedBuffer buf(64, &handles);
+
+  void* a = buf.Allocate(8);
+  buf.Allocate(56);
+  EXPECT_EQ(1u, buf.num_chunks());
+
+  void* data = buf.Leak();
+  EXPECT_EQ(a, data);
+  free(data);
+}
+
+// Tests that ChunkedBuffer uses a caller-provided first chunk, and copies out
+// of it on Leak().
+TEST(ChunkedBufferTest, CallerProvidedFirstChunk) {
+  std::vector<Handle> handles;
+  uint64_t first_chunk[4];
+  internal::ChunkedBuffer buf(first_chunk, sizeof(first_chunk), &handles);
+
+  char* a = static_cast<char*>(buf.Allocate(8));
+  EXPECT_EQ(reinterpret_cast<char*>(first_chunk), a);
+  a[0] = 'a';
+  char* b = static_cast<char*>(buf.Allocate(32));
+  EXPECT_EQ(2u, buf.num_chunks());
+  b[31] = 'b';
+
+  char* data = static_cast<char*>(buf.Leak());
+  EXPECT_NE(a, data);
+  EXPECT_EQ('a', data[0]);
+  EXPECT_EQ('b', data[8 + 31]);
+  free(data);
+}
+
+// Tests that ChunkedBuffer encodes pointers relative to the contiguous layout.
+TEST(ChunkedBufferTest, EncodePointer) {
+  std::vector<Handle> handles;
+  internal::ChunkedBuffer buf(16, &handles);
+
+  uint64_t* first = static_cast<uint64_t*>(buf.Allocate(16));
+  uint64_t* second = static_cast<uint64_t*>(buf.Allocate(8));
+  uint64_t* third = static_cast<uint64_t*>(buf.Allocate(32));
+  ASSERT_EQ(3u, buf.num_chunks());
+
+  buf.EncodePointer(second, &first[1]);
+  EXPECT_EQ(8u, first[1]);
+  buf.EncodePointer(third, &first[0]);
+  EXPECT_EQ(24u, first[0]);
+  buf.EncodePointer(third + 2, second);
+  EXPECT_EQ(24u, *second);
+  buf.EncodePointer(nullptr, &third[0]);
+  EXPECT_EQ(0u, third[0]);
+
+  // The encoded pointers should decode correctly once the buffer is
+  // contiguous.
+  char* data = static_cast<char*>(buf.Leak());
+  const uint64_t* contiguous_first = reinterpret_cast<uint64_t*>(data);
+  EXPECT_EQ(data + 16, internal::DecodePointerRaw(&contiguous_first[1]));
+  EXPECT_EQ(data + 24, internal::DecodePointerRaw(&contiguous_first[0]));
+  free(data);
+}
+
 }  // namespace
 }  // namespace test
 }  // namespace mojo
@@ -5,13 +5,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "mojo/public/cpp/bindings/lib/connector.h"
 #include "mojo/public/cpp/bindings/lib/message_builder.h"
 #include "mojo/public/cpp/bindings/tests/message_queue.h"
 #include "mojo/public/cpp/environment/logging.h"
 #include "mojo/public/cpp/system/macros.h"
+#include "mojo/public/cpp/system/wait.h"
 #include "mojo/public/cpp/utility/run_loop.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
@@ -176,6 +179,40 @@ TEST_F(ConnectorTest, Basic_TwoMessages) {
   }
 }
 
+// Received messages may borrow their data from the message pipe; check that
+// messages kept by the receiver outlive the connector (and its message pipe).
+TEST_F(ConnectorTest, ReceivedMessagesOutliveConnector) {
+  internal::Connector connector0(handle0_.Pass());
+  std::unique_ptr<internal::Connector> connector1(
+      new internal::Connector(handle1_.Pass()));
+
+  const char* kText[] = {"hello", "world"};
+
+  for (size_t i = 0; i < MOJO_ARRAYSIZE(kText); ++i) {
+    Message message;
+    AllocMessage(kText[i], &message);
+
+    connector0.Accept(&message);
+  }
+
+  MessageAccumulator accumulator;
+  connector1->set_incoming_receiver(&accumulator);
+
+  PumpMessages();
+  connector1.reset();
+
+  for (size_t i = 0; i < MOJO_ARRAYSIZE(kText); ++i) {
+    ASSERT_FALSE(accumulator.IsEmpty());
+
+    Message message_received;
+    accumulator.Pop(&message_received);
+
+    EXPECT_EQ(
+        std::string(kText[i]),
+        std::string(reinterpret_cast<const char*>(message_received.payload())));
+  }
+}
+
 TEST_F(ConnectorTest, Basic_TwoMessages_Synchronous) {
   internal::Connector connector0(handle0_.Pass());
   internal::Connector connector1(handle1_.Pass());
@@ -343,6 +380,123 @@ TEST_F(ConnectorTest, WaitForIncomingMessageWithDeletion) {
       std::string(reinterpret_cast<const char*>(message_received.payload())));
 }
 
+class PipeClosingMessageAccumulator : public MessageAccumulator {
+ public:
+  explicit PipeClosingMessageAccumulator(internal::Connector* connector)
+      : connector_(connector) {}
+
+  bool Accept(Message* message) override {
+    connector_->CloseMessagePipe();
+    return MessageAccumulator::Accept(message);
+  }
+
+ private:
+  internal::Connector* connector_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(PipeClosingMessageAccumulator);
+};
+
+// Received messages may borrow their data from the message pipe; check that a
+// message stays valid if its receiver closes the pipe while handling it.
+TEST_F(ConnectorTest, CloseMessagePipeDuringDispatch) {
+  internal::Connector connector0(handle0_.Pass());
+  internal::Connector connector1(handle1_.Pass());
+
+  const char* kText[] = {"hello", "world"};
+
+  for (size_t i = 0; i < MOJO_ARRAYSIZE(kText); ++i) {
+    Message message;
+    AllocMessage(kText[i], &message);
+
+    connector0.Accept(&message);
+  }
+
+  PipeClosingMessageAccumulator accumulator(&connector1);
+  connector1.set_incoming_receiver(&accumulator);
+
+  PumpMessages();
+
+  EXPECT_FALSE(connector1.is_valid());
+  EXPECT_FALSE(connector1.encountered_error());
+
+  // Only the first message was read before the pipe was closed.
+  ASSERT_FALSE(accumulator.IsEmpty());
+  Message message_received;
+  accumulator.Pop(&message_received);
+  EXPECT_EQ(
+      std::string(kText[0]),
+      std::string(reinterpret_cast<const char*>(message_received.payload())));
+  EXPECT_TRUE(accumulator.IsEmpty());
+}
+
+class PipePassingMessageAccumulator : public MessageAccumulator {
+ public:
+  explicit PipePassingMessageAccumulator(internal::Connector* connector)
+      : connector_(connector) {}
+
+  bool Accept(Message* message) override {
+    passed_pipe_ = connector_->PassMessagePipe();
+    return MessageAccumulator::Accept(message);
+  }
+
+  ScopedMessagePipeHandle PassPipe() { return passed_pipe_.Pass(); }
+
+ private:
+  internal::Connector* connector_;
+  ScopedMessagePipeHandle passed_pipe_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(PipePassingMessageAccumulator);
+};
+
+// Checks that if the receiver passes the pipe on while handling a message (as
+// |Binding::Unbind()| does), the messages after it can still be read from it.
+TEST_F(ConnectorTest, PassMessagePipeDuringDispatch) {
+  internal::Connector connector0(handle0_.Pass());
+  internal::Connector connector1(handle1_.Pass());
+
+  const char* kText[] = {"hello", "world", "again"};
+
+  for (size_t i = 0; i < MOJO_ARRAYSIZE(kText); ++i) {
+    Message message;
+    AllocMessage(kText[i], &message);
+
+    connector0.Accept(&message);
+  }
+
+  PipePassingMessageAccumulator accumulator(&connector1);
+  connector1.set_incoming_receiver(&accumulator);
+
+  PumpMessages();
+
+  EXPECT_FALSE(connector1.is_valid());
+  EXPECT_FALSE(connector1.encountered_error());
+
+  ASSERT_FALSE(accumulator.IsEmpty());
+  Message message_received;
+  accumulator.Pop(&message_received);
+  EXPECT_EQ(
+      std::string(kText[0]),
+      std::string(reinterpret_cast<const char*>(message_received.payload())));
+  EXPECT_TRUE(accumulator.IsEmpty());
+
+  internal::Connector connector2(accumulator.PassPipe());
+  MessageAccumulator accumulator2;
+  connector2.set_incoming_receiver(&accumulator2);
+
+  PumpMessages();
+
+  for (size_t i = 1; i < MOJO_ARRAYSIZE(kText); ++i) {
+    ASSERT_FALSE(accumulator2.IsEmpty());
+
+    accumulator2.Pop(&message_received);
+
+    EXPECT_EQ(
+        std::string(kText[i]),
+        std::string(reinterpret_cast<const char*>(message_received.payload())));
+  }
+  EXPECT_TRUE(accumulator2.IsEmpty());
+}
+
 class ReentrantMessageAccumulator : public MessageAccumulator {
  public:
   explicit ReentrantMessageAccumulator(internal::Connector* connector)
@@ -399,6 +553,89 @@ TEST_F(ConnectorTest, WaitForIncomingMessageWithReentrancy) {
   ASSERT_EQ(2, accumulator.number_of_calls());
 }
 
+// Checks that bursts of messages, which are read in batches, are delivered in
+// order, including messages that are too big to be batched and messages with
+// handles.
+TEST_F(ConnectorTest, ManyMessages) {
+  internal::Connector connector0(handle0_.Pass());
+  internal::Connector connector1(handle1_.Pass());
+
+  const size_t kNumMessages = 300;
+  const size_t kBigMessageIndex = 150;
+  const size_t kMessageWithHandleIndex = 200;
+  std::vector<std::string> texts;
+  for (size_t i = 0; i < kNumMessages; ++i) {
+    std::string text = std::to_string(i);
+    if (i == kBigMessageIndex)
+      text.append(100000, 'x');
+
+    Message message;
+    AllocMessage(text.c_str(), &message);
+    if (i == kMessageWithHandleIndex) {
+      MessagePipe pipe;
+      message.mutable_handles()->push_back(pipe.handle0.release());
+    }
+    connector0.Accept(&message);
+    texts.push_back(text);
+  }
+
+  MessageAccumulator accumulator;
+  connector1.set_incoming_receiver(&accumulator);
+  connector1.set_batch_reads(true);
+
+  PumpMessages();
+
+  for (size_t i = 0; i < kNumMessages; ++i) {
+    ASSERT_FALSE(accumulator.IsEmpty());
+
+    Message message_received;
+    accumulator.Pop(&message_received);
+
+    EXPECT_EQ(
+        texts[i],
+        std::string(reinterpret_cast<const char*>(message_received.payload())));
+    EXPECT_EQ(i == kMessageWithHandleIndex ? 1u : 0u,
+              message_received.handles()->size());
+  }
+  EXPECT_TRUE(accumulator.IsEmpty());
+  EXPECT_FALSE(connector1.encountered_error());
+}
+
+// Checks that the handles of messages that were read in a batch along with a
+// message whose dispatch deletes the connector are closed.
+TEST_F(ConnectorTest, DeletionDuringBatchClosesHandles) {
+  internal::Connector connector0(handle0_.Pass());
+  internal::Connector* connector1 = new internal::Connector(handle1_.Pass());
+
+  const char kText[] = "hello world";
+
+  Message message1;
+  AllocMessage(kText, &message1);
+  connector0.Accept(&message1);
+
+  MessagePipe pipe;
+  Message message2;
+  AllocMessage(kText, &message2);
+  message2.mutable_handles()->push_back(pipe.handle0.release());
+  connector0.Accept(&message2);
+
+  ConnectorDeletingMessageAccumulator accumulator(&connector1);
+  connector1->set_incoming_receiver(&accumulator);
+  connector1->set_batch_reads(true);
+
+  PumpMessages();
+
+  ASSERT_FALSE(connector1);
+  ASSERT_FALSE(accumulator.IsEmpty());
+  Message message_received;
+  accumulator.Pop(&message_received);
+  EXPECT_TRUE(accumulator.IsEmpty());
+
+  // The handle sent in the second message should have been closed.
+  EXPECT_EQ(MOJO_RESULT_OK, Wait(pipe.handle1.get(),
+                                 MOJO_HANDLE_SIGNAL_PEER_CLOSED, 0, nullptr));
+}
+
 // This message receiver just accepts messages, and responds (to another fixed
 // receiver)
 class NoTaskStarvationReplier : public MessageReceiver {
@@ -0,0 +1,281 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+
+#include "mojo/public/cpp/bindings/binding.h"
+#include "mojo/public/cpp/bindings/lib/fixed_buffer.h"
+#include "mojo/public/cpp/bindings/lib/validation_errors.h"
+#include "mojo/public/cpp/system/message_pipe.h"
+#include "mojo/public/cpp/system/wait.h"
+#include "mojo/public/cpp/utility/run_loop.h"
+#include "mojo/public/interfaces/bindings/tests/rect.mojom.h"
+#include "mojo/public/interfaces/bindings/tests/test_data_views.mojom.h"
+#include "mojo/public/interfaces/bindings/tests/test_structs.mojom.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace mojo {
+namespace test {
+namespace {
+
+DataViewInnerPtr MakeInner(const char* name, int32_t first_value) {
+  DataViewInnerPtr inner(DataViewInner::New());
+  inner->name = name;
+  inner->values = Array<int32_t>::New(2);
+  inner->values[0] = first_value;
+  inner->values[1] = first_value + 1;
+  return inner;
+}
+
+DataViewStructPtr MakeDataViewStruct() {
+  DataViewStructPtr output(DataViewStruct::New());
+  output->f_bool = true;
+  output->f_int32 = -42;
+  output->f_double = 1.5;
+  output->f_enum = DataViewEnum::SECOND;
+  output->f_string = "hello";
+  output->f_bytes = Array<uint8_t>::New(3);
+  output->f_bytes[0] = 1;
+  output->f_bytes[1] = 2;
+  output->f_bytes[2] = 3;
+  output->f_bools = Array<bool>::New(10);
+  output->f_bools[9] = true;
+  output->f_inner = MakeInner("inner", 100);
+  output->f_inners = Array<DataViewInnerPtr>::New(2);
+  output->f_inners[0] = MakeInner("a", 1);
+  output->f_inners[1] = MakeInner("b", 2);
+  output->f_map.insert("one", 1);
+  output->f_union = DataViewUnion::New();
+  output->f_union->set_f_string("union");
+  return output;
+}
+
+template <typename T>
+typename mojo::internal::WrapperTraits<T>::DataType Serialize(
+    T input,
+    mojo::internal::FixedBufferForTesting* buf) {
+  typename mojo::internal::WrapperTraits<T>::DataType data;
+  EXPECT_EQ(mojo::internal::ValidationError::NONE,
+            Serialize_(input.get(), buf, &data));
+  return data;
+}
+
+TEST(DataViewTest, Getters) {
+  DataViewStructPtr input = MakeDataViewStruct();
+  mojo::internal::FixedBufferForTesting buf(GetSerializedSize_(*input));
+  DataViewStructDataView view(Serialize(input.Pass(), &buf));
+
+  ASSERT_FALSE(view.is_null());
+  EXPECT_TRUE(view.f_bool());
+  EXPECT_EQ(-42, view.f_int32());
+  EXPECT_EQ(1.5, view.f_double());
+  EXPECT_EQ(DataViewEnum::SECOND, view.f_enum());
+
+  StringDataView f_string = view.f_string();
+  ASSERT_FALSE(f_string.is_null());
+  EXPECT_EQ("hello", std::string(f_string.storage(), f_string.size()));
+  EXPECT_TRUE(view.f_nullable_string().is_null());
+  EXPECT_EQ("", view.f_nullable_string().ToString());
+
+  ArrayDataView<uint8_t> f_bytes = view.f_bytes();
+  ASSERT_EQ(3u, f_bytes.size());
+  EXPECT_EQ(1u, f_bytes[0]);
+  EXPECT_EQ(3u, f_bytes.storage()[2]);
+
+  ArrayDataView<bool> f_bools = view.f_bools();
+  ASSERT_EQ(10u, f_bools.size());
+  EXPECT_FALSE(f_bools[8]);
+  EXPECT_TRUE(f_bools[9]);
+
+  DataViewInnerDataView f_inner = view.f_inner();
+  ASSERT_FALSE(f_inner.is_null());
+  EXPECT_EQ("inner", f_inner.name().ToString());
+  ASSERT_EQ(2u, f_inner.values().size());
+  EXPECT_EQ(101, f_inner.values()[1]);
+  EXPECT_TRUE(view.f_nullable_inner().is_null());
+}
+
+TEST(DataViewTest, ReadAndTake) {
+  DataViewStructPtr input = MakeDataViewStruct();
+  MessagePipe pipe;
+  input->f_pipe = pipe.handle0.Pass();
+  mojo::internal::FixedBufferForTesting buf(GetSerializedSize_(*input));
+  DataViewStructDataView view(Serialize(input.Pass(), &buf));
+
+  String f_string;
+  view.ReadFString(&f_string);
+  EXPECT_EQ("hello", f_string);
+
+  DataViewInnerPtr f_inner;
+  view.ReadFInner(&f_inner);
+  ASSERT_TRUE(f_inner);
+  EXPECT_TRUE(f_inner->Equals(*MakeInner("inner", 100)));
+
+  DataViewInnerPtr f_nullable_inner = MakeInner("stale", 0);
+  view.ReadFNullableInner(&f_nullable_inner);
+  EXPECT_FALSE(f_nullable_inner);
+
+  Array<DataViewInnerPtr> f_inners;
+  view.ReadFInners(&f_inners);
+  ASSERT_EQ(2u, f_inners.size());
+  EXPECT_EQ("b", f_inners[1]->name);
+
+  Map<String, int32_t> f_map;
+  view.ReadFMap(&f_map);
+  ASSERT_EQ(1u, f_map.size());
+  EXPECT_EQ(1, f_map.at("one"));
+
+  DataViewUnionPtr f_union;
+  view.ReadFUnion(&f_union);
+  ASSERT_TRUE(f_union);
+  EXPECT_EQ("union", f_union->get_f_string());
+
+  ScopedMessagePipeHandle f_pipe = view.TakeFPipe();
+  EXPECT_TRUE(f_pipe.is_valid());
+  // The handle may only be taken once.
+  EXPECT_FALSE(view.TakeFPipe().is_valid());
+}
+
+TEST(DataViewTest, Versioning) {
+  MultiVersionStructV1Ptr input(MultiVersionStructV1::New());
+  input->f_int32 = 123;
+  input->f_rect = Rect::New();
+  input->f_rect->x = 5;
+  mojo::internal::FixedBufferForTesting buf(GetSerializedSize_(*input));
+  MultiVersionStructDataView view(
+      reinterpret_cast<internal::MultiVersionStruct_Data*>(
+          Serialize(input.Pass(), &buf)));
+
+  EXPECT_EQ(123, view.f_int32());
+  ASSERT_FALSE(view.f_rect().is_null());
+  EXPECT_EQ(5, view.f_rect().x());
+
+  // Fields from later versions read as their defaults.
+  EXPECT_TRUE(view.f_string().is_null());
+  String f_string("not null");
+  view.ReadFString(&f_string);
+  EXPECT_EQ("not null", f_string);
+  EXPECT_TRUE(view.f_array().is_null());
+  EXPECT_FALSE(view.TakeFMessagePipe().is_valid());
+  EXPECT_FALSE(view.f_bool());
+  EXPECT_EQ(0, view.f_int16());
+}
+
+// An implementation that inspects its requests through data views.
+class DataViewServiceViewImpl : public DataViewService {
+ public:
+  explicit DataViewServiceViewImpl(InterfaceRequest<DataViewService> request)
+      : binding_(this, request.Pass()) {}
+  ~DataViewServiceViewImpl() override {}
+
+  const std::string& last_message() const { return last_message_; }
+  size_t last_payload_size() const { return last_payload_size_; }
+
+  // |DataViewService| implementation:
+  void Inspect(DataViewStructPtr request,
+               ScopedMessagePipeHandle pipe,
+               const InspectCallback& callback) override {
+    ADD_FAILURE() << "Should have been called with a data view";
+  }
+  void InspectWithDataView(DataViewService_Inspect_ParamsDataView params,
+                           const InspectCallback& callback) override {
+    // Leave |pipe| in the message, which should then close it.
+    callback.Run(params.request().f_inner().name().ToString());
+  }
+  void Log(const String& message, Array<uint8_t> payload) override {
+    ADD_FAILURE() << "Should have been called with a data view";
+  }
+  void LogWithDataView(DataViewService_Log_ParamsDataView params) override {
+    last_message_ = params.message().ToString();
+    last_payload_size_ = params.payload().size();
+  }
+  void Ping(const PingCallback& callback) override { callback.Run(); }
+
+ private:
+  Binding<DataViewService> binding_;
+  std::string last_message_;
+  size_t last_payload_size_ = 0u;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(DataViewServiceViewImpl);
+};
+
+// An implementation that doesn't override the data view methods, so gets
+// deserialized parameters as usual.
+class DataViewServiceImpl : public DataViewService {
+ public:
+  explicit DataViewServiceImpl(InterfaceRequest<DataViewService> request)
+      : binding_(this, request.Pass()) {}
+  ~DataViewServiceImpl() override {}
+
+  const std::string& last_message() const { return last_message_; }
+
+  // |DataViewService| implementation:
+  void Inspect(DataViewStructPtr request,
+               ScopedMessagePipeHandle pipe,
+               const InspectCallback& callback) override {
+    EXPECT_TRUE(pipe.is_valid());
+    callback.Run(request->f_inner->name);
+  }
+  void Log(const String& message, Array<uint8_t> payload) override {
+    last_message_ = message;
+  }
+  void Ping(const PingCallback& callback) override { callback.Run(); }
+
+ private:
+  Binding<DataViewService> binding_;
+  std::string last_message_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(DataViewServiceImpl);
+};
+
+class DataViewServiceTest : public testing::Test {
+ public:
+  DataViewServiceTest() {}
+  ~DataViewServiceTest() override { loop_.RunUntilIdle(); }
+
+  void PumpMessages() { loop_.RunUntilIdle(); }
+
+ private:
+  RunLoop loop_;
+
+  MOJO_DISALLOW_COPY_AND_ASSIGN(DataViewServiceTest);
+};
+
+TEST_F(DataViewServiceTest, StubPassesDataViews) {
+  DataViewServicePtr service;
+  DataViewServiceViewImpl impl(GetProxy(&service));
+
+  MessagePipe pipe;
+  std::string name;
+  service->Inspect(MakeDataViewStruct(), pipe.handle0.Pass(),
+                   [&name](const String& result) { name = result; });
+  service->Log("message", Array<uint8_t>::New(7));
+  PumpMessages();
+
+  EXPECT_EQ("inner", name);
+  EXPECT_EQ("message", impl.last_message());
+  EXPECT_EQ(7u, impl.last_payload_size());
+  // The handle that the implementation didn't take should have been closed.
+  EXPECT_EQ(MOJO_RESULT_OK, Wait(pipe.handle1.get(),
+                                 MOJO_HANDLE_SIGNAL_PEER_CLOSED, 0, nullptr));
+}
+
+TEST_F(DataViewServiceTest, DefaultDataViewMethods) {
+  DataViewServicePtr service;
+  DataViewServiceImpl impl(GetProxy(&service));
+
+  MessagePipe pipe;
+  std::string name;
+  service->Inspect(MakeDataViewStruct(), pipe.handle0.Pass(),
+                   [&name](const String& result) { name = result; });
+  service->Log("message", Array<uint8_t>::New(7));
+  PumpMessages();
+
+  EXPECT_EQ("inner", name);
+  EXPECT_EQ("message", impl.last_message());
+}
+
+}  // namespace
+}  // namespace test
+}  // namespace mojo
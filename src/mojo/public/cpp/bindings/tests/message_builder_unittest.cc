@@ -71,6 +71,49 @@ TEST(MessageBuilderTest, ResponseMessageBuilder) {
   EXPECT_EQ(sizeof(internal::MessageHeaderWithRequestID), msg_hdr->num_bytes);
 }
 
+TEST(MessageBuilderTest, ChunkedMessageBuilder) {
+  internal::ChunkedMessageBuilder b(123u);
+  // Outgrow the inline chunk.
+  const size_t kMoreSize = internal::ChunkedMessageBuilder::kInlineChunkSize;
+  char* payload = static_cast<char*>(b.buffer()->Allocate(8));
+  payload[0] = 'x';
+  char* more = static_cast<char*>(b.buffer()->Allocate(kMoreSize));
+  more[kMoreSize - 1] = 'y';
+  Message* message = b.Finish();
+
+  EXPECT_EQ(8u + kMoreSize, message->payload_num_bytes());
+  EXPECT_EQ(8u + kMoreSize + sizeof(internal::MessageHeader),
+            message->data_num_bytes());
+  EXPECT_EQ('x', message->payload()[0]);
+  EXPECT_EQ('y', message->payload()[8 + kMoreSize - 1]);
+
+  const auto* msg_hdr =
+      reinterpret_cast<const internal::MessageHeader*>(message->data());
+  EXPECT_EQ(123u, msg_hdr->name);
+  EXPECT_EQ(0u, msg_hdr->flags);
+  EXPECT_EQ(0u, msg_hdr->version);
+  EXPECT_EQ(sizeof(internal::MessageHeader), msg_hdr->num_bytes);
+}
+
+TEST(MessageBuilderTest, ChunkedMessageBuilderWithRequestID) {
+  internal::ChunkedMessageBuilder b(123u, internal::kMessageIsResponse, 456u);
+  b.buffer()->Allocate(8);
+  Message* message = b.Finish();
+
+  EXPECT_EQ(8u, message->payload_num_bytes());
+  EXPECT_EQ(8u + sizeof(internal::MessageHeaderWithRequestID),
+            message->data_num_bytes());
+
+  const auto* msg_hdr =
+      reinterpret_cast<const internal::MessageHeaderWithRequestID*>(
+          message->data());
+  EXPECT_EQ(123u, msg_hdr->name);
+  EXPECT_EQ(internal::kMessageIsResponse, msg_hdr->flags);
+  EXPECT_EQ(1u, msg_hdr->version);
+  EXPECT_EQ(456ul, msg_hdr->request_id);
+  EXPECT_EQ(sizeof(internal::MessageHeaderWithRequestID), msg_hdr->num_bytes);
+}
+
 }  // namespace
 }  // namespace test
 }  // namespace mojo
@@ -2,13 +2,17 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <stdlib.h>
 #include <string.h>
 #include <type_traits>
 
+#include "mojo/public/cpp/bindings/lib/bounds_checker.h"
+#include "mojo/public/cpp/bindings/lib/chunked_buffer.h"
 #include "mojo/public/cpp/bindings/lib/fixed_buffer.h"
 #include "mojo/public/cpp/bindings/lib/validation_errors.h"
 #include "mojo/public/cpp/system/message_pipe.h"
 #include "mojo/public/interfaces/bindings/tests/test_structs.mojom.h"
+#include "mojo/public/interfaces/bindings/tests/test_unions.mojom.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
 namespace mojo {
@@ -51,6 +55,121 @@ MultiVersionStructPtr MakeMultiVersionStruct() {
   return output;
 }
 
+StructOfStructsPtr MakeStructOfStructs() {
+  StructOfStructsPtr output(StructOfStructs::New());
+  output->nr = NamedRegion::New();
+  output->nr->name = "region";
+  output->nr->rects = Array<RectPtr>::New(2);
+  output->nr->rects[0] = MakeRect();
+  output->nr->rects[1] = MakeRect(2);
+  output->a_nr = Array<NamedRegionPtr>::New(1);
+  output->a_nr[0] = NamedRegion::New();
+  output->a_rp = Array<RectPairPtr>::New(1);
+  output->a_rp[0] = RectPair::New();
+  output->a_rp[0]->second = MakeRect(3);
+  output->m_ndfv.mark_non_null();
+  for (int64_t i = 0; i < 2; ++i) {
+    HandleStructPtr handle_struct(HandleStruct::New());
+    MessagePipe pipe;
+    handle_struct->h = pipe.handle0.Pass();
+    handle_struct->array_h = Array<ScopedMessagePipeHandle>::New(1);
+    handle_struct->array_h[0] = pipe.handle1.Pass();
+    output->m_hs.insert(i, handle_struct.Pass());
+  }
+  return output;
+}
+
+// Returns an interface handle (whose other end is closed).
+InterfaceHandle<SmallCache> MakeSmallCacheHandle() {
+  MessagePipe pipe;
+  return InterfaceHandle<SmallCache>(pipe.handle0.Pass(), 0u);
+}
+
+HandleUnionPtr MakeHandleUnionWithHandle() {
+  MessagePipe pipe;
+  HandleUnionPtr handle_union(HandleUnion::New());
+  handle_union->set_f_handle(ScopedHandle::From(pipe.handle0.Pass()));
+  return handle_union;
+}
+
+HandleUnionPtr MakeHandleUnionWithSmallCache() {
+  HandleUnionPtr handle_union(HandleUnion::New());
+  handle_union->set_f_small_cache(MakeSmallCacheHandle());
+  return handle_union;
+}
+
+StructOfUnionsAndInterfacesPtr MakeStructOfUnionsAndInterfaces() {
+  StructOfUnionsAndInterfacesPtr output(StructOfUnionsAndInterfaces::New());
+  PodUnionPtr pod_union(PodUnion::New());
+  pod_union->set_f_int32(7);
+  output->object_union = ObjectUnion::New();
+  output->object_union->set_f_pod_union(pod_union.Pass());
+  output->handle_union = MakeHandleUnionWithSmallCache();
+  MessagePipe pipe;
+  output->nullable_handle_union = HandleUnion::New();
+  output->nullable_handle_union->set_f_message_pipe(pipe.handle0.Pass());
+  auto a_hu = Array<HandleUnionPtr>::New(1);
+  a_hu[0] = MakeHandleUnionWithHandle();
+  output->union_of_unions = UnionOfUnions::New();
+  output->union_of_unions->set_a_hu(a_hu.Pass());
+  output->handle_unions = Array<HandleUnionPtr>::New(2);
+  output->handle_unions[0] = MakeHandleUnionWithHandle();
+  output->handle_unions[1] = MakeHandleUnionWithSmallCache();
+  output->caches = Array<InterfaceHandle<SmallCache>>::New(2);
+  output->cache_requests = Array<InterfaceRequest<SmallCache>>::New(2);
+  for (size_t i = 0; i < 2; ++i) {
+    output->caches[i] = MakeSmallCacheHandle();
+    SmallCachePtr cache;
+    output->cache_requests[i] = GetProxy(&cache);
+  }
+  return output;
+}
+
+// Serializes the result of |make_input()| in a single pass into a
+// ChunkedBuffer (which encodes pointers and handles as it goes, and which has
+// to grow), and checks that this gives the same result as serializing another
+// result of |make_input()| into a FixedBuffer and then encoding. (Since
+// serializing takes the input's handles, each serialization needs its own
+// input.) Returns the (encoded) single-pass result, which must be freed with
+// |free()|, putting its size in |*num_bytes| and its handles in |*handles|.
+template <typename T>
+typename mojo::internal::WrapperTraits<T>::DataType SerializeInSinglePass(
+    T (*make_input)(),
+    size_t* num_bytes,
+    std::vector<Handle>* handles) {
+  typedef typename mojo::internal::WrapperTraits<T>::DataType DataType;
+
+  T input = make_input();
+  mojo::internal::FixedBufferForTesting fixed_buf(GetSerializedSize_(*input));
+  DataType fixed_data;
+  EXPECT_EQ(mojo::internal::ValidationError::NONE,
+            Serialize_(input.get(), &fixed_buf, &fixed_data));
+  // |GetSerializedSize_()| overestimates for unions inlined in structs, so
+  // compare against what was actually used.
+  size_t size = fixed_buf.BytesUsed();
+  std::vector<Handle> fixed_handles;
+  fixed_data->EncodePointersAndHandles(&fixed_handles);
+
+  mojo::internal::ChunkedBuffer chunked_buf(8, handles);
+  T single_pass_input = make_input();
+  DataType data;
+  EXPECT_EQ(mojo::internal::ValidationError::NONE,
+            Serialize_(single_pass_input.get(), &chunked_buf, &data));
+  EXPECT_LT(1u, chunked_buf.num_chunks());
+
+  size_t single_pass_size = chunked_buf.BytesUsed();
+  EXPECT_EQ(size, single_pass_size);
+  void* single_pass_data = chunked_buf.Leak();
+  if (single_pass_size == size)
+    EXPECT_EQ(0, memcmp(fixed_data, single_pass_data, size));
+  EXPECT_EQ(fixed_handles.size(), handles->size());
+
+  for (Handle handle : fixed_handles)
+    CloseRaw(handle);
+  *num_bytes = single_pass_size;
+  return static_cast<DataType>(single_pass_data);
+}
+
 template <typename U, typename T>
 U SerializeAndDeserialize(T input) {
   typedef typename mojo::internal::WrapperTraits<T>::DataType InputDataType;
@@ -277,6 +396,67 @@ TEST(StructTest, Serialization_InterfaceRequest) {
   EXPECT_TRUE(iface_req_struct.req.is_pending());
 }
 
+// Tests that serializing in a single pass into a ChunkedBuffer gives the same
+// result as serializing into a FixedBuffer and then encoding.
+TEST(StructTest, Serialization_SinglePass) {
+  size_t num_bytes = 0u;
+  std::vector<Handle> handles;
+  internal::StructOfStructs_Data* data =
+      SerializeInSinglePass(&MakeStructOfStructs, &num_bytes, &handles);
+  EXPECT_EQ(4u, handles.size());
+
+  // The single-pass result should decode and deserialize as usual.
+  data->DecodePointersAndHandles(&handles);
+  StructOfStructsPtr output(StructOfStructs::New());
+  Deserialize_(data, output.get());
+  EXPECT_EQ("region", output->nr->name);
+  CheckRect(*output->nr->rects[1], 2);
+  CheckRect(*output->a_rp[0]->second, 3);
+  ASSERT_EQ(2u, output->m_hs.size());
+  EXPECT_TRUE(output->m_hs.at(1)->h.is_valid());
+  EXPECT_TRUE(output->m_hs.at(1)->array_h[0].is_valid());
+  free(data);
+}
+
+// Like |Serialization_SinglePass|, but for unions (including nested ones, and
+// ones holding handles and interfaces) and arrays of interfaces and interface
+// requests, which are encoded differently.
+TEST(StructTest, Serialization_SinglePass_UnionsAndInterfaces) {
+  size_t num_bytes = 0u;
+  std::vector<Handle> handles;
+  internal::StructOfUnionsAndInterfaces_Data* data = SerializeInSinglePass(
+      &MakeStructOfUnionsAndInterfaces, &num_bytes, &handles);
+  EXPECT_EQ(9u, handles.size());
+
+  // Every handle should have been encoded (so validation claims each once).
+  mojo::internal::BoundsChecker bounds_checker(
+      data, static_cast<uint32_t>(num_bytes), handles.size());
+  EXPECT_EQ(mojo::internal::ValidationError::NONE,
+            internal::StructOfUnionsAndInterfaces_Data::Validate(
+                data, &bounds_checker, nullptr));
+
+  data->DecodePointersAndHandles(&handles);
+  StructOfUnionsAndInterfacesPtr output(StructOfUnionsAndInterfaces::New());
+  Deserialize_(data, output.get());
+  ASSERT_TRUE(output->object_union->is_f_pod_union());
+  EXPECT_EQ(7, output->object_union->get_f_pod_union()->get_f_int32());
+  ASSERT_TRUE(output->handle_union->is_f_small_cache());
+  EXPECT_TRUE(output->handle_union->get_f_small_cache().is_valid());
+  ASSERT_TRUE(output->nullable_handle_union->is_f_message_pipe());
+  EXPECT_TRUE(output->nullable_handle_union->get_f_message_pipe().is_valid());
+  ASSERT_TRUE(output->union_of_unions->is_a_hu());
+  const Array<HandleUnionPtr>& a_hu = output->union_of_unions->get_a_hu();
+  ASSERT_EQ(1u, a_hu.size());
+  EXPECT_TRUE(a_hu[0]->get_f_handle().is_valid());
+  ASSERT_EQ(2u, output->handle_unions.size());
+  EXPECT_TRUE(output->handle_unions[1]->get_f_small_cache().is_valid());
+  ASSERT_EQ(2u, output->caches.size());
+  EXPECT_TRUE(output->caches[1].is_valid());
+  ASSERT_EQ(2u, output->cache_requests.size());
+  EXPECT_TRUE(output->cache_requests[1].is_pending());
+  free(data);
+}
+
 // Tests deserializing structs as a newer version.
 TEST(StructTest, Versioning_OldToNew) {
   {
@@ -21,6 +21,7 @@
 #include "mojo/public/cpp/system/message_pipe.h"
 #include "mojo/public/cpp/test_support/test_support.h"
 #include "mojo/public/cpp/utility/run_loop.h"
+#include "mojo/public/interfaces/bindings/tests/test_fused_validation.mojom.h"
 #include "mojo/public/interfaces/bindings/tests/validation_test_interfaces.mojom.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
@@ -141,6 +142,16 @@ std::string GetPath(const std::string& root, const std::string& suffix) {
          suffix;
 }
 
+// |message| should be a newly created object.
+void InitMessage(const std::vector<uint8_t>& data,
+                 size_t num_handles,
+                 Message* message) {
+  message->AllocUninitializedData(static_cast<uint32_t>(data.size()));
+  if (!data.empty())
+    memcpy(message->mutable_data(), &data[0], data.size());
+  message->mutable_handles()->resize(num_handles);
+}
+
 // |message| should be a newly created object.
 bool ReadTestCase(const std::string& test,
                   Message* message,
@@ -152,14 +163,26 @@ bool ReadTestCase(const std::string& test,
     return false;
   }
 
-  message->AllocUninitializedData(static_cast<uint32_t>(data.size()));
-  if (!data.empty())
-    memcpy(message->mutable_data(), &data[0], data.size());
-  message->mutable_handles()->resize(num_handles);
-
+  InitMessage(data, num_handles, message);
   return true;
 }
 
+// Runs |validators| on |message| and, if they pass, passes it to |receiver|.
+// Returns the first error reported by either.
+ValidationError ValidateMessage(const MessageValidatorList& validators,
+                                MessageReceiver* receiver,
+                                Message* message) {
+  auto result = RunValidatorsOnMessage(validators, message, nullptr);
+  if (result == ValidationError::NONE) {
+    // Receivers that validate messages as they deserialize them report
+    // errors themselves.
+    mojo::internal::ValidationErrorObserverForTesting observer;
+    ignore_result(receiver->Accept(message));
+    result = observer.last_error();
+  }
+  return result;
+}
+
 void RunValidationTests(const std::string& prefix,
                         const MessageValidatorList& validators,
                         MessageReceiver* test_message_receiver) {
@@ -173,18 +196,58 @@ void RunValidationTests(const std::string& prefix,
     ASSERT_TRUE(ReadTestCase(tests[i], &message, &expected));
 
     std::string actual;
-    auto result = RunValidatorsOnMessage(validators, &message, nullptr);
-    if (result == ValidationError::NONE) {
-      ignore_result(test_message_receiver->Accept(&message));
+    auto result = ValidateMessage(validators, test_message_receiver, &message);
+    if (result == ValidationError::NONE)
       actual = "PASS";
-    } else {
+    else
       actual = ValidationErrorToString(result);
-    }
 
     EXPECT_EQ(expected, actual) << "failed test: " << tests[i];
   }
 }
 
+// Checks that |validators| followed by |receiver| and |fused_validators|
+// followed by |fused_receiver| report the same error for each test input
+// matching |prefix|, and for copies of it with single words overwritten (to
+// reach inputs that the test data doesn't).
+void RunAgreementTests(const std::string& prefix,
+                       const MessageValidatorList& validators,
+                       MessageReceiver* receiver,
+                       const MessageValidatorList& fused_validators,
+                       MessageReceiver* fused_receiver) {
+  std::vector<std::string> names =
+      EnumerateSourceRootRelativeDirectory(GetPath("", ""));
+  std::vector<std::string> tests = GetMatchingTests(names, prefix);
+  const uint32_t kWordValues[] = {0u, 8u, 16u, 0xffffffffu};
+
+  for (size_t i = 0; i < tests.size(); ++i) {
+    std::vector<uint8_t> data;
+    size_t num_handles;
+    ASSERT_TRUE(
+        ReadAndParseDataFile(GetPath(tests[i], ".data"), &data, &num_handles));
+
+    std::vector<std::vector<uint8_t>> inputs(1, data);
+    for (size_t offset = 0; offset + 4 <= data.size(); offset += 4) {
+      for (uint32_t value : kWordValues) {
+        inputs.push_back(data);
+        memcpy(&inputs.back()[offset], &value, sizeof(value));
+      }
+    }
+
+    for (size_t j = 0; j < inputs.size(); ++j) {
+      Message message;
+      InitMessage(inputs[j], num_handles, &message);
+      Message fused_message;
+      InitMessage(inputs[j], num_handles, &fused_message);
+
+      EXPECT_EQ(
+          ValidateMessage(validators, receiver, &message),
+          ValidateMessage(fused_validators, fused_receiver, &fused_message))
+          << "failed test: " << tests[i] << ", input " << j;
+    }
+  }
+}
+
 class DummyMessageReceiver : public MessageReceiver {
  public:
   bool Accept(Message* message) override {
@@ -192,6 +255,71 @@ class DummyMessageReceiver : public MessageReceiver {
   }
 };
 
+// Passes messages to the stub of a [CppFusedValidation=true] interface, which
+// validates them as it deserializes them.
+template <typename Interface>
+class FusedValidationMessageReceiver : public MessageReceiver {
+ public:
+  explicit FusedValidationMessageReceiver(Interface* impl) {
+    stub_.set_sink(impl);
+  }
+
+  bool Accept(Message* message) override {
+    if (!message->has_flag(mojo::internal::kMessageExpectsResponse))
+      return stub_.Accept(message);
+
+    MessageReceiverWithStatus* responder = new DummyResponder;
+    if (!stub_.AcceptWithResponder(message, responder)) {
+      delete responder;
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  class DummyResponder : public MessageReceiverWithStatus {
+   public:
+    bool Accept(Message* message) override { return true; }
+    bool IsValid() override { return false; }
+  };
+
+  typename Interface::Stub_ stub_;
+};
+
+// Implementations whose methods do nothing (except echo |Method0()|'s
+// parameter, to test responses).
+class FusedBoundsCheckTestInterfaceImpl : public FusedBoundsCheckTestInterface {
+ public:
+  void Method0(uint8_t param0, const Method0Callback& callback) override {
+    callback.Run(param0);
+  }
+  void Method1(uint8_t param0) override {}
+};
+
+class FusedConformanceTestInterfaceImpl
+    : public FusedConformanceTestInterface {
+ public:
+  void Method0(float param0) override {}
+  void Method1(StructAPtr param0) override {}
+  void Method2(StructBPtr param0, StructAPtr param1) override {}
+  void Method3(Array<bool> param0) override {}
+  void Method4(StructCPtr param0, Array<uint8_t> param1) override {}
+  void Method5(StructEPtr param0,
+               ScopedDataPipeProducerHandle param1) override {}
+  void Method6(Array<Array<uint8_t>> param0) override {}
+  void Method7(StructFPtr param0, Array<Array<uint8_t>> param1) override {}
+  void Method8(Array<Array<String>> param0) override {}
+  void Method9(Array<Array<ScopedHandle>> param0) override {}
+  void Method10(Map<String, uint8_t> param0) override {}
+  void Method11(StructGPtr param0) override {}
+  void Method12(float param0, const Method12Callback& callback) override {}
+  void Method13(InterfaceHandle<InterfaceA> param0,
+                uint32_t param1,
+                InterfaceHandle<InterfaceA> param2) override {}
+  void Method14(UnionAPtr param0) override {}
+  void Method15(StructHPtr param0) override {}
+};
+
 class ValidationIntegrationTest : public testing::Test {
  public:
   ValidationIntegrationTest() : test_message_receiver_(nullptr) {}
@@ -397,6 +525,90 @@ TEST(ValidationTest, BoundsCheck) {
   RunValidationTests("boundscheck_", validators, &dummy_receiver);
 }
 
+// These tests are the same as the Conformance and BoundsCheck tests, but for
+// interfaces whose stubs validate requests as they deserialize them.
+TEST(ValidationTest, FusedConformance) {
+  FusedConformanceTestInterfaceImpl impl;
+  FusedValidationMessageReceiver<FusedConformanceTestInterface> receiver(
+      &impl);
+  MessageValidatorList validators;
+  validators.push_back(std::unique_ptr<MessageValidator>(
+      new mojo::internal::MessageHeaderValidator));
+  validators.push_back(std::unique_ptr<MessageValidator>(
+      new FusedConformanceTestInterface::RequestValidator_));
+
+  RunValidationTests("conformance_", validators, &receiver);
+}
+
+TEST(ValidationTest, FusedBoundsCheck) {
+  FusedBoundsCheckTestInterfaceImpl impl;
+  FusedValidationMessageReceiver<FusedBoundsCheckTestInterface> receiver(
+      &impl);
+  MessageValidatorList validators;
+  validators.push_back(std::unique_ptr<MessageValidator>(
+      new mojo::internal::MessageHeaderValidator));
+  validators.push_back(std::unique_ptr<MessageValidator>(
+      new FusedBoundsCheckTestInterface::RequestValidator_));
+
+  RunValidationTests("boundscheck_", validators, &receiver);
+}
+
+// Runs the Conformance and BoundsCheck inputs through both kinds of stub.
+TEST(ValidationTest, FusedAndStandaloneAgree) {
+  DummyMessageReceiver dummy_receiver;
+  {
+    MessageValidatorList validators;
+    validators.push_back(std::unique_ptr<MessageValidator>(
+        new mojo::internal::MessageHeaderValidator));
+    validators.push_back(std::unique_ptr<MessageValidator>(
+        new ConformanceTestInterface::RequestValidator_));
+    FusedConformanceTestInterfaceImpl impl;
+    FusedValidationMessageReceiver<FusedConformanceTestInterface> receiver(
+        &impl);
+    MessageValidatorList fused_validators;
+    fused_validators.push_back(std::unique_ptr<MessageValidator>(
+        new mojo::internal::MessageHeaderValidator));
+    fused_validators.push_back(std::unique_ptr<MessageValidator>(
+        new FusedConformanceTestInterface::RequestValidator_));
+
+    RunAgreementTests("conformance_", validators, &dummy_receiver,
+                      fused_validators, &receiver);
+  }
+  {
+    MessageValidatorList validators;
+    validators.push_back(std::unique_ptr<MessageValidator>(
+        new mojo::internal::MessageHeaderValidator));
+    validators.push_back(std::unique_ptr<MessageValidator>(
+        new BoundsCheckTestInterface::RequestValidator_));
+    FusedBoundsCheckTestInterfaceImpl impl;
+    FusedValidationMessageReceiver<FusedBoundsCheckTestInterface> receiver(
+        &impl);
+    MessageValidatorList fused_validators;
+    fused_validators.push_back(std::unique_ptr<MessageValidator>(
+        new mojo::internal::MessageHeaderValidator));
+    fused_validators.push_back(std::unique_ptr<MessageValidator>(
+        new FusedBoundsCheckTestInterface::RequestValidator_));
+
+    RunAgreementTests("boundscheck_", validators, &dummy_receiver,
+                      fused_validators, &receiver);
+  }
+}
+
+// Tests that valid requests and responses make it through stubs and proxies that
+// validate them as they deserialize them.
+TEST(ValidationTest, FusedRoundTrip) {
+  RunLoop loop;
+  FusedBoundsCheckTestInterfaceImpl impl;
+  FusedBoundsCheckTestInterfacePtr interface_ptr;
+  Binding<FusedBoundsCheckTestInterface> binding(&impl,
+                                                 GetProxy(&interface_ptr));
+
+  uint8_t result = 0u;
+  interface_ptr->Method0(42u, [&result](uint8_t param0) { result = param0; });
+  loop.RunUntilIdle();
+  EXPECT_EQ(42u, result);
+}
+
 // This test is similar to the Conformance test but for responses.
 TEST(ValidationTest, ResponseConformance) {
   DummyMessageReceiver dummy_receiver;
@@ -101,6 +101,29 @@ inline MojoResult EndWriteDataRaw(DataPipeProducerHandle data_pipe_producer,
   return MojoEndWriteData(data_pipe_producer.value(), num_bytes_written);
 }
 
+// Begins a two-phase write to a data pipe, exposing up to two spans. See
+// |MojoBeginWriteDataSpans()| for complete documentation.
+inline MojoResult BeginWriteDataSpansRaw(
+    DataPipeProducerHandle data_pipe_producer,
+    void* buffers[2],
+    uint32_t buffers_num_bytes[2],
+    MojoWriteDataFlags flags) {
+  return MojoBeginWriteDataSpans(data_pipe_producer.value(), buffers,
+                                 buffers_num_bytes, flags);
+}
+
+// Writes to a data pipe from multiple buffers. See |MojoWriteDataV()| for
+// complete documentation.
+inline MojoResult WriteDataVRaw(DataPipeProducerHandle data_pipe_producer,
+                                const void* const* buffers,
+                                const uint32_t* buffers_num_bytes,
+                                uint32_t num_buffers,
+                                uint32_t* num_bytes_written,
+                                MojoWriteDataFlags flags) {
+  return MojoWriteDataV(data_pipe_producer.value(), buffers, buffers_num_bytes,
+                        num_buffers, num_bytes_written, flags);
+}
+
 // Sets data pipe consumer options to their defaults. See
 // |MojoGetDataPipeConsumerOptions()| for complete documentation.
 inline MojoResult SetDataPipeConsumerOptionsToDefault(
@@ -161,6 +184,29 @@ inline MojoResult EndReadDataRaw(DataPipeConsumerHandle data_pipe_consumer,
   return MojoEndReadData(data_pipe_consumer.value(), num_bytes_read);
 }
 
+// Begins a two-phase read from a data pipe, exposing up to two spans. See
+// |MojoBeginReadDataSpans()| for complete documentation.
+inline MojoResult BeginReadDataSpansRaw(
+    DataPipeConsumerHandle data_pipe_consumer,
+    const void* buffers[2],
+    uint32_t buffers_num_bytes[2],
+    MojoReadDataFlags flags) {
+  return MojoBeginReadDataSpans(data_pipe_consumer.value(), buffers,
+                                buffers_num_bytes, flags);
+}
+
+// Reads from a data pipe into multiple buffers. See |MojoReadDataV()| for
+// complete documentation.
+inline MojoResult ReadDataVRaw(DataPipeConsumerHandle data_pipe_consumer,
+                               void* const* buffers,
+                               const uint32_t* buffers_num_bytes,
+                               uint32_t num_buffers,
+                               uint32_t* num_bytes_read,
+                               MojoReadDataFlags flags) {
+  return MojoReadDataV(data_pipe_consumer.value(), buffers, buffers_num_bytes,
+                       num_buffers, num_bytes_read, flags);
+}
+
 // A wrapper class that automatically creates a data pipe and owns both handles.
 // TODO(vtl): Make an even more friendly version? (Maybe templatized for a
 // particular type instead of some "element"? Maybe functions that take
@@ -87,6 +87,52 @@ inline MojoResult ReadMessageRaw(MessagePipeHandle message_pipe,
       message_pipe.value(), bytes, num_bytes, handles, num_handles, flags);
 }
 
+// Begins a two-phase read from a message pipe. See |MojoBeginReadMessage()| for
+// complete documentation.
+inline MojoResult BeginReadMessageRaw(MessagePipeHandle message_pipe,
+                                      void** buffer,
+                                      uint32_t* buffer_num_bytes,
+                                      MojoHandle* handles,
+                                      uint32_t* num_handles,
+                                      MojoReadMessageFlags flags) {
+  return MojoBeginReadMessage(message_pipe.value(), buffer, buffer_num_bytes,
+                              handles, num_handles, flags);
+}
+
+// Completes a two-phase read from a message pipe. See |MojoEndReadMessage()|
+// for complete documentation.
+inline MojoResult EndReadMessageRaw(MessagePipeHandle message_pipe) {
+  return MojoEndReadMessage(message_pipe.value());
+}
+
+// Writes several messages (without handles) to a message pipe. See
+// |MojoWriteMessages()| for complete documentation.
+inline MojoResult WriteMessagesRaw(MessagePipeHandle message_pipe,
+                                   const void* bytes,
+                                   const uint32_t* message_num_bytes,
+                                   uint32_t num_messages,
+                                   uint32_t* num_messages_written,
+                                   MojoWriteMessageFlags flags) {
+  return MojoWriteMessages(message_pipe.value(), bytes, message_num_bytes,
+                           num_messages, num_messages_written, flags);
+}
+
+// Reads several messages from a message pipe. See |MojoReadMessages()| for
+// complete documentation.
+inline MojoResult ReadMessagesRaw(MessagePipeHandle message_pipe,
+                                  void* bytes,
+                                  uint32_t* num_bytes,
+                                  MojoHandle* handles,
+                                  uint32_t* num_handles,
+                                  uint32_t* message_num_bytes,
+                                  uint32_t* message_num_handles,
+                                  uint32_t* num_messages,
+                                  MojoReadMessageFlags flags) {
+  return MojoReadMessages(message_pipe.value(), bytes, num_bytes, handles,
+                          num_handles, message_num_bytes, message_num_handles,
+                          num_messages, flags);
+}
+
 // A wrapper class that automatically creates a message pipe and owns both
 // handles.
 class MessagePipe {
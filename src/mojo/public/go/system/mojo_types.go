@@ -73,6 +73,7 @@ const (
 	MOJO_CREATE_SHARED_BUFFER_OPTIONS_FLAG_NONE    MojoCreateSharedBufferOptionsFlags    = 0
 	MOJO_DUPLICATE_BUFFER_HANDLE_OPTIONS_FLAG_NONE MojoDuplicateBufferHandleOptionsFlags = 0
 	MOJO_MAP_BUFFER_FLAG_NONE                      MojoMapBufferFlags                    = 0
+	MOJO_MAP_BUFFER_FLAG_READ_ONLY                 MojoMapBufferFlags                    = 1 << 0
 	MOJO_BUFFER_INFORMATION_FLAG_NONE              MojoBufferInformationFlags            = 0
 )
 
@@ -493,7 +493,7 @@ std::mutex HandleWatcher::handle_watcher_threads_mutex_;
 
 // Create a message pipe for communication and spawns a handle watcher thread.
 MojoHandle HandleWatcher::Start() {
-  MojoCreateMessagePipeOptions options;
+  MojoCreateMessagePipeOptions options = {};
   options.struct_size = sizeof(MojoCreateMessagePipeOptions);
   options.flags = MOJO_CREATE_MESSAGE_PIPE_OPTIONS_FLAG_NONE;
 
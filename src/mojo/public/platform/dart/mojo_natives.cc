@@ -553,7 +553,7 @@ void MojoMessagePipe_Create(Dart_NativeArguments arguments) {
   int64_t flags = 0;
   CHECK_INTEGER_ARGUMENT(arguments, 0, &flags, Null);
 
-  MojoCreateMessagePipeOptions options;
+  MojoCreateMessagePipeOptions options = {};
   options.struct_size = sizeof(MojoCreateMessagePipeOptions);
   options.flags = static_cast<MojoCreateMessagePipeOptionsFlags>(flags);
 
@@ -148,6 +148,78 @@ MojoResult MojoReadMessage(MojoHandle message_pipe_handle,
                                    handles, num_handles, flags);
 }
 
+// The two-phase message read functions are not (yet) part of the IRT
+// interface. Callers are expected to fall back to |MojoReadMessage()|.
+MojoResult MojoBeginReadMessage(MojoHandle message_pipe_handle,
+                                void** buffer,
+                                uint32_t* buffer_num_bytes,
+                                MojoHandle* handles,
+                                uint32_t* num_handles,
+                                MojoReadMessageFlags flags) {
+  return MOJO_RESULT_UNIMPLEMENTED;
+}
+
+MojoResult MojoEndReadMessage(MojoHandle message_pipe_handle) {
+  return MOJO_RESULT_UNIMPLEMENTED;
+}
+
+// Likewise for the batched message functions. Callers are expected to fall
+// back to |MojoWriteMessage()|/|MojoReadMessage()|.
+MojoResult MojoWriteMessages(MojoHandle message_pipe_handle,
+                             const void* bytes,
+                             const uint32_t* message_num_bytes,
+                             uint32_t num_messages,
+                             uint32_t* num_messages_written,
+                             MojoWriteMessageFlags flags) {
+  return MOJO_RESULT_UNIMPLEMENTED;
+}
+
+MojoResult MojoReadMessages(MojoHandle message_pipe_handle,
+                            void* bytes,
+                            uint32_t* num_bytes,
+                            MojoHandle* handles,
+                            uint32_t* num_handles,
+                            uint32_t* message_num_bytes,
+                            uint32_t* message_num_handles,
+                            uint32_t* num_messages,
+                            MojoReadMessageFlags flags) {
+  return MOJO_RESULT_UNIMPLEMENTED;
+}
+
+// Likewise for the data pipe span and vectored functions. Callers are expected
+// to fall back to the single-buffer functions.
+MojoResult MojoBeginWriteDataSpans(MojoHandle data_pipe_producer_handle,
+                                   void** buffers,
+                                   uint32_t* buffers_num_bytes,
+                                   MojoWriteDataFlags flags) {
+  return MOJO_RESULT_UNIMPLEMENTED;
+}
+
+MojoResult MojoWriteDataV(MojoHandle data_pipe_producer_handle,
+                          const void* const* buffers,
+                          const uint32_t* buffers_num_bytes,
+                          uint32_t num_buffers,
+                          uint32_t* num_bytes_written,
+                          MojoWriteDataFlags flags) {
+  return MOJO_RESULT_UNIMPLEMENTED;
+}
+
+MojoResult MojoBeginReadDataSpans(MojoHandle data_pipe_consumer_handle,
+                                  const void** buffers,
+                                  uint32_t* buffers_num_bytes,
+                                  MojoReadDataFlags flags) {
+  return MOJO_RESULT_UNIMPLEMENTED;
+}
+
+MojoResult MojoReadDataV(MojoHandle data_pipe_consumer_handle,
+                         void* const* buffers,
+                         const uint32_t* buffers_num_bytes,
+                         uint32_t num_buffers,
+                         uint32_t* num_bytes_read,
+                         MojoReadDataFlags flags) {
+  return MOJO_RESULT_UNIMPLEMENTED;
+}
+
 MojoResult MojoCreateDataPipe(const struct MojoCreateDataPipeOptions* options,
                               MojoHandle* data_pipe_producer_handle,
                               MojoHandle* data_pipe_consumer_handle) {
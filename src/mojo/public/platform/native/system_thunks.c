@@ -226,6 +226,121 @@ MojoResult MojoUnmapBuffer(void* buffer) {
   return g_thunks.UnmapBuffer(buffer);
 }
 
+MojoResult MojoCreateWaitSet(const struct MojoCreateWaitSetOptions* options,
+                             MojoHandle* handle) {
+  assert(g_thunks.CreateWaitSet);
+  return g_thunks.CreateWaitSet(options, handle);
+}
+
+MojoResult MojoWaitSetAdd(const struct MojoWaitSetAddOptions* options,
+                          MojoHandle wait_set_handle,
+                          MojoHandle handle,
+                          MojoHandleSignals signals,
+                          uint64_t cookie) {
+  assert(g_thunks.WaitSetAdd);
+  return g_thunks.WaitSetAdd(options, wait_set_handle, handle, signals, cookie);
+}
+
+MojoResult MojoWaitSetRemove(MojoHandle wait_set_handle, uint64_t cookie) {
+  assert(g_thunks.WaitSetRemove);
+  return g_thunks.WaitSetRemove(wait_set_handle, cookie);
+}
+
+MojoResult MojoWaitSetWait(MojoHandle wait_set_handle,
+                           MojoDeadline deadline,
+                           uint32_t* num_results,
+                           struct MojoWaitSetResult* results,
+                           uint32_t* max_results) {
+  assert(g_thunks.WaitSetWait);
+  return g_thunks.WaitSetWait(wait_set_handle, deadline, num_results, results,
+                              max_results);
+}
+
+MojoResult MojoBeginReadMessage(MojoHandle message_pipe_handle,
+                                void** buffer,
+                                uint32_t* buffer_num_bytes,
+                                MojoHandle* handles,
+                                uint32_t* num_handles,
+                                MojoReadMessageFlags flags) {
+  assert(g_thunks.BeginReadMessage);
+  return g_thunks.BeginReadMessage(message_pipe_handle, buffer,
+                                   buffer_num_bytes, handles, num_handles,
+                                   flags);
+}
+
+MojoResult MojoEndReadMessage(MojoHandle message_pipe_handle) {
+  assert(g_thunks.EndReadMessage);
+  return g_thunks.EndReadMessage(message_pipe_handle);
+}
+
+MojoResult MojoWriteMessages(MojoHandle message_pipe_handle,
+                             const void* bytes,
+                             const uint32_t* message_num_bytes,
+                             uint32_t num_messages,
+                             uint32_t* num_messages_written,
+                             MojoWriteMessageFlags flags) {
+  assert(g_thunks.WriteMessages);
+  return g_thunks.WriteMessages(message_pipe_handle, bytes, message_num_bytes,
+                                num_messages, num_messages_written, flags);
+}
+
+MojoResult MojoReadMessages(MojoHandle message_pipe_handle,
+                            void* bytes,
+                            uint32_t* num_bytes,
+                            MojoHandle* handles,
+                            uint32_t* num_handles,
+                            uint32_t* message_num_bytes,
+                            uint32_t* message_num_handles,
+                            uint32_t* num_messages,
+                            MojoReadMessageFlags flags) {
+  assert(g_thunks.ReadMessages);
+  return g_thunks.ReadMessages(message_pipe_handle, bytes, num_bytes, handles,
+                               num_handles, message_num_bytes,
+                               message_num_handles, num_messages, flags);
+}
+
+MojoResult MojoBeginWriteDataSpans(MojoHandle data_pipe_producer_handle,
+                                   void** buffers,
+                                   uint32_t* buffers_num_bytes,
+                                   MojoWriteDataFlags flags) {
+  assert(g_thunks.BeginWriteDataSpans);
+  return g_thunks.BeginWriteDataSpans(data_pipe_producer_handle, buffers,
+                                      buffers_num_bytes, flags);
+}
+
+MojoResult MojoWriteDataV(MojoHandle data_pipe_producer_handle,
+                          const void* const* buffers,
+                          const uint32_t* buffers_num_bytes,
+                          uint32_t num_buffers,
+                          uint32_t* num_bytes_written,
+                          MojoWriteDataFlags flags) {
+  assert(g_thunks.WriteDataV);
+  return g_thunks.WriteDataV(data_pipe_producer_handle, buffers,
+                             buffers_num_bytes, num_buffers, num_bytes_written,
+                             flags);
+}
+
+MojoResult MojoBeginReadDataSpans(MojoHandle data_pipe_consumer_handle,
+                                  const void** buffers,
+                                  uint32_t* buffers_num_bytes,
+                                  MojoReadDataFlags flags) {
+  assert(g_thunks.BeginReadDataSpans);
+  return g_thunks.BeginReadDataSpans(data_pipe_consumer_handle, buffers,
+                                     buffers_num_bytes, flags);
+}
+
+MojoResult MojoReadDataV(MojoHandle data_pipe_consumer_handle,
+                         void* const* buffers,
+                         const uint32_t* buffers_num_bytes,
+                         uint32_t num_buffers,
+                         uint32_t* num_bytes_read,
+                         MojoReadDataFlags flags) {
+  assert(g_thunks.ReadDataV);
+  return g_thunks.ReadDataV(data_pipe_consumer_handle, buffers,
+                            buffers_num_bytes, num_buffers, num_bytes_read,
+                            flags);
+}
+
 THUNK_EXPORT size_t
 MojoSetSystemThunks(const struct MojoSystemThunks* system_thunks) {
   if (system_thunks->size >= sizeof(g_thunks))
@@ -16,6 +16,7 @@
 #include "mojo/public/c/system/result.h"
 #include "mojo/public/c/system/time.h"
 #include "mojo/public/c/system/wait.h"
+#include "mojo/public/c/system/wait_set.h"
 
 // The embedder needs to bind the basic Mojo Core functions of a DSO to those of
 // the embedder when loading a DSO that is dependent on mojo_system.
@@ -136,6 +137,61 @@ struct MojoSystemThunks {
       MojoHandle handle,
       MojoHandleRights rights_to_remove,
       MojoHandle* replacement_handle);
+  MojoResult (*CreateWaitSet)(const struct MojoCreateWaitSetOptions* options,
+                              MojoHandle* handle);
+  MojoResult (*WaitSetAdd)(const struct MojoWaitSetAddOptions* options,
+                           MojoHandle wait_set_handle,
+                           MojoHandle handle,
+                           MojoHandleSignals signals,
+                           uint64_t cookie);
+  MojoResult (*WaitSetRemove)(MojoHandle wait_set_handle, uint64_t cookie);
+  MojoResult (*WaitSetWait)(MojoHandle wait_set_handle,
+                            MojoDeadline deadline,
+                            uint32_t* num_results,
+                            struct MojoWaitSetResult* results,
+                            uint32_t* max_results);
+  MojoResult (*BeginReadMessage)(MojoHandle message_pipe_handle,
+                                 void** buffer,
+                                 uint32_t* buffer_num_bytes,
+                                 MojoHandle* handles,
+                                 uint32_t* num_handles,
+                                 MojoReadMessageFlags flags);
+  MojoResult (*EndReadMessage)(MojoHandle message_pipe_handle);
+  MojoResult (*WriteMessages)(MojoHandle message_pipe_handle,
+                              const void* bytes,
+                              const uint32_t* message_num_bytes,
+                              uint32_t num_messages,
+                              uint32_t* num_messages_written,
+                              MojoWriteMessageFlags flags);
+  MojoResult (*ReadMessages)(MojoHandle message_pipe_handle,
+                             void* bytes,
+                             uint32_t* num_bytes,
+                             MojoHandle* handles,
+                             uint32_t* num_handles,
+                             uint32_t* message_num_bytes,
+                             uint32_t* message_num_handles,
+                             uint32_t* num_messages,
+                             MojoReadMessageFlags flags);
+  MojoResult (*BeginWriteDataSpans)(MojoHandle data_pipe_producer_handle,
+                                    void** buffers,
+                                    uint32_t* buffers_num_bytes,
+                                    MojoWriteDataFlags flags);
+  MojoResult (*WriteDataV)(MojoHandle data_pipe_producer_handle,
+                           const void* const* buffers,
+                           const uint32_t* buffers_num_bytes,
+                           uint32_t num_buffers,
+                           uint32_t* num_bytes_written,
+                           MojoWriteDataFlags flags);
+  MojoResult (*BeginReadDataSpans)(MojoHandle data_pipe_consumer_handle,
+                                   const void** buffers,
+                                   uint32_t* buffers_num_bytes,
+                                   MojoReadDataFlags flags);
+  MojoResult (*ReadDataV)(MojoHandle data_pipe_consumer_handle,
+                          void* const* buffers,
+                          const uint32_t* buffers_num_bytes,
+                          uint32_t num_buffers,
+                          uint32_t* num_bytes_read,
+                          MojoReadDataFlags flags);
 };
 #pragma pack(pop)
 
@@ -173,6 +229,18 @@ inline MojoSystemThunks MojoMakeSystemThunks() {
       MojoDuplicateHandleWithReducedRights,
       MojoDuplicateHandle,
       MojoReplaceHandleWithReducedRights,
+      MojoCreateWaitSet,
+      MojoWaitSetAdd,
+      MojoWaitSetRemove,
+      MojoWaitSetWait,
+      MojoBeginReadMessage,
+      MojoEndReadMessage,
+      MojoWriteMessages,
+      MojoReadMessages,
+      MojoBeginWriteDataSpans,
+      MojoWriteDataV,
+      MojoBeginReadDataSpans,
+      MojoReadDataV,
   };
   return system_thunks;
 }
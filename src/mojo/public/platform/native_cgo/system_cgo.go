@@ -223,6 +223,8 @@ func (c *CGoSystem) CreateMessagePipe(flags uint32) (uint32, uint32, uint32) {
 	opts = &C.struct_MojoCreateMessagePipeOptions{
 		C.uint32_t(unsafe.Sizeof(*opts)),
 		C.MojoCreateMessagePipeOptionsFlags(flags),
+		0,
+		0,
 	}
 	r := C.CreateMessagePipe(opts, &handle0, &handle1)
 	return uint32(r), uint32(handle0), uint32(handle1)
@@ -107,14 +107,15 @@ def GetCppPodType(kind):
 def GetCppArrayArgWrapperType(kind):
   if mojom.IsEnumKind(kind):
     return GetNameForKind(kind)
-  if (mojom.IsStructKind(kind) or mojom.IsUnionKind(kind) or
-      mojom.IsInterfaceKind(kind)):
+  if mojom.IsStructKind(kind) or mojom.IsUnionKind(kind):
     return "%sPtr" % GetNameForKind(kind)
   if mojom.IsArrayKind(kind):
     return "mojo::Array<%s> " % GetCppArrayArgWrapperType(kind.kind)
   if mojom.IsMapKind(kind):
     return "mojo::Map<%s, %s> " % (GetCppArrayArgWrapperType(kind.key_kind),
                                    GetCppArrayArgWrapperType(kind.value_kind))
+  if mojom.IsInterfaceKind(kind):
+    return "mojo::InterfaceHandle<%s>" % GetNameForKind(kind)
   if mojom.IsInterfaceRequestKind(kind):
     return "mojo::InterfaceRequest<%s>" % GetNameForKind(kind.kind)
   if mojom.IsStringKind(kind):
@@ -250,6 +251,47 @@ def GetCppUnionFieldType(kind):
         GetNameForKind(kind, internal=True))
   return GetCppFieldType(kind)
 
+def IsDataViewArrayKind(kind):
+  """Returns whether generated data views expose |kind| directly as a
+  |mojo::ArrayDataView|, i.e., whether it is an array of numbers or bools."""
+  return mojom.IsArrayKind(kind) and mojom.IsNumericalKind(kind.kind)
+
+def HasDataViewGetter(kind):
+  return (mojom.IsStringKind(kind) or mojom.IsStructKind(kind) or
+          IsDataViewArrayKind(kind))
+
+def GetDataViewType(kind):
+  if mojom.IsStringKind(kind):
+    return "mojo::StringDataView"
+  if IsDataViewArrayKind(kind):
+    return "mojo::ArrayDataView<%s>" % GetCppTypeForKind(kind.kind)
+  if mojom.IsStructKind(kind):
+    return "%sDataView" % GetNameForKind(kind)
+  raise Exception("No data view for kind %s" % kind.spec)
+
+def GetDataViewAccessorSuffix(field):
+  # Unlike |generator.UnderToCamel()|, this leaves the case of the rest of each
+  # word alone, so that "some_fieldName" becomes "SomeFieldName".
+  return "".join(word[0].upper() + word[1:]
+                 for word in field.name.split("_") if word)
+
+def UsesDataView(method):
+  """Returns whether the stub hands requests for |method| to the
+  implementation as a data view (see the CppDataView attribute)."""
+  return bool(method.attributes and method.attributes.get("CppDataView"))
+
+def UsesArena(interface):
+  """Returns whether the stub for |interface| deserializes requests using an
+  arena (see the CppArena attribute)."""
+  return bool(interface.attributes and interface.attributes.get("CppArena"))
+
+def UsesFusedValidation(interface):
+  """Returns whether the stub (and proxy) for |interface| validate and
+  deserialize incoming messages in a single pass instead of validating them
+  up front (see the CppFusedValidation attribute)."""
+  return bool(interface.attributes and
+              interface.attributes.get("CppFusedValidation"))
+
 def GetUnionGetterReturnType(kind):
   if (mojom.IsStructKind(kind) or mojom.IsUnionKind(kind) or
       mojom.IsArrayKind(kind) or mojom.IsMapKind(kind) or
@@ -341,6 +383,12 @@ def ShouldInlineStruct(struct):
       return False
   return True
 
+def IsPointerFreeStruct(struct):
+  """Returns whether the serialized form of |struct| is a fixed-size block with
+  no pointers or handles, i.e., all its fields are numbers, bools or enums."""
+  return all(mojom.IsNumericalKind(field.kind) or mojom.IsEnumKind(field.kind)
+             for field in struct.fields)
+
 def ShouldInlineUnion(union):
   return not any(mojom.IsMoveOnlyKind(field.kind) for field in union.fields)
 
@@ -389,6 +437,8 @@ class Generator(generator.Generator):
     "cpp_type": GetCppType,
     "cpp_union_getter_return_type": GetUnionGetterReturnType,
     "cpp_wrapper_type": GetCppWrapperType,
+    "data_view_accessor_suffix": GetDataViewAccessorSuffix,
+    "data_view_type": GetDataViewType,
     "default_value": DefaultValue,
     "expression_to_text": ExpressionToText,
     "get_array_validate_params_ctor_args": GetArrayValidateParamsCtorArgs,
@@ -396,6 +446,7 @@ class Generator(generator.Generator):
     "get_name_for_kind": GetNameForKind,
     "get_pad": pack.GetPad,
     "has_callbacks": mojom.HasCallbacks,
+    "has_data_view_getter": HasDataViewGetter,
     "should_inline": ShouldInlineStruct,
     "should_inline_union": ShouldInlineUnion,
     "is_array_kind": mojom.IsArrayKind,
@@ -409,6 +460,7 @@ class Generator(generator.Generator):
     "is_map_kind": mojom.IsMapKind,
     "is_nullable_kind": mojom.IsNullableKind,
     "is_object_kind": mojom.IsObjectKind,
+    "is_pointer_free_struct": IsPointerFreeStruct,
     "is_string_kind": mojom.IsStringKind,
     "is_struct_kind": mojom.IsStructKind,
     "is_union_kind": mojom.IsUnionKind,
@@ -416,6 +468,9 @@ class Generator(generator.Generator):
     "stylize_method": generator.StudlyCapsToCamel,
     "to_all_caps": generator.CamelCaseToAllCaps,
     "under_to_camel": generator.UnderToCamel,
+    "uses_arena": UsesArena,
+    "uses_fused_validation": UsesFusedValidation,
+    "uses_data_view": UsesDataView,
   }
 
   def GetJinjaExports(self):
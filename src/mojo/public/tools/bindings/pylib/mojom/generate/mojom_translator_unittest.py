@@ -651,6 +651,8 @@ class TestUserDefinedTypeFromMojom(unittest.TestCase):
         min_version=6,
         decl_data=mojom_types_mojom.DeclarationData(
           short_name='AMethod',
+          attributes=[mojom_types_mojom.Attribute(key='CppDataView',
+            value=mojom_types_mojom.LiteralValue(bool_value=True))],
           source_file_info=mojom_types_mojom.SourceFileInfo(
             file_name=file_name)))
 
@@ -682,6 +684,7 @@ class TestUserDefinedTypeFromMojom(unittest.TestCase):
     self.assertEquals(interface, method.interface)
     self.assertEquals(mojom_method.ordinal, method.ordinal)
     self.assertEquals(mojom_method.min_version, method.min_version)
+    self.assertEquals({'CppDataView': True}, method.attributes)
     self.assertIsNone(method.response_parameters)
     self.assertEquals(
         len(mojom_method.parameters.fields), len(method.parameters))
@@ -79,18 +79,25 @@ void Connection::SendResponse(HttpResponsePtr response) {
 }
 
 void Connection::OnRequestDataReady(MojoResult result) {
-  uint32_t num_bytes = 0;
-  result =
-      ReadDataRaw(receiver_.get(), NULL, &num_bytes, MOJO_READ_DATA_FLAG_QUERY);
-  if (!num_bytes)
+  // Hand everything available to the parser directly from the data pipe's
+  // buffer (in up to two spans, if the data wraps around). Data pipes that
+  // can't provide spans still support a single two-phase read.
+  const void* buffers[2] = {};
+  uint32_t buffers_num_bytes[2] = {};
+  result = BeginReadDataSpansRaw(receiver_.get(), buffers, buffers_num_bytes,
+                                 MOJO_READ_DATA_FLAG_NONE);
+  if (result == MOJO_RESULT_UNIMPLEMENTED) {
+    result = BeginReadDataRaw(receiver_.get(), &buffers[0],
+                              &buffers_num_bytes[0], MOJO_READ_DATA_FLAG_NONE);
+  }
+  if (result != MOJO_RESULT_OK)
     return;
 
-  scoped_ptr<uint8_t[]> buffer(new uint8_t[num_bytes]);
-  result = ReadDataRaw(receiver_.get(), buffer.get(), &num_bytes,
-                       MOJO_READ_DATA_FLAG_ALL_OR_NONE);
-
-  request_parser_.ProcessChunk(
-      base::StringPiece(reinterpret_cast<char*>(buffer.get()), num_bytes));
+  for (size_t i = 0; i < 2; i++) {
+    request_parser_.ProcessChunk(base::StringPiece(
+        static_cast<const char*>(buffers[i]), buffers_num_bytes[i]));
+  }
+  EndReadDataRaw(receiver_.get(), buffers_num_bytes[0] + buffers_num_bytes[1]);
   if (request_parser_.ParseRequest() == HttpRequestParser::ACCEPTED) {
     handle_request_callback_.Run(this, request_parser_.GetRequest());
   }
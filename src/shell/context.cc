@@ -24,6 +24,7 @@
 #include "mojo/common/trace_provider_impl.h"
 #include "mojo/common/tracing_impl.h"
 #include "mojo/edk/embedder/embedder.h"
+#include "mojo/edk/embedder/ipc_stats.h"
 #include "mojo/edk/embedder/multiprocess_embedder.h"
 #include "mojo/edk/embedder/simple_platform_support.h"
 #include "mojo/public/cpp/application/connect.h"
@@ -191,6 +192,45 @@ void InitNativeOptions(ApplicationManager* manager,
       ->new_process_per_connection = true;
 }
 
+// Records the statistics for the IPC channels to other processes (see
+// mojo/edk/embedder/ipc_stats.h) as trace counters, both totals and per
+// channel (keyed by channel ID).
+void SampleIPCCounters() {
+  std::vector<mojo::embedder::ChannelStats> all_stats;
+  mojo::embedder::GetAllChannelStats(&all_stats);
+
+  mojo::embedder::ChannelStats total = {};
+  for (const auto& stats : all_stats) {
+    total.num_messages_sent += stats.num_messages_sent;
+    total.num_bytes_sent += stats.num_bytes_sent;
+    total.num_messages_received += stats.num_messages_received;
+    total.num_bytes_received += stats.num_bytes_received;
+    total.num_handles_sent += stats.num_handles_sent;
+    total.num_handles_received += stats.num_handles_received;
+    total.num_write_syscalls += stats.num_write_syscalls;
+    total.num_read_syscalls += stats.num_read_syscalls;
+    total.num_bytes_pending_write += stats.num_bytes_pending_write;
+
+    TRACE_COUNTER_ID2("mojo", "IPCChannelBytes", stats.channel_id, "sent",
+                      stats.num_bytes_sent, "received",
+                      stats.num_bytes_received);
+    TRACE_COUNTER_ID1("mojo", "IPCChannelPendingWriteBytes", stats.channel_id,
+                      stats.num_bytes_pending_write);
+  }
+
+  TRACE_COUNTER1("mojo", "IPCChannels", all_stats.size());
+  TRACE_COUNTER2("mojo", "IPCMessages", "sent", total.num_messages_sent,
+                 "received", total.num_messages_received);
+  TRACE_COUNTER2("mojo", "IPCBytes", "sent", total.num_bytes_sent, "received",
+                 total.num_bytes_received);
+  TRACE_COUNTER2("mojo", "IPCHandles", "sent", total.num_handles_sent,
+                 "received", total.num_handles_received);
+  TRACE_COUNTER2("mojo", "IPCSyscalls", "write", total.num_write_syscalls,
+                 "read", total.num_read_syscalls);
+  TRACE_COUNTER1("mojo", "IPCPendingWriteBytes",
+                 total.num_bytes_pending_write);
+}
+
 }  // namespace
 
 Context::Context(Tracer* tracer)
@@ -316,6 +356,7 @@ bool Context::InitWithPaths(
     mojo::InterfaceHandle<tracing::TraceProvider> provider;
     tracer_->ConnectToProvider(GetProxy(&provider));
     registry->RegisterTraceProvider(provider.Pass());
+    tracer_->SetCounterSampler(base::Bind(&SampleIPCCounters));
   }
 
   if (command_line.HasSwitch(switches::kTraceStartup)) {
@@ -331,6 +372,9 @@ bool Context::InitWithPaths(
 void Context::Shutdown() {
   TRACE_EVENT0("mojo_shell", "Context::Shutdown");
   DCHECK(task_runners_->shell_runner()->RunsTasksOnCurrentThread());
+  // The counter sampler uses the IPC support, so stop it first.
+  if (tracer_)
+    tracer_->SetCounterSampler(base::Closure());
   mojo::embedder::ShutdownIPCSupport();
   // We'll quit when we get OnShutdownComplete().
   base::MessageLoop::current()->Run();
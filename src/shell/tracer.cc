@@ -68,6 +68,10 @@ void Tracer::ConnectToProvider(
   trace_provider_impl_.Bind(request.Pass());
 }
 
+void Tracer::SetCounterSampler(const base::Closure& sampler) {
+  trace_provider_impl_.SetCounterSampler(sampler);
+}
+
 void Tracer::StopTracingAndFlushToDisk() {
   tracing_ = false;
   trace_file_ = fopen(trace_filename_.c_str(), "w+");
@@ -53,6 +53,9 @@ class Tracer : public mojo::common::DataPipeDrainer::Client {
   void ConnectToProvider(
       mojo::InterfaceRequest<tracing::TraceProvider> request);
 
+  // See |mojo::TraceProviderImpl::SetCounterSampler()|.
+  void SetCounterSampler(const base::Closure& sampler);
+
  private:
   void StopTracingAndFlushToDisk();
 